@@ -0,0 +1,42 @@
+/*===-- TaffoConvert.c - Array Conversions of the Converted Code ---*- C -*-===*
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * The arrays are not restrict, so the compiler vectorizes the loops behind
+ * a check of their overlap, and keeps the order of the elements otherwise.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "TaffoConvert.h"
+
+#define TAFFO_CONVERT_DEFINE(fname, ftype, iname, itype) \
+  void taffo_fixm_to_fixed_##fname##_##iname(const ftype *in, itype *out, size_t n, ftype scale) \
+  { \
+    size_t i; \
+    for (i = 0; i < n; i++) \
+      out[i] = (itype)(in[i] * scale); \
+  } \
+  void taffo_fixm_from_fixed_##iname##_##fname(const itype *in, ftype *out, size_t n, ftype scale) \
+  { \
+    size_t i; \
+    for (i = 0; i < n; i++) \
+      out[i] = (ftype)in[i] * scale; \
+  }
+
+#define TAFFO_CONVERT_DEFINE_FLOAT(fname, ftype) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, s8, int8_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, u8, uint8_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, s16, int16_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, u16, uint16_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, s32, int32_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, u32, uint32_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, s64, int64_t) \
+  TAFFO_CONVERT_DEFINE(fname, ftype, u64, uint64_t)
+
+TAFFO_CONVERT_DEFINE_FLOAT(f32, float)
+TAFFO_CONVERT_DEFINE_FLOAT(f64, double)
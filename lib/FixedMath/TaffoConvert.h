@@ -0,0 +1,58 @@
+/*===-- TaffoConvert.h - Array Conversions of the Converted Code ---*- C -*-===*
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * Called in place of the loops which convert whole arrays between floating
+ * point and fixed point at the boundaries of the converted code, as found
+ * by taffo -vectorize-boundaries.
+ *
+ * taffo_fixm_to_fixed_<float>_<int> stores in out[i] the conversion to int
+ * (truncating toward zero, like fptosi and fptoui) of in[i] * scale, and
+ * taffo_fixm_from_fixed_<int>_<float> stores in out[i] the conversion of
+ * in[i] to float times scale, for i from 0 to n - 1 in order; <float> is
+ * f32 or f64, <int> is s8, u8, s16, u16, s32, u32, s64 or u64. The arrays
+ * may overlap like in the loops they replace. The loops are vectorized by
+ * the compiler of the runtime when the arrays do not overlap.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#ifndef TAFFO_CONVERT_H
+#define TAFFO_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAFFO_CONVERT_DECLARE(fname, ftype, iname, itype) \
+  void taffo_fixm_to_fixed_##fname##_##iname(const ftype *in, itype *out, size_t n, ftype scale); \
+  void taffo_fixm_from_fixed_##iname##_##fname(const itype *in, ftype *out, size_t n, ftype scale);
+
+#define TAFFO_CONVERT_DECLARE_FLOAT(fname, ftype) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, s8, int8_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, u8, uint8_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, s16, int16_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, u16, uint16_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, s32, int32_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, u32, uint32_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, s64, int64_t) \
+  TAFFO_CONVERT_DECLARE(fname, ftype, u64, uint64_t)
+
+TAFFO_CONVERT_DECLARE_FLOAT(f32, float)
+TAFFO_CONVERT_DECLARE_FLOAT(f64, double)
+
+#undef TAFFO_CONVERT_DECLARE_FLOAT
+#undef TAFFO_CONVERT_DECLARE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,257 @@
+/*===-- TaffoFixedMath.c - Fixed Point Math Runtime -----------------*- C -*-===*
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * The routines compute on int64_t with 40 fractional bits (Q40), so that
+ * their error before the final rounding is far below the ulp of any 32
+ * bit result.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "TaffoFixedMath.h"
+
+#define Q40_ONE ((int64_t)1 << 40)
+
+/* pi/2 with 92 fractional bits, split in its bits down to the 61st and the
+ * following 31 */
+#define PIO2_Q61 INT64_C(0x3243f6a8885a308d)
+#define PIO2_LO31 INT64_C(0x1898cc51)
+/* 2/pi with 31 fractional bits */
+#define TWO_OVER_PI_Q31 INT64_C(1367130551)
+/* log2(e) with 62 fractional bits, split in its bits down to the 31st and
+ * the following 31 */
+#define LOG2E_HI31 (INT64_C(0x5c551d94ae0bf85e) >> 31)
+#define LOG2E_LO31 (INT64_C(0x5c551d94ae0bf85e) & 0x7fffffff)
+#define LN2_Q40 INT64_C(762123384786)
+/* product of 1 / sqrt(1 + 2^-2i) over the CORDIC iterations */
+#define CORDIC_GAIN_Q40 INT64_C(667681663043)
+#define CORDIC_ITERATIONS 40
+
+/* atan(2^-i) */
+static const int64_t fixm_atan_q40[CORDIC_ITERATIONS] = {
+  INT64_C(863554413089), INT64_C(509785937287), INT64_C(269356888665),
+  INT64_C(136729762476), INT64_C(68630207382), INT64_C(34348560106),
+  INT64_C(17178471287), INT64_C(8589759836), INT64_C(4294945451),
+  INT64_C(2147480917), INT64_C(1073741483), INT64_C(536870869),
+  INT64_C(268435451), INT64_C(134217727), INT64_C(67108864),
+  INT64_C(33554432), INT64_C(16777216), INT64_C(8388608), INT64_C(4194304),
+  INT64_C(2097152), INT64_C(1048576), INT64_C(524288), INT64_C(262144),
+  INT64_C(131072), INT64_C(65536), INT64_C(32768), INT64_C(16384),
+  INT64_C(8192), INT64_C(4096), INT64_C(2048), INT64_C(1024), INT64_C(512),
+  INT64_C(256), INT64_C(128), INT64_C(64), INT64_C(32), INT64_C(16),
+  INT64_C(8), INT64_C(4), INT64_C(2)
+};
+
+/* 1/k!, for the Taylor series of e^y on [0, ln(2)) */
+#define EXP_TERMS 15
+static const int64_t fixm_exp_q40[EXP_TERMS] = {
+  INT64_C(1099511627776), INT64_C(1099511627776), INT64_C(549755813888),
+  INT64_C(183251937963), INT64_C(45812984491), INT64_C(9162596898),
+  INT64_C(1527099483), INT64_C(218157069), INT64_C(27269634),
+  INT64_C(3029959), INT64_C(302996), INT64_C(27545), INT64_C(2295),
+  INT64_C(177), INT64_C(13)
+};
+
+/* 1/(2k+1), for the series of atanh(z) / z on [0, 1/3) */
+#define LOG_TERMS 14
+static const int64_t fixm_log_q40[LOG_TERMS] = {
+  INT64_C(1099511627776), INT64_C(366503875925), INT64_C(219902325555),
+  INT64_C(157073089682), INT64_C(122167958642), INT64_C(99955602525),
+  INT64_C(84577817521), INT64_C(73300775185), INT64_C(64677154575),
+  INT64_C(57869033041), INT64_C(52357696561), INT64_C(47804853382),
+  INT64_C(43980465111), INT64_C(40722652881)
+};
+
+
+/* a * b in Q40, for |a| < 2^42 and |b| < 2^42 */
+static int64_t fixm_mul_q40(int64_t a, int64_t b)
+{
+  int64_t bh = b >> 20;
+  int64_t bl = b & ((1 << 20) - 1);
+  return ((a * bh) >> 20) + ((a * bl) >> 40);
+}
+
+/* v, with frac_v fractional bits, rounded to the nearest value with
+ * frac_out fractional bits and saturated to int32_t */
+static int32_t fixm_to_fixed(int64_t v, int frac_v, int frac_out)
+{
+  int shift = frac_v - frac_out;
+  if (shift > 62) {
+    return 0;
+  } else if (shift > 0) {
+    v = ((v >> (shift - 1)) + 1) >> 1;
+  } else if (shift < 0) {
+    if (v == 0)
+      return 0;
+    if (shift < -31)
+      return v > 0 ? INT32_MAX : INT32_MIN;
+    if (v > (INT32_MAX >> -shift))
+      return INT32_MAX;
+    if (v < INT32_MIN / ((int64_t)1 << -shift))
+      return INT32_MIN;
+    v *= (int64_t)1 << -shift;
+  }
+  if (v > INT32_MAX)
+    return INT32_MAX;
+  if (v < INT32_MIN)
+    return INT32_MIN;
+  return (int32_t)v;
+}
+
+static int fixm_msb(uint64_t v)
+{
+  int n = -1;
+  while (v) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+}
+
+/* x = k pi/2 + r, with r in Q40 and |r| <= pi/4 (approximately) */
+static int64_t fixm_reduce_pio2(int32_t x, int frac_in, int64_t *k)
+{
+  int64_t pio2_hi = PIO2_Q61 >> (31 - frac_in);
+  int64_t pio2_lo = ((PIO2_Q61 & (((int64_t)1 << (31 - frac_in)) - 1)) << frac_in) |
+                    (PIO2_LO31 >> (31 - frac_in));
+  /* the remainder has 30 more fractional bits than x */
+  int64_t r;
+  *k = ((int64_t)x * TWO_OVER_PI_Q31 + ((int64_t)1 << (30 + frac_in))) >> (31 + frac_in);
+  r = (int64_t)x * ((int64_t)1 << 30) - *k * pio2_hi - ((*k * pio2_lo) >> 31);
+  return frac_in >= 10 ? r >> (frac_in - 10) : r * ((int64_t)1 << (10 - frac_in));
+}
+
+static void fixm_cordic(int64_t a, int64_t *c, int64_t *s)
+{
+  int64_t x = CORDIC_GAIN_Q40, y = 0;
+  int i;
+  for (i = 0; i < CORDIC_ITERATIONS; i++) {
+    int64_t dx = y >> i, dy = x >> i;
+    if (a >= 0) {
+      x -= dx;
+      y += dy;
+      a -= fixm_atan_q40[i];
+    } else {
+      x += dx;
+      y -= dy;
+      a += fixm_atan_q40[i];
+    }
+  }
+  *c = x;
+  *s = y;
+}
+
+static void fixm_sincos(int32_t x, int frac_in, int64_t *c, int64_t *s)
+{
+  int64_t k, rc, rs;
+  fixm_cordic(fixm_reduce_pio2(x, frac_in, &k), &rc, &rs);
+  switch (k & 3) {
+    case 0: *c = rc; *s = rs; break;
+    case 1: *c = -rs; *s = rc; break;
+    case 2: *c = -rc; *s = -rs; break;
+    default: *c = rs; *s = -rc; break;
+  }
+}
+
+int32_t taffo_fixm_sin(int32_t x, int32_t frac_in, int32_t frac_out)
+{
+  int64_t c, s;
+  fixm_sincos(x, frac_in, &c, &s);
+  return fixm_to_fixed(s, 40, frac_out);
+}
+
+int32_t taffo_fixm_cos(int32_t x, int32_t frac_in, int32_t frac_out)
+{
+  int64_t c, s;
+  fixm_sincos(x, frac_in, &c, &s);
+  return fixm_to_fixed(c, 40, frac_out);
+}
+
+int32_t taffo_fixm_exp(int32_t x, int32_t frac_in, int32_t frac_out)
+{
+  int64_t t, n, y, p;
+  int i, shift, frac_t;
+  /* e^23 > 2^31 and e^-23 < 2^-32 */
+  if ((int64_t)x >= (int64_t)23 << frac_in)
+    return INT32_MAX;
+  if ((int64_t)x <= -((int64_t)23 << frac_in))
+    return 0;
+
+  /* x log2(e) = n + f, with the product by the 62 bits of log2(e) split in
+   * two 31 bit halves; t has frac_t >= 56 fractional bits */
+  shift = frac_in < 26 ? 25 - frac_in : 0;
+  frac_t = frac_in + 31 + shift;
+  t = (int64_t)x * LOG2E_HI31 * ((int64_t)1 << shift) + (((int64_t)x * LOG2E_LO31) >> (31 - shift));
+  n = t >> frac_t;
+  y = fixm_mul_q40((t & (((int64_t)1 << frac_t) - 1)) >> (frac_t - 40), LN2_Q40);
+
+  /* 2^f = e^(f ln(2)) */
+  p = fixm_exp_q40[EXP_TERMS - 1];
+  for (i = EXP_TERMS - 2; i >= 0; i--)
+    p = fixm_exp_q40[i] + fixm_mul_q40(y, p);
+  return fixm_to_fixed(p, 40 - (int)n, frac_out);
+}
+
+int32_t taffo_fixm_log(int32_t x, int32_t frac_in, int32_t frac_out)
+{
+  int msb, i;
+  int64_t m, a, b, q, r, z, z2, p, res;
+  if (x <= 0)
+    return INT32_MIN;
+
+  /* x = m 2^(msb - frac_in), m in [1, 2) */
+  msb = fixm_msb((uint64_t)x);
+  m = (int64_t)x << (40 - msb);
+
+  /* z = (m - 1) / (m + 1) in Q40, by two divisions of 20 bits each */
+  a = m - Q40_ONE;
+  b = m + Q40_ONE;
+  q = (a << 20) / b;
+  r = (a << 20) % b;
+  z = (q << 20) + (r << 20) / b;
+
+  z2 = fixm_mul_q40(z, z);
+  p = fixm_log_q40[LOG_TERMS - 1];
+  for (i = LOG_TERMS - 2; i >= 0; i--)
+    p = fixm_log_q40[i] + fixm_mul_q40(z2, p);
+  res = (int64_t)(msb - frac_in) * LN2_Q40 + 2 * fixm_mul_q40(z, p);
+  return fixm_to_fixed(res, 40, frac_out);
+}
+
+static uint64_t fixm_isqrt(uint64_t n)
+{
+  uint64_t r = 0, b = (uint64_t)1 << 62;
+  while (b > n)
+    b >>= 2;
+  while (b) {
+    if (n >= r + b) {
+      n -= r + b;
+      r = (r >> 1) + b;
+    } else {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+  return r;
+}
+
+int32_t taffo_fixm_sqrt(int32_t x, int32_t frac_in, int32_t frac_out)
+{
+  /* sqrt(x 2^-frac_in) 2^frac_out = sqrt(x 2^e) */
+  int e = 2 * frac_out - frac_in;
+  uint64_t n, r;
+  if (x <= 0)
+    return 0;
+  if (fixm_msb((uint64_t)x) + e >= 62)
+    return INT32_MAX;
+  /* one more bit of the root for the rounding */
+  e += 2;
+  n = e >= 0 ? (uint64_t)x << e : (uint64_t)x >> -e;
+  r = (fixm_isqrt(n) + 1) >> 1;
+  return r > INT32_MAX ? INT32_MAX : (int32_t)r;
+}
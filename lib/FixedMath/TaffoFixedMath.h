@@ -0,0 +1,48 @@
+/*===-- TaffoFixedMath.h - Fixed Point Math Runtime -----------------*- C -*-===*
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * Elementary functions on fixed point values, called by the code converted
+ * by TAFFO in place of the functions of libm.
+ *
+ * The arguments and the results are signed 32 bit integers with frac_in and
+ * frac_out fractional bits (0 to 31). The results are rounded to the
+ * nearest and saturated to the range of int32_t. The error bounds of the
+ * routines are listed in lib/TaffoUtils/FixedMathCalls.cpp.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#ifndef TAFFO_FIXED_MATH_H
+#define TAFFO_FIXED_MATH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* CORDIC, after the reduction of the argument modulo pi/2 */
+int32_t taffo_fixm_sin(int32_t x, int32_t frac_in, int32_t frac_out);
+int32_t taffo_fixm_cos(int32_t x, int32_t frac_in, int32_t frac_out);
+
+/* 2^(x log2(e)), with a polynomial for the fractional part of the
+ * exponent; 0 below -23 */
+int32_t taffo_fixm_exp(int32_t x, int32_t frac_in, int32_t frac_out);
+
+/* e ln(2) + 2 atanh((m - 1) / (m + 1)) with x = m 2^e, m in [1, 2); the
+ * most negative value if x <= 0 */
+int32_t taffo_fixm_log(int32_t x, int32_t frac_in, int32_t frac_out);
+
+/* integer square root; 0 if x < 0 */
+int32_t taffo_fixm_sqrt(int32_t x, int32_t frac_in, int32_t frac_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
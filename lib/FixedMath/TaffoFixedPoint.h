@@ -0,0 +1,204 @@
+//===-- TaffoFixedPoint.h - Fixed Point Types for C++ ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Header-only fixed point types for the code written around the programs
+// converted by TAFFO (I/O, checks, test oracles), in the formats of the
+// taffo.info metadata: fixp<Width, PointPos, Signed> is the FPType of
+// lib/TaffoUtils/InputInfo.h, and sfixp<I, F> / ufixp<I, F> are the types
+// printed as sI_Ffixp / uI_Ffixp by FPType::toString().
+//
+// The values are stored in the narrowest integer of 8, 16, 32 or 64 bits
+// which holds Width bits, and the arithmetic wraps around like the one of
+// the converted code: the sums and the differences modulo 2^Width, the
+// products and the quotients computed with 2 Width bits and truncated. The
+// conversions from floating point truncate toward zero like fptosi, but
+// saturate to the bounds of the format; NaN becomes 0. Requires C++14.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFO_FIXED_POINT_H
+#define TAFFO_FIXED_POINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace taffo {
+
+namespace fixp_detail {
+
+template <unsigned Bits, bool Signed> struct Storage;
+template <> struct Storage<8, true> { typedef int8_t type; };
+template <> struct Storage<8, false> { typedef uint8_t type; };
+template <> struct Storage<16, true> { typedef int16_t type; };
+template <> struct Storage<16, false> { typedef uint16_t type; };
+template <> struct Storage<32, true> { typedef int32_t type; };
+template <> struct Storage<32, false> { typedef uint32_t type; };
+template <> struct Storage<64, true> { typedef int64_t type; };
+template <> struct Storage<64, false> { typedef uint64_t type; };
+#ifdef __SIZEOF_INT128__
+template <> struct Storage<128, true> { typedef __int128 type; };
+template <> struct Storage<128, false> { typedef unsigned __int128 type; };
+#endif
+
+constexpr unsigned storageBits(unsigned Width) {
+  return Width <= 8 ? 8 : Width <= 16 ? 16 : Width <= 32 ? 32 : Width <= 64 ? 64 : 128;
+}
+
+/* 2^Exp, exact for the exponents of the formats */
+constexpr double pow2(int Exp) {
+  double R = 1.0;
+  for (; Exp > 0; Exp--)
+    R *= 2.0;
+  for (; Exp < 0; Exp++)
+    R *= 0.5;
+  return R;
+}
+
+}
+
+template <unsigned Width, unsigned PointPos, bool Signed = true>
+class fixp {
+  static_assert(Width >= 1 && Width <= 64, "the width must be between 1 and 64 bits");
+  static_assert(PointPos < 64, "the point position must be less than 64");
+
+public:
+  typedef typename fixp_detail::Storage<fixp_detail::storageBits(Width), Signed>::type storage_type;
+
+  static constexpr unsigned width = Width;
+  static constexpr unsigned point_pos = PointPos;
+  static constexpr bool is_signed = Signed;
+
+  constexpr fixp() : Bits(0) {}
+
+  /// The value whose representation is B, reduced modulo 2^Width.
+  static constexpr fixp fromBits(storage_type B) {
+    fixp R;
+    R.Bits = wrap(static_cast<uint64_t>(B));
+    return R;
+  }
+
+  static constexpr fixp fromDouble(double X) { return fromBits(saturate(X * scale())); }
+
+  static constexpr fixp min() { return fromBits(minBits()); }
+  static constexpr fixp max() { return fromBits(maxBits()); }
+  /// The smallest positive value, 2^-PointPos.
+  static constexpr fixp epsilon() { return fromBits(1); }
+
+  /// The name of the format in the taffo.info metadata, e.g. s16_16fixp.
+  static std::string name() {
+    return (Signed ? "s" : "u") + std::to_string(static_cast<int>(Width) - static_cast<int>(PointPos)) + "_" +
+           std::to_string(PointPos) + "fixp";
+  }
+
+  constexpr storage_type bits() const { return Bits; }
+  constexpr double toDouble() const { return static_cast<double>(Bits) / scale(); }
+  explicit constexpr operator double() const { return toDouble(); }
+
+  /// This value in the format To, truncated and wrapped around like the
+  /// shifts of the converted code.
+  template <class To> constexpr To convert() const {
+    return To::point_pos >= PointPos
+               ? To::fromBits(static_cast<typename To::storage_type>(static_cast<uint64_t>(Bits)
+                                                                     << (To::point_pos - PointPos)))
+               : To::fromBits(static_cast<typename To::storage_type>(Bits >> (PointPos - To::point_pos)));
+  }
+
+  friend constexpr fixp operator+(fixp A, fixp B) {
+    return fromBits(static_cast<storage_type>(static_cast<uint64_t>(A.Bits) + static_cast<uint64_t>(B.Bits)));
+  }
+  friend constexpr fixp operator-(fixp A, fixp B) {
+    return fromBits(static_cast<storage_type>(static_cast<uint64_t>(A.Bits) - static_cast<uint64_t>(B.Bits)));
+  }
+  friend constexpr fixp operator-(fixp A) { return fixp() - A; }
+  /// The products and the quotients are computed in 2 Width bits: the
+  /// formats wider than 32 bits need __int128.
+  friend constexpr fixp operator*(fixp A, fixp B) {
+    return fromBits(static_cast<storage_type>((static_cast<wide_type<>>(A.Bits) * B.Bits) >> PointPos));
+  }
+  /// The quotient truncated toward zero; B must not be 0.
+  friend constexpr fixp operator/(fixp A, fixp B) {
+    return fromBits(static_cast<storage_type>(static_cast<wide_type<>>(A.Bits) * (wide_type<>(1) << PointPos) / B.Bits));
+  }
+
+  fixp &operator+=(fixp B) { return *this = *this + B; }
+  fixp &operator-=(fixp B) { return *this = *this - B; }
+  fixp &operator*=(fixp B) { return *this = *this * B; }
+  fixp &operator/=(fixp B) { return *this = *this / B; }
+
+  friend constexpr bool operator==(fixp A, fixp B) { return A.Bits == B.Bits; }
+  friend constexpr bool operator!=(fixp A, fixp B) { return A.Bits != B.Bits; }
+  friend constexpr bool operator<(fixp A, fixp B) { return A.Bits < B.Bits; }
+  friend constexpr bool operator<=(fixp A, fixp B) { return A.Bits <= B.Bits; }
+  friend constexpr bool operator>(fixp A, fixp B) { return A.Bits > B.Bits; }
+  friend constexpr bool operator>=(fixp A, fixp B) { return A.Bits >= B.Bits; }
+
+private:
+  /* a template, so that it is only required by the products and the
+   * quotients */
+  template <unsigned W = Width>
+  using wide_type = typename fixp_detail::Storage<fixp_detail::storageBits(2 * W), Signed>::type;
+
+  storage_type Bits;
+
+  static constexpr double scale() { return fixp_detail::pow2(PointPos); }
+
+  static constexpr uint64_t mask() { return Width == 64 ? ~uint64_t(0) : (uint64_t(1) << Width) - 1; }
+
+  static constexpr storage_type minBits() {
+    return Signed ? static_cast<storage_type>(~(mask() >> 1)) : storage_type(0);
+  }
+  static constexpr storage_type maxBits() { return static_cast<storage_type>(Signed ? mask() >> 1 : mask()); }
+
+  /* the low Width bits of V, sign extended if the format is signed */
+  static constexpr storage_type wrap(uint64_t V) {
+    return static_cast<storage_type>(Signed && ((V >> (Width - 1)) & 1) ? V | ~mask() : V & mask());
+  }
+
+  /* the bits of the scaled value S, saturated to the bounds of the format;
+   * the comparisons are done on the exact bounds, since the maximum of the
+   * formats wider than 53 bits is not a double */
+  static constexpr storage_type saturate(double S) {
+    return S != S ? storage_type(0)
+           : !(S > fixp_detail::pow2(Width - 1) * (Signed ? -1.0 : 0.0)) ? minBits()
+           : S >= fixp_detail::pow2(Signed ? Width - 1 : Width) ? maxBits()
+           : static_cast<storage_type>(S);
+  }
+};
+
+template <unsigned Width, unsigned PointPos, bool Signed> constexpr unsigned fixp<Width, PointPos, Signed>::width;
+template <unsigned Width, unsigned PointPos, bool Signed> constexpr unsigned fixp<Width, PointPos, Signed>::point_pos;
+template <unsigned Width, unsigned PointPos, bool Signed> constexpr bool fixp<Width, PointPos, Signed>::is_signed;
+
+/// The formats as printed by FPType::toString(): sfixp<16, 16> is the
+/// 32 bit s16_16fixp.
+template <unsigned IntBits, unsigned FracBits> using sfixp = fixp<IntBits + FracBits, FracBits, true>;
+template <unsigned IntBits, unsigned FracBits> using ufixp = fixp<IntBits + FracBits, FracBits, false>;
+
+/// Convert N floating point values to the representation of the format
+/// Fixp, as fixp::fromDouble. The loop has no branches, so that the
+/// compiler can vectorize it.
+template <class Fixp, class Float>
+void toFixedArray(const Float *In, typename Fixp::storage_type *Out, size_t N) {
+  for (size_t I = 0; I < N; I++)
+    Out[I] = Fixp::fromDouble(In[I]).bits();
+}
+
+/// Convert N values in the representation of the format Fixp to floating
+/// point, as fixp::toDouble.
+template <class Fixp, class Float>
+void fromFixedArray(const typename Fixp::storage_type *In, Float *Out, size_t N) {
+  const Float Scale = static_cast<Float>(1.0 / fixp_detail::pow2(Fixp::point_pos));
+  for (size_t I = 0; I < N; I++)
+    Out[I] = static_cast<Float>(In[I]) * Scale;
+}
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*===-- TaffoOverflow.c - Overflow Reports of the Converted Code ---*- C -*-===*
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * The locations are identified by the address of their string, in a fixed
+ * size table; the overflows of the locations which do not fit are printed
+ * each time. The converted code may run on several threads (OpenMP), so
+ * the table and the log are only accessed with the __atomic builtins: a
+ * slot is claimed by the thread which sets its location, and the other
+ * threads wait for it to store the first value before updating it.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "TaffoOverflow.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define OVERFLOW_SITES 1024
+
+struct overflow_site {
+  const char *location;
+  int ready;
+  unsigned long count;
+  double min;
+  double max;
+};
+
+static struct overflow_site overflow_sites[OVERFLOW_SITES];
+static FILE *overflow_log;
+/* 0 until the log is being opened, 1 while it is, 2 once it is open */
+static int overflow_log_state;
+
+static void overflow_summary(void)
+{
+  unsigned i;
+  for (i = 0; i < OVERFLOW_SITES; i++) {
+    struct overflow_site *site = &overflow_sites[i];
+    double min, max;
+    if (!__atomic_load_n(&site->ready, __ATOMIC_ACQUIRE))
+      continue;
+    __atomic_load(&site->min, &min, __ATOMIC_RELAXED);
+    __atomic_load(&site->max, &max, __ATOMIC_RELAXED);
+    fprintf(overflow_log, "taffo: %s: %lu overflows, values in [%g, %g]\n",
+            site->location, __atomic_load_n(&site->count, __ATOMIC_RELAXED), min, max);
+  }
+  if (overflow_log != stderr)
+    fclose(overflow_log);
+}
+
+static FILE *overflow_get_log(void)
+{
+  int state = 0;
+  if (__atomic_compare_exchange_n(&overflow_log_state, &state, 1, 0, __ATOMIC_ACQUIRE,
+                                  __ATOMIC_ACQUIRE)) {
+    const char *name = getenv("TAFFO_OVERFLOW_LOG");
+    FILE *log = name ? fopen(name, "a") : NULL;
+    if (!log)
+      log = stderr;
+    overflow_log = log;
+    atexit(overflow_summary);
+    __atomic_store_n(&overflow_log_state, 2, __ATOMIC_RELEASE);
+  } else {
+    while (__atomic_load_n(&overflow_log_state, __ATOMIC_ACQUIRE) != 2)
+      ;
+  }
+  return overflow_log;
+}
+
+/* *bound = value, if value is below (above when greater) *bound */
+static void overflow_update_bound(double *bound, double value, int greater)
+{
+  double old;
+  __atomic_load(bound, &old, __ATOMIC_RELAXED);
+  while (greater ? value > old : value < old) {
+    if (__atomic_compare_exchange(bound, &old, &value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      break;
+  }
+}
+
+void taffo_fixm_overflow(const char *location, double value)
+{
+  unsigned i, start;
+  FILE *log = overflow_get_log();
+
+  start = (unsigned)(((uintptr_t)location >> 3) % OVERFLOW_SITES);
+  for (i = 0; i < OVERFLOW_SITES; i++) {
+    struct overflow_site *site = &overflow_sites[(start + i) % OVERFLOW_SITES];
+    const char *other = NULL;
+    if (__atomic_compare_exchange_n(&site->location, &other, location, 0, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED)) {
+      site->count = 1;
+      site->min = value;
+      site->max = value;
+      __atomic_store_n(&site->ready, 1, __ATOMIC_RELEASE);
+      break;
+    }
+    if (other == location) {
+      while (!__atomic_load_n(&site->ready, __ATOMIC_ACQUIRE))
+        ;
+      __atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+      overflow_update_bound(&site->min, value, 0);
+      overflow_update_bound(&site->max, value, 1);
+      return;
+    }
+  }
+  fprintf(log, "taffo: overflow at %s: %g\n", location, value);
+}
@@ -0,0 +1,35 @@
+/*===-- TaffoOverflow.h - Overflow Reports of the Converted Code ---*- C -*-===*
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * Called by the overflow checks inserted by taffo -overflow-checks in the
+ * converted code.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#ifndef TAFFO_OVERFLOW_H
+#define TAFFO_OVERFLOW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Records that the fixed point operation at location (a string constant of
+ * the instrumented code) overflowed, with value its exact result. The first
+ * overflow of each location is printed immediately, and at exit the number
+ * of overflows and the range of the values of each location are printed.
+ * The reports go to the standard error, or are appended to the file named
+ * by the TAFFO_OVERFLOW_LOG environment variable. It may be called from
+ * several threads at once. */
+void taffo_fixm_overflow(const char *location, double value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
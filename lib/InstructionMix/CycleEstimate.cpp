@@ -0,0 +1,161 @@
+#include <mutex>
+#include "CycleEstimate.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+
+using namespace llvm;
+
+
+struct opcode_cost {
+  unsigned opcode;
+  double cycles;
+};
+
+
+/* Integer and control flow operations take 1 cycle unless listed */
+static const opcode_cost x86_64Costs[] = {
+  /* Skylake */
+  {Instruction::Mul, 3}, {Instruction::SDiv, 26}, {Instruction::UDiv, 26},
+  {Instruction::SRem, 26}, {Instruction::URem, 26},
+  {Instruction::FAdd, 4}, {Instruction::FSub, 4}, {Instruction::FMul, 4},
+  {Instruction::FDiv, 14}, {Instruction::FRem, 40}, {Instruction::FCmp, 3},
+  {Instruction::SIToFP, 5}, {Instruction::UIToFP, 5}, {Instruction::FPToSI, 6},
+  {Instruction::FPToUI, 6}, {Instruction::FPExt, 5}, {Instruction::FPTrunc, 5},
+  {Instruction::Load, 4}, {Instruction::Call, 5}, {Instruction::Switch, 2},
+  {Instruction::PHI, 0}, {Instruction::Alloca, 0}, {Instruction::BitCast, 0}
+};
+
+static const opcode_cost aarch64Costs[] = {
+  /* Cortex-A72 */
+  {Instruction::Mul, 3}, {Instruction::SDiv, 12}, {Instruction::UDiv, 12},
+  {Instruction::SRem, 15}, {Instruction::URem, 15},
+  {Instruction::FAdd, 4}, {Instruction::FSub, 4}, {Instruction::FMul, 4},
+  {Instruction::FDiv, 15}, {Instruction::FRem, 40}, {Instruction::FCmp, 3},
+  {Instruction::SIToFP, 5}, {Instruction::UIToFP, 5}, {Instruction::FPToSI, 5},
+  {Instruction::FPToUI, 5}, {Instruction::FPExt, 3}, {Instruction::FPTrunc, 3},
+  {Instruction::Load, 4}, {Instruction::Call, 4}, {Instruction::Switch, 2},
+  {Instruction::PHI, 0}, {Instruction::Alloca, 0}, {Instruction::BitCast, 0}
+};
+
+static const opcode_cost cortexMCosts[] = {
+  /* Cortex-M4F; the double precision operations are emulated in software
+   * but have the same opcodes, so the single precision costs are used */
+  {Instruction::Mul, 1}, {Instruction::SDiv, 7}, {Instruction::UDiv, 7},
+  {Instruction::SRem, 9}, {Instruction::URem, 9},
+  {Instruction::FAdd, 1}, {Instruction::FSub, 1}, {Instruction::FMul, 1},
+  {Instruction::FDiv, 14}, {Instruction::FRem, 60}, {Instruction::FCmp, 1},
+  {Instruction::Load, 2}, {Instruction::Br, 3}, {Instruction::Call, 4},
+  {Instruction::Ret, 3}, {Instruction::Switch, 4},
+  {Instruction::PHI, 0}, {Instruction::Alloca, 0}, {Instruction::BitCast, 0}
+};
+
+
+LatencyTable::LatencyTable()
+{
+  for (unsigned op = 0; op < Instruction::OtherOpsEnd; op++)
+    opcodeCost[op] = defaultCost;
+}
+
+
+bool LatencyTable::parse(StringRef text, std::string& error)
+{
+  SmallVector<StringRef, 64> lines;
+  text.split(lines, '\n');
+  for (unsigned i = 0; i < lines.size(); i++) {
+    StringRef line = lines[i].trim();
+    if (line.empty() || line.startswith("#"))
+      continue;
+    std::pair<StringRef, StringRef> nameCost = line.split(' ');
+    StringRef name = nameCost.first.trim();
+    if (name == "vector-width") {
+      if (nameCost.second.trim().getAsInteger(10, vectorWidth)) {
+        error = "line " + std::to_string(i + 1) + ": invalid vector width";
+        return false;
+      }
+      continue;
+    }
+    double cost;
+    if (nameCost.second.trim().getAsDouble(cost) || cost < 0.0) {
+      error = "line " + std::to_string(i + 1) + ": invalid cost";
+      return false;
+    }
+    if (name == "default") {
+      for (unsigned op = 0; op < Instruction::OtherOpsEnd; op++) {
+        if (opcodeCost[op] == defaultCost)
+          opcodeCost[op] = cost;
+      }
+      defaultCost = cost;
+      continue;
+    }
+    bool found = false;
+    for (unsigned op = 1; op < Instruction::OtherOpsEnd && !found; op++) {
+      if (name == Instruction::getOpcodeName(op)) {
+        opcodeCost[op] = cost;
+        found = true;
+      }
+    }
+    if (!found) {
+      error = "line " + std::to_string(i + 1) + ": unknown opcode " + name.str();
+      return false;
+    }
+  }
+  return true;
+}
+
+
+template <size_t N>
+static void initTable(LatencyTable& table, const char *name, unsigned vectorWidth,
+                      const opcode_cost (&costs)[N])
+{
+  table.name = name;
+  table.vectorWidth = vectorWidth;
+  for (const opcode_cost& cost: costs)
+    table.opcodeCost[cost.opcode] = cost.cycles;
+}
+
+
+const LatencyTable *getBuiltinLatencyTable(StringRef target)
+{
+  static LatencyTable x86_64, aarch64, cortexM;
+  static std::once_flag init;
+  std::call_once(init, []() {
+    /* SSE2, NEON, and the 32-bit SIMD instructions of the DSP extension */
+    initTable(x86_64, "x86-64", 128, x86_64Costs);
+    initTable(aarch64, "aarch64", 128, aarch64Costs);
+    initTable(cortexM, "cortex-m", 32, cortexMCosts);
+  });
+
+  if (target == "x86-64")
+    return &x86_64;
+  if (target == "aarch64")
+    return &aarch64;
+  if (target == "cortex-m")
+    return &cortexM;
+
+  Triple triple(target);
+  switch (triple.getArch()) {
+    case Triple::x86_64:
+      return &x86_64;
+    case Triple::aarch64:
+      return &aarch64;
+    case Triple::thumb:
+    case Triple::arm:
+      if (triple.getSubArch() == Triple::ARMSubArch_v7em ||
+          triple.getSubArch() == Triple::ARMSubArch_v7m ||
+          triple.getSubArch() == Triple::ARMSubArch_v6m ||
+          triple.getSubArch() == Triple::ARMSubArch_v8m_mainline)
+        return &cortexM;
+      return nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+
+double estimateCycles(const InstructionMix& imix, const LatencyTable& table)
+{
+  double cycles = 0.0;
+  for (unsigned op = 0; op < Instruction::OtherOpsEnd; op++)
+    cycles += imix.opcodeStat[op] * table.opcodeCost[op];
+  return cycles;
+}
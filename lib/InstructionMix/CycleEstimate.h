@@ -0,0 +1,43 @@
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Instruction.h"
+#include "InstructionMix.h"
+
+
+#ifndef CYCLE_ESTIMATE_H
+#define CYCLE_ESTIMATE_H
+
+
+/* Average cost in cycles of each opcode on a target. The costs are a
+ * blend of latency and reciprocal throughput from the vendor optimization
+ * guides, meant to compare the float and the fixed point version of the
+ * same program rather than to predict its absolute running time. */
+struct LatencyTable
+{
+  std::string name;
+  double opcodeCost[llvm::Instruction::OtherOpsEnd];
+  /* cost of the opcodes not listed in the table */
+  double defaultCost = 1.0;
+  /* width in bits of the vector registers, 0 without vector instructions */
+  unsigned vectorWidth = 0;
+
+  LatencyTable();
+
+  /* Overrides the costs with the lines "<opcode name> <cycles>" of text,
+   * and the vector width with a line "vector-width <bits>".
+   * Empty lines and lines starting with '#' are ignored.
+   * Returns false, with a message in error, on malformed lines. */
+  bool parse(llvm::StringRef text, std::string& error);
+};
+
+
+/* Returns the builtin table of a target, named either "x86-64", "aarch64"
+ * or "cortex-m", or by the architecture of a target triple. Returns
+ * nullptr if there is no table for the target. */
+const LatencyTable *getBuiltinLatencyTable(llvm::StringRef target);
+
+/* Estimated number of cycles spent executing the instructions of imix */
+double estimateCycles(const InstructionMix& imix, const LatencyTable& table);
+
+
+#endif
@@ -0,0 +1,119 @@
+#include <cmath>
+#include <unordered_map>
+#include "FeatureModel.h"
+#include "llvm/ADT/SmallVector.h"
+
+using namespace llvm;
+
+
+bool FeatureModel::parse(StringRef text, std::string& error)
+{
+  std::unordered_map<std::string, int> featureIdx;
+  /* splits of the current tree whose second subtree is not started yet */
+  SmallVector<int, 16> pending;
+  bool treeOpen = false;
+
+  SmallVector<StringRef, 64> lines;
+  text.split(lines, '\n');
+  for (unsigned i = 0; i < lines.size(); i++) {
+    std::string where = "line " + std::to_string(i + 1) + ": ";
+    StringRef line = lines[i].trim();
+    if (line.empty() || line.startswith("#"))
+      continue;
+    SmallVector<StringRef, 4> fields;
+    line.split(fields, ' ', -1, false);
+    StringRef kind = fields[0];
+
+    if (kind == "option" || kind == "tree") {
+      if (treeOpen) {
+        error = where + "incomplete tree";
+        return false;
+      }
+      if (kind == "tree") {
+        if (ensembles.empty()) {
+          error = where + "tree before any option";
+          return false;
+        }
+        ensembles.back().trees.push_back(nodes.size());
+        treeOpen = true;
+        continue;
+      }
+      double base;
+      if (fields.size() != 3 || fields[2].getAsDouble(base)) {
+        error = where + "expected \"option <name> <base>\"";
+        return false;
+      }
+      ensembles.push_back({fields[1].str(), base, {}});
+      continue;
+    }
+
+    if (!treeOpen) {
+      error = where + kind.str() + " outside of a tree";
+      return false;
+    }
+    Node node;
+    if (kind == "split") {
+      if (fields.size() != 3 || fields[2].getAsDouble(node.value)) {
+        error = where + "expected \"split <feature> <threshold>\"";
+        return false;
+      }
+      auto idx = featureIdx.insert({fields[1].str(), featureNames.size()});
+      if (idx.second)
+        featureNames.push_back(fields[1].str());
+      node.feature = idx.first->second;
+      node.second = -1;
+      pending.push_back(nodes.size());
+      nodes.push_back(node);
+    } else if (kind == "leaf") {
+      if (fields.size() != 2 || fields[1].getAsDouble(node.value)) {
+        error = where + "expected \"leaf <value>\"";
+        return false;
+      }
+      node.feature = -1;
+      node.second = -1;
+      nodes.push_back(node);
+      /* a leaf completes the first subtree of the innermost pending split,
+       * or the whole tree */
+      if (pending.empty()) {
+        treeOpen = false;
+      } else {
+        nodes[pending.back()].second = nodes.size();
+        pending.pop_back();
+      }
+    } else {
+      error = where + "unknown line kind " + kind.str();
+      return false;
+    }
+  }
+  if (treeOpen) {
+    error = "incomplete tree at the end of the model";
+    return false;
+  }
+  return true;
+}
+
+
+FeatureList FeatureModel::predict(const FeatureList& features) const
+{
+  std::unordered_map<std::string, int64_t> byName;
+  for (auto& feat: features)
+    byName.insert(feat);
+  std::vector<double> values(featureNames.size(), 0.0);
+  for (size_t i = 0; i < featureNames.size(); i++) {
+    auto feat = byName.find(featureNames[i]);
+    if (feat != byName.end())
+      values[i] = feat->second;
+  }
+
+  FeatureList res;
+  for (const Ensemble& ens: ensembles) {
+    double value = ens.base;
+    for (int n: ens.trees) {
+      while (nodes[n].feature >= 0)
+        n = values[nodes[n].feature] <= nodes[n].value ? n + 1 : nodes[n].second;
+      value += nodes[n].value;
+    }
+    res.push_back({ens.option, std::llround(value)});
+  }
+  return res;
+}
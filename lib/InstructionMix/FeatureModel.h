@@ -0,0 +1,58 @@
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "FeatureTable.h"
+
+
+#ifndef FEATURE_MODEL_H
+#define FEATURE_MODEL_H
+
+
+/* Ensembles of regression trees which predict the value of the options of
+ * a pass from the features of a program. Each line of the text format is
+ * one of:
+ *   option <name> <base>    starts the ensemble of the option <name>; its
+ *                           value is <base> plus the sum of its trees
+ *   tree                    starts a tree of the last option, whose nodes
+ *                           follow in preorder
+ *   split <feature> <threshold>
+ *                           a node which continues in its first subtree if
+ *                           the feature is not greater than the threshold,
+ *                           in the second one otherwise
+ *   leaf <value>
+ * A decision tree is an option with a base of 0 and a single tree, the
+ * leaves of a random forest are divided by the number of its trees.
+ * The features missing from a program count as 0. Empty lines and lines
+ * starting with '#' are ignored. */
+class FeatureModel
+{
+public:
+  /* Returns false, with a message in error, on malformed text */
+  bool parse(llvm::StringRef text, std::string& error);
+
+  /* Predicted value of each option, rounded to the nearest integer, in the
+   * order of the model */
+  FeatureList predict(const FeatureList& features) const;
+
+private:
+  struct Node {
+    /* index in featureNames, -1 for the leaves */
+    int feature;
+    double value;
+    /* the first subtree of a split follows it */
+    int second;
+  };
+  struct Ensemble {
+    std::string option;
+    double base;
+    /* index of the root of each tree in nodes */
+    std::vector<int> trees;
+  };
+
+  std::vector<std::string> featureNames;
+  std::vector<Node> nodes;
+  std::vector<Ensemble> ensembles;
+};
+
+
+#endif
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <thread>
+#include "FeatureTable.h"
+
+
+static void printCSVField(std::ostream& out, const std::string& s)
+{
+  if (s.find_first_of(",\"\n") == std::string::npos) {
+    out << s;
+    return;
+  }
+  out << '"';
+  for (char c: s) {
+    if (c == '"')
+      out << '"';
+    out << c;
+  }
+  out << '"';
+}
+
+
+static void printJSONString(std::ostream& out, const std::string& s)
+{
+  static const char hex[] = "0123456789abcdef";
+  out << '"';
+  for (char c: s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if ((unsigned char)c < 0x20) {
+      out << "\\u00" << hex[(c >> 4) & 0xF] << hex[c & 0xF];
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+
+void FeatureTable::print(std::ostream& out, Format format) const
+{
+  if (format == Text) {
+    for (const Row& row: rows) {
+      if (rows.size() > 1)
+        out << "# " << row.file << std::endl;
+      if (!row.error.empty())
+        out << row.error << std::endl;
+      for (auto& feat: row.features)
+        out << feat.first << " " << feat.second << std::endl;
+    }
+
+  } else if (format == CSV) {
+    std::set<std::string> names;
+    for (const Row& row: rows) {
+      for (auto& feat: row.features)
+        names.insert(feat.first);
+    }
+    printCSVField(out, keyName);
+    for (const std::string& name: names) {
+      out << ',';
+      printCSVField(out, name);
+    }
+    out << ",error" << std::endl;
+    for (const Row& row: rows) {
+      printCSVField(out, row.file);
+      std::vector<std::pair<std::string, int64_t>> sorted(row.features);
+      std::stable_sort(sorted.begin(), sorted.end(),
+          [](const std::pair<std::string, int64_t>& a, const std::pair<std::string, int64_t>& b) {
+            return a.first < b.first;
+          });
+      auto feat = sorted.begin();
+      for (const std::string& name: names) {
+        out << ',';
+        if (feat != sorted.end() && feat->first == name) {
+          out << feat->second;
+          while (feat != sorted.end() && feat->first == name)
+            feat++;
+        }
+      }
+      out << ',';
+      printCSVField(out, row.error);
+      out << std::endl;
+    }
+
+  } else {
+    out << "{";
+    for (size_t i = 0; i < rows.size(); i++) {
+      const Row& row = rows[i];
+      out << (i > 0 ? ",\n  " : "\n  ");
+      printJSONString(out, row.file);
+      out << ": {";
+      if (!row.error.empty()) {
+        out << "\"error\": ";
+        printJSONString(out, row.error);
+      } else {
+        for (size_t j = 0; j < row.features.size(); j++) {
+          out << (j > 0 ? ", " : "");
+          printJSONString(out, row.features[j].first);
+          out << ": " << row.features[j].second;
+        }
+      }
+      out << "}";
+    }
+    out << "\n}" << std::endl;
+  }
+}
+
+
+bool collectInputFiles(const std::vector<std::string>& positional,
+                       const std::string& listFile,
+                       std::vector<std::string>& out)
+{
+  out.insert(out.end(), positional.begin(), positional.end());
+  if (listFile.empty())
+    return true;
+  std::ifstream list(listFile);
+  if (!list)
+    return false;
+  std::string line;
+  while (std::getline(list, line)) {
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+      continue;
+    size_t end = line.find_last_not_of(" \t\r");
+    out.push_back(line.substr(begin, end - begin + 1));
+  }
+  return true;
+}
+
+
+void runInParallel(size_t n, unsigned jobs, std::function<void(size_t)> fn)
+{
+  if (jobs == 0)
+    jobs = std::max(std::thread::hardware_concurrency(), 1U);
+  jobs = std::min<size_t>(jobs, n);
+
+  /* the indices are picked dynamically, since the sizes of the inputs
+   * vary a lot */
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++)
+      fn(i);
+  };
+  if (jobs <= 1) {
+    worker();
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; i++)
+    threads.emplace_back(worker);
+  for (std::thread& t: threads)
+    t.join();
+}
+
+
+FeatureTable analyzeFiles(const std::vector<std::string>& files, unsigned jobs,
+    std::function<void(const std::string&, FeatureTable::Row&)> analyze)
+{
+  FeatureTable table;
+  table.rows.resize(files.size());
+  for (size_t i = 0; i < files.size(); i++)
+    table.rows[i].file = files[i];
+  runInParallel(files.size(), jobs, [&](size_t i) {
+    analyze(files[i], table.rows[i]);
+  });
+  return table;
+}
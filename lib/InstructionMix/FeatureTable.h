@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+#ifndef FEATURE_TABLE_H
+#define FEATURE_TABLE_H
+
+
+/* Features extracted from a single input file, in output order */
+typedef std::vector<std::pair<std::string, int64_t>> FeatureList;
+
+
+/* Results of the analysis of a set of input files, one row per file */
+class FeatureTable
+{
+public:
+  enum Format {
+    Text,
+    CSV,
+    JSON
+  };
+  
+  struct Row {
+    std::string file;
+    FeatureList features;
+    /* set if the file could not be analyzed */
+    std::string error;
+  };
+  
+  std::vector<Row> rows;
+  /* the header of the column of Row::file in the CSV format */
+  std::string keyName = "file";
+  
+  /* Text: the "name value" lines of each file, preceded by its name when
+   * there are several files.
+   * CSV: a column per feature name, sorted, plus an error column.
+   * JSON: an object with a member per file, holding the features or an
+   * "error" member. */
+  void print(std::ostream& out, Format format) const;
+};
+
+
+/* Reads the list of input files from the positional arguments and from
+ * listFile (one file per line), if not empty.
+ * Returns false if listFile cannot be read. */
+bool collectInputFiles(const std::vector<std::string>& positional,
+                       const std::string& listFile,
+                       std::vector<std::string>& out);
+
+/* Runs fn(i) for each i in [0, n) on jobs threads (the number of cores if
+ * 0); the indices are handed out dynamically, in increasing order. */
+void runInParallel(size_t n, unsigned jobs, std::function<void(size_t)> fn);
+
+/* Runs analyze(file, row) on each file on jobs threads (the number of
+ * cores if 0) and returns the rows in the order of the files.
+ * analyze is called concurrently, and must use its own LLVMContext. */
+FeatureTable analyzeFiles(const std::vector<std::string>& files, unsigned jobs,
+    std::function<void(const std::string&, FeatureTable::Row&)> analyze);
+
+
+#endif
@@ -1,52 +1,99 @@
-#include <sstream>
 #include "llvm/IR/Intrinsics.h"
 #include "InstructionMix.h"
 
 using namespace llvm;
 
 
-void InstructionMix::updateWithInstruction(Instruction *inst)
+void InstructionMix::updateWithInstruction(Instruction *inst, int64_t weight)
 {
-  ninstr++;
-  stat[inst->getOpcodeName()]++;
+  ninstr += weight;
+  opcodeStat[inst->getOpcode()] += weight;
 
   if (isa<AllocaInst>(inst) || isa<LoadInst>(inst) || isa<StoreInst>(inst) || isa<GetElementPtrInst>(inst) ) {
-    stat["MemOp"]++;
+    categoryStat[MemOp] += weight;
   } else if (isa<PHINode>(inst) || isa<SelectInst>(inst) || isa<FCmpInst>(inst) || isa<CmpInst>(inst) ) {
-    stat["CmpOp"]++;
+    categoryStat[CmpOp] += weight;
   } else if (isa<CastInst>(inst)) {
-    stat["CastOp"]++;
+    categoryStat[CastOp] += weight;
   } else if (inst->isBinaryOp()) {
-    stat["MathOp"]++;
+    categoryStat[MathOp] += weight;
     if (inst->getType()->isFloatingPointTy()) {
-      stat["FloatingPointOp"]++;
+      categoryStat[FloatingPointOp] += weight;
       if (inst->getOpcode() == Instruction::FMul || inst->getOpcode() == Instruction::FDiv)
-        stat["FloatMulDivOp"]++;
+        categoryStat[FloatMulDivOp] += weight;
     } else
-      stat["IntegerOp"]++;
+      categoryStat[IntegerOp] += weight;
   }
   if (inst->isShift()) {
-    stat["Shift"]++;
+    categoryStat[Shift] += weight;
   }
 
   if (CallBase *call = dyn_cast<CallBase>(inst)) {
-    std::stringstream stm;
-    
     if (isa<CallInst>(call)) {
-      stm << "call(";
+      callStat[call->getCalledFunction()] += weight;
     } else {
-      stm << "invoke(";
+      invokeStat[call->getCalledFunction()] += weight;
     }
-    
-    Function *opnd = call->getCalledFunction();
-    if (opnd) {
-      stm << opnd->getName().str();
-    } else {
-      stm << "%indirect";
-    }
-    
-    stm << ")";
-    stat[stm.str()]++;
+  }
+}
+
+
+void InstructionMix::add(const InstructionMix& other, int64_t weight)
+{
+  ninstr += other.ninstr * weight;
+  for (unsigned op = 0; op < Instruction::OtherOpsEnd; op++)
+    opcodeStat[op] += other.opcodeStat[op] * weight;
+  for (int c = 0; c < NumCategories; c++)
+    categoryStat[c] += other.categoryStat[c] * weight;
+  for (auto& entry: other.callStat)
+    callStat[entry.first] += entry.second * weight;
+  for (auto& entry: other.invokeStat)
+    invokeStat[entry.first] += entry.second * weight;
+}
+
+
+static void addCallStat(std::map<std::string, int64_t>& res, const char *kind,
+                        const DenseMap<Function *, int64_t>& stat)
+{
+  for (auto& entry: stat) {
+    std::string name = kind;
+    name += "(";
+    name += entry.first ? entry.first->getName().str() : "%indirect";
+    name += ")";
+    res[name] += entry.second;
+  }
+}
+
+
+std::map<std::string, int64_t> InstructionMix::getStat() const
+{
+  std::map<std::string, int64_t> res;
+  for (unsigned op = 0; op < Instruction::OtherOpsEnd; op++) {
+    if (opcodeStat[op] != 0)
+      res[Instruction::getOpcodeName(op)] += opcodeStat[op];
+  }
+  for (int c = 0; c < NumCategories; c++) {
+    if (categoryStat[c] != 0)
+      res[getCategoryName((Category)c)] += categoryStat[c];
+  }
+  addCallStat(res, "call", callStat);
+  addCallStat(res, "invoke", invokeStat);
+  return res;
+}
+
+
+const char *InstructionMix::getCategoryName(Category c)
+{
+  switch (c) {
+    case MemOp: return "MemOp";
+    case CmpOp: return "CmpOp";
+    case CastOp: return "CastOp";
+    case MathOp: return "MathOp";
+    case FloatingPointOp: return "FloatingPointOp";
+    case FloatMulDivOp: return "FloatMulDivOp";
+    case IntegerOp: return "IntegerOp";
+    case Shift: return "Shift";
+    default: return "";
   }
 }
 
@@ -1,5 +1,8 @@
+#include <cstdint>
+#include <map>
 #include <string>
 #include <unordered_map>
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Instructions.h"
 
 
@@ -10,11 +13,38 @@
 class InstructionMix
 {
 public:
-  std::map<std::string, int> stat;
-  int ninstr = 0;
+  enum Category {
+    MemOp,
+    CmpOp,
+    CastOp,
+    MathOp,
+    FloatingPointOp,
+    FloatMulDivOp,
+    IntegerOp,
+    Shift,
+    NumCategories
+  };
   
-  void updateWithInstruction(llvm::Instruction *instr);
+  int64_t ninstr = 0;
+  /* counters indexed by opcode and by category */
+  int64_t opcodeStat[llvm::Instruction::OtherOpsEnd] = {};
+  int64_t categoryStat[NumCategories] = {};
+  /* counters of the direct calls and invokes, by callee; the indirect
+   * ones are keyed by nullptr */
+  llvm::DenseMap<llvm::Function *, int64_t> callStat;
+  llvm::DenseMap<llvm::Function *, int64_t> invokeStat;
   
+  /* Counts instr as executed weight times */
+  void updateWithInstruction(llvm::Instruction *instr, int64_t weight = 1);
+  
+  /* Adds the counters of other, multiplied by weight */
+  void add(const InstructionMix& other, int64_t weight = 1);
+  
+  /* Returns the counters keyed by opcode name, category name and
+   * "call(callee)" / "invoke(callee)", leaving out the ones at zero */
+  std::map<std::string, int64_t> getStat() const;
+  
+  static const char *getCategoryName(Category c);
 };
 
 bool isFunctionInlinable(llvm::Function *fun);
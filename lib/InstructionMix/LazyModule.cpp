@@ -0,0 +1,72 @@
+#include <vector>
+#include "LazyModule.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SourceMgr.h"
+
+using namespace llvm;
+
+
+std::unique_ptr<Module> readLazyModule(const std::string& filename,
+    LLVMContext& c, std::string& error)
+{
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = getLazyIRFileModule(filename, err, c);
+  if (!m)
+    error = err.getMessage().str();
+  return m;
+}
+
+
+/* Queues the functions used by a constant, looking through constant
+ * expressions and aggregates */
+static void collectFunctions(Constant *c, SmallPtrSetImpl<Constant *>& visited,
+                             std::vector<Function *>& queue)
+{
+  if (!visited.insert(c).second)
+    return;
+  if (Function *f = dyn_cast<Function>(c)) {
+    queue.push_back(f);
+    return;
+  }
+  if (isa<GlobalValue>(c))
+    return;
+  for (Use& op: c->operands()) {
+    if (Constant *opc = dyn_cast<Constant>(op.get()))
+      collectFunctions(opc, visited, queue);
+  }
+}
+
+
+bool materializeReachableFunctions(Function& root, std::string& error)
+{
+  SmallPtrSet<Constant *, 32> visited;
+  std::vector<Function *> queue;
+  collectFunctions(&root, visited, queue);
+  while (!queue.empty()) {
+    Function *f = queue.back();
+    queue.pop_back();
+    if (Error e = f->materialize()) {
+      error = toString(std::move(e));
+      return false;
+    }
+    for (BasicBlock& bb: *f) {
+      for (Instruction& inst: bb) {
+        for (Use& op: inst.operands()) {
+          if (Constant *c = dyn_cast<Constant>(op.get()))
+            collectFunctions(c, visited, queue);
+        }
+      }
+    }
+  }
+  
+  Module *m = root.getParent();
+  for (Function& f: *m) {
+    if (f.isMaterializable())
+      f.deleteBody();
+  }
+  return true;
+}
@@ -0,0 +1,27 @@
+#include <memory>
+#include <string>
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+
+#ifndef LAZY_MODULE_H
+#define LAZY_MODULE_H
+
+
+/* Reads a module from a bitcode or LLVM assembly file. The function bodies
+ * of bitcode files are not materialized: they look like declarations until
+ * materializeReachableFunctions or Module::materializeAll is called.
+ * Returns nullptr, with a message in error, if the file cannot be read. */
+std::unique_ptr<llvm::Module> readLazyModule(const std::string& filename,
+    llvm::LLVMContext& c, std::string& error);
+
+/* Materializes root and all the functions referenced, directly or through
+ * constant expressions, by the code of the materialized functions.
+ * Functions only reachable through global initializers are not
+ * materialized. The bodies of all the functions which were not
+ * materialized are dropped, so that they become plain declarations.
+ * Returns false, with a message in error, if materialization fails. */
+bool materializeReachableFunctions(llvm::Function& root, std::string& error);
+
+
+#endif
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Metadata.h"
+#include "MixComparison.h"
+
+using namespace llvm;
+
+
+static const Function *getFunctionFromMD(const MDNode *md)
+{
+  if (!md || md->getNumOperands() == 0)
+    return nullptr;
+  if (auto *vmd = dyn_cast_or_null<ValueAsMetadata>(md->getOperand(0).get()))
+    return dyn_cast<Function>(vmd->getValue()->stripPointerCasts());
+  return nullptr;
+}
+
+
+std::string getSourceFunctionName(const Function& f)
+{
+  const Function *orig = &f;
+  /* the clones of clones also point to their source: the bound only
+   * guards against cycles */
+  for (unsigned i = 0; i < 8; i++) {
+    const Function *next = getFunctionFromMD(orig->getMetadata("taffo.originalCall"));
+    if (!next)
+      next = getFunctionFromMD(orig->getMetadata("taffo.sourceFunction"));
+    if (!next || next == orig)
+      break;
+    orig = next;
+  }
+  return orig->getName().str();
+}
+
+
+static void addBlockMix(InstructionMix& mix, BasicBlock& bb, int64_t weight)
+{
+  for (Instruction& inst: bb) {
+    if (!isSkippableInstruction(&inst))
+      mix.updateWithInstruction(&inst, weight);
+  }
+}
+
+
+/* Appends the mixes of the loops, sorted by the position of their headers,
+ * and of the loops nested in them */
+static void addLoopMixes(function_mix& fm, std::vector<Loop *> loops, const std::string& prefix,
+                         const DenseMap<BasicBlock *, unsigned>& blockIndex,
+                         const DenseMap<BasicBlock *, int64_t>& weights)
+{
+  std::sort(loops.begin(), loops.end(), [&](Loop *a, Loop *b) {
+    return blockIndex.lookup(a->getHeader()) < blockIndex.lookup(b->getHeader());
+  });
+  for (size_t i = 0; i < loops.size(); i++) {
+    std::string name = prefix + std::to_string(i + 1);
+    InstructionMix mix;
+    for (BasicBlock *bb: loops[i]->blocks())
+      addBlockMix(mix, *bb, weights.lookup(bb));
+    fm.loops.push_back({name, std::move(mix)});
+    addLoopMixes(fm, loops[i]->getSubLoops(), name + ".", blockIndex, weights);
+  }
+}
+
+
+std::vector<function_mix> collectFunctionMixes(Module& m,
+    std::function<int64_t(BasicBlock *)> blockWeight)
+{
+  std::vector<function_mix> res;
+  for (Function& f: m) {
+    if (f.isDeclaration())
+      continue;
+    function_mix fm;
+    fm.name = f.getName().str();
+    fm.sourceName = getSourceFunctionName(f);
+    DenseMap<BasicBlock *, unsigned> blockIndex;
+    DenseMap<BasicBlock *, int64_t> weights;
+    unsigned index = 0;
+    for (BasicBlock& bb: f) {
+      blockIndex[&bb] = index++;
+      weights[&bb] = blockWeight ? blockWeight(&bb) : 1;
+      addBlockMix(fm.mix, bb, weights[&bb]);
+    }
+    DominatorTree dt(f);
+    LoopInfo li(dt);
+    addLoopMixes(fm, std::vector<Loop *>(li.begin(), li.end()), "", blockIndex, weights);
+    res.push_back(std::move(fm));
+  }
+  return res;
+}
+
+
+static int64_t getCallCount(const InstructionMix& mix)
+{
+  int64_t count = 0;
+  for (auto& entry: mix.callStat)
+    count += entry.second;
+  for (auto& entry: mix.invokeStat)
+    count += entry.second;
+  return count;
+}
+
+
+static FeatureTable::Row compareMixes(const std::string& name, const InstructionMix& floatMix,
+                                      const InstructionMix& fixedMix)
+{
+  static const InstructionMix::Category categories[] = {
+    InstructionMix::MathOp, InstructionMix::Shift, InstructionMix::CastOp, InstructionMix::MemOp
+  };
+  FeatureTable::Row row;
+  row.file = name;
+  auto addCounter = [&](const std::string& counter, int64_t f, int64_t x) {
+    row.features.push_back({counter + ".float", f});
+    row.features.push_back({counter + ".fixed", x});
+    row.features.push_back({counter + ".delta", x - f});
+  };
+  addCounter("*", floatMix.ninstr, fixedMix.ninstr);
+  for (InstructionMix::Category c: categories)
+    addCounter(InstructionMix::getCategoryName(c), floatMix.categoryStat[c], fixedMix.categoryStat[c]);
+  addCounter("call", getCallCount(floatMix), getCallCount(fixedMix));
+  return row;
+}
+
+
+std::vector<FeatureTable::Row> compareFunctionMixes(const std::vector<function_mix>& floatMixes,
+                                                    const std::vector<function_mix>& fixedMixes)
+{
+  std::map<std::string, const function_mix *> floatByName;
+  for (const function_mix& fm: floatMixes)
+    floatByName[fm.name] = &fm;
+
+  static const InstructionMix empty;
+  std::vector<FeatureTable::Row> rows;
+  std::set<const function_mix *> matched;
+  for (const function_mix& fixed: fixedMixes) {
+    auto it = floatByName.find(fixed.name);
+    if (it == floatByName.end())
+      it = floatByName.find(fixed.sourceName);
+    const function_mix *flt = it != floatByName.end() ? it->second : nullptr;
+    if (flt)
+      matched.insert(flt);
+
+    std::string name = fixed.name;
+    if (fixed.sourceName != fixed.name)
+      name += " (" + fixed.sourceName + ")";
+    rows.push_back(compareMixes(name, flt ? flt->mix : empty, fixed.mix));
+
+    std::map<std::string, const InstructionMix *> floatLoops;
+    if (flt) {
+      for (auto& loop: flt->loops)
+        floatLoops[loop.first] = &loop.second;
+    }
+    for (auto& loop: fixed.loops) {
+      auto fl = floatLoops.find(loop.first);
+      rows.push_back(compareMixes(name + " loop " + loop.first,
+                                  fl != floatLoops.end() ? *fl->second : empty, loop.second));
+      if (fl != floatLoops.end())
+        floatLoops.erase(fl);
+    }
+    /* the loops which are only in the float function */
+    for (auto& loop: floatLoops)
+      rows.push_back(compareMixes(name + " loop " + loop.first, *loop.second, empty));
+  }
+
+  for (const function_mix& flt: floatMixes) {
+    if (!matched.count(&flt))
+      rows.push_back(compareMixes(flt.name + " (float only)", flt.mix, empty));
+  }
+  return rows;
+}
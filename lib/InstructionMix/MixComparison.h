@@ -0,0 +1,56 @@
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "FeatureTable.h"
+#include "InstructionMix.h"
+
+
+#ifndef MIX_COMPARISON_H
+#define MIX_COMPARISON_H
+
+
+/* Static instruction mix of a function, not including its callees, and of
+ * each of its loops, including the nested ones. The loops are named by
+ * their position in the loop forest, counting the loops in the order of
+ * their headers in the function: "1.2" is the second loop nested in the
+ * first outermost loop. The converted code has the same loops as the
+ * float code, hence the names match between the two versions. */
+struct function_mix {
+  std::string name;
+  /* the function the clones made by TAFFO come from, following
+   * taffo.originalCall and taffo.sourceFunction; name otherwise */
+  std::string sourceName;
+  InstructionMix mix;
+  std::vector<std::pair<std::string, InstructionMix>> loops;
+};
+
+/* Name of the function f comes from, see function_mix::sourceName */
+std::string getSourceFunctionName(const llvm::Function& f);
+
+/* Mixes of the functions defined in m, whose bodies must be materialized.
+ * If blockWeight is set, each instruction counts as many times as it
+ * returns for its block. */
+std::vector<function_mix> collectFunctionMixes(llvm::Module& m,
+    std::function<int64_t(llvm::BasicBlock *)> blockWeight = nullptr);
+
+/* Compares the mixes of the float functions with the ones of the converted
+ * functions. Each converted function is matched with the float function of
+ * the same name or, failing that, of the same source name, and each of its
+ * loops with the loop of the same name; the float functions without a
+ * match come last, as "<function> (float only)". The rows are named
+ * "<function>", or "<function> (<source>)" for the clones, followed by
+ * " loop <name>" for the loops. The
+ * features are the float and the fixed count of the instructions ("*"),
+ * of MathOp, Shift, CastOp and MemOp and of the calls and the invokes
+ * ("call"), and the difference, as "<counter>.float", "<counter>.fixed"
+ * and "<counter>.delta". */
+std::vector<FeatureTable::Row> compareFunctionMixes(const std::vector<function_mix>& floatMixes,
+                                                    const std::vector<function_mix>& fixedMixes);
+
+
+#endif
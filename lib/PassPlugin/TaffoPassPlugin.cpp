@@ -0,0 +1,139 @@
+//===-- TaffoPassPlugin.cpp - New Pass Manager Registration -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Registration of the TAFFO passes with the new pass manager, for
+/// opt -load-pass-plugin Taffo.so -passes=taffoinit,taffovra,...
+///
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#include "llvm/Transforms/Scalar/DCE.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
+
+using namespace llvm;
+
+namespace {
+
+/* What a TAFFO pass leaves valid in the analyses of the functions it
+ * does not create */
+enum class StagePreserves {
+  /* it only attaches metadata */
+  All,
+  /* it removes or replaces instructions, but not blocks or edges */
+  CFG,
+  /* it rewrites the code */
+  None
+};
+
+struct StagePassDesc {
+  /* name in -passes */
+  const char *Name;
+  /* argument of the legacy pass */
+  const char *LegacyName;
+  StagePreserves Preserves;
+};
+
+const StagePassDesc StagePasses[] = {
+  {"taffoinit", "taffoinit", StagePreserves::CFG},
+  {"taffovra", "taffoVRA", StagePreserves::All},
+  {"taffodta", "taffodta", StagePreserves::CFG},
+  {"flttofix", "flttofix", StagePreserves::None},
+  {"taffoerr", "errorprop", StagePreserves::All}
+};
+
+/* Runs a TAFFO pass registered with the legacy pass manager, and reports
+ * to the new pass manager which of its cached analyses are still valid,
+ * so that the passes of the pipeline around the TAFFO stages do not
+ * recompute the dominator trees, the loops and the scalar evolution of
+ * the functions which were only annotated */
+class TaffoStagePass : public PassInfoMixin<TaffoStagePass> {
+public:
+  TaffoStagePass(const StagePassDesc &Desc) : Desc(&Desc) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    const PassInfo *PI = PassRegistry::getPassRegistry()->getPassInfo(StringRef(Desc->LegacyName));
+    if (!PI || !PI->getNormalCtor())
+      report_fatal_error(Twine("TAFFO pass -") + Desc->LegacyName + " is not registered");
+    legacy::PassManager PM;
+    PM.add(PI->createPass());
+    if (!PM.run(M))
+      return PreservedAnalyses::all();
+
+    switch (Desc->Preserves) {
+    case StagePreserves::All:
+      return PreservedAnalyses::all();
+    case StagePreserves::CFG: {
+      PreservedAnalyses PA;
+      PA.preserveSet<CFGAnalyses>();
+      return PA;
+    }
+    default:
+      return PreservedAnalyses::none();
+    }
+  }
+
+  /* the passes are not optional in -opt-bisect and optnone */
+  static bool isRequired() { return true; }
+
+private:
+  const StagePassDesc *Desc;
+};
+
+const StagePassDesc *lookupStagePass(StringRef Name) {
+  for (const StagePassDesc &Desc : StagePasses)
+    if (Name == Desc.Name)
+      return &Desc;
+  return nullptr;
+}
+
+/* The whole TAFFO pipeline, as run by taffo-driver: mem2reg before VRA,
+ * and the dead code elimination after DTA and the conversion */
+void addTaffoPipeline(ModulePassManager &MPM) {
+  MPM.addPass(TaffoStagePass(*lookupStagePass("taffoinit")));
+  MPM.addPass(createModuleToFunctionPassAdaptor(PromotePass()));
+  MPM.addPass(TaffoStagePass(*lookupStagePass("taffovra")));
+  MPM.addPass(TaffoStagePass(*lookupStagePass("taffodta")));
+  MPM.addPass(GlobalDCEPass());
+  MPM.addPass(TaffoStagePass(*lookupStagePass("flttofix")));
+  MPM.addPass(GlobalDCEPass());
+  MPM.addPass(createModuleToFunctionPassAdaptor(DCEPass()));
+  MPM.addPass(TaffoStagePass(*lookupStagePass("taffoerr")));
+}
+
+void registerTaffoPasses(PassBuilder &PB) {
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, ModulePassManager &MPM, ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "taffo") {
+          addTaffoPipeline(MPM);
+          return true;
+        }
+        if (const StagePassDesc *Desc = lookupStagePass(Name)) {
+          MPM.addPass(TaffoStagePass(*Desc));
+          return true;
+        }
+        return false;
+      });
+}
+
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "Taffo", LLVM_VERSION_STRING, registerTaffoPasses};
+}
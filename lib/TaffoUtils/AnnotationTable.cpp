@@ -0,0 +1,232 @@
+//===-- AnnotationTable.cpp - Binary Side-Table of TAFFO Annotations -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Compact encoding of the scalar input info of a module (types, ranges
+/// and errors) as a single binary blob.
+///
+//===----------------------------------------------------------------------===//
+
+#include "AnnotationTable.h"
+
+#include <algorithm>
+#include <cstring>
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/Endian.h"
+#include "Metadata.h"
+
+namespace mdutils {
+
+using namespace llvm;
+
+/* Encoding (all the fields are little endian)
+ * header: char[4] "TAFT", u32 version, u32 number of numbered values,
+ *   u32 number of records
+ * records, sorted by value ID: u32 ValueID, u32 Flags, i32 Width,
+ *   u32 PointPos, f64 Min, f64 Max, f64 Error, f64 AbsError */
+static const char TableMagic[4] = {'T', 'A', 'F', 'T'};
+static const uint32_t TableVersion = 1U;
+static const size_t HeaderSize = 16U;
+
+static void encodeDouble(char *P, double D) {
+  uint64_t Bits;
+  std::memcpy(&Bits, &D, sizeof(Bits));
+  support::endian::write64le(P, Bits);
+}
+
+static double decodeDouble(const char *P) {
+  uint64_t Bits = support::endian::read64le(P);
+  double D;
+  std::memcpy(&D, &Bits, sizeof(D));
+  return D;
+}
+
+bool AnnotationRecord::setInputInfo(const InputInfo &II) {
+  Flags &= ~(HasType | HasRange | HasError | EnableConversion | Final);
+  if (II.IType) {
+    const FPType *FPT = dyn_cast<FPType>(II.IType.get());
+    if (!FPT)
+      return false;
+    Flags |= HasType;
+    Width = FPT->getSWidth();
+    PointPos = FPT->getPointPos();
+  }
+  if (II.IRange) {
+    Flags |= HasRange;
+    Min = II.IRange->Min;
+    Max = II.IRange->Max;
+  }
+  if (II.IError) {
+    Flags |= HasError;
+    Error = *II.IError;
+  }
+  if (II.IEnableConversion)
+    Flags |= EnableConversion;
+  if (II.IFinal)
+    Flags |= Final;
+  return true;
+}
+
+std::unique_ptr<InputInfo> AnnotationRecord::toInputInfo() const {
+  std::shared_ptr<TType> T;
+  std::shared_ptr<Range> R;
+  std::shared_ptr<double> E;
+  if (has(HasType))
+    T = std::make_shared<FPType>(Width, PointPos);
+  if (has(HasRange))
+    R = std::make_shared<Range>(Min, Max);
+  if (has(HasError))
+    E = std::make_shared<double>(Error);
+  return std::unique_ptr<InputInfo>(new InputInfo(T, R, E, has(EnableConversion), has(Final)));
+}
+
+AnnotationValueNumbering::AnnotationValueNumbering(const Module &M) {
+  forEachValue(M, [this](uint32_t ID, const Value &V) { IDs[&V] = ID; });
+}
+
+void AnnotationTableWriter::addRecord(const AnnotationRecord &R) {
+  Records.push_back(R);
+}
+
+void AnnotationTableWriter::addFromMetadata(Module &M) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  SmallVector<MDInfo *, 8U> ArgInfos;
+  AnnotationValueNumbering::forEachValue(M, [&](uint32_t ID, const Value &V) {
+    AnnotationRecord R;
+    R.ValueID = ID;
+    InputInfo *II = nullptr;
+    if (const Argument *Arg = dyn_cast<Argument>(&V)) {
+      if (Arg->getArgNo() == 0) {
+        ArgInfos.clear();
+        MM.retrieveArgumentInputInfo(*Arg->getParent(), ArgInfos);
+      }
+      if (Arg->getArgNo() < ArgInfos.size())
+        II = dyn_cast_or_null<InputInfo>(ArgInfos[Arg->getArgNo()]);
+    } else if (const Instruction *I = dyn_cast<Instruction>(&V)) {
+      II = MM.retrieveInputInfo(*I);
+      if (I->getMetadata(COMP_ERROR_METADATA)) {
+        R.Flags |= AnnotationRecord::HasAbsError;
+        R.AbsError = MetadataManager::retrieveErrorMetadata(*I);
+      }
+    } else {
+      II = MM.retrieveInputInfo(cast<GlobalObject>(V));
+    }
+    if (II && !R.setInputInfo(*II))
+      return;
+    if (II || R.Flags != 0)
+      addRecord(R);
+  });
+}
+
+std::string AnnotationTableWriter::encode(uint32_t NumValues) {
+  /* the last record added for an ID wins */
+  std::stable_sort(Records.begin(), Records.end(),
+                   [](const AnnotationRecord &A, const AnnotationRecord &B) {
+                     return A.ValueID < B.ValueID;
+                   });
+  auto Last = std::unique(Records.rbegin(), Records.rend(),
+                          [](const AnnotationRecord &A, const AnnotationRecord &B) {
+                            return A.ValueID == B.ValueID;
+                          });
+  Records.erase(Records.begin(), Last.base());
+
+  std::string Blob(HeaderSize + Records.size() * AnnotationRecord::EncodedSize, '\0');
+  char *P = &Blob[0];
+  std::memcpy(P, TableMagic, sizeof(TableMagic));
+  support::endian::write32le(P + 4, TableVersion);
+  support::endian::write32le(P + 8, NumValues);
+  support::endian::write32le(P + 12, Records.size());
+  P += HeaderSize;
+  for (const AnnotationRecord &R : Records) {
+    support::endian::write32le(P, R.ValueID);
+    support::endian::write32le(P + 4, R.Flags);
+    support::endian::write32le(P + 8, static_cast<uint32_t>(R.Width));
+    support::endian::write32le(P + 12, R.PointPos);
+    encodeDouble(P + 16, R.Min);
+    encodeDouble(P + 24, R.Max);
+    encodeDouble(P + 32, R.Error);
+    encodeDouble(P + 40, R.AbsError);
+    P += AnnotationRecord::EncodedSize;
+  }
+  return Blob;
+}
+
+void AnnotationTableWriter::write(Module &M, uint32_t NumValues) {
+  if (NamedMDNode *Old = M.getNamedMetadata(ANNOTATION_TABLE_METADATA))
+    M.eraseNamedMetadata(Old);
+  LLVMContext &C = M.getContext();
+  NamedMDNode *Table = M.getOrInsertNamedMetadata(ANNOTATION_TABLE_METADATA);
+  Table->addOperand(MDNode::get(C, MDString::get(C, encode(NumValues))));
+}
+
+AnnotationTableReader::AnnotationTableReader(StringRef Blob, uint32_t NumValues) {
+  init(Blob, NumValues);
+}
+
+AnnotationTableReader::AnnotationTableReader(const Module &M,
+                                             const AnnotationValueNumbering &N) {
+  NamedMDNode *Table = M.getNamedMetadata(ANNOTATION_TABLE_METADATA);
+  if (!Table || Table->getNumOperands() != 1U || Table->getOperand(0U)->getNumOperands() != 1U)
+    return;
+  if (MDString *S = dyn_cast<MDString>(Table->getOperand(0U)->getOperand(0U)))
+    init(S->getString(), N.size());
+}
+
+void AnnotationTableReader::init(StringRef B, uint32_t NumValues) {
+  if (B.size() < HeaderSize || std::memcmp(B.data(), TableMagic, sizeof(TableMagic)) != 0)
+    return;
+  const char *P = B.data();
+  if (support::endian::read32le(P + 4) != TableVersion ||
+      support::endian::read32le(P + 8) != NumValues)
+    return;
+  uint32_t N = support::endian::read32le(P + 12);
+  if (B.size() != HeaderSize + (uint64_t)N * AnnotationRecord::EncodedSize)
+    return;
+  Blob = B;
+  NumRecords = N;
+  Valid = true;
+}
+
+uint32_t AnnotationTableReader::getRecordID(uint32_t I) const {
+  return support::endian::read32le(Blob.data() + HeaderSize + I * AnnotationRecord::EncodedSize);
+}
+
+void AnnotationTableReader::getRecord(uint32_t I, AnnotationRecord &Out) const {
+  assert(I < NumRecords && "Record index out of range.");
+  const char *P = Blob.data() + HeaderSize + I * AnnotationRecord::EncodedSize;
+  Out.ValueID = support::endian::read32le(P);
+  Out.Flags = support::endian::read32le(P + 4);
+  Out.Width = static_cast<int32_t>(support::endian::read32le(P + 8));
+  Out.PointPos = support::endian::read32le(P + 12);
+  Out.Min = decodeDouble(P + 16);
+  Out.Max = decodeDouble(P + 24);
+  Out.Error = decodeDouble(P + 32);
+  Out.AbsError = decodeDouble(P + 40);
+}
+
+bool AnnotationTableReader::lookup(uint32_t ID, AnnotationRecord &Out) const {
+  if (!Valid)
+    return false;
+  uint32_t Lo = 0, Hi = NumRecords;
+  while (Lo < Hi) {
+    uint32_t Mid = Lo + (Hi - Lo) / 2;
+    uint32_t MidID = getRecordID(Mid);
+    if (MidID == ID) {
+      getRecord(Mid, Out);
+      return true;
+    }
+    if (MidID < ID)
+      Lo = Mid + 1;
+    else
+      Hi = Mid;
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,159 @@
+//===-- AnnotationTable.h - Binary Side-Table of TAFFO Annotations -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Compact encoding of the scalar input info of a module (types, ranges
+/// and errors) as a single binary blob, alternative to the per-value
+/// metadata described in doc/MetadataFormat.md.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_ANNOTATION_TABLE_H
+#define TAFFOUTILS_ANNOTATION_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Value.h"
+#include "InputInfo.h"
+
+#define ANNOTATION_TABLE_METADATA "taffo.table"
+
+namespace mdutils {
+
+/// Fixed-size record of the annotations of a single value.
+struct AnnotationRecord {
+  enum RecordFlags : uint32_t {
+    HasType = 1U << 0,
+    HasRange = 1U << 1,
+    HasError = 1U << 2,
+    HasAbsError = 1U << 3,
+    EnableConversion = 1U << 4,
+    Final = 1U << 5
+  };
+
+  uint32_t ValueID = 0;
+  uint32_t Flags = 0;
+  int32_t Width = 0;     ///< Signed width of the fixp type, if HasType.
+  uint32_t PointPos = 0; ///< Fractional bits of the fixp type, if HasType.
+  double Min = 0.0;      ///< Range, if HasRange.
+  double Max = 0.0;
+  double Error = 0.0;    ///< Initial error, if HasError.
+  double AbsError = 0.0; ///< Computed absolute error, if HasAbsError.
+
+  /// Size of a record in the encoded table.
+  static const size_t EncodedSize = 48U;
+
+  bool has(RecordFlags F) const { return (Flags & F) != 0; }
+
+  /// Fill the type, range, initial error and flags from II.
+  /// Return false if II has a type which cannot be encoded.
+  bool setInputInfo(const InputInfo &II);
+
+  /// Build the InputInfo described by this record.
+  std::unique_ptr<InputInfo> toInputInfo() const;
+};
+
+/// Numbering of the values which may be annotated in a module: the global
+/// variables in module order, followed by the arguments and then the
+/// instructions of each function, in module order.
+/// The numbering is only valid as long as the module is not modified.
+class AnnotationValueNumbering {
+public:
+  explicit AnnotationValueNumbering(const llvm::Module &M);
+
+  /// Return the ID of V, or NoID if V is not numbered.
+  uint32_t getID(const llvm::Value *V) const {
+    auto It = IDs.find(V);
+    return It != IDs.end() ? It->second : NoID;
+  }
+
+  uint32_t size() const { return IDs.size(); }
+
+  static const uint32_t NoID = ~0U;
+
+  /// Call F(ID, V) for each numbered value, in ID order.
+  template <typename Fn>
+  static void forEachValue(const llvm::Module &M, Fn F) {
+    uint32_t ID = 0;
+    for (const llvm::GlobalVariable &GV : M.globals())
+      F(ID++, GV);
+    for (const llvm::Function &Fun : M) {
+      for (const llvm::Argument &Arg : Fun.args())
+        F(ID++, Arg);
+      for (const llvm::BasicBlock &BB : Fun)
+        for (const llvm::Instruction &I : BB)
+          F(ID++, I);
+    }
+  }
+
+private:
+  llvm::DenseMap<const llvm::Value *, uint32_t> IDs;
+};
+
+/// Builds the annotation table of a module.
+class AnnotationTableWriter {
+public:
+  /// Add (or replace) the record of R.ValueID.
+  void addRecord(const AnnotationRecord &R);
+
+  /// Add a record for every value of M which has scalar input info or a
+  /// computed absolute error in the metadata format.
+  /// Struct and constant operand infos are not encoded.
+  void addFromMetadata(llvm::Module &M);
+
+  /// Encode the records as the ANNOTATION_TABLE_METADATA named metadata of
+  /// M, replacing any previous table. NumValues is the size of the
+  /// AnnotationValueNumbering of M.
+  void write(llvm::Module &M, uint32_t NumValues);
+
+  /// Encode the records into a blob.
+  std::string encode(uint32_t NumValues);
+
+private:
+  std::vector<AnnotationRecord> Records;
+};
+
+/// Reads records from an encoded annotation table without allocating.
+/// The reader refers to the blob, which must outlive it.
+class AnnotationTableReader {
+public:
+  /// Create a reader over Blob, encoded for NumValues values.
+  /// The reader is invalid if Blob is malformed or has been encoded for a
+  /// different number of values.
+  AnnotationTableReader(llvm::StringRef Blob, uint32_t NumValues);
+
+  /// Create a reader over the table of M, if any.
+  AnnotationTableReader(const llvm::Module &M, const AnnotationValueNumbering &N);
+
+  bool isValid() const { return Valid; }
+
+  uint32_t getNumRecords() const { return NumRecords; }
+
+  /// Look up the record of the value ID. Return false if there is none.
+  bool lookup(uint32_t ID, AnnotationRecord &Out) const;
+
+  /// Decode the I-th record of the table.
+  void getRecord(uint32_t I, AnnotationRecord &Out) const;
+
+private:
+  llvm::StringRef Blob;
+  uint32_t NumRecords = 0;
+  bool Valid = false;
+
+  void init(llvm::StringRef B, uint32_t NumValues);
+  uint32_t getRecordID(uint32_t I) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,285 @@
+//===-- BoundaryConversions.cpp - Boundary Array Conversions ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Replacement of the loops which convert whole arrays between floating
+/// point and fixed point with calls to the vectorized routines of
+/// lib/FixedMath/TaffoConvert.h.
+///
+//===----------------------------------------------------------------------===//
+
+#include "BoundaryConversions.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#if LLVM_VERSION_MAJOR >= 11
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#else
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#endif
+
+using namespace llvm;
+
+#define DEBUG_TYPE "taffo-boundary"
+
+ALWAYS_ENABLED_STATISTIC(NumArrayConversions, "Number of array conversion loops replaced by the runtime");
+
+namespace taffo {
+
+std::string getArrayConversionName(bool ToFixed, const Type *FloatTy, unsigned IntWidth, bool Signed) {
+  const char *Float;
+  if (FloatTy->isFloatTy())
+    Float = "f32";
+  else if (FloatTy->isDoubleTy())
+    Float = "f64";
+  else
+    return "";
+  if (IntWidth != 8 && IntWidth != 16 && IntWidth != 32 && IntWidth != 64)
+    return "";
+  std::string Int = (Signed ? "s" : "u") + std::to_string(IntWidth);
+  if (ToFixed)
+    return std::string("taffo_fixm_to_fixed_") + Float + "_" + Int;
+  return "taffo_fixm_from_fixed_" + Int + "_" + Float;
+}
+
+namespace {
+
+/* The conversion of one element: Store stores the conversion of the value
+ * of Load, through the instructions in Chain */
+struct ElementConversion {
+  LoadInst *Load = nullptr;
+  StoreInst *Store = nullptr;
+  bool ToFixed;
+  bool Signed;
+  Constant *Scale = nullptr;
+  SmallVector<Instruction *, 3> Chain;
+};
+
+/* If V is X * C, C * X, or X / C with 1 / C exact, sets Scale to C or 1 / C
+ * and returns X; otherwise sets Scale to 1 and returns V */
+Value *matchScale(Value *V, Constant *&Scale, SmallVectorImpl<Instruction *> &Chain) {
+  Scale = ConstantFP::get(V->getType(), 1.0);
+  auto *BO = dyn_cast<BinaryOperator>(V);
+  if (!BO || !BO->hasOneUse())
+    return V;
+  if (BO->getOpcode() == Instruction::FMul) {
+    for (unsigned Op = 0; Op < 2; Op++) {
+      if (auto *C = dyn_cast<ConstantFP>(BO->getOperand(Op))) {
+        Scale = C;
+        Chain.push_back(BO);
+        return BO->getOperand(1 - Op);
+      }
+    }
+  } else if (BO->getOpcode() == Instruction::FDiv) {
+    auto *C = dyn_cast<ConstantFP>(BO->getOperand(1));
+    APFloat Inverse(0.0);
+    if (C && C->getValueAPF().getExactInverse(&Inverse)) {
+      Scale = ConstantFP::get(V->getContext(), Inverse);
+      Chain.push_back(BO);
+      return BO->getOperand(0);
+    }
+  }
+  return V;
+}
+
+/* Matches the conversion of the value stored by S */
+bool matchElementConversion(StoreInst &S, ElementConversion &Conv) {
+  Conv.Store = &S;
+  Value *V = S.getValueOperand();
+  Value *X;
+  if (auto *FToI = dyn_cast<FPToSIInst>(V)) {
+    Conv.ToFixed = true;
+    Conv.Signed = true;
+    Conv.Chain.push_back(FToI);
+  } else if (auto *FToI = dyn_cast<FPToUIInst>(V)) {
+    Conv.ToFixed = true;
+    Conv.Signed = false;
+    Conv.Chain.push_back(FToI);
+  } else {
+    Conv.ToFixed = false;
+  }
+
+  if (Conv.ToFixed) {
+    if (!V->hasOneUse())
+      return false;
+    X = matchScale(cast<Instruction>(V)->getOperand(0), Conv.Scale, Conv.Chain);
+  } else {
+    if (!V->getType()->isFloatingPointTy())
+      return false;
+    Value *IToF = matchScale(V, Conv.Scale, Conv.Chain);
+    if (!isa<SIToFPInst>(IToF) && !isa<UIToFPInst>(IToF))
+      return false;
+    if (!IToF->hasOneUse())
+      return false;
+    Conv.Signed = isa<SIToFPInst>(IToF);
+    Conv.Chain.push_back(cast<Instruction>(IToF));
+    X = cast<Instruction>(IToF)->getOperand(0);
+  }
+
+  Conv.Load = dyn_cast<LoadInst>(X);
+  return Conv.Load && Conv.Load->isSimple() && Conv.Load->hasOneUse();
+}
+
+/* The only conversion of L, if L has no other memory accesses or calls */
+bool findElementConversion(Loop &L, ElementConversion &Conv) {
+  StoreInst *Store = nullptr;
+  LoadInst *Load = nullptr;
+  for (BasicBlock *BB : L.blocks()) {
+    for (Instruction &I : *BB) {
+      if (isa<DbgInfoIntrinsic>(&I))
+        continue;
+      if (auto *S = dyn_cast<StoreInst>(&I)) {
+        if (Store || !S->isSimple())
+          return false;
+        Store = S;
+      } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        if (Load)
+          return false;
+        Load = LI;
+      } else if (I.mayReadOrWriteMemory()) {
+        return false;
+      }
+    }
+  }
+  return Store && Load && matchElementConversion(*Store, Conv) && Conv.Load == Load;
+}
+
+/* The pointer of I, if it is an element of an array which L accesses in
+ * consecutive order */
+const SCEVAddRecExpr *getConsecutiveAccess(Instruction &I, Value *Ptr, Type *ElemTy, Loop &L,
+                                           ScalarEvolution &SE) {
+  const DataLayout &DL = I.getModule()->getDataLayout();
+  if (Ptr->getType()->getPointerAddressSpace() != 0 ||
+      DL.getTypeStoreSize(ElemTy) != DL.getTypeAllocSize(ElemTy))
+    return nullptr;
+  auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+  if (!AR || AR->getLoop() != &L || !AR->isAffine())
+    return nullptr;
+  auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+  if (!Step || Step->getAPInt() != DL.getTypeAllocSize(ElemTy))
+    return nullptr;
+  return AR;
+}
+
+/* The number of times BB is executed by each execution of L */
+const SCEV *getExecutionCount(Loop &L, BasicBlock *BB, Type *IntPtrTy, ScalarEvolution &SE, DominatorTree &DT) {
+  const SCEV *BTC = SE.getBackedgeTakenCount(&L);
+  if (isa<SCEVCouldNotCompute>(BTC))
+    return nullptr;
+  const SCEV *Count = SE.getTruncateOrZeroExtend(BTC, IntPtrTy);
+
+  /* before the exit test in each iteration */
+  SmallVector<BasicBlock *, 4> Exiting;
+  L.getExitingBlocks(Exiting);
+  bool BeforeExits = true;
+  for (BasicBlock *E : Exiting)
+    BeforeExits &= DT.dominates(BB, E);
+  if (BeforeExits)
+    return SE.getAddExpr(Count, SE.getOne(IntPtrTy));
+
+  /* after the exit test in the header, in each iteration that continues */
+  BasicBlock *Latch = L.getLoopLatch();
+  if (L.getExitingBlock() == L.getHeader() && BB != L.getHeader() && Latch && DT.dominates(BB, Latch))
+    return Count;
+  return nullptr;
+}
+
+bool replaceConversionLoop(Loop &L, ScalarEvolution &SE, DominatorTree &DT) {
+  BasicBlock *Preheader = L.getLoopPreheader();
+  if (!Preheader)
+    return false;
+  ElementConversion Conv;
+  if (!findElementConversion(L, Conv))
+    return false;
+
+  Type *FloatTy = Conv.ToFixed ? Conv.Load->getType() : Conv.Store->getValueOperand()->getType();
+  Type *IntTy = Conv.ToFixed ? Conv.Store->getValueOperand()->getType() : Conv.Load->getType();
+  if (!IntTy->isIntegerTy())
+    return false;
+  std::string Name = getArrayConversionName(Conv.ToFixed, FloatTy, IntTy->getIntegerBitWidth(), Conv.Signed);
+  if (Name.empty())
+    return false;
+
+  const SCEVAddRecExpr *Src = getConsecutiveAccess(*Conv.Load, Conv.Load->getPointerOperand(),
+                                                   Conv.Load->getType(), L, SE);
+  const SCEVAddRecExpr *Dst = getConsecutiveAccess(*Conv.Store, Conv.Store->getPointerOperand(),
+                                                   Conv.Store->getValueOperand()->getType(), L, SE);
+  Module *M = Preheader->getModule();
+  const DataLayout &DL = M->getDataLayout();
+  Type *IntPtrTy = DL.getIntPtrType(M->getContext());
+  const SCEV *Count = getExecutionCount(L, Conv.Store->getParent(), IntPtrTy, SE, DT);
+  if (!Src || !Dst || !Count || !isSafeToExpand(Src->getStart(), SE) || !isSafeToExpand(Dst->getStart(), SE) ||
+      !isSafeToExpand(Count, SE))
+    return false;
+
+  Instruction *InsertPt = Preheader->getTerminator();
+  SCEVExpander Expander(SE, DL, "taffo.conv");
+  Value *SrcPtr = Expander.expandCodeFor(Src->getStart(), Conv.Load->getPointerOperandType(), InsertPt);
+  Value *DstPtr = Expander.expandCodeFor(Dst->getStart(), Conv.Store->getPointerOperandType(), InsertPt);
+  Value *N = Expander.expandCodeFor(Count, IntPtrTy, InsertPt);
+
+  Type *SrcTy = Conv.ToFixed ? FloatTy : IntTy;
+  Type *DstTy = Conv.ToFixed ? IntTy : FloatTy;
+  FunctionCallee Callee = M->getOrInsertFunction(Name, Type::getVoidTy(M->getContext()), SrcTy->getPointerTo(),
+                                                 DstTy->getPointerTo(), IntPtrTy, FloatTy);
+  IRBuilder<> Builder(InsertPt);
+  Builder.CreateCall(Callee, {Builder.CreatePointerCast(SrcPtr, SrcTy->getPointerTo()),
+                              Builder.CreatePointerCast(DstPtr, DstTy->getPointerTo()), N, Conv.Scale});
+
+  /* the chain goes from the store to the load */
+  Conv.Store->eraseFromParent();
+  for (Instruction *I : Conv.Chain)
+    I->eraseFromParent();
+  Conv.Load->eraseFromParent();
+  return true;
+}
+
+}
+
+unsigned vectorizeBoundaryConversions(Function &F) {
+  if (F.isDeclaration())
+    return 0;
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+  TargetLibraryInfo TLI(TLII);
+  AssumptionCache AC(F);
+  ScalarEvolution SE(F, TLI, AC, DT, LI);
+
+  unsigned Count = 0;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    if (L->getSubLoops().empty() && replaceConversionLoop(*L, SE, DT)) {
+      SE.forgetLoop(L);
+      Count++;
+    }
+  }
+  NumArrayConversions += Count;
+  return Count;
+}
+
+unsigned vectorizeBoundaryConversions(Module &M) {
+  unsigned Count = 0;
+  for (Function &F : M)
+    Count += vectorizeBoundaryConversions(F);
+  return Count;
+}
+
+}
@@ -0,0 +1,50 @@
+//===-- BoundaryConversions.h - Boundary Array Conversions ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Replacement of the loops which convert whole arrays between floating
+/// point and fixed point with calls to the vectorized routines of
+/// lib/FixedMath/TaffoConvert.h.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_BOUNDARY_CONVERSIONS_H
+#define TAFFOUTILS_BOUNDARY_CONVERSIONS_H
+
+#include <string>
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Type.h"
+
+namespace taffo {
+
+/// The name of the routine which converts arrays of FloatTy to arrays of
+/// integers of IntWidth bits (ToFixed), or the other way around; empty if
+/// the runtime has none.
+std::string getArrayConversionName(bool ToFixed, const llvm::Type *FloatTy, unsigned IntWidth, bool Signed);
+
+/// Replace the loops of F which only convert an array element by element
+/// with a call to the routine of the conversion in their preheader. The
+/// loops must store in consecutive elements of an array, in each
+/// iteration, the conversion of an element of another array loaded at the
+/// same index: fpto[su]i(x * C), fpto[su]i(x / C), [su]itofp(x) * C or
+/// [su]itofp(x) / C, with C a constant whose inverse is exact in the
+/// division. The loops with other memory accesses or calls are not
+/// changed, so the conversions already computed in the loops which use
+/// their values are left there. The stores and the conversions are
+/// removed, and the remaining loops, which only count, are deleted by the
+/// optimizations after TAFFO. Returns the number of loops replaced.
+unsigned vectorizeBoundaryConversions(llvm::Function &F);
+
+/// vectorizeBoundaryConversions on each function of M.
+unsigned vectorizeBoundaryConversions(llvm::Module &M);
+
+}
+
+#endif
@@ -0,0 +1,155 @@
+//===-- CloneMerging.cpp - Merging of the Equivalent Clones -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Merging of the functions cloned by TAFFO whose converted code ended up
+/// the same, to save the code size of the copies.
+///
+//===----------------------------------------------------------------------===//
+
+#include "CloneMerging.h"
+
+#include <algorithm>
+#include <map>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Transforms/Utils/FunctionComparator.h"
+#include "Metadata.h"
+#include "Trace.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "taffo-clone-merging"
+
+ALWAYS_ENABLED_STATISTIC(NumMergedClones, "Number of clones merged into an equivalent function");
+ALWAYS_ENABLED_STATISTIC(NumMergedCloneBytes, "Estimate of the bytes of code of the merged clones");
+
+namespace taffo {
+
+bool isTaffoClone(const Function &F) {
+  return F.getMetadata(SOURCE_FUN_METADATA) || F.getMetadata(ORIGINAL_FUN_METADATA);
+}
+
+uint64_t estimateCodeSize(const Function &F, unsigned BytesPerInstruction) {
+  uint64_t Count = 0;
+  for (const Instruction &I : instructions(F)) {
+    if (!isa<DbgInfoIntrinsic>(&I))
+      Count++;
+  }
+  return Count * BytesPerInstruction;
+}
+
+/* Replace the body of F with a tail call to Into, and its direct calls
+ * with calls to Into, leaving F only as the address it had */
+static void writeThunk(Function &F, Function &Into) {
+  SmallVector<CallBase *, 8> Calls;
+  for (Use &U : F.uses()) {
+    auto *Call = dyn_cast<CallBase>(U.getUser());
+    if (Call && Call->isCallee(&U))
+      Calls.push_back(Call);
+  }
+  for (CallBase *Call : Calls)
+    Call->setCalledFunction(&Into);
+
+  /* deleteBody makes it external, and removes its metadata, so that it is
+   * no longer a clone to merge */
+  GlobalValue::LinkageTypes Linkage = F.getLinkage();
+  F.deleteBody();
+  F.setLinkage(Linkage);
+  IRBuilder<> B(BasicBlock::Create(F.getContext(), "entry", &F));
+  SmallVector<Value *, 8> Args;
+  for (Argument &Arg : F.args())
+    Args.push_back(&Arg);
+  CallInst *Call = B.CreateCall(&Into, Args);
+  Call->setTailCall();
+  Call->setCallingConv(Into.getCallingConv());
+  if (F.getReturnType()->isVoidTy())
+    B.CreateRetVoid();
+  else
+    B.CreateRet(Call);
+}
+
+std::vector<MergedClone> mergeEquivalentClones(Module &M) {
+  std::vector<MergedClone> Merged;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    GlobalNumberState Numbers;
+    std::map<FunctionComparator::FunctionHash, SmallVector<Function *, 4>> Buckets;
+    for (Function &F : M) {
+      if (!F.isDeclaration())
+        Buckets[FunctionComparator::functionHash(F)].push_back(&F);
+    }
+
+    for (auto &Bucket : Buckets) {
+      /* the functions which are kept first, so that the clones are merged
+       * into them */
+      auto IsRemovable = [](Function *F) { return isTaffoClone(*F) && F->hasLocalLinkage(); };
+      std::stable_partition(Bucket.second.begin(), Bucket.second.end(),
+                            [&](Function *F) { return !IsRemovable(F); });
+      SmallVector<Function *, 4> Kept;
+      for (Function *F : Bucket.second) {
+        Function *Into = nullptr;
+        if (IsRemovable(F)) {
+          for (Function *K : Kept) {
+            if (!K->isInterposable() && FunctionComparator(F, K, &Numbers).compare() == 0) {
+              Into = K;
+              break;
+            }
+          }
+        }
+        if (!Into) {
+          Kept.push_back(F);
+          continue;
+        }
+        TAFFO_TRACE(TraceStage::Conversion, F, nullptr, nullptr, "merged clone");
+        Merged.push_back({F->getName().str(), Into->getName().str(), estimateCodeSize(*F)});
+        /* the address of F cannot become the one of Into when it may be
+         * compared to it */
+        if (F->hasGlobalUnnamedAddr() || !F->hasAddressTaken()) {
+          F->replaceAllUsesWith(Into);
+          F->eraseFromParent();
+        } else {
+          writeThunk(*F, *Into);
+          Merged.back().Bytes -= estimateCodeSize(*F);
+        }
+        NumMergedCloneBytes += Merged.back().Bytes;
+        Changed = true;
+      }
+    }
+  }
+  NumMergedClones += Merged.size();
+  return Merged;
+}
+
+void writeCloneMergeReport(ArrayRef<MergedClone> Merged, raw_ostream &OS) {
+  uint64_t Bytes = 0;
+  json::OStream J(OS, 2);
+  J.object([&]() {
+    J.attribute("version", 1);
+    J.attributeArray("merged", [&]() {
+      for (const MergedClone &C : Merged) {
+        J.object([&]() {
+          J.attribute("function", C.Name);
+          J.attribute("into", C.Into);
+          J.attribute("bytes", (int64_t)C.Bytes);
+        });
+        Bytes += C.Bytes;
+      }
+    });
+    J.attribute("bytes", (int64_t)Bytes);
+  });
+  OS << "\n";
+}
+
+}
@@ -0,0 +1,68 @@
+//===-- CloneMerging.h - Merging of the Equivalent Clones -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Merging of the functions cloned by TAFFO whose converted code ended up
+/// the same, to save the code size of the copies.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_CLONE_MERGING_H
+#define TAFFOUTILS_CLONE_MERGING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace taffo {
+
+/// A clone replaced by an equivalent function.
+struct MergedClone {
+  std::string Name;
+  std::string Into;
+  /// The estimate of the size of the code of the clone, in bytes, less the
+  /// one of its thunk if it was kept as one.
+  uint64_t Bytes;
+};
+
+/// Whether F was cloned by TAFFO from another function: it has a
+/// taffo.sourceFunction or a taffo.originalCall.
+bool isTaffoClone(const llvm::Function &F);
+
+/// An estimate of the size of the code of F: BytesPerInstruction bytes for
+/// each of its instructions, except the debug intrinsics.
+uint64_t estimateCodeSize(const llvm::Function &F, unsigned BytesPerInstruction = 4);
+
+/// Replace the clones of M with local linkage whose signature and body are
+/// the same as the ones of another function of M with those of the other
+/// function, and remove them. The clones are merged into the originals and
+/// the clones which cannot be removed when possible, otherwise into the
+/// first equivalent clone. The clones whose address is taken and may be
+/// compared (they are not unnamed_addr) are kept as thunks which tail call
+/// the other function.
+/// Since the callers of the merged clones may become the same in turn, it
+/// is repeated until nothing changes. Returns the clones merged.
+std::vector<MergedClone> mergeEquivalentClones(llvm::Module &M);
+
+/// Write to OS a JSON report of the clones merged:
+///
+///     {"version": 1,
+///      "merged": [{"function": ..., "into": ..., "bytes": ...}],
+///      "bytes": ...}
+///
+/// where the bytes are the estimates of estimateCodeSize, and their total.
+void writeCloneMergeReport(llvm::ArrayRef<MergedClone> Merged, llvm::raw_ostream &OS);
+
+}
+
+#endif
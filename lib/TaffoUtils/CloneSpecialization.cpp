@@ -0,0 +1,187 @@
+//===-- CloneSpecialization.cpp - Clones Specialized on Ranges --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Specialization of the functions cloned by TAFFO on the ranges of the
+/// arguments at their call sites.
+///
+//===----------------------------------------------------------------------===//
+
+#include "CloneSpecialization.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <map>
+#include <vector>
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-clone-specialization"
+
+ALWAYS_ENABLED_STATISTIC(NumSpecializedClones, "Number of copies of the functions specialized on the ranges of their arguments");
+
+namespace taffo {
+
+std::shared_ptr<Range> getCallSiteRange(const Value *V) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  if (auto *C = dyn_cast<ConstantFP>(V)) {
+    double Val = C->getValueAPF().convertToDouble();
+    return std::make_shared<Range>(Val, Val);
+  }
+  InputInfo *II = nullptr;
+  if (auto *I = dyn_cast<Instruction>(V)) {
+    II = MM.retrieveInputInfo(*I);
+  } else if (auto *A = dyn_cast<Argument>(V)) {
+    SmallVector<MDInfo *, 4> ArgInfos;
+    MM.retrieveArgumentInputInfo(*A->getParent(), ArgInfos);
+    if (A->getArgNo() < ArgInfos.size())
+      II = dyn_cast_or_null<InputInfo>(ArgInfos[A->getArgNo()]);
+  }
+  if (!II || !II->IRange || std::isnan(II->IRange->Min) || std::isnan(II->IRange->Max))
+    return nullptr;
+  return II->IRange;
+}
+
+void appendRangeSignature(const Range *R, SmallVectorImpl<int> &Sig) {
+  if (!R) {
+    Sig.push_back(INT_MAX);
+    Sig.push_back(1);
+    return;
+  }
+  double Mag = std::max(std::abs(R->Min), std::abs(R->Max));
+  if (std::isinf(Mag))
+    Sig.push_back(INT_MAX);
+  else
+    Sig.push_back(Mag == 0.0 ? INT_MIN : std::ilogb(Mag) + 1);
+  Sig.push_back(R->Min < 0.0);
+}
+
+SmallVector<int, 8> getCallRangeSignature(const CallInst &Call) {
+  SmallVector<int, 8> Sig;
+  for (const Value *Arg : Call.args()) {
+    if (Arg->getType()->isFloatingPointTy())
+      appendRangeSignature(getCallSiteRange(Arg).get(), Sig);
+  }
+  return Sig;
+}
+
+/* Union of the ranges of the I-th argument of Calls; nullptr if one of them
+ * is not known */
+static std::shared_ptr<Range> argumentRangeUnion(ArrayRef<CallInst *> Calls, unsigned I) {
+  std::shared_ptr<Range> Res;
+  for (CallInst *Call : Calls) {
+    std::shared_ptr<Range> R = getCallSiteRange(Call->getArgOperand(I));
+    if (!R)
+      return nullptr;
+    if (!Res)
+      Res = std::make_shared<Range>(R->Min, R->Max);
+    Res->Min = std::min(Res->Min, R->Min);
+    Res->Max = std::max(Res->Max, R->Max);
+  }
+  return Res;
+}
+
+/* Copy of F called by Calls, with the ranges of its arguments narrowed to
+ * the ones at the calls */
+static Function *createSpecializedClone(Function &F, ArrayRef<CallInst *> Calls) {
+  ValueToValueMapTy VMap;
+  Function *NewF = CloneFunction(&F, VMap);
+  NewF->setName(F.getName() + ".spec");
+  NewF->setLinkage(GlobalValue::InternalLinkage);
+  NewF->setComdat(nullptr);
+
+  SmallVector<MDInfo *, 4> ArgInfos;
+  MetadataManager::getMetadataManager().retrieveArgumentInputInfo(F, ArgInfos);
+  std::vector<std::unique_ptr<MDInfo>> NewInfos;
+  SmallVector<MDInfo *, 4> NewArgInfos;
+  for (unsigned I = 0; I < ArgInfos.size(); I++) {
+    InputInfo *II = dyn_cast_or_null<InputInfo>(ArgInfos[I]);
+    std::shared_ptr<Range> R;
+    if (II && F.getArg(I)->getType()->isFloatingPointTy())
+      R = argumentRangeUnion(Calls, I);
+    if (!R) {
+      NewArgInfos.push_back(ArgInfos[I]);
+      continue;
+    }
+    InputInfo *NewII = cast<InputInfo>(II->clone());
+    NewII->IRange = R;
+    NewInfos.emplace_back(NewII);
+    NewArgInfos.push_back(NewII);
+  }
+  if (!ArgInfos.empty())
+    MetadataManager::setArgumentInputInfoMetadata(*NewF, NewArgInfos);
+
+  /* the original function lists all its clones */
+  if (auto *OrigMD = F.getMetadata(ORIGINAL_FUN_METADATA)) {
+    auto *VMD = dyn_cast_or_null<ValueAsMetadata>(OrigMD->getOperand(0).get());
+    Function *Orig = VMD ? dyn_cast<Function>(VMD->getValue()->stripPointerCasts()) : nullptr;
+    MDNode *Clones = Orig ? Orig->getMetadata(CLONED_FUN_METADATA) : nullptr;
+    if (Clones) {
+      SmallVector<Metadata *, 8> Ops(Clones->op_begin(), Clones->op_end());
+      Ops.push_back(ValueAsMetadata::get(NewF));
+      Orig->setMetadata(CLONED_FUN_METADATA, MDNode::get(F.getContext(), Ops));
+    }
+  }
+
+  for (CallInst *Call : Calls)
+    Call->setCalledFunction(NewF);
+  return NewF;
+}
+
+unsigned specializeClonesOnCallRanges(Module &M, unsigned MaxClones) {
+  if (MaxClones < 2)
+    return 0;
+
+  std::vector<Function *> Clones;
+  for (Function &F : M) {
+    if (!F.isDeclaration() && F.getMetadata(ORIGINAL_FUN_METADATA))
+      Clones.push_back(&F);
+  }
+
+  unsigned Count = 0;
+  for (Function *F : Clones) {
+    /* calls grouped by signature, in the order of their first call */
+    std::map<SmallVector<int, 8>, unsigned> GroupOf;
+    std::vector<SmallVector<CallInst *, 4>> Groups;
+    for (User *U : F->users()) {
+      CallInst *Call = dyn_cast<CallInst>(U);
+      if (!Call || Call->getCalledFunction() != F || Call->getFunction() == F)
+        continue;
+      auto Ins = GroupOf.insert({getCallRangeSignature(*Call), Groups.size()});
+      if (Ins.second)
+        Groups.emplace_back();
+      Groups[Ins.first->second].push_back(Call);
+    }
+    if (Groups.size() < 2)
+      continue;
+
+    /* the calls with the most frequent signatures get a copy each, at
+     * least one group is left to the existing clone */
+    std::stable_sort(Groups.begin(), Groups.end(),
+        [](const SmallVector<CallInst *, 4> &A, const SmallVector<CallInst *, 4> &B) {
+          return A.size() > B.size();
+        });
+    size_t NumSpecialized = std::min<size_t>(MaxClones - 1, Groups.size() - 1);
+    for (size_t I = 0; I < NumSpecialized; I++) {
+      createSpecializedClone(*F, Groups[I]);
+      Count++;
+    }
+  }
+  NumSpecializedClones += Count;
+  return Count;
+}
+
+}
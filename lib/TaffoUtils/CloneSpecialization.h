@@ -0,0 +1,55 @@
+//===-- CloneSpecialization.h - Clones Specialized on Ranges ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Specialization of the functions cloned by TAFFO on the ranges of the
+/// arguments at their call sites.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_CLONE_SPECIALIZATION_H
+#define TAFFOUTILS_CLONE_SPECIALIZATION_H
+
+#include <memory>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// The range of V at a call site: the value of a floating point constant,
+/// or the range in the metadata of an instruction or in the taffo.funinfo
+/// of the function of an argument. nullptr if it is not known.
+std::shared_ptr<mdutils::Range> getCallSiteRange(const llvm::Value *V);
+
+/// Append to Sig the signature of R: the number of bits of its integer
+/// part and whether it may be negative, or an unknown signature if R is
+/// nullptr or unbounded.
+void appendRangeSignature(const mdutils::Range *R, llvm::SmallVectorImpl<int> &Sig);
+
+/// The signature of the ranges of the floating point arguments of Call:
+/// for each of them, the number of bits of its integer part and whether
+/// it may be negative. The calls with the same signature need the same
+/// fixed point types for the arguments.
+llvm::SmallVector<int, 8> getCallRangeSignature(const llvm::CallInst &Call);
+
+/// Split the functions cloned by TAFFO (the ones with taffo.originalCall)
+/// whose calls have different range signatures in up to MaxClones
+/// functions. The calls with the most frequent signatures are redirected
+/// to new copies of the clone, whose taffo.funinfo has the union of the
+/// ranges of their calls. The remaining calls keep calling the existing
+/// clone. The ranges in the copies are the ones of the clone they are
+/// copied from, thus VRA must run again to narrow them.
+/// Returns the number of functions created.
+unsigned specializeClonesOnCallRanges(llvm::Module &M, unsigned MaxClones);
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+//===-- ErrorBudget.cpp - Type Allocation from an Error Budget --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Allocation of the narrowest fixed point types which keep the errors of
+/// the targets within an absolute error budget.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ErrorBudget.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Instruction.h"
+#include "ErrorSummaries.h"
+#include "Metadata.h"
+#include "Trace.h"
+#include "TypeUtils.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-error-budget"
+
+ALWAYS_ENABLED_STATISTIC(NumBudgetTypes, "Number of types reassigned from the error budget");
+ALWAYS_ENABLED_STATISTIC(NumBudgetRounds, "Number of error propagations to check the error budget");
+ALWAYS_ENABLED_STATISTIC(NumBudgetsNotMet, "Number of error budgets which could not be met");
+
+namespace taffo {
+
+double ErrorBudget::get(StringRef Target) const {
+  auto It = Targets.find(Target.str());
+  return It != Targets.end() ? It->second : Default;
+}
+
+bool ErrorBudget::parse(StringRef Spec, std::string &Error) {
+  StringRef Target, Value;
+  std::tie(Target, Value) = Spec.split('=');
+  if (Value.empty())
+    std::swap(Target, Value);
+  double E;
+  if (Value.trim().getAsDouble(E) || !(E > 0.0)) {
+    Error = "invalid error budget " + Spec.str();
+    return false;
+  }
+  if (Target.empty())
+    Default = E;
+  else
+    Targets[Target.trim().str()] = E;
+  return true;
+}
+
+namespace {
+
+/* An instruction whose type is chosen from the budget */
+struct BudgetValue {
+  Instruction *I;
+  std::shared_ptr<TType> Original;
+  /* the sensitivities of the targets with a budget, and their number of
+   * instructions */
+  SmallVector<std::pair<double, double>, 2> Terms;
+};
+
+/* The narrowest type for the range R with FracBits fractional bits, or
+ * nullptr if none is at most 64 bit wide */
+std::shared_ptr<FPType> getBudgetType(const Range &R, int FracBits) {
+  for (int Width : {8, 16, 32, 64}) {
+    FixedPointTypeGenError Err;
+    FPType T = fixedPointTypeFromRange(R, &Err, Width, 0, Width, Width);
+    if (Err == FixedPointTypeGenError::NoError && (int)T.getPointPos() >= FracBits)
+      return std::make_shared<FPType>(T);
+  }
+  return nullptr;
+}
+
+void setType(Instruction &I, std::shared_ptr<TType> T, StringRef Reason) {
+  InputInfo *II = MetadataManager::getMetadataManager().retrieveInputInfo(I);
+  std::unique_ptr<InputInfo> New(cast<InputInfo>(II->clone()));
+  New->IType = T;
+  TAFFO_TRACE(TraceStage::DTA, &I, New->IRange.get(), T.get(), Reason);
+  MetadataManager::setInputInfoMetadata(I, *New);
+}
+
+}
+
+bool allocateTypesForErrorBudget(Module &M, const ErrorBudget &Budget, unsigned &NumChanged, unsigned Jobs,
+                                 unsigned MaxRounds) {
+  NumChanged = 0;
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  std::map<std::string, DenseMap<const Instruction *, double>> Sensitivities = computeErrorSensitivities(M);
+
+  /* the instructions which round to a fixed point type, by target */
+  DenseMap<Instruction *, unsigned> Index;
+  std::vector<BudgetValue> Values;
+  SmallPtrSet<Instruction *, 8> Unbounded;
+  for (const auto &T : Sensitivities) {
+    double B = Budget.get(T.first);
+    if (std::isinf(B))
+      continue;
+    std::vector<std::pair<Instruction *, double>> Reached;
+    for (const auto &S : T.second) {
+      Instruction *I = const_cast<Instruction *>(S.first);
+      InputInfo *II = mayRoundToType(*I) ? MM.retrieveInputInfo(*I) : nullptr;
+      if (!II || !II->IType || !isa<FPType>(II->IType.get()) || !II->IRange)
+        continue;
+      if (std::isinf(S.second))
+        Unbounded.insert(I);
+      else
+        Reached.push_back({I, S.second});
+    }
+    for (const auto &R : Reached) {
+      auto It = Index.insert({R.first, Values.size()});
+      if (It.second)
+        Values.push_back({R.first, MM.retrieveInputInfo(*R.first)->IType, {}});
+      /* the share of the budget of each instruction is B / N */
+      Values[It.first->second].Terms.push_back({R.second, (double)Reached.size() / B});
+    }
+  }
+  if (Values.empty())
+    return true;
+
+  double Scale = 1.0;
+  for (unsigned Round = 0; Round < MaxRounds; Round++) {
+    NumChanged = 0;
+    for (BudgetValue &V : Values) {
+      if (Unbounded.count(V.I))
+        continue;
+      double Needed = 0.0;
+      for (const auto &Term : V.Terms)
+        Needed = std::max(Needed, Term.first * Term.second / Scale);
+      int FracBits = Needed > 1.0 ? (int)std::ceil(std::log2(Needed)) : 0;
+      std::shared_ptr<FPType> T = getBudgetType(*MM.retrieveInputInfo(*V.I)->IRange, FracBits);
+      if (!T)
+        T = std::static_pointer_cast<FPType>(V.Original);
+      if (!(*T == *V.Original))
+        NumChanged++;
+      setType(*V.I, T, "error budget");
+    }
+
+    SummaryErrorPropagation Propagation(M);
+    Propagation.run(Jobs);
+    NumBudgetRounds++;
+    double Ratio = 1.0;
+    for (const auto &E : Propagation.getTargetErrors()) {
+      double B = Budget.get(E.first);
+      if (E.second > B)
+        Ratio = std::min(Ratio, B / E.second);
+    }
+    if (Ratio == 1.0) {
+      NumBudgetTypes += NumChanged;
+      return true;
+    }
+    if (!(Ratio > 0.0))
+      break;
+    Scale *= Ratio;
+  }
+
+  for (BudgetValue &V : Values)
+    setType(*V.I, V.Original, "error budget not met");
+  NumChanged = 0;
+  NumBudgetsNotMet++;
+  return false;
+}
+
+}
@@ -0,0 +1,63 @@
+//===-- ErrorBudget.h - Type Allocation from an Error Budget ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Allocation of the narrowest fixed point types which keep the errors of
+/// the targets within an absolute error budget.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_ERROR_BUDGET_H
+#define TAFFOUTILS_ERROR_BUDGET_H
+
+#include <limits>
+#include <map>
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// The largest absolute error allowed for each target.
+struct ErrorBudget {
+  /// The budget of the targets not in Targets; Inf for no budget.
+  double Default = std::numeric_limits<double>::infinity();
+  std::map<std::string, double> Targets;
+
+  double get(llvm::StringRef Target) const;
+
+  /// Add "<error>", the default budget, or "<target>=<error>". Returns
+  /// false, with a message in Error, if Spec is malformed.
+  bool parse(llvm::StringRef Spec, std::string &Error);
+};
+
+/// Reassign the fixed point types chosen by DTA to the instructions of M
+/// which round their result, so that the errors of the targets with a
+/// budget stay within it with the fewest bits. Each instruction I gets the
+/// fractional bits
+///   max over the targets T of ceil(log2(N(T) * S(I, T) / Budget(T)))
+/// where S(I, T) is the sensitivity of the error of T to the rounding
+/// error of I (computeErrorSensitivities) and N(T) the number of the
+/// instructions which reach T: this minimizes the total of the fractional
+/// bits for the linearized errors. The type is the narrowest among 8, 16,
+/// 32 and 64 bits with those fractional bits and the integer bits of the
+/// range; the other bits are given to the fraction. The instructions with
+/// an unbounded sensitivity keep their types.
+///
+/// The errors are then checked by SummaryErrorPropagation, on Jobs
+/// threads, and the budgets are scaled down by how much they were exceeded
+/// for at most MaxRounds rounds. Returns false, with the types of DTA
+/// restored, if the budget cannot be met; NumChanged is set to the number
+/// of types changed.
+bool allocateTypesForErrorBudget(llvm::Module &M, const ErrorBudget &Budget, unsigned &NumChanged,
+                                 unsigned Jobs = 1, unsigned MaxRounds = 4);
+
+}
+
+#endif
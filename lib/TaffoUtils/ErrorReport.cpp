@@ -0,0 +1,139 @@
+//===-- ErrorReport.cpp - Report of the Propagated Errors -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Machine-readable report of the propagated errors.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ErrorReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/JSON.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+namespace taffo {
+
+static Optional<double> getError(const Value *V) {
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I || !I->getMetadata(COMP_ERROR_METADATA))
+    return None;
+  return MetadataManager::retrieveErrorMetadata(*I);
+}
+
+/* JSON has no infinities */
+static json::Value errorValue(double E) {
+  if (!std::isfinite(E))
+    return nullptr;
+  return E;
+}
+
+void writeErrorReport(const Module &M, raw_ostream &OS) {
+  std::map<std::string, double> Targets;
+  auto Record = [&](StringRef Name, double E) {
+    auto Res = Targets.emplace(Name.str(), E);
+    if (!Res.second)
+      Res.first->second = std::max(Res.first->second, E);
+  };
+  for (const GlobalVariable &GV : M.globals()) {
+    Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(GV);
+    if (!Name)
+      continue;
+    InputInfo *II = dyn_cast_or_null<InputInfo>(MetadataManager::getMetadataManager().retrieveMDInfo(&GV));
+    Record(*Name, II && II->IError ? *II->IError : 0.0);
+    for (const User *U : GV.users()) {
+      auto *Store = dyn_cast<StoreInst>(U);
+      if (!Store || Store->getPointerOperand() != &GV)
+        continue;
+      if (Optional<double> E = getError(Store->getValueOperand()))
+        Record(*Name, *E);
+    }
+  }
+
+  for (const Function &F : M) {
+    for (const Instruction &I : instructions(F)) {
+      Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(I);
+      Optional<double> E = getError(&I);
+      if (Name && E)
+        Record(*Name, *E);
+    }
+  }
+
+  json::OStream J(OS, 2);
+  J.object([&]() {
+    J.attribute("version", 1);
+    J.attributeArray("targets", [&]() {
+      for (const auto &T : Targets) {
+        J.object([&]() {
+          J.attribute("name", T.first);
+          J.attribute("error", errorValue(T.second));
+        });
+      }
+    });
+
+    J.attributeArray("comparisons", [&]() {
+      for (const Function &F : M) {
+        unsigned Index = 0;
+        for (const Instruction &I : instructions(F)) {
+          std::unique_ptr<CmpErrorInfo> CEI;
+          if (I.getMetadata(WRONG_CMP_METADATA))
+            CEI = MetadataManager::retrieveCmpError(I);
+          if (CEI) {
+            std::string Location;
+            if (const DebugLoc &DL = I.getDebugLoc()) {
+              raw_string_ostream LS(Location);
+              LS << DL->getFilename() << ":" << DL.getLine() << ":" << DL.getCol();
+              LS.flush();
+            }
+            J.object([&]() {
+              J.attribute("function", F.getName());
+              J.attribute("instruction", Index);
+              J.attribute("location", Location);
+              J.attribute("max_tolerance", errorValue(CEI->MaxTolerance));
+              J.attribute("may_be_wrong", CEI->MayBeWrong);
+            });
+          }
+          Index++;
+        }
+      }
+    });
+
+    J.attributeArray("functions", [&]() {
+      for (const Function &F : M) {
+        double Max = 0.0;
+        unsigned Count = 0;
+        for (const Instruction &I : instructions(F)) {
+          if (Optional<double> E = getError(&I)) {
+            Max = std::max(Max, *E);
+            Count++;
+          }
+        }
+        if (Count == 0)
+          continue;
+        J.object([&]() {
+          J.attribute("name", F.getName());
+          J.attribute("max_error", errorValue(Max));
+          J.attribute("instructions", Count);
+        });
+      }
+    });
+  });
+  OS << "\n";
+}
+
+}
@@ -0,0 +1,43 @@
+//===-- ErrorReport.h - Report of the Propagated Errors ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Machine-readable report of the errors attached to a module by the error
+/// propagation.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_ERROR_REPORT_H
+#define TAFFOUTILS_ERROR_REPORT_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace taffo {
+
+/// Write to OS a JSON report of the errors in the metadata of M, as
+/// attached by the Error Propagator or by SummaryErrorPropagation:
+///
+///     {"version": 1,
+///      "targets": [{"name": ..., "error": ...}],
+///      "comparisons": [{"function": ..., "instruction": ..., "location": ...,
+///                       "max_tolerance": ..., "may_be_wrong": ...}],
+///      "functions": [{"name": ..., "max_error": ..., "instructions": ...}]}
+///
+/// The error of a target is the largest one of the instructions marked
+/// with its name, and of the values stored directly to the globals marked
+/// with it. The comparisons are the ones which may be wrong, identified by
+/// the index of the instruction in its function and by its debug location
+/// ("" without one). The functions have the largest error, and the number,
+/// of their instructions with an error. The unbounded errors are null.
+void writeErrorReport(const llvm::Module &M, llvm::raw_ostream &OS);
+
+}
+
+#endif
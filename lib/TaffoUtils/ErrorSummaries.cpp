@@ -0,0 +1,1132 @@
+//===-- ErrorSummaries.cpp - Summary-Based Error Propagation -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Interprocedural propagation of the absolute errors based on function
+/// summaries.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ErrorSummaries.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <thread>
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-err-summaries"
+
+ALWAYS_ENABLED_STATISTIC(NumSummaries, "Number of function summaries computed");
+ALWAYS_ENABLED_STATISTIC(NumIterations, "Number of iterations over the functions to reach the fixed points");
+ALWAYS_ENABLED_STATISTIC(NumUnbounded, "Number of errors still growing after the widening iterations");
+ALWAYS_ENABLED_STATISTIC(NumCachedSummaries, "Number of function summaries reused from the cache");
+
+namespace taffo {
+
+static const double Inf = std::numeric_limits<double>::infinity();
+
+/* number of iterations on a loop before the growing errors are unbounded */
+static const unsigned WidenAfter = 3;
+
+int getErrorSignature(double Error) {
+  if (!(Error > 0.0))
+    return Error == 0.0 ? INT_MIN : INT_MAX;
+  if (std::isinf(Error))
+    return INT_MAX;
+  int Exp;
+  double Frac = std::frexp(Error, &Exp);
+  return Frac == 0.5 ? Exp - 1 : Exp;
+}
+
+double getSignatureError(int Bits) {
+  if (Bits == INT_MIN)
+    return 0.0;
+  if (Bits == INT_MAX)
+    return Inf;
+  return std::ldexp(1.0, Bits);
+}
+
+static const InputInfo *getInfo(const Value *V) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  if (auto *I = dyn_cast<Instruction>(V))
+    return MM.retrieveInputInfo(*I);
+  if (auto *GO = dyn_cast<GlobalObject>(V))
+    return MM.retrieveInputInfo(*GO);
+  if (auto *A = dyn_cast<Argument>(V)) {
+    SmallVector<MDInfo *, 4> Infos;
+    MM.retrieveArgumentInputInfo(*A->getParent(), Infos);
+    if (A->getArgNo() < Infos.size())
+      return dyn_cast_or_null<InputInfo>(Infos[A->getArgNo()]);
+  }
+  return nullptr;
+}
+
+static double getInitialError(const InputInfo *II) {
+  return II && II->IError ? *II->IError : 0.0;
+}
+
+static Optional<Range> getRangeOf(const Value *V) {
+  if (auto *CFP = dyn_cast<ConstantFP>(V)) {
+    double C = CFP->getValueAPF().convertToDouble();
+    return Range(C, C);
+  }
+  const InputInfo *II = getInfo(V);
+  if (!II || !II->IRange)
+    return None;
+  return *II->IRange;
+}
+
+static double getMagnitude(const Range &R) {
+  return std::max(std::abs(R.Min), std::abs(R.Max));
+}
+
+static double getMinMagnitude(const Range &R) {
+  if (R.Min <= 0.0 && R.Max >= 0.0)
+    return 0.0;
+  return std::min(std::abs(R.Min), std::abs(R.Max));
+}
+
+/* The maximum rounding error of a value in the type of II */
+static double getRoundingError(const InputInfo *II) {
+  if (!II || !II->IType)
+    return 0.0;
+  if (auto *FT = dyn_cast<FloatType>(II->IType.get())) {
+    if (II->IRange)
+      return FT->getRoundingError(II->IRange->Min, II->IRange->Max);
+    return FT->getRoundingError(FT->getMinValueBound(), FT->getMaxValueBound());
+  }
+  return II->IType->getRoundingError();
+}
+
+/* The error of the constant C converted to the type of II */
+static double getRepresentationError(double C, const InputInfo *II) {
+  if (!II || !II->IType)
+    return 0.0;
+  if (auto *FPT = dyn_cast<FPType>(II->IType.get())) {
+    double Scaled = std::ldexp(C, FPT->getPointPos());
+    return Scaled == std::floor(Scaled) ? 0.0 : FPT->getRoundingError();
+  }
+  if (auto *FT = dyn_cast<FloatType>(II->IType.get())) {
+    int Exp;
+    double Scaled = std::ldexp(std::frexp(C, &Exp), FT->getPrecision());
+    return Scaled == std::floor(Scaled) ? 0.0 : FT->getRoundingError(C, C);
+  }
+  return 0.0;
+}
+
+/* e * M, where an error of zero is not scaled even by unknown magnitudes */
+static double scaleError(double E, double M) {
+  return E == 0.0 ? 0.0 : E * M;
+}
+
+static const Value *getBaseObject(const Value *P) {
+  while (true) {
+    if (auto *GEP = dyn_cast<GEPOperator>(P))
+      P = GEP->getPointerOperand();
+    else if (auto *BC = dyn_cast<BitCastOperator>(P))
+      P = BC->getOperand(0);
+    else
+      return P;
+  }
+}
+
+/* The name of the math function called, without the float suffix */
+static StringRef getMathFunctionName(const Function &Callee) {
+  if (Callee.isIntrinsic()) {
+    switch (Callee.getIntrinsicID()) {
+      case Intrinsic::sqrt: return "sqrt";
+      case Intrinsic::exp: return "exp";
+      case Intrinsic::log: return "log";
+      case Intrinsic::sin: return "sin";
+      case Intrinsic::cos: return "cos";
+      case Intrinsic::fabs: return "fabs";
+      case Intrinsic::minnum: return "fmin";
+      case Intrinsic::maxnum: return "fmax";
+      case Intrinsic::fma:
+      case Intrinsic::fmuladd:
+        return "fma";
+      default:
+        return "";
+    }
+  }
+  static const char *const Names[] = {
+    "sqrt", "exp", "log", "sin", "cos", "fabs", "fmin", "fmax", "fma"
+  };
+  StringRef Name = Callee.getName();
+  for (const char *Math : Names) {
+    if (Name == Math || Name == (std::string(Math) + "f"))
+      return Math;
+  }
+  return "";
+}
+
+bool mayRoundToType(const Instruction &I) {
+  switch (I.getOpcode()) {
+    case Instruction::FAdd:
+    case Instruction::FSub:
+    case Instruction::FMul:
+    case Instruction::FDiv:
+    case Instruction::FRem:
+    case Instruction::FPTrunc:
+    case Instruction::SIToFP:
+    case Instruction::UIToFP:
+    case Instruction::FPToSI:
+    case Instruction::FPToUI:
+    case Instruction::AShr:
+    case Instruction::LShr:
+    case Instruction::SDiv:
+    case Instruction::UDiv:
+      return true;
+    case Instruction::Call: {
+      const Function *Callee = cast<CallInst>(&I)->getCalledFunction();
+      return Callee && Callee->isDeclaration();
+    }
+    default:
+      return false;
+  }
+}
+
+namespace {
+
+/* The fixed point iteration on one function for one signature */
+class FunctionPropagator {
+public:
+  FunctionPropagator(SummaryErrorPropagation &SEP, const Function &F, const FunctionFacts &Facts,
+                     const std::vector<int> &Signature, unsigned SCC,
+                     const DenseMap<const Function *, unsigned> &SCCOf,
+                     ErrorSummary &S)
+    : SEP(SEP), F(F), Facts(Facts), Signature(Signature), SCC(SCC), SCCOf(SCCOf), S(S) {}
+
+  void run() {
+    do {
+      Changed = false;
+      for (const BasicBlock *BB : Facts.Blocks) {
+        for (const Instruction &I : *BB)
+          transfer(I);
+      }
+      Iteration++;
+    } while (Changed);
+    NumIterations += Iteration;
+    for (const Instruction &I : instructions(F)) {
+      if (isa<AllocaInst>(&I)) {
+        auto It = Memory.find(&I);
+        if (It != Memory.end())
+          S.Values[&I] = It->second;
+      }
+    }
+  }
+
+private:
+  SummaryErrorPropagation &SEP;
+  const Function &F;
+  const FunctionFacts &Facts;
+  const std::vector<int> &Signature;
+  unsigned SCC;
+  const DenseMap<const Function *, unsigned> &SCCOf;
+  ErrorSummary &S;
+  /* the error of the values in each object */
+  DenseMap<const Value *, double> Memory;
+  unsigned Iteration = 0;
+  bool Changed = false;
+
+  /* raises Dst to E; the errors still growing after WidenAfter iterations
+   * are unbounded */
+  void update(Optional<double> &Dst, double E) {
+    if (std::isnan(E))
+      E = Inf;
+    if (Dst && E <= *Dst)
+      return;
+    if (Dst && Iteration >= WidenAfter) {
+      E = Inf;
+      NumUnbounded++;
+    }
+    Dst = E;
+    Changed = true;
+  }
+
+  template <typename K>
+  void update(DenseMap<K, double> &Map, K Key, double E) {
+    auto It = Map.find(Key);
+    Optional<double> Dst;
+    if (It != Map.end())
+      Dst = It->second;
+    update(Dst, E);
+    Map[Key] = *Dst;
+  }
+
+  /* the error of V used as a value of the type of Ctx */
+  Optional<double> get(const Value *V, const InputInfo *Ctx) {
+    if (auto *CFP = dyn_cast<ConstantFP>(V))
+      return getRepresentationError(CFP->getValueAPF().convertToDouble(), Ctx);
+    if (isa<Constant>(V))
+      return 0.0;
+    if (auto *A = dyn_cast<Argument>(V))
+      return A->getArgNo() < S.Args.size() ? S.Args[A->getArgNo()] : 0.0;
+    auto It = S.Values.find(V);
+    if (It == S.Values.end())
+      return None;
+    return It->second;
+  }
+
+  double getInitialMemoryError(const Value *Base) {
+    if (isa<AllocaInst>(Base) || isa<GlobalVariable>(Base) || isa<Argument>(Base))
+      return getInitialError(getInfo(Base));
+    return 0.0;
+  }
+
+  Optional<double> load(const Value *Ptr) {
+    const Value *Base = getBaseObject(Ptr);
+    auto It = Memory.find(Base);
+    if (It != Memory.end())
+      return It->second;
+    double E = getInitialMemoryError(Base);
+    Memory[Base] = E;
+    return E;
+  }
+
+  void store(const Value *Ptr, double E) {
+    const Value *Base = getBaseObject(Ptr);
+    auto *GV = dyn_cast<GlobalVariable>(Base);
+    if (GV && GV->isConstant())
+      return;
+    if (!Memory.count(Base))
+      Memory[Base] = getInitialMemoryError(Base);
+    update(Memory, Base, E);
+    if (auto *A = dyn_cast<Argument>(Base)) {
+      if (A->getArgNo() < S.ArgStores.size())
+        update(S.ArgStores[A->getArgNo()], E);
+    } else if (GV) {
+      update(S.GlobalStores, (const GlobalVariable *)GV, E);
+    }
+  }
+
+  /* the memory reachable from the pointer arguments of a call which is not
+   * analyzed may hold values with any error */
+  void clobberArguments(const CallBase &Call) {
+    for (unsigned A = 0; A < Call.arg_size(); A++) {
+      if (!Call.getArgOperand(A)->getType()->isPointerTy())
+        continue;
+      if (Call.paramHasAttr(A, Attribute::ReadOnly) || Call.paramHasAttr(A, Attribute::ReadNone))
+        continue;
+      store(Call.getArgOperand(A), Inf);
+    }
+  }
+
+  void transfer(const Instruction &I) {
+    if (auto *St = dyn_cast<StoreInst>(&I)) {
+      const Value *V = St->getValueOperand();
+      if (V->getType()->isPointerTy()) {
+        /* the object may be written through the stored pointer */
+        store(V, Inf);
+      } else if (Optional<double> E = get(V, getInfo(getBaseObject(St->getPointerOperand())))) {
+        store(St->getPointerOperand(), *E);
+      }
+      return;
+    }
+    if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+      if (const Value *V = Ret->getReturnValue()) {
+        if (Optional<double> E = get(V, nullptr))
+          update(S.Return, *E);
+      }
+      return;
+    }
+    Optional<double> E;
+    if (auto *Call = dyn_cast<CallBase>(&I))
+      E = transferCall(*Call);
+    else if (!I.getType()->isVoidTy() && !I.getType()->isPointerTy() && !isa<CmpInst>(&I))
+      E = compute(I);
+    if (!E || I.getType()->isVoidTy() || I.getType()->isPointerTy())
+      return;
+    const InputInfo *II = getInfo(&I);
+    double Total = *E + (mayRoundToType(I) ? getRoundingError(II) : 0.0);
+    update(S.Values, (const Value *)&I, std::max(Total, getInitialError(II)));
+  }
+
+  Optional<double> compute(const Instruction &I) {
+    const InputInfo *II = getInfo(&I);
+    auto Op = [&](unsigned N) { return get(I.getOperand(N), II); };
+    /* the magnitude of operand N; the integer constants of the converted
+     * code are scaled, so theirs is derived from the ranges of the result
+     * and of the other operand */
+    auto Mag = [&](unsigned N) -> double {
+      if (Optional<Range> R = getRangeOf(I.getOperand(N)))
+        return getMagnitude(*R);
+      Optional<Range> Other = getRangeOf(I.getOperand(1 - N));
+      if (isa<ConstantInt>(I.getOperand(N)) && II && II->IRange && Other && getMagnitude(*Other) > 0.0)
+        return getMagnitude(*II->IRange) / getMagnitude(*Other);
+      return Inf;
+    };
+
+    switch (I.getOpcode()) {
+      case Instruction::Add:
+      case Instruction::FAdd:
+      case Instruction::Sub:
+      case Instruction::FSub: {
+        Optional<double> A = Op(0), B = Op(1);
+        if (!A || !B)
+          return None;
+        return *A + *B;
+      }
+      case Instruction::Mul:
+      case Instruction::FMul: {
+        Optional<double> A = Op(0), B = Op(1);
+        if (!A || !B)
+          return None;
+        return scaleError(*B, Mag(0)) + scaleError(*A, Mag(1)) + *A * *B;
+      }
+      case Instruction::SDiv:
+      case Instruction::UDiv:
+      case Instruction::FDiv: {
+        Optional<double> A = Op(0), B = Op(1);
+        if (!A || !B)
+          return None;
+        if (*A == 0.0 && *B == 0.0)
+          return 0.0;
+        Optional<Range> Div = getRangeOf(I.getOperand(1));
+        double MinB = Div ? getMinMagnitude(*Div) : 0.0;
+        if (MinB <= *B)
+          return Inf;
+        return scaleError(*B, Mag(0)) / (MinB * (MinB - *B)) + *A / (MinB - *B);
+      }
+      case Instruction::FRem:
+      case Instruction::SRem:
+      case Instruction::URem: {
+        Optional<double> A = Op(0), B = Op(1);
+        if (!A || !B)
+          return None;
+        return *B == 0.0 ? *A : Inf;
+      }
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor: {
+        Optional<double> A = Op(0), B = Op(1);
+        if (!A || !B)
+          return None;
+        return (*A == 0.0 && *B == 0.0) ? 0.0 : Inf;
+      }
+      case Instruction::PHI: {
+        auto Acc = Facts.Accumulators.find(cast<PHINode>(&I));
+        if (Acc != Facts.Accumulators.end()) {
+          Optional<double> Init = get(Acc->second.Init, II), Step = get(Acc->second.Step, II);
+          if (!Init || !Step)
+            return None;
+          const PHINode *Phi = cast<PHINode>(&I);
+          const Value *Next = Phi->getIncomingValue(0) == Acc->second.Init ? Phi->getIncomingValue(1)
+                                                                            : Phi->getIncomingValue(0);
+          double Rounding = getRoundingError(getInfo(Next));
+          return *Init + Acc->second.TripCount * (*Step + Rounding);
+        }
+        Optional<double> E;
+        for (const Value *In : cast<PHINode>(&I)->incoming_values()) {
+          if (Optional<double> InE = get(In, II))
+            E = E ? std::max(*E, *InE) : *InE;
+        }
+        return E;
+      }
+      case Instruction::Select: {
+        Optional<double> A = Op(1), B = Op(2);
+        if (!A)
+          return B;
+        return B ? std::max(*A, *B) : *A;
+      }
+      case Instruction::Load:
+        return load(cast<LoadInst>(&I)->getPointerOperand());
+      default: {
+        /* shifts, casts, negations and the other instructions keep the
+         * largest error of their operands */
+        Optional<double> E;
+        for (const Value *Operand : I.operands()) {
+          if (Operand->getType()->isPointerTy() || isa<BasicBlock>(Operand))
+            continue;
+          Optional<double> OpE = get(Operand, II);
+          if (!OpE)
+            return None;
+          E = E ? std::max(*E, *OpE) : *OpE;
+        }
+        return E ? *E : 0.0;
+      }
+    }
+  }
+
+  Optional<double> getMathCallError(StringRef Name, const CallBase &Call) {
+    SmallVector<double, 3> Errors;
+    SmallVector<Optional<Range>, 3> Ranges;
+    for (const Value *Arg : Call.args()) {
+      Optional<double> E = get(Arg, getInfo(&Call));
+      if (!E)
+        return None;
+      Errors.push_back(*E);
+      Ranges.push_back(getRangeOf(Arg));
+    }
+    bool Exact = std::all_of(Errors.begin(), Errors.end(), [](double E) { return E == 0.0; });
+    if (Exact)
+      return 0.0;
+    double E = Errors[0];
+    if (Name == "fabs" || ((Name == "sin" || Name == "cos") && Errors.size() == 1))
+      return std::min(E, 2.0);
+    if ((Name == "fmin" || Name == "fmax") && Errors.size() == 2)
+      return std::max(Errors[0], Errors[1]);
+    if (Errors.size() == 1 && Ranges[0]) {
+      double MinA = getMinMagnitude(*Ranges[0]);
+      if (Name == "sqrt") {
+        /* sqrt(x) - sqrt(y) = (x - y) / (sqrt(x) + sqrt(y)) */
+        double Lo = std::sqrt(std::max(MinA - E, 0.0)) + std::sqrt(MinA);
+        return Lo > 0.0 ? std::min(std::sqrt(E), E / Lo) : std::sqrt(E);
+      }
+      if (Name == "exp")
+        return std::exp(Ranges[0]->Max) * std::expm1(E);
+      if (Name == "log")
+        return MinA > E ? E / (MinA - E) : Inf;
+    }
+    if (Name == "fma" && Errors.size() == 3 && Ranges[0] && Ranges[1]) {
+      return scaleError(Errors[1], getMagnitude(*Ranges[0])) + scaleError(Errors[0], getMagnitude(*Ranges[1])) +
+             Errors[0] * Errors[1] + Errors[2];
+    }
+    return Inf;
+  }
+
+  Optional<double> transferCall(const CallBase &Call) {
+    const Function *Callee = Call.getCalledFunction();
+    if (!Callee) {
+      clobberArguments(Call);
+      return Inf;
+    }
+    if (Callee->isDeclaration() || Callee->isIntrinsic()) {
+      if (auto *II = dyn_cast<IntrinsicInst>(&Call)) {
+        if (isa<DbgInfoIntrinsic>(II) || II->getIntrinsicID() == Intrinsic::lifetime_start ||
+            II->getIntrinsicID() == Intrinsic::lifetime_end)
+          return None;
+      }
+      StringRef Math = getMathFunctionName(*Callee);
+      if (Math.empty() && !Call.onlyReadsMemory())
+        clobberArguments(Call);
+      if (Call.getType()->isVoidTy())
+        return None;
+      if (!Math.empty())
+        return getMathCallError(Math, Call);
+      return Inf;
+    }
+
+    /* the errors of the arguments must be known, or the call is analyzed
+     * at a later iteration */
+    std::vector<double> Args;
+    std::vector<int> CalleeSig;
+    for (const Value *Arg : Call.args()) {
+      Optional<double> E = Arg->getType()->isPointerTy() ? 0.0 : get(Arg, nullptr);
+      if (!E)
+        return None;
+      Args.push_back(*E);
+      CalleeSig.push_back(getErrorSignature(*E));
+    }
+
+    auto CalleeSCC = SCCOf.find(Callee);
+    if (CalleeSCC != SCCOf.end() && CalleeSCC->second == SCC) {
+      if (Callee == &F && CalleeSig == Signature) {
+        /* the errors computed so far for this summary */
+        for (unsigned A = 0; A < Call.arg_size() && A < S.ArgStores.size(); A++) {
+          if (S.ArgStores[A])
+            store(Call.getArgOperand(A), *S.ArgStores[A]);
+        }
+        return S.Return;
+      }
+      clobberArguments(Call);
+      return Inf;
+    }
+
+    const ErrorSummary &CS = SEP.getSummary(*Callee, Args);
+    S.Callees.insert({Callee, CalleeSig});
+    for (unsigned A = 0; A < Call.arg_size() && A < CS.ArgStores.size(); A++) {
+      if (CS.ArgStores[A])
+        store(Call.getArgOperand(A), *CS.ArgStores[A]);
+    }
+    for (const auto &GS : CS.GlobalStores)
+      store(GS.first, GS.second);
+    return CS.Return;
+  }
+};
+
+}
+
+SummaryErrorPropagation::SummaryErrorPropagation(Module &M) : M(M) {
+  CallGraph CG(M);
+  unsigned Id = 0;
+  for (scc_iterator<CallGraph *> It = scc_begin(&CG); !It.isAtEnd(); ++It, ++Id) {
+    for (CallGraphNode *Node : *It) {
+      if (const Function *F = Node->getFunction())
+        SCCOf[F] = Id;
+    }
+  }
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    computeFunctionFacts(F, Facts[&F]);
+    if (MetadataManager::isStartingPoint(F) || F.hasAddressTaken() || F.use_empty())
+      Roots.push_back(&F);
+  }
+}
+
+std::unique_ptr<ErrorSummary> SummaryErrorPropagation::analyze(const Function &F,
+                                                               const std::vector<int> &Signature) {
+  std::unique_ptr<ErrorSummary> S(new ErrorSummary());
+  for (int Bits : Signature)
+    S->Args.push_back(getSignatureError(Bits));
+  S->ArgStores.resize(F.arg_size());
+  FunctionPropagator(*this, F, Facts.find(&F)->second, Signature, SCCOf.lookup(&F), SCCOf, *S).run();
+  NumSummaries++;
+  return S;
+}
+
+const ErrorSummary &SummaryErrorPropagation::getSummary(const Function &F,
+                                                        ArrayRef<double> ArgErrors) {
+  std::vector<int> Signature;
+  for (unsigned A = 0; A < F.arg_size(); A++)
+    Signature.push_back(getErrorSignature(A < ArgErrors.size() ? ArgErrors[A] : 0.0));
+  return getSummaryFor(F, Signature);
+}
+
+const ErrorSummary &SummaryErrorPropagation::getSummaryFor(const Function &F,
+                                                           const std::vector<int> &Signature) {
+  Key K(&F, Signature);
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Summaries.find(K);
+    if (It != Summaries.end())
+      return *It->second;
+  }
+  /* another thread may compute the same summary meanwhile; the first one
+   * is kept, and they are equal */
+  std::unique_ptr<ErrorSummary> S = reuseCached(F, Signature);
+  if (!S)
+    S = analyze(F, Signature);
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto Res = Summaries.emplace(K, std::move(S));
+  return *Res.first->second;
+}
+
+void SummaryErrorPropagation::run(unsigned Jobs) {
+  /* the metadata of the roots is read before the threads start */
+  std::vector<std::vector<double>> RootArgs;
+  for (const Function *F : Roots) {
+    RootArgs.emplace_back();
+    for (const Argument &A : F->args())
+      RootArgs.back().push_back(getInitialError(getInfo(&A)));
+  }
+  std::atomic<unsigned> Next(0);
+  auto Worker = [&]() {
+    for (unsigned R = Next++; R < Roots.size(); R = Next++)
+      getSummary(*Roots[R], RootArgs[R]);
+  };
+  std::vector<std::thread> Threads;
+  for (unsigned J = 1; J < Jobs && J < Roots.size(); J++)
+    Threads.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Threads)
+    T.join();
+}
+
+unsigned SummaryErrorPropagation::getNumSummaries() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Summaries.size();
+}
+
+unsigned SummaryErrorPropagation::annotate() {
+  DenseMap<const Value *, double> Max;
+  for (const auto &Entry : Summaries) {
+    for (const auto &V : Entry.second->Values)
+      Max[V.first] = std::max(Max.lookup(V.first), V.second);
+  }
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  unsigned Set = 0;
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      auto It = Max.find(&I);
+      if (It != Max.end() && MM.retrieveInputInfo(I)) {
+        MetadataManager::setErrorMetadata(I, It->second);
+        Set++;
+      }
+    }
+  }
+  return Set;
+}
+
+std::map<std::string, double> SummaryErrorPropagation::getTargetErrors() const {
+  std::map<std::string, double> Targets;
+  auto Record = [&](StringRef Name, double E) {
+    auto Res = Targets.emplace(Name.str(), E);
+    if (!Res.second)
+      Res.first->second = std::max(Res.first->second, E);
+  };
+  std::lock_guard<std::mutex> Guard(Lock);
+  for (const auto &Entry : Summaries) {
+    for (const auto &V : Entry.second->Values) {
+      if (auto *I = dyn_cast<Instruction>(V.first)) {
+        if (Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(*I))
+          Record(*Name, V.second);
+      }
+    }
+    for (const auto &GS : Entry.second->GlobalStores) {
+      if (Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(*GS.first))
+        Record(*Name, GS.second);
+    }
+  }
+  for (const GlobalVariable &GV : M.globals()) {
+    if (Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(GV))
+      Record(*Name, getInitialError(getInfo(&GV)));
+  }
+  return Targets;
+}
+
+void SummaryErrorPropagation::printTargetErrors(raw_ostream &OS) const {
+  for (const auto &T : getTargetErrors())
+    OS << "Computed error for target " << T.first << ": " << format("%.20e", T.second) << "\n";
+}
+
+
+namespace {
+
+/* The backward propagation of the sensitivity of the error of one target */
+class SensitivityPropagator {
+public:
+  explicit SensitivityPropagator(Module &M) : M(M) {}
+
+  DenseMap<const Instruction *, double> run(ArrayRef<const Value *> Targets) {
+    for (const Value *T : Targets) {
+      if (isa<AllocaInst>(T) || isa<GlobalVariable>(T))
+        Memory[T] = 1.0;
+      else
+        Values[T] = 1.0;
+    }
+    do {
+      Changed = false;
+      for (Function &F : M) {
+        if (F.isDeclaration())
+          continue;
+        for (BasicBlock *BB : post_order(&F)) {
+          for (auto I = BB->rbegin(); I != BB->rend(); ++I)
+            transfer(*I);
+        }
+      }
+      Iteration++;
+    } while (Changed);
+
+    DenseMap<const Instruction *, double> Res;
+    for (const auto &V : Values) {
+      if (auto *I = dyn_cast<Instruction>(V.first))
+        Res[I] = V.second;
+    }
+    return Res;
+  }
+
+private:
+  Module &M;
+  /* the sensitivity to the error of each value, and of the values in
+   * each object */
+  DenseMap<const Value *, double> Values;
+  DenseMap<const Value *, double> Memory;
+  unsigned Iteration = 0;
+  bool Changed = false;
+
+  /* the sensitivities still growing after the widening iterations are
+   * unbounded */
+  void update(DenseMap<const Value *, double> &Map, const Value *Key, double S) {
+    if (std::isnan(S))
+      S = Inf;
+    if (!(S > 0.0) || isa<Constant>(Key))
+      return;
+    double &Dst = Map[Key];
+    if (S <= Dst)
+      return;
+    if (Dst > 0.0 && Iteration >= WidenAfter * 2)
+      S = Inf;
+    Dst = S;
+    Changed = true;
+  }
+
+  double getMag(const Value *V) {
+    Optional<Range> R = getRangeOf(V);
+    return R ? getMagnitude(*R) : Inf;
+  }
+
+  double getMinMag(const Value *V) {
+    Optional<Range> R = getRangeOf(V);
+    return R ? getMinMagnitude(*R) : 0.0;
+  }
+
+  /* the derivative of the error of Call with respect to the error of its
+   * argument N */
+  double getMathCallDerivative(StringRef Name, const CallBase &Call, unsigned N) {
+    if (Name == "fabs" || Name == "sin" || Name == "cos" || Name == "fmin" || Name == "fmax")
+      return 1.0;
+    if (Name == "fma")
+      return N == 2 ? 1.0 : getMag(Call.getArgOperand(1 - N));
+    /* the derivatives of sqrt, exp and log bound their error */
+    const Value *A = Call.getArgOperand(0);
+    if (Name == "sqrt") {
+      double MinA = getMinMag(A);
+      return MinA > 0.0 ? 0.5 / std::sqrt(MinA) : Inf;
+    }
+    if (Name == "exp") {
+      Optional<Range> R = getRangeOf(A);
+      return R ? std::exp(R->Max) : Inf;
+    }
+    if (Name == "log") {
+      double MinA = getMinMag(A);
+      return MinA > 0.0 ? 1.0 / MinA : Inf;
+    }
+    return Inf;
+  }
+
+  /* the derivative of the error of I with respect to the error of its
+   * operand N, as in FunctionPropagator::compute */
+  double getDerivative(const Instruction &I, unsigned N) {
+    switch (I.getOpcode()) {
+      case Instruction::Add:
+      case Instruction::FAdd:
+      case Instruction::Sub:
+      case Instruction::FSub:
+      case Instruction::PHI:
+        return 1.0;
+      case Instruction::Mul:
+      case Instruction::FMul:
+        return getMag(I.getOperand(1 - N));
+      case Instruction::SDiv:
+      case Instruction::UDiv:
+      case Instruction::FDiv: {
+        double MinB = getMinMag(I.getOperand(1));
+        if (MinB == 0.0)
+          return Inf;
+        return N == 0 ? 1.0 / MinB : getMag(I.getOperand(0)) / (MinB * MinB);
+      }
+      case Instruction::FRem:
+      case Instruction::SRem:
+      case Instruction::URem:
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+        return Inf;
+      case Instruction::Select:
+        return N == 0 ? 0.0 : 1.0;
+      case Instruction::ICmp:
+      case Instruction::FCmp:
+        return 0.0;
+      case Instruction::Call: {
+        const CallBase &Call = cast<CallBase>(I);
+        const Function *Callee = Call.getCalledFunction();
+        if (!Callee || N >= Call.arg_size())
+          return Callee ? 0.0 : Inf;
+        if (auto *II = dyn_cast<IntrinsicInst>(&Call)) {
+          if (isa<DbgInfoIntrinsic>(II) || II->getIntrinsicID() == Intrinsic::lifetime_start ||
+              II->getIntrinsicID() == Intrinsic::lifetime_end)
+            return 0.0;
+        }
+        StringRef Math = getMathFunctionName(*Callee);
+        return Math.empty() ? Inf : getMathCallDerivative(Math, Call, N);
+      }
+      default:
+        /* shifts, casts and negations keep the error of their operands */
+        return 1.0;
+    }
+  }
+
+  void transfer(const Instruction &I) {
+    if (auto *St = dyn_cast<StoreInst>(&I)) {
+      const Value *V = St->getValueOperand();
+      if (!V->getType()->isPointerTy())
+        update(Values, V, Memory.lookup(getBaseObject(St->getPointerOperand())));
+      return;
+    }
+    if (auto *Ld = dyn_cast<LoadInst>(&I)) {
+      update(Memory, getBaseObject(Ld->getPointerOperand()), Values.lookup(&I));
+      return;
+    }
+    if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+      const Value *V = Ret->getReturnValue();
+      if (!V)
+        return;
+      for (const User *U : I.getFunction()->users()) {
+        auto *Call = dyn_cast<CallBase>(U);
+        if (Call && Call->getCalledFunction() == I.getFunction())
+          update(Values, V, Values.lookup(Call));
+      }
+      return;
+    }
+    double S = Values.lookup(&I);
+    if (S == 0.0)
+      return;
+    for (unsigned N = 0; N < I.getNumOperands(); N++) {
+      const Value *Op = I.getOperand(N);
+      if (Op->getType()->isPointerTy() || isa<BasicBlock>(Op) || isa<Constant>(Op))
+        continue;
+      double D = getDerivative(I, N);
+      update(Values, Op, D == 0.0 ? 0.0 : S * D);
+    }
+  }
+};
+
+}
+
+std::map<std::string, DenseMap<const Instruction *, double>> computeErrorSensitivities(Module &M) {
+  std::map<std::string, SmallVector<const Value *, 4>> Targets;
+  for (GlobalVariable &GV : M.globals()) {
+    if (Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(GV))
+      Targets[Name->str()].push_back(&GV);
+  }
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      if (Optional<StringRef> Name = MetadataManager::retrieveTargetMetadata(I))
+        Targets[Name->str()].push_back(&I);
+    }
+  }
+  std::map<std::string, DenseMap<const Instruction *, double>> Res;
+  for (const auto &T : Targets)
+    Res[T.first] = SensitivityPropagator(M).run(T.second);
+  return Res;
+}
+
+
+static const char CacheHeader[] = "taffo-err-cache 1";
+
+static std::string formatError(double E) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << format("%a", E);
+  return OS.str();
+}
+
+static bool parseError(StringRef Text, double &E) {
+  std::string Str = Text.str();
+  char *End;
+  E = std::strtod(Str.c_str(), &End);
+  return End == Str.c_str() + Str.size();
+}
+
+/* A digest of the errors a summary gives to its callers */
+static std::string getInterfaceDigest(const ErrorSummary &S) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << (S.Return ? formatError(*S.Return) : "-");
+  for (const Optional<double> &E : S.ArgStores)
+    OS << " " << (E ? formatError(*E) : "-");
+  std::vector<std::pair<std::string, double>> Globals;
+  for (const auto &GS : S.GlobalStores)
+    Globals.emplace_back(GS.first->getName().str(), GS.second);
+  llvm::sort(Globals);
+  for (const auto &GS : Globals)
+    OS << " " << GS.first << "=" << formatError(GS.second);
+  MD5 Hasher;
+  Hasher.update(OS.str());
+  MD5::MD5Result Res;
+  Hasher.final(Res);
+  return std::string(Res.digest().str());
+}
+
+void SummaryErrorPropagation::computeBodyHashes() {
+  if (!BodyHashes.empty())
+    return;
+  for (const Function &F : M) {
+    if (!F.isDeclaration())
+      BodyHashes[&F] = hashFunctionBody(F);
+  }
+}
+
+std::unique_ptr<ErrorSummary> SummaryErrorPropagation::reuseCached(const Function &F,
+                                                                   const std::vector<int> &Signature) {
+  Key K(&F, Signature);
+  std::vector<CachedCallee> Callees;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Cache.find(K);
+    if (It == Cache.end() || !It->second.S || It->second.BodyHash != BodyHashes.lookup(&F))
+      return nullptr;
+    Callees = It->second.Callees;
+  }
+  /* the callees are propagated first, and the summary is only valid if they
+   * give the same errors as before */
+  for (const CachedCallee &Callee : Callees) {
+    if (getInterfaceDigest(getSummaryFor(*Callee.F, Callee.Signature)) != Callee.Digest)
+      return nullptr;
+  }
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto It = Cache.find(K);
+  if (!It->second.S)
+    return nullptr;
+  Reused++;
+  NumCachedSummaries++;
+  return std::move(It->second.S);
+}
+
+unsigned SummaryErrorPropagation::getNumReused() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Reused;
+}
+
+bool SummaryErrorPropagation::saveCache(StringRef Path, std::string &Error) {
+  computeBodyHashes();
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    Error = EC.message();
+    return false;
+  }
+  OS << CacheHeader << "\n";
+  for (const auto &Entry : Summaries) {
+    const Function *F = Entry.first.first;
+    const ErrorSummary &S = *Entry.second;
+    /* the entries are found by the names of the functions and globals */
+    bool Named = F->hasName();
+    for (const auto &GS : S.GlobalStores)
+      Named &= GS.first->hasName();
+    if (!Named)
+      continue;
+
+    OS << "function " << F->getName() << " " << BodyHashes.lookup(F);
+    for (int Bits : Entry.first.second)
+      OS << " " << Bits;
+    OS << "\n";
+    for (const auto &Callee : S.Callees) {
+      auto CS = Summaries.find(Callee);
+      OS << "callee " << Callee.first->getName() << " " << getInterfaceDigest(*CS->second);
+      for (int Bits : Callee.second)
+        OS << " " << Bits;
+      OS << "\n";
+    }
+    if (S.Return)
+      OS << "return " << formatError(*S.Return) << "\n";
+    for (unsigned A = 0; A < S.ArgStores.size(); A++) {
+      if (S.ArgStores[A])
+        OS << "argstore " << A << " " << formatError(*S.ArgStores[A]) << "\n";
+    }
+    for (const auto &GS : S.GlobalStores)
+      OS << "global " << GS.first->getName() << " " << formatError(GS.second) << "\n";
+    unsigned Index = 0;
+    for (const Instruction &I : instructions(*F)) {
+      auto It = S.Values.find(&I);
+      if (It != S.Values.end())
+        OS << "value " << Index << " " << formatError(It->second) << "\n";
+      Index++;
+    }
+    OS << "end\n";
+  }
+  OS.close();
+  if (OS.has_error()) {
+    Error = OS.error().message();
+    OS.clear_error();
+    return false;
+  }
+  return true;
+}
+
+unsigned SummaryErrorPropagation::loadCache(StringRef Path) {
+  computeBodyHashes();
+  ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path);
+  if (!File)
+    return 0;
+  SmallVector<StringRef, 0> Lines;
+  (*File)->getBuffer().split(Lines, '\n');
+  if (Lines.empty() || Lines[0] != CacheHeader)
+    return 0;
+
+  auto ParseSignature = [](ArrayRef<StringRef> Fields, unsigned First, std::vector<int> &Signature) {
+    Signature.clear();
+    for (unsigned I = First; I < Fields.size(); I++) {
+      int Bits;
+      if (Fields[I].getAsInteger(10, Bits))
+        return false;
+      Signature.push_back(Bits);
+    }
+    return true;
+  };
+
+  unsigned Loaded = 0;
+  const Function *F = nullptr;
+  std::vector<int> Signature;
+  CachedSummary C;
+  std::vector<const Instruction *> Insts;
+  for (unsigned L = 1; L < Lines.size(); L++) {
+    SmallVector<StringRef, 8> Fields;
+    Lines[L].split(Fields, ' ', -1, false);
+    if (Fields.empty())
+      continue;
+    if (Fields[0] == "function") {
+      C.S = nullptr;
+      F = Fields.size() >= 3 ? M.getFunction(Fields[1]) : nullptr;
+      if (!F || F->isDeclaration() || !ParseSignature(Fields, 3, Signature) ||
+          Signature.size() != F->arg_size())
+        continue;
+      C.BodyHash = Fields[2].str();
+      C.Callees.clear();
+      C.S.reset(new ErrorSummary());
+      for (int Bits : Signature)
+        C.S->Args.push_back(getSignatureError(Bits));
+      C.S->ArgStores.resize(F->arg_size());
+      Insts.clear();
+      for (const Instruction &I : instructions(*F))
+        Insts.push_back(&I);
+      continue;
+    }
+    if (!C.S)
+      continue;
+
+    double E;
+    unsigned Index;
+    const Function *Callee = Fields.size() > 2 && Fields[0] == "callee" ? M.getFunction(Fields[1]) : nullptr;
+    if (Fields[0] == "end") {
+      for (const CachedCallee &CC : C.Callees)
+        C.S->Callees.insert({CC.F, CC.Signature});
+      Cache[Key(F, Signature)] = std::move(C);
+      C = CachedSummary();
+      Loaded++;
+    } else if (Callee && !Callee->isDeclaration()) {
+      CachedCallee CC{Callee, {}, Fields[2].str()};
+      if (ParseSignature(Fields, 3, CC.Signature) && CC.Signature.size() == Callee->arg_size())
+        C.Callees.push_back(CC);
+      else
+        C.S = nullptr;
+    } else if (Fields[0] == "return" && Fields.size() == 2 && parseError(Fields[1], E)) {
+      C.S->Return = E;
+    } else if (Fields[0] == "argstore" && Fields.size() == 3 && !Fields[1].getAsInteger(10, Index) &&
+               Index < C.S->ArgStores.size() && parseError(Fields[2], E)) {
+      C.S->ArgStores[Index] = E;
+    } else if (Fields[0] == "global" && Fields.size() == 3 && M.getGlobalVariable(Fields[1], true) &&
+               parseError(Fields[2], E)) {
+      C.S->GlobalStores[M.getGlobalVariable(Fields[1], true)] = E;
+    } else if (Fields[0] == "value" && Fields.size() == 3 && !Fields[1].getAsInteger(10, Index) &&
+               Index < Insts.size() && parseError(Fields[2], E)) {
+      C.S->Values[Insts[Index]] = E;
+    } else {
+      /* invalid entry */
+      C.S = nullptr;
+    }
+  }
+  return Loaded;
+}
+
+}
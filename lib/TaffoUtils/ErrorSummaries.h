@@ -0,0 +1,177 @@
+//===-- ErrorSummaries.h - Summary-Based Error Propagation ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Interprocedural propagation of the absolute errors of the converted
+/// values, based on summaries of the functions computed for each signature
+/// of the errors of their arguments.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_ERROR_SUMMARIES_H
+#define TAFFOUTILS_ERROR_SUMMARIES_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "RangeSummaries.h"
+
+namespace taffo {
+
+/// The signature of an absolute error: the exponent of the smallest power
+/// of two not below it, INT_MIN for no error and INT_MAX for an unbounded
+/// one.
+int getErrorSignature(double Error);
+
+/// The largest error with the signature Bits.
+double getSignatureError(int Bits);
+
+/// Whether I may round its result to the type in its taffo.info, adding
+/// the rounding error of that type to the errors of its operands.
+bool mayRoundToType(const llvm::Instruction &I);
+
+/// The sensitivity of the error of each target of M, by name, to the
+/// rounding errors of the instructions: the largest factor by which the
+/// instructions on the paths from an instruction to the target scale its
+/// error, with the errors linearized (e.g. the errors of the operands of a
+/// product are scaled by the magnitude of the other operand). The
+/// instructions which do not reach a target are not in its map; the
+/// sensitivity is Inf when the error may be amplified without bound, e.g.
+/// through a division by a range containing zero, a call which is not a
+/// known math function, or a loop which scales it at each iteration.
+std::map<std::string, llvm::DenseMap<const llvm::Instruction *, double>>
+computeErrorSensitivities(llvm::Module &M);
+
+/// The errors of a function for one signature of the errors of its
+/// arguments.
+struct ErrorSummary {
+  /// The error of each argument in this context.
+  std::vector<double> Args;
+  /// The error of the returned value; None if nothing is returned.
+  llvm::Optional<double> Return;
+  /// The error of the values stored through each pointer argument.
+  std::vector<llvm::Optional<double>> ArgStores;
+  /// The error of the values stored to the globals.
+  llvm::DenseMap<const llvm::GlobalVariable *, double> GlobalStores;
+  /// The error of each instruction, and of the values in the memory
+  /// allocated by each alloca.
+  llvm::DenseMap<const llvm::Value *, double> Values;
+  /// The summaries of the callees used, with their signatures.
+  std::set<std::pair<const llvm::Function *, std::vector<int>>> Callees;
+};
+
+/// Propagation of the absolute errors of a module, which summarizes each
+/// function for each signature of the errors of its arguments at the calls,
+/// so that the calls with the same signature share the propagation in the
+/// callee. The argument errors of a summary are the largest ones with its
+/// signature.
+///
+/// Each instruction adds to the errors of its operands the rounding error
+/// of the type in its taffo.info, when it may round: the fixed point types
+/// truncate to their point positions, the floating point ones round to
+/// their precision in the range of the instruction. The errors of the
+/// products and quotients are scaled by the ranges of the operands; the
+/// inputs start with the errors in their taffo.info. Both the code before
+/// the Conversion and the converted code are handled: the integer
+/// additions, subtractions, multiplications and left shifts of fixed point
+/// values are exact, their right shifts and divisions truncate.
+///
+/// As in SummaryRangeAnalysis, the summaries are computed on demand from
+/// the roots of the call graph, on several threads; the calls within a
+/// strongly connected component other than the recursive calls with the
+/// same signature give unbounded errors. The loops are iterated to a fixed
+/// point; the errors still growing after a few iterations are unbounded,
+/// except for the accumulators of loops with a known maximum trip count,
+/// whose error grows at most by the error of its step at each iteration.
+class SummaryErrorPropagation {
+public:
+  explicit SummaryErrorPropagation(llvm::Module &M);
+
+  /// Compute the summaries of the roots, and of the functions they call,
+  /// on Jobs threads.
+  void run(unsigned Jobs);
+
+  /// The summary of F for the signature of ArgErrors (one element for each
+  /// argument of F).
+  const ErrorSummary &getSummary(const llvm::Function &F, llvm::ArrayRef<double> ArgErrors);
+
+  /// Number of summaries computed.
+  unsigned getNumSummaries() const;
+
+  /// Attach to each instruction with a taffo.info its largest error in the
+  /// summaries as taffo.abserror. Returns the number of instructions.
+  unsigned annotate();
+
+  /// The largest error of each value marked as a target, by name.
+  std::map<std::string, double> getTargetErrors() const;
+
+  /// Print the largest error of each value marked as a target, as the
+  /// Error Propagator pass does.
+  void printTargetErrors(llvm::raw_ostream &OS) const;
+
+  /// Load the summaries of a previous propagation saved to Path by
+  /// saveCache. A summary is reused if its function has the same body and
+  /// metadata (in particular the same types) and if the summaries of its
+  /// callees give the same errors as before; so only the functions whose
+  /// types changed, and their callers reached by changed errors, are
+  /// propagated again. Must be called before run. Returns the number of
+  /// summaries read.
+  unsigned loadCache(llvm::StringRef Path);
+
+  /// Save all the summaries to Path.
+  bool saveCache(llvm::StringRef Path, std::string &Error);
+
+  /// Number of summaries reused from the ones loaded.
+  unsigned getNumReused() const;
+
+private:
+  typedef std::pair<const llvm::Function *, std::vector<int>> Key;
+
+  struct CachedCallee {
+    const llvm::Function *F;
+    std::vector<int> Signature;
+    std::string Digest;
+  };
+  struct CachedSummary {
+    std::string BodyHash;
+    std::vector<CachedCallee> Callees;
+    std::unique_ptr<ErrorSummary> S;
+  };
+
+  const ErrorSummary &getSummaryFor(const llvm::Function &F, const std::vector<int> &Signature);
+  std::unique_ptr<ErrorSummary> reuseCached(const llvm::Function &F,
+                                            const std::vector<int> &Signature);
+  std::unique_ptr<ErrorSummary> analyze(const llvm::Function &F,
+                                        const std::vector<int> &Signature);
+  void computeBodyHashes();
+
+  llvm::Module &M;
+  llvm::DenseMap<const llvm::Function *, unsigned> SCCOf;
+  /* computed by the constructor, and only read afterwards */
+  llvm::DenseMap<const llvm::Function *, FunctionFacts> Facts;
+  std::vector<const llvm::Function *> Roots;
+  mutable std::mutex Lock;
+  std::map<Key, std::unique_ptr<ErrorSummary>> Summaries;
+  std::map<Key, CachedSummary> Cache;
+  llvm::DenseMap<const llvm::Function *, std::string> BodyHashes;
+  unsigned Reused = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+//===-- FixedMathCalls.cpp - Calls to the Fixed Point Math Runtime -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Replacement of the calls to libm with calls to the fixed point math
+/// runtime in lib/FixedMath, and error bounds of its routines.
+///
+//===----------------------------------------------------------------------===//
+
+#include "FixedMathCalls.h"
+
+#include <algorithm>
+#include <cmath>
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+namespace taffo {
+
+/* The bounds are the ones measured against libm on the whole range of the
+ * arguments, rounded up: the routines are exact before the final rounding
+ * to about 2^-34, except for the reduction of the argument of sin and cos,
+ * which is done with 30 more fractional bits than the argument. */
+static const FixedMathFunction FixedMathFunctions[] = {
+  {"sin", "taffo_fixm_sin", 1.0, 1.0 / (1LL << 29), 0.0},
+  {"cos", "taffo_fixm_cos", 1.0, 1.0 / (1LL << 29), 0.0},
+  {"exp", "taffo_fixm_exp", 1.0, 0.0, 1.0 / (1LL << 34)},
+  {"log", "taffo_fixm_log", 1.0, 1.0 / (1LL << 34), 0.0},
+  {"sqrt", "taffo_fixm_sqrt", 1.0, 0.0, 0.0},
+};
+
+static const FixedMathFunction *lookupFixedMathFunction(StringRef Name) {
+  for (const FixedMathFunction &Fn : FixedMathFunctions) {
+    if (Name == Fn.LibmName)
+      return &Fn;
+  }
+  return nullptr;
+}
+
+const FixedMathFunction *getFixedMathFunction(StringRef Name) {
+  /* llvm.sin.f64 */
+  if (Name.consume_front("llvm."))
+    return lookupFixedMathFunction(Name.split('.').first);
+  if (const FixedMathFunction *Fn = lookupFixedMathFunction(Name))
+    return Fn;
+  /* sinf, sinl */
+  if (Name.endswith("f") || Name.endswith("l"))
+    return lookupFixedMathFunction(Name.drop_back());
+  return nullptr;
+}
+
+bool isFixedMathType(const FPType &T) {
+  unsigned MaxWidth = T.isSigned() ? 32 : 31;
+  return T.getWidth() <= MaxWidth && T.getPointPos() <= 31;
+}
+
+double getFixedMathError(const FixedMathFunction &Fn, const FPType &TRes,
+                         const Range &Res) {
+  double Magnitude = std::max(std::abs(Res.Min), std::abs(Res.Max));
+  return Fn.UlpError * std::ldexp(1.0, -(int)TRes.getPointPos()) +
+         Fn.AbsError + Fn.RelError * Magnitude;
+}
+
+Value *createFixedMathCall(IRBuilder<> &Builder, const FixedMathFunction &Fn,
+                           Value *X, const FPType &TX, const FPType &TRes) {
+  if (!isFixedMathType(TX) || !isFixedMathType(TRes) || !X->getType()->isIntegerTy())
+    return nullptr;
+  Module *M = Builder.GetInsertBlock()->getModule();
+  Type *I32 = Builder.getInt32Ty();
+  FunctionCallee Callee = M->getOrInsertFunction(Fn.RuntimeName, I32, I32, I32, I32);
+  if (Function *F = dyn_cast<Function>(Callee.getCallee())) {
+    F->setDoesNotAccessMemory();
+    F->setDoesNotThrow();
+  }
+
+  Value *Arg = Builder.CreateIntCast(X, I32, TX.isSigned());
+  CallInst *Call = Builder.CreateCall(Callee, {Arg, Builder.getInt32(TX.getPointPos()),
+                                               Builder.getInt32(TRes.getPointPos())});
+  Call->setDoesNotAccessMemory();
+  /* the result is saturated to int32_t, and in the range of TRes if the
+   * range of the call is */
+  return Builder.CreateIntCast(Call, Builder.getIntNTy(TRes.getWidth()), true);
+}
+
+}
@@ -0,0 +1,66 @@
+//===-- FixedMathCalls.h - Calls to the Fixed Point Math Runtime -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Replacement of the calls to libm with calls to the fixed point math
+/// runtime in lib/FixedMath, and error bounds of its routines.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_FIXED_MATH_CALLS_H
+#define TAFFOUTILS_FIXED_MATH_CALLS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Value.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// A routine of the fixed point math runtime.
+struct FixedMathFunction {
+  /// Name of the libm function without the type suffix (sin, not sinf).
+  const char *LibmName;
+  /// Name of the routine, of type i32 (i32 x, i32 frac_in, i32 frac_out).
+  const char *RuntimeName;
+  /// The maximum error of the result with respect to the exact function of
+  /// the argument is UlpError units in the last place of the result type,
+  /// plus AbsError, plus RelError times the magnitude of the result.
+  double UlpError;
+  double AbsError;
+  double RelError;
+};
+
+/// The routine which replaces the function called Name: a libm function
+/// (sin, sinf, sinl, ...) or the corresponding intrinsic (llvm.sin.f32,
+/// ...). nullptr if there is none.
+const FixedMathFunction *getFixedMathFunction(llvm::StringRef Name);
+
+/// True if values of type T can be passed to and returned by the routines,
+/// which work on 32 bit signed integers.
+bool isFixedMathType(const mdutils::FPType &T);
+
+/// Maximum absolute error of Fn with result type TRes, for results in the
+/// range Res.
+double getFixedMathError(const FixedMathFunction &Fn,
+                         const mdutils::FPType &TRes,
+                         const mdutils::Range &Res);
+
+/// Emit the call of Fn on X, of type TX, with result type TRes. The
+/// declaration of the routine is added to the module if needed. Returns
+/// nullptr if TX or TRes are not supported by the runtime, in which case
+/// the call must be kept in floating point.
+llvm::Value *createFixedMathCall(llvm::IRBuilder<> &Builder,
+                                 const FixedMathFunction &Fn,
+                                 llvm::Value *X, const mdutils::FPType &TX,
+                                 const mdutils::FPType &TRes);
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+//===-- FixedPointArith.cpp - Lowering of Fixed Point Arithmetic -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Emission of fixed point multiplications, divisions and multiply-adds.
+///
+//===----------------------------------------------------------------------===//
+
+#include "FixedPointArith.h"
+
+#include <algorithm>
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+namespace taffo {
+
+static unsigned intermediateWidth(int Bits) {
+  return std::max<uint64_t>(8U, PowerOf2Ceil(std::max(Bits, 1)));
+}
+
+/* The type with the same shape of V (scalar or vector) and the given
+ * integer width */
+static Type *intTypeLike(Value *V, unsigned Width) {
+  return V->getType()->getWithNewBitWidth(Width);
+}
+
+/* Shift right by Shift bits, or left by -Shift bits */
+static Value *shiftRight(IRBuilder<> &Builder, Value *V, int Shift, bool Signed) {
+  if (Shift > 0)
+    return Signed ? Builder.CreateAShr(V, Shift) : Builder.CreateLShr(V, Shift);
+  if (Shift < 0)
+    return Builder.CreateShl(V, -Shift);
+  return V;
+}
+
+unsigned fixedPointMulWidth(const FPType &A, const FPType &B, const FPType &Res) {
+  int Shift = (int)A.getPointPos() + (int)B.getPointPos() - (int)Res.getPointPos();
+  /* the bits of the result are the bits [Shift, Shift + width) of the
+   * product, which only depend on its lowest Shift + width bits */
+  return intermediateWidth(Res.getWidth() + std::max(Shift, 0));
+}
+
+unsigned fixedPointDivWidth(const FPType &A, const FPType &B, const FPType &Res) {
+  /* A * 2^Shift / B has the fractional bits of the result; if Shift is
+   * negative the divisor is shifted instead, so that no bit is lost */
+  int Shift = (int)Res.getPointPos() + (int)B.getPointPos() - (int)A.getPointPos();
+  int Bits = std::max((int)A.getWidth() + std::max(Shift, 0),
+                      (int)B.getWidth() + std::max(-Shift, 0));
+  /* an unsigned operand of a signed division needs a zero sign bit */
+  if (A.isSigned() != B.isSigned())
+    Bits++;
+  return intermediateWidth(Bits);
+}
+
+Value *createFixedPointMul(IRBuilder<> &Builder,
+                           Value *A, const FPType &TA,
+                           Value *B, const FPType &TB,
+                           const FPType &TRes, bool Round) {
+  bool Signed = TA.isSigned() || TB.isSigned();
+  int Shift = (int)TA.getPointPos() + (int)TB.getPointPos() - (int)TRes.getPointPos();
+  Type *WideTy = intTypeLike(A, fixedPointMulWidth(TA, TB, TRes));
+
+  Value *P = Builder.CreateMul(Builder.CreateIntCast(A, WideTy, TA.isSigned()),
+                               Builder.CreateIntCast(B, WideTy, TB.isSigned()));
+  if (Shift > 0) {
+    if (Round)
+      P = Builder.CreateAdd(P, ConstantInt::get(WideTy, 1ULL << (Shift - 1)));
+    P = shiftRight(Builder, P, Shift, Signed);
+  }
+  Value *Res = Builder.CreateIntCast(P, intTypeLike(A, TRes.getWidth()), Signed);
+  if (Shift < 0)
+    Res = shiftRight(Builder, Res, Shift, Signed);
+  return Res;
+}
+
+Value *createFixedPointDiv(IRBuilder<> &Builder,
+                           Value *A, const FPType &TA,
+                           Value *B, const FPType &TB,
+                           const FPType &TRes) {
+  bool Signed = TA.isSigned() || TB.isSigned();
+  int Shift = (int)TRes.getPointPos() + (int)TB.getPointPos() - (int)TA.getPointPos();
+  Type *WideTy = intTypeLike(A, fixedPointDivWidth(TA, TB, TRes));
+
+  Value *WA = Builder.CreateIntCast(A, WideTy, TA.isSigned());
+  Value *WB = Builder.CreateIntCast(B, WideTy, TB.isSigned());
+  if (Shift > 0)
+    WA = Builder.CreateShl(WA, Shift);
+  else if (Shift < 0)
+    WB = Builder.CreateShl(WB, -Shift);
+  Value *Q = Signed ? Builder.CreateSDiv(WA, WB) : Builder.CreateUDiv(WA, WB);
+  return Builder.CreateIntCast(Q, intTypeLike(A, TRes.getWidth()), Signed);
+}
+
+Value *createFixedPointMulAdd(IRBuilder<> &Builder,
+                              Value *Acc, const FPType &TAcc,
+                              Value *A, const FPType &TA,
+                              Value *B, const FPType &TB) {
+  int Shift = (int)TA.getPointPos() + (int)TB.getPointPos() - (int)TAcc.getPointPos();
+  if (Shift < 0)
+    return Builder.CreateAdd(Acc, createFixedPointMul(Builder, A, TA, B, TB, TAcc));
+
+  bool Signed = TA.isSigned() || TB.isSigned() || TAcc.isSigned();
+  Type *WideTy = intTypeLike(Acc, fixedPointMulWidth(TA, TB, TAcc));
+  Value *P = Builder.CreateMul(Builder.CreateIntCast(A, WideTy, TA.isSigned()),
+                               Builder.CreateIntCast(B, WideTy, TB.isSigned()));
+  Value *WAcc = Builder.CreateIntCast(Acc, WideTy, TAcc.isSigned());
+  Value *Sum = Builder.CreateAdd(Builder.CreateShl(WAcc, Shift), P);
+  Sum = shiftRight(Builder, Sum, Shift, Signed);
+  return Builder.CreateIntCast(Sum, Acc->getType(), Signed);
+}
+
+}
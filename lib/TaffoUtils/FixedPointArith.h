@@ -0,0 +1,73 @@
+//===-- FixedPointArith.h - Lowering of Fixed Point Arithmetic --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Emission of fixed point multiplications, divisions and multiply-adds
+/// on integer scalars or vectors of integers.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_FIXED_POINT_ARITH_H
+#define TAFFOUTILS_FIXED_POINT_ARITH_H
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Value.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// The operations compute on integers of the narrowest power of two width
+/// which gives the exact result modulo 2^(width of the result type), that
+/// is the result of the conversion when it wraps around: for example, the
+/// product of two 16-bit values with 15 fractional bits is computed in 32
+/// bits rather than in 64. These sequences of extend, multiply, shift and
+/// truncate are widened by the loop vectorizer and selected by the
+/// backends as high-half multiplies (pmulhw/pmulhrsw on x86, sqdmulh and
+/// sqrdmulh on ARM) and as multiply-accumulates (pmaddwd, mla). They apply
+/// to each lane when the operands are vectors. The operands must have the
+/// integer widths of their types, and the result has the width of the
+/// result type.
+
+/// Width of the intermediate product of A and B converted to Res.
+unsigned fixedPointMulWidth(const mdutils::FPType &A, const mdutils::FPType &B,
+                            const mdutils::FPType &Res);
+
+/// Width of the intermediate quotient of A and B converted to Res.
+unsigned fixedPointDivWidth(const mdutils::FPType &A, const mdutils::FPType &B,
+                            const mdutils::FPType &Res);
+
+/// Emit the product of A and B, of types TA and TB, converted to TRes.
+/// If Round is set, the product is rounded to the nearest value of TRes
+/// instead of truncated towards minus infinity.
+llvm::Value *createFixedPointMul(llvm::IRBuilder<> &Builder,
+                                 llvm::Value *A, const mdutils::FPType &TA,
+                                 llvm::Value *B, const mdutils::FPType &TB,
+                                 const mdutils::FPType &TRes, bool Round = false);
+
+/// Emit the quotient of A and B, of types TA and TB, converted to TRes.
+/// The quotient is truncated towards zero, as sdiv and udiv do. Unlike the
+/// other operations, the division needs the whole dividend, so it is
+/// computed in the width which holds the shifted operands.
+llvm::Value *createFixedPointDiv(llvm::IRBuilder<> &Builder,
+                                 llvm::Value *A, const mdutils::FPType &TA,
+                                 llvm::Value *B, const mdutils::FPType &TB,
+                                 const mdutils::FPType &TRes);
+
+/// Emit Acc + A * B, where Acc and the result have type TAcc. When TAcc has
+/// no more fractional bits than the product, the addition is done on the
+/// product before it is shifted, so that the result is exact before its
+/// conversion and the multiply-accumulate is not split.
+llvm::Value *createFixedPointMulAdd(llvm::IRBuilder<> &Builder,
+                                    llvm::Value *Acc, const mdutils::FPType &TAcc,
+                                    llvm::Value *A, const mdutils::FPType &TA,
+                                    llvm::Value *B, const mdutils::FPType &TB);
+
+}
+
+#endif
@@ -16,7 +16,13 @@
 #include "InputInfo.h"
 
 #include <cmath>
+#include <limits>
+#include <string>
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Mutex.h"
 
 namespace mdutils {
 
@@ -25,13 +31,15 @@ using namespace llvm;
 std::unique_ptr<TType> TType::createFromMetadata(MDNode *MDN) {
   if (FPType::isFPTypeMetadata(MDN))
     return FPType::createFromMetadata(MDN);
+  if (FloatType::isFloatTypeMetadata(MDN))
+    return FloatType::createFromMetadata(MDN);
 
   llvm_unreachable("Unsupported data type.");
 }
 
 bool TType::isTTypeMetadata(Metadata *MD) {
   if (MDNode *MDN = dyn_cast_or_null<MDNode>(MD))
-    return FPType::isFPTypeMetadata(MDN);
+    return FPType::isFPTypeMetadata(MDN) || FloatType::isFloatTypeMetadata(MDN);
   else
     return false;
 }
@@ -99,6 +107,112 @@ double FPType::getMaxValueBound() const  {
   return std::ldexp(MaxInt, -getPointPos());
 }
 
+unsigned FloatType::getWidth() const {
+  switch (Standard) {
+  case Float_half:
+  case Float_bfloat:
+    return 16U;
+  case Float_float:
+    return 32U;
+  case Float_double:
+    return 64U;
+  }
+  llvm_unreachable("Unknown float standard.");
+}
+
+unsigned FloatType::getPrecision() const {
+  switch (Standard) {
+  case Float_half:
+    return 11U;
+  case Float_bfloat:
+    return 8U;
+  case Float_float:
+    return 24U;
+  case Float_double:
+    return 53U;
+  }
+  llvm_unreachable("Unknown float standard.");
+}
+
+/// Exponent of the smallest normal number of Standard.
+static int getMinNormalExponent(FloatType::FloatStandard Standard) {
+  switch (Standard) {
+  case FloatType::Float_half:
+    return -14;
+  case FloatType::Float_bfloat:
+  case FloatType::Float_float:
+    return -126;
+  case FloatType::Float_double:
+    return -1022;
+  }
+  llvm_unreachable("Unknown float standard.");
+}
+
+double FloatType::getRoundingError() const {
+  return std::ldexp(1.0, -(int)getPrecision());
+}
+
+double FloatType::getRoundingError(double Min, double Max) const {
+  double MaxAbs = std::max(std::abs(Min), std::abs(Max));
+  /* below the normal range the absolute error is the one of the
+   * subnormal numbers */
+  double SubnormalError = std::ldexp(1.0, getMinNormalExponent(Standard) - (int)getPrecision());
+  return std::max(MaxAbs * getRoundingError(), SubnormalError);
+}
+
+double FloatType::getMinValueBound() const {
+  return -getMaxValueBound();
+}
+
+double FloatType::getMaxValueBound() const {
+  if (Standard == Float_double)
+    return std::numeric_limits<double>::max();
+  /* (2 - 2^(1-p)) * 2^maxexp */
+  int MaxExp = (Standard == Float_half) ? 15 : 127;
+  int P = getPrecision();
+  return std::ldexp(2.0 - std::ldexp(1.0, 1 - P), MaxExp);
+}
+
+const char *FloatType::getStandardName(FloatStandard Standard) {
+  switch (Standard) {
+  case Float_half:
+    return "half";
+  case Float_bfloat:
+    return "bfloat";
+  case Float_float:
+    return "float";
+  case Float_double:
+    return "double";
+  }
+  llvm_unreachable("Unknown float standard.");
+}
+
+bool FloatType::isFloatTypeMetadata(MDNode *MDN) {
+  if (MDN->getNumOperands() < 1)
+    return false;
+
+  MDString *Flag = dyn_cast<MDString>(MDN->getOperand(0U).get());
+  return Flag && Flag->getString().equals(FLOAT_TYPE_FLAG);
+}
+
+std::unique_ptr<FloatType> FloatType::createFromMetadata(MDNode *MDN) {
+  assert(isFloatTypeMetadata(MDN) && "Must be of float type.");
+  assert(MDN->getNumOperands() >= 2U && "Must have flag and standard.");
+
+  MDString *StdMD = cast<MDString>(MDN->getOperand(1U).get());
+  for (FloatStandard Std : {Float_half, Float_bfloat, Float_float, Float_double}) {
+    if (StdMD->getString().equals(getStandardName(Std)))
+      return std::unique_ptr<FloatType>(new FloatType(Std));
+  }
+  llvm_unreachable("Unsupported float standard.");
+}
+
+MDNode *FloatType::toMetadata(LLVMContext &C) const {
+  Metadata *MDs[] = {MDString::get(C, FLOAT_TYPE_FLAG),
+                     MDString::get(C, getStandardName(Standard))};
+  return MDNode::get(C, MDs);
+}
+
 Metadata *createDoubleMetadata(LLVMContext &C, double Value) {
   Type *DoubleTy = Type::getDoubleTy(C);
   Constant *ValC = ConstantFP::get(DoubleTy, Value);
@@ -198,11 +312,91 @@ bool InputInfo::isInputInfoMetadata(Metadata *MD) {
   return true;
 }
 
+namespace {
+
+/// The skeletons of the types of a context. The types which do not contain
+/// any struct are mapped to nullptr.
+struct ContextSkeletons {
+  DenseMap<Type *, std::shared_ptr<StructInfo>> Types;
+#ifndef NDEBUG
+  /// A metadata kind registered in the context with the skeletons, to
+  /// check that a context with the same address is the same context.
+  std::string Tag;
+#endif
+};
+
+/// Skeletons built by StructInfo::constructFromLLVMType, by context.
+struct StructSkeletonCache {
+  sys::SmartMutex<true> Lock;
+  DenseMap<LLVMContext *, ContextSkeletons> Skeletons;
+#ifndef NDEBUG
+  unsigned NumTags = 0;
+#endif
+};
+
+StructSkeletonCache &getStructSkeletonCache() {
+  static StructSkeletonCache Cache;
+  return Cache;
+}
+
+#ifndef NDEBUG
+bool hasMDKind(LLVMContext &C, StringRef Name) {
+  SmallVector<StringRef, 32> Names;
+  C.getMDKindNames(Names);
+  return is_contained(Names, Name);
+}
+#endif
+
+}
+
+std::shared_ptr<StructInfo> StructInfo::constructFromLLVMTypeCached(Type *t) {
+  StructSkeletonCache &Cache = getStructSkeletonCache();
+  std::shared_ptr<StructInfo> Skeleton;
+  {
+    sys::SmartScopedLock<true> Guard(Cache.Lock);
+    LLVMContext &C = t->getContext();
+    auto Inserted = Cache.Skeletons.try_emplace(&C);
+    ContextSkeletons &Entry = Inserted.first->second;
+#ifndef NDEBUG
+    if (Inserted.second) {
+      Entry.Tag = "taffo.skeletons." + std::to_string(Cache.NumTags++);
+      C.getMDKindID(Entry.Tag);
+    }
+    assert(hasMDKind(C, Entry.Tag) &&
+           "LLVMContext destroyed without MetadataManager::releaseContext");
+#endif
+    auto &TypeMap = Entry.Types;
+    auto It = TypeMap.find(t);
+    if (It == TypeMap.end()) {
+      SmallDenseMap<Type *, std::shared_ptr<StructInfo>> RecursionMap;
+      It = TypeMap.insert({t, constructFromLLVMType(t, &RecursionMap)}).first;
+    }
+    Skeleton = It->second;
+  }
+  if (!Skeleton)
+    return nullptr;
+  /* the skeletons are never modified, the callers get a clone which shares
+   * their fields until it is modified */
+  return std::shared_ptr<StructInfo>(Skeleton->cloneShared());
+}
+
+void StructInfo::releaseTypeCache(LLVMContext &C) {
+  StructSkeletonCache &Cache = getStructSkeletonCache();
+  sys::SmartScopedLock<true> Guard(Cache.Lock);
+  Cache.Skeletons.erase(&C);
+}
+
+void StructInfo::clearTypeCache() {
+  StructSkeletonCache &Cache = getStructSkeletonCache();
+  sys::SmartScopedLock<true> Guard(Cache.Lock);
+  Cache.Skeletons.clear();
+}
+
 MDNode *StructInfo::toMetadata(LLVMContext &C) const {
   Metadata *Null = ConstantAsMetadata::get(ConstantInt::getFalse(C));
   SmallVector<Metadata *, 4U> FieldMDs;
-  FieldMDs.reserve(Fields.size());
-  for (std::shared_ptr<MDInfo> MDI : Fields) {
+  FieldMDs.reserve(size());
+  for (std::shared_ptr<MDInfo> MDI : *this) {
     FieldMDs.push_back((MDI) ? MDI->toMetadata(C) : Null);
   }
   return MDNode::get(C, FieldMDs);
@@ -16,6 +16,7 @@
 #ifndef TAFFO_INPUT_INFO_H
 #define TAFFO_INPUT_INFO_H
 
+#include <atomic>
 #include <memory>
 #include <sstream>
 #include "llvm/Support/Debug.h"
@@ -27,11 +28,13 @@
 namespace mdutils {
 
 #define FIXP_TYPE_FLAG "fixp"
+#define FLOAT_TYPE_FLAG "float"
 
 /// Info about a data type for numerical computations.
+/// Types are immutable once created, and may be shared among InputInfos.
 class TType {
 public:
-  enum TTypeKind { K_FPType };
+  enum TTypeKind { K_FPType, K_FloatType };
 
   TType(TTypeKind K) : Kind(K) {}
 
@@ -114,6 +117,57 @@ protected:
   unsigned PointPos; ///< Number of fractional bits.
 };
 
+/// A Floating Point Type in one of the IEEE 754 binary formats, or bfloat16.
+class FloatType : public TType {
+public:
+  enum FloatStandard {
+    Float_half,   ///< IEEE 754 binary16
+    Float_bfloat, ///< bfloat16 (8 bit exponent, 7 bit fraction)
+    Float_float,  ///< IEEE 754 binary32
+    Float_double  ///< IEEE 754 binary64
+  };
+
+  FloatType(FloatStandard Standard)
+    : TType(K_FloatType), Standard(Standard) {}
+
+  /// Unit roundoff of the format, i.e. the maximum rounding error
+  /// relative to the magnitude of the rounded value.
+  double getRoundingError() const override;
+  /// Maximum absolute rounding error for values in the range [Min, Max].
+  double getRoundingError(double Min, double Max) const;
+  double getMinValueBound() const override;
+  double getMaxValueBound() const override;
+  llvm::MDNode *toMetadata(llvm::LLVMContext &C) const override;
+  FloatStandard getStandard() const { return Standard; }
+  /// Number of bits of the format.
+  unsigned getWidth() const;
+  /// Number of significand bits, including the implicit one.
+  unsigned getPrecision() const;
+
+  virtual TType *clone() const override {
+    return new FloatType(Standard);
+  };
+
+  static bool isFloatTypeMetadata(llvm::MDNode *MDN);
+  static std::unique_ptr<FloatType> createFromMetadata(llvm::MDNode *MDN);
+
+  virtual std::string toString() const override {
+    return getStandardName(Standard);
+  };
+
+  virtual bool operator ==(const TType &b) const override {
+    if (!TType::operator==(b))
+      return false;
+    return Standard == llvm::cast<FloatType>(&b)->Standard;
+  }
+
+  static const char *getStandardName(FloatStandard Standard);
+
+  static bool classof(const TType *T) { return T->getKind() == K_FloatType; }
+protected:
+  FloatStandard Standard;
+};
+
 struct Range {
 public:
   double Min;
@@ -121,7 +175,6 @@ public:
 
   Range() : Min(0.0), Max(0.0) {}
   Range(double Min, double Max) : Min(Min), Max(Max) {}
-  Range(Range& r) : Min(r.Min), Max(r.Max) {}
   
   std::string toString() const {
     std::stringstream sstm;
@@ -179,11 +232,12 @@ struct InputInfo : public MDInfo {
   InputInfo(std::shared_ptr<TType> T, std::shared_ptr<Range> R, std::shared_ptr<double> Error, bool EnC, bool IsFinal = false)
     : MDInfo(K_Field), IType(T), IRange(R), IError(Error), IEnableConversion(EnC), IFinal(IsFinal) {}
 
+  /// The type is immutable, thus it is shared with the clone; the range and
+  /// the error are copied.
   virtual MDInfo *clone() const override {
-    std::shared_ptr<TType> NewIType(IType.get() ? IType->clone() : nullptr);
-    std::shared_ptr<Range> NewIRange(IRange.get() ? new Range(*IRange) : nullptr);
-    std::shared_ptr<double> NewIError(IError.get() ? new double(*IError) : nullptr);
-    return new InputInfo(NewIType, NewIRange, NewIError, IEnableConversion, IFinal);
+    std::shared_ptr<Range> NewIRange(IRange.get() ? std::make_shared<Range>(*IRange) : nullptr);
+    std::shared_ptr<double> NewIError(IError.get() ? std::make_shared<double>(*IError) : nullptr);
+    return new InputInfo(IType, NewIRange, NewIError, IEnableConversion, IFinal);
   }
 
   llvm::MDNode *toMetadata(llvm::LLVMContext &C) const override;
@@ -239,11 +293,34 @@ struct InputInfo : public MDInfo {
 class StructInfo : public MDInfo {
 private:
   typedef llvm::SmallVector<std::shared_ptr<MDInfo>, 4U> FieldsType;
-  FieldsType Fields;
-  
+
+  /// The fields of a StructInfo. The storage of a StructInfo created by
+  /// cloneShared() is shared with the original one; both copy it the
+  /// first time they are modified, since Shared is never reset.
+  struct FieldsStorage {
+    FieldsType Fields;
+    std::atomic<bool> Shared{false};
+
+    FieldsStorage(FieldsType F) : Fields(std::move(F)) {}
+  };
+  std::shared_ptr<FieldsStorage> Storage;
+
+  /// Give this StructInfo its own FieldsStorage, if its current one may be
+  /// shared. The fields are cloned as well; the nested StructInfos share
+  /// their own fields in turn.
+  void makeUnique() {
+    if (!Storage->Shared.load(std::memory_order_acquire))
+      return;
+    FieldsType New;
+    New.reserve(Storage->Fields.size());
+    for (const std::shared_ptr<MDInfo> &F : Storage->Fields)
+      New.push_back(F ? std::shared_ptr<MDInfo>(cloneSharingFields(*F)) : nullptr);
+    Storage = std::make_shared<FieldsStorage>(std::move(New));
+  }
+
   bool _getEnableConversion(llvm::SmallPtrSetImpl<const StructInfo *>& visited) const {
     visited.insert(this);
-    for (auto field: Fields) {
+    for (auto field: Storage->Fields) {
       if (!field.get())
         continue;
       if (StructInfo *si = llvm::dyn_cast<StructInfo>(field.get())) {
@@ -265,31 +342,34 @@ public:
   typedef FieldsType::size_type size_type;
 
   StructInfo(int size)
-    : MDInfo(K_Struct), Fields(size, nullptr) {}
+    : MDInfo(K_Struct), Storage(std::make_shared<FieldsStorage>(FieldsType(size, nullptr))) {}
   
   StructInfo(const llvm::ArrayRef<std::shared_ptr<MDInfo>> SInfos)
-    : MDInfo(K_Struct), Fields(SInfos.begin(), SInfos.end()) {}
-
-  iterator begin() { return Fields.begin(); }
-  iterator end() { return Fields.end(); }
-  const_iterator begin() const { return Fields.begin(); }
-  const_iterator end() const { return Fields.end(); }
-  size_type size() const { return Fields.size(); }
-  MDInfo *getField(size_type I) const { return Fields[I].get(); }
-  void setField(size_type I, std::shared_ptr<MDInfo> F) { Fields[I] = F; }
-  std::shared_ptr<MDInfo> getField(size_type I) { return Fields[I]; }
+    : MDInfo(K_Struct), Storage(std::make_shared<FieldsStorage>(FieldsType(SInfos.begin(), SInfos.end()))) {}
+
+  /// The non-const accessors give access to fields which may be modified
+  /// in place, copying them first if they are shared with another
+  /// StructInfo. The fields reached through a const StructInfo must not
+  /// be modified.
+  iterator begin() { makeUnique(); return Storage->Fields.begin(); }
+  iterator end() { makeUnique(); return Storage->Fields.end(); }
+  const_iterator begin() const { return Storage->Fields.begin(); }
+  const_iterator end() const { return Storage->Fields.end(); }
+  size_type size() const { return Storage->Fields.size(); }
+  const MDInfo *getField(size_type I) const { return Storage->Fields[I].get(); }
+  void setField(size_type I, std::shared_ptr<MDInfo> F) { makeUnique(); Storage->Fields[I] = F; }
+  std::shared_ptr<MDInfo> getField(size_type I) { makeUnique(); return Storage->Fields[I]; }
   
   /** Builds a StructInfo with the recursive structure of the specified
    *  LLVM Type. All non-struct struct members are set to nullptr.
+   *  When no recursionMap is given, the result is a clone of a skeleton
+   *  built once per type and shared with the other values of that type.
    *  @returns Either a StructInfo, or nullptr if the type does not
    *    contain any structure. */
   static std::shared_ptr<StructInfo> constructFromLLVMType(llvm::Type *t, llvm::SmallDenseMap<llvm::Type *, std::shared_ptr<StructInfo>> *recursionMap = nullptr) {
-    std::unique_ptr<llvm::SmallDenseMap<llvm::Type *, std::shared_ptr<StructInfo>>> _recursionMap;
-    if (!recursionMap) {
-      _recursionMap.reset(new llvm::SmallDenseMap<llvm::Type *, std::shared_ptr<StructInfo>>());
-      recursionMap = _recursionMap.get();
-    }
-    
+    if (!recursionMap)
+      return constructFromLLVMTypeCached(t);
+
     auto rec = recursionMap->find(t);
     if (rec != recursionMap->end()) {
       return rec->getSecond();
@@ -314,6 +394,13 @@ public:
     
     return StructInfo::constructFromLLVMType(t->getContainedType(0), recursionMap);
   }
+
+  /** Drops the skeletons cached by constructFromLLVMType for the types
+   *  of C. Must be called before destroying C, if constructFromLLVMType
+   *  will be used again afterwards, since a new context may get the same
+   *  address and types; the builds with assertions check it. */
+  static void releaseTypeCache(llvm::LLVMContext &C);
+  static void clearTypeCache();
   
   std::shared_ptr<MDInfo> resolveFromIndexList(llvm::Type *type, llvm::ArrayRef<unsigned> indices) {
     llvm::Type *resolvedType = type;
@@ -333,7 +420,7 @@ public:
   
   virtual MDInfo *clone() const override {
     FieldsType newFields;
-    for (std::shared_ptr<MDInfo> oldF: Fields) {
+    for (const std::shared_ptr<MDInfo> &oldF: Storage->Fields) {
       if (oldF.get())
         newFields.push_back(std::shared_ptr<MDInfo>(oldF->clone()));
       else
@@ -341,12 +428,28 @@ public:
     }
     return new StructInfo(newFields);
   }
+
+  /// Clone in O(1): the clone shares the fields with this StructInfo
+  /// until either of them is modified. The fields previously obtained
+  /// through the non-const accessors of this StructInfo must not be
+  /// modified anymore, since they may be shared with the clone.
+  StructInfo *cloneShared() const {
+    Storage->Shared.store(true, std::memory_order_release);
+    return new StructInfo(*this);
+  }
+
+  /// Clone I, sharing the fields if it is a StructInfo (see cloneShared).
+  static MDInfo *cloneSharingFields(const MDInfo &I) {
+    if (const StructInfo *SI = llvm::dyn_cast<StructInfo>(&I))
+      return SI->cloneShared();
+    return I.clone();
+  }
   
   virtual std::string toString() const override {
     std::stringstream sstm;
     sstm << "struct(";
     bool first = true;
-    for (std::shared_ptr<MDInfo> i: Fields) {
+    for (std::shared_ptr<MDInfo> i: Storage->Fields) {
       if (!first)
         sstm << ", ";
       if (i.get()) {
@@ -368,6 +471,9 @@ public:
   llvm::MDNode *toMetadata(llvm::LLVMContext &C) const override;
 
   static bool classof(const MDInfo *M) { return M->getKind() == K_Struct; }
+
+private:
+  static std::shared_ptr<StructInfo> constructFromLLVMTypeCached(llvm::Type *t);
 };
 
 
@@ -0,0 +1,484 @@
+//===-- IntegerNarrowing.cpp - Narrowing of the Integers by VRA -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Narrowing of the integer arrays and of the integer arithmetic whose
+/// ranges, computed by VRA, fit in fewer bits, so that the integer code is
+/// vectorized with the lane width of the converted fixed point code.
+///
+//===----------------------------------------------------------------------===//
+
+#include "IntegerNarrowing.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-integer-narrowing"
+
+ALWAYS_ENABLED_STATISTIC(NumNarrowedIntStorage, "Number of integer arrays and scalars narrowed");
+ALWAYS_ENABLED_STATISTIC(NumNarrowedIntOps, "Number of integer instructions computed in fewer bits");
+
+namespace taffo {
+
+bool fitsIntegerWidth(const Range &R, unsigned Width, bool Signed) {
+  if (std::isnan(R.Min) || std::isnan(R.Max) || Width == 0 || Width >= 64)
+    return false;
+  double Min = Signed ? -std::ldexp(1.0, Width - 1) : 0.0;
+  double Max = Signed ? std::ldexp(1.0, Width - 1) - 1.0 : std::ldexp(1.0, Width) - 1.0;
+  return R.Min >= Min && R.Max <= Max;
+}
+
+/* The range of the integer V: of its taffo.info, of the constants, or of
+ * the type V is extended from */
+static bool getIntegerRange(Value *V, Range &R) {
+  if (auto *CI = dyn_cast<ConstantInt>(V)) {
+    if (CI->getBitWidth() > 64)
+      return false;
+    R = Range(CI->getSExtValue(), CI->getSExtValue());
+    return true;
+  }
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I)
+    return false;
+  auto *II = dyn_cast_or_null<InputInfo>(MetadataManager::getMetadataManager().retrieveMDInfo(I));
+  if (II && II->IRange) {
+    R = *II->IRange;
+    return true;
+  }
+  if (isa<SExtInst>(I) || isa<ZExtInst>(I)) {
+    unsigned Width = I->getOperand(0)->getType()->getIntegerBitWidth();
+    if (Width >= 64)
+      return false;
+    if (isa<SExtInst>(I))
+      R = Range(-std::ldexp(1.0, Width - 1), std::ldexp(1.0, Width - 1) - 1.0);
+    else
+      R = Range(0.0, std::ldexp(1.0, Width) - 1.0);
+    return true;
+  }
+  return false;
+}
+
+/* Whether the range of V is known and fits in Width bits */
+static bool fitsIntegerWidth(Value *V, unsigned Width, bool Signed) {
+  Range R;
+  return getIntegerRange(V, R) && fitsIntegerWidth(R, Width, Signed);
+}
+
+/* The low bits of V in Ty, if they are computed without new instructions */
+static Value *getNarrowValue(Value *V, IntegerType *Ty) {
+  if (auto *CI = dyn_cast<ConstantInt>(V))
+    return ConstantInt::get(Ty, CI->getValue().trunc(Ty->getBitWidth()));
+  if (isa<UndefValue>(V))
+    return UndefValue::get(Ty);
+  if ((isa<SExtInst>(V) || isa<ZExtInst>(V)) && cast<Instruction>(V)->getOperand(0)->getType() == Ty)
+    return cast<Instruction>(V)->getOperand(0);
+  return nullptr;
+}
+
+/* The low bits of V in Ty, truncated before InsertBefore if needed */
+static Value *getNarrowOperand(Value *V, IntegerType *Ty, Instruction *InsertBefore) {
+  if (Value *N = getNarrowValue(V, Ty))
+    return N;
+  return new TruncInst(V, Ty, V->getName() + ".trunc", InsertBefore);
+}
+
+/* Whether an operand of I other than the constants is already narrow */
+static bool hasNarrowOperand(Instruction &I, unsigned First, IntegerType *Ty) {
+  for (unsigned Op = First; Op < I.getNumOperands(); Op++) {
+    Value *V = I.getOperand(Op);
+    if (!isa<Constant>(V) && getNarrowValue(V, Ty))
+      return true;
+  }
+  return false;
+}
+
+/* Replaces I with the extension of New, which has its low bits */
+static Instruction *replaceWithExtension(Instruction &I, Instruction *New, bool Signed, Instruction *InsertBefore) {
+  Instruction::CastOps Op = Signed ? Instruction::SExt : Instruction::ZExt;
+  Instruction *Ext = CastInst::Create(Op, New, I.getType(), "", InsertBefore);
+  New->setDebugLoc(I.getDebugLoc());
+  Ext->setDebugLoc(I.getDebugLoc());
+  Ext->setMetadata(INPUT_INFO_METADATA, I.getMetadata(INPUT_INFO_METADATA));
+  Ext->takeName(&I);
+  I.replaceAllUsesWith(Ext);
+  return Ext;
+}
+
+/* Computes in Ty the instruction I, whose range fits in Ty */
+static bool narrowInstruction(Instruction &I, IntegerType *Ty, bool Signed) {
+  unsigned Width = Ty->getBitWidth();
+  Instruction *New;
+  if (auto *BO = dyn_cast<BinaryOperator>(&I)) {
+    switch (BO->getOpcode()) {
+      case Instruction::Shl: {
+        /* the narrow shifts by Width bits or more are poison */
+        Range Amount;
+        if (!getIntegerRange(BO->getOperand(1), Amount) || Amount.Min < 0.0 || Amount.Max >= Width)
+          return false;
+        break;
+      }
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Mul:
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+        break;
+      default:
+        return false;
+    }
+    if (!hasNarrowOperand(I, 0, Ty))
+      return false;
+    auto *NewBO = BinaryOperator::Create(BO->getOpcode(), getNarrowOperand(BO->getOperand(0), Ty, &I),
+                                         getNarrowOperand(BO->getOperand(1), Ty, &I), I.getName() + ".narrow", &I);
+    /* the ranges are of the exact results, so the narrow operation does not
+     * wrap when they and the ranges of the operands fit in it */
+    if (isa<OverflowingBinaryOperator>(NewBO) && BO->getOpcode() != Instruction::Shl) {
+      bool NSW = true, NUW = true;
+      for (Value *V : {(Value *)BO, BO->getOperand(0), BO->getOperand(1)}) {
+        NSW &= fitsIntegerWidth(V, Width, true);
+        NUW &= fitsIntegerWidth(V, Width, false);
+      }
+      NewBO->setHasNoSignedWrap(NSW);
+      NewBO->setHasNoUnsignedWrap(NUW);
+    }
+    New = NewBO;
+  } else if (auto *Sel = dyn_cast<SelectInst>(&I)) {
+    if (!hasNarrowOperand(I, 1, Ty))
+      return false;
+    New = SelectInst::Create(Sel->getCondition(), getNarrowOperand(Sel->getTrueValue(), Ty, &I),
+                             getNarrowOperand(Sel->getFalseValue(), Ty, &I), I.getName() + ".narrow", &I);
+  } else {
+    return false;
+  }
+  replaceWithExtension(I, New, Signed, &I);
+  I.eraseFromParent();
+  return true;
+}
+
+/* Compares in Ty the operands of C, if their ranges fit in it */
+static bool narrowCompare(ICmpInst &C, IntegerType *Ty) {
+  auto *OpTy = dyn_cast<IntegerType>(C.getOperand(0)->getType());
+  if (!OpTy || OpTy->getBitWidth() <= Ty->getBitWidth() || !hasNarrowOperand(C, 0, Ty))
+    return false;
+  unsigned Width = Ty->getBitWidth();
+  bool Signed = fitsIntegerWidth(C.getOperand(0), Width, true) && fitsIntegerWidth(C.getOperand(1), Width, true);
+  bool Unsigned = fitsIntegerWidth(C.getOperand(0), Width, false) && fitsIntegerWidth(C.getOperand(1), Width, false);
+  if (C.isEquality() ? !Signed && !Unsigned : (C.isSigned() ? !Signed : !Unsigned))
+    return false;
+  auto *New = new ICmpInst(&C, C.getPredicate(), getNarrowOperand(C.getOperand(0), Ty, &C),
+                           getNarrowOperand(C.getOperand(1), Ty, &C));
+  New->setDebugLoc(C.getDebugLoc());
+  New->takeName(&C);
+  C.replaceAllUsesWith(New);
+  C.eraseFromParent();
+  return true;
+}
+
+unsigned narrowIntegerArithmetic(Function &F, unsigned Width) {
+  if (F.isDeclaration())
+    return 0;
+  IntegerType *Ty = IntegerType::get(F.getContext(), Width);
+  std::vector<PHINode *> Phis;
+  std::vector<std::pair<Instruction *, bool>> Candidates;
+  std::vector<ICmpInst *> Compares;
+  for (Instruction &I : instructions(F)) {
+    if (auto *C = dyn_cast<ICmpInst>(&I)) {
+      Compares.push_back(C);
+      continue;
+    }
+    auto *IntTy = dyn_cast<IntegerType>(I.getType());
+    Range R;
+    if (!IntTy || IntTy->getBitWidth() <= Width || !getIntegerRange(&I, R))
+      continue;
+    bool Signed = fitsIntegerWidth(R, Width, true);
+    if (!Signed && !fitsIntegerWidth(R, Width, false))
+      continue;
+    if (auto *P = dyn_cast<PHINode>(&I)) {
+      /* the updates in the loops are narrowed after the phis */
+      bool Known = false;
+      bool Narrow = P->getParent()->getFirstInsertionPt() != P->getParent()->end();
+      for (Value *V : P->incoming_values())
+        Known |= getNarrowValue(V, Ty) != nullptr;
+      if (Narrow && Known)
+        Phis.push_back(P);
+    } else {
+      Candidates.push_back({&I, Signed});
+    }
+  }
+
+  unsigned Count = 0;
+  std::vector<std::pair<PHINode *, PHINode *>> NewPhis;
+  for (PHINode *P : Phis) {
+    auto *NP = PHINode::Create(Ty, P->getNumIncomingValues(), P->getName() + ".narrow", P);
+    replaceWithExtension(*P, NP, fitsIntegerWidth(P, Width, true), &*P->getParent()->getFirstInsertionPt());
+    NewPhis.push_back({P, NP});
+    Count++;
+  }
+  for (auto &C : Candidates) {
+    if (narrowInstruction(*C.first, Ty, C.second))
+      Count++;
+  }
+  for (ICmpInst *C : Compares) {
+    if (narrowCompare(*C, Ty))
+      Count++;
+  }
+
+  for (auto &Entry : NewPhis) {
+    PHINode *P = Entry.first, *NP = Entry.second;
+    for (unsigned I = 0; I < P->getNumIncomingValues(); I++) {
+      BasicBlock *BB = P->getIncomingBlock(I);
+      /* the same value for all the edges from a block */
+      int Prev = NP->getBasicBlockIndex(BB);
+      NP->addIncoming(Prev >= 0 ? NP->getIncomingValue(Prev)
+                                : getNarrowOperand(P->getIncomingValue(I), Ty, BB->getTerminator()),
+                      BB);
+    }
+    P->eraseFromParent();
+  }
+
+  /* the extensions whose users are all narrow */
+  SmallVector<Instruction *, 16> Dead;
+  for (Instruction &I : instructions(F)) {
+    if ((isa<SExtInst>(I) || isa<ZExtInst>(I)) && I.use_empty())
+      Dead.push_back(&I);
+  }
+  for (Instruction *I : Dead)
+    I->eraseFromParent();
+
+  NumNarrowedIntOps += Count;
+  return Count;
+}
+
+namespace {
+
+/* The accesses to the elements of a global or an alloca */
+struct ElementAccesses {
+  /* each GEP after the one it is computed from */
+  SmallVector<GEPOperator *, 8> GEPs;
+  SmallVector<LoadInst *, 8> Loads;
+  SmallVector<StoreInst *, 8> Stores;
+};
+
+}
+
+/* The integer type of the elements of T, an integer or an array of them */
+static IntegerType *getElementIntegerType(Type *T) {
+  while (auto *AT = dyn_cast<ArrayType>(T))
+    T = AT->getElementType();
+  return dyn_cast<IntegerType>(T);
+}
+
+static Type *replaceElementType(Type *T, Type *Elem) {
+  if (auto *AT = dyn_cast<ArrayType>(T))
+    return ArrayType::get(replaceElementType(AT->getElementType(), Elem), AT->getNumElements());
+  return Elem;
+}
+
+/* Collects the accesses to the elements of type ElemTy of Base, which
+ * points to a ValueTy; false if the elements are accessed otherwise */
+static bool collectElementAccesses(Value *Base, Type *ValueTy, IntegerType *ElemTy, ElementAccesses &A) {
+  SmallVector<std::pair<Value *, Type *>, 8> Work = {{Base, ValueTy}};
+  for (size_t Next = 0; Next < Work.size(); Next++) {
+    Value *V = Work[Next].first;
+    Type *Pointee = Work[Next].second;
+    for (User *U : V->users()) {
+      if (auto *LI = dyn_cast<LoadInst>(U)) {
+        if (!LI->isSimple() || Pointee != ElemTy || LI->getType() != ElemTy)
+          return false;
+        A.Loads.push_back(LI);
+      } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+        if (!SI->isSimple() || SI->getValueOperand() == V || Pointee != ElemTy ||
+            SI->getValueOperand()->getType() != ElemTy)
+          return false;
+        A.Stores.push_back(SI);
+      } else if (auto *GEP = dyn_cast<GEPOperator>(U)) {
+        if (GEP->getPointerOperand() != V || GEP->getSourceElementType() != Pointee || GEP->getType()->isVectorTy())
+          return false;
+        SmallVector<Value *, 4> Indices(GEP->idx_begin(), GEP->idx_end());
+        Type *Result = GetElementPtrInst::getIndexedType(Pointee, Indices);
+        if (!Result)
+          return false;
+        A.GEPs.push_back(GEP);
+        Work.push_back({GEP, Result});
+      } else {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* The initializer C in NewTy, if its integers fit in Width bits */
+static Constant *narrowConstant(Constant *C, Type *NewTy, unsigned Width, bool Signed) {
+  if (C->isNullValue())
+    return Constant::getNullValue(NewTy);
+  if (isa<UndefValue>(C))
+    return UndefValue::get(NewTy);
+  if (auto *CI = dyn_cast<ConstantInt>(C)) {
+    const APInt &V = CI->getValue();
+    if (Signed ? !V.isSignedIntN(Width) : !V.isIntN(Width))
+      return nullptr;
+    return ConstantInt::get(NewTy, V.trunc(Width));
+  }
+  auto *AT = dyn_cast<ArrayType>(NewTy);
+  if (!AT)
+    return nullptr;
+  SmallVector<Constant *, 16> Elems;
+  for (uint64_t I = 0; I < AT->getNumElements(); I++) {
+    Constant *E = C->getAggregateElement(I);
+    Constant *NE = E ? narrowConstant(E, AT->getElementType(), Width, Signed) : nullptr;
+    if (!NE)
+      return nullptr;
+    Elems.push_back(NE);
+  }
+  return ConstantArray::get(AT, Elems);
+}
+
+/* Gives elements of Width bits to Base, a global or an alloca of a ValueTy */
+static bool narrowStorage(Value *Base, Type *ValueTy, unsigned Width) {
+  IntegerType *ElemTy = getElementIntegerType(ValueTy);
+  if (!ElemTy || ElemTy->getBitWidth() <= Width)
+    return false;
+  auto *II = dyn_cast_or_null<InputInfo>(MetadataManager::getMetadataManager().retrieveMDInfo(Base));
+  if (!II || !II->IRange)
+    return false;
+  bool Signed = fitsIntegerWidth(*II->IRange, Width, true);
+  if (!Signed && !fitsIntegerWidth(*II->IRange, Width, false))
+    return false;
+  ElementAccesses A;
+  if (!collectElementAccesses(Base, ValueTy, ElemTy, A))
+    return false;
+
+  IntegerType *Ty = IntegerType::get(Base->getContext(), Width);
+  Type *NewTy = replaceElementType(ValueTy, Ty);
+  Value *NewBase;
+  if (auto *GV = dyn_cast<GlobalVariable>(Base)) {
+    Constant *Init = nullptr;
+    if (GV->hasInitializer() && !(Init = narrowConstant(GV->getInitializer(), NewTy, Width, Signed)))
+      return false;
+    auto *NewGV = new GlobalVariable(*GV->getParent(), NewTy, GV->isConstant(), GV->getLinkage(), Init, "", GV,
+                                     GV->getThreadLocalMode(), GV->getAddressSpace());
+    NewGV->copyAttributesFrom(GV);
+    /* the debug information describes the original type */
+    SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+    GV->getAllMetadata(MDs);
+    for (auto &MD : MDs) {
+      if (MD.first != LLVMContext::MD_dbg)
+        NewGV->setMetadata(MD.first, MD.second);
+    }
+    NewGV->takeName(GV);
+    NewBase = NewGV;
+  } else {
+    auto *AI = cast<AllocaInst>(Base);
+#if LLVM_VERSION_MAJOR >= 11
+    auto *NewAI = new AllocaInst(NewTy, AI->getType()->getAddressSpace(), AI->getArraySize(), AI->getAlign(), "", AI);
+#else
+    auto *NewAI = new AllocaInst(NewTy, AI->getType()->getAddressSpace(), AI->getArraySize(),
+                                 MaybeAlign(AI->getAlignment()), "", AI);
+#endif
+    NewAI->setDebugLoc(AI->getDebugLoc());
+    NewAI->setMetadata(INPUT_INFO_METADATA, AI->getMetadata(INPUT_INFO_METADATA));
+    NewAI->takeName(AI);
+    NewBase = NewAI;
+  }
+
+  DenseMap<Value *, Value *> NewPointers;
+  NewPointers[Base] = NewBase;
+  for (GEPOperator *GEP : A.GEPs) {
+    Value *Ptr = NewPointers[GEP->getPointerOperand()];
+    Type *SrcTy = replaceElementType(GEP->getSourceElementType(), Ty);
+    if (auto *I = dyn_cast<GetElementPtrInst>(GEP)) {
+      SmallVector<Value *, 4> Indices(I->idx_begin(), I->idx_end());
+      auto *New = GetElementPtrInst::Create(SrcTy, Ptr, Indices, "", I);
+      New->setIsInBounds(I->isInBounds());
+      New->setDebugLoc(I->getDebugLoc());
+      New->setMetadata(INPUT_INFO_METADATA, I->getMetadata(INPUT_INFO_METADATA));
+      New->takeName(I);
+      NewPointers[GEP] = New;
+    } else {
+      SmallVector<Constant *, 4> Indices;
+      for (Value *Index : GEP->indices())
+        Indices.push_back(cast<Constant>(Index));
+      NewPointers[GEP] = ConstantExpr::getGetElementPtr(SrcTy, cast<Constant>(Ptr), Indices, GEP->isInBounds());
+    }
+  }
+  for (LoadInst *LI : A.Loads) {
+    IRBuilder<> Builder(LI);
+    LoadInst *New = Builder.CreateLoad(Ty, NewPointers[LI->getPointerOperand()], LI->getName() + ".narrow");
+    Value *Ext = Signed ? Builder.CreateSExt(New, LI->getType()) : Builder.CreateZExt(New, LI->getType());
+    cast<Instruction>(Ext)->setMetadata(INPUT_INFO_METADATA, LI->getMetadata(INPUT_INFO_METADATA));
+    Ext->takeName(LI);
+    LI->replaceAllUsesWith(Ext);
+    LI->eraseFromParent();
+  }
+  for (StoreInst *SI : A.Stores) {
+    Value *V = getNarrowOperand(SI->getValueOperand(), Ty, SI);
+    IRBuilder<> Builder(SI);
+    Builder.CreateStore(V, NewPointers[SI->getPointerOperand()]);
+    SI->eraseFromParent();
+  }
+  for (auto It = A.GEPs.rbegin(); It != A.GEPs.rend(); ++It) {
+    if (auto *I = dyn_cast<GetElementPtrInst>(*It))
+      I->eraseFromParent();
+  }
+
+  if (auto *GV = dyn_cast<GlobalVariable>(Base)) {
+    GV->removeDeadConstantUsers();
+    GV->eraseFromParent();
+  } else {
+    SmallVector<DbgVariableIntrinsic *, 2> DbgUsers;
+    findDbgUsers(DbgUsers, Base);
+    for (DbgVariableIntrinsic *DVI : DbgUsers)
+      DVI->eraseFromParent();
+    cast<AllocaInst>(Base)->eraseFromParent();
+  }
+  return true;
+}
+
+unsigned narrowIntegerStorage(Module &M, unsigned Width) {
+  SmallVector<std::pair<Value *, Type *>, 16> Bases;
+  for (GlobalVariable &GV : M.globals()) {
+    if (GV.hasLocalLinkage() && !GV.isDeclaration())
+      Bases.push_back({&GV, GV.getValueType()});
+  }
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      if (auto *AI = dyn_cast<AllocaInst>(&I))
+        Bases.push_back({AI, AI->getAllocatedType()});
+    }
+  }
+
+  unsigned Narrowed = 0;
+  for (auto &Base : Bases) {
+    if (narrowStorage(Base.first, Base.second, Width))
+      Narrowed++;
+  }
+  NumNarrowedIntStorage += Narrowed;
+  return Narrowed;
+}
+
+}
@@ -0,0 +1,51 @@
+//===-- IntegerNarrowing.h - Narrowing of the Integers by VRA ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Narrowing of the integer arrays and of the integer arithmetic whose
+/// ranges, computed by VRA, fit in fewer bits, so that the integer code is
+/// vectorized with the lane width of the converted fixed point code.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_INTEGER_NARROWING_H
+#define TAFFOUTILS_INTEGER_NARROWING_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// Whether all the integers in R are representable in Width bits, as
+/// signed or as unsigned integers.
+bool fitsIntegerWidth(const mdutils::Range &R, unsigned Width, bool Signed);
+
+/// Give elements of Width bits to the integer arrays and scalars among the
+/// allocas and the globals with local linkage of M, when the range in
+/// their taffo.info fits in Width bits and they are only accessed by GEPs,
+/// loads and stores of their elements. The loads are sign or zero
+/// extended to the original type, and the stored values truncated. The
+/// debug information of those globals and allocas is dropped. Returns the
+/// number of globals and allocas narrowed.
+unsigned narrowIntegerStorage(llvm::Module &M, unsigned Width);
+
+/// Compute in Width bits the integer phis whose range fits in them, and the
+/// additions, subtractions, multiplications, shifts to the left, bitwise
+/// operations, selects and comparisons of the values which are already
+/// narrow (the extensions from Width bits, the narrowed phis and
+/// instructions, and the constants), when their range fits in Width bits.
+/// The ranges of the wide operations are exact, so the low bits of their
+/// results are the same; the narrow results are extended where the wide
+/// values are still used. Returns the number of instructions narrowed.
+unsigned narrowIntegerArithmetic(llvm::Function &F, unsigned Width);
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+//===-- Kernels.cpp - GPU and OpenCL Kernels --------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Recognition of the kernels of the OpenCL, SPIR, AMDGPU and NVPTX
+/// modules, which are the entry points of the converted code.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Kernels.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/CallingConv.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-kernels"
+
+ALWAYS_ENABLED_STATISTIC(NumKernels, "Number of kernels marked as starting points");
+
+namespace taffo {
+
+bool isKernelTarget(const Module &M) {
+  switch (Triple(M.getTargetTriple()).getArch()) {
+  case Triple::spir:
+  case Triple::spir64:
+  case Triple::amdgcn:
+  case Triple::r600:
+  case Triple::nvptx:
+  case Triple::nvptx64:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* Whether the nvvm.annotations of M have the entry {F, "kernel", 1} */
+static bool isNVVMKernel(const Function &F) {
+  const NamedMDNode *Annotations = F.getParent()->getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return false;
+  for (const MDNode *Node : Annotations->operands()) {
+    /* the entries are lists of the function and of key-value pairs */
+    if (Node->getNumOperands() < 3 || mdconst::dyn_extract_or_null<Function>(Node->getOperand(0)) != &F)
+      continue;
+    for (unsigned I = 1; I + 1 < Node->getNumOperands(); I += 2) {
+      auto *Key = dyn_cast_or_null<MDString>(Node->getOperand(I));
+      auto *Value = mdconst::dyn_extract_or_null<ConstantInt>(Node->getOperand(I + 1));
+      if (Key && Value && Key->getString() == "kernel" && !Value->isZero())
+        return true;
+    }
+  }
+  return false;
+}
+
+bool isKernel(const Function &F) {
+  if (F.isDeclaration())
+    return false;
+  switch (F.getCallingConv()) {
+  case CallingConv::SPIR_KERNEL:
+  case CallingConv::AMDGPU_KERNEL:
+  case CallingConv::PTX_Kernel:
+    return true;
+  default:
+    return isNVVMKernel(F);
+  }
+}
+
+unsigned markKernelEntryPoints(Module &M) {
+  unsigned Count = 0;
+  for (Function &F : M) {
+    if (!isKernel(F) || MetadataManager::isStartingPoint(F))
+      continue;
+    MetadataManager::setStartingPoint(F);
+    Count++;
+  }
+  NumKernels += Count;
+  return Count;
+}
+
+}
@@ -0,0 +1,39 @@
+//===-- Kernels.h - GPU and OpenCL Kernels ----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Recognition of the kernels of the OpenCL, SPIR, AMDGPU and NVPTX
+/// modules, which are the entry points of the converted code.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_KERNELS_H
+#define TAFFOUTILS_KERNELS_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// Whether the target triple of M is one of a device: spir, spir64, amdgcn,
+/// r600, nvptx or nvptx64.
+bool isKernelTarget(const llvm::Module &M);
+
+/// Whether F is a kernel: a definition with the SPIR, AMDGPU or PTX kernel
+/// calling convention, or listed as a kernel in the nvvm.annotations.
+bool isKernel(const llvm::Function &F);
+
+/// Mark the kernels of M as starting points (taffo.start), so that they
+/// are the roots of the analysis with the ranges of their annotated
+/// arguments. Returns the number of kernels marked.
+unsigned markKernelEntryPoints(llvm::Module &M);
+
+}
+
+#endif
@@ -15,6 +15,7 @@
 #include "Metadata.h"
 
 #include <sstream>
+#include "Trace.h"
 
 namespace mdutils {
 
@@ -25,6 +26,182 @@ MetadataManager& MetadataManager::getMetadataManager() {
   return Instance;
 }
 
+void MetadataManager::clearCache() {
+  TTypes.clear();
+  Ranges.clear();
+  IErrors.clear();
+  IInfos.clear();
+  StructInfos.clear();
+  Annotations.clear();
+  sys::SmartScopedLock<true> Guard(EmittedInputInfosLock);
+  EmittedInputInfos.clear();
+  StructInfo::clearTypeCache();
+}
+
+void MetadataManager::releaseContext(LLVMContext &C) {
+  TTypes.releaseContext(C);
+  Ranges.releaseContext(C);
+  IErrors.releaseContext(C);
+  IInfos.releaseContext(C);
+  StructInfos.releaseContext(C);
+  StructInfo::releaseTypeCache(C);
+
+  /* the keys of the emitted nodes start with the address of the context */
+  LLVMContext *Ctx = &C;
+  StringRef Prefix(reinterpret_cast<const char *>(&Ctx), sizeof(Ctx));
+  sys::SmartScopedLock<true> Guard(EmittedInputInfosLock);
+  for (auto It = EmittedInputInfos.begin(), End = EmittedInputInfos.end(); It != End;) {
+    auto Cur = It++;
+    if (Cur->getKey().startswith(Prefix))
+      EmittedInputInfos.erase(Cur);
+  }
+}
+
+MDCacheStats MetadataManager::getCacheStats() const {
+  MDCacheStats Stats;
+  Stats += TTypes.getStats();
+  Stats += Ranges.getStats();
+  Stats += IErrors.getStats();
+  Stats += IInfos.getStats();
+  Stats += StructInfos.getStats();
+  Stats += Annotations.getStats();
+  return Stats;
+}
+
+void MetadataManager::printCacheStats(raw_ostream &OS) const {
+  auto Print = [&OS](StringRef Name, const MDCacheStats &Stats) {
+    OS << Name << ": " << Stats.Entries << " entries, " << Stats.Hits
+       << " hits, " << Stats.Misses << " misses\n";
+  };
+  Print("TType", TTypes.getStats());
+  Print("Range", Ranges.getStats());
+  Print("Error", IErrors.getStats());
+  Print("InputInfo", IInfos.getStats());
+  Print("StructInfo", StructInfos.getStats());
+  Print("Annotation", Annotations.getStats());
+}
+
+std::shared_ptr<const ParsedAnnotation> AnnotationCache::get(StringRef Text, ParseFunction Parse,
+                                                             std::string &Error) {
+  {
+    sys::SmartScopedReader<true> Guard(Lock);
+    auto It = Map.find(Text);
+    if (It != Map.end()) {
+      Hits.fetch_add(1, std::memory_order_relaxed);
+      return It->second;
+    }
+  }
+  Misses.fetch_add(1, std::memory_order_relaxed);
+  /* parsed without holding the lock; if another thread parses the same
+   * string meanwhile, the first result is kept */
+  std::shared_ptr<ParsedAnnotation> A = std::make_shared<ParsedAnnotation>();
+  if (!Parse(Text, *A, Error))
+    return nullptr;
+  sys::SmartScopedWriter<true> Guard(Lock);
+  return Map.insert(std::make_pair(Text, std::move(A))).first->second;
+}
+
+void AnnotationCache::clear() {
+  sys::SmartScopedWriter<true> Guard(Lock);
+  Map.clear();
+}
+
+MDCacheStats AnnotationCache::getStats() const {
+  MDCacheStats Stats;
+  Stats.Hits = Hits.load(std::memory_order_relaxed);
+  Stats.Misses = Misses.load(std::memory_order_relaxed);
+  sys::SmartScopedReader<true> Guard(Lock);
+  Stats.Entries = Map.size();
+  return Stats;
+}
+
+/// Append to Key the bytes identifying the metadata of II in C.
+/// Return false if II contains a type which cannot be keyed.
+static bool appendInputInfoKey(SmallVectorImpl<char> &Key,
+                               LLVMContext &C, const InputInfo &II) {
+  auto Append = [&Key](const void *P, size_t Size) {
+    const char *Bytes = static_cast<const char *>(P);
+    Key.append(Bytes, Bytes + Size);
+  };
+  LLVMContext *Ctx = &C;
+  Append(&Ctx, sizeof(Ctx));
+
+  char Present = II.IType != nullptr;
+  Append(&Present, 1);
+  if (II.IType) {
+    const FPType *FPT = dyn_cast<FPType>(II.IType.get());
+    if (!FPT)
+      return false;
+    int Width = FPT->getSWidth();
+    unsigned PointPos = FPT->getPointPos();
+    Append(&Width, sizeof(Width));
+    Append(&PointPos, sizeof(PointPos));
+  }
+
+  /* the bit patterns distinguish 0.0 from -0.0 like ConstantFP does */
+  Present = II.IRange != nullptr;
+  Append(&Present, 1);
+  if (II.IRange) {
+    Append(&II.IRange->Min, sizeof(double));
+    Append(&II.IRange->Max, sizeof(double));
+  }
+
+  Present = II.IError != nullptr;
+  Append(&Present, 1);
+  if (II.IError)
+    Append(II.IError.get(), sizeof(double));
+
+  char Flags = II.IEnableConversion | (II.IFinal << 1);
+  Append(&Flags, 1);
+  return true;
+}
+
+MDNode *MetadataManager::emitMDInfo(LLVMContext &C, const MDInfo &Info) {
+  if (const StructInfo *SInfo = dyn_cast<StructInfo>(&Info)) {
+    Metadata *Null = ConstantAsMetadata::get(ConstantInt::getFalse(C));
+    SmallVector<Metadata *, 4U> FieldMDs;
+    FieldMDs.reserve(SInfo->size());
+    for (const std::shared_ptr<MDInfo> &Field : *SInfo)
+      FieldMDs.push_back((Field) ? emitMDInfo(C, *Field) : Null);
+    return MDNode::get(C, FieldMDs);
+  }
+
+  const InputInfo &IInfo = cast<InputInfo>(Info);
+  SmallString<64> Key;
+  if (!appendInputInfoKey(Key, C, IInfo))
+    return IInfo.toMetadata(C);
+  {
+    sys::SmartScopedLock<true> Guard(EmittedInputInfosLock);
+    auto Cached = EmittedInputInfos.find(Key);
+    if (Cached != EmittedInputInfos.end())
+      return Cached->second;
+  }
+
+  MDNode *MDN = IInfo.toMetadata(C);
+  seedInputInfo(MDN, IInfo);
+  sys::SmartScopedLock<true> Guard(EmittedInputInfosLock);
+  EmittedInputInfos.insert(std::make_pair(Key, MDN));
+  return MDN;
+}
+
+/// Insert in the conversion caches the objects that decoding MDN, just
+/// built from II, would produce.
+void MetadataManager::seedInputInfo(MDNode *MDN, const InputInfo &II) {
+  if (IInfos.contains(MDN))
+    return;
+  std::shared_ptr<TType> IType;
+  std::shared_ptr<Range> IRange;
+  std::shared_ptr<double> IError;
+  if (II.IType)
+    IType = TTypes.insert(cast<MDNode>(MDN->getOperand(0U)), II.IType);
+  if (II.IRange)
+    IRange = Ranges.insert(cast<MDNode>(MDN->getOperand(1U)), std::make_shared<Range>(*II.IRange));
+  if (II.IError)
+    IError = IErrors.insert(cast<MDNode>(MDN->getOperand(2U)), std::make_shared<double>(*II.IError));
+  IInfos.insert(MDN, std::make_shared<InputInfo>(IType, IRange, IError,
+                                                 II.IEnableConversion, II.IFinal));
+}
+
 MDInfo *MetadataManager::retrieveMDInfo(const Value *v) {
   if (const Instruction *i = dyn_cast<Instruction>(v)) {
     if (MDNode *mdn = i->getMetadata(INPUT_INFO_METADATA)) {
@@ -123,22 +300,65 @@ setMDInfoMetadata(llvm::Value *u, const MDInfo *mdinfo) {
   }
   
   if (Instruction *instr = dyn_cast<Instruction>(u)) {
-    instr->setMetadata(mdid, mdinfo->toMetadata(u->getContext()));
+    instr->setMetadata(mdid, getMetadataManager().emitMDInfo(u->getContext(), *mdinfo));
   } else if (GlobalObject *go = dyn_cast<GlobalObject>(u)) {
-    go->setMetadata(mdid, mdinfo->toMetadata(u->getContext()));
+    go->setMetadata(mdid, getMetadataManager().emitMDInfo(u->getContext(), *mdinfo));
   } else {
     assert(false && "parameter not an instruction or a global object");
   }
 }
 
+void MetadataManager::
+retrieveFunctionMDInfo(const Function &F, SmallVectorImpl<MDInfo *> &ResInfos) {
+  LLVMContext &C = F.getContext();
+  unsigned InputInfoKind = C.getMDKindID(INPUT_INFO_METADATA);
+  unsigned StructInfoKind = C.getMDKindID(STRUCT_INFO_METADATA);
+  ResInfos.clear();
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      if (!I.hasMetadata()) {
+        ResInfos.push_back(nullptr);
+      } else if (MDNode *mdn = I.getMetadata(InputInfoKind)) {
+        ResInfos.push_back(retrieveInputInfo(mdn).get());
+      } else if (MDNode *mdn = I.getMetadata(StructInfoKind)) {
+        ResInfos.push_back(retrieveStructInfo(mdn).get());
+      } else {
+        ResInfos.push_back(nullptr);
+      }
+    }
+  }
+}
+
+void MetadataManager::
+setFunctionMDInfoMetadata(Function &F, ArrayRef<const MDInfo *> Infos) {
+  LLVMContext &C = F.getContext();
+  unsigned InputInfoKind = C.getMDKindID(INPUT_INFO_METADATA);
+  unsigned StructInfoKind = C.getMDKindID(STRUCT_INFO_METADATA);
+  MetadataManager &MM = getMetadataManager();
+  auto Info = Infos.begin();
+  for (BasicBlock &BB : F) {
+    for (Instruction &I : BB) {
+      if (Info == Infos.end())
+        return;
+      const MDInfo *mdinfo = *Info++;
+      if (!mdinfo)
+        continue;
+      unsigned Kind = isa<StructInfo>(mdinfo) ? StructInfoKind : InputInfoKind;
+      I.setMetadata(Kind, MM.emitMDInfo(C, *mdinfo));
+    }
+  }
+}
+
 void MetadataManager::
 setInputInfoMetadata(Instruction &I, const InputInfo &IInfo) {
-  I.setMetadata(INPUT_INFO_METADATA, IInfo.toMetadata(I.getContext()));
+  TAFFO_TRACE(taffo::Trace::getCurrentStage(), &I, IInfo.IRange.get(), IInfo.IType.get(), "taffo.info");
+  I.setMetadata(INPUT_INFO_METADATA, getMetadataManager().emitMDInfo(I.getContext(), IInfo));
 }
 
 void MetadataManager::
 setInputInfoMetadata(GlobalObject &V, const InputInfo &IInfo) {
-  V.setMetadata(INPUT_INFO_METADATA, IInfo.toMetadata(V.getContext()));
+  TAFFO_TRACE(taffo::Trace::getCurrentStage(), &V, IInfo.IRange.get(), IInfo.IType.get(), "taffo.info");
+  V.setMetadata(INPUT_INFO_METADATA, getMetadataManager().emitMDInfo(V.getContext(), IInfo));
 }
 
 void MetadataManager::
@@ -155,10 +375,10 @@ setArgumentInputInfoMetadata(Function &F, const ArrayRef<MDInfo *> AInfo) {
       val = ConstantAsMetadata::get(Constant::getNullValue(Type::getInt1Ty(Context)));
     } else if (InputInfo *IInfo = dyn_cast<InputInfo>(info)) {
       tid = 1;
-      val = IInfo->toMetadata(Context);
+      val = getMetadataManager().emitMDInfo(Context, *IInfo);
     } else if (StructInfo *SInfo = dyn_cast<StructInfo>(info)) {
       tid = 2;
-      val = SInfo->toMetadata(Context);
+      val = getMetadataManager().emitMDInfo(Context, *SInfo);
     } else {
       assert("invalid MDInfo in array");
     }
@@ -184,7 +404,7 @@ setConstInfoMetadata(llvm::Instruction &I,
 
   for (InputInfo *II : CInfo) {
     if (II) {
-      ConstMDs.push_back(II->toMetadata(Context));
+      ConstMDs.push_back(getMetadataManager().emitMDInfo(Context, *II));
     } else {
       ConstMDs.push_back(ConstantAsMetadata::get(ConstantInt::getFalse(Context)));
     }
@@ -202,11 +422,11 @@ StructInfo* MetadataManager::retrieveStructInfo(const GlobalObject &V) {
 }
 
 void MetadataManager::setStructInfoMetadata(Instruction &I, const StructInfo &SInfo) {
-  I.setMetadata(STRUCT_INFO_METADATA, SInfo.toMetadata(I.getContext()));
+  I.setMetadata(STRUCT_INFO_METADATA, getMetadataManager().emitMDInfo(I.getContext(), SInfo));
 }
 
 void MetadataManager::setStructInfoMetadata(GlobalObject &V, const StructInfo &SInfo) {
-  V.setMetadata(STRUCT_INFO_METADATA, SInfo.toMetadata(V.getContext()));
+  V.setMetadata(STRUCT_INFO_METADATA, getMetadataManager().emitMDInfo(V.getContext(), SInfo));
 }
 
 
@@ -477,70 +697,60 @@ std::shared_ptr<TType> MetadataManager::retrieveTType(MDNode *MDN) {
   if (MDN == nullptr)
     return nullptr;
 
-  auto CachedTT = TTypes.find(MDN);
-  if (CachedTT != TTypes.end())
-    return CachedTT->second;
+  if (std::shared_ptr<TType> CachedTT = TTypes.lookup(MDN))
+    return CachedTT;
 
   std::shared_ptr<TType> TT(TType::createFromMetadata(MDN));
 
-  TTypes.insert(std::make_pair(MDN, TT));
-  return TT;
+  return TTypes.insert(MDN, TT);
 }
 
 std::shared_ptr<Range> MetadataManager::retrieveRange(MDNode *MDN) {
   if (MDN == nullptr)
     return nullptr;
 
-  auto CachedRange = Ranges.find(MDN);
-  if (CachedRange != Ranges.end())
-    return CachedRange->second;
+  if (std::shared_ptr<Range> CachedRange = Ranges.lookup(MDN))
+    return CachedRange;
 
   std::shared_ptr<Range> NRange(Range::createFromMetadata(MDN));
 
-  Ranges.insert(std::make_pair(MDN, NRange));
-  return NRange;
+  return Ranges.insert(MDN, NRange);
 }
 
 std::shared_ptr<double> MetadataManager::retrieveError(MDNode *MDN) {
   if (MDN == nullptr)
     return nullptr;
 
-  auto CachedError = IErrors.find(MDN);
-  if (CachedError != IErrors.end())
-    return CachedError->second;
+  if (std::shared_ptr<double> CachedError = IErrors.lookup(MDN))
+    return CachedError;
 
   std::shared_ptr<double> NError(CreateInitialErrorFromMetadata(MDN));
 
-  IErrors.insert(std::make_pair(MDN, NError));
-  return NError;
+  return IErrors.insert(MDN, NError);
 }
 
 std::shared_ptr<InputInfo> MetadataManager::retrieveInputInfo(MDNode *MDN) {
   if (MDN == nullptr)
     return nullptr;
 
-  auto CachedIInfo = IInfos.find(MDN);
-  if (CachedIInfo != IInfos.end())
-    return CachedIInfo->second;
+  if (std::shared_ptr<InputInfo> CachedIInfo = IInfos.lookup(MDN))
+    return CachedIInfo;
 
   std::shared_ptr<InputInfo> NIInfo(createInputInfoFromMetadata(MDN));
 
-  IInfos.insert(std::make_pair(MDN, NIInfo));
-  return NIInfo;
+  return IInfos.insert(MDN, NIInfo);
 }
 
 std::shared_ptr<StructInfo> MetadataManager::retrieveStructInfo(MDNode *MDN) {
   if (MDN == nullptr)
     return nullptr;
 
-  auto CachedStructInfo = StructInfos.find(MDN);
-  if (CachedStructInfo != StructInfos.end())
-    return CachedStructInfo->second;
+  if (std::shared_ptr<StructInfo> CachedStructInfo = StructInfos.lookup(MDN))
+    return CachedStructInfo;
 
   std::shared_ptr<StructInfo> NSInfo(createStructInfoFromMetadata(MDN));
 
-  StructInfos.insert(std::make_pair(MDN, NSInfo));
-  return NSInfo;
+  return StructInfos.insert(MDN, NSInfo);
 }
 
 std::unique_ptr<InputInfo> MetadataManager::
@@ -600,3 +810,7 @@ createStructInfoFromMetadata(MDNode *MDN) {
 }
 
 }
+
+void TaffoMetadataManagerClearCache() {
+  mdutils::MetadataManager::getMetadataManager().clearCache();
+}
@@ -15,17 +15,25 @@
 #ifndef ERRORPROPAGATOR_METADATA_H
 #define ERRORPROPAGATOR_METADATA_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/GlobalObject.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/RWMutex.h"
+#include "llvm/Support/raw_ostream.h"
 #include "InputInfo.h"
 
 #define INPUT_INFO_METADATA    "taffo.info"
@@ -41,6 +49,7 @@
 #define ORIGINAL_FUN_METADATA  "taffo.originalCall"
 #define CLONED_FUN_METADATA    "taffo.equivalentChild"
 #define SOURCE_FUN_METADATA    "taffo.sourceFunction"
+#define RANGE_GUARD_METADATA   "taffo.rangeGuard"
 
 /* Integer which specifies the distance of the metadata from the
  * original annotation as data flow node counts.
@@ -49,13 +58,198 @@
 
 namespace mdutils {
 
+/// Counters of the accesses to the MetadataManager caches.
+struct MDCacheStats {
+  uint64_t Hits = 0;
+  uint64_t Misses = 0;
+  uint64_t Entries = 0;
+
+  MDCacheStats &operator+=(const MDCacheStats &O) {
+    Hits += O.Hits;
+    Misses += O.Misses;
+    Entries += O.Entries;
+    return *this;
+  }
+};
+
+/// Thread-safe cache of the in-memory representation of MDNodes.
+/// The entries are distributed among shards by the hash of the node, each
+/// one protected by its own reader/writer lock, so that concurrent lookups
+/// only contend when they hit the same shard while it is being written.
+template <typename T>
+class MDNodeCache {
+public:
+  /// Return the cached value for MDN, or nullptr if there is none.
+  std::shared_ptr<T> lookup(llvm::MDNode *MDN) const {
+    const Shard &S = Shards[shardOf(MDN)];
+    llvm::sys::SmartScopedReader<true> Guard(S.Lock);
+    auto It = S.Map.find(MDN);
+    if (It == S.Map.end()) {
+      Misses.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Hits.fetch_add(1, std::memory_order_relaxed);
+    return It->second.Value;
+  }
+
+  /// Return whether a value is cached for MDN, without counting the
+  /// access in the statistics.
+  bool contains(llvm::MDNode *MDN) const {
+    const Shard &S = Shards[shardOf(MDN)];
+    llvm::sys::SmartScopedReader<true> Guard(S.Lock);
+    return S.Map.count(MDN) != 0;
+  }
+
+  /// Cache V for MDN, unless another value has been cached in the meantime.
+  /// Return the value actually cached.
+  /// V is built by the caller without holding any lock, since converting a
+  /// node may require retrieving the nodes it refers to.
+  std::shared_ptr<T> insert(llvm::MDNode *MDN, std::shared_ptr<T> V) {
+    Shard &S = Shards[shardOf(MDN)];
+    Entry E = {std::move(V), &MDN->getContext()};
+    llvm::sys::SmartScopedWriter<true> Guard(S.Lock);
+    return S.Map.insert(std::make_pair(MDN, std::move(E))).first->second.Value;
+  }
+
+  void clear() {
+    for (Shard &S : Shards) {
+      llvm::sys::SmartScopedWriter<true> Guard(S.Lock);
+      S.Map.clear();
+    }
+  }
+
+  /// Drop the entries of the nodes owned by C.
+  /// The nodes themselves are never accessed, since they may already be
+  /// freed.
+  void releaseContext(const llvm::LLVMContext &C) {
+    for (Shard &S : Shards) {
+      llvm::sys::SmartScopedWriter<true> Guard(S.Lock);
+      for (auto It = S.Map.begin(), End = S.Map.end(); It != End; ++It) {
+        if (It->second.Context == &C)
+          S.Map.erase(It);
+      }
+    }
+  }
+
+  MDCacheStats getStats() const {
+    MDCacheStats Stats;
+    Stats.Hits = Hits.load(std::memory_order_relaxed);
+    Stats.Misses = Misses.load(std::memory_order_relaxed);
+    for (const Shard &S : Shards) {
+      llvm::sys::SmartScopedReader<true> Guard(S.Lock);
+      Stats.Entries += S.Map.size();
+    }
+    return Stats;
+  }
+
+private:
+  enum { NumShards = 16 };
+
+  struct Entry {
+    std::shared_ptr<T> Value;
+    /// The context owning the node, recorded when it was alive.
+    const llvm::LLVMContext *Context;
+  };
+
+  struct Shard {
+    mutable llvm::sys::SmartRWMutex<true> Lock;
+    llvm::DenseMap<llvm::MDNode *, Entry> Map;
+  };
+
+  Shard Shards[NumShards];
+  mutable std::atomic<uint64_t> Hits{0};
+  mutable std::atomic<uint64_t> Misses{0};
+
+  static unsigned shardOf(llvm::MDNode *MDN) {
+    return llvm::DenseMapInfo<llvm::MDNode *>::getHashValue(MDN) % NumShards;
+  }
+};
+
+/// An annotation string (doc/AnnotationSyntax.md) as parsed by the
+/// Initializer: its top-level attributes and its data type pattern.
+struct ParsedAnnotation {
+  /// The data type pattern; nullptr for void. It is shared by all the
+  /// values with the same annotation, and thus never modified.
+  std::shared_ptr<const MDInfo> Info;
+  /// The name given by target(), if any.
+  llvm::Optional<std::string> Target;
+  /// The depth given by backtracking(): 0 if disabled, ~0U if unlimited.
+  unsigned Backtracking = 0;
+
+  /// A copy of Info for one annotated value, which may be modified; the
+  /// fields of the StructInfos are shared until then.
+  std::unique_ptr<MDInfo> instantiate() const {
+    return std::unique_ptr<MDInfo>(Info ? StructInfo::cloneSharingFields(*Info) : nullptr);
+  }
+};
+
+/// Thread-safe cache of the parsed annotation strings, keyed by their text,
+/// so that the strings repeated over many variables (e.g. by macros) are
+/// parsed once.
+class AnnotationCache {
+public:
+  /// The parser of the Initializer: fills Out from Text, or returns false
+  /// with a message in Error.
+  typedef llvm::function_ref<bool(llvm::StringRef, ParsedAnnotation &, std::string &)> ParseFunction;
+
+  /// Return the annotation Text, parsed by Parse unless it is cached.
+  /// Return nullptr, with the message of Parse in Error, if Text is
+  /// malformed; the malformed strings are not cached, so that each use
+  /// reports its error.
+  std::shared_ptr<const ParsedAnnotation> get(llvm::StringRef Text, ParseFunction Parse,
+                                              std::string &Error);
+
+  void clear();
+
+  MDCacheStats getStats() const;
+
+private:
+  mutable llvm::sys::SmartRWMutex<true> Lock;
+  llvm::StringMap<std::shared_ptr<const ParsedAnnotation> > Map;
+  mutable std::atomic<uint64_t> Hits{0};
+  mutable std::atomic<uint64_t> Misses{0};
+};
+
 /// Class that converts LLVM Metadata into the in.memory representation.
 /// It caches internally the converted data structures
 /// to reduce memory consumption and conversion overhead.
 /// The returned pointers have the same lifetime as the MetadataManager instance.
+/// The retrieve methods may be called concurrently from multiple threads,
+/// as long as the metadata they read is not modified in the meantime.
 class MetadataManager {
 public:
   static MetadataManager& getMetadataManager();
+
+  /// Drop all the converted data structures cached so far.
+  /// The pointers previously returned by the MetadataManager become dangling.
+  /// Must be called before destroying the LLVMContext owning the cached
+  /// metadata, if the MetadataManager will be used again afterwards.
+  void clearCache();
+
+  /// Drop the converted data structures of the metadata owned by C.
+  /// The pointers previously returned for that metadata become dangling.
+  /// Must be called before destroying C, otherwise the addresses of its
+  /// nodes may be reused by a later context and hit stale entries.
+  void releaseContext(llvm::LLVMContext &C);
+
+  /// Metadata is owned by the LLVMContext rather than by the Module, so
+  /// this releases the entries of every module sharing M's context.
+  void releaseModule(llvm::Module &M) { releaseContext(M.getContext()); }
+
+  /// Return the hit, miss and entry counts of all the caches together.
+  MDCacheStats getCacheStats() const;
+
+  /// Print the statistics of each cache, one per line.
+  void printCacheStats(llvm::raw_ostream &OS) const;
+
+  /// The annotation strings parsed so far, shared by the Initializers of
+  /// all the modules; they do not depend on the LLVMContext.
+  AnnotationCache &getAnnotationCache() { return Annotations; }
+
+  /// Build the metadata node for Info, or return the node previously built
+  /// for an equal InputInfo. The nodes built are also inserted in the
+  /// conversion caches, so that retrieving them again does not decode them.
+  llvm::MDNode *emitMDInfo(llvm::LLVMContext &C, const MDInfo &Info);
   
   ///\section Input Info & Struct Info
 
@@ -80,9 +274,22 @@ public:
   void retrieveConstInfo(const llvm::Instruction &I,
 			 llvm::SmallVectorImpl<InputInfo *> &ResII);
 
+  /// Fill ResInfos with the MDInfo of each instruction of F, in
+  /// instruction order (nullptr for the instructions without one).
+  /// Equivalent to calling retrieveMDInfo on each instruction, but the
+  /// metadata kinds are looked up once for the whole function.
+  void retrieveFunctionMDInfo(const llvm::Function &F,
+                              llvm::SmallVectorImpl<MDInfo *> &ResInfos);
+
   /// Attach to value u the specified MDInfo node.
   static void setMDInfoMetadata(llvm::Value *u, const MDInfo *mdinfo);
 
+  /// Attach Infos[i] to the i-th instruction of F, in instruction order.
+  /// The instructions whose info is nullptr are left untouched, and Infos
+  /// may be shorter than the number of instructions.
+  static void setFunctionMDInfoMetadata(llvm::Function &F,
+                                        llvm::ArrayRef<const MDInfo *> Infos);
+
   /// Attach to Instruction I an input info metadata node
   /// containing Type info T, Range, and initial Error.
   static void setInputInfoMetadata(llvm::Instruction &I, const InputInfo &IInfo);
@@ -175,11 +382,19 @@ public:
   static llvm::Optional<llvm::StringRef> retrieveTargetMetadata(const llvm::GlobalObject &V);
 
 protected:
-  llvm::DenseMap<llvm::MDNode *, std::shared_ptr<TType> > TTypes;
-  llvm::DenseMap<llvm::MDNode *, std::shared_ptr<Range> > Ranges;
-  llvm::DenseMap<llvm::MDNode *, std::shared_ptr<double> > IErrors;
-  llvm::DenseMap<llvm::MDNode *, std::shared_ptr<InputInfo> > IInfos;
-  llvm::DenseMap<llvm::MDNode *, std::shared_ptr<StructInfo> > StructInfos;
+  MDNodeCache<TType> TTypes;
+  MDNodeCache<Range> Ranges;
+  MDNodeCache<double> IErrors;
+  MDNodeCache<InputInfo> IInfos;
+  MDNodeCache<StructInfo> StructInfos;
+  AnnotationCache Annotations;
+
+  /// Nodes built by emitMDInfo for InputInfos, keyed by the context and
+  /// the bit patterns of the type, range, error and flags.
+  llvm::StringMap<llvm::MDNode *> EmittedInputInfos;
+  llvm::sys::SmartMutex<true> EmittedInputInfosLock;
+
+  void seedInputInfo(llvm::MDNode *MDN, const InputInfo &II);
 
   std::shared_ptr<TType> retrieveTType(llvm::MDNode *MDN);
   std::shared_ptr<Range> retrieveRange(llvm::MDNode *MDN);
@@ -206,4 +421,8 @@ private:
 
 }
 
+/// C entry point to MetadataManager::clearCache(), looked up by the tools
+/// which load the TAFFO plugin once and use it on multiple LLVMContexts.
+extern "C" void TaffoMetadataManagerClearCache();
+
 #endif
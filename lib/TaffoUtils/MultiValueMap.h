@@ -14,6 +14,8 @@
 // This data structure guarantees that the mapped values will never change
 // allocation address during the lifetime of the object, no matter how it is
 // mutated.
+// The list nodes and the mapped values are allocated from pools of slabs
+// owned by the map, rather than one by one.
 //
 // All operations invalidate all item-wise standard iterators.
 //
@@ -25,8 +27,11 @@
 #include <utility>
 #include <memory>
 #include <type_traits>
+#include <algorithm>
+#include <iterator>
 #include <limits>
-#include <list>
+#include <new>
+#include <vector>
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/ValueMap.h"
@@ -35,6 +40,182 @@
 namespace taffo {
 
 
+/// Allocator of objects of type T with stable addresses. The objects are
+/// carved out of slabs of SlabSize objects, and the memory of the destroyed
+/// ones is reused. The objects still alive when the pool is destroyed are
+/// not destroyed.
+template <typename T, unsigned SlabSize = 64>
+class StablePool {
+  union Slot {
+    Slot *NextFree;
+    alignas(T) char Storage[sizeof(T)];
+  };
+
+  std::vector<std::unique_ptr<Slot[]>> Slabs;
+  Slot *FreeList = nullptr;
+  size_t NumFree = 0;
+  unsigned UsedInLastSlab = SlabSize;
+
+  /// Push Count contiguous slots on the free list, so that they are used in
+  /// address order.
+  void linkFree(Slot *First, unsigned Count) {
+    for (unsigned I = Count; I > 0; I--) {
+      First[I - 1].NextFree = FreeList;
+      FreeList = &First[I - 1];
+    }
+    NumFree += Count;
+  }
+
+public:
+  StablePool() = default;
+  StablePool(const StablePool &) = delete;
+  StablePool &operator=(const StablePool &) = delete;
+
+  template <typename... ArgTs>
+  T *create(ArgTs&&... Args) {
+    Slot *S = FreeList;
+    if (S) {
+      FreeList = S->NextFree;
+      NumFree--;
+    } else {
+      if (UsedInLastSlab == SlabSize) {
+        Slabs.emplace_back(new Slot[SlabSize]);
+        UsedInLastSlab = 0;
+      }
+      S = &Slabs.back()[UsedInLastSlab++];
+    }
+    return new (S->Storage) T(std::forward<ArgTs>(Args)...);
+  }
+
+  void destroy(T *P) {
+    P->~T();
+    Slot *S = reinterpret_cast<Slot *>(P);
+    S->NextFree = FreeList;
+    FreeList = S;
+    NumFree++;
+  }
+
+  /// Allocate the memory for N more objects.
+  void reserve(size_t N) {
+    if (NumFree + (SlabSize - UsedInLastSlab) >= N)
+      return;
+    /* the reserved slabs are handed out through the free list, so the
+     * unused tail of the last slab must go there too before it stops being
+     * the last one */
+    if (!Slabs.empty())
+      linkFree(Slabs.back().get() + UsedInLastSlab, SlabSize - UsedInLastSlab);
+    UsedInLastSlab = SlabSize;
+    while (NumFree < N) {
+      Slabs.emplace_back(new Slot[SlabSize]);
+      linkFree(Slabs.back().get(), SlabSize);
+    }
+  }
+
+  /// Release all the memory. All the objects must have been destroyed.
+  void reset() {
+    Slabs.clear();
+    FreeList = nullptr;
+    NumFree = 0;
+    UsedInLastSlab = SlabSize;
+  }
+};
+
+
+/// Doubly linked list with the std::list interface used by MultiValueMap,
+/// whose nodes are allocated from a StablePool. Like std::list, the
+/// elements never move, and T may be incomplete where the list is declared.
+template <typename T>
+class PooledList {
+  struct NodeBase {
+    NodeBase *Prev;
+    NodeBase *Next;
+  };
+  struct Node : public NodeBase {
+    T Value;
+    Node(T&& V) : Value(std::move(V)) {}
+  };
+
+  NodeBase Sentinel;
+  StablePool<Node> Pool;
+
+  template <bool IsConst>
+  class Iterator : public std::iterator<std::bidirectional_iterator_tag,
+      typename std::conditional<IsConst, const T, T>::type> {
+    friend class PooledList;
+    using RefT = typename std::conditional<IsConst, const T&, T&>::type;
+    using PtrT = typename std::conditional<IsConst, const T*, T*>::type;
+
+    NodeBase *N = nullptr;
+
+  public:
+    Iterator() = default;
+    explicit Iterator(const NodeBase *N) : N(const_cast<NodeBase *>(N)) {}
+    template <bool OtherConst, typename = typename std::enable_if<IsConst || !OtherConst>::type>
+    Iterator(const Iterator<OtherConst> &Other) : N(Other.getNode()) {}
+
+    NodeBase *getNode() const { return N; }
+
+    RefT operator*() const { return static_cast<Node *>(N)->Value; }
+    PtrT operator->() const { return &static_cast<Node *>(N)->Value; }
+    Iterator &operator++() { N = N->Next; return *this; }
+    Iterator operator++(int) { Iterator Res = *this; N = N->Next; return Res; }
+    Iterator &operator--() { N = N->Prev; return *this; }
+    Iterator operator--(int) { Iterator Res = *this; N = N->Prev; return Res; }
+    template <bool OtherConst>
+    bool operator==(const Iterator<OtherConst> &RHS) const { return N == RHS.getNode(); }
+    template <bool OtherConst>
+    bool operator!=(const Iterator<OtherConst> &RHS) const { return N != RHS.getNode(); }
+  };
+
+public:
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  PooledList() { Sentinel.Prev = Sentinel.Next = &Sentinel; }
+  PooledList(const PooledList &) = delete;
+  PooledList &operator=(const PooledList &) = delete;
+  ~PooledList() { clear(); }
+
+  iterator begin() { return iterator(Sentinel.Next); }
+  iterator end() { return iterator(&Sentinel); }
+  const_iterator begin() const { return const_iterator(Sentinel.Next); }
+  const_iterator end() const { return const_iterator(&Sentinel); }
+  bool empty() const { return Sentinel.Next == &Sentinel; }
+  void reserve(size_t N) { Pool.reserve(N); }
+
+  /// Insert V before Pos.
+  iterator insert(const_iterator Pos, T&& V) {
+    Node *New = Pool.create(std::move(V));
+    NodeBase *Next = Pos.getNode();
+    New->Next = Next;
+    New->Prev = Next->Prev;
+    Next->Prev->Next = New;
+    Next->Prev = New;
+    return iterator(New);
+  }
+
+  /// Erase the element at Pos. Returns the iterator to the next one.
+  iterator erase(const_iterator Pos) {
+    NodeBase *N = Pos.getNode();
+    NodeBase *Next = N->Next;
+    N->Prev->Next = Next;
+    Next->Prev = N->Prev;
+    Pool.destroy(static_cast<Node *>(N));
+    return iterator(Next);
+  }
+
+  void clear() {
+    for (NodeBase *N = Sentinel.Next; N != &Sentinel;) {
+      NodeBase *Next = N->Next;
+      static_cast<Node *>(N)->~Node();
+      N = Next;
+    }
+    Sentinel.Prev = Sentinel.Next = &Sentinel;
+    Pool.reset();
+  }
+};
+
+
 template <typename KeyT>
 struct MultiValueMapConfig {
   // All methods will be called with a first argument of type ExtraData.  The
@@ -57,15 +238,16 @@ protected:
   struct KeyListItemT;
 
   // Type of the list of the groups of values associated to each key
-  using KeyListT = std::list<KeyListItemT>;
+  using KeyListT = PooledList<KeyListItemT>;
   
   struct KeyListItemT {
-    std::unique_ptr<ValueT> Value;
+    // Mapped value, allocated from Values; only tags have one
+    ValueT *Value = nullptr;
     KeyT Key;
     typename KeyListT::iterator TagIt;
     long long OrderIdx = std::numeric_limits<long long>::max();
     
-    bool isTag() const { return bool(Value); };
+    bool isTag() const { return Value != nullptr; };
   };
   
   struct SingleValueIndexConfig : public llvm::ValueMapConfig<KeyT> {
@@ -80,9 +262,26 @@ protected:
 
   SingleValueIndexT Index;
   KeyListT KeyList;
+  StablePool<ValueT> Values;
   long long OrderIdxSpacing = 0x100000;
   
   MultiValueMapBase() : Index(this) {}
+  ~MultiValueMapBase() { destroyValues(); }
+
+  /// Erase an item of the key list, and its value if it is a tag.
+  typename KeyListT::iterator eraseItem(typename KeyListT::iterator I) {
+    if (I->isTag())
+      Values.destroy(I->Value);
+    return KeyList.erase(I);
+  }
+
+  void destroyValues() {
+    for (KeyListItemT &Item: KeyList) {
+      if (Item.isTag())
+        Values.destroy(Item.Value);
+    }
+    Values.reset();
+  }
 };
 
 
@@ -227,7 +426,7 @@ public:
   }
   ValueTypeProxy operator*() const {
     skipTagForward();
-    MappedT& V = *(IKeyList->TagIt->Value.get());
+    MappedT& V = *(IKeyList->TagIt->Value);
     return ValueTypeProxy{IKeyList->Key, V};
   }
   ValueTypeProxy operator->() const {
@@ -236,8 +435,11 @@ public:
   
   bool operator<=(const MultiValueMapIterator& RHS) const {
     skipTagForward();
-    if (RHS.IKeyList == IKeyList)
+    RHS.skipTagForward();
+    if (RHS.IKeyList == IKeyList || RHS.IKeyList == Parent->KeyList.end())
       return true;
+    if (IKeyList == Parent->KeyList.end())
+      return false;
     return IKeyList->OrderIdx <= RHS.IKeyList->OrderIdx;
   }
   bool operator<(const MultiValueMapIterator& RHS) const {
@@ -288,10 +490,34 @@ public:
   unsigned size() const { return this->Index.size(); }
   
   void clear() {
+    this->destroyValues();
     this->KeyList.clear();
     this->Index.clear();
   }
   
+  /// Prepare the map to hold N more keys, each one associated to its own
+  /// value. The index can only be resized while the map is empty.
+  void reserve(size_type N) {
+    this->KeyList.reserve(2 * N);
+    this->Values.reserve(N);
+    if (this->Index.empty()) {
+      /* ValueMap has no reserve; the empty index holds no value handles,
+       * so it can be rebuilt in place with the desired size */
+      this->Index.~SingleValueIndexT();
+      new (&this->Index) SingleValueIndexT(this, N);
+    }
+  }
+  
+  /// Replace the contents of the map with the key, value pairs in [I, E),
+  /// each key associated to its own value. Keys after the first occurrence
+  /// of the same key are ignored. [I, E) must be a forward range.
+  template<typename ForwardIt>
+  void assign(ForwardIt I, ForwardIt E) {
+    clear();
+    reserve(std::distance(I, E));
+    appendPairs(I, E);
+  }
+  
   size_type count(const KeyT& K) const {
     return this->Index.find(K) != this->Index.end();
   }
@@ -322,12 +548,12 @@ public:
     auto VListIt = this->Index.find(K);
     if (VListIt == this->Index.end())
       return ValueT();
-    return *(VListIt->second->TagIt->Value.get());
+    return *(VListIt->second->TagIt->Value);
   }
   ValueT& operator[](const KeyT& K) {
     auto VListIt = this->Index.find(K);
     assert(VListIt != this->Index.end());
-    return *(VListIt->second->TagIt->Value.get());
+    return *(VListIt->second->TagIt->Value);
   }
   
   /// Get the list of keys associated to the same value as a given key.
@@ -345,9 +571,17 @@ public:
     return true;
   }
   
+  /// Returns true if K1 precedes K2 in the map, in constant time.
+  /// Both keys must be in the map.
+  bool comesBefore(const KeyT& K1, const KeyT& K2) const {
+    auto I1 = this->Index.find(K1);
+    auto I2 = this->Index.find(K2);
+    assert(I1 != this->Index.end() && I2 != this->Index.end() && "keys not in the map");
+    return I1->second->OrderIdx < I2->second->OrderIdx;
+  }
+  
 private:
   long long orderIdxForNewElem(typename KeyListT::iterator Pos) {
-    // TODO: CATCH OVERFLOWS/UNDERFLOWS/BAD IDX ALLOCATIONS!!!!
     auto Next = Pos;
     if (Next == this->KeyList.begin()) {
       if (Next != this->KeyList.end())
@@ -358,7 +592,94 @@ private:
     auto Prev = --Pos;
     if (Next == this->KeyList.end())
       return Prev->OrderIdx + this->OrderIdxSpacing;
-    return (Prev->OrderIdx + Next->OrderIdx) / 2;
+    if (Next->OrderIdx - Prev->OrderIdx < 2)
+      relabelAround(Prev, Next);
+    return Prev->OrderIdx + (Next->OrderIdx - Prev->OrderIdx) / 2;
+  }
+  
+  /// Appends the key, value pairs in [I, E) to the end of the list with
+  /// evenly spaced order indices, probing the index once per key.
+  template<typename InputIt>
+  void appendPairs(InputIt I, InputIt E) {
+    long long Idx = this->KeyList.empty() ? 0
+        : std::prev(this->KeyList.end())->OrderIdx + this->OrderIdxSpacing;
+    for (; I != E; ++I) {
+      const KeyT& K = (*I).first;
+      auto IndexIns = this->Index.insert(std::make_pair(K, this->KeyList.end()));
+      if (!IndexIns.second)
+        continue;
+      
+      KeyListItemT NewTag;
+      NewTag.Value = this->Values.create((*I).second);
+      NewTag.OrderIdx = Idx;
+      auto TagIt = this->KeyList.insert(this->KeyList.end(), std::move(NewTag));
+      TagIt->TagIt = TagIt;
+      
+      KeyListItemT NewItem;
+      NewItem.Key = K;
+      NewItem.TagIt = TagIt;
+      NewItem.OrderIdx = Idx + this->OrderIdxSpacing / 2;
+      IndexIns.first->second = this->KeyList.insert(this->KeyList.end(), std::move(NewItem));
+      Idx += this->OrderIdxSpacing;
+    }
+  }
+  
+  /// Spreads the OrderIdx of the items around the adjacent items L and R,
+  /// so that there is room for a new item between them.
+  /// The window of items to relabel starts from L and R and doubles until
+  /// the indices available around it are sparse enough; the density
+  /// required decreases as the window grows, so that the cost of the
+  /// relabellings is amortized over the insertions.
+  void relabelAround(typename KeyListT::iterator L, typename KeyListT::iterator R) {
+    auto First = L;
+    auto Last = R;
+    long long N = 2;
+    for (unsigned Level = 1;; Level++) {
+      bool AtBegin = First == this->KeyList.begin();
+      bool AtEnd = std::next(Last) == this->KeyList.end();
+      if (AtBegin && AtEnd) {
+        long long Idx = 0;
+        for (KeyListItemT& Item: this->KeyList) {
+          Item.OrderIdx = Idx;
+          Idx += this->OrderIdxSpacing;
+        }
+        return;
+      }
+      
+      long long MinGap = 1LL << std::min(Level, 40U);
+      long long Lo, Hi;
+      if (AtBegin) {
+        Hi = std::next(Last)->OrderIdx;
+        Lo = Hi - (N + 1) * std::max(MinGap, this->OrderIdxSpacing);
+      } else if (AtEnd) {
+        Lo = std::prev(First)->OrderIdx;
+        Hi = Lo + (N + 1) * std::max(MinGap, this->OrderIdxSpacing);
+      } else {
+        Lo = std::prev(First)->OrderIdx;
+        Hi = std::next(Last)->OrderIdx;
+      }
+      
+      long long Step = (Hi - Lo) / (N + 1);
+      if (Step >= MinGap) {
+        long long Idx = Lo;
+        for (auto I = First; I != std::next(Last); ++I) {
+          Idx += Step;
+          I->OrderIdx = Idx;
+        }
+        return;
+      }
+      
+      for (long long Grow = (N + 1) / 2; Grow > 0; Grow--) {
+        if (First != this->KeyList.begin()) {
+          --First;
+          N++;
+        }
+        if (std::next(Last) != this->KeyList.end()) {
+          ++Last;
+          N++;
+        }
+      }
+    }
   }
 
 public:
@@ -369,7 +690,7 @@ public:
       
     auto FixedP = P.insertionPointerForNewList();
     KeyListItemT NewTag;
-    NewTag.Value.reset(new ValueT(V));
+    NewTag.Value = this->Values.create(V);
     NewTag.OrderIdx = orderIdxForNewElem(FixedP);
     auto TagIt = this->KeyList.insert(FixedP, std::move(NewTag));
     TagIt->TagIt = TagIt;
@@ -455,6 +776,10 @@ public:
   
   template<typename InputIt>
   iterator insert(iterator P, InputIt I, InputIt E) {
+    if (P == end()) {
+      appendPairs(I, E);
+      return end();
+    }
     std::pair<iterator, bool> State{P, true};
     for (; I != E; ++I, ++State.first)
       State = insert(State.first, *I);
@@ -471,10 +796,10 @@ public:
   
   iterator eraseAll(iterator I) {
     auto Ptr = I.IKeyList->TagIt;
-    Ptr = this->KeyList.erase(Ptr);
+    Ptr = this->eraseItem(Ptr);
     while (Ptr != this->KeyList.end() && !Ptr->isTag()) {
       this->Index.erase(Ptr->Key);
-      Ptr = this->KeyList.erase(Ptr);
+      Ptr = this->eraseItem(Ptr);
     }
     return iterator(*this, Ptr);
   }
@@ -491,11 +816,11 @@ public:
     auto Itm = I.IKeyList;
     auto Tag = Itm->TagIt;
     this->Index.erase(Itm->Key);
-    Itm = this->KeyList.erase(Itm);
+    Itm = this->eraseItem(Itm);
     auto Prev = Itm;
     --Prev;
-    if (Itm->isTag() && Prev == Tag) {
-      this->KeyList.erase(Tag);
+    if ((Itm == this->KeyList.end() || Itm->isTag()) && Prev == Tag) {
+      this->eraseItem(Tag);
     }
     return iterator(*this, Itm);
   }
@@ -516,7 +841,7 @@ public:
     #define DEBUG_TYPE "MultiValueMap"
     for (auto& V: this->KeyList) {
       if (V.isTag())
-        LLVM_DEBUG(llvm::dbgs() << "[TAG] V=" << V.Value.get() << "\n");
+        LLVM_DEBUG(llvm::dbgs() << "[TAG] V=" << V.Value << "\n");
       else
         LLVM_DEBUG(llvm::dbgs() << "[ITM] K=" << V.Key << " O=" << V.OrderIdx << "\n");
     }
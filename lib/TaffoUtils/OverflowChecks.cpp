@@ -0,0 +1,285 @@
+//===-- OverflowChecks.cpp - Fixed Point Overflow Checks --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Sampled checks for the overflows of the fixed point operations of the
+/// converted code.
+///
+//===----------------------------------------------------------------------===//
+
+#include "OverflowChecks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include "InputInfo.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-overflow-checks"
+
+ALWAYS_ENABLED_STATISTIC(NumOverflowChecks, "Number of overflow checks inserted");
+ALWAYS_ENABLED_STATISTIC(NumSampledFunctions, "Number of functions with sampled overflow checks");
+
+namespace taffo {
+
+static const FPType *getFixedPointType(const Instruction &I) {
+  const InputInfo *II = MetadataManager::getMetadataManager().retrieveInputInfo(I);
+  if (!II || !II->IType)
+    return nullptr;
+  return dyn_cast<FPType>(II->IType.get());
+}
+
+std::string getCheckLocation(const Instruction &I) {
+  const Function &F = *I.getFunction();
+  std::string Location;
+  raw_string_ostream OS(Location);
+  if (const DebugLoc &DL = I.getDebugLoc()) {
+    OS << DL->getFilename() << ":" << DL.getLine() << ":" << DL.getCol() << " in " << F.getName();
+  } else {
+    unsigned Index = 0;
+    for (const Instruction &Other : instructions(F)) {
+      if (&Other == &I)
+        break;
+      Index++;
+    }
+    OS << F.getName() << ", instruction " << Index;
+  }
+  OS.flush();
+  return Location;
+}
+
+bool mayOverflow(const Instruction &I) {
+  if (!I.getType()->isIntegerTy())
+    return false;
+  switch (I.getOpcode()) {
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul:
+  case Instruction::Shl:
+  case Instruction::Trunc:
+    return getFixedPointType(I) != nullptr;
+  default:
+    return false;
+  }
+}
+
+static bool isTarget(const Value *V) {
+  while (true) {
+    if (auto *GEP = dyn_cast<GEPOperator>(V))
+      V = GEP->getPointerOperand();
+    else if (auto *BC = dyn_cast<BitCastOperator>(V))
+      V = BC->getOperand(0);
+    else
+      break;
+  }
+  if (auto *I = dyn_cast<Instruction>(V))
+    return MetadataManager::retrieveTargetMetadata(*I).hasValue();
+  if (auto *GO = dyn_cast<GlobalObject>(V))
+    return MetadataManager::retrieveTargetMetadata(*GO).hasValue();
+  return false;
+}
+
+std::vector<Instruction *> collectMayOverflow(Function &F, bool TargetsOnly) {
+  std::vector<Instruction *> Checks;
+  for (Instruction &I : instructions(F)) {
+    if (!TargetsOnly) {
+      if (mayOverflow(I))
+        Checks.push_back(&I);
+      continue;
+    }
+    Instruction *Checked = &I;
+    if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      Checked = dyn_cast<Instruction>(Store->getValueOperand());
+      if (!Checked || !isTarget(Store->getPointerOperand()))
+        continue;
+    } else if (!MetadataManager::retrieveTargetMetadata(I)) {
+      continue;
+    }
+    if (mayOverflow(*Checked) && std::find(Checks.begin(), Checks.end(), Checked) == Checks.end())
+      Checks.push_back(Checked);
+  }
+  return Checks;
+}
+
+/* Inserts after I the check of its overflow, which reports Location */
+static void insertCheck(Instruction &I, StringRef Location) {
+  const FPType *FPT = getFixedPointType(I);
+  bool Signed = FPT->isSigned();
+  Module &M = *I.getModule();
+  LLVMContext &C = M.getContext();
+  Type *DoubleTy = Type::getDoubleTy(C);
+  IRBuilder<> B(I.getNextNode());
+
+  Value *Overflow;
+  Value *A = I.getOperand(0);
+  switch (I.getOpcode()) {
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul: {
+    Intrinsic::ID ID;
+    if (I.getOpcode() == Instruction::Add)
+      ID = Signed ? Intrinsic::sadd_with_overflow : Intrinsic::uadd_with_overflow;
+    else if (I.getOpcode() == Instruction::Sub)
+      ID = Signed ? Intrinsic::ssub_with_overflow : Intrinsic::usub_with_overflow;
+    else
+      ID = Signed ? Intrinsic::smul_with_overflow : Intrinsic::umul_with_overflow;
+    Function *WithOverflow = Intrinsic::getDeclaration(&M, ID, {I.getType()});
+    Overflow = B.CreateExtractValue(B.CreateCall(WithOverflow, {A, I.getOperand(1)}), 1);
+    break;
+  }
+  case Instruction::Shl: {
+    Value *Back = Signed ? B.CreateAShr(&I, I.getOperand(1)) : B.CreateLShr(&I, I.getOperand(1));
+    Overflow = B.CreateICmpNE(Back, A);
+    break;
+  }
+  default: {
+    Value *Back = Signed ? B.CreateSExt(&I, A->getType()) : B.CreateZExt(&I, A->getType());
+    Overflow = B.CreateICmpNE(Back, A);
+    break;
+  }
+  }
+
+  /* the report is in a block of its own, off the hot path */
+  Instruction *SplitPt = cast<Instruction>(Overflow)->getNextNode();
+  BasicBlock *Head = SplitPt->getParent();
+  BasicBlock *Tail = Head->splitBasicBlock(SplitPt, Head->getName() + ".ovf.tail");
+  BasicBlock *ReportBB = BasicBlock::Create(C, Head->getName() + ".ovf", Head->getParent(), Tail);
+  Head->getTerminator()->eraseFromParent();
+  BranchInst *Br = BranchInst::Create(ReportBB, Tail, Overflow, Head);
+  Br->setMetadata(LLVMContext::MD_prof, MDBuilder(C).createBranchWeights(1, 1 << 20));
+
+  /* the exact result, with the point position of the result */
+  B.SetInsertPoint(BranchInst::Create(Tail, ReportBB));
+  auto ToDouble = [&](Value *V) {
+    return Signed ? B.CreateSIToFP(V, DoubleTy) : B.CreateUIToFP(V, DoubleTy);
+  };
+  Value *Exact;
+  switch (I.getOpcode()) {
+  case Instruction::Add:
+    Exact = B.CreateFAdd(ToDouble(A), ToDouble(I.getOperand(1)));
+    break;
+  case Instruction::Sub:
+    Exact = B.CreateFSub(ToDouble(A), ToDouble(I.getOperand(1)));
+    break;
+  case Instruction::Mul:
+    Exact = B.CreateFMul(ToDouble(A), ToDouble(I.getOperand(1)));
+    break;
+  case Instruction::Shl: {
+    Value *Amount = B.CreateUIToFP(I.getOperand(1), DoubleTy);
+    Exact = B.CreateFMul(ToDouble(A), B.CreateIntrinsic(Intrinsic::exp2, {DoubleTy}, {Amount}));
+    break;
+  }
+  default:
+    Exact = ToDouble(A);
+    break;
+  }
+  Exact = B.CreateFMul(Exact, ConstantFP::get(DoubleTy, std::ldexp(1.0, -(int)FPT->getPointPos())));
+  FunctionCallee Report = M.getOrInsertFunction("taffo_fixm_overflow", Type::getVoidTy(C),
+                                                Type::getInt8PtrTy(C), DoubleTy);
+  B.CreateCall(Report, {B.CreateGlobalStringPtr(Location), Exact});
+  NumOverflowChecks++;
+}
+
+/* Makes one call every Period of F run Checked instead */
+static void dispatchSampled(Function &F, Function &Checked, unsigned Period) {
+  Module &M = *F.getParent();
+  LLVMContext &C = M.getContext();
+  Type *I32 = Type::getInt32Ty(C);
+  GlobalVariable *Countdown = new GlobalVariable(M, I32, false, GlobalValue::InternalLinkage,
+                                                 ConstantInt::get(I32, Period),
+                                                 "__taffo_overflow_countdown." + F.getName());
+
+  /* after the allocas, which stay at the beginning of the entry block */
+  BasicBlock::iterator Entry = F.getEntryBlock().getFirstInsertionPt();
+  while (isa<AllocaInst>(&*Entry))
+    ++Entry;
+  IRBuilder<> B(&*Entry);
+  /* F may run on several threads: the accesses to the countdown are
+   * atomic, but not the decrement, since a lost decrement only delays the
+   * next sample */
+  LoadInst *Current = B.CreateLoad(I32, Countdown);
+  Current->setAlignment(Align(4));
+  Current->setAtomic(AtomicOrdering::Monotonic);
+  Value *Next = B.CreateSub(Current, ConstantInt::get(I32, 1));
+  Value *Sample = B.CreateICmpEQ(Next, ConstantInt::get(I32, 0));
+  StoreInst *Store = B.CreateStore(B.CreateSelect(Sample, ConstantInt::get(I32, Period), Next), Countdown);
+  Store->setAlignment(Align(4));
+  Store->setAtomic(AtomicOrdering::Monotonic);
+
+  BasicBlock *Head = &F.getEntryBlock();
+  BasicBlock *Tail = Head->splitBasicBlock(&*B.GetInsertPoint(), "ovf.unchecked");
+  BasicBlock *CheckedBB = BasicBlock::Create(C, "ovf.checked", &F, Tail);
+  Head->getTerminator()->eraseFromParent();
+  BranchInst *Br = BranchInst::Create(CheckedBB, Tail, Sample, Head);
+  Br->setMetadata(LLVMContext::MD_prof, MDBuilder(C).createBranchWeights(1, Period - 1));
+
+  B.SetInsertPoint(CheckedBB);
+  std::vector<Value *> Args;
+  for (Argument &Arg : F.args())
+    Args.push_back(&Arg);
+  CallInst *Call = B.CreateCall(&Checked, Args);
+  Call->setCallingConv(F.getCallingConv());
+  if (F.getReturnType()->isVoidTy())
+    B.CreateRetVoid();
+  else
+    B.CreateRet(Call);
+}
+
+unsigned insertOverflowChecks(Module &M, unsigned SamplePeriod, bool TargetsOnly) {
+  std::vector<std::pair<Function *, std::vector<Instruction *>>> Work;
+  for (Function &F : M) {
+    if (F.isDeclaration() || (SamplePeriod > 1 && F.isVarArg()))
+      continue;
+    std::vector<Instruction *> Checks = collectMayOverflow(F, TargetsOnly);
+    if (!Checks.empty())
+      Work.push_back({&F, std::move(Checks)});
+  }
+
+  unsigned Count = 0;
+  for (auto &FChecks : Work) {
+    Function &F = *FChecks.first;
+    /* the locations refer to the original function */
+    std::vector<std::string> Locations;
+    for (Instruction *I : FChecks.second)
+      Locations.push_back(getCheckLocation(*I));
+
+    std::vector<Instruction *> Checks = FChecks.second;
+    if (SamplePeriod > 1) {
+      ValueToValueMapTy VMap;
+      Function *Checked = CloneFunction(&F, VMap);
+      Checked->setName(F.getName() + ".checked");
+      Checked->setLinkage(GlobalValue::InternalLinkage);
+      Checked->setComdat(nullptr);
+      for (Instruction *&I : Checks)
+        I = cast<Instruction>(VMap[I]);
+      dispatchSampled(F, *Checked, SamplePeriod);
+      NumSampledFunctions++;
+    }
+    for (unsigned I = 0; I < Checks.size(); I++)
+      insertCheck(*Checks[I], Locations[I]);
+    Count += Checks.size();
+  }
+  return Count;
+}
+
+}
@@ -0,0 +1,56 @@
+//===-- OverflowChecks.h - Fixed Point Overflow Checks ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Sampled checks for the overflows of the fixed point operations of the
+/// converted code.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_OVERFLOW_CHECKS_H
+#define TAFFOUTILS_OVERFLOW_CHECKS_H
+
+#include <string>
+#include <vector>
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// Where I is, for the reports: its debug location and its function, or
+/// its function and its index in it.
+std::string getCheckLocation(const llvm::Instruction &I);
+
+/// Whether the converted instruction I may overflow its fixed point type:
+/// the additions, subtractions, multiplications and left shifts, and the
+/// truncations of the wider intermediate values, whose taffo.info has a
+/// fixed point type.
+bool mayOverflow(const llvm::Instruction &I);
+
+/// The instructions of F which may overflow, in program order; if
+/// TargetsOnly, only the ones marked as targets and the values stored to
+/// the targets.
+std::vector<llvm::Instruction *> collectMayOverflow(llvm::Function &F, bool TargetsOnly);
+
+/// Check the operations of the converted code which may overflow, and call
+/// taffo_fixm_overflow (TaffoOverflow.h) with the location and the exact
+/// real value of the ones which do. If TargetsOnly, only the instructions
+/// marked as targets, and the values stored to the targets, are checked.
+///
+/// With a SamplePeriod above 1 the checks are sampled: each function with
+/// checks is cloned, and one call every SamplePeriod of the function runs
+/// the checked clone, so that the other calls only pay a countdown. The
+/// variadic functions cannot forward their arguments, so they are not
+/// checked when sampling. Returns the number of checks inserted.
+unsigned insertOverflowChecks(llvm::Module &M, unsigned SamplePeriod, bool TargetsOnly);
+
+}
+
+#endif
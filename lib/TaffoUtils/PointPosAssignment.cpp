@@ -0,0 +1,317 @@
+//===-- PointPosAssignment.cpp - Shift Minimizing Point Positions -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Global assignment of the point positions of fixed point values which
+/// minimizes the alignment shifts executed by the converted code.
+///
+//===----------------------------------------------------------------------===//
+
+#include "PointPosAssignment.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <memory>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-min-shifts"
+
+ALWAYS_ENABLED_STATISTIC(NumPointPosChanged, "Number of point positions changed to minimize the shifts");
+
+namespace taffo {
+
+namespace {
+
+/* Dinic's maximum flow, on the residual graph */
+class MaxFlow {
+public:
+  explicit MaxFlow(unsigned N) : Adj(N), Level(N), Next(N) {}
+
+  void addEdge(unsigned From, unsigned To, double Cap) {
+    Adj[From].push_back(Edges.size());
+    Edges.push_back({To, Cap});
+    Adj[To].push_back(Edges.size());
+    Edges.push_back({From, 0.0});
+  }
+
+  void run(unsigned S, unsigned T) {
+    while (buildLevels(S, T)) {
+      std::fill(Next.begin(), Next.end(), 0);
+      while (augment(S, T, Inf) > 0.0)
+        ;
+    }
+  }
+
+  /* after run, the nodes reachable from the source in the residual graph
+   * are on its side of the minimum cut */
+  bool isOnSourceSide(unsigned N) const { return Level[N] >= 0; }
+
+  static constexpr double Inf = std::numeric_limits<double>::infinity();
+
+private:
+  struct Arc {
+    unsigned To;
+    double Cap;
+  };
+  std::vector<Arc> Edges;
+  std::vector<std::vector<unsigned>> Adj;
+  std::vector<int> Level;
+  std::vector<unsigned> Next;
+
+  static bool hasCapacity(double Cap) { return Cap > 1e-12; }
+
+  bool buildLevels(unsigned S, unsigned T) {
+    std::fill(Level.begin(), Level.end(), -1);
+    std::vector<unsigned> Queue = {S};
+    Level[S] = 0;
+    for (size_t I = 0; I < Queue.size(); I++) {
+      for (unsigned E : Adj[Queue[I]]) {
+        if (hasCapacity(Edges[E].Cap) && Level[Edges[E].To] < 0) {
+          Level[Edges[E].To] = Level[Queue[I]] + 1;
+          Queue.push_back(Edges[E].To);
+        }
+      }
+    }
+    return Level[T] >= 0;
+  }
+
+  double augment(unsigned N, unsigned T, double Flow) {
+    if (N == T)
+      return Flow;
+    for (unsigned &I = Next[N]; I < Adj[N].size(); I++) {
+      Arc &A = Edges[Adj[N][I]];
+      if (!hasCapacity(A.Cap) || Level[A.To] != Level[N] + 1)
+        continue;
+      double Pushed = augment(A.To, T, std::min(Flow, A.Cap));
+      if (Pushed > 0.0) {
+        A.Cap -= Pushed;
+        Edges[Adj[N][I] ^ 1].Cap += Pushed;
+        return Pushed;
+      }
+    }
+    return 0.0;
+  }
+};
+
+}
+
+unsigned PointPosProblem::addValue(int MinPos, int MaxPos, double PrecisionWeight) {
+  assert(MinPos <= MaxPos && "empty interval of point positions");
+  Values.push_back({MinPos, MaxPos, PrecisionWeight});
+  return Values.size() - 1;
+}
+
+void PointPosProblem::addEdge(unsigned A, unsigned B, double Weight) {
+  if (A != B && Weight > 0.0)
+    Edges.push_back({A, B, Weight});
+}
+
+double PointPosProblem::getCost(const std::vector<int> &Pos) const {
+  double Cost = 0.0;
+  for (const Edge &E : Edges)
+    Cost += E.Weight * std::abs(Pos[E.A] - Pos[E.B]);
+  for (unsigned I = 0; I < Values.size(); I++)
+    Cost += Values[I].PrecisionWeight * (Values[I].MaxPos - Pos[I]);
+  return Cost;
+}
+
+std::vector<int> PointPosProblem::solve() const {
+  /* the binary variable (V, L) is Pos(V) >= L, for MinPos < L <= MaxPos;
+   * it is true when its node is on the source side of the cut */
+  const unsigned S = 0, T = 1;
+  std::vector<unsigned> FirstNode(Values.size());
+  unsigned NumNodes = 2;
+  for (unsigned I = 0; I < Values.size(); I++) {
+    FirstNode[I] = NumNodes;
+    NumNodes += Values[I].MaxPos - Values[I].MinPos;
+  }
+  auto NodeOf = [&](unsigned V, int L) -> unsigned {
+    if (L <= Values[V].MinPos)
+      return S;
+    if (L > Values[V].MaxPos)
+      return T;
+    return FirstNode[V] + (L - Values[V].MinPos - 1);
+  };
+
+  MaxFlow G(NumNodes);
+  for (unsigned V = 0; V < Values.size(); V++) {
+    for (int L = Values[V].MinPos + 1; L <= Values[V].MaxPos; L++) {
+      /* a position below L loses one bit of precision */
+      G.addEdge(S, NodeOf(V, L), Values[V].PrecisionWeight);
+      /* Pos(V) >= L implies Pos(V) >= L - 1 */
+      if (L > Values[V].MinPos + 1)
+        G.addEdge(NodeOf(V, L), NodeOf(V, L - 1), MaxFlow::Inf);
+    }
+  }
+  /* |Pos(A) - Pos(B)| is the number of levels with different values */
+  for (const Edge &E : Edges) {
+    int Lo = std::min(Values[E.A].MinPos, Values[E.B].MinPos) + 1;
+    int Hi = std::max(Values[E.A].MaxPos, Values[E.B].MaxPos);
+    for (int L = Lo; L <= Hi; L++) {
+      unsigned NA = NodeOf(E.A, L), NB = NodeOf(E.B, L);
+      if (NA == NB)
+        continue;
+      G.addEdge(NA, NB, E.Weight);
+      G.addEdge(NB, NA, E.Weight);
+    }
+  }
+  G.run(S, T);
+
+  std::vector<int> Pos(Values.size());
+  for (unsigned V = 0; V < Values.size(); V++) {
+    Pos[V] = Values[V].MinPos;
+    for (int L = Values[V].MinPos + 1; L <= Values[V].MaxPos; L++) {
+      if (G.isOnSourceSide(NodeOf(V, L)))
+        Pos[V] = L;
+    }
+  }
+  return Pos;
+}
+
+double getBlockExecutionWeight(const BasicBlock &BB, const LoopInfo &LI,
+                               ArrayRef<unsigned> TripCounts,
+                               double DefaultTripCount) {
+  double Weight = 1.0;
+  for (const Loop *L = LI.getLoopFor(&BB); L; L = L->getParentLoop()) {
+    unsigned Depth = L->getLoopDepth();
+    unsigned TC = Depth - 1 < TripCounts.size() ? TripCounts[Depth - 1] : 0;
+    Weight *= TC ? (double)TC : DefaultTripCount;
+  }
+  return std::min(Weight, 1e15);
+}
+
+double getBlockExecutionWeight(const BasicBlock &BB, const LoopInfo &LI,
+                               ScalarEvolution &SE) {
+  SmallVector<unsigned, 4> TripCounts;
+  for (const Loop *L = LI.getLoopFor(&BB); L; L = L->getParentLoop())
+    TripCounts.push_back(SE.getSmallConstantTripCount(L));
+  std::reverse(TripCounts.begin(), TripCounts.end());
+  return getBlockExecutionWeight(BB, LI, TripCounts);
+}
+
+unsigned minimizePointPosShifts(Function &F, unsigned MaxPrecisionLoss) {
+  if (F.isDeclaration())
+    return 0;
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+
+  /* the values with a fixed point type; the precision only breaks the ties
+   * between the assignments with the same shifts, whose weights are at
+   * least 1 */
+  std::vector<Instruction *> Insts;
+  std::vector<InputInfo *> Infos;
+  for (Instruction &I : instructions(F)) {
+    InputInfo *II = MM.retrieveInputInfo(I);
+    FPType *T = II ? dyn_cast_or_null<FPType>(II->IType.get()) : nullptr;
+    if (T && II->IEnableConversion) {
+      Insts.push_back(&I);
+      Infos.push_back(II);
+    }
+  }
+  if (Insts.empty())
+    return 0;
+  PointPosProblem Problem;
+  DenseMap<const llvm::Value *, unsigned> ValueOf;
+  double PrecisionWeight = 1e-3 / (Insts.size() * (MaxPrecisionLoss + 1.0));
+  for (unsigned V = 0; V < Insts.size(); V++) {
+    int MaxPos = cast<FPType>(Infos[V]->IType.get())->getPointPos();
+    int MinPos = MaxPos - std::min<int>(MaxPos, MaxPrecisionLoss);
+    ValueOf[Insts[V]] = Problem.addValue(MinPos, MaxPos, PrecisionWeight);
+  }
+
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+  TargetLibraryInfo TLI(TLII);
+  AssumptionCache AC(F);
+  ScalarEvolution SE(F, TLI, AC, DT, LI);
+  DenseMap<const BasicBlock *, double> BlockWeights;
+  auto WeightOf = [&](const BasicBlock *BB) -> double {
+    auto It = BlockWeights.find(BB);
+    if (It != BlockWeights.end())
+      return It->second;
+    double W = getBlockExecutionWeight(*BB, LI, SE);
+    BlockWeights[BB] = W;
+    return W;
+  };
+
+  auto Join = [&](const llvm::Value *A, const llvm::Value *B, double W) {
+    auto IA = ValueOf.find(A), IB = ValueOf.find(B);
+    if (IA != ValueOf.end() && IB != ValueOf.end())
+      Problem.addEdge(IA->second, IB->second, W);
+  };
+  for (Instruction *I : Insts) {
+    double W = WeightOf(I->getParent());
+    switch (I->getOpcode()) {
+      case Instruction::FAdd:
+      case Instruction::FSub:
+      case Instruction::Add:
+      case Instruction::Sub:
+        Join(I, I->getOperand(0), W);
+        Join(I, I->getOperand(1), W);
+        break;
+      case Instruction::FNeg:
+        Join(I, I->getOperand(0), W);
+        break;
+      case Instruction::PHI:
+        for (const llvm::Value *In : cast<PHINode>(I)->incoming_values())
+          Join(I, In, W);
+        break;
+      case Instruction::Select:
+        Join(I, I->getOperand(1), W);
+        Join(I, I->getOperand(2), W);
+        break;
+      case Instruction::Load:
+        Join(I, cast<LoadInst>(I)->getPointerOperand(), W);
+        break;
+      default:
+        break;
+    }
+    /* the users without a type of their own; each comparison and store is
+     * joined once, from its first operand */
+    for (const User *U : I->users()) {
+      const Instruction *UI = dyn_cast<Instruction>(U);
+      if (!UI || ValueOf.count(UI) || UI->getOperand(0) != I)
+        continue;
+      if (auto *Cmp = dyn_cast<CmpInst>(UI))
+        Join(Cmp->getOperand(0), Cmp->getOperand(1), WeightOf(UI->getParent()));
+      else if (auto *St = dyn_cast<StoreInst>(UI))
+        Join(St->getValueOperand(), St->getPointerOperand(), WeightOf(UI->getParent()));
+    }
+  }
+
+  std::vector<int> Pos = Problem.solve();
+  unsigned Changed = 0;
+  for (unsigned V = 0; V < Insts.size(); V++) {
+    FPType *T = cast<FPType>(Infos[V]->IType.get());
+    if ((int)T->getPointPos() == Pos[V])
+      continue;
+    std::unique_ptr<InputInfo> NewII(cast<InputInfo>(Infos[V]->clone()));
+    NewII->IType = std::make_shared<FPType>(T->getSWidth(), (unsigned)Pos[V]);
+    MetadataManager::setInputInfoMetadata(*Insts[V], *NewII);
+    Changed++;
+  }
+  NumPointPosChanged += Changed;
+  return Changed;
+}
+
+}
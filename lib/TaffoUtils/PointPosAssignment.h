@@ -0,0 +1,93 @@
+//===-- PointPosAssignment.h - Shift Minimizing Point Positions -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Global assignment of the point positions of fixed point values which
+/// minimizes the alignment shifts executed by the converted code.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_POINT_POS_ASSIGNMENT_H
+#define TAFFOUTILS_POINT_POS_ASSIGNMENT_H
+
+#include <vector>
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Function.h"
+
+namespace taffo {
+
+/// Problem of choosing a point position for each value in an interval,
+/// minimizing
+///   sum over the edges (A, B) of Weight * |Pos(A) - Pos(B)|
+///   + sum over the values of PrecisionWeight * (MaxPos - Pos).
+/// An edge joins two values which are aligned by a shift unless they have
+/// the same point position; its weight is the number of times the shift is
+/// executed. The cost of a shift grows with its amount, which makes the
+/// problem convex, and it is solved exactly as a minimum cut on the
+/// values replicated for each point position (Ishikawa's construction).
+/// When an assignment without any shift is possible, it is optimal for
+/// the number of shifts too.
+class PointPosProblem {
+public:
+  /// Add a value with a point position in [MinPos, MaxPos], and return its
+  /// index.
+  unsigned addValue(int MinPos, int MaxPos, double PrecisionWeight);
+
+  /// Add the cost of the shifts between A and B.
+  void addEdge(unsigned A, unsigned B, double Weight);
+
+  unsigned getNumValues() const { return Values.size(); }
+
+  /// The optimal point position of each value.
+  std::vector<int> solve() const;
+
+  /// The cost of an assignment.
+  double getCost(const std::vector<int> &Pos) const;
+
+private:
+  struct Value {
+    int MinPos;
+    int MaxPos;
+    double PrecisionWeight;
+  };
+  struct Edge {
+    unsigned A;
+    unsigned B;
+    double Weight;
+  };
+  std::vector<Value> Values;
+  std::vector<Edge> Edges;
+};
+
+/// Estimate of the number of executions of BB per execution of its
+/// function: the product of the trip counts of the loops BB is in, with
+/// DefaultTripCount for the loops without a constant one.
+double getBlockExecutionWeight(const llvm::BasicBlock &BB,
+                               const llvm::LoopInfo &LI,
+                               llvm::ArrayRef<unsigned> TripCounts,
+                               double DefaultTripCount = 8.0);
+
+/// The same estimate, with the constant trip counts computed by SE.
+double getBlockExecutionWeight(const llvm::BasicBlock &BB,
+                               const llvm::LoopInfo &LI,
+                               llvm::ScalarEvolution &SE);
+
+/// Reassign the point positions of the fixed point types in the taffo.info
+/// of the instructions of F, to minimize the alignment shifts between the
+/// operands of additions, subtractions, comparisons, phis, selects, loads
+/// and stores, weighted by the execution estimate of their block. Each
+/// position may only decrease, so that no value overflows, and by at most
+/// MaxPrecisionLoss bits. The widths and the other metadata are kept.
+/// Returns the number of types changed.
+unsigned minimizePointPosShifts(llvm::Function &F, unsigned MaxPrecisionLoss);
+
+}
+
+#endif
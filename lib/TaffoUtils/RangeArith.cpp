@@ -0,0 +1,252 @@
+//===-- RangeArith.cpp - Interval Arithmetic on Ranges ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Interval arithmetic on mdutils::Range, with outward rounding.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RangeArith.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace mdutils {
+
+static const double Inf = std::numeric_limits<double>::infinity();
+static const double Pi = 3.14159265358979323846;
+static const double Eps = std::numeric_limits<double>::epsilon();
+
+/* The bounds are widened by |x| * 2^-52 plus the smallest subnormal, which
+ * is at least one ulp of x, instead of changing the rounding mode: this
+ * keeps the kernels free of branches and of floating point environment
+ * accesses, so that the batch loops can be vectorized. */
+static inline double roundDown(double X) {
+  return std::abs(X) == Inf ? X
+      : X - (std::abs(X) * Eps + std::numeric_limits<double>::denorm_min());
+}
+
+static inline double roundUp(double X) {
+  return std::abs(X) == Inf ? X
+      : X + (std::abs(X) * Eps + std::numeric_limits<double>::denorm_min());
+}
+
+/* The libm functions are not correctly rounded, but are accurate to 1 ulp */
+static inline double libmDown(double X) { return roundDown(roundDown(X)); }
+static inline double libmUp(double X) { return roundUp(roundUp(X)); }
+
+/* NaN bounds mean that the result is not defined on part of the operands */
+static inline void fixNaN(double &Lo, double &Hi) {
+  bool IsNaN = Lo != Lo || Hi != Hi;
+  Lo = IsNaN ? -Inf : Lo;
+  Hi = IsNaN ? Inf : Hi;
+}
+
+/* In interval arithmetic 0 * inf is 0 */
+static inline double mulBound(double A, double B) {
+  return (A == 0.0 || B == 0.0) ? 0.0 : A * B;
+}
+
+static inline void addKernel(double ALo, double AHi, double BLo, double BHi,
+                             double &Lo, double &Hi) {
+  Lo = roundDown(ALo + BLo);
+  Hi = roundUp(AHi + BHi);
+  fixNaN(Lo, Hi);
+}
+
+static inline void subKernel(double ALo, double AHi, double BLo, double BHi,
+                             double &Lo, double &Hi) {
+  Lo = roundDown(ALo - BHi);
+  Hi = roundUp(AHi - BLo);
+  fixNaN(Lo, Hi);
+}
+
+static inline void mulKernel(double ALo, double AHi, double BLo, double BHi,
+                             double &Lo, double &Hi) {
+  double P1 = mulBound(ALo, BLo);
+  double P2 = mulBound(ALo, BHi);
+  double P3 = mulBound(AHi, BLo);
+  double P4 = mulBound(AHi, BHi);
+  Lo = roundDown(std::min(std::min(P1, P2), std::min(P3, P4)));
+  Hi = roundUp(std::max(std::max(P1, P2), std::max(P3, P4)));
+}
+
+static inline void divKernel(double ALo, double AHi, double BLo, double BHi,
+                             double &Lo, double &Hi) {
+  double Q1 = ALo / BLo;
+  double Q2 = ALo / BHi;
+  double Q3 = AHi / BLo;
+  double Q4 = AHi / BHi;
+  Lo = roundDown(std::min(std::min(Q1, Q2), std::min(Q3, Q4)));
+  Hi = roundUp(std::max(std::max(Q1, Q2), std::max(Q3, Q4)));
+  /* std::min and std::max do not propagate NaNs reliably */
+  bool IsNaN = Q1 != Q1 || Q2 != Q2 || Q3 != Q3 || Q4 != Q4;
+  bool HasZero = BLo <= 0.0 && BHi >= 0.0;
+  Lo = (IsNaN || HasZero) ? -Inf : Lo;
+  Hi = (IsNaN || HasZero) ? Inf : Hi;
+}
+
+
+Range rangeAdd(const Range &A, const Range &B) {
+  Range R;
+  addKernel(A.Min, A.Max, B.Min, B.Max, R.Min, R.Max);
+  return R;
+}
+
+Range rangeSub(const Range &A, const Range &B) {
+  Range R;
+  subKernel(A.Min, A.Max, B.Min, B.Max, R.Min, R.Max);
+  return R;
+}
+
+Range rangeMul(const Range &A, const Range &B) {
+  Range R;
+  mulKernel(A.Min, A.Max, B.Min, B.Max, R.Min, R.Max);
+  return R;
+}
+
+Range rangeDiv(const Range &A, const Range &B) {
+  Range R;
+  divKernel(A.Min, A.Max, B.Min, B.Max, R.Min, R.Max);
+  return R;
+}
+
+Range rangeMin(const Range &A, const Range &B) {
+  return Range(std::min(A.Min, B.Min), std::min(A.Max, B.Max));
+}
+
+Range rangeMax(const Range &A, const Range &B) {
+  return Range(std::max(A.Min, B.Min), std::max(A.Max, B.Max));
+}
+
+Range rangeUnion(const Range &A, const Range &B) {
+  return Range(std::min(A.Min, B.Min), std::max(A.Max, B.Max));
+}
+
+Range rangeNeg(const Range &A) {
+  return Range(-A.Max, -A.Min);
+}
+
+Range rangeAbs(const Range &A) {
+  if (A.Min >= 0.0)
+    return A;
+  if (A.Max <= 0.0)
+    return rangeNeg(A);
+  return Range(0.0, std::max(-A.Min, A.Max));
+}
+
+Range rangeSqrt(const Range &A) {
+  /* sqrt is correctly rounded */
+  double Lo = std::sqrt(std::max(A.Min, 0.0));
+  double Hi = std::sqrt(std::max(A.Max, 0.0));
+  return Range(std::max(roundDown(Lo), 0.0), roundUp(Hi));
+}
+
+Range rangeExp(const Range &A) {
+  return Range(std::max(libmDown(std::exp(A.Min)), 0.0), libmUp(std::exp(A.Max)));
+}
+
+Range rangeLog(const Range &A) {
+  double Lo = std::log(std::max(A.Min, 0.0));
+  double Hi = std::log(std::max(A.Max, 0.0));
+  return Range(libmDown(Lo), libmUp(Hi));
+}
+
+/* Range of Fn(x) = cos(x + Phase) for x in A. The bounds are evaluated
+ * with Fn, since adding Phase would lose the precision of sin near 0 */
+template <typename FnTy>
+static Range periodicRange(const Range &A, double Phase, FnTy Fn) {
+  if (std::isinf(A.Min) || std::isinf(A.Max) || A.Max - A.Min >= 2.0 * Pi)
+    return Range(-1.0, 1.0);
+  double C1 = Fn(A.Min);
+  double C2 = Fn(A.Max);
+  double Lo = libmDown(std::min(C1, C2));
+  double Hi = libmUp(std::max(C1, C2));
+  /* maxima at 2k*pi - Phase, minima at (2k+1)*pi - Phase */
+  double KMax = std::ceil((A.Min + Phase) / (2.0 * Pi));
+  if (KMax * 2.0 * Pi - Phase <= A.Max)
+    Hi = 1.0;
+  double KMin = std::ceil((A.Min + Phase - Pi) / (2.0 * Pi));
+  if (KMin * 2.0 * Pi + Pi - Phase <= A.Max)
+    Lo = -1.0;
+  return Range(std::max(Lo, -1.0), std::min(Hi, 1.0));
+}
+
+Range rangeSin(const Range &A) {
+  /* sin(x) = cos(x - pi/2) */
+  return periodicRange(A, -Pi / 2.0, [](double X) { return std::sin(X); });
+}
+
+Range rangeCos(const Range &A) {
+  return periodicRange(A, 0.0, [](double X) { return std::cos(X); });
+}
+
+
+/* Applies a binary kernel to each element of the arrays. The kernel is
+ * inlined into a loop over plain arrays, which can be vectorized. */
+template <typename KernelTy>
+static void applyBatch(const RangeArray &A, const RangeArray &B, RangeArray &R,
+                       KernelTy Kernel) {
+  assert(A.size() == B.size() && "Operands must have the same size");
+  size_t N = A.size();
+  R.resize(N);
+  const double *ALo = A.mins(), *AHi = A.maxs();
+  const double *BLo = B.mins(), *BHi = B.maxs();
+  double *RLo = R.mins(), *RHi = R.maxs();
+  for (size_t I = 0; I < N; I++) {
+    double Lo, Hi;
+    Kernel(ALo[I], AHi[I], BLo[I], BHi[I], Lo, Hi);
+    RLo[I] = Lo;
+    RHi[I] = Hi;
+  }
+}
+
+void rangeAdd(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, addKernel);
+}
+
+void rangeSub(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, subKernel);
+}
+
+void rangeMul(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, mulKernel);
+}
+
+void rangeDiv(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, divKernel);
+}
+
+void rangeMin(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, [](double ALo, double AHi, double BLo, double BHi,
+                         double &Lo, double &Hi) {
+    Lo = std::min(ALo, BLo);
+    Hi = std::min(AHi, BHi);
+  });
+}
+
+void rangeMax(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, [](double ALo, double AHi, double BLo, double BHi,
+                         double &Lo, double &Hi) {
+    Lo = std::max(ALo, BLo);
+    Hi = std::max(AHi, BHi);
+  });
+}
+
+void rangeUnion(const RangeArray &A, const RangeArray &B, RangeArray &R) {
+  applyBatch(A, B, R, [](double ALo, double AHi, double BLo, double BHi,
+                         double &Lo, double &Hi) {
+    Lo = std::min(ALo, BLo);
+    Hi = std::max(AHi, BHi);
+  });
+}
+
+}
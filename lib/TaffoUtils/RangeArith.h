@@ -0,0 +1,89 @@
+//===-- RangeArith.h - Interval Arithmetic on Ranges ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Interval arithmetic on mdutils::Range, with outward rounding, in a
+/// scalar version and in a batch version working on arrays of ranges.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_RANGE_ARITH_H
+#define TAFFOUTILS_RANGE_ARITH_H
+
+#include <cstddef>
+#include "llvm/ADT/SmallVector.h"
+#include "InputInfo.h"
+
+namespace mdutils {
+
+/// The operations assume well-formed operands (Min <= Max, no NaN).
+/// The bounds of the results are widened outwards by at least the rounding
+/// error of their computation, so that the result always contains the
+/// exact one. Operations which may produce NaN on part of the operands
+/// (inf - inf, division by a range containing zero) give [-inf, +inf].
+/// The functions with a restricted domain (sqrt and log) ignore the part
+/// of the operand outside the domain.
+///\{
+Range rangeAdd(const Range &A, const Range &B);
+Range rangeSub(const Range &A, const Range &B);
+Range rangeMul(const Range &A, const Range &B);
+Range rangeDiv(const Range &A, const Range &B);
+Range rangeMin(const Range &A, const Range &B);
+Range rangeMax(const Range &A, const Range &B);
+Range rangeNeg(const Range &A);
+Range rangeAbs(const Range &A);
+Range rangeSqrt(const Range &A);
+Range rangeExp(const Range &A);
+Range rangeLog(const Range &A);
+Range rangeSin(const Range &A);
+Range rangeCos(const Range &A);
+///\}
+
+/// Smallest range containing both A and B.
+Range rangeUnion(const Range &A, const Range &B);
+
+/// Array of ranges stored as separate arrays of lower and upper bounds,
+/// processed by the batch operations.
+class RangeArray {
+public:
+  RangeArray() = default;
+  explicit RangeArray(size_t Size) : Min(Size, 0.0), Max(Size, 0.0) {}
+
+  size_t size() const { return Min.size(); }
+  void resize(size_t Size) { Min.resize(Size, 0.0); Max.resize(Size, 0.0); }
+  void push_back(const Range &R) { Min.push_back(R.Min); Max.push_back(R.Max); }
+  Range get(size_t I) const { return Range(Min[I], Max[I]); }
+  void set(size_t I, const Range &R) { Min[I] = R.Min; Max[I] = R.Max; }
+
+  double *mins() { return Min.data(); }
+  double *maxs() { return Max.data(); }
+  const double *mins() const { return Min.data(); }
+  const double *maxs() const { return Max.data(); }
+
+private:
+  llvm::SmallVector<double, 16> Min;
+  llvm::SmallVector<double, 16> Max;
+};
+
+/// Batch operations: R[i] = op(A[i], B[i]) for each i. The operands must
+/// have the same size, R is resized accordingly and may be one of them.
+/// The results are the same as the ones of the scalar operations.
+///\{
+void rangeAdd(const RangeArray &A, const RangeArray &B, RangeArray &R);
+void rangeSub(const RangeArray &A, const RangeArray &B, RangeArray &R);
+void rangeMul(const RangeArray &A, const RangeArray &B, RangeArray &R);
+void rangeDiv(const RangeArray &A, const RangeArray &B, RangeArray &R);
+void rangeMin(const RangeArray &A, const RangeArray &B, RangeArray &R);
+void rangeMax(const RangeArray &A, const RangeArray &B, RangeArray &R);
+void rangeUnion(const RangeArray &A, const RangeArray &B, RangeArray &R);
+///\}
+
+}
+
+#endif
@@ -0,0 +1,218 @@
+//===-- RangeFolding.cpp - Folding of the Values Fixed by VRA ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Replacement of the values whose range is a single point, and of the
+/// comparisons decided by the ranges of their operands, with constants,
+/// and removal of the branches they make dead.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RangeFolding.h"
+
+#include <cmath>
+#include <utility>
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-range-folding"
+
+ALWAYS_ENABLED_STATISTIC(NumFoldedValues, "Number of values with a single point range replaced by a constant");
+ALWAYS_ENABLED_STATISTIC(NumFoldedCmps, "Number of comparisons decided by the ranges of their operands");
+ALWAYS_ENABLED_STATISTIC(NumPrunedBranches, "Number of branches removed on the conditions folded from the ranges");
+
+namespace taffo {
+
+Optional<bool> evaluateCmpOnRanges(CmpInst::Predicate Pred, const Range &A, const Range &B) {
+  if (std::isnan(A.Min) || std::isnan(A.Max) || std::isnan(B.Min) || std::isnan(B.Max))
+    return None;
+  if (CmpInst::isUnsigned(Pred) && (A.Min < 0.0 || B.Min < 0.0))
+    return None;
+
+  const Range *L = &A, *R = &B;
+  switch (Pred) {
+    case CmpInst::FCMP_OEQ:
+    case CmpInst::FCMP_UEQ:
+    case CmpInst::ICMP_EQ:
+    case CmpInst::FCMP_ONE:
+    case CmpInst::FCMP_UNE:
+    case CmpInst::ICMP_NE: {
+      bool Eq = Pred == CmpInst::FCMP_OEQ || Pred == CmpInst::FCMP_UEQ || Pred == CmpInst::ICMP_EQ;
+      if (A.Min == A.Max && B.Min == B.Max && A.Min == B.Min)
+        return Eq;
+      if (A.Max < B.Min || B.Max < A.Min)
+        return !Eq;
+      return None;
+    }
+    case CmpInst::FCMP_OGT:
+    case CmpInst::FCMP_UGT:
+    case CmpInst::ICMP_SGT:
+    case CmpInst::ICMP_UGT:
+    case CmpInst::FCMP_OGE:
+    case CmpInst::FCMP_UGE:
+    case CmpInst::ICMP_SGE:
+    case CmpInst::ICMP_UGE:
+      std::swap(L, R);
+      Pred = CmpInst::getSwappedPredicate(Pred);
+      break;
+    case CmpInst::FCMP_OLT:
+    case CmpInst::FCMP_ULT:
+    case CmpInst::ICMP_SLT:
+    case CmpInst::ICMP_ULT:
+    case CmpInst::FCMP_OLE:
+    case CmpInst::FCMP_ULE:
+    case CmpInst::ICMP_SLE:
+    case CmpInst::ICMP_ULE:
+      break;
+    default:
+      return None;
+  }
+
+  /* L < R or L <= R */
+  if (Pred == CmpInst::FCMP_OLT || Pred == CmpInst::FCMP_ULT || Pred == CmpInst::ICMP_SLT ||
+      Pred == CmpInst::ICMP_ULT) {
+    if (L->Max < R->Min)
+      return true;
+    if (L->Min >= R->Max)
+      return false;
+  } else {
+    if (L->Max <= R->Min)
+      return true;
+    if (L->Min > R->Max)
+      return false;
+  }
+  return None;
+}
+
+namespace {
+
+/* The range of V; the integer constants are read as unsigned when
+ * Unsigned is set */
+Optional<Range> getRangeOf(const Value *V, bool Unsigned = false) {
+  if (auto *CFP = dyn_cast<ConstantFP>(V)) {
+    double C = CFP->getValueAPF().convertToDouble();
+    return Range(C, C);
+  }
+  if (auto *CI = dyn_cast<ConstantInt>(V)) {
+    if (CI->getBitWidth() > 64)
+      return None;
+    double C = Unsigned ? (double)CI->getZExtValue() : (double)CI->getSExtValue();
+    return Range(C, C);
+  }
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I)
+    return None;
+  InputInfo *II = MetadataManager::getMetadataManager().retrieveInputInfo(*I);
+  if (!II || !II->IRange)
+    return None;
+  return *II->IRange;
+}
+
+/* Whether the ranges of the operands of Cmp decide it. The ranges are
+ * values, thus the operands must be integer or floating point scalars, and
+ * the integer constants must have the same value as signed and as
+ * unsigned numbers when the predicate (eq, ne) does not tell which one
+ * they are. */
+bool isFoldableCmp(const CmpInst &Cmp) {
+  Type *Ty = Cmp.getOperand(0)->getType();
+  if (!Ty->isIntegerTy() && !Ty->isFloatingPointTy())
+    return false;
+  if (!Cmp.isEquality() || !Ty->isIntegerTy())
+    return true;
+  for (const Value *Op : Cmp.operands()) {
+    auto *CI = dyn_cast<ConstantInt>(Op);
+    if (CI && CI->isNegative())
+      return false;
+  }
+  return true;
+}
+
+/* The constant of type Ty with the value C, if it is exact */
+Constant *getExactConstant(Type *Ty, double C) {
+  if (!std::isfinite(C))
+    return nullptr;
+  if (Ty->isFloatingPointTy()) {
+    APFloat F(C);
+    bool LosesInfo;
+    F.convert(Ty->getFltSemantics(), APFloat::rmNearestTiesToEven, &LosesInfo);
+    return LosesInfo ? nullptr : ConstantFP::get(Ty->getContext(), F);
+  }
+  if (auto *IntTy = dyn_cast<IntegerType>(Ty)) {
+    unsigned Width = IntTy->getBitWidth();
+    if (C != std::floor(C) || Width > 64 || std::abs(C) >= std::ldexp(1.0, (int)Width - 1))
+      return nullptr;
+    return ConstantInt::get(IntTy, (int64_t)C, true);
+  }
+  return nullptr;
+}
+
+}
+
+unsigned foldRangeConstants(Function &F) {
+  unsigned Folded = 0;
+  for (Instruction &I : instructions(F)) {
+    if (I.use_empty())
+      continue;
+    Constant *C = nullptr;
+    if (auto *Cmp = dyn_cast<CmpInst>(&I)) {
+      if (!isFoldableCmp(*Cmp))
+        continue;
+      bool Unsigned = Cmp->isUnsigned();
+      Optional<Range> A = getRangeOf(Cmp->getOperand(0), Unsigned);
+      Optional<Range> B = getRangeOf(Cmp->getOperand(1), Unsigned);
+      Optional<bool> Res = A && B ? evaluateCmpOnRanges(Cmp->getPredicate(), *A, *B) : None;
+      if (Res && Cmp->getType()->isIntegerTy(1)) {
+        C = ConstantInt::getBool(Cmp->getType(), *Res);
+        NumFoldedCmps++;
+      }
+    } else if (!isa<Constant>(&I)) {
+      Optional<Range> R = getRangeOf(&I);
+      if (R && R->Min == R->Max && (C = getExactConstant(I.getType(), R->Min)))
+        NumFoldedValues++;
+    }
+    if (C) {
+      I.replaceAllUsesWith(C);
+      Folded++;
+    }
+  }
+
+  for (BasicBlock &BB : F) {
+    Instruction *Term = BB.getTerminator();
+    if (!Term || Term->getNumSuccessors() < 2 || !isa<Constant>(Term->getOperand(0)))
+      continue;
+    if (ConstantFoldTerminator(&BB, true)) {
+      NumPrunedBranches++;
+      Folded++;
+    }
+  }
+  removeUnreachableBlocks(F);
+
+  SmallVector<WeakTrackingVH, 16> Dead;
+  for (Instruction &I : instructions(F)) {
+    if (isInstructionTriviallyDead(&I))
+      Dead.push_back(&I);
+  }
+  for (WeakTrackingVH &V : Dead) {
+    if (V)
+      RecursivelyDeleteTriviallyDeadInstructions(V);
+  }
+  return Folded;
+}
+
+}
@@ -0,0 +1,44 @@
+//===-- RangeFolding.h - Folding of the Values Fixed by VRA -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Replacement of the values whose range is a single point, and of the
+/// comparisons decided by the ranges of their operands, with constants,
+/// and removal of the branches they make dead.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_RANGE_FOLDING_H
+#define TAFFOUTILS_RANGE_FOLDING_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// The outcome of the comparison Pred between the values in A and in B, if
+/// the ranges decide it. The ranges do not contain NaN, as in VRA, so the
+/// ordered and the unordered floating point predicates are the same; the
+/// unsigned integer predicates are only decided on non negative ranges.
+llvm::Optional<bool> evaluateCmpOnRanges(llvm::CmpInst::Predicate Pred, const mdutils::Range &A,
+                                         const mdutils::Range &B);
+
+/// Replace with constants the uses of the instructions of F whose range in
+/// their taffo.info is a single finite value representable in their type,
+/// and of the comparisons decided by the ranges of their operands; then
+/// remove the branches on the constant conditions, the blocks they make
+/// unreachable and the instructions left dead. Returns the number of values
+/// and branches folded.
+unsigned foldRangeConstants(llvm::Function &F);
+
+}
+
+#endif
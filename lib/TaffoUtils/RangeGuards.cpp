@@ -0,0 +1,151 @@
+//===-- RangeGuards.cpp - Range Checked Calls to Converted Code -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Versioning of the calls to the functions cloned by TAFFO on the ranges
+/// of their arguments.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RangeGuards.h"
+
+#include <limits>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-range-guards"
+
+ALWAYS_ENABLED_STATISTIC(NumGuardedCalls, "Number of calls guarded by a range check");
+
+namespace taffo {
+
+static const double Inf = std::numeric_limits<double>::infinity();
+
+static Function *originalFunctionFromMD(const MDNode *MD) {
+  if (!MD || MD->getNumOperands() == 0)
+    return nullptr;
+  if (auto *VMD = dyn_cast_or_null<ValueAsMetadata>(MD->getOperand(0).get()))
+    return dyn_cast<Function>(VMD->getValue()->stripPointerCasts());
+  return nullptr;
+}
+
+Function *getOriginalFunction(const CallInst &Call) {
+  Function *Callee = Call.getCalledFunction();
+  if (!Callee)
+    return nullptr;
+  Function *Orig = originalFunctionFromMD(Callee->getMetadata(ORIGINAL_FUN_METADATA));
+  if (!Orig)
+    Orig = originalFunctionFromMD(Call.getMetadata(ORIGINAL_FUN_METADATA));
+  if (!Orig || Orig == Callee || Orig->getFunctionType() != Callee->getFunctionType())
+    return nullptr;
+  return Orig;
+}
+
+/* Removes the metadata which makes the passes of TAFFO pick up I */
+static void dropTaffoMetadata(Instruction &I) {
+  SmallVector<StringRef, 32> Names;
+  I.getContext().getMDKindNames(Names);
+  SmallVector<std::pair<unsigned, MDNode *>, 8> MDs;
+  I.getAllMetadata(MDs);
+  for (auto &MD : MDs) {
+    if (MD.first < Names.size() && Names[MD.first].startswith("taffo."))
+      I.setMetadata(MD.first, nullptr);
+  }
+}
+
+bool insertRangeGuard(CallInst &Call) {
+  Function *Callee = Call.getCalledFunction();
+  Function *Orig = getOriginalFunction(Call);
+  if (!Orig || Call.isMustTailCall() || Call.getMetadata(RANGE_GUARD_METADATA))
+    return false;
+
+  SmallVector<MDInfo *, 4> ArgInfos;
+  MetadataManager::getMetadataManager().retrieveArgumentInputInfo(*Callee, ArgInfos);
+
+  /* the conjunction of the checks; the ordered comparisons are false on
+   * NaN, which thus takes the fallback too */
+  IRBuilder<> Builder(&Call);
+  Value *InRange = nullptr;
+  for (unsigned I = 0; I < ArgInfos.size() && I < Call.arg_size(); I++) {
+    InputInfo *II = dyn_cast_or_null<InputInfo>(ArgInfos[I]);
+    Value *Arg = Call.getArgOperand(I);
+    if (!II || !II->IRange || !Arg->getType()->isFloatingPointTy())
+      continue;
+    SmallVector<Value *, 2> Checks;
+    if (II->IRange->Min != -Inf)
+      Checks.push_back(Builder.CreateFCmpOGE(Arg, ConstantFP::get(Arg->getType(), II->IRange->Min)));
+    if (II->IRange->Max != Inf)
+      Checks.push_back(Builder.CreateFCmpOLE(Arg, ConstantFP::get(Arg->getType(), II->IRange->Max)));
+    for (Value *Check : Checks)
+      InRange = InRange ? Builder.CreateAnd(InRange, Check) : Check;
+  }
+  if (!InRange) {
+    return false;
+  } else if (auto *C = dyn_cast<Constant>(InRange)) {
+    if (C->isOneValue())
+      return false;
+  }
+  if (auto *I = dyn_cast<Instruction>(InRange))
+    I->setName("taffo.inrange");
+
+  BasicBlock *Head = Call.getParent();
+  BasicBlock *Tail = Head->splitBasicBlock(&Call, Head->getName() + ".guard.tail");
+  Function *F = Head->getParent();
+  LLVMContext &C = F->getContext();
+  BasicBlock *FixBB = BasicBlock::Create(C, Head->getName() + ".guard.fix", F, Tail);
+  BasicBlock *FloatBB = BasicBlock::Create(C, Head->getName() + ".guard.float", F, Tail);
+  Head->getTerminator()->eraseFromParent();
+  BranchInst::Create(FixBB, FloatBB, InRange, Head);
+  BranchInst *FixBr = BranchInst::Create(Tail, FixBB);
+  BranchInst *FloatBr = BranchInst::Create(Tail, FloatBB);
+
+  Call.moveBefore(FixBr);
+  Call.setMetadata(RANGE_GUARD_METADATA, MDNode::get(C, None));
+  CallInst *Fallback = cast<CallInst>(Call.clone());
+  Fallback->insertBefore(FloatBr);
+  Fallback->setCalledFunction(Orig);
+  dropTaffoMetadata(*Fallback);
+
+  if (!Call.getType()->isVoidTy()) {
+    Fallback->setName(Call.getName() + ".float");
+    PHINode *Res = PHINode::Create(Call.getType(), 2, Call.getName() + ".guard", &Tail->front());
+    Call.replaceAllUsesWith(Res);
+    Res->addIncoming(&Call, FixBB);
+    Res->addIncoming(Fallback, FloatBB);
+  }
+  return true;
+}
+
+unsigned insertRangeGuards(Module &M) {
+  SmallVector<CallInst *, 16> Calls;
+  for (Function &F : M) {
+    if (F.getMetadata(ORIGINAL_FUN_METADATA))
+      continue;
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        CallInst *Call = dyn_cast<CallInst>(&I);
+        if (Call && getOriginalFunction(*Call))
+          Calls.push_back(Call);
+      }
+    }
+  }
+  unsigned Count = 0;
+  for (CallInst *Call : Calls)
+    Count += insertRangeGuard(*Call);
+  NumGuardedCalls += Count;
+  return Count;
+}
+
+}
@@ -0,0 +1,49 @@
+//===-- RangeGuards.h - Range Checked Calls to Converted Code ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Versioning of the calls to the functions cloned by TAFFO on the ranges
+/// of their arguments.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_RANGE_GUARDS_H
+#define TAFFOUTILS_RANGE_GUARDS_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// The function F was cloned from, as recorded by taffo.originalCall on
+/// F or on the call, or nullptr if it is not a clone or if the original
+/// function does not exist anymore.
+llvm::Function *getOriginalFunction(const llvm::CallInst &Call);
+
+/// Guard the call with a check that its floating point arguments are in
+/// the ranges in the taffo.funinfo of the callee. The call is kept when
+/// they are, and the original function is called on the same arguments
+/// otherwise. The fallback call and the value merging the results have no
+/// TAFFO metadata, so they are left in floating point by the conversion.
+/// Returns false if the call is not to a clone, if none of its arguments
+/// has a range, or if the arguments are known to be in range.
+bool insertRangeGuard(llvm::CallInst &Call);
+
+/// Guard the calls to the clones from the functions which are not clones,
+/// that is the calls by which the floating point code enters the code
+/// which TAFFO converts, and which have not been guarded yet. The ranges
+/// the clones have been sized for must be in their metadata, thus this
+/// runs after VRA and before DTA removes the unused original functions.
+/// Returns the number of calls guarded.
+unsigned insertRangeGuards(llvm::Module &M);
+
+}
+
+#endif
@@ -0,0 +1,1218 @@
+//===-- RangeSummaries.cpp - Summary-Based Range Analysis --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Interprocedural range analysis based on function summaries.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RangeSummaries.h"
+
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Config/llvm-config.h"
+#if LLVM_VERSION_MAJOR < 11
+#include "llvm/IR/CallSite.h"
+#endif
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "CloneSpecialization.h"
+#include "Metadata.h"
+#include "RangeArith.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-vra-summaries"
+
+ALWAYS_ENABLED_STATISTIC(NumSummaries, "Number of function summaries computed");
+ALWAYS_ENABLED_STATISTIC(NumIterations, "Number of iterations over the functions to reach the fixed points");
+ALWAYS_ENABLED_STATISTIC(NumWidened, "Number of ranges widened to infinity");
+ALWAYS_ENABLED_STATISTIC(NumCachedSummaries, "Number of function summaries reused from the cache");
+
+namespace taffo {
+
+static const double Inf = std::numeric_limits<double>::infinity();
+
+/* number of iterations on a loop before the growing ranges are widened */
+static const unsigned WidenAfter = 3;
+/* number of descending iterations after the fixed point is reached */
+static const unsigned NarrowingIterations = 2;
+
+Range getSignatureRange(int Bits, bool Negative) {
+  if (Bits == INT_MAX)
+    return Range(-Inf, Inf);
+  if (Bits == INT_MIN)
+    return Range(0.0, 0.0);
+  double Mag = std::ldexp(1.0, Bits);
+  return Range(Negative ? -Mag : 0.0, Mag);
+}
+
+/* The object which P points into */
+static const Value *getBaseObject(const Value *P) {
+  while (true) {
+    if (auto *GEP = dyn_cast<GEPOperator>(P))
+      P = GEP->getPointerOperand();
+    else if (auto *BC = dyn_cast<BitCastOperator>(P))
+      P = BC->getOperand(0);
+    else
+      return P;
+  }
+}
+
+static Optional<Range> rangeOfInfo(const MDInfo *Info) {
+  const InputInfo *II = dyn_cast_or_null<InputInfo>(Info);
+  if (!II || !II->IRange || std::isnan(II->IRange->Min) || std::isnan(II->IRange->Max))
+    return None;
+  return *II->IRange;
+}
+
+/* The range in the metadata of an instruction, a global or an argument */
+static Optional<Range> getAnnotatedRange(const Value *V) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  if (auto *I = dyn_cast<Instruction>(V))
+    return rangeOfInfo(MM.retrieveInputInfo(*I));
+  if (auto *GO = dyn_cast<GlobalObject>(V))
+    return rangeOfInfo(MM.retrieveInputInfo(*GO));
+  if (auto *A = dyn_cast<Argument>(V)) {
+    SmallVector<MDInfo *, 4> Infos;
+    MM.retrieveArgumentInputInfo(*A->getParent(), Infos);
+    if (A->getArgNo() < Infos.size())
+      return rangeOfInfo(Infos[A->getArgNo()]);
+  }
+  return None;
+}
+
+static void join(Optional<Range> &Dst, const Optional<Range> &R) {
+  if (R)
+    Dst = Dst ? rangeUnion(*Dst, *R) : *R;
+}
+
+/* The range of the floating point values in the constant C */
+static Optional<Range> getConstantRange(const Constant *C) {
+  if (auto *CFP = dyn_cast<ConstantFP>(C)) {
+    double V = CFP->getValueAPF().convertToDouble();
+    return Range(V, V);
+  }
+  if (isa<ConstantAggregateZero>(C) || isa<ConstantPointerNull>(C))
+    return Range(0.0, 0.0);
+  if (isa<UndefValue>(C))
+    return None;
+  if (auto *CDS = dyn_cast<ConstantDataSequential>(C)) {
+    if (!CDS->getElementType()->isFloatingPointTy())
+      return None;
+    Optional<Range> R;
+    for (unsigned I = 0; I < CDS->getNumElements(); I++) {
+      double V = CDS->getElementAsAPFloat(I).convertToDouble();
+      join(R, Range(V, V));
+    }
+    return R;
+  }
+  if (isa<ConstantArray>(C) || isa<ConstantStruct>(C) || isa<ConstantVector>(C)) {
+    Optional<Range> R;
+    for (const Use &Op : C->operands())
+      join(R, getConstantRange(cast<Constant>(Op.get())));
+    return R;
+  }
+  return Range(-Inf, Inf);
+}
+
+static Optional<Range> getMathCallRange(const CallBase &Call, const Function &Callee,
+                                        ArrayRef<Optional<Range>> Args) {
+  StringRef Name = Callee.getName();
+  if (Callee.isIntrinsic()) {
+    switch (Callee.getIntrinsicID()) {
+      case Intrinsic::sqrt: Name = "sqrt"; break;
+      case Intrinsic::exp: Name = "exp"; break;
+      case Intrinsic::log: Name = "log"; break;
+      case Intrinsic::sin: Name = "sin"; break;
+      case Intrinsic::cos: Name = "cos"; break;
+      case Intrinsic::fabs: Name = "fabs"; break;
+      case Intrinsic::minnum: Name = "fmin"; break;
+      case Intrinsic::maxnum: Name = "fmax"; break;
+      case Intrinsic::fma:
+      case Intrinsic::fmuladd:
+        Name = "fma";
+        break;
+      default:
+        return Range(-Inf, Inf);
+    }
+  } else if (Name.endswith("f") && Name != "modf") {
+    Name = Name.drop_back();
+  }
+  for (const Optional<Range> &A : Args) {
+    if (!A)
+      return None;
+  }
+  if (Name == "sqrt" && Args.size() == 1)
+    return rangeSqrt(*Args[0]);
+  if (Name == "exp" && Args.size() == 1)
+    return rangeExp(*Args[0]);
+  if (Name == "log" && Args.size() == 1)
+    return rangeLog(*Args[0]);
+  if (Name == "sin" && Args.size() == 1)
+    return rangeSin(*Args[0]);
+  if (Name == "cos" && Args.size() == 1)
+    return rangeCos(*Args[0]);
+  if (Name == "fabs" && Args.size() == 1)
+    return rangeAbs(*Args[0]);
+  if (Name == "fmin" && Args.size() == 2)
+    return rangeMin(*Args[0], *Args[1]);
+  if (Name == "fmax" && Args.size() == 2)
+    return rangeMax(*Args[0], *Args[1]);
+  if (Name == "fma" && Args.size() == 3)
+    return rangeAdd(rangeMul(*Args[0], *Args[1]), *Args[2]);
+  return Range(-Inf, Inf);
+}
+
+void findLoopAccumulators(LoopInfo &LI, ScalarEvolution &SE,
+                          DenseMap<const PHINode *, LoopAccumulator> &Accumulators) {
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    unsigned TripCount = SE.getSmallConstantMaxTripCount(L);
+    BasicBlock *Latch = L->getLoopLatch();
+    if (TripCount == 0 || !Latch || !L->getLoopPreheader())
+      continue;
+    for (const PHINode &Phi : L->getHeader()->phis()) {
+      if (!Phi.getType()->isFloatingPointTy() || Phi.getNumIncomingValues() != 2)
+        continue;
+      auto *Next = dyn_cast<BinaryOperator>(Phi.getIncomingValueForBlock(Latch));
+      if (!Next)
+        continue;
+      const Value *Init = Phi.getIncomingValueForBlock(L->getLoopPreheader());
+      if (Next->getOpcode() == Instruction::FAdd && Next->getOperand(0) == &Phi)
+        Accumulators[&Phi] = {Init, Next->getOperand(1), false, TripCount};
+      else if (Next->getOpcode() == Instruction::FAdd && Next->getOperand(1) == &Phi)
+        Accumulators[&Phi] = {Init, Next->getOperand(0), false, TripCount};
+      else if (Next->getOpcode() == Instruction::FSub && Next->getOperand(0) == &Phi)
+        Accumulators[&Phi] = {Init, Next->getOperand(1), true, TripCount};
+    }
+  }
+}
+
+void computeFunctionFacts(Function &F, FunctionFacts &Facts) {
+  ReversePostOrderTraversal<const Function *> RPOT(&F);
+  Facts.Blocks.assign(RPOT.begin(), RPOT.end());
+
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+  TargetLibraryInfo TLI(TLII);
+  AssumptionCache AC(F);
+  ScalarEvolution SE(F, TLI, AC, DT, LI);
+  findLoopAccumulators(LI, SE, Facts.Accumulators);
+
+  /* the integer induction variables and the values computed from them are
+   * bounded by ScalarEvolution */
+  for (Instruction &I : instructions(F)) {
+    if (!isa<SIToFPInst>(&I) && !isa<UIToFPInst>(&I))
+      continue;
+    Value *Op = I.getOperand(0);
+    if (isa<ConstantInt>(Op) || !SE.isSCEVable(Op->getType()))
+      continue;
+    const SCEV *S = SE.getSCEV(Op);
+    if (isa<SIToFPInst>(&I)) {
+      ConstantRange CR = SE.getSignedRange(S);
+      Facts.IntToFPRanges[&I] = Range(CR.getSignedMin().roundToDouble(true), CR.getSignedMax().roundToDouble(true));
+    } else {
+      ConstantRange CR = SE.getUnsignedRange(S);
+      Facts.IntToFPRanges[&I] = Range(CR.getUnsignedMin().roundToDouble(false), CR.getUnsignedMax().roundToDouble(false));
+    }
+  }
+}
+
+static bool isMathFunction(const Function &F) {
+  static const char *const Names[] = {
+    "sqrt", "sqrtf", "exp", "expf", "log", "logf", "sin", "sinf",
+    "cos", "cosf", "fabs", "fabsf", "fmin", "fminf", "fmax", "fmaxf"
+  };
+  for (const char *Name : Names) {
+    if (F.getName() == Name)
+      return true;
+  }
+  return false;
+}
+
+/* The functions of the OpenMP runtime which only write the integer
+ * bookkeeping of the threads and of the work sharing loops through their
+ * pointer arguments */
+static bool isOpenMPBookkeeping(const Function &F) {
+  static const char *const Prefixes[] = {
+    "__kmpc_for_static_init", "__kmpc_for_static_fini", "__kmpc_dispatch_",
+    "__kmpc_barrier", "__kmpc_global_thread_num", "__kmpc_push_num_threads",
+    "__kmpc_serialized_parallel", "__kmpc_end_serialized_parallel", "omp_get_"
+  };
+  for (const char *Prefix : Prefixes) {
+    if (F.getName().startswith(Prefix))
+      return true;
+  }
+  return false;
+}
+
+/* The outlined function of the parallel region started by Call, if it is a
+ * __kmpc_fork_call or a __kmpc_fork_teams. The OpenMP runtime calls it in
+ * each thread with the thread ids and the arguments of Call after the
+ * first three. */
+static const Function *getForkedFunction(const CallBase &Call) {
+  const Function *Callee = Call.getCalledFunction();
+  if (!Callee || Call.arg_size() < 3 ||
+      (Callee->getName() != "__kmpc_fork_call" && Callee->getName() != "__kmpc_fork_teams"))
+    return nullptr;
+  return dyn_cast<Function>(Call.getArgOperand(2)->stripPointerCasts());
+}
+
+/* Whether F is only used as the outlined function of parallel regions */
+static bool isForkedOnly(const Function &F) {
+  if (F.use_empty())
+    return false;
+  SmallVector<const User *, 4> Users(F.users());
+  while (!Users.empty()) {
+    const User *U = Users.pop_back_val();
+    if (isa<BitCastOperator>(U)) {
+      Users.append(U->user_begin(), U->user_end());
+      continue;
+    }
+    auto *Call = dyn_cast<CallBase>(U);
+    if (!Call || getForkedFunction(*Call) != &F)
+      return false;
+  }
+  return true;
+}
+
+/* Whether A has a range in the summaries: the floating point arguments,
+ * and the pointers to the captured variables of the outlined functions,
+ * whose range is the one of the values they point to at the fork */
+static bool hasArgumentRange(const Argument &A) {
+  if (A.getType()->isFloatingPointTy())
+    return true;
+  return A.getType()->isPointerTy() && A.getArgNo() >= 2 && isForkedOnly(*A.getParent());
+}
+
+/* The call graph of M, in which the functions starting parallel regions
+ * also call their outlined functions */
+static void addForkEdges(Module &M, CallGraph &CG) {
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      auto *Call = dyn_cast<CallBase>(&I);
+      const Function *Forked = Call ? getForkedFunction(*Call) : nullptr;
+      if (!Forked)
+        continue;
+#if LLVM_VERSION_MAJOR >= 11
+      CG[&F]->addCalledFunction(Call, CG[Forked]);
+#else
+      CG[&F]->addCalledFunction(CallSite(Call), CG[Forked]);
+#endif
+    }
+  }
+}
+
+namespace {
+
+/* The fixed point iteration on one function for one signature */
+class FunctionAnalyzer {
+public:
+  FunctionAnalyzer(SummaryRangeAnalysis &SRA, const Function &F,
+                   const FunctionFacts &Facts,
+                   const std::vector<int> &Signature, unsigned SCC,
+                   const DenseMap<const Function *, unsigned> &SCCOf,
+                   RangeSummary &S)
+    : SRA(SRA), F(F), Facts(Facts), Signature(Signature), SCC(SCC), SCCOf(SCCOf), S(S) {}
+
+  void run() {
+    do {
+      Changed = false;
+      for (const BasicBlock *BB : Facts.Blocks) {
+        for (const Instruction &I : *BB)
+          transfer(I);
+      }
+      Iteration++;
+    } while (Changed);
+    NumIterations += Iteration;
+
+    /* each descending iteration from the fixed point is still a sound
+     * approximation, and recovers the bounds lost by widening the values
+     * which are limited afterwards */
+    Narrowing = true;
+    for (unsigned N = 0; N < NarrowingIterations; N++) {
+      NarrowedReturn = None;
+      for (const BasicBlock *BB : Facts.Blocks) {
+        for (const Instruction &I : *BB)
+          transfer(I);
+      }
+      if (S.Return && NarrowedReturn)
+        S.Return = intersect(*S.Return, *NarrowedReturn);
+    }
+
+    for (const Instruction &I : instructions(F)) {
+      if (isa<AllocaInst>(&I)) {
+        auto It = Memory.find(&I);
+        if (It != Memory.end())
+          S.Values[&I] = It->second;
+      }
+    }
+  }
+
+private:
+  SummaryRangeAnalysis &SRA;
+  const Function &F;
+  const FunctionFacts &Facts;
+  const std::vector<int> &Signature;
+  unsigned SCC;
+  const DenseMap<const Function *, unsigned> &SCCOf;
+  RangeSummary &S;
+  /* the range of the values in each object, from its stores and from its
+   * initial content */
+  DenseMap<const Value *, Range> Memory;
+  unsigned Iteration = 0;
+  bool Changed = false;
+  bool Narrowing = false;
+  Optional<Range> NarrowedReturn;
+
+  static Range intersect(const Range &A, const Range &B) {
+    Range R(std::max(A.Min, B.Min), std::min(A.Max, B.Max));
+    /* only on unreachable code */
+    if (R.Min > R.Max)
+      return B;
+    return R;
+  }
+
+  void setValue(const Value *V, const Range &R) {
+    if (!Narrowing) {
+      update(S.Values, V, R);
+      return;
+    }
+    auto It = S.Values.find(V);
+    if (It != S.Values.end())
+      It->second = intersect(It->second, R);
+  }
+
+  void setReturn(const Range &R) {
+    if (Narrowing)
+      join(NarrowedReturn, R);
+    else
+      update(S.Return, R);
+  }
+
+  /* joins R to Dst, widening it if it still grows after WidenAfter
+   * iterations */
+  void update(Optional<Range> &Dst, const Range &R) {
+    if (!Dst) {
+      Dst = R;
+      Changed = true;
+      return;
+    }
+    Range New = rangeUnion(*Dst, R);
+    if (New.Min >= Dst->Min && New.Max <= Dst->Max)
+      return;
+    if (Iteration >= WidenAfter) {
+      if (New.Min < Dst->Min)
+        New.Min = -Inf;
+      if (New.Max > Dst->Max)
+        New.Max = Inf;
+      NumWidened++;
+    }
+    Dst = New;
+    Changed = true;
+  }
+
+  template <typename K>
+  void update(DenseMap<K, Range> &Map, K Key, const Range &R) {
+    auto It = Map.find(Key);
+    Optional<Range> Dst;
+    if (It != Map.end())
+      Dst = It->second;
+    update(Dst, R);
+    Map[Key] = *Dst;
+  }
+
+  Optional<Range> get(const Value *V) {
+    if (auto *C = dyn_cast<Constant>(V))
+      return getConstantRange(C);
+    if (auto *A = dyn_cast<Argument>(V)) {
+      if (!A->getType()->isFloatingPointTy())
+        return None;
+      return A->getArgNo() < S.Args.size() ? S.Args[A->getArgNo()] : None;
+    }
+    auto It = S.Values.find(V);
+    if (It == S.Values.end())
+      return None;
+    return It->second;
+  }
+
+  /* the initial content of an object */
+  Optional<Range> getInitialRange(const Value *Base) {
+    if (isa<AllocaInst>(Base))
+      return getAnnotatedRange(Base);
+    if (auto *GV = dyn_cast<GlobalVariable>(Base)) {
+      if (GV->isConstant() && GV->hasDefinitiveInitializer())
+        return getConstantRange(GV->getInitializer());
+      Optional<Range> R = getAnnotatedRange(GV);
+      if (R && GV->hasDefinitiveInitializer())
+        join(R, getConstantRange(GV->getInitializer()));
+      return R ? R : Range(-Inf, Inf);
+    }
+    if (auto *A = dyn_cast<Argument>(Base)) {
+      Optional<Range> R = getAnnotatedRange(Base);
+      if (A->getType()->isPointerTy() && A->getArgNo() < S.Args.size())
+        join(R, S.Args[A->getArgNo()]);
+      return R ? R : Range(-Inf, Inf);
+    }
+    return Range(-Inf, Inf);
+  }
+
+  Optional<Range> load(const Value *Ptr) {
+    const Value *Base = getBaseObject(Ptr);
+    auto It = Memory.find(Base);
+    if (It != Memory.end())
+      return It->second;
+    Optional<Range> R = getInitialRange(Base);
+    if (R)
+      Memory[Base] = *R;
+    return R;
+  }
+
+  void store(const Value *Ptr, const Range &R) {
+    const Value *Base = getBaseObject(Ptr);
+    if (!Memory.count(Base)) {
+      if (Optional<Range> Init = getInitialRange(Base))
+        Memory[Base] = *Init;
+    }
+    update(Memory, Base, R);
+    if (auto *A = dyn_cast<Argument>(Base)) {
+      if (A->getArgNo() < S.ArgStores.size())
+        update(S.ArgStores[A->getArgNo()], R);
+    } else if (auto *GV = dyn_cast<GlobalVariable>(Base)) {
+      update(S.GlobalStores, GV, R);
+    }
+  }
+
+  /* the memory reachable from the pointer arguments of a call which is not
+   * analyzed may contain anything */
+  void clobberArguments(const CallBase &Call) {
+    for (const Value *Arg : Call.args()) {
+      if (Arg->getType()->isPointerTy())
+        store(Arg, Range(-Inf, Inf));
+    }
+  }
+
+  void transfer(const Instruction &I) {
+    if (auto *St = dyn_cast<StoreInst>(&I)) {
+      const Value *V = St->getValueOperand();
+      if (V->getType()->isFPOrFPVectorTy() || V->getType()->isAggregateType()) {
+        if (Optional<Range> R = get(V))
+          store(St->getPointerOperand(), *R);
+      } else if (V->getType()->isPointerTy()) {
+        /* the object may be written through the stored pointer */
+        store(V, Range(-Inf, Inf));
+      }
+      return;
+    }
+    if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+      if (Ret->getReturnValue() && Ret->getReturnValue()->getType()->isFloatingPointTy()) {
+        if (Optional<Range> R = get(Ret->getReturnValue()))
+          setReturn(*R);
+      }
+      return;
+    }
+    if (auto *Call = dyn_cast<CallBase>(&I)) {
+      transferCall(*Call);
+      return;
+    }
+    if (!I.getType()->isFloatingPointTy())
+      return;
+    if (Optional<Range> R = compute(I))
+      setValue(&I, *R);
+  }
+
+  Optional<Range> compute(const Instruction &I) {
+    auto Binary = [&](Range (*Op)(const Range &, const Range &)) -> Optional<Range> {
+      Optional<Range> A = get(I.getOperand(0)), B = get(I.getOperand(1));
+      if (!A || !B)
+        return None;
+      return Op(*A, *B);
+    };
+    switch (I.getOpcode()) {
+      case Instruction::FAdd:
+        return Binary(rangeAdd);
+      case Instruction::FSub:
+        return Binary(rangeSub);
+      case Instruction::FMul:
+        return Binary(rangeMul);
+      case Instruction::FDiv:
+        return Binary(rangeDiv);
+      case Instruction::FRem: {
+        Optional<Range> A = get(I.getOperand(0)), B = get(I.getOperand(1));
+        if (!A || !B)
+          return None;
+        double Mag = std::min(std::max(std::abs(A->Min), std::abs(A->Max)),
+                              std::max(std::abs(B->Min), std::abs(B->Max)));
+        return Range(A->Min < 0.0 ? -Mag : 0.0, A->Max > 0.0 ? Mag : 0.0);
+      }
+      case Instruction::FNeg: {
+        Optional<Range> A = get(I.getOperand(0));
+        return A ? Optional<Range>(rangeNeg(*A)) : None;
+      }
+      case Instruction::FPExt:
+      case Instruction::FPTrunc:
+        return get(I.getOperand(0));
+      case Instruction::SIToFP:
+      case Instruction::UIToFP: {
+        bool Signed = I.getOpcode() == Instruction::SIToFP;
+        if (auto *CI = dyn_cast<ConstantInt>(I.getOperand(0))) {
+          double V = Signed ? (double)CI->getSExtValue() : (double)CI->getZExtValue();
+          return Range(V, V);
+        }
+        auto IntRange = Facts.IntToFPRanges.find(&I);
+        if (IntRange != Facts.IntToFPRanges.end())
+          return IntRange->second;
+        unsigned Bits = I.getOperand(0)->getType()->getScalarSizeInBits();
+        if (Signed)
+          return Range(-std::ldexp(1.0, Bits - 1), std::ldexp(1.0, Bits - 1));
+        return Range(0.0, std::ldexp(1.0, Bits));
+      }
+      case Instruction::PHI: {
+        auto Acc = Facts.Accumulators.find(cast<PHINode>(&I));
+        if (Acc != Facts.Accumulators.end()) {
+          Optional<Range> Init = get(Acc->second.Init), Step = get(Acc->second.Step);
+          if (!Init || !Step)
+            return None;
+          Range D = Acc->second.Negative ? rangeNeg(*Step) : *Step;
+          double T = Acc->second.TripCount;
+          return rangeAdd(*Init, Range(T * std::min(D.Min, 0.0), T * std::max(D.Max, 0.0)));
+        }
+        Optional<Range> R;
+        for (const Value *In : cast<PHINode>(&I)->incoming_values())
+          join(R, get(In));
+        return R;
+      }
+      case Instruction::Select: {
+        Optional<Range> R = get(I.getOperand(1));
+        join(R, get(I.getOperand(2)));
+        return R;
+      }
+      case Instruction::Load:
+        return load(cast<LoadInst>(&I)->getPointerOperand());
+      default:
+        return Range(-Inf, Inf);
+    }
+  }
+
+  void transferCall(const CallBase &Call) {
+    const Function *Callee = Call.getCalledFunction();
+    bool FPResult = Call.getType()->isFloatingPointTy();
+    if (!Callee) {
+      clobberArguments(Call);
+      if (FPResult)
+        setValue(&Call, Range(-Inf, Inf));
+      return;
+    }
+
+    SmallVector<Optional<Range>, 4> ArgRanges;
+    for (const Value *Arg : Call.args())
+      ArgRanges.push_back(Arg->getType()->isFloatingPointTy() ? get(Arg) : Range(-Inf, Inf));
+
+    if (const Function *Forked = getForkedFunction(Call)) {
+      transferFork(Call, *Forked);
+      return;
+    }
+
+    if (Callee->isDeclaration() || Callee->isIntrinsic()) {
+      if (auto *II = dyn_cast<IntrinsicInst>(&Call)) {
+        if (isa<DbgInfoIntrinsic>(II) || II->getIntrinsicID() == Intrinsic::lifetime_start ||
+            II->getIntrinsicID() == Intrinsic::lifetime_end)
+          return;
+      }
+      if (!Callee->isIntrinsic() && !isMathFunction(*Callee) && !isOpenMPBookkeeping(*Callee))
+        clobberArguments(Call);
+      else if (isa<MemIntrinsic>(&Call))
+        clobberArguments(Call);
+      if (FPResult) {
+        if (Optional<Range> R = getMathCallRange(Call, *Callee, ArgRanges))
+          setValue(&Call, *R);
+      }
+      return;
+    }
+
+    /* the ranges of the arguments must be known, or the call is analyzed at
+     * a later iteration */
+    std::vector<const Range *> Args;
+    std::vector<int> CalleeSig;
+    for (unsigned A = 0; A < Call.arg_size(); A++) {
+      const Value *Arg = Call.getArgOperand(A);
+      if (!Arg->getType()->isFloatingPointTy()) {
+        Args.push_back(nullptr);
+        continue;
+      }
+      if (!ArgRanges[A])
+        return;
+      Args.push_back(ArgRanges[A].getPointer());
+      SmallVector<int, 2> Sig;
+      appendRangeSignature(Args.back(), Sig);
+      CalleeSig.insert(CalleeSig.end(), Sig.begin(), Sig.end());
+    }
+
+    auto CalleeSCC = SCCOf.find(Callee);
+    if (CalleeSCC != SCCOf.end() && CalleeSCC->second == SCC) {
+      if (Callee == &F && CalleeSig == Signature) {
+        /* the ranges computed so far for this summary */
+        for (unsigned A = 0; A < Call.arg_size() && A < S.ArgStores.size(); A++) {
+          if (S.ArgStores[A])
+            store(Call.getArgOperand(A), *S.ArgStores[A]);
+        }
+        if (FPResult && S.Return)
+          setValue(&Call, *S.Return);
+      } else {
+        clobberArguments(Call);
+        if (FPResult)
+          setValue(&Call, Range(-Inf, Inf));
+      }
+      return;
+    }
+
+    const RangeSummary &CS = SRA.getSummary(*Callee, Args);
+    for (unsigned A = 0; A < Call.arg_size() && A < CS.ArgStores.size(); A++) {
+      if (CS.ArgStores[A])
+        store(Call.getArgOperand(A), *CS.ArgStores[A]);
+    }
+    for (const auto &GS : CS.GlobalStores)
+      store(GS.first, GS.second);
+    if (FPResult && CS.Return)
+      setValue(&Call, *CS.Return);
+  }
+
+  /* A parallel region, analyzed as a call to its outlined function with the
+   * arguments after the thread ids; the outlined function starts from the
+   * ranges of the values in the variables captured by reference */
+  void transferFork(const CallBase &Call, const Function &Outlined) {
+    auto OutlinedSCC = SCCOf.find(&Outlined);
+    if (Outlined.isDeclaration() || !isForkedOnly(Outlined) ||
+        (OutlinedSCC != SCCOf.end() && OutlinedSCC->second == SCC)) {
+      clobberArguments(Call);
+      return;
+    }
+
+    unsigned N = Outlined.arg_size();
+    std::vector<const Value *> Actuals(N, nullptr);
+    for (unsigned A = 2; A < N && A + 1 < Call.arg_size(); A++)
+      Actuals[A] = Call.getArgOperand(A + 1);
+    std::vector<Optional<Range>> ArgRanges(N);
+    std::vector<const Range *> Args(N, nullptr);
+    for (unsigned A = 2; A < N; A++) {
+      if (!Actuals[A])
+        continue;
+      if (Actuals[A]->getType()->isFloatingPointTy()) {
+        ArgRanges[A] = get(Actuals[A]);
+        if (!ArgRanges[A])
+          return;
+      } else if (Actuals[A]->getType()->isPointerTy()) {
+        ArgRanges[A] = load(Actuals[A]);
+      }
+      if (ArgRanges[A])
+        Args[A] = ArgRanges[A].getPointer();
+    }
+
+    const RangeSummary &CS = SRA.getSummary(Outlined, Args);
+    for (unsigned A = 2; A < N && A < CS.ArgStores.size(); A++) {
+      if (Actuals[A] && CS.ArgStores[A])
+        store(Actuals[A], *CS.ArgStores[A]);
+    }
+    for (const auto &GS : CS.GlobalStores)
+      store(GS.first, GS.second);
+  }
+};
+
+}
+
+SummaryRangeAnalysis::SummaryRangeAnalysis(Module &M) : M(M) {
+  CallGraph CG(M);
+  addForkEdges(M, CG);
+  unsigned Id = 0;
+  for (scc_iterator<CallGraph *> It = scc_begin(&CG); !It.isAtEnd(); ++It, ++Id) {
+    for (CallGraphNode *Node : *It) {
+      if (const Function *F = Node->getFunction())
+        SCCOf[F] = Id;
+    }
+  }
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    computeFunctionFacts(F, Facts[&F]);
+    if (MetadataManager::isStartingPoint(F) || (F.hasAddressTaken() && !isForkedOnly(F)) || F.use_empty())
+      Roots.push_back(&F);
+  }
+}
+
+/* An empty summary of F with the argument ranges of Signature; nullptr if
+ * Signature has not one pair for each floating point argument */
+static std::unique_ptr<RangeSummary> createSummary(const Function &F,
+                                                   const std::vector<int> &Signature) {
+  std::unique_ptr<RangeSummary> S(new RangeSummary());
+  unsigned Next = 0;
+  for (const Argument &A : F.args()) {
+    if (hasArgumentRange(A)) {
+      if (Next + 1 >= Signature.size())
+        return nullptr;
+      S->Args.push_back(getSignatureRange(Signature[Next], Signature[Next + 1]));
+      Next += 2;
+    } else {
+      S->Args.push_back(None);
+    }
+  }
+  if (Next != Signature.size())
+    return nullptr;
+  S->ArgStores.resize(F.arg_size());
+  return S;
+}
+
+std::unique_ptr<RangeSummary> SummaryRangeAnalysis::analyze(const Function &F,
+                                                            const std::vector<int> &Signature) {
+  std::unique_ptr<RangeSummary> S = createSummary(F, Signature);
+  FunctionAnalyzer(*this, F, Facts.find(&F)->second, Signature, SCCOf.lookup(&F), SCCOf, *S).run();
+  NumSummaries++;
+  return S;
+}
+
+const RangeSummary &SummaryRangeAnalysis::getSummary(const Function &F,
+                                                     ArrayRef<const Range *> Args) {
+  std::vector<int> Signature;
+  for (const Argument &A : F.args()) {
+    if (!hasArgumentRange(A))
+      continue;
+    SmallVector<int, 2> Sig;
+    appendRangeSignature(A.getArgNo() < Args.size() ? Args[A.getArgNo()] : nullptr, Sig);
+    Signature.insert(Signature.end(), Sig.begin(), Sig.end());
+  }
+  Key K(&F, Signature);
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Summaries.find(K);
+    if (It != Summaries.end())
+      return *It->second;
+  }
+  /* another thread may compute the same summary meanwhile; the first one
+   * is kept, and they are equal */
+  std::unique_ptr<RangeSummary> S = analyze(F, Signature);
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto Res = Summaries.emplace(K, std::move(S));
+  return *Res.first->second;
+}
+
+void SummaryRangeAnalysis::run(unsigned Jobs) {
+  /* the metadata of the roots is read before the threads start */
+  std::vector<std::vector<Optional<Range>>> RootArgs;
+  for (const Function *F : Roots) {
+    RootArgs.emplace_back();
+    for (const Argument &A : F->args())
+      RootArgs.back().push_back(getAnnotatedRange(&A));
+  }
+  std::atomic<unsigned> Next(0);
+  auto Worker = [&]() {
+    for (unsigned R = Next++; R < Roots.size(); R = Next++) {
+      std::vector<const Range *> Args;
+      for (const Optional<Range> &A : RootArgs[R])
+        Args.push_back(A ? A.getPointer() : nullptr);
+      getSummary(*Roots[R], Args);
+    }
+  };
+  std::vector<std::thread> Threads;
+  for (unsigned J = 1; J < Jobs && J < Roots.size(); J++)
+    Threads.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Threads)
+    T.join();
+}
+
+unsigned SummaryRangeAnalysis::getNumSummaries() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Summaries.size();
+}
+
+unsigned SummaryRangeAnalysis::annotate() {
+  DenseMap<const Value *, Range> Union;
+  DenseMap<const Function *, std::vector<Optional<Range>>> ArgUnion;
+  auto Join = [&](const Value *V, const Range &R) {
+    auto It = Union.find(V);
+    if (It == Union.end())
+      Union[V] = R;
+    else
+      It->second = rangeUnion(It->second, R);
+  };
+  for (const auto &Entry : Summaries) {
+    const RangeSummary &S = *Entry.second;
+    for (const auto &V : S.Values)
+      Join(V.first, V.second);
+    for (const auto &G : S.GlobalStores)
+      Join(G.first, G.second);
+    std::vector<Optional<Range>> &Args = ArgUnion[Entry.first.first];
+    Args.resize(S.Args.size());
+    for (unsigned A = 0; A < S.Args.size(); A++)
+      join(Args[A], S.Args[A]);
+  }
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  unsigned Set = 0;
+  auto NewInfo = [&](const InputInfo *II, const Range &R) {
+    std::unique_ptr<InputInfo> New(cast<InputInfo>(II->clone()));
+    New->IRange = std::make_shared<Range>(R);
+    Set++;
+    return New;
+  };
+  for (GlobalVariable &GV : M.globals()) {
+    InputInfo *II = MM.retrieveInputInfo(GV);
+    auto It = Union.find(&GV);
+    if (!II || II->IFinal || It == Union.end())
+      continue;
+    Range R = It->second;
+    if (II->IRange)
+      R = rangeUnion(R, *II->IRange);
+    if (GV.hasDefinitiveInitializer()) {
+      if (Optional<Range> Init = getConstantRange(GV.getInitializer()))
+        R = rangeUnion(R, *Init);
+    }
+    MetadataManager::setInputInfoMetadata(GV, *NewInfo(II, R));
+  }
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    for (Instruction &I : instructions(F)) {
+      InputInfo *II = MM.retrieveInputInfo(I);
+      auto It = Union.find(&I);
+      if (II && !II->IFinal && It != Union.end())
+        MetadataManager::setInputInfoMetadata(I, *NewInfo(II, It->second));
+    }
+
+    auto Args = ArgUnion.find(&F);
+    if (Args == ArgUnion.end())
+      continue;
+    SmallVector<MDInfo *, 4> Infos;
+    MM.retrieveArgumentInputInfo(F, Infos);
+    std::vector<std::unique_ptr<MDInfo>> Owned;
+    SmallVector<MDInfo *, 4> NewInfos(Infos.begin(), Infos.end());
+    bool Changed = false;
+    for (unsigned A = 0; A < NewInfos.size() && A < Args->second.size(); A++) {
+      InputInfo *II = dyn_cast_or_null<InputInfo>(NewInfos[A]);
+      if (!II || II->IFinal || !Args->second[A])
+        continue;
+      Owned.push_back(NewInfo(II, *Args->second[A]));
+      NewInfos[A] = Owned.back().get();
+      Changed = true;
+    }
+    if (Changed)
+      MetadataManager::setArgumentInputInfoMetadata(F, NewInfos);
+  }
+  return Set;
+}
+
+
+static const char CacheHeader[] = "taffo-vra-cache 1";
+
+static void printRange(raw_ostream &OS, const Optional<Range> &R) {
+  if (R)
+    OS << format("%a %a", R->Min, R->Max);
+  else
+    OS << "-";
+}
+
+static bool parseRange(ArrayRef<StringRef> Fields, unsigned First, Range &R) {
+  if (Fields.size() != First + 2)
+    return false;
+  double Bounds[2];
+  for (unsigned I = 0; I < 2; I++) {
+    std::string Text = Fields[First + I].str();
+    char *End;
+    Bounds[I] = std::strtod(Text.c_str(), &End);
+    if (End != Text.c_str() + Text.size())
+      return false;
+  }
+  R = Range(Bounds[0], Bounds[1]);
+  return true;
+}
+
+/* The range and the other annotations of V, exactly */
+static void printInfo(raw_ostream &OS, const Value *V) {
+  printRange(OS, getAnnotatedRange(V));
+  MDInfo *Info = nullptr;
+  if (auto *A = dyn_cast<Argument>(V)) {
+    SmallVector<MDInfo *, 4> Infos;
+    MetadataManager::getMetadataManager().retrieveArgumentInputInfo(*A->getParent(), Infos);
+    if (A->getArgNo() < Infos.size())
+      Info = Infos[A->getArgNo()];
+  } else {
+    Info = MetadataManager::getMetadataManager().retrieveMDInfo(V);
+  }
+  OS << " " << (Info ? Info->toString() : "-");
+}
+
+static void printOperand(raw_ostream &OS, const Value *V, const DenseMap<const Value *, unsigned> &Ids) {
+  auto Id = Ids.find(V);
+  if (Id != Ids.end()) {
+    OS << "%" << Id->second;
+  } else if (auto *GV = dyn_cast<GlobalVariable>(V)) {
+    /* what the analysis reads of the global */
+    OS << "@" << GV->getName() << (GV->isConstant() ? " constant " : " ");
+    printInfo(OS, GV);
+    OS << " ";
+    printRange(OS, GV->hasDefinitiveInitializer() ? getConstantRange(GV->getInitializer()) : None);
+  } else if (auto *GlobV = dyn_cast<GlobalValue>(V)) {
+    OS << "@" << GlobV->getName();
+  } else if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+    OS << CE->getOpcodeName() << " " << *CE->getType() << " (";
+    for (const Use &Op : CE->operands()) {
+      printOperand(OS, Op.get(), Ids);
+      OS << ", ";
+    }
+    OS << ")";
+  } else {
+    V->printAsOperand(OS, true);
+  }
+}
+
+std::string hashFunctionBody(const Function &F) {
+  DenseMap<const Value *, unsigned> Ids;
+  unsigned Next = 0;
+  for (const Argument &A : F.args())
+    Ids[&A] = Next++;
+  for (const BasicBlock &BB : F) {
+    Ids[&BB] = Next++;
+    for (const Instruction &I : BB)
+      Ids[&I] = Next++;
+  }
+
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << F.getName() << " " << *F.getFunctionType();
+  for (const Argument &A : F.args()) {
+    OS << " ";
+    printInfo(OS, &A);
+  }
+  for (const BasicBlock &BB : F) {
+    OS << "\n%" << Ids[&BB] << ":";
+    for (const Instruction &I : BB) {
+      OS << "\n" << I.getOpcodeName() << " " << *I.getType();
+      if (auto *Cmp = dyn_cast<CmpInst>(&I))
+        OS << " " << Cmp->getPredicate();
+      else if (auto *AI = dyn_cast<AllocaInst>(&I))
+        OS << " " << *AI->getAllocatedType();
+      else if (auto *GEP = dyn_cast<GetElementPtrInst>(&I))
+        OS << " " << *GEP->getSourceElementType();
+      for (const Use &Op : I.operands()) {
+        OS << " " << *Op->getType() << " ";
+        printOperand(OS, Op.get(), Ids);
+      }
+      if (auto *Phi = dyn_cast<PHINode>(&I)) {
+        for (const BasicBlock *In : Phi->blocks())
+          OS << " %" << Ids[In];
+      }
+      OS << " ";
+      printInfo(OS, &I);
+    }
+  }
+  MD5 Hasher;
+  Hasher.update(OS.str());
+  MD5::MD5Result Res;
+  Hasher.final(Res);
+  return std::string(Res.digest().str());
+}
+
+void SummaryRangeAnalysis::computeHashes() {
+  if (!Hashes.empty())
+    return;
+  /* the components are visited with the callees first; the hash of each
+   * component includes the ones of the components it calls */
+  CallGraph CG(M);
+  addForkEdges(M, CG);
+  for (scc_iterator<CallGraph *> It = scc_begin(&CG); !It.isAtEnd(); ++It) {
+    std::vector<const Function *> Members;
+    std::vector<std::string> Parts;
+    for (CallGraphNode *Node : *It) {
+      const Function *F = Node->getFunction();
+      if (!F || F->isDeclaration())
+        continue;
+      Members.push_back(F);
+      Parts.push_back(hashFunctionBody(*F));
+      for (const CallGraphNode::CallRecord &Call : *Node) {
+        const Function *Callee = Call.second->getFunction();
+        auto CalleeHash = Callee ? Hashes.find(Callee) : Hashes.end();
+        if (CalleeHash != Hashes.end())
+          Parts.push_back("call " + CalleeHash->second);
+      }
+    }
+    if (Members.empty())
+      continue;
+    llvm::sort(Parts);
+    MD5 Hasher;
+    for (const std::string &Part : Parts) {
+      Hasher.update(Part);
+      Hasher.update("\n");
+    }
+    MD5::MD5Result Res;
+    Hasher.final(Res);
+    std::string Hash(Res.digest().str());
+    for (const Function *F : Members)
+      Hashes[F] = Hash;
+  }
+}
+
+bool SummaryRangeAnalysis::saveCache(StringRef Path, std::string &Error) {
+  computeHashes();
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    Error = EC.message();
+    return false;
+  }
+  OS << CacheHeader << "\n";
+  for (const auto &Entry : Summaries) {
+    const Function *F = Entry.first.first;
+    const RangeSummary &S = *Entry.second;
+    /* the entries are found by the names of the functions and globals */
+    bool Named = F->hasName();
+    for (const auto &GS : S.GlobalStores)
+      Named &= GS.first->hasName();
+    if (!Named)
+      continue;
+
+    OS << "function " << F->getName() << " " << Hashes.lookup(F);
+    for (int Bits : Entry.first.second)
+      OS << " " << Bits;
+    OS << "\n";
+    if (S.Return) {
+      OS << "return ";
+      printRange(OS, S.Return);
+      OS << "\n";
+    }
+    for (unsigned A = 0; A < S.ArgStores.size(); A++) {
+      if (S.ArgStores[A]) {
+        OS << "argstore " << A << " ";
+        printRange(OS, S.ArgStores[A]);
+        OS << "\n";
+      }
+    }
+    for (const auto &GS : S.GlobalStores) {
+      OS << "global " << GS.first->getName() << " ";
+      printRange(OS, GS.second);
+      OS << "\n";
+    }
+    unsigned Index = 0;
+    for (const Instruction &I : instructions(*F)) {
+      auto It = S.Values.find(&I);
+      if (It != S.Values.end()) {
+        OS << "value " << Index << " ";
+        printRange(OS, It->second);
+        OS << "\n";
+      }
+      Index++;
+    }
+    OS << "end\n";
+  }
+  OS.close();
+  if (OS.has_error()) {
+    Error = OS.error().message();
+    OS.clear_error();
+    return false;
+  }
+  return true;
+}
+
+unsigned SummaryRangeAnalysis::loadCache(StringRef Path) {
+  /* the hashes are taken before annotate changes the ranges, so that they
+   * match the ones of the next compilation */
+  computeHashes();
+  ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path);
+  if (!File)
+    return 0;
+  SmallVector<StringRef, 0> Lines;
+  (*File)->getBuffer().split(Lines, '\n');
+  if (Lines.empty() || Lines[0] != CacheHeader)
+    return 0;
+
+  unsigned Loaded = 0;
+  const Function *F = nullptr;
+  std::vector<int> Signature;
+  std::unique_ptr<RangeSummary> S;
+  std::vector<const Instruction *> Insts;
+  for (unsigned L = 1; L < Lines.size(); L++) {
+    SmallVector<StringRef, 8> Fields;
+    Lines[L].split(Fields, ' ', -1, false);
+    if (Fields.empty())
+      continue;
+    if (Fields[0] == "function") {
+      S = nullptr;
+      F = Fields.size() >= 3 ? M.getFunction(Fields[1]) : nullptr;
+      /* the functions changed since, or calling changed functions, are
+       * analyzed again */
+      if (!F || F->isDeclaration() || Hashes.lookup(F) != Fields[2])
+        continue;
+      Signature.clear();
+      bool Valid = true;
+      for (unsigned I = 3; I < Fields.size(); I++) {
+        int Bits;
+        Valid &= !Fields[I].getAsInteger(10, Bits);
+        Signature.push_back(Bits);
+      }
+      if (!Valid)
+        continue;
+      S = createSummary(*F, Signature);
+      Insts.clear();
+      for (const Instruction &I : instructions(*F))
+        Insts.push_back(&I);
+      continue;
+    }
+    if (!S)
+      continue;
+
+    Range R;
+    unsigned Index;
+    if (Fields[0] == "end") {
+      if (Summaries.emplace(Key(F, Signature), std::move(S)).second)
+        Loaded++;
+      S = nullptr;
+    } else if (Fields[0] == "return" && parseRange(Fields, 1, R)) {
+      S->Return = R;
+    } else if (Fields[0] == "argstore" && Fields.size() > 1 && !Fields[1].getAsInteger(10, Index) &&
+               Index < S->ArgStores.size() && parseRange(Fields, 2, R)) {
+      S->ArgStores[Index] = R;
+    } else if (Fields[0] == "global" && Fields.size() > 1 && M.getGlobalVariable(Fields[1], true) &&
+               parseRange(Fields, 2, R)) {
+      S->GlobalStores[M.getGlobalVariable(Fields[1], true)] = R;
+    } else if (Fields[0] == "value" && Fields.size() > 1 && !Fields[1].getAsInteger(10, Index) &&
+               Index < Insts.size() && parseRange(Fields, 2, R)) {
+      S->Values[Insts[Index]] = R;
+    } else {
+      /* invalid entry */
+      S = nullptr;
+    }
+  }
+  NumCachedSummaries += Loaded;
+  return Loaded;
+}
+
+}
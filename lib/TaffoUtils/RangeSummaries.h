@@ -0,0 +1,182 @@
+//===-- RangeSummaries.h - Summary-Based Range Analysis ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Interprocedural range analysis of the floating point values, based on
+/// summaries of the functions computed for each signature of the ranges of
+/// their arguments.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_RANGE_SUMMARIES_H
+#define TAFFOUTILS_RANGE_SUMMARIES_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "InputInfo.h"
+
+namespace llvm {
+class ScalarEvolution;
+}
+
+namespace taffo {
+
+/// The widest range with the signature (Bits, Negative) computed by
+/// appendRangeSignature.
+mdutils::Range getSignatureRange(int Bits, bool Negative);
+
+/// A floating point phi in the header of a loop, which the loop increments
+/// by Step (decrements when Negative) at each of at most TripCount
+/// iterations.
+struct LoopAccumulator {
+  const llvm::Value *Init;
+  const llvm::Value *Step;
+  bool Negative;
+  unsigned TripCount;
+};
+
+/// Find the accumulators of the loops of LI whose maximum trip count is
+/// known to SE.
+void findLoopAccumulators(llvm::LoopInfo &LI, llvm::ScalarEvolution &SE,
+                          llvm::DenseMap<const llvm::PHINode *, LoopAccumulator> &Accumulators);
+
+/// The inputs of the analysis of a function which do not depend on the
+/// ranges. They are gathered for all the functions on one thread before
+/// the functions are analyzed in parallel, since the LLVM analyses which
+/// compute them create value handles and uniqued constants in the
+/// LLVMContext, which is not thread-safe.
+struct FunctionFacts {
+  /// The blocks of the function in reverse post order.
+  std::vector<const llvm::BasicBlock *> Blocks;
+  /// The accumulators of the loops of the function.
+  llvm::DenseMap<const llvm::PHINode *, LoopAccumulator> Accumulators;
+  /// The range computed by ScalarEvolution for the integer operand of each
+  /// sitofp and uitofp.
+  llvm::DenseMap<const llvm::Instruction *, mdutils::Range> IntToFPRanges;
+};
+
+/// Gather the facts of F. Must not run concurrently with the other users
+/// of the LLVMContext of F.
+void computeFunctionFacts(llvm::Function &F, FunctionFacts &Facts);
+
+/// A hash of the body of F, of the metadata of its arguments and
+/// instructions, and of the metadata and initial ranges of the globals it
+/// uses; independent from the rest of the module.
+std::string hashFunctionBody(const llvm::Function &F);
+
+/// The ranges of a function for one signature of the ranges of its
+/// floating point arguments.
+struct RangeSummary {
+  /// The range of each argument in this context; None for the arguments
+  /// which are not floating point values.
+  std::vector<llvm::Optional<mdutils::Range>> Args;
+  /// The range of the returned value; None if nothing is returned.
+  llvm::Optional<mdutils::Range> Return;
+  /// The range of the values stored through each pointer argument.
+  std::vector<llvm::Optional<mdutils::Range>> ArgStores;
+  /// The range of the floating point values stored to the globals.
+  llvm::DenseMap<const llvm::GlobalVariable *, mdutils::Range> GlobalStores;
+  /// The range of each floating point instruction, and of the values in
+  /// the memory allocated by each alloca.
+  llvm::DenseMap<const llvm::Value *, mdutils::Range> Values;
+};
+
+/// Range analysis of a module, which summarizes each function for each
+/// signature of the ranges of its arguments at the calls, so that the
+/// calls with the same signature share the analysis of the callee. The
+/// argument ranges of a summary are the widest ones with its signature.
+///
+/// The summaries are computed on demand from the roots of the call graph
+/// (the starting points, and the functions without direct calls), whose
+/// arguments have the ranges in their taffo.funinfo; the roots are
+/// analyzed in parallel. The calls between the functions of the same
+/// strongly connected component of the call graph, except the recursive
+/// calls of a function with the same signature, return unbounded ranges,
+/// which keeps the analysis of each component independent from the order
+/// in which it is reached. Within a function the loops are iterated to a
+/// fixed point, widening the ranges which still grow after a few
+/// iterations, followed by a few narrowing iterations. The number of
+/// iterations does not depend on the trip counts: the values converted from
+/// integers have the ranges computed by ScalarEvolution, and the phis which
+/// accumulate a value at each iteration of a loop with a known maximum trip
+/// count are bounded by the trip count times the accumulated range.
+///
+/// The OpenMP parallel regions (__kmpc_fork_call and __kmpc_fork_teams) are
+/// analyzed as calls to their outlined functions, which are not roots when
+/// they are only forked: the pointers to the variables captured by
+/// reference have the range of the values they point to at the fork, and
+/// the stores of the region through them are seen by the caller.
+///
+/// The memory is not analyzed per pointer: the values loaded from an
+/// alloca or a global have the union of the range in its taffo.info, of
+/// its initializer and of the stores to it in the function (for the
+/// globals) or in the function and in its callees (for the allocas).
+class SummaryRangeAnalysis {
+public:
+  explicit SummaryRangeAnalysis(llvm::Module &M);
+
+  /// Compute the summaries of the roots, and of the functions they call,
+  /// on Jobs threads.
+  void run(unsigned Jobs);
+
+  /// The summary of F for the signature of Args (one element for each
+  /// argument of F, nullptr for the unknown ranges).
+  const RangeSummary &getSummary(const llvm::Function &F,
+                                 llvm::ArrayRef<const mdutils::Range *> Args);
+
+  /// Number of summaries computed.
+  unsigned getNumSummaries() const;
+
+  /// Load the summaries saved to Path by saveCache whose functions are
+  /// unchanged since: the same body, annotations and globals they read, and
+  /// the same for all the functions they call. Must be called before run.
+  /// Returns the number of summaries loaded; a missing or invalid file
+  /// loads none.
+  unsigned loadCache(llvm::StringRef Path);
+
+  /// Save all the summaries to Path, keyed by the hash of their functions.
+  bool saveCache(llvm::StringRef Path, std::string &Error);
+
+  /// Set the range of the taffo.info of each floating point instruction,
+  /// alloca and global with one, and of the arguments in the taffo.funinfo,
+  /// to the union of their ranges in the summaries. The ranges marked as
+  /// final are not changed. Returns the number of ranges set.
+  unsigned annotate();
+
+private:
+  typedef std::pair<const llvm::Function *, std::vector<int>> Key;
+
+  std::unique_ptr<RangeSummary> analyze(const llvm::Function &F,
+                                        const std::vector<int> &Signature);
+  void computeHashes();
+
+  llvm::Module &M;
+  llvm::DenseMap<const llvm::Function *, unsigned> SCCOf;
+  /* computed by the constructor, and only read afterwards */
+  llvm::DenseMap<const llvm::Function *, FunctionFacts> Facts;
+  std::vector<const llvm::Function *> Roots;
+  mutable std::mutex Lock;
+  std::map<Key, std::unique_ptr<RangeSummary>> Summaries;
+  /* structural hash of each defined function and of its callees */
+  llvm::DenseMap<const llvm::Function *, std::string> Hashes;
+};
+
+}
+
+#endif
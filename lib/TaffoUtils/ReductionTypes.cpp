@@ -0,0 +1,204 @@
+//===-- ReductionTypes.cpp - Narrow Operands of the Reductions --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Narrow fixed point types for the arrays reduced by the loops into wide
+/// accumulators, such as the operands of the dot products.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ReductionTypes.h"
+
+#include <memory>
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Operator.h"
+#include "Metadata.h"
+#include "StorageNarrowing.h"
+#include "Trace.h"
+#include "TypeUtils.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-reductions"
+
+ALWAYS_ENABLED_STATISTIC(NumReductions, "Number of reductions found in the loops");
+ALWAYS_ENABLED_STATISTIC(NumNarrowedOperands, "Number of arrays of reduction operands narrowed");
+
+namespace taffo {
+
+/* The only user of V in L, or nullptr */
+static Instruction *getOnlyUserInLoop(Value *V, Loop &L) {
+  Instruction *Res = nullptr;
+  for (Use &U : V->uses()) {
+    auto *I = dyn_cast<Instruction>(U.getUser());
+    if (!I || !L.contains(I))
+      continue;
+    if (Res)
+      return nullptr;
+    Res = I;
+  }
+  return Res;
+}
+
+SmallVector<Reduction, 2> findReductions(Loop &L) {
+  SmallVector<Reduction, 2> Res;
+  BasicBlock *Latch = L.getLoopLatch();
+  if (!Latch)
+    return Res;
+  for (PHINode &Phi : L.getHeader()->phis()) {
+    Type *Ty = Phi.getType();
+    if (Phi.getNumIncomingValues() != 2 || (!Ty->isFloatingPointTy() && !Ty->isIntegerTy()))
+      continue;
+
+    /* from the phi along the updates, back to the phi */
+    Reduction R;
+    R.Accumulator = &Phi;
+    Value *Cur = &Phi;
+    bool Valid = true;
+    while (Valid) {
+      Instruction *Next = getOnlyUserInLoop(Cur, L);
+      if (Next == &Phi) {
+        Valid = Cur != &Phi && Phi.getIncomingValueForBlock(Latch) == Cur;
+        break;
+      }
+      auto *BO = dyn_cast_or_null<BinaryOperator>(Next);
+      unsigned Op = BO ? BO->getOpcode() : 0;
+      if (Op == Instruction::FAdd || Op == Instruction::Add) {
+        R.Steps.push_back(BO->getOperand(BO->getOperand(0) == Cur ? 1 : 0));
+      } else if ((Op == Instruction::FSub || Op == Instruction::Sub) && BO->getOperand(0) == Cur) {
+        R.Steps.push_back(BO->getOperand(1));
+      } else {
+        Valid = false;
+        break;
+      }
+      R.Updates.push_back(BO);
+      Cur = BO;
+    }
+    if (!Valid)
+      continue;
+
+    for (Value *Step : R.Steps) {
+      auto *Mul = dyn_cast<BinaryOperator>(Step);
+      if (Mul && (Mul->getOpcode() == Instruction::FMul || Mul->getOpcode() == Instruction::Mul)) {
+        R.Operands.push_back(Mul->getOperand(0));
+        R.Operands.push_back(Mul->getOperand(1));
+      } else {
+        R.Operands.push_back(Step);
+      }
+    }
+    Res.push_back(std::move(R));
+  }
+  return Res;
+}
+
+/* The object V points into */
+static Value *getBaseObject(Value *V) {
+  while (true) {
+    if (auto *GEP = dyn_cast<GEPOperator>(V))
+      V = GEP->getPointerOperand();
+    else if (auto *BC = dyn_cast<BitCastOperator>(V))
+      V = BC->getOperand(0);
+    else
+      return V;
+  }
+}
+
+static void setType(Value *V, const std::shared_ptr<FPType> &T) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  InputInfo *II = dyn_cast_or_null<InputInfo>(MM.retrieveMDInfo(V));
+  if (!II)
+    return;
+  std::unique_ptr<InputInfo> New(cast<InputInfo>(II->clone()));
+  New->IType = T;
+  TAFFO_TRACE(TraceStage::DTA, V, New->IRange.get(), T.get(), "reduction operand");
+  if (auto *I = dyn_cast<Instruction>(V))
+    MetadataManager::setInputInfoMetadata(*I, *New);
+  else if (auto *GO = dyn_cast<GlobalObject>(V))
+    MetadataManager::setInputInfoMetadata(*GO, *New);
+}
+
+/* Narrows Base and its accesses if all its loads are in Operands */
+static bool narrowOperandArray(Value *Base, const SmallPtrSetImpl<Value *> &Operands, unsigned Width) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  InputInfo *II = dyn_cast_or_null<InputInfo>(MM.retrieveMDInfo(Base));
+  auto *Old = II ? dyn_cast_or_null<FPType>(II->IType.get()) : nullptr;
+  if (!Old || !II->IRange || Old->getWidth() <= Width)
+    return false;
+  FixedPointTypeGenError Err;
+  FPType T = fixedPointTypeFromRange(*II->IRange, &Err, Width, 0, Width, Width);
+  if (Err != FixedPointTypeGenError::NoError)
+    return false;
+
+  SmallVector<Instruction *, 16> Derived;
+  if (!collectDerivedPointers(Base, Derived))
+    return false;
+  /* the loads through the constant GEPs too, which are not in Derived */
+  SmallVector<Value *, 8> Work = {Base};
+  SmallPtrSet<Value *, 16> Seen = {Base};
+  SmallVector<LoadInst *, 8> Loads;
+  while (!Work.empty()) {
+    Value *V = Work.pop_back_val();
+    for (User *U : V->users()) {
+      if (auto *LI = dyn_cast<LoadInst>(U)) {
+        if (!Operands.count(LI))
+          return false;
+        Loads.push_back(LI);
+      } else if (isa<GEPOperator>(U) && Seen.insert(U).second) {
+        Work.push_back(U);
+      }
+    }
+  }
+
+  auto New = std::make_shared<FPType>(T);
+  setType(Base, New);
+  for (Instruction *I : Derived)
+    setType(I, New);
+  for (LoadInst *LI : Loads)
+    setType(LI, New);
+  return true;
+}
+
+unsigned narrowReductionOperands(Module &M, unsigned Width) {
+  SmallPtrSet<Value *, 16> Operands;
+  SetVector<Value *> Bases;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    for (Loop *L : LI.getLoopsInPreorder()) {
+      for (Reduction &R : findReductions(*L)) {
+        NumReductions++;
+        for (Value *Op : R.Operands) {
+          auto *Load = dyn_cast<LoadInst>(Op);
+          if (!Load)
+            continue;
+          Operands.insert(Load);
+          Value *Base = getBaseObject(Load->getPointerOperand());
+          if (isa<AllocaInst>(Base) || (isa<GlobalVariable>(Base) && !cast<GlobalVariable>(Base)->isDeclaration()))
+            Bases.insert(Base);
+        }
+      }
+    }
+  }
+
+  unsigned Narrowed = 0;
+  for (Value *Base : Bases) {
+    if (narrowOperandArray(Base, Operands, Width))
+      Narrowed++;
+  }
+  NumNarrowedOperands += Narrowed;
+  return Narrowed;
+}
+
+}
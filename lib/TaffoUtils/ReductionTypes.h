@@ -0,0 +1,53 @@
+//===-- ReductionTypes.h - Narrow Operands of the Reductions ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Narrow fixed point types for the arrays reduced by the loops into wide
+/// accumulators, such as the operands of the dot products.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_REDUCTION_TYPES_H
+#define TAFFOUTILS_REDUCTION_TYPES_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// A reduction of a loop: an accumulator in the header of the loop,
+/// updated once per iteration by a chain of additions or subtractions of
+/// steps, where each update is only used by the next one in the loop.
+struct Reduction {
+  llvm::PHINode *Accumulator;
+  llvm::SmallVector<llvm::Instruction *, 2> Updates;
+  llvm::SmallVector<llvm::Value *, 2> Steps;
+  /// The values combined by the steps: the operands of the steps which
+  /// are multiplications, and the other steps.
+  llvm::SmallVector<llvm::Value *, 4> Operands;
+};
+
+/// The reductions whose accumulator is a phi in the header of L.
+llvm::SmallVector<Reduction, 2> findReductions(llvm::Loop &L);
+
+/// Give the fixed point type of Width bits for their range to the arrays
+/// and the globals whose values are only loaded as operands of reductions,
+/// and to their element pointers and their loads. The accumulators and the
+/// steps keep the wide types chosen by DTA, so that the Conversion widens
+/// the narrow operands inside the multiply-accumulate, and the narrow
+/// arrays are loaded in more vector lanes. The values stored to those
+/// arrays are converted to the narrow type. Returns the number of arrays
+/// and globals narrowed.
+unsigned narrowReductionOperands(llvm::Module &M, unsigned Width);
+
+}
+
+#endif
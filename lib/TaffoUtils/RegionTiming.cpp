@@ -0,0 +1,324 @@
+//===-- RegionTiming.cpp - Cycle Counters for the TAFFO Regions -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Instrumentation of the functions marked by TAFFO with cycle counters,
+/// to attribute the speedups of the converted code to the kernels.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RegionTiming.h"
+
+#include <map>
+#include <set>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-region-timing"
+
+ALWAYS_ENABLED_STATISTIC(NumTimedFunctions, "Number of functions instrumented with cycle counters");
+
+#define REGION_PROFILE_HEADER "taffo-region-profile"
+
+namespace taffo {
+
+/* Memory mapped registers of the ARMv7-M and ARMv8-M debug unit */
+static const uint64_t DWT_CTRL = 0xE0001000;
+static const uint64_t DWT_CYCCNT = 0xE0001004;
+static const uint64_t DEMCR = 0xE000EDFC;
+
+static const Function *functionFromMD(const MDNode *MD) {
+  if (!MD || MD->getNumOperands() == 0)
+    return nullptr;
+  if (auto *VMD = dyn_cast_or_null<ValueAsMetadata>(MD->getOperand(0).get()))
+    return dyn_cast<Function>(VMD->getValue()->stripPointerCasts());
+  return nullptr;
+}
+
+std::string getRegionName(const Function &F) {
+  const Function *Orig = &F;
+  /* the clones of clones also point to their source: the chain is short,
+   * the bound only guards against cycles */
+  for (unsigned I = 0; I < 8; I++) {
+    const Function *Next = functionFromMD(Orig->getMetadata(ORIGINAL_FUN_METADATA));
+    if (!Next)
+      Next = functionFromMD(Orig->getMetadata(SOURCE_FUN_METADATA));
+    if (!Next || Next == Orig)
+      break;
+    Orig = Next;
+  }
+  if (Orig != &F)
+    return Orig->getName().str();
+  /* the original function may have been removed after cloning; the
+   * suffixes of the clones start with a dot, which is not in the names of
+   * the C and C++ functions */
+  return F.getName().split('.').first.str();
+}
+
+std::vector<std::string> collectTimingRegions(const Module &M) {
+  std::set<std::string> Names;
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    bool IsRegion = MetadataManager::isStartingPoint(F);
+    for (const Instruction &I : instructions(F)) {
+      if (IsRegion)
+        break;
+      IsRegion = MetadataManager::retrieveTargetMetadata(I).hasValue();
+    }
+    if (IsRegion)
+      Names.insert(getRegionName(F));
+  }
+  return std::vector<std::string>(Names.begin(), Names.end());
+}
+
+namespace {
+
+enum class CycleCounter {
+  /* llvm.readcyclecounter, rdtsc on x86 */
+  Generic,
+  /* the virtual counter of the ARMv8-A generic timer, readable at EL0 */
+  AArch64Virtual,
+  /* the 32 bit cycle counter of the ARMv7-M and ARMv8-M debug unit */
+  CortexMDWT
+};
+
+CycleCounter getCycleCounter(const Triple &T) {
+  if (T.isAArch64())
+    return CycleCounter::AArch64Virtual;
+  if (T.getArch() == Triple::arm || T.getArch() == Triple::thumb) {
+    switch (T.getSubArch()) {
+    case Triple::ARMSubArch_v7m:
+    case Triple::ARMSubArch_v7em:
+    case Triple::ARMSubArch_v8m_mainline:
+    case Triple::ARMSubArch_v8_1m_mainline:
+      return CycleCounter::CortexMDWT;
+    default:
+      break;
+    }
+  }
+  return CycleCounter::Generic;
+}
+
+class RegionInstrumenter {
+public:
+  RegionInstrumenter(Module &M, unsigned NumRegions)
+      : M(M), C(M.getContext()), Counter(getCycleCounter(Triple(M.getTargetTriple()))) {
+    Type *I64 = Type::getInt64Ty(C);
+    Type *I32 = Type::getInt32Ty(C);
+    ArrayType *CountsTy = ArrayType::get(I64, NumRegions);
+    ArrayType *DepthsTy = ArrayType::get(I32, NumRegions);
+    Calls = new GlobalVariable(M, CountsTy, false, GlobalValue::InternalLinkage,
+                               ConstantAggregateZero::get(CountsTy), "__taffo_region_calls");
+    Cycles = new GlobalVariable(M, CountsTy, false, GlobalValue::InternalLinkage,
+                                ConstantAggregateZero::get(CountsTy), "__taffo_region_cycles");
+    Depths = new GlobalVariable(M, DepthsTy, false, GlobalValue::InternalLinkage,
+                                ConstantAggregateZero::get(DepthsTy), "__taffo_region_depth");
+  }
+
+  void instrument(Function &F, unsigned Region);
+  void createDumpFunction(ArrayRef<std::string> Regions);
+
+private:
+  Value *readCounter(IRBuilder<> &B);
+  Value *counterAddress(IRBuilder<> &B, uint64_t Address);
+  void add(IRBuilder<> &B, GlobalVariable *GV, unsigned Region, Value *V);
+
+  Module &M;
+  LLVMContext &C;
+  CycleCounter Counter;
+  GlobalVariable *Calls;
+  GlobalVariable *Cycles;
+  GlobalVariable *Depths;
+};
+
+Value *RegionInstrumenter::counterAddress(IRBuilder<> &B, uint64_t Address) {
+  Type *IntPtrTy = M.getDataLayout().getIntPtrType(C);
+  return B.CreateIntToPtr(ConstantInt::get(IntPtrTy, Address), Type::getInt32PtrTy(C));
+}
+
+Value *RegionInstrumenter::readCounter(IRBuilder<> &B) {
+  Type *I64 = Type::getInt64Ty(C);
+  switch (Counter) {
+  case CycleCounter::AArch64Virtual: {
+#if LLVM_VERSION_MAJOR >= 11
+    Function *Read = Intrinsic::getDeclaration(&M, Intrinsic::read_volatile_register, {I64});
+#else
+    Function *Read = Intrinsic::getDeclaration(&M, Intrinsic::read_register, {I64});
+#endif
+    MDNode *Reg = MDNode::get(C, MDString::get(C, "cntvct_el0"));
+    return B.CreateCall(Read, {MetadataAsValue::get(C, Reg)});
+  }
+  case CycleCounter::CortexMDWT:
+    return B.CreateLoad(Type::getInt32Ty(C), counterAddress(B, DWT_CYCCNT), true);
+  case CycleCounter::Generic:
+    break;
+  }
+  return B.CreateCall(Intrinsic::getDeclaration(&M, Intrinsic::readcyclecounter));
+}
+
+void RegionInstrumenter::add(IRBuilder<> &B, GlobalVariable *GV, unsigned Region, Value *V) {
+  Value *Ptr = B.CreateConstInBoundsGEP2_64(GV->getValueType(), GV, 0, Region);
+  B.CreateStore(B.CreateAdd(B.CreateLoad(V->getType(), Ptr), V), Ptr);
+}
+
+void RegionInstrumenter::instrument(Function &F, unsigned Region) {
+  Type *I32 = Type::getInt32Ty(C);
+  Type *I64 = Type::getInt64Ty(C);
+
+  /* after the allocas, which stay at the beginning of the entry block */
+  BasicBlock::iterator Entry = F.getEntryBlock().getFirstInsertionPt();
+  while (isa<AllocaInst>(&*Entry))
+    ++Entry;
+  IRBuilder<> B(&*Entry);
+  add(B, Calls, Region, ConstantInt::get(I64, 1));
+  add(B, Depths, Region, ConstantInt::get(I32, 1));
+  Value *Start = readCounter(B);
+
+  SmallVector<ReturnInst *, 4> Returns;
+  for (BasicBlock &BB : F) {
+    if (auto *Ret = dyn_cast<ReturnInst>(BB.getTerminator()))
+      Returns.push_back(Ret);
+  }
+  for (ReturnInst *Ret : Returns) {
+    B.SetInsertPoint(Ret);
+    Value *End = readCounter(B);
+    Value *DepthPtr = B.CreateConstInBoundsGEP2_64(Depths->getValueType(), Depths, 0, Region);
+    Value *Depth = B.CreateSub(B.CreateLoad(I32, DepthPtr), ConstantInt::get(I32, 1));
+    B.CreateStore(Depth, DepthPtr);
+    /* the counter may wrap around between the two readings */
+    Value *Elapsed = B.CreateZExt(B.CreateSub(End, Start), I64);
+    add(B, Cycles, Region, B.CreateSelect(B.CreateICmpEQ(Depth, ConstantInt::get(I32, 0)),
+                                          Elapsed, ConstantInt::get(I64, 0)));
+  }
+}
+
+void RegionInstrumenter::createDumpFunction(ArrayRef<std::string> Regions) {
+  Type *VoidTy = Type::getVoidTy(C);
+  Type *I32 = Type::getInt32Ty(C);
+  Type *I64 = Type::getInt64Ty(C);
+  PointerType *PtrTy = Type::getInt8PtrTy(C);
+  Triple T(M.getTargetTriple());
+  bool Hosted = T.getOS() != Triple::UnknownOS;
+
+  Function *Dump = Function::Create(FunctionType::get(VoidTy, false), GlobalValue::InternalLinkage,
+                                    "__taffo_region_dump", &M);
+  BasicBlock *EntryBB = BasicBlock::Create(C, "entry", Dump);
+  IRBuilder<> B(EntryBB);
+
+  /* without an operating system there is no file to write to */
+  Value *File = nullptr;
+  FunctionCallee Print;
+  BasicBlock *ExitBB = nullptr;
+  if (Hosted) {
+    FunctionCallee GetEnvF = M.getOrInsertFunction("getenv", PtrTy, PtrTy);
+    FunctionCallee FOpenF = M.getOrInsertFunction("fopen", PtrTy, PtrTy, PtrTy);
+    Print = M.getOrInsertFunction("fprintf", FunctionType::get(I32, {PtrTy, PtrTy}, true));
+    Value *EnvName = B.CreateCall(GetEnvF, {B.CreateGlobalStringPtr(REGION_PROFILE_ENV)});
+    Value *FileName = B.CreateSelect(B.CreateIsNull(EnvName), B.CreateGlobalStringPtr(REGION_PROFILE_DEFAULT),
+                                     EnvName);
+    File = B.CreateCall(FOpenF, {FileName, B.CreateGlobalStringPtr("w")});
+    BasicBlock *WriteBB = BasicBlock::Create(C, "write", Dump);
+    ExitBB = BasicBlock::Create(C, "exit", Dump);
+    B.CreateCondBr(B.CreateIsNull(File), ExitBB, WriteBB);
+    B.SetInsertPoint(WriteBB);
+  } else {
+    Print = M.getOrInsertFunction("printf", FunctionType::get(I32, {PtrTy}, true));
+  }
+  auto Printf = [&](ArrayRef<Value *> Args) {
+    SmallVector<Value *, 4> AllArgs;
+    if (File)
+      AllArgs.push_back(File);
+    AllArgs.append(Args.begin(), Args.end());
+    B.CreateCall(Print, AllArgs);
+  };
+
+  Printf({B.CreateGlobalStringPtr(REGION_PROFILE_HEADER " %llu\n"), ConstantInt::get(I64, Regions.size())});
+  Value *Format = B.CreateGlobalStringPtr("%s %llu %llu\n");
+  for (unsigned I = 0; I < Regions.size(); I++) {
+    Value *Count = B.CreateLoad(I64, B.CreateConstInBoundsGEP2_64(Calls->getValueType(), Calls, 0, I));
+    Value *Cycle = B.CreateLoad(I64, B.CreateConstInBoundsGEP2_64(Cycles->getValueType(), Cycles, 0, I));
+    Printf({Format, B.CreateGlobalStringPtr(Regions[I]), Count, Cycle});
+  }
+  if (Hosted) {
+    FunctionCallee FCloseF = M.getOrInsertFunction("fclose", I32, PtrTy);
+    B.CreateCall(FCloseF, {File});
+    B.CreateBr(ExitBB);
+    B.SetInsertPoint(ExitBB);
+  }
+  B.CreateRetVoid();
+
+  /* the dump function is registered with atexit by a constructor, so that
+   * it also runs when the program calls exit */
+  FunctionCallee AtExitF = M.getOrInsertFunction("atexit", I32, Dump->getType());
+  Function *Init = Function::Create(FunctionType::get(VoidTy, false), GlobalValue::InternalLinkage,
+                                    "__taffo_region_init", &M);
+  B.SetInsertPoint(BasicBlock::Create(C, "entry", Init));
+  if (Counter == CycleCounter::CortexMDWT) {
+    /* enable the trace unit (TRCENA) and its cycle counter (CYCCNTENA) */
+    for (std::pair<uint64_t, uint32_t> Enable : {std::make_pair(DEMCR, 1U << 24), std::make_pair(DWT_CTRL, 1U)}) {
+      Value *Reg = counterAddress(B, Enable.first);
+      Value *V = B.CreateOr(B.CreateLoad(I32, Reg, true), ConstantInt::get(I32, Enable.second));
+      B.CreateStore(V, Reg, true);
+    }
+  }
+  B.CreateCall(AtExitF, {Dump});
+  B.CreateRetVoid();
+  appendToGlobalCtors(M, Init, 0);
+}
+
+}
+
+unsigned instrumentRegionTiming(Module &M, ArrayRef<std::string> Regions) {
+  std::map<std::string, unsigned> RegionIdx;
+  for (const std::string &Name : Regions)
+    RegionIdx.insert({Name, RegionIdx.size()});
+  std::vector<std::pair<Function *, unsigned>> Timed;
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.getName().startswith("__taffo_"))
+      continue;
+    auto It = RegionIdx.find(getRegionName(F));
+    if (It == RegionIdx.end())
+      continue;
+    /* nothing can be inserted between a musttail call and its return */
+    bool MustTail = false;
+    for (Instruction &I : instructions(F)) {
+      auto *Call = dyn_cast<CallInst>(&I);
+      MustTail |= Call && Call->isMustTailCall();
+    }
+    if (!MustTail)
+      Timed.push_back({&F, It->second});
+  }
+  if (Timed.empty())
+    return 0;
+
+  std::vector<std::string> Names(RegionIdx.size());
+  for (auto &Region : RegionIdx)
+    Names[Region.second] = Region.first;
+  RegionInstrumenter RI(M, Names.size());
+  for (auto &F : Timed)
+    RI.instrument(*F.first, F.second);
+  RI.createDumpFunction(Names);
+  NumTimedFunctions += Timed.size();
+  return Timed.size();
+}
+
+}
@@ -0,0 +1,62 @@
+//===-- RegionTiming.h - Cycle Counters for the TAFFO Regions ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Instrumentation of the functions marked by TAFFO with cycle counters,
+/// to attribute the speedups of the converted code to the kernels.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_REGION_TIMING_H
+#define TAFFOUTILS_REGION_TIMING_H
+
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+/// Environment variable with the path of the profile written by an
+/// instrumented program, and path used when it is not set.
+#define REGION_PROFILE_ENV "TAFFO_REGION_PROFILE"
+#define REGION_PROFILE_DEFAULT "regions.prof"
+
+namespace taffo {
+
+/// The name of the region of F, which is the same in the floating point
+/// and in the converted module: the name of the function F was cloned
+/// from, as recorded by taffo.originalCall or taffo.sourceFunction, or
+/// the name of F up to the suffix added to the clones.
+std::string getRegionName(const llvm::Function &F);
+
+/// The names of the regions of M, sorted: the functions marked as
+/// starting points (taffo.start) and the functions with an instruction
+/// marked as a target (taffo.target).
+std::vector<std::string> collectTimingRegions(const llvm::Module &M);
+
+/// Count the calls to the functions whose region is in Regions and the
+/// cycles spent in them, with the cycle counter of the target of M:
+/// rdtsc on x86, cntvct_el0 on AArch64, DWT_CYCCNT on Cortex-M (enabled
+/// by a constructor), llvm.readcyclecounter otherwise. The clones of a
+/// function share its counters. The cycles of the recursive calls are
+/// counted once in the outermost call; a function left by unwinding is
+/// counted but its cycles are not. The counters are not updated
+/// atomically.
+///
+/// At exit the counters are written to the file named by
+/// REGION_PROFILE_ENV, or to REGION_PROFILE_DEFAULT, as a
+/// "taffo-region-profile <number of regions>" line followed by a
+/// "<region> <calls> <cycles>" line for each region; without an operating
+/// system they are printed on the standard output. Returns the number of
+/// functions instrumented.
+unsigned instrumentRegionTiming(llvm::Module &M, llvm::ArrayRef<std::string> Regions);
+
+}
+
+#endif
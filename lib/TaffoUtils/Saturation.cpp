@@ -0,0 +1,222 @@
+//===-- Saturation.cpp - Saturating Fixed Point Arithmetic ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Lowering of the fixed point operations of the converted code to
+/// saturating arithmetic.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Saturation.h"
+
+#include <cmath>
+#include <vector>
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "InputInfo.h"
+#include "Metadata.h"
+#include "OverflowChecks.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-saturation"
+
+ALWAYS_ENABLED_STATISTIC(NumSaturating, "Number of operations made saturating");
+ALWAYS_ENABLED_STATISTIC(NumFixedMuls, "Number of multiplications lowered to mul.fix.sat");
+
+namespace taffo {
+
+static const FPType *getFixedPointType(const Instruction &I) {
+  const InputInfo *II = MetadataManager::getMetadataManager().retrieveInputInfo(I);
+  if (!II || !II->IType)
+    return nullptr;
+  return dyn_cast<FPType>(II->IType.get());
+}
+
+bool parseSaturationMode(StringRef Text, SaturationMode &Mode) {
+  if (Text == "all")
+    Mode = SaturationMode::All;
+  else if (Text == "targets")
+    Mode = SaturationMode::Targets;
+  else if (Text == "edge")
+    Mode = SaturationMode::Edge;
+  else
+    return false;
+  return true;
+}
+
+bool isNearTypeBounds(const Instruction &I) {
+  const InputInfo *II = MetadataManager::getMetadataManager().retrieveInputInfo(I);
+  const FPType *FPT = getFixedPointType(I);
+  if (!FPT)
+    return false;
+  if (!II->IRange)
+    return true;
+  double Bound = std::max(std::abs(FPT->getMinValueBound()), FPT->getMaxValueBound());
+  return std::max(std::abs(II->IRange->Min), std::abs(II->IRange->Max)) > Bound / 2.0;
+}
+
+/* Replaces I with New, which takes its name and its metadata */
+static void replaceWith(Instruction &I, Instruction *New) {
+  New->copyMetadata(I);
+  New->takeName(&I);
+  I.replaceAllUsesWith(New);
+  I.eraseFromParent();
+}
+
+/* V as a value of type Ty, if it is an extension from Ty or a constant
+ * which fits in it */
+static Value *getNarrowOperand(Value *V, Type *Ty, bool Signed) {
+  if (auto *Ext = dyn_cast<CastInst>(V)) {
+    if (Ext->getOpcode() == (Signed ? Instruction::SExt : Instruction::ZExt) && Ext->getSrcTy() == Ty)
+      return Ext->getOperand(0);
+    return nullptr;
+  }
+  if (auto *C = dyn_cast<ConstantInt>(V)) {
+    unsigned Width = Ty->getIntegerBitWidth();
+    if (Signed ? C->getValue().isSignedIntN(Width) : C->getValue().isIntN(Width))
+      return ConstantInt::get(Ty, C->getValue().trunc(Width));
+  }
+  return nullptr;
+}
+
+/* Lowers trunc((ext a * ext b) >> S) to mul.fix.sat(a, b, S), erasing the
+ * instructions which are not used anymore; returns false if T does not
+ * truncate a fixed point product */
+static bool lowerFixedMul(TruncInst &T, bool Signed, SmallPtrSetImpl<Instruction *> &Erased) {
+  auto *Shift = dyn_cast<BinaryOperator>(T.getOperand(0));
+  if (!Shift || Shift->getOpcode() != (Signed ? Instruction::AShr : Instruction::LShr) || !Shift->hasOneUse())
+    return false;
+  auto *Scale = dyn_cast<ConstantInt>(Shift->getOperand(1));
+  auto *Mul = dyn_cast<BinaryOperator>(Shift->getOperand(0));
+  if (!Scale || !Mul || Mul->getOpcode() != Instruction::Mul || !Mul->hasOneUse())
+    return false;
+  Type *Ty = T.getType();
+  if (Scale->getZExtValue() >= Ty->getIntegerBitWidth())
+    return false;
+  Value *A = getNarrowOperand(Mul->getOperand(0), Ty, Signed);
+  Value *B = getNarrowOperand(Mul->getOperand(1), Ty, Signed);
+  if (!A || !B)
+    return false;
+
+  IRBuilder<> Builder(&T);
+  Function *MulFix = Intrinsic::getDeclaration(T.getModule(), Signed ? Intrinsic::smul_fix_sat : Intrinsic::umul_fix_sat,
+                                               {Ty});
+  CallInst *Res = Builder.CreateCall(MulFix, {A, B, Builder.getInt32(Scale->getZExtValue())});
+  replaceWith(T, Res);
+  Shift->eraseFromParent();
+  SmallVector<Instruction *, 2> Exts;
+  for (Value *Op : Mul->operands()) {
+    auto *I = dyn_cast<Instruction>(Op);
+    if (I && !is_contained(Exts, I))
+      Exts.push_back(I);
+  }
+  Mul->eraseFromParent();
+  for (Instruction *Ext : Exts) {
+    if (Ext->use_empty()) {
+      Erased.insert(Ext);
+      Ext->eraseFromParent();
+    }
+  }
+  Erased.insert(Shift);
+  Erased.insert(Mul);
+  NumFixedMuls++;
+  return true;
+}
+
+/* Makes I saturate to the bounds of its type; returns false if it cannot */
+static bool saturate(Instruction &I, bool Signed) {
+  IRBuilder<> B(&I);
+  Module *M = I.getModule();
+  Type *Ty = I.getType();
+  auto Binary = [&](Intrinsic::ID SignedID, Intrinsic::ID UnsignedID) {
+    Function *Sat = Intrinsic::getDeclaration(M, Signed ? SignedID : UnsignedID, {Ty});
+    replaceWith(I, B.CreateCall(Sat, {I.getOperand(0), I.getOperand(1)}));
+    return true;
+  };
+  switch (I.getOpcode()) {
+  case Instruction::Add:
+    return Binary(Intrinsic::sadd_sat, Intrinsic::uadd_sat);
+  case Instruction::Sub:
+    return Binary(Intrinsic::ssub_sat, Intrinsic::usub_sat);
+  case Instruction::Mul: {
+    Function *Sat = Intrinsic::getDeclaration(M, Signed ? Intrinsic::smul_fix_sat : Intrinsic::umul_fix_sat, {Ty});
+    replaceWith(I, B.CreateCall(Sat, {I.getOperand(0), I.getOperand(1), B.getInt32(0)}));
+    return true;
+  }
+  case Instruction::Shl:
+#if LLVM_VERSION_MAJOR >= 11
+    return Binary(Intrinsic::sshl_sat, Intrinsic::ushl_sat);
+#else
+    return false;
+#endif
+  case Instruction::Trunc: {
+    /* clamp the wide value to the bounds of the narrow type */
+    Value *X = I.getOperand(0);
+    unsigned Narrow = Ty->getIntegerBitWidth();
+    unsigned Wide = X->getType()->getIntegerBitWidth();
+    APInt Max = Signed ? APInt::getSignedMaxValue(Narrow).sext(Wide) : APInt::getMaxValue(Narrow).zext(Wide);
+    Constant *Hi = ConstantInt::get(X->getType(), Max);
+    X = B.CreateSelect(Signed ? B.CreateICmpSGT(X, Hi) : B.CreateICmpUGT(X, Hi), Hi, X);
+    if (Signed) {
+      Constant *Lo = ConstantInt::get(X->getType(), APInt::getSignedMinValue(Narrow).sext(Wide));
+      X = B.CreateSelect(B.CreateICmpSLT(X, Lo), Lo, X);
+    }
+    I.setOperand(0, X);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+unsigned lowerToSaturatingArith(Module &M, SaturationMode Mode) {
+  unsigned Count = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    std::vector<Instruction *> Ops;
+    for (Instruction *I : collectMayOverflow(F, Mode == SaturationMode::Targets)) {
+      if (Mode != SaturationMode::Edge || isNearTypeBounds(*I))
+        Ops.push_back(I);
+    }
+
+    /* the truncations absorb the products they truncate, which are not
+     * lowered on their own afterwards */
+    SmallPtrSet<Instruction *, 16> Erased;
+    std::vector<Instruction *> Rest;
+    for (Instruction *I : Ops) {
+      if (Erased.count(I))
+        continue;
+      auto *T = dyn_cast<TruncInst>(I);
+      if (T && lowerFixedMul(*T, getFixedPointType(*T)->isSigned(), Erased)) {
+        Erased.insert(T);
+        Count++;
+      } else {
+        Rest.push_back(I);
+      }
+    }
+    for (Instruction *I : Rest) {
+      if (!Erased.count(I) && saturate(*I, getFixedPointType(*I)->isSigned()))
+        Count++;
+    }
+  }
+  NumSaturating += Count;
+  return Count;
+}
+
+}
@@ -0,0 +1,57 @@
+//===-- Saturation.h - Saturating Fixed Point Arithmetic --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Lowering of the fixed point operations of the converted code to
+/// saturating arithmetic.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_SATURATION_H
+#define TAFFOUTILS_SATURATION_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// The operations which saturate.
+enum class SaturationMode {
+  /// All the operations which may overflow.
+  All,
+  /// The targets and the values stored to the targets.
+  Targets,
+  /// The operations whose range reaches the outer half of the range of
+  /// their type, or which have no range.
+  Edge
+};
+
+/// Parse a mode: "all", "targets" or "edge".
+bool parseSaturationMode(llvm::StringRef Text, SaturationMode &Mode);
+
+/// Whether the range in the taffo.info of I reaches the outer half of the
+/// values of its fixed point type.
+bool isNearTypeBounds(const llvm::Instruction &I);
+
+/// Make the fixed point operations of the converted code selected by Mode
+/// saturate to the bounds of their type instead of wrapping around. The
+/// additions and subtractions become llvm.[su]add.sat and
+/// llvm.[su]sub.sat; the multiplications computed on the extended
+/// operands, shifted right and truncated to the type of the operands
+/// become llvm.[su]mul.fix.sat, and the other multiplications saturate
+/// in their type. The left shifts become llvm.[su]shl.sat (LLVM 11 and
+/// later), and the other truncations clamp the value to the bounds of the
+/// narrow type. The new operations keep the metadata of the ones they
+/// replace. Returns the number of operations made saturating.
+unsigned lowerToSaturatingArith(llvm::Module &M, SaturationMode Mode);
+
+}
+
+#endif
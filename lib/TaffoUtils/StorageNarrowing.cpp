@@ -0,0 +1,177 @@
+//===-- StorageNarrowing.cpp - Narrow Storage of Fixed Point Data -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Storage of the arrays, globals and structure fields in narrower types.
+///
+//===----------------------------------------------------------------------===//
+
+#include "StorageNarrowing.h"
+
+#include <algorithm>
+#include <cmath>
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-narrow-storage"
+
+ALWAYS_ENABLED_STATISTIC(NumNarrowedStorage, "Number of allocations and globals stored in a narrower type");
+
+namespace taffo {
+
+bool parseStorageFormat(StringRef Text, StorageFormat &Format) {
+  if (Text == "half") {
+    Format.Width = 0;
+    Format.Float = FloatType::Float_half;
+    return true;
+  }
+  if (Text == "bfloat16") {
+    Format.Width = 0;
+    Format.Float = FloatType::Float_bfloat;
+    return true;
+  }
+  unsigned Width;
+  if (Text.getAsInteger(10, Width) || (Width != 8 && Width != 16 && Width != 32))
+    return false;
+  Format.Width = Width;
+  return true;
+}
+
+std::shared_ptr<TType> getNarrowStorageType(const TType &T, const StorageFormat &Format) {
+  const FPType *FT = dyn_cast<FPType>(&T);
+  if (!FT)
+    return nullptr;
+  if (Format.Width) {
+    int IntBits = (int)FT->getWidth() - (int)FT->getPointPos();
+    int PointPos = (int)Format.Width - IntBits;
+    if (FT->getWidth() <= Format.Width || PointPos < 0)
+      return nullptr;
+    int Width = FT->isSigned() ? -(int)Format.Width : (int)Format.Width;
+    return std::make_shared<FPType>(Width, (unsigned)PointPos);
+  }
+  auto Res = std::make_shared<FloatType>(Format.Float);
+  double Mag = std::max(std::abs(FT->getMinValueBound()), FT->getMaxValueBound());
+  if (FT->getWidth() <= Res->getWidth() || Mag > Res->getMaxValueBound())
+    return nullptr;
+  return Res;
+}
+
+/* Narrows the types in Info in place; returns whether any has changed */
+static bool narrowInfo(MDInfo *Info, const StorageFormat &Format,
+                       SmallPtrSetImpl<StructInfo *> &Visited) {
+  if (!Info)
+    return false;
+  if (InputInfo *II = dyn_cast<InputInfo>(Info)) {
+    if (!II->IEnableConversion || !II->IType)
+      return false;
+    std::shared_ptr<TType> T = getNarrowStorageType(*II->IType, Format);
+    if (!T)
+      return false;
+    II->IType = T;
+    return true;
+  }
+  StructInfo *SI = cast<StructInfo>(Info);
+  if (!Visited.insert(SI).second)
+    return false;
+  bool Changed = false;
+  for (unsigned I = 0; I < SI->size(); I++) {
+    std::shared_ptr<MDInfo> Field = SI->getField(I);
+    Changed |= narrowInfo(Field.get(), Format, Visited);
+  }
+  return Changed;
+}
+
+/* Narrows the types in the metadata of V; returns whether any has changed */
+static bool narrowMetadata(Value *V, const StorageFormat &Format) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  MDInfo *Info = MM.retrieveMDInfo(V);
+  if (!Info)
+    return false;
+  std::unique_ptr<MDInfo> New(Info->clone());
+  SmallPtrSet<StructInfo *, 4> Visited;
+  if (!narrowInfo(New.get(), Format, Visited))
+    return false;
+  MetadataManager::setMDInfoMetadata(V, New.get());
+  return true;
+}
+
+bool collectDerivedPointers(Value *Base, SmallVectorImpl<Instruction *> &Derived) {
+  SmallVector<Value *, 8> Work = {Base};
+  SmallPtrSet<Value *, 16> Seen = {Base};
+  while (!Work.empty()) {
+    Value *V = Work.pop_back_val();
+    for (User *U : V->users()) {
+      if (isa<LoadInst>(U) || isa<CmpInst>(U))
+        continue;
+      if (auto *SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getValueOperand() == V)
+          return false;
+        continue;
+      }
+      if (auto *II = dyn_cast<IntrinsicInst>(U)) {
+        if (isa<DbgInfoIntrinsic>(II) || II->getIntrinsicID() == Intrinsic::lifetime_start ||
+            II->getIntrinsicID() == Intrinsic::lifetime_end)
+          continue;
+        return false;
+      }
+      auto *GEP = dyn_cast<GEPOperator>(U);
+      if (!GEP || GEP->getPointerOperand() != V)
+        return false;
+      if (Seen.insert(U).second) {
+        Work.push_back(U);
+        if (auto *I = dyn_cast<Instruction>(U))
+          Derived.push_back(I);
+      }
+    }
+  }
+  return true;
+}
+
+static bool narrowAllocation(Value *Base, const StorageFormat &Format) {
+  SmallVector<Instruction *, 16> Derived;
+  if (!collectDerivedPointers(Base, Derived))
+    return false;
+  if (!narrowMetadata(Base, Format))
+    return false;
+  for (Instruction *I : Derived)
+    narrowMetadata(I, Format);
+  return true;
+}
+
+unsigned narrowStorageTypes(Module &M, const StorageFormat &Format) {
+  unsigned Narrowed = 0;
+  for (GlobalVariable &GV : M.globals()) {
+    if (!GV.isDeclaration() && narrowAllocation(&GV, Format))
+      Narrowed++;
+  }
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      auto *AI = dyn_cast<AllocaInst>(&I);
+      if (!AI)
+        continue;
+      Type *Ty = AI->getAllocatedType();
+      if ((Ty->isArrayTy() || Ty->isStructTy()) && narrowAllocation(AI, Format))
+        Narrowed++;
+    }
+  }
+  NumNarrowedStorage += Narrowed;
+  return Narrowed;
+}
+
+}
@@ -0,0 +1,63 @@
+//===-- StorageNarrowing.h - Narrow Storage of Fixed Point Data -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Storage of the arrays, globals and structure fields in memory in a type
+/// narrower than the one of the computations on their elements.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_STORAGE_NARROWING_H
+#define TAFFOUTILS_STORAGE_NARROWING_H
+
+#include <memory>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// The format of the narrowed storage: fixed point values of Width bits,
+/// or values of the floating point format Float when Width is 0.
+struct StorageFormat {
+  unsigned Width = 16;
+  mdutils::FloatType::FloatStandard Float = mdutils::FloatType::Float_half;
+};
+
+/// Parse a format: a width of 8, 16 or 32 bits, "half" or "bfloat16".
+bool parseStorageFormat(llvm::StringRef Text, StorageFormat &Format);
+
+/// The type in which the values of type T are stored in Format: the fixed
+/// point type of the width of Format with the integer bits of T, or the
+/// floating point type of Format. Returns nullptr if T is not a fixed
+/// point type wider than Format, or if Format cannot hold its values.
+std::shared_ptr<mdutils::TType> getNarrowStorageType(const mdutils::TType &T,
+                                                     const StorageFormat &Format);
+
+/// Collect in Derived the pointers to the elements of Base computed by the
+/// instructions (GEPs, and GEPs of GEPs); returns false if the address of
+/// Base escapes through calls or stores of pointers, or is used otherwise
+/// than by loads, stores, comparisons and the lifetime intrinsics.
+bool collectDerivedPointers(llvm::Value *Base, llvm::SmallVectorImpl<llvm::Instruction *> &Derived);
+
+/// Give the arrays and structures allocated on the stack, the globals and
+/// the pointers to their elements the storage types of Format, in their
+/// taffo.info and taffo.structinfo. The loads, and the other values
+/// computed from the stored ones, keep their types, so that the Conversion
+/// widens the loaded values and narrows the stored ones; the converted
+/// structures only take the space of their narrowed fields. The memory
+/// whose address escapes through calls, returns, casts or stores of
+/// pointers is not narrowed, since it is accessed with the original types
+/// elsewhere. Returns the number of allocations narrowed.
+unsigned narrowStorageTypes(llvm::Module &M, const StorageFormat &Format);
+
+}
+
+#endif
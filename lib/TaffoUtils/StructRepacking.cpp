@@ -0,0 +1,340 @@
+//===-- StructRepacking.cpp - Field Reordering of Structures ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Reordering of the fields of the structures of the converted code, to
+/// remove the padding between the fields whose types were changed.
+///
+//===----------------------------------------------------------------------===//
+
+#include "StructRepacking.h"
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include "InputInfo.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-repack"
+
+ALWAYS_ENABLED_STATISTIC(NumRepackedStructs, "Number of structures with reordered fields");
+ALWAYS_ENABLED_STATISTIC(NumRepackedBytes, "Bytes of padding removed from the repacked structures");
+
+namespace taffo {
+
+SmallVector<unsigned, 8> getRepackedFieldOrder(StructType *T, const DataLayout &DL) {
+  SmallVector<unsigned, 8> Order(T->getNumElements());
+  std::iota(Order.begin(), Order.end(), 0);
+  std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+    return DL.getABITypeAlignment(T->getElementType(A)) > DL.getABITypeAlignment(T->getElementType(B));
+  });
+
+  uint64_t Size = 0;
+  uint64_t MaxAlign = 1;
+  for (unsigned I : Order) {
+    Type *Ty = T->getElementType(I);
+    uint64_t Align = DL.getABITypeAlignment(Ty);
+    Size = alignTo(Size, Align) + DL.getTypeAllocSize(Ty);
+    MaxAlign = std::max(MaxAlign, Align);
+  }
+  if (alignTo(Size, MaxAlign) >= DL.getTypeAllocSize(T))
+    return {};
+  return Order;
+}
+
+namespace {
+
+/* Whether Ty contains one of Targets: inside its aggregates if Inline,
+ * and also behind its pointers otherwise */
+bool containsType(Type *Ty, const SmallPtrSetImpl<StructType *> &Targets, bool Inline,
+                  SmallPtrSetImpl<Type *> &Visited) {
+  if (auto *ST = dyn_cast<StructType>(Ty)) {
+    if (Targets.count(ST))
+      return true;
+    if (!ST->isLiteral() && !Visited.insert(ST).second)
+      return false;
+  }
+  if (Ty->isPointerTy())
+    return !Inline && containsType(Ty->getPointerElementType(), Targets, Inline, Visited);
+  for (Type *Sub : Ty->subtypes())
+    if (containsType(Sub, Targets, Inline, Visited))
+      return true;
+  return false;
+}
+
+bool containsType(Type *Ty, const SmallPtrSetImpl<StructType *> &Targets, bool Inline = false) {
+  SmallPtrSet<Type *, 8> Visited;
+  return containsType(Ty, Targets, Inline, Visited);
+}
+
+/* Whether the type of I, of an operand, or the type it allocates or
+ * indexes mentions one of Targets */
+bool mentionsType(Instruction &I, const SmallPtrSetImpl<StructType *> &Targets) {
+  if (containsType(I.getType(), Targets))
+    return true;
+  for (Value *Op : I.operands())
+    if (containsType(Op->getType(), Targets))
+      return true;
+  if (auto *AI = dyn_cast<AllocaInst>(&I))
+    return containsType(AI->getAllocatedType(), Targets);
+  if (auto *GEP = dyn_cast<GetElementPtrInst>(&I))
+    return containsType(GEP->getSourceElementType(), Targets);
+  return false;
+}
+
+bool isCallTo(Value *V, ArrayRef<StringRef> Names) {
+  auto *Call = dyn_cast<CallInst>(V);
+  Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+  return Callee && is_contained(Names, Callee->getName());
+}
+
+/* The pointers to the values of the structures may come from malloc and
+ * calloc, whose memory has no layout yet, and go to free and to the
+ * lifetime intrinsics, which do not look at it */
+bool isLocalCast(BitCastInst &BC, const SmallPtrSetImpl<StructType *> &Targets) {
+  bool FromStruct = containsType(BC.getSrcTy(), Targets);
+  bool ToStruct = containsType(BC.getDestTy(), Targets);
+  if (FromStruct && ToStruct)
+    return true;
+  if (ToStruct) {
+    Value *Src = BC.getOperand(0);
+    if (!isCallTo(Src, {"malloc", "calloc"}))
+      return false;
+    return all_of(Src->users(), [&](User *U) {
+      auto *Other = dyn_cast<BitCastInst>(U);
+      return Other && containsType(Other->getDestTy(), Targets);
+    });
+  }
+  return all_of(BC.users(), [](User *U) {
+    if (auto *II = dyn_cast<IntrinsicInst>(U))
+      return II->getIntrinsicID() == Intrinsic::lifetime_start || II->getIntrinsicID() == Intrinsic::lifetime_end;
+    return isCallTo(U, {"free"});
+  });
+}
+
+bool isLocalUse(Instruction &I, const SmallPtrSetImpl<StructType *> &Targets) {
+  /* no whole values of the structures, which may be copied or built with
+   * any layout, and no vectors of pointers */
+  if (containsType(I.getType(), Targets, true) || I.getType()->isVectorTy())
+    return false;
+  for (Value *Op : I.operands()) {
+    if (!containsType(Op->getType(), Targets))
+      continue;
+    if (containsType(Op->getType(), Targets, true) || Op->getType()->isVectorTy())
+      return false;
+    if (isa<Constant>(Op) && !isa<ConstantPointerNull>(Op) && !isa<UndefValue>(Op))
+      return false;
+  }
+  switch (I.getOpcode()) {
+  case Instruction::Alloca:
+  case Instruction::GetElementPtr:
+  case Instruction::Load:
+  case Instruction::Store:
+  case Instruction::PHI:
+  case Instruction::Select:
+  case Instruction::ICmp:
+  case Instruction::ExtractValue:
+  case Instruction::InsertValue:
+    return true;
+  case Instruction::BitCast:
+    return isLocalCast(cast<BitCastInst>(I), Targets);
+  default:
+    return false;
+  }
+}
+
+/* Maps the types which contain the repacked structures to the types which
+ * contain their replacements */
+class RepackedTypeMapper : public ValueMapTypeRemapper {
+public:
+  RepackedTypeMapper(const DenseMap<StructType *, StructType *> &Structs) : Structs(Structs) {}
+
+  Type *remapType(Type *Ty) override {
+    auto It = Cache.find(Ty);
+    if (It != Cache.end())
+      return It->second;
+    Type *New = Ty;
+    if (auto *ST = dyn_cast<StructType>(Ty)) {
+      auto Repacked = Structs.find(ST);
+      if (Repacked != Structs.end()) {
+        New = Repacked->second;
+      } else if (ST->isLiteral()) {
+        SmallVector<Type *, 8> Elems;
+        for (Type *Elem : ST->elements())
+          Elems.push_back(remapType(Elem));
+        New = StructType::get(Ty->getContext(), Elems, ST->isPacked());
+      }
+    } else if (auto *PT = dyn_cast<PointerType>(Ty)) {
+      New = PointerType::get(remapType(PT->getPointerElementType()), PT->getAddressSpace());
+    } else if (auto *AT = dyn_cast<ArrayType>(Ty)) {
+      New = ArrayType::get(remapType(AT->getElementType()), AT->getNumElements());
+    }
+    Cache[Ty] = New;
+    return New;
+  }
+
+private:
+  const DenseMap<StructType *, StructType *> &Structs;
+  DenseMap<Type *, Type *> Cache;
+};
+
+/* The structure at the bottom of the pointers and arrays of Ty */
+StructType *getUnderlyingStruct(Type *Ty) {
+  while (Ty->isPointerTy() || Ty->isArrayTy())
+    Ty = Ty->isPointerTy() ? Ty->getPointerElementType() : Ty->getArrayElementType();
+  return dyn_cast<StructType>(Ty);
+}
+
+struct Repacking {
+  StructType *New;
+  SmallVector<unsigned, 8> Order;
+  /* the position in New of each field of the original structure */
+  SmallVector<unsigned, 8> NewIndex;
+};
+
+}
+
+bool hasLocalLayout(Module &M, StructType *T) {
+  if (T->isLiteral() || T->isOpaque() || T->isPacked())
+    return false;
+  SmallPtrSet<StructType *, 1> Targets;
+  Targets.insert(T);
+
+  for (StructType *ST : M.getIdentifiedStructTypes()) {
+    if (ST == T || ST->isOpaque())
+      continue;
+    for (Type *Elem : ST->elements())
+      if (containsType(Elem, Targets))
+        return false;
+  }
+  for (GlobalVariable &GV : M.globals())
+    if (containsType(GV.getValueType(), Targets))
+      return false;
+  for (Function &F : M) {
+    if (containsType(F.getFunctionType(), Targets))
+      return false;
+    for (Instruction &I : instructions(F)) {
+      if (!isa<DbgInfoIntrinsic>(&I) && mentionsType(I, Targets) && !isLocalUse(I, Targets))
+        return false;
+    }
+  }
+  return true;
+}
+
+unsigned repackStructTypes(Module &M) {
+#if LLVM_VERSION_MAJOR >= 14
+  if (!M.getContext().supportsTypedPointers())
+    return 0;
+#endif
+  const DataLayout &DL = M.getDataLayout();
+  DenseMap<StructType *, Repacking> Repackings;
+  DenseMap<StructType *, StructType *> NewTypes;
+  SmallPtrSet<StructType *, 8> Targets;
+  for (StructType *T : M.getIdentifiedStructTypes()) {
+    if (T->isOpaque() || T->isPacked())
+      continue;
+    Repacking R;
+    R.Order = getRepackedFieldOrder(T, DL);
+    if (R.Order.empty() || !hasLocalLayout(M, T))
+      continue;
+    R.New = StructType::create(M.getContext(), (T->getName() + ".repacked").str());
+    R.NewIndex.resize(R.Order.size());
+    for (unsigned I = 0; I < R.Order.size(); I++)
+      R.NewIndex[R.Order[I]] = I;
+    NewTypes[T] = R.New;
+    Targets.insert(T);
+    Repackings[T] = std::move(R);
+  }
+  if (Repackings.empty())
+    return 0;
+
+  /* the bodies are set once all the new types exist, since the fields may
+   * point to the other repacked structures */
+  RepackedTypeMapper Mapper(NewTypes);
+  for (auto &Entry : Repackings) {
+    StructType *T = Entry.first;
+    SmallVector<Type *, 8> Elems;
+    for (unsigned I : Entry.second.Order)
+      Elems.push_back(Mapper.remapType(T->getElementType(I)));
+    Entry.second.New->setBody(Elems);
+    NumRepackedBytes += DL.getTypeAllocSize(T) - DL.getTypeAllocSize(Entry.second.New);
+  }
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  for (Function &F : M) {
+    std::vector<Instruction *> Rewritten;
+    std::vector<Instruction *> DebugInfo;
+    for (Instruction &I : instructions(F)) {
+      if (auto *DVI = dyn_cast<DbgVariableIntrinsic>(&I)) {
+        auto *MAV = dyn_cast<MetadataAsValue>(DVI->getArgOperand(0));
+        auto *VAM = MAV ? dyn_cast<ValueAsMetadata>(MAV->getMetadata()) : nullptr;
+        if (VAM && containsType(VAM->getValue()->getType(), Targets))
+          DebugInfo.push_back(DVI);
+      } else if (mentionsType(I, Targets)) {
+        Rewritten.push_back(&I);
+      }
+    }
+    /* the debug information describes the offsets of the original fields */
+    for (Instruction *I : DebugInfo)
+      I->eraseFromParent();
+
+    for (Instruction *I : Rewritten) {
+      /* the indices are found with the original types, and changed
+       * afterwards */
+      if (auto *GEP = dyn_cast<GetElementPtrInst>(I)) {
+        SmallVector<std::pair<unsigned, unsigned>, 4> NewIndices;
+        unsigned OpNo = 1;
+        for (auto GTI = gep_type_begin(GEP), E = gep_type_end(GEP); GTI != E; ++GTI, ++OpNo) {
+          StructType *ST = GTI.getStructTypeOrNull();
+          auto It = ST ? Repackings.find(ST) : Repackings.end();
+          if (It != Repackings.end())
+            NewIndices.push_back(
+                {OpNo, It->second.NewIndex[cast<ConstantInt>(GTI.getOperand())->getZExtValue()]});
+        }
+        for (auto &Index : NewIndices)
+          GEP->setOperand(Index.first, ConstantInt::get(GEP->getOperand(Index.first)->getType(), Index.second));
+      }
+
+      Type *ValueTy = isa<AllocaInst>(I) ? cast<AllocaInst>(I)->getAllocatedType() : I->getType();
+      StructType *ST = getUnderlyingStruct(ValueTy);
+      auto It = ST ? Repackings.find(ST) : Repackings.end();
+      StructInfo *SI = It != Repackings.end() ? MM.retrieveStructInfo(*I) : nullptr;
+      if (SI && SI->size() == It->second.Order.size()) {
+        StructInfo New(SI->size());
+        for (unsigned Field = 0; Field < SI->size(); Field++)
+          New.setField(Field, SI->getField(It->second.Order[Field]));
+        MetadataManager::setStructInfoMetadata(*I, New);
+      }
+    }
+
+    ValueToValueMapTy VM;
+    for (Instruction *I : Rewritten)
+      RemapInstruction(I, VM, RF_NoModuleLevelChanges | RF_IgnoreMissingLocals, &Mapper);
+  }
+
+  NumRepackedStructs += Repackings.size();
+  return Repackings.size();
+}
+
+}
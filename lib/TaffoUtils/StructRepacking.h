@@ -0,0 +1,52 @@
+//===-- StructRepacking.h - Field Reordering of Structures ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Reordering of the fields of the structures of the converted code, to
+/// remove the padding between the fields whose types were changed.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_STRUCT_REPACKING_H
+#define TAFFOUTILS_STRUCT_REPACKING_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
+
+namespace taffo {
+
+/// The order of the fields of T with the least padding: the fields sorted
+/// by decreasing alignment, in their original order when their alignment
+/// is the same. The field at position I of the repacked structure is the
+/// field Order[I] of T. Returns an empty order if it is not smaller than T.
+llvm::SmallVector<unsigned, 8> getRepackedFieldOrder(llvm::StructType *T, const llvm::DataLayout &DL);
+
+/// Whether the layout of T is only known to the code of M: T is a named,
+/// non packed structure, the other types of the globals, of the functions
+/// and of the other named structures do not contain it, and its values
+/// are only accessed through the GEPs of its fields. The pointers to T may
+/// be loaded, stored, compared and selected, may come from malloc and
+/// calloc, and may be passed to free and to the lifetime intrinsics; any
+/// other cast, call or use as a whole value exposes the layout.
+bool hasLocalLayout(llvm::Module &M, llvm::StructType *T);
+
+/// Replace the named structures of M whose layout is local with structures
+/// with the fields in the order of getRepackedFieldOrder, when it is
+/// smaller: the allocations, the GEPs and the taffo.structinfo of their
+/// values are rewritten, and the debug information of the variables of
+/// those types is dropped. Nothing is done on the modules with opaque
+/// pointers, whose casts cannot be tracked through the types. Returns the
+/// number of structures repacked.
+unsigned repackStructTypes(llvm::Module &M);
+
+}
+
+#endif
@@ -0,0 +1,590 @@
+//===-- TargetCostModel.cpp - Cost of Operations on a Target -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Cost model of a target for the choice of the fixed point types.
+///
+//===----------------------------------------------------------------------===//
+
+#include "TargetCostModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "FixedPointArith.h"
+#include "Metadata.h"
+#include "PointPosAssignment.h"
+#include "Trace.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+#define DEBUG_TYPE "taffo-cost-model"
+
+ALWAYS_ENABLED_STATISTIC(NumRevertedToFloat, "Number of values kept in floating point because their conversion is not profitable");
+
+namespace taffo {
+
+static const unsigned CostTypeWidth[TargetCostModel::NumCostTypes] = {8, 16, 32, 64, 32, 64};
+static const char *const CostTypeName[TargetCostModel::NumCostTypes] = {
+  "i8", "i16", "i32", "i64", "float", "double"
+};
+
+TargetCostModel::TargetCostModel(double DefaultCost) {
+  for (unsigned T = 0; T < NumCostTypes; T++) {
+    for (unsigned Op = 0; Op < Instruction::OtherOpsEnd; Op++)
+      Cost[T][Op] = DefaultCost;
+    Lanes[T] = 1;
+  }
+}
+
+TargetCostModel::CostType TargetCostModel::getIntCostType(unsigned Width) {
+  if (Width <= 8)
+    return Int8;
+  if (Width <= 16)
+    return Int16;
+  if (Width <= 32)
+    return Int32;
+  return Int64;
+}
+
+Optional<TargetCostModel::CostType> TargetCostModel::getCostType(const Type *Ty) {
+  Ty = Ty->getScalarType();
+  if (Ty->isIntegerTy())
+    return getIntCostType(Ty->getIntegerBitWidth());
+  if (Ty->isHalfTy() || Ty->isFloatTy())
+    return Float;
+  if (Ty->isDoubleTy())
+    return Double;
+  return None;
+}
+
+StringRef TargetCostModel::getCostTypeName(CostType T) {
+  return CostTypeName[T];
+}
+
+double TargetCostModel::getCost(unsigned Opcode, CostType T, bool InLoop) const {
+  if (InLoop && Instruction::isBinaryOp(Opcode))
+    return Cost[T][Opcode] / Lanes[T];
+  return Cost[T][Opcode];
+}
+
+static bool parseCostType(StringRef Name, TargetCostModel::CostType &T) {
+  for (unsigned I = 0; I < TargetCostModel::NumCostTypes; I++) {
+    if (Name == CostTypeName[I]) {
+      T = (TargetCostModel::CostType)I;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TargetCostModel::parse(StringRef Text, std::string &Error) {
+  SmallVector<StringRef, 64> Lines;
+  Text.split(Lines, '\n');
+  for (unsigned L = 0; L < Lines.size(); L++) {
+    StringRef Line = Lines[L].trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+    std::string Where = "line " + std::to_string(L + 1) + ": ";
+    SmallVector<StringRef, 3> Fields;
+    Line.split(Fields, ' ', -1, false);
+
+    CostType T;
+    if (Fields[0] == "lanes") {
+      unsigned N;
+      if (Fields.size() != 3 || !parseCostType(Fields[1], T) ||
+          Fields[2].getAsInteger(10, N) || N == 0) {
+        Error = Where + "expected \"lanes <type> <count>\"";
+        return false;
+      }
+      Lanes[T] = N;
+      continue;
+    }
+
+    unsigned Opcode = 0;
+    for (unsigned Op = 1; Op < Instruction::OtherOpsEnd && !Opcode; Op++) {
+      if (Fields[0] == Instruction::getOpcodeName(Op))
+        Opcode = Op;
+    }
+    if (!Opcode) {
+      Error = Where + "unknown opcode " + Fields[0].str();
+      return false;
+    }
+    if (Fields.size() == 3 && !parseCostType(Fields[1], T)) {
+      Error = Where + "unknown type " + Fields[1].str();
+      return false;
+    }
+    double Cycles;
+    if (Fields.size() < 2 || Fields.size() > 3 ||
+        Fields.back().getAsDouble(Cycles) || Cycles < 0.0) {
+      Error = Where + "invalid cost";
+      return false;
+    }
+    if (Fields.size() == 3) {
+      Cost[T][Opcode] = Cycles;
+    } else {
+      for (unsigned I = 0; I < NumCostTypes; I++)
+        Cost[I][Opcode] = Cycles;
+    }
+  }
+  return true;
+}
+
+namespace {
+
+struct TypedCost {
+  unsigned Opcode;
+  TargetCostModel::CostType Type;
+  double Cycles;
+};
+
+}
+
+/* Cortex-M4F: the operations on i64 take two or three instructions, except
+ * the divisions which are library calls, and the double precision
+ * operations are emulated in software */
+static const TypedCost CortexM4Costs[] = {
+  {Instruction::SDiv, TargetCostModel::Int32, 7}, {Instruction::UDiv, TargetCostModel::Int32, 7},
+  {Instruction::SRem, TargetCostModel::Int32, 9}, {Instruction::URem, TargetCostModel::Int32, 9},
+  {Instruction::Add, TargetCostModel::Int64, 2}, {Instruction::Sub, TargetCostModel::Int64, 2},
+  {Instruction::Mul, TargetCostModel::Int64, 3}, {Instruction::Shl, TargetCostModel::Int64, 3},
+  {Instruction::AShr, TargetCostModel::Int64, 3}, {Instruction::LShr, TargetCostModel::Int64, 3},
+  {Instruction::SDiv, TargetCostModel::Int64, 90}, {Instruction::UDiv, TargetCostModel::Int64, 80},
+  {Instruction::SRem, TargetCostModel::Int64, 95}, {Instruction::URem, TargetCostModel::Int64, 85},
+  {Instruction::ICmp, TargetCostModel::Int64, 2}, {Instruction::Select, TargetCostModel::Int64, 2},
+  {Instruction::Load, TargetCostModel::Int64, 3}, {Instruction::Store, TargetCostModel::Int64, 2},
+  {Instruction::Trunc, TargetCostModel::Int64, 0}, {Instruction::Load, TargetCostModel::Int32, 2},
+  {Instruction::FDiv, TargetCostModel::Float, 14}, {Instruction::FRem, TargetCostModel::Float, 60},
+  {Instruction::Load, TargetCostModel::Float, 2},
+  {Instruction::FAdd, TargetCostModel::Double, 60}, {Instruction::FSub, TargetCostModel::Double, 60},
+  {Instruction::FMul, TargetCostModel::Double, 50}, {Instruction::FDiv, TargetCostModel::Double, 100},
+  {Instruction::FRem, TargetCostModel::Double, 200}, {Instruction::FNeg, TargetCostModel::Double, 1},
+  {Instruction::FCmp, TargetCostModel::Double, 30}, {Instruction::SIToFP, TargetCostModel::Double, 30},
+  {Instruction::UIToFP, TargetCostModel::Double, 30}, {Instruction::FPToSI, TargetCostModel::Double, 30},
+  {Instruction::FPToUI, TargetCostModel::Double, 30}, {Instruction::FPExt, TargetCostModel::Double, 20},
+  {Instruction::FPTrunc, TargetCostModel::Double, 20}, {Instruction::Load, TargetCostModel::Double, 3},
+  {Instruction::Store, TargetCostModel::Double, 2}
+};
+
+const TargetCostModel *TargetCostModel::getBuiltin(StringRef Name) {
+  static std::unique_ptr<TargetCostModel> CortexM4;
+  static std::once_flag Init;
+  std::call_once(Init, []() {
+    CortexM4.reset(new TargetCostModel());
+    for (const TypedCost &C : CortexM4Costs)
+      CortexM4->setCost(C.Opcode, C.Type, C.Cycles);
+    for (unsigned T = 0; T < NumCostTypes; T++) {
+      CortexM4->setCost(Instruction::PHI, (CostType)T, 0);
+      CortexM4->setCost(Instruction::Alloca, (CostType)T, 0);
+      CortexM4->setCost(Instruction::BitCast, (CostType)T, 0);
+    }
+    /* SADD16, SMLAD and the other instructions of the DSP extension on
+     * halves and bytes of the registers */
+    CortexM4->setLanes(Int16, 2);
+    CortexM4->setLanes(Int8, 4);
+  });
+
+  if (Name == "cortex-m4")
+    return CortexM4.get();
+  return nullptr;
+}
+
+#if LLVM_VERSION_MAJOR >= 12
+static double toCycles(const InstructionCost &C) {
+  return C.isValid() ? (double)*C.getValue() : -1.0;
+}
+#else
+static double toCycles(int C) {
+  return C;
+}
+#endif
+
+static double getCastCycles(const TargetTransformInfo &TTI, unsigned Opcode,
+                            Type *Dst, Type *Src) {
+#if LLVM_VERSION_MAJOR >= 12
+  return toCycles(TTI.getCastInstrCost(Opcode, Dst, Src, TargetTransformInfo::CastContextHint::None));
+#else
+  return toCycles(TTI.getCastInstrCost(Opcode, Dst, Src));
+#endif
+}
+
+static double getCmpSelCycles(const TargetTransformInfo &TTI, unsigned Opcode,
+                              Type *Ty, Type *CondTy) {
+#if LLVM_VERSION_MAJOR >= 12
+  return toCycles(TTI.getCmpSelInstrCost(Opcode, Ty, CondTy, CmpInst::BAD_ICMP_PREDICATE));
+#else
+  return toCycles(TTI.getCmpSelInstrCost(Opcode, Ty, CondTy));
+#endif
+}
+
+TargetCostModel TargetCostModel::fromTargetTransformInfo(const TargetTransformInfo &TTI,
+                                                         LLVMContext &C) {
+  TargetCostModel Model;
+  Type *Tys[NumCostTypes] = {
+    Type::getInt8Ty(C), Type::getInt16Ty(C), Type::getInt32Ty(C),
+    Type::getInt64Ty(C), Type::getFloatTy(C), Type::getDoubleTy(C)
+  };
+#if LLVM_VERSION_MAJOR >= 13
+  unsigned VectorBits =
+    TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector).getFixedSize();
+#else
+  unsigned VectorBits = TTI.getRegisterBitWidth(true);
+#endif
+  Type *BoolTy = Type::getInt1Ty(C);
+
+  auto Set = [&](unsigned Opcode, unsigned T, double Cycles) {
+    if (Cycles >= 0.0)
+      Model.Cost[T][Opcode] = Cycles;
+  };
+  for (unsigned T = 0; T < NumCostTypes; T++) {
+    Type *Ty = Tys[T];
+    bool IsFP = Ty->isFloatingPointTy();
+    for (unsigned Op = Instruction::BinaryOpsBegin; Op < Instruction::BinaryOpsEnd; Op++) {
+      bool FPOp = Op == Instruction::FAdd || Op == Instruction::FSub ||
+                  Op == Instruction::FMul || Op == Instruction::FDiv ||
+                  Op == Instruction::FRem;
+      if (FPOp == IsFP)
+        Set(Op, T, toCycles(TTI.getArithmeticInstrCost(Op, Ty)));
+    }
+    Set(IsFP ? Instruction::FCmp : Instruction::ICmp, T,
+        getCmpSelCycles(TTI, IsFP ? Instruction::FCmp : Instruction::ICmp, Ty, BoolTy));
+    Set(Instruction::Select, T, getCmpSelCycles(TTI, Instruction::Select, Ty, BoolTy));
+
+    /* the casts cost as their wider type, and those between integer and
+     * floating point values as their floating point type */
+    if (IsFP) {
+      Type *IntTy = Tys[T == Float ? Int32 : Int64];
+      Set(Instruction::SIToFP, T, getCastCycles(TTI, Instruction::SIToFP, Ty, IntTy));
+      Set(Instruction::UIToFP, T, getCastCycles(TTI, Instruction::UIToFP, Ty, IntTy));
+      Set(Instruction::FPToSI, T, getCastCycles(TTI, Instruction::FPToSI, IntTy, Ty));
+      Set(Instruction::FPToUI, T, getCastCycles(TTI, Instruction::FPToUI, IntTy, Ty));
+      if (T == Double) {
+        Set(Instruction::FPExt, T, getCastCycles(TTI, Instruction::FPExt, Ty, Tys[Float]));
+        Set(Instruction::FPTrunc, T, getCastCycles(TTI, Instruction::FPTrunc, Tys[Float], Ty));
+      }
+    } else if (T != Int8) {
+      Type *HalfTy = Tys[T - 1];
+      Set(Instruction::SExt, T, getCastCycles(TTI, Instruction::SExt, Ty, HalfTy));
+      Set(Instruction::ZExt, T, getCastCycles(TTI, Instruction::ZExt, Ty, HalfTy));
+      Set(Instruction::Trunc, T, getCastCycles(TTI, Instruction::Trunc, HalfTy, Ty));
+    }
+
+    unsigned N = VectorBits / CostTypeWidth[T];
+    unsigned AddOp = IsFP ? Instruction::FAdd : Instruction::Add;
+    if (N >= 2) {
+      double Vector = toCycles(TTI.getArithmeticInstrCost(AddOp, VectorType::get(Ty, N, false)));
+      if (Vector > 0.0) {
+        double Lanes = std::round(N * Model.Cost[T][AddOp] / Vector);
+        Model.Lanes[T] = (unsigned)std::max(1.0, std::min<double>(Lanes, N));
+      }
+    }
+  }
+  return Model;
+}
+
+/* The type on which I computes: the type of the compared or stored value
+ * for the comparisons and the stores, and the wider type for the casts */
+static TargetCostModel::CostType getInstructionCostType(const Instruction &I) {
+  const Type *Ty = I.getType();
+  switch (I.getOpcode()) {
+    case Instruction::ICmp:
+    case Instruction::FCmp:
+    case Instruction::Trunc:
+    case Instruction::FPTrunc:
+    case Instruction::FPToSI:
+    case Instruction::FPToUI:
+    case Instruction::Store:
+      Ty = I.getOperand(0)->getType();
+      break;
+    default:
+      break;
+  }
+  return TargetCostModel::getCostType(Ty).getValueOr(TargetCostModel::Int32);
+}
+
+double getFloatCost(const Instruction &I, const TargetCostModel &M, bool InLoop) {
+  return M.getCost(I.getOpcode(), getInstructionCostType(I), InLoop);
+}
+
+double getFixedPointCost(const Instruction &I, const FPType &T,
+                         ArrayRef<const FPType *> OperandTypes,
+                         const TargetCostModel &M, bool InLoop) {
+  typedef TargetCostModel TCM;
+  TCM::CostType CT = TCM::getIntCostType(T.getWidth());
+  auto TypeOf = [&](unsigned Idx) -> const FPType & {
+    return Idx < OperandTypes.size() && OperandTypes[Idx] ? *OperandTypes[Idx] : T;
+  };
+  /* the cast and the shift which give the operand Idx the type of I */
+  auto Align = [&](unsigned Idx) -> double {
+    const FPType &From = TypeOf(Idx);
+    double C = 0.0;
+    if (From.getWidth() < T.getWidth())
+      C += M.getCost(Instruction::SExt, CT, InLoop);
+    else if (From.getWidth() > T.getWidth())
+      C += M.getCost(Instruction::Trunc, TCM::getIntCostType(From.getWidth()), InLoop);
+    if (From.getPointPos() < T.getPointPos())
+      C += M.getCost(Instruction::Shl, CT, InLoop);
+    else if (From.getPointPos() > T.getPointPos())
+      C += M.getCost(Instruction::AShr, CT, InLoop);
+    return C;
+  };
+  /* the extension of the operands to Width and the truncation of the
+   * result */
+  auto Widen = [&](unsigned Width) -> double {
+    if (Width <= T.getWidth())
+      return 0.0;
+    TCM::CostType WT = TCM::getIntCostType(Width);
+    return 2 * M.getCost(Instruction::SExt, WT, InLoop) +
+           M.getCost(Instruction::Trunc, WT, InLoop);
+  };
+
+  switch (I.getOpcode()) {
+    case Instruction::FAdd:
+      return M.getCost(Instruction::Add, CT, InLoop) + Align(0) + Align(1);
+    case Instruction::FSub:
+      return M.getCost(Instruction::Sub, CT, InLoop) + Align(0) + Align(1);
+    case Instruction::FNeg:
+      return M.getCost(Instruction::Sub, CT, InLoop) + Align(0);
+    case Instruction::FMul: {
+      const FPType &A = TypeOf(0), &B = TypeOf(1);
+      unsigned Width = fixedPointMulWidth(A, B, T);
+      TCM::CostType WT = TCM::getIntCostType(Width);
+      double C = M.getCost(Instruction::Mul, WT, InLoop) + Widen(Width);
+      int Shift = (int)A.getPointPos() + (int)B.getPointPos() - (int)T.getPointPos();
+      if (Shift > 0)
+        C += M.getCost(Instruction::AShr, WT, InLoop);
+      else if (Shift < 0)
+        C += M.getCost(Instruction::Shl, CT, InLoop);
+      return C;
+    }
+    case Instruction::FDiv:
+    case Instruction::FRem: {
+      const FPType &A = TypeOf(0), &B = TypeOf(1);
+      unsigned Width = fixedPointDivWidth(A, B, T);
+      TCM::CostType WT = TCM::getIntCostType(Width);
+      unsigned Op = I.getOpcode() == Instruction::FDiv ? Instruction::SDiv : Instruction::SRem;
+      double C = M.getCost(Op, WT, InLoop) + Widen(Width);
+      if (T.getPointPos() + B.getPointPos() != A.getPointPos())
+        C += M.getCost(Instruction::Shl, WT, InLoop);
+      return C;
+    }
+    case Instruction::FCmp:
+      return M.getCost(Instruction::ICmp, CT, InLoop) + Align(0) + Align(1);
+    case Instruction::Store:
+      return M.getCost(Instruction::Store, CT, InLoop) + Align(0);
+    case Instruction::Load:
+      return M.getCost(Instruction::Load, CT, InLoop);
+    case Instruction::PHI: {
+      double C = M.getCost(Instruction::PHI, CT, InLoop);
+      for (unsigned Idx = 0; Idx < I.getNumOperands(); Idx++)
+        C += Align(Idx);
+      return C;
+    }
+    case Instruction::Select:
+      return M.getCost(Instruction::Select, CT, InLoop) + Align(1) + Align(2);
+    case Instruction::SIToFP:
+    case Instruction::UIToFP:
+      return M.getCost(Instruction::SExt, CT, InLoop) + M.getCost(Instruction::Shl, CT, InLoop);
+    case Instruction::FPToSI:
+    case Instruction::FPToUI:
+      return M.getCost(Instruction::AShr, CT, InLoop) + M.getCost(Instruction::Trunc, CT, InLoop);
+    case Instruction::FPExt:
+    case Instruction::FPTrunc:
+      return Align(0);
+    default:
+      /* the calls, the allocas and the address computations do not change */
+      return getFloatCost(I, M, InLoop);
+  }
+}
+
+unsigned chooseCheapestType(const Instruction &I, ArrayRef<FPType> Candidates,
+                            ArrayRef<const FPType *> OperandTypes,
+                            const TargetCostModel &M, bool InLoop) {
+  unsigned Best = 0;
+  double BestCost = 0.0;
+  for (unsigned C = 0; C < Candidates.size(); C++) {
+    double Cost = getFixedPointCost(I, Candidates[C], OperandTypes, M, InLoop);
+    if (C == 0 || Cost < BestCost) {
+      Best = C;
+      BestCost = Cost;
+    }
+  }
+  return Best;
+}
+
+/* The cost of a cast between the floating point value V and a fixed point
+ * value: a multiplication by a power of two and a conversion */
+static double getBoundaryCost(const Value &V, const TargetCostModel &M, bool InLoop) {
+  Optional<TargetCostModel::CostType> T = TargetCostModel::getCostType(V.getType());
+  if (!T || !V.getType()->isFPOrFPVectorTy())
+    return 0.0;
+  return M.getCost(Instruction::FMul, *T, InLoop) + M.getCost(Instruction::FPToSI, *T, InLoop);
+}
+
+unsigned revertUnprofitableConversions(Function &F, const TargetCostModel &M) {
+  if (F.isDeclaration())
+    return 0;
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  DenseMap<const Instruction *, const FPType *> TypeOf;
+  DenseMap<const Instruction *, InputInfo *> InfoOf;
+  std::vector<Instruction *> Insts;
+  for (Instruction &I : instructions(F)) {
+    InputInfo *II = MM.retrieveInputInfo(I);
+    FPType *T = II ? dyn_cast_or_null<FPType>(II->IType.get()) : nullptr;
+    if (T && II->IEnableConversion) {
+      Insts.push_back(&I);
+      TypeOf[&I] = T;
+      InfoOf[&I] = II;
+    }
+  }
+  if (Insts.empty())
+    return 0;
+
+  auto Converted = [&](const Value *V) -> const Instruction * {
+    const Instruction *I = dyn_cast<Instruction>(V);
+    return I && TypeOf.count(I) ? I : nullptr;
+  };
+  auto OperandTypes = [&](const Instruction &I) {
+    SmallVector<const FPType *, 4> Types;
+    for (const Value *Op : I.operands()) {
+      const Instruction *OI = Converted(Op);
+      Types.push_back(OI ? TypeOf[OI] : nullptr);
+    }
+    return Types;
+  };
+  auto Shared = [](const Value *V) {
+    return isa<Argument>(V) || isa<GlobalVariable>(V);
+  };
+
+  /* the groups, and those which exchange fixed point values with other
+   * functions */
+  EquivalenceClasses<const Instruction *> Groups;
+  DenseMap<const Instruction *, bool> Pinned;
+  for (const Instruction *I : Insts) {
+    Groups.insert(I);
+    if (isa<CallBase>(I))
+      Pinned[I] = true;
+    for (const Value *Op : I->operands()) {
+      if (const Instruction *OI = Converted(Op))
+        Groups.unionSets(I, OI);
+      else if (Shared(Op))
+        Pinned[I] = true;
+    }
+    for (const User *U : I->users()) {
+      const Instruction *UI = dyn_cast<Instruction>(U);
+      if (!UI || Converted(UI))
+        continue;
+      if (isa<StoreInst>(UI) || isa<CmpInst>(UI)) {
+        for (const Value *Op : UI->operands()) {
+          if (const Instruction *OI = Converted(Op))
+            Groups.unionSets(I, OI);
+          else if (Shared(Op))
+            Pinned[I] = true;
+        }
+      } else if (isa<CallBase>(UI) || isa<ReturnInst>(UI)) {
+        Pinned[I] = true;
+      }
+    }
+  }
+
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+  TargetLibraryInfo TLI(TLII);
+  AssumptionCache AC(F);
+  ScalarEvolution SE(F, TLI, AC, DT, LI);
+
+  /* the difference between the cost of each group converted and in float */
+  DenseMap<const Instruction *, double> Delta;
+  for (const Instruction *I : Insts) {
+    const BasicBlock *BB = I->getParent();
+    double W = getBlockExecutionWeight(*BB, LI, SE);
+    bool InLoop = LI.getLoopFor(BB) != nullptr;
+    double D = getFixedPointCost(*I, *TypeOf[I], OperandTypes(*I), M, InLoop) -
+               getFloatCost(*I, M, InLoop);
+    for (const Value *Op : I->operands()) {
+      if (isa<Instruction>(Op) && !Converted(Op))
+        D += getBoundaryCost(*Op, M, InLoop);
+    }
+    bool CastBack = false;
+    for (const User *U : I->users()) {
+      const Instruction *UI = dyn_cast<Instruction>(U);
+      if (!UI || Converted(UI))
+        continue;
+      if (!isa<StoreInst>(UI) && !isa<CmpInst>(UI)) {
+        CastBack = true;
+        continue;
+      }
+      /* the stores and the comparisons are counted once, from their first
+       * converted operand */
+      const Instruction *First = nullptr;
+      for (const Value *Op : UI->operands()) {
+        if ((First = Converted(Op)))
+          break;
+      }
+      if (First != I)
+        continue;
+      const BasicBlock *UBB = UI->getParent();
+      bool UInLoop = LI.getLoopFor(UBB) != nullptr;
+      /* a stored value takes the type of the memory */
+      const FPType *UT = TypeOf[I];
+      if (auto *SI = dyn_cast<StoreInst>(UI)) {
+        if (const Instruction *Ptr = Converted(SI->getPointerOperand()))
+          UT = TypeOf[Ptr];
+      }
+      double UD = getFixedPointCost(*UI, *UT, OperandTypes(*UI), M, UInLoop) -
+                  getFloatCost(*UI, M, UInLoop);
+      for (const Value *Op : UI->operands()) {
+        if (isa<Instruction>(Op) && !Converted(Op))
+          UD += getBoundaryCost(*Op, M, UInLoop);
+      }
+      D += UD * getBlockExecutionWeight(*UBB, LI, SE) / W;
+    }
+    if (CastBack)
+      D += getBoundaryCost(*I, M, InLoop);
+    Delta[Groups.getLeaderValue(I)] += D * W;
+  }
+  for (const Instruction *I : Insts) {
+    if (Pinned.lookup(I))
+      Pinned[Groups.getLeaderValue(I)] = true;
+  }
+
+  unsigned Reverted = 0;
+  for (Instruction *I : Insts) {
+    const Instruction *Leader = Groups.getLeaderValue(I);
+    if (Pinned.lookup(Leader) || Delta[Leader] <= 0.0)
+      continue;
+    std::unique_ptr<InputInfo> NewII(cast<InputInfo>(InfoOf[I]->clone()));
+    NewII->IEnableConversion = false;
+    TAFFO_TRACE(TraceStage::DTA, I, NewII->IRange.get(), NewII->IType.get(), "kept in float by the cost model");
+    MetadataManager::setInputInfoMetadata(*I, *NewII);
+    Reverted++;
+  }
+  NumRevertedToFloat += Reverted;
+  return Reverted;
+}
+
+}
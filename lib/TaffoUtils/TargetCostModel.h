@@ -0,0 +1,115 @@
+//===-- TargetCostModel.h - Cost of Operations on a Target ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Cost model of a target, which compares the float and the fixed point
+/// versions of the values when choosing their types and whether to convert
+/// them at all.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_TARGET_COST_MODEL_H
+#define TAFFOUTILS_TARGET_COST_MODEL_H
+
+#include <string>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// Cost in cycles of each opcode on each scalar type of a target. The
+/// operations on the vector types cost as much as on their elements.
+/// A type may have a number of SIMD lanes, by which the cost of the binary
+/// operations in loops is divided, since the vectorizer packs them (for
+/// example, the 16-bit instructions of the DSP extension of the Cortex-M4
+/// execute two additions or multiply-accumulates at once).
+class TargetCostModel {
+public:
+  enum CostType { Int8, Int16, Int32, Int64, Float, Double, NumCostTypes };
+
+  /// A model where every operation costs DefaultCost on every type.
+  explicit TargetCostModel(double DefaultCost = 1.0);
+
+  /// The integer type which holds Width bits, Int64 when none does.
+  static CostType getIntCostType(unsigned Width);
+  /// The type of the scalar or of the elements of Ty, if it is an integer,
+  /// half, float or double type.
+  static llvm::Optional<CostType> getCostType(const llvm::Type *Ty);
+  /// The name of T in the model files: i8, i16, i32, i64, float or double.
+  static llvm::StringRef getCostTypeName(CostType T);
+
+  double getCost(unsigned Opcode, CostType T) const { return Cost[T][Opcode]; }
+  void setCost(unsigned Opcode, CostType T, double Cycles) { Cost[T][Opcode] = Cycles; }
+  unsigned getLanes(CostType T) const { return Lanes[T]; }
+  void setLanes(CostType T, unsigned N) { Lanes[T] = N ? N : 1; }
+
+  /// The cost of Opcode on a value of T computed InLoop times for each
+  /// execution of the loop body.
+  double getCost(unsigned Opcode, CostType T, bool InLoop) const;
+
+  /// Override the costs with the lines "<opcode name> <type> <cycles>", or
+  /// "<opcode name> <cycles>" for all the types, and the lanes with the
+  /// lines "lanes <type> <count>". Empty lines and lines starting with '#'
+  /// are ignored. Return false, with a message in Error, on malformed
+  /// lines.
+  bool parse(llvm::StringRef Text, std::string &Error);
+
+  /// The builtin model named Name ("cortex-m4"), or nullptr.
+  static const TargetCostModel *getBuiltin(llvm::StringRef Name);
+
+  /// A model with the reciprocal throughputs of the arithmetic operations,
+  /// the casts and the comparisons reported by TTI, and with lanes from its
+  /// vector registers.
+  static TargetCostModel fromTargetTransformInfo(const llvm::TargetTransformInfo &TTI,
+                                                 llvm::LLVMContext &C);
+
+private:
+  double Cost[NumCostTypes][llvm::Instruction::OtherOpsEnd];
+  unsigned Lanes[NumCostTypes];
+};
+
+/// Cost of I before its conversion.
+double getFloatCost(const llvm::Instruction &I, const TargetCostModel &M,
+                    bool InLoop);
+
+/// Cost of I converted to T, with the operands of types OperandTypes (one
+/// element for each operand of I, nullptr for the constants and the
+/// operands of the same type as I). It includes the shifts and the casts
+/// which align the operands.
+double getFixedPointCost(const llvm::Instruction &I, const mdutils::FPType &T,
+                         llvm::ArrayRef<const mdutils::FPType *> OperandTypes,
+                         const TargetCostModel &M, bool InLoop);
+
+/// Index of the cheapest of the Candidates types for I, the first one
+/// among those of the same cost, so that they can be sorted by precision.
+unsigned chooseCheapestType(const llvm::Instruction &I,
+                            llvm::ArrayRef<mdutils::FPType> Candidates,
+                            llvm::ArrayRef<const mdutils::FPType *> OperandTypes,
+                            const TargetCostModel &M, bool InLoop);
+
+/// Disable the conversion of the groups of instructions of F with a fixed
+/// point type in their taffo.info whose converted code would be slower than
+/// the float one, counting the casts to and from the values out of the
+/// group and weighting each instruction by the execution estimate of its
+/// block. A group is made of the instructions joined by their operands,
+/// and it is kept converted if it exchanges fixed point values with other
+/// functions or with the memory of other functions through calls, returns,
+/// arguments or globals. Returns the number of instructions which stay in
+/// float.
+unsigned revertUnprofitableConversions(llvm::Function &F,
+                                       const TargetCostModel &M);
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+//===-- Trace.cpp - Binary Trace of the TAFFO Decisions ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Trace of the ranges and the types given to the values by the stages of
+/// TAFFO, written in a compact binary format which is read by taffo-trace.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Trace.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Argument.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+namespace taffo {
+
+/* The file starts with the magic, the version and the size of the events,
+ * followed by the records: 'S', the length and the bytes of the next
+ * string of the table, or 'E' and an event. The strings are written
+ * before the events which refer to them. All in the byte order of the
+ * host. */
+static const char TraceMagic[8] = {'T', 'A', 'F', 'F', 'O', 'T', 'R', 'C'};
+static const uint32_t TraceVersion = 1;
+
+/* the events written at once when there is no ring */
+static const size_t TraceBufferSize = 1024;
+
+static const char *const StageNames[NumTraceStages] = {"init", "vra", "dta", "conversion", "errorprop", "driver"};
+
+std::atomic<unsigned> Trace::EnabledStages(0);
+std::atomic<uint8_t> Trace::CurrentStage(static_cast<uint8_t>(TraceStage::Driver));
+
+bool parseTraceStage(StringRef Name, TraceStage &Stage) {
+  for (unsigned I = 0; I < NumTraceStages; I++) {
+    if (Name == StageNames[I]) {
+      Stage = static_cast<TraceStage>(I);
+      return true;
+    }
+  }
+  return false;
+}
+
+StringRef getTraceStageName(TraceStage Stage) {
+  return StageNames[static_cast<unsigned>(Stage)];
+}
+
+namespace {
+
+struct TraceState {
+  sys::SmartMutex<true> Lock;
+  std::unique_ptr<raw_fd_ostream> OS;
+  StringMap<uint32_t> Strings;
+  uint32_t NextString = 1;
+  std::vector<TraceEvent> Events;
+  /* with a ring, the index of the oldest event once it is full */
+  size_t RingSize = 0;
+  size_t RingNext = 0;
+  unsigned Sample = 1;
+  std::atomic<uint64_t> Counts[NumTraceStages];
+
+  template <class T> void write(const T &Data) {
+    OS->write(reinterpret_cast<const char *>(&Data), sizeof(T));
+  }
+
+  uint32_t intern(StringRef S) {
+    if (S.empty())
+      return 0;
+    auto It = Strings.insert(std::make_pair(S, NextString));
+    if (It.second) {
+      NextString++;
+      OS->write('S');
+      write(static_cast<uint32_t>(S.size()));
+      OS->write(S.data(), S.size());
+    }
+    return It.first->second;
+  }
+
+  void flushEvents() {
+    size_t First = Events.size() == RingSize ? RingNext : 0;
+    for (size_t I = 0; I < Events.size(); I++) {
+      OS->write('E');
+      write(Events[(First + I) % Events.size()]);
+    }
+    Events.clear();
+    RingNext = 0;
+  }
+};
+
+TraceState &getTraceState() {
+  static TraceState State;
+  return State;
+}
+
+}
+
+bool Trace::start(StringRef File, ArrayRef<TraceStage> Stages, unsigned Sample, size_t RingSize,
+                  std::string &Error) {
+  TraceState &S = getTraceState();
+  sys::SmartScopedLock<true> Guard(S.Lock);
+  std::error_code EC;
+  S.OS.reset(new raw_fd_ostream(File, EC, sys::fs::OF_None));
+  if (EC) {
+    Error = "cannot open " + File.str() + ": " + EC.message();
+    S.OS.reset();
+    return false;
+  }
+  S.OS->write(TraceMagic, sizeof(TraceMagic));
+  S.write(TraceVersion);
+  S.write(static_cast<uint32_t>(sizeof(TraceEvent)));
+  S.Strings.clear();
+  S.NextString = 1;
+  S.Events.clear();
+  S.Events.reserve(RingSize ? RingSize : TraceBufferSize);
+  S.RingSize = RingSize;
+  S.RingNext = 0;
+  S.Sample = Sample ? Sample : 1;
+  for (auto &Count : S.Counts)
+    Count.store(0, std::memory_order_relaxed);
+
+  unsigned Mask = 0;
+  for (TraceStage Stage : Stages)
+    Mask |= 1U << static_cast<unsigned>(Stage);
+  EnabledStages.store(Stages.empty() ? (1U << NumTraceStages) - 1 : Mask, std::memory_order_relaxed);
+  return true;
+}
+
+void Trace::finish() {
+  TraceState &S = getTraceState();
+  sys::SmartScopedLock<true> Guard(S.Lock);
+  EnabledStages.store(0, std::memory_order_relaxed);
+  if (!S.OS)
+    return;
+  S.flushEvents();
+  S.OS.reset();
+}
+
+void Trace::record(TraceStage Stage, const Value *V, const Range *R, const TType *T, StringRef Reason) {
+  TraceState &S = getTraceState();
+  if (S.Counts[static_cast<unsigned>(Stage)].fetch_add(1, std::memory_order_relaxed) % S.Sample != 0)
+    return;
+
+  TraceEvent E;
+  std::memset(&E, 0, sizeof(E));
+  E.Stage = static_cast<uint8_t>(Stage);
+  E.ValueID = reinterpret_cast<uintptr_t>(V);
+  E.Min = R ? R->Min : std::numeric_limits<double>::quiet_NaN();
+  E.Max = R ? R->Max : std::numeric_limits<double>::quiet_NaN();
+  if (auto *FPT = dyn_cast_or_null<FPType>(T)) {
+    E.Type = TraceEvent::FixedPoint;
+    E.Width = FPT->getSWidth();
+    E.PointPos = FPT->getPointPos();
+  } else if (auto *FT = dyn_cast_or_null<FloatType>(T)) {
+    E.Type = TraceEvent::FloatingPoint;
+    E.Width = FT->getStandard();
+  }
+  const Function *F = nullptr;
+  if (auto *I = dyn_cast_or_null<Instruction>(V))
+    F = I->getFunction();
+  else if (auto *A = dyn_cast_or_null<Argument>(V))
+    F = A->getParent();
+
+  sys::SmartScopedLock<true> Guard(S.Lock);
+  if (!S.OS)
+    return;
+  E.Function = F ? S.intern(F->getName()) : 0;
+  E.Value = V ? S.intern(V->getName()) : 0;
+  E.Reason = S.intern(Reason);
+  if (!S.RingSize) {
+    S.Events.push_back(E);
+    if (S.Events.size() == TraceBufferSize)
+      S.flushEvents();
+  } else if (S.Events.size() < S.RingSize) {
+    S.Events.push_back(E);
+  } else {
+    S.Events[S.RingNext] = E;
+    S.RingNext = (S.RingNext + 1) % S.RingSize;
+  }
+}
+
+bool readTrace(StringRef File, TraceContents &Contents, std::string &Error) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(File);
+  if (!Buffer) {
+    Error = "cannot read " + File.str() + ": " + Buffer.getError().message();
+    return false;
+  }
+  StringRef Data = (*Buffer)->getBuffer();
+  auto Read = [&](void *Out, size_t Size) {
+    if (Data.size() < Size)
+      return false;
+    std::memcpy(Out, Data.data(), Size);
+    Data = Data.drop_front(Size);
+    return true;
+  };
+
+  char Magic[sizeof(TraceMagic)];
+  uint32_t Version, EventSize;
+  if (!Read(Magic, sizeof(Magic)) || std::memcmp(Magic, TraceMagic, sizeof(Magic)) != 0 ||
+      !Read(&Version, sizeof(Version)) || !Read(&EventSize, sizeof(EventSize))) {
+    Error = File.str() + " is not a TAFFO trace";
+    return false;
+  }
+  if (Version != TraceVersion || EventSize != sizeof(TraceEvent)) {
+    Error = File.str() + " was written by another version of TAFFO";
+    return false;
+  }
+
+  Contents.Events.clear();
+  Contents.Strings.assign(1, std::string());
+  while (!Data.empty()) {
+    char Tag = Data.front();
+    Data = Data.drop_front();
+    if (Tag == 'S') {
+      uint32_t Size;
+      if (!Read(&Size, sizeof(Size)) || Data.size() < Size)
+        break;
+      Contents.Strings.push_back(Data.take_front(Size).str());
+      Data = Data.drop_front(Size);
+    } else if (Tag == 'E') {
+      TraceEvent E;
+      if (!Read(&E, sizeof(E)))
+        break;
+      Contents.Events.push_back(E);
+    } else {
+      break;
+    }
+  }
+  if (!Data.empty()) {
+    Error = File.str() + " is truncated or corrupted";
+    return false;
+  }
+  return true;
+}
+
+}
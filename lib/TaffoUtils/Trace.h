@@ -0,0 +1,135 @@
+//===-- Trace.h - Binary Trace of the TAFFO Decisions -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Trace of the ranges and the types given to the values by the stages of
+/// TAFFO, written in a compact binary format which is read by taffo-trace.
+/// Unlike -debug-only, it works in release builds of LLVM, and costs a
+/// test of a flag when it is disabled.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TAFFOUTILS_TRACE_H
+#define TAFFOUTILS_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Value.h"
+#include "InputInfo.h"
+
+namespace taffo {
+
+/// The stages which produce trace events.
+enum class TraceStage : uint8_t {
+  Init,
+  VRA,
+  DTA,
+  Conversion,
+  ErrorProp,
+  /// The boundaries of the stages, and the steps of taffo-driver.
+  Driver
+};
+
+const unsigned NumTraceStages = 6;
+
+/// Parse the name of a stage: init, vra, dta, conversion, errorprop or
+/// driver.
+bool parseTraceStage(llvm::StringRef Name, TraceStage &Stage);
+
+llvm::StringRef getTraceStageName(TraceStage Stage);
+
+/// An event of the trace. The names are indices in the string table of the
+/// trace, where 0 is the empty string.
+struct TraceEvent {
+  enum TypeKind : uint8_t { NoType, FixedPoint, FloatingPoint };
+
+  /// The address of the value in the compiler, unique while it exists; 0
+  /// when the event is not about a value.
+  uint64_t ValueID;
+  /// The range of the value; NaN when it has none.
+  double Min;
+  double Max;
+  /// The width of the fixed point type (negative if signed), or the
+  /// FloatType::FloatStandard of the floating point type.
+  int32_t Width;
+  uint32_t PointPos;
+  uint32_t Function;
+  uint32_t Value;
+  uint32_t Reason;
+  uint8_t Stage;
+  uint8_t Type;
+  uint8_t Padding[2];
+};
+
+/// The trace of the current process. All the functions are thread safe.
+class Trace {
+public:
+  /// Whether the events of Stage are recorded.
+  static bool isEnabled(TraceStage Stage) {
+    return EnabledStages.load(std::memory_order_relaxed) & (1U << static_cast<unsigned>(Stage));
+  }
+
+  /// Start recording to File the events of Stages (all the stages if it is
+  /// empty), one every Sample events of each stage. If RingSize is not 0,
+  /// only the last RingSize events are kept, and written by finish();
+  /// otherwise the events are written as they are recorded.
+  static bool start(llvm::StringRef File, llvm::ArrayRef<TraceStage> Stages, unsigned Sample,
+                    size_t RingSize, std::string &Error);
+
+  /// Write the pending events and close the trace.
+  static void finish();
+
+  /// The stage of the events recorded by the code shared among the stages
+  /// (e.g. the writes of the taffo.info metadata).
+  static void setCurrentStage(TraceStage Stage) {
+    CurrentStage.store(static_cast<uint8_t>(Stage), std::memory_order_relaxed);
+  }
+  static TraceStage getCurrentStage() {
+    return static_cast<TraceStage>(CurrentStage.load(std::memory_order_relaxed));
+  }
+
+  /// Record the range R and the type T of V, which may all be nullptr,
+  /// with the reason Reason. Use TAFFO_TRACE, which does not evaluate the
+  /// arguments when Stage is disabled.
+  static void record(TraceStage Stage, const llvm::Value *V, const mdutils::Range *R,
+                     const mdutils::TType *T, llvm::StringRef Reason);
+
+private:
+  static std::atomic<unsigned> EnabledStages;
+  static std::atomic<uint8_t> CurrentStage;
+};
+
+/// The contents of a trace file.
+struct TraceContents {
+  std::vector<TraceEvent> Events;
+  std::vector<std::string> Strings;
+
+  llvm::StringRef getString(uint32_t Index) const {
+    return Index < Strings.size() ? llvm::StringRef(Strings[Index]) : llvm::StringRef();
+  }
+};
+
+/// Read the trace written to File.
+bool readTrace(llvm::StringRef File, TraceContents &Contents, std::string &Error);
+
+}
+
+/// Record an event of Stage with the arguments of Trace::record, which are
+/// only evaluated when the tracing of Stage is enabled.
+#define TAFFO_TRACE(Stage, V, R, T, Reason) \
+  do { \
+    if (::taffo::Trace::isEnabled(Stage)) \
+      ::taffo::Trace::record(Stage, V, R, T, Reason); \
+  } while (false)
+
+#endif
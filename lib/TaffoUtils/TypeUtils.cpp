@@ -1,9 +1,23 @@
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "TypeUtils.h"
+#include "Trace.h"
 
 #define DEBUG_TYPE "taffo"
 
+ALWAYS_ENABLED_STATISTIC(NumFixedPointTypes, "Number of fixed point types generated for ranges");
+ALWAYS_ENABLED_STATISTIC(NumTypesUpTo8Bits, "Number of fixed point types of up to 8 bits");
+ALWAYS_ENABLED_STATISTIC(NumTypesUpTo16Bits, "Number of fixed point types of 9 to 16 bits");
+ALWAYS_ENABLED_STATISTIC(NumTypesUpTo32Bits, "Number of fixed point types of 17 to 32 bits");
+ALWAYS_ENABLED_STATISTIC(NumTypesUpTo64Bits, "Number of fixed point types of 33 to 64 bits");
+ALWAYS_ENABLED_STATISTIC(NumTypesWider, "Number of fixed point types wider than 64 bits");
+ALWAYS_ENABLED_STATISTIC(NumInvalidRanges, "Number of ranges containing NaN");
+ALWAYS_ENABLED_STATISTIC(NumUnboundedRanges, "Number of unbounded ranges");
+ALWAYS_ENABLED_STATISTIC(NumNotEnoughFracBits, "Number of types with too few fractional bits");
+ALWAYS_ENABLED_STATISTIC(NumNotEnoughIntAndFracBits, "Number of types which may overflow");
+ALWAYS_ENABLED_STATISTIC(NumLaneTypes, "Number of fixed point types fitting a vector lane");
+
 
 using namespace taffo;
 using namespace llvm;
@@ -26,39 +40,52 @@ bool taffo::isFloatType(Type *srct)
 }
 
 
-mdutils::FPType taffo::fixedPointTypeFromRange(
-  const mdutils::Range& rng,
-  FixedPointTypeGenError *outerr,
+namespace {
+
+/* Type selected for a range, before building the FPType */
+struct FixedPointTypeChoice {
+  int bitsAmt;
+  int fracBitsAmt;
+  bool isSigned;
+  FixedPointTypeGenError err;
+};
+
+}
+
+
+/* Smallest k >= 1 such that base + k * inc >= target, for inc > 0 */
+static inline int incrementsToReach(int base, int target, int inc)
+{
+  if (base + inc >= target)
+    return 1;
+  return (int)(((long long)target - base + inc - 1) / inc);
+}
+
+
+static inline FixedPointTypeChoice chooseFixedPointType(
+  double min, double max_,
   int totalBits,
   int fracThreshold,
   int maxTotalBits,
   int totalBitsIncrement)
 {
-  if (outerr) *outerr = FixedPointTypeGenError::NoError;
-  
-  if (std::isnan(rng.Min) || std::isnan(rng.Max)) {
-    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " contains NaN\n");
-    if (outerr) *outerr = FixedPointTypeGenError::InvalidRange;
-    return mdutils::FPType(totalBits, 0, true);
-  }
+  if (std::isnan(min) || std::isnan(max_))
+    return {totalBits, 0, true, FixedPointTypeGenError::InvalidRange};
 
-  bool isSigned = rng.Min < 0;
+  bool isSigned = min < 0;
 
-  if (std::isinf(rng.Min) || std::isinf(rng.Max)) {
-    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " contains +/-inf. Overflow may occur!\n");
-    if (outerr) *outerr = FixedPointTypeGenError::UnboundedRange;
-    return mdutils::FPType(totalBits, 0, isSigned);
-  }
+  if (std::isinf(min) || std::isinf(max_))
+    return {totalBits, 0, isSigned, FixedPointTypeGenError::UnboundedRange};
 
-  double max = std::max(std::abs(rng.Min), std::abs(rng.Max));
+  double max = std::max(std::abs(min), std::abs(max_));
   int intBit = std::lround(std::ceil(std::log2(max+1.0))) + (isSigned ? 1 : 0);
   int bitsAmt = totalBits;
   
   int maxFracBitsAmt;
-  if (rng.Min == rng.Max && fracThreshold < 0) {
+  if (min == max_ && fracThreshold < 0) {
     int exp;
     double mant = std::frexp(max, &exp);
-    // rng.Min == rng.Max == mant * (2 ** exp)
+    // min == max == mant * (2 ** exp)
     int nonzerobits = 0;
     while (mant != 0) {
       nonzerobits += 1;
@@ -73,23 +100,205 @@ mdutils::FPType taffo::fixedPointTypeFromRange(
   // compensate for always zero fractional bits for numbers < 0.5
   int negIntBitsAmt = std::max(0, (int)std::ceil(-std::log2(max)));
   
-  while ((fracBitsAmt - negIntBitsAmt) < fracThreshold && bitsAmt < maxTotalBits) {
-    bitsAmt += totalBitsIncrement;
-    fracBitsAmt = bitsAmt - intBit;
+  // grow the type by totalBitsIncrement until the fractional part is
+  // large enough or the maximum size is reached
+  if ((fracBitsAmt - negIntBitsAmt) < fracThreshold && bitsAmt < maxTotalBits) {
+    if (totalBitsIncrement > 0) {
+      int k = std::min(
+        incrementsToReach(bitsAmt, fracThreshold + intBit + negIntBitsAmt, totalBitsIncrement),
+        incrementsToReach(bitsAmt, maxTotalBits, totalBitsIncrement));
+      bitsAmt += k * totalBitsIncrement;
+      fracBitsAmt = bitsAmt - intBit;
+    } else {
+      while ((fracBitsAmt - negIntBitsAmt) < fracThreshold && bitsAmt < maxTotalBits) {
+        bitsAmt += totalBitsIncrement;
+        fracBitsAmt = bitsAmt - intBit;
+      }
+    }
   }
 
   // Check dimension
+  FixedPointTypeGenError err = FixedPointTypeGenError::NoError;
   if (fracBitsAmt < fracThreshold) {
-    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " Fractional part is too small!\n");
     fracBitsAmt = 0;
-    if (intBit > bitsAmt) {
-      LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " Overflow may occur!\n");
-      if (outerr) *outerr = FixedPointTypeGenError::NotEnoughIntAndFracBits;
-    } else {
-      if (outerr) *outerr = FixedPointTypeGenError::NotEnoughFracBits;
-    }
+    if (intBit > bitsAmt)
+      err = FixedPointTypeGenError::NotEnoughIntAndFracBits;
+    else
+      err = FixedPointTypeGenError::NotEnoughFracBits;
   }
   
-  return mdutils::FPType(bitsAmt, fracBitsAmt, isSigned);
+  return {bitsAmt, fracBitsAmt, isSigned, err};
+}
+
+
+/* Counts of the types chosen, added to the statistics at once */
+namespace {
+
+struct FixedPointTypeCounts {
+  unsigned types = 0;
+  unsigned byWidth[5] = {0, 0, 0, 0, 0};
+  unsigned byError[5] = {0, 0, 0, 0, 0};
+
+  void count(const FixedPointTypeChoice& res)
+  {
+    types++;
+    int width = res.bitsAmt;
+    byWidth[width <= 8 ? 0 : width <= 16 ? 1 : width <= 32 ? 2 : width <= 64 ? 3 : 4]++;
+    byError[(int)res.err]++;
+  }
+
+  ~FixedPointTypeCounts()
+  {
+    NumFixedPointTypes += types;
+    NumTypesUpTo8Bits += byWidth[0];
+    NumTypesUpTo16Bits += byWidth[1];
+    NumTypesUpTo32Bits += byWidth[2];
+    NumTypesUpTo64Bits += byWidth[3];
+    NumTypesWider += byWidth[4];
+    NumInvalidRanges += byError[(int)FixedPointTypeGenError::InvalidRange];
+    NumUnboundedRanges += byError[(int)FixedPointTypeGenError::UnboundedRange];
+    NumNotEnoughFracBits += byError[(int)FixedPointTypeGenError::NotEnoughFracBits];
+    NumNotEnoughIntAndFracBits += byError[(int)FixedPointTypeGenError::NotEnoughIntAndFracBits];
+  }
+};
+
+}
+
+
+/* The reason recorded in the trace for a type generated with err */
+static const char *getTypeGenTraceReason(FixedPointTypeGenError err)
+{
+  switch (err) {
+  case FixedPointTypeGenError::InvalidRange:
+    return "range contains NaN";
+  case FixedPointTypeGenError::UnboundedRange:
+    return "unbounded range, may overflow";
+  case FixedPointTypeGenError::NotEnoughIntAndFracBits:
+    return "not enough integer bits, may overflow";
+  case FixedPointTypeGenError::NotEnoughFracBits:
+    return "not enough fractional bits";
+  default:
+    return "type from range";
+  }
+}
+
+
+mdutils::FPType taffo::fixedPointTypeFromRange(
+  const mdutils::Range& rng,
+  FixedPointTypeGenError *outerr,
+  int totalBits,
+  int fracThreshold,
+  int maxTotalBits,
+  int totalBitsIncrement)
+{
+  FixedPointTypeChoice res = chooseFixedPointType(rng.Min, rng.Max,
+    totalBits, fracThreshold, maxTotalBits, totalBitsIncrement);
+  FixedPointTypeCounts counts;
+  counts.count(res);
+  if (outerr) *outerr = res.err;
+
+  switch (res.err) {
+  case FixedPointTypeGenError::InvalidRange:
+    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " contains NaN\n");
+    break;
+  case FixedPointTypeGenError::UnboundedRange:
+    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " contains +/-inf. Overflow may occur!\n");
+    break;
+  case FixedPointTypeGenError::NotEnoughIntAndFracBits:
+    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " Fractional part is too small!\n");
+    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " Overflow may occur!\n");
+    break;
+  case FixedPointTypeGenError::NotEnoughFracBits:
+    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " Fractional part is too small!\n");
+    break;
+  case FixedPointTypeGenError::NoError:
+    break;
+  }
+
+  mdutils::FPType type(res.bitsAmt, res.fracBitsAmt, res.isSigned);
+  TAFFO_TRACE(Trace::getCurrentStage(), nullptr, &rng, &type, getTypeGenTraceReason(res.err));
+  return type;
+}
+
+
+void taffo::fixedPointTypesFromRanges(
+  ArrayRef<double> mins,
+  ArrayRef<double> maxs,
+  MutableArrayRef<int> outSWidths,
+  MutableArrayRef<unsigned> outPointPos,
+  MutableArrayRef<FixedPointTypeGenError> outerrs,
+  int totalBits,
+  int fracThreshold,
+  int maxTotalBits,
+  int totalBitsIncrement)
+{
+  size_t n = mins.size();
+  assert(maxs.size() == n && outSWidths.size() == n && outPointPos.size() == n &&
+         "range and type arrays must have the same size");
+  assert((outerrs.empty() || outerrs.size() == n) && "error array must be empty or as large as the ranges");
+  bool reportErrs = !outerrs.empty();
+
+  FixedPointTypeCounts counts;
+  for (size_t i = 0; i < n; i++) {
+    FixedPointTypeChoice res = chooseFixedPointType(mins[i], maxs[i],
+      totalBits, fracThreshold, maxTotalBits, totalBitsIncrement);
+    counts.count(res);
+    /* same width and point position as the FPType built by the scalar version */
+    unsigned width = res.bitsAmt;
+    outSWidths[i] = res.isSigned ? -width : width;
+    outPointPos[i] = res.fracBitsAmt;
+    if (reportErrs)
+      outerrs[i] = res.err;
+  }
+}
+
+
+SmallVector<int, 4> taffo::vectorLaneWidthsForTarget(const Triple& triple)
+{
+  switch (triple.getArch()) {
+  case Triple::x86:
+  case Triple::x86_64:
+  case Triple::arm:
+  case Triple::armeb:
+  case Triple::thumb:
+  case Triple::thumbeb:
+  case Triple::aarch64:
+  case Triple::aarch64_be:
+  case Triple::ppc64:
+  case Triple::ppc64le:
+    return {8, 16, 32};
+  default:
+    return {};
+  }
 }
 
+
+mdutils::FPType taffo::fixedPointTypeFromRangeForLanes(
+  const mdutils::Range& rng,
+  ArrayRef<int> laneWidths,
+  FixedPointTypeGenError *outerr,
+  int *outLaneWidth,
+  int totalBits,
+  int fracThreshold,
+  int maxTotalBits,
+  int totalBitsIncrement)
+{
+  if (outLaneWidth) *outLaneWidth = 0;
+  for (int laneWidth: laneWidths) {
+    if (laneWidth > maxTotalBits)
+      break;
+    /* the type must fit the lane without growing */
+    FixedPointTypeChoice res = chooseFixedPointType(rng.Min, rng.Max,
+      laneWidth, fracThreshold, laneWidth, 0);
+    if (res.err != FixedPointTypeGenError::NoError)
+      continue;
+    LLVM_DEBUG(dbgs() << "[" << __PRETTY_FUNCTION__ << "] range=" << rng.toString() << " fits " << laneWidth << "-bit lanes\n");
+    FixedPointTypeCounts counts;
+    counts.count(res);
+    NumLaneTypes++;
+    if (outerr) *outerr = res.err;
+    if (outLaneWidth) *outLaneWidth = laneWidth;
+    return mdutils::FPType(res.bitsAmt, res.fracBitsAmt, res.isSigned);
+  }
+  return fixedPointTypeFromRange(rng, outerr, totalBits, fracThreshold, maxTotalBits, totalBitsIncrement);
+}
@@ -1,3 +1,6 @@
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/CallSite.h"
@@ -45,6 +48,48 @@ mdutils::FPType fixedPointTypeFromRange(
   int maxTotalBits=64,
   int totalBitsIncrement=64);
 
+/** Batch version of fixedPointTypeFromRange, which selects the type of
+ *  each range (mins[i], maxs[i]) with the same parameters.
+ *  @param outSWidths Receives the signed width of each type, negative if
+ *    the type is signed, as returned by FPType::getSWidth
+ *  @param outPointPos Receives the fractional bits of each type
+ *  @param outerrs Receives the outcome of each type assignment, as
+ *    fixedPointTypeFromRange would report it. Optionally can be empty.
+ *  The results are the same that fixedPointTypeFromRange gives for each
+ *  range. */
+void fixedPointTypesFromRanges(
+  llvm::ArrayRef<double> mins,
+  llvm::ArrayRef<double> maxs,
+  llvm::MutableArrayRef<int> outSWidths,
+  llvm::MutableArrayRef<unsigned> outPointPos,
+  llvm::MutableArrayRef<FixedPointTypeGenError> outerrs,
+  int totalBits=32,
+  int fracThreshold=3,
+  int maxTotalBits=64,
+  int totalBitsIncrement=64);
+
+/** Returns the integer lane widths, in bits and in increasing order, of
+ *  the vector units commonly available on the architecture of a target.
+ *  Empty if the architecture is not known to have integer vector units. */
+llvm::SmallVector<int, 4> vectorLaneWidthsForTarget(const llvm::Triple& triple);
+
+/** Like fixedPointTypeFromRange, but prefers the narrowest of the given
+ *  lane widths which can represent the range with at least fracThreshold
+ *  fractional bits, since narrower lanes give more elements per vector.
+ *  If no lane width fits, the type is chosen by fixedPointTypeFromRange
+ *  starting from totalBits.
+ *  @param outLaneWidth If not nullptr, receives the lane width chosen, or
+ *    0 if none of them was used. */
+mdutils::FPType fixedPointTypeFromRangeForLanes(
+  const mdutils::Range& range,
+  llvm::ArrayRef<int> laneWidths,
+  FixedPointTypeGenError *outerr=nullptr,
+  int *outLaneWidth=nullptr,
+  int totalBits=32,
+  int fracThreshold=3,
+  int maxTotalBits=64,
+  int totalBitsIncrement=64);
+
 }
 
 
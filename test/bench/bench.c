@@ -0,0 +1,25 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <time.h>
+#include "bench.h"
+
+static struct timespec timer_start_time;
+static double timer_elapsed;
+
+void polybench_timer_start(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &timer_start_time);
+}
+
+void polybench_timer_stop(void)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  timer_elapsed = (double)(end.tv_sec - timer_start_time.tv_sec) +
+                  (double)(end.tv_nsec - timer_start_time.tv_nsec) * 1e-9;
+}
+
+void polybench_timer_print(void)
+{
+  fprintf(stderr, "time %0.9f\n", timer_elapsed);
+}
@@ -0,0 +1,19 @@
+/* Timer of the benchmark kernels.
+ *
+ * The kernel region of each benchmark is enclosed between
+ * polybench_timer_start and polybench_timer_stop, which are also the region
+ * delimiters recognized by taffo-instmix and the performance estimator.
+ * These functions are in bench.c, which is not annotated, so TAFFO does not
+ * convert or inline them. */
+
+#ifndef TAFFO_BENCH_H
+#define TAFFO_BENCH_H
+
+void polybench_timer_start(void);
+void polybench_timer_stop(void);
+
+/* Print the time of the region on stderr as "time <seconds>", so that the
+ * output of the kernel on stdout only contains its results. */
+void polybench_timer_print(void);
+
+#endif
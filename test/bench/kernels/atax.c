@@ -0,0 +1,46 @@
+/* atax: y = A^T (A x) (PolyBench, linear-algebra/kernels) */
+#include <stdio.h>
+#include "bench.h"
+
+#define M 1900
+#define N 2100
+
+static double A[M][N] __attribute__((annotate("scalar(range(0, 1) final)")));
+static double x[N] __attribute__((annotate("scalar(range(0, 2) final)")));
+static double tmp[M] __attribute__((annotate("scalar(range(0, 1024) final)")));
+static double y[N] __attribute__((annotate("target('y') scalar(range(0, 524288) final)")));
+
+static void init_array(void)
+{
+  for (int j = 0; j < N; j++)
+    x[j] = 1.0 + (double)j / N;
+  for (int i = 0; i < M; i++)
+    for (int j = 0; j < N; j++)
+      A[i][j] = (double)((i + j) % N) / (5 * M);
+}
+
+static void kernel_atax(void)
+{
+  for (int j = 0; j < N; j++)
+    y[j] = 0.0;
+  for (int i = 0; i < M; i++) {
+    tmp[i] = 0.0;
+    for (int j = 0; j < N; j++)
+      tmp[i] += A[i][j] * x[j];
+    for (int j = 0; j < N; j++)
+      y[j] += A[i][j] * tmp[i];
+  }
+}
+
+int main(void)
+{
+  init_array();
+  polybench_timer_start();
+  kernel_atax();
+  polybench_timer_stop();
+  polybench_timer_print();
+
+  for (int j = 0; j < N; j++)
+    printf("%.10e\n", y[j]);
+  return 0;
+}
@@ -0,0 +1,44 @@
+/* forwardk2j: forward kinematics of a 2-joint arm (AxBench, inversek2j) */
+#include <math.h>
+#include <stdio.h>
+#include "bench.h"
+
+#define N 200000
+#define PI 3.14159265358979
+
+static const double l1 = 0.5;
+static const double l2 = 0.5;
+
+static double theta1[N] __attribute__((annotate("scalar(range(0, 1.5708) final)")));
+static double theta2[N] __attribute__((annotate("scalar(range(0, 1.5708) final)")));
+static double x[N] __attribute__((annotate("target('x') scalar(range(-1, 1) final)")));
+static double y[N] __attribute__((annotate("target('y') scalar(range(-1, 1) final)")));
+
+static void init_array(void)
+{
+  for (int i = 0; i < N; i++) {
+    theta1[i] = (PI / 2) * (double)(i % 1000) / 1000;
+    theta2[i] = (PI / 2) * (double)((i * 7) % 1000) / 1000;
+  }
+}
+
+static void kernel_forwardk2j(void)
+{
+  for (int i = 0; i < N; i++) {
+    x[i] = l1 * cos(theta1[i]) + l2 * cos(theta1[i] + theta2[i]);
+    y[i] = l1 * sin(theta1[i]) + l2 * sin(theta1[i] + theta2[i]);
+  }
+}
+
+int main(void)
+{
+  init_array();
+  polybench_timer_start();
+  kernel_forwardk2j();
+  polybench_timer_stop();
+  polybench_timer_print();
+
+  for (int i = 0; i < N; i++)
+    printf("%.10e %.10e\n", x[i], y[i]);
+  return 0;
+}
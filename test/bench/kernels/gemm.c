@@ -0,0 +1,46 @@
+/* gemm: C = alpha * A * B + beta * C (PolyBench, linear-algebra/blas) */
+#include <stdio.h>
+#include "bench.h"
+
+#define N 400
+
+static double A[N][N] __attribute__((annotate("scalar(range(0, 1) final)")));
+static double B[N][N] __attribute__((annotate("scalar(range(0, 1) final)")));
+static double C[N][N] __attribute__((annotate("target('C') scalar(range(0, 1024) final)")));
+
+static void init_array(void)
+{
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++) {
+      A[i][j] = (double)((i * j + 1) % N) / N;
+      B[i][j] = (double)((i * (j + 1) + 2) % N) / N;
+      C[i][j] = (double)((i * (j + 2) + 3) % N) / N;
+    }
+}
+
+static void kernel_gemm(double alpha, double beta)
+{
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++) {
+      C[i][j] *= beta;
+      for (int k = 0; k < N; k++)
+        C[i][j] += alpha * A[i][k] * B[k][j];
+    }
+}
+
+int main(void)
+{
+  double alpha __attribute__((annotate("scalar(range(1, 2) final)"))) = 1.5;
+  double beta __attribute__((annotate("scalar(range(1, 2) final)"))) = 1.2;
+
+  init_array();
+  polybench_timer_start();
+  kernel_gemm(alpha, beta);
+  polybench_timer_stop();
+  polybench_timer_print();
+
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++)
+      printf("%.10e\n", C[i][j]);
+  return 0;
+}
@@ -0,0 +1,40 @@
+/* jacobi-1d: 1-D Jacobi stencil (PolyBench, stencils) */
+#include <stdio.h>
+#include "bench.h"
+
+#define TSTEPS 2000
+#define N 20000
+
+static double A[N] __attribute__((annotate("target('A') scalar(range(0, 2) final)")));
+static double B[N] __attribute__((annotate("scalar(range(0, 2) final)")));
+
+static void init_array(void)
+{
+  for (int i = 0; i < N; i++) {
+    A[i] = ((double)i + 2) / N;
+    B[i] = ((double)i + 3) / N;
+  }
+}
+
+static void kernel_jacobi_1d(void)
+{
+  for (int t = 0; t < TSTEPS; t++) {
+    for (int i = 1; i < N - 1; i++)
+      B[i] = 0.33333 * (A[i - 1] + A[i] + A[i + 1]);
+    for (int i = 1; i < N - 1; i++)
+      A[i] = 0.33333 * (B[i - 1] + B[i] + B[i + 1]);
+  }
+}
+
+int main(void)
+{
+  init_array();
+  polybench_timer_start();
+  kernel_jacobi_1d();
+  polybench_timer_stop();
+  polybench_timer_print();
+
+  for (int i = 0; i < N; i++)
+    printf("%.10e\n", A[i]);
+  return 0;
+}
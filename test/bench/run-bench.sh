@@ -0,0 +1,164 @@
+#!/bin/bash
+#
+# End-to-end speed and accuracy benchmark of TAFFO.
+#
+# Each kernel in kernels/ is compiled with taffo and, through -float-output,
+# without the conversion. Both programs are run -repetitions times; the time
+# of a run is the one of the region between polybench_timer_start and
+# polybench_timer_stop, and the fastest run of each is kept. The numbers
+# printed by the converted program are compared with the ones printed by the
+# floating point one. The results are written in JSON:
+#
+#   {"version": 1, "kernels": [{"name": ..., "status": ..., "float_time": ...,
+#     "taffo_time": ..., "speedup": ..., "max_abs_error": ...,
+#     "mean_abs_error": ..., "mean_rel_error": ...}, ...]}
+#
+# where the status is "ok", "compile-error", "run-error" or "output-mismatch"
+# (the two programs printed a different number of values), and the values
+# which could not be measured are null. The exit status is 1 if any kernel
+# did not succeed.
+
+SCRIPTPATH=$(cd "$(dirname "$BASH_SOURCE")" && pwd)
+
+taffo=taffo
+output_file=
+repetitions=5
+work_dir=
+taffo_flags=
+kernels=()
+
+parse_state=0
+for opt in "$@"; do
+  case $parse_state in
+    0)
+      case $opt in
+        -taffo) parse_state=1 ;;
+        -o) parse_state=2 ;;
+        -repetitions) parse_state=3 ;;
+        -work-dir) parse_state=4 ;;
+        -Xtaffo) parse_state=5 ;;
+        -h|-help|--help)
+          cat << HELP_END
+Usage: run-bench.sh [options] [kernel...]
+
+Compiles the kernels in ${SCRIPTPATH}/kernels (all of them by default) with
+and without TAFFO, runs them and reports the speedup and the output error
+of each one in JSON.
+
+Options:
+  -taffo <path>         The taffo script to use (Default: taffo in PATH)
+  -o <file>             Write the JSON report to <file> (Default: stdout)
+  -repetitions <N>      Run each program N times and keep the fastest run
+                        (Default: 5)
+  -work-dir <dir>       Keep the programs and their outputs in <dir>
+                        (Default: a temporary directory, then removed)
+  -Xtaffo <option>      Pass the specified option to taffo
+HELP_END
+          exit 0
+          ;;
+        *) kernels+=( "$opt" ) ;;
+      esac
+      ;;
+    1) taffo="$opt"; parse_state=0 ;;
+    2) output_file="$opt"; parse_state=0 ;;
+    3) repetitions="$opt"; parse_state=0 ;;
+    4) work_dir="$opt"; parse_state=0 ;;
+    5) taffo_flags="$taffo_flags $opt"; parse_state=0 ;;
+  esac
+done
+
+if [[ ${#kernels[@]} -eq 0 ]]; then
+  for src in "${SCRIPTPATH}"/kernels/*.c; do
+    kernels+=( "$(basename "$src" .c)" )
+  done
+fi
+
+del_work_dir=0
+if [[ -z "$work_dir" ]]; then
+  work_dir=$(mktemp -d)
+  del_work_dir=1
+fi
+mkdir -p "$work_dir" || exit 1
+
+# Runs the program $1 $repetitions times, with its output in $2, and prints
+# the time of the fastest run
+bench_run()
+{
+  local best=
+  for ((r = 0; r < repetitions; r++)); do
+    "$1" > "$2" 2> "$2.time" || return 1
+    local t=$(awk '$1 == "time" { print $2 }' "$2.time")
+    if [[ -z "$t" ]]; then return 1; fi
+    if [[ ( -z "$best" ) || ( $(awk -v a="$t" -v b="$best" 'BEGIN { print (a < b) }') -eq 1 ) ]]; then
+      best=$t
+    fi
+  done
+  echo "$best"
+}
+
+# Prints the JSON attributes of the errors of the values in $2 with respect
+# to the ones in $1, or nothing if they do not have the same number of values
+bench_errors()
+{
+  awk '
+    NR == FNR { for (i = 1; i <= NF; i++) ref[n++] = $i; next }
+    { for (i = 1; i <= NF; i++) val[m++] = $i }
+    END {
+      if (n != m || n == 0)
+        exit 1;
+      maxabs = 0; sumabs = 0; sumrel = 0;
+      for (i = 0; i < n; i++) {
+        d = val[i] - ref[i]; if (d < 0) d = -d;
+        r = ref[i]; if (r < 0) r = -r;
+        if (d > maxabs) maxabs = d;
+        sumabs += d;
+        sumrel += (r > 0 ? d / r : d);
+      }
+      printf "\"max_abs_error\": %.6e, \"mean_abs_error\": %.6e, \"mean_rel_error\": %.6e", maxabs, sumabs / n, sumrel / n
+    }' "$1" "$2"
+}
+
+failed=0
+results=()
+for k in "${kernels[@]}"; do
+  src="${SCRIPTPATH}/kernels/$k.c"
+  status=ok
+  float_time=null
+  taffo_time=null
+  speedup=null
+  errors='"max_abs_error": null, "mean_abs_error": null, "mean_rel_error": null'
+  echo "$k" 1>&2
+
+  if ! "$taffo" -O3 -I"${SCRIPTPATH}" ${taffo_flags} \
+      -o "$work_dir/$k.taffo" -float-output "$work_dir/$k.float" \
+      "$src" "${SCRIPTPATH}/bench.c" -lm > "$work_dir/$k.log" 2>&1; then
+    status=compile-error
+  elif ! float_time=$(bench_run "$work_dir/$k.float" "$work_dir/$k.float.out") ||
+       ! taffo_time=$(bench_run "$work_dir/$k.taffo" "$work_dir/$k.taffo.out"); then
+    status=run-error
+  elif ! errors=$(bench_errors "$work_dir/$k.float.out" "$work_dir/$k.taffo.out"); then
+    status=output-mismatch
+    errors='"max_abs_error": null, "mean_abs_error": null, "mean_rel_error": null'
+  fi
+  if [[ -z "$float_time" ]]; then float_time=null; fi
+  if [[ -z "$taffo_time" ]]; then taffo_time=null; fi
+  if [[ ( $float_time != null ) && ( $taffo_time != null ) ]]; then
+    speedup=$(awk -v f="$float_time" -v t="$taffo_time" 'BEGIN { if (t > 0) printf "%.4f", f / t; else print "null" }')
+  fi
+  if [[ $status != ok ]]; then failed=1; fi
+
+  results+=( "    {\"name\": \"$k\", \"status\": \"$status\", \"float_time\": $float_time, \"taffo_time\": $taffo_time, \"speedup\": $speedup, $errors}" )
+done
+
+{
+  printf '{\n  "version": 1,\n  "kernels": ['
+  for i in "${!results[@]}"; do
+    printf '%s\n%s' "$([[ $i -gt 0 ]] && echo ,)" "${results[$i]}"
+  done
+  printf '\n  ]\n}\n'
+} > "${output_file:-/dev/stdout}"
+
+if [[ $del_work_dir -ne 0 ]]; then
+  rm -rf "$work_dir"
+fi
+exit $failed
@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# Check of the warm start of the feedback estimator across builds.
+#
+# The same kernel is built twice with taffo -feedback -feedback-state in a
+# fresh state directory. The first build must save exactly one state, and
+# the second one must find it under the same key and restart from it
+# instead of saving a new one. The exit status is 1 if it did not.
+
+SCRIPTPATH=$(cd "$(dirname "$BASH_SOURCE")" && pwd)
+
+taffo=taffo
+kernel=gemm
+work_dir=
+taffo_flags=
+
+parse_state=0
+for opt in "$@"; do
+  case $parse_state in
+    0)
+      case $opt in
+        -taffo) parse_state=1 ;;
+        -kernel) parse_state=2 ;;
+        -work-dir) parse_state=3 ;;
+        -Xtaffo) parse_state=4 ;;
+        -h|-help|--help)
+          cat << HELP_END
+Usage: run-feedback-state.sh [options]
+
+Builds a kernel of ${SCRIPTPATH}/../bench twice with the feedback
+estimator and checks that the second build restarts from the state saved
+by the first one.
+
+Options:
+  -taffo <path>         The taffo script to use (Default: taffo in PATH)
+  -kernel <name>        The benchmark kernel to build (Default: $kernel)
+  -work-dir <dir>       Keep the programs, the logs and the state in <dir>
+                        (Default: a temporary directory, then removed)
+  -Xtaffo <option>      Pass the specified option to taffo
+HELP_END
+          exit 0
+          ;;
+        *) echo "Unknown option $opt" 1>&2; exit 2 ;;
+      esac
+      ;;
+    1) taffo="$opt"; parse_state=0 ;;
+    2) kernel="$opt"; parse_state=0 ;;
+    3) work_dir="$opt"; parse_state=0 ;;
+    4) taffo_flags="$taffo_flags $opt"; parse_state=0 ;;
+  esac
+done
+
+del_work_dir=0
+if [[ -z "$work_dir" ]]; then
+  work_dir=$(mktemp -d)
+  del_work_dir=1
+fi
+state_dir="$work_dir/state"
+rm -rf "$state_dir"
+mkdir -p "$work_dir" || exit 1
+
+bench_dir="${SCRIPTPATH}/../bench"
+# Builds the kernel with the log of the build in $1, and prints the saved
+# keys of the feedback state
+build()
+{
+  "$taffo" -O3 -I"$bench_dir" ${taffo_flags} -feedback -feedback-state "$state_dir" \
+    -o "$work_dir/$kernel" "$bench_dir/kernels/$kernel.c" "$bench_dir/bench.c" -lm \
+    > "$1" 2>&1 || return 1
+  ls "$state_dir" | grep '\.flags$'
+}
+
+failed=0
+if ! first=$(build "$work_dir/first.log"); then
+  echo "FAIL: the first build failed, see $work_dir/first.log" 1>&2
+  failed=1
+elif [[ $(echo "$first" | grep -c .) -ne 1 ]]; then
+  echo "FAIL: the first build saved $(echo "$first" | grep -c .) states instead of one" 1>&2
+  failed=1
+elif ! second=$(build "$work_dir/second.log"); then
+  echo "FAIL: the second build failed, see $work_dir/second.log" 1>&2
+  failed=1
+elif [[ "$second" != "$first" ]]; then
+  echo "FAIL: the second build did not find the state of the first one" 1>&2
+  echo "  first:  $first" 1>&2
+  echo "  second: $(echo $second)" 1>&2
+  failed=1
+else
+  echo "PASS: the second build restarted from $first" 1>&2
+fi
+
+if [[ ( $del_work_dir -ne 0 ) && ( $failed -eq 0 ) ]]; then
+  rm -rf "$work_dir"
+fi
+exit $failed
@@ -0,0 +1,194 @@
+#!/bin/bash
+#
+# Compile-time scalability benchmark of the TAFFO stages.
+#
+# For each size, taffo-synth generates a synthetic annotated module with
+# that number of functions (and the other parameters given with -Xsynth),
+# and each stage of TAFFO is run on the output of the previous one by a
+# separate taffo-driver process, so that its peak resident set size is its
+# own. The results are written in JSON:
+#
+#   {"version": 1, "synth_flags": ..., "max_exponent": ...,
+#    "stages": [{"name": ..., "time_exponent": ..., "memory_exponent": ...,
+#                "superlinear": ..., "points": [{"functions": ...,
+#                "instructions": ..., "wall": ..., "user": ...,
+#                "peak_rss_kib": ...}, ...]}, ...]}
+#
+# The exponents are the slopes of the least squares fits of the logarithm
+# of the wall time and of the peak RSS against the logarithm of the number
+# of instructions. A stage is superlinear when its time exponent is above
+# -max-exponent and its time on the largest module is above -min-time; the
+# exit status is then 1. The work directory also gets the data points in
+# scale.dat and a gnuplot script plot.gp which plots them to time.png and
+# memory.png (run with -plot).
+
+driver=taffo-driver
+synth=taffo-synth
+plugin=
+output_file=
+sizes="25 50 100 200 400"
+synth_flags=
+max_exponent=1.5
+min_time=0.5
+work_dir=
+plot=0
+stages="init vra dta conversion err"
+
+parse_state=0
+for opt in "$@"; do
+  case $parse_state in
+    0)
+      case $opt in
+        -driver) parse_state=1 ;;
+        -synth) parse_state=2 ;;
+        -load) parse_state=3 ;;
+        -o) parse_state=4 ;;
+        -sizes) parse_state=5 ;;
+        -Xsynth) parse_state=6 ;;
+        -max-exponent) parse_state=7 ;;
+        -min-time) parse_state=8 ;;
+        -work-dir) parse_state=9 ;;
+        -stages) parse_state=10 ;;
+        -plot) plot=1 ;;
+        *)
+          cat << HELP_END
+Usage: run-scale.sh -load <Taffo.so> [options]
+
+Measures how the compile time and the memory of each stage of TAFFO grow
+with the size of synthetic modules, and reports them in JSON.
+
+Options:
+  -load <plugin>        The TAFFO passes plugin
+  -driver <path>        The taffo-driver tool (Default: taffo-driver in PATH)
+  -synth <path>         The taffo-synth tool (Default: taffo-synth in PATH)
+  -o <file>             Write the JSON report to <file> (Default: stdout)
+  -sizes "<N>..."       Numbers of functions of the modules
+                        (Default: "$sizes")
+  -Xsynth <option>      Pass the specified option to taffo-synth, for example
+                        -loop-depth=3 or -annotation-density=1
+  -stages "<stage>..."  The stages to measure (Default: "$stages")
+  -max-exponent <E>     Fail when the time of a stage grows faster than
+                        the number of instructions to the power E
+                        (Default: $max_exponent)
+  -min-time <seconds>   Ignore the stages faster than this on the largest
+                        module (Default: $min_time)
+  -work-dir <dir>       Keep the modules and the data points in <dir>
+                        (Default: a temporary directory, then removed)
+  -plot                 Plot the data points with gnuplot in the work
+                        directory
+HELP_END
+          exit 0
+          ;;
+      esac
+      ;;
+    1) driver="$opt"; parse_state=0 ;;
+    2) synth="$opt"; parse_state=0 ;;
+    3) plugin="$opt"; parse_state=0 ;;
+    4) output_file="$opt"; parse_state=0 ;;
+    5) sizes="$opt"; parse_state=0 ;;
+    6) synth_flags="$synth_flags $opt"; parse_state=0 ;;
+    7) max_exponent="$opt"; parse_state=0 ;;
+    8) min_time="$opt"; parse_state=0 ;;
+    9) work_dir="$opt"; parse_state=0 ;;
+    10) stages="$opt"; parse_state=0 ;;
+  esac
+done
+
+plugin_opts=
+if [[ ! ( -z "$plugin" ) ]]; then
+  plugin_opts="-load=$plugin"
+fi
+
+del_work_dir=0
+if [[ -z "$work_dir" ]]; then
+  work_dir=$(mktemp -d)
+  del_work_dir=1
+fi
+mkdir -p "$work_dir" || exit 1
+data_file="$work_dir/scale.dat"
+rm -f "$data_file"
+
+# The data points are tab-separated lines
+# <stage> <functions> <instructions> <wall> <user> <peak RSS KiB>
+for n in $sizes; do
+  echo "functions: $n" 1>&2
+  input="$work_dir/synth.$n.ll"
+  "$synth" -S -functions=$n $synth_flags -o "$input" || exit 1
+  instructions=$(awk '/^  [^ ;]/ { n++ } END { print n + 0 }' "$input")
+  for stage in $stages; do
+    output="$work_dir/synth.$n.$stage.ll"
+    report="$work_dir/synth.$n.$stage.time.txt"
+    rm -f "$report"
+    "$driver" $plugin_opts -S -disable-verify \
+      -first-stage=$stage -last-stage=$stage \
+      -time-report-file "$report" \
+      -o "$output" "$input" > "$work_dir/synth.$n.$stage.log" 2>&1 || {
+        echo "$stage failed on $input, see $work_dir/synth.$n.$stage.log" 1>&2
+        exit 1
+      }
+    awk -F '\t' -v stage=$stage -v n=$n -v insts=$instructions \
+      '$1 == stage { printf "%s\t%d\t%d\t%s\t%s\t%s\n", stage, n, insts, $2, $3, $4 }' \
+      "$report" >> "$data_file"
+    input="$output"
+  done
+done
+
+cat > "$work_dir/plot.gp" << PLOT_END
+set terminal png size 800,600
+set logscale xy
+set key left top
+set xlabel "instructions"
+set output "time.png"
+set ylabel "wall time (s)"
+plot $(for s in $stages; do printf '"scale.dat" using (strcol(1) eq "%s" ? $3 : NaN):4 with linespoints title "%s", ' $s $s; done | sed 's/, $//')
+set output "memory.png"
+set ylabel "peak RSS (KiB)"
+plot $(for s in $stages; do printf '"scale.dat" using (strcol(1) eq "%s" ? $3 : NaN):6 with linespoints title "%s", ' $s $s; done | sed 's/, $//')
+PLOT_END
+if [[ $plot -ne 0 ]]; then
+  (cd "$work_dir" && gnuplot plot.gp) || echo "Cannot run gnuplot" 1>&2
+fi
+
+awk -F '\t' -v stages="$stages" -v flags="$synth_flags" -v maxexp=$max_exponent -v mintime=$min_time '
+  function slope(s, col,    i, x, y, sx, sy, sxx, sxy, k) {
+    k = 0
+    for (i = 0; i < count[s]; i++) {
+      if (insts[s, i] <= 0 || val[s, i, col] <= 0)
+        continue
+      x = log(insts[s, i]); y = log(val[s, i, col])
+      sx += x; sy += y; sxx += x * x; sxy += x * y; k++
+    }
+    if (k < 2 || k * sxx - sx * sx == 0)
+      return "null"
+    return sprintf("%.3f", (k * sxy - sx * sy) / (k * sxx - sx * sx))
+  }
+  {
+    i = count[$1]++
+    funcs[$1, i] = $2; insts[$1, i] = $3
+    val[$1, i, 4] = $4; val[$1, i, 5] = $5; val[$1, i, 6] = $6
+  }
+  END {
+    gsub(/^ +/, "", flags); gsub(/["\\]/, "\\\\&", flags)
+    printf "{\n  \"version\": 1,\n  \"synth_flags\": \"%s\",\n  \"max_exponent\": %s,\n  \"stages\": [", flags, maxexp
+    ns = split(stages, names, " ")
+    failed = 0
+    for (j = 1; j <= ns; j++) {
+      s = names[j]
+      te = slope(s, 4); me = slope(s, 6)
+      last = count[s] - 1
+      super = (te != "null" && te + 0 > maxexp && val[s, last, 4] + 0 > mintime)
+      if (super) failed = 1
+      printf "%s\n    {\"name\": \"%s\", \"time_exponent\": %s, \"memory_exponent\": %s, \"superlinear\": %s, \"points\": [", (j > 1 ? "," : ""), s, te, me, (super ? "true" : "false")
+      for (i = 0; i < count[s]; i++)
+        printf "%s\n      {\"functions\": %d, \"instructions\": %d, \"wall\": %s, \"user\": %s, \"peak_rss_kib\": %s}", (i > 0 ? "," : ""), funcs[s, i], insts[s, i], val[s, i, 4], val[s, i, 5], val[s, i, 6]
+      printf "\n    ]}"
+    }
+    printf "\n  ]\n}\n"
+    exit failed
+  }' "$data_file" > "${output_file:-/dev/stdout}"
+status=$?
+
+if [[ $del_work_dir -ne 0 ]]; then
+  rm -rf "$work_dir"
+fi
+exit $status
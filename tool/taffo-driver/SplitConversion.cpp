@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <system_error>
+#include <unistd.h>
+#include "SplitConversion.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+using namespace llvm;
+
+
+namespace {
+
+/* Collects the global values referenced by a value, a constant or a metadata
+ * node, looking through constant expressions, aggregates and MDNodes */
+class GlobalRefCollector {
+public:
+  SmallVector<const GlobalValue *, 16> Refs;
+
+  void collect(const Value *V)
+  {
+    if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
+      Refs.push_back(GV);
+      return;
+    }
+    if (const MetadataAsValue *MAV = dyn_cast<MetadataAsValue>(V)) {
+      collect(MAV->getMetadata());
+      return;
+    }
+    const Constant *C = dyn_cast<Constant>(V);
+    if (!C || !VisitedValues.insert(C).second)
+      return;
+    for (const Use& Op: C->operands())
+      collect(Op.get());
+  }
+
+  void collect(const Metadata *MD)
+  {
+    if (!VisitedMD.insert(MD).second)
+      return;
+    if (const ValueAsMetadata *VAM = dyn_cast<ValueAsMetadata>(MD)) {
+      collect(VAM->getValue());
+    } else if (const MDNode *N = dyn_cast<MDNode>(MD)) {
+      for (const MDOperand& Op: N->operands()) {
+        if (Op)
+          collect(Op.get());
+      }
+    }
+  }
+
+  /* Debug info is skipped: it never refers to the definitions in a way
+   * which matters to the Conversion, and walking it from every function
+   * would be quadratic */
+  void collectAttachments(const GlobalObject& GO)
+  {
+    SmallVector<std::pair<unsigned, MDNode *>, 8> MDs;
+    GO.getAllMetadata(MDs);
+    for (auto& KindAndNode: MDs) {
+      if (KindAndNode.first != LLVMContext::MD_dbg)
+        collect(KindAndNode.second);
+    }
+  }
+
+  void collectAttachments(const Instruction& I)
+  {
+    SmallVector<std::pair<unsigned, MDNode *>, 8> MDs;
+    I.getAllMetadataOtherThanDebugLoc(MDs);
+    for (auto& KindAndNode: MDs)
+      collect(KindAndNode.second);
+  }
+
+private:
+  SmallPtrSet<const Value *, 32> VisitedValues;
+  SmallPtrSet<const Metadata *, 32> VisitedMD;
+};
+
+}
+
+
+unsigned partitionForConversion(Module& M, unsigned maxParts,
+    DenseMap<const GlobalValue *, unsigned>& partOf)
+{
+  /* aliases would need the aliasee in every partition where they are used */
+  if (!M.alias_empty() || !M.ifunc_empty())
+    return 0;
+
+  EquivalenceClasses<const GlobalValue *> classes;
+  DenseMap<const GlobalValue *, unsigned> weight;
+  DenseMap<const Comdat *, const GlobalValue *> comdatLeader;
+
+  auto addDefinition = [&](const GlobalObject& GO, GlobalRefCollector& refs, unsigned w) {
+    classes.insert(&GO);
+    weight[&GO] = w;
+    for (const GlobalValue *Ref: refs.Refs) {
+      if (!Ref->isDeclaration())
+        classes.unionSets(&GO, Ref);
+    }
+    if (const Comdat *C = GO.getComdat()) {
+      auto Leader = comdatLeader.insert({C, &GO});
+      if (!Leader.second)
+        classes.unionSets(&GO, Leader.first->second);
+    }
+  };
+
+  for (const GlobalVariable& GV: M.globals()) {
+    if (GV.isDeclaration())
+      continue;
+    GlobalRefCollector refs;
+    refs.collect(GV.getInitializer());
+    refs.collectAttachments(GV);
+    addDefinition(GV, refs, 1);
+  }
+  for (const Function& F: M.functions()) {
+    if (F.isDeclaration())
+      continue;
+    GlobalRefCollector refs;
+    unsigned numInstrs = 0;
+    refs.collectAttachments(F);
+    if (F.hasPersonalityFn())
+      refs.collect(F.getPersonalityFn());
+    for (const BasicBlock& BB: F) {
+      for (const Instruction& I: BB) {
+        numInstrs++;
+        for (const Use& Op: I.operands())
+          refs.collect(Op.get());
+        refs.collectAttachments(I);
+      }
+    }
+    addDefinition(F, refs, numInstrs);
+  }
+
+  /* Named metadata is kept in a single partition, thus everything it
+   * refers to must be there too */
+  const GlobalValue *namedMDLeader = nullptr;
+  for (const NamedMDNode& NMD: M.named_metadata()) {
+    GlobalRefCollector refs;
+    for (const MDNode *N: NMD.operands())
+      refs.collect(N);
+    for (const GlobalValue *Ref: refs.Refs) {
+      if (Ref->isDeclaration())
+        continue;
+      if (namedMDLeader)
+        classes.unionSets(namedMDLeader, Ref);
+      else
+        namedMDLeader = Ref;
+    }
+  }
+
+  /* Greedy bin packing of the components, largest first */
+  std::vector<std::pair<unsigned, std::vector<const GlobalValue *>>> components;
+  for (auto I = classes.begin(), E = classes.end(); I != E; ++I) {
+    if (!I->isLeader())
+      continue;
+    components.emplace_back();
+    for (auto MI = classes.member_begin(I); MI != classes.member_end(); ++MI) {
+      components.back().first += weight[*MI];
+      components.back().second.push_back(*MI);
+    }
+  }
+  std::stable_sort(components.begin(), components.end(),
+    [](const std::pair<unsigned, std::vector<const GlobalValue *>>& A,
+       const std::pair<unsigned, std::vector<const GlobalValue *>>& B) {
+      return A.first > B.first;
+    });
+
+  unsigned numParts = std::min<unsigned>(maxParts, components.size());
+  if (numParts < 2)
+    return 0;
+  std::vector<unsigned> load(numParts, 0);
+  for (auto& Comp: components) {
+    unsigned part = std::min_element(load.begin(), load.end()) - load.begin();
+    load[part] += Comp.first;
+    for (const GlobalValue *GV: Comp.second)
+      partOf[GV] = part;
+  }
+  /* the partition with the named metadata is always the first one */
+  if (namedMDLeader) {
+    unsigned mdPart = partOf[namedMDLeader];
+    for (auto& GVAndPart: partOf) {
+      if (GVAndPart.second == mdPart)
+        GVAndPart.second = 0;
+      else if (GVAndPart.second == 0)
+        GVAndPart.second = mdPart;
+    }
+  }
+  return numParts;
+}
+
+
+std::unique_ptr<Module> runSplitConversion(Module& M, unsigned jobs,
+    StringRef driverPath, ArrayRef<std::string> childArgs, bool& error)
+{
+  error = false;
+  DenseMap<const GlobalValue *, unsigned> partOf;
+  unsigned numParts = partitionForConversion(M, jobs, partOf);
+  if (numParts < 2)
+    return nullptr;
+
+  std::vector<SmallString<128>> inputs(numParts), outputs(numParts);
+  std::vector<std::unique_ptr<FileRemover>> removers;
+  for (unsigned i = 0; i < numParts; i++) {
+    int fd;
+    if (std::error_code ec = sys::fs::createTemporaryFile("taffo-part", "bc", fd, inputs[i])) {
+      errs() << "Cannot create a temporary file: " << ec.message() << "\n";
+      error = true;
+      return nullptr;
+    }
+    removers.push_back(std::make_unique<FileRemover>(inputs[i]));
+    if (std::error_code ec = sys::fs::createTemporaryFile("taffo-part", "bc", outputs[i])) {
+      close(fd);
+      errs() << "Cannot create a temporary file: " << ec.message() << "\n";
+      error = true;
+      return nullptr;
+    }
+    removers.push_back(std::make_unique<FileRemover>(outputs[i]));
+
+    ValueToValueMapTy VMap;
+    std::unique_ptr<Module> part = CloneModule(M, VMap, [&](const GlobalValue *GV) {
+      auto it = partOf.find(GV);
+      return it != partOf.end() && it->second == i;
+    });
+    /* The definitions of the other partitions are left as unused external
+     * declarations by CloneModule; linking them back would clash with the
+     * internal definitions they come from */
+    for (auto& GVAndPart: partOf) {
+      if (GVAndPart.second == i)
+        continue;
+      GlobalValue *Decl = cast<GlobalValue>(VMap[GVAndPart.first]);
+      Decl->removeDeadConstantUsers();
+      assert(Decl->use_empty() && "definition referenced across partitions");
+      Decl->eraseFromParent();
+    }
+    /* named metadata would be duplicated by the linker */
+    if (i != 0) {
+      for (NamedMDNode& NMD: make_early_inc_range(part->named_metadata())) {
+        if (NMD.getName() != "llvm.module.flags")
+          part->eraseNamedMetadata(&NMD);
+      }
+    }
+
+    raw_fd_ostream out(fd, true);
+    WriteBitcodeToFile(*part, out);
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      errs() << "Cannot write " << inputs[i] << "\n";
+      error = true;
+      return nullptr;
+    }
+  }
+
+  std::vector<sys::ProcessInfo> children;
+  for (unsigned i = 0; i < numParts; i++) {
+    std::vector<StringRef> args = {driverPath};
+    for (const std::string& arg: childArgs)
+      args.push_back(arg);
+    args.push_back(inputs[i]);
+    args.push_back("-o");
+    args.push_back(outputs[i]);
+    std::string errMsg;
+    bool failed = false;
+    children.push_back(sys::ExecuteNoWait(driverPath, args, None, {}, 0, &errMsg, &failed));
+    if (failed) {
+      errs() << "Cannot execute " << driverPath << ": " << errMsg << "\n";
+      error = true;
+    }
+  }
+  for (sys::ProcessInfo& child: children) {
+    if (child.Pid == 0)
+      continue;
+    std::string errMsg;
+    sys::ProcessInfo res = sys::Wait(child, 0, true, &errMsg);
+    if (res.ReturnCode != 0)
+      error = true;
+  }
+  if (error)
+    return nullptr;
+
+  std::unique_ptr<Module> res;
+  for (unsigned i = 0; i < numParts; i++) {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> part = parseIRFile(outputs[i], Err, M.getContext());
+    if (!part) {
+      Err.print("taffo-driver", errs());
+      error = true;
+      return nullptr;
+    }
+    if (!res) {
+      res = std::move(part);
+      continue;
+    }
+    if (Linker::linkModules(*res, std::move(part))) {
+      errs() << "Cannot link the converted partitions\n";
+      error = true;
+      return nullptr;
+    }
+  }
+  res->setModuleIdentifier(M.getModuleIdentifier());
+  return res;
+}
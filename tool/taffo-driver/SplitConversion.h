@@ -0,0 +1,34 @@
+#ifndef TAFFO_DRIVER_SPLIT_CONVERSION_H
+#define TAFFO_DRIVER_SPLIT_CONVERSION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/Module.h"
+
+
+/* Partitions the definitions of M in at most maxParts groups such that the
+ * Conversion pass can run on each of them independently. Two definitions
+ * are in the same group when one references the other, either through its
+ * code, its initializer or its metadata (taffo.funinfo,
+ * taffo.equivalentChild, taffo.originalCall, ...), or when they share a
+ * comdat. Whatever is referenced by named metadata ends up in the first
+ * group. Returns the number of groups actually produced (0 if the module
+ * cannot be partitioned). */
+unsigned partitionForConversion(llvm::Module& M, unsigned maxParts,
+    llvm::DenseMap<const llvm::GlobalValue *, unsigned>& partOf);
+
+/* Runs the Conversion stage on the partitions of M in parallel processes,
+ * each one started as "driverPath childArgs... <input> -o <output>",
+ * and links the results back together.
+ * Returns nullptr if the module was not split; in that case an error has
+ * been printed only if error is set. */
+std::unique_ptr<llvm::Module> runSplitConversion(llvm::Module& M, unsigned jobs,
+    llvm::StringRef driverPath, llvm::ArrayRef<std::string> childArgs, bool& error);
+
+
+#endif
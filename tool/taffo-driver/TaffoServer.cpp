@@ -0,0 +1,256 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "TaffoServer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+
+/* Protocol
+ * client -> server: a uint32 header with the length of the payload, sent
+ *   together with the stdin, stdout and stderr of the client as SCM_RIGHTS
+ *   ancillary data, followed by the payload: the working directory and
+ *   the arguments, each one terminated by a NUL character.
+ * server -> client: the exit code of the job as an int32.
+ * Since the client streams are used directly by the job, diagnostics reach
+ * the client as they are printed. */
+
+static const int NumForwardedFds = 3;
+
+
+static bool writeAll(int fd, const void *buf, size_t len)
+{
+  const char *p = static_cast<const char *>(buf);
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+static bool readAll(int fd, void *buf, size_t len)
+{
+  char *p = static_cast<char *>(buf);
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+static bool fillSocketAddress(sockaddr_un& addr, StringRef path)
+{
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    errs() << "Socket path " << path << " is too long\n";
+    return false;
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+
+static bool receiveHeader(int conn, uint32_t& len, int fds[NumForwardedFds])
+{
+  char control[CMSG_SPACE(sizeof(int) * NumForwardedFds)];
+  iovec iov = {&len, sizeof(len)};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n;
+  do {
+    n = recvmsg(conn, &msg, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n != sizeof(len))
+    return false;
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int) * NumForwardedFds))
+    return false;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * NumForwardedFds);
+  return true;
+}
+
+
+static void serveConnection(int conn, TaffoServerJob& job)
+{
+  uint32_t len;
+  int fds[NumForwardedFds];
+  if (!receiveHeader(conn, len, fds)) {
+    errs() << "taffo-server: malformed request\n";
+    return;
+  }
+  std::string payload(len, '\0');
+  if (!readAll(conn, &payload[0], len)) {
+    for (int fd: fds)
+      close(fd);
+    errs() << "taffo-server: truncated request\n";
+    return;
+  }
+
+  std::vector<std::string> fields;
+  for (StringRef rest = payload; !rest.empty();) {
+    std::pair<StringRef, StringRef> split = rest.split('\0');
+    fields.push_back(std::string(split.first));
+    rest = split.second;
+  }
+  if (fields.empty()) {
+    for (int fd: fds)
+      close(fd);
+    return;
+  }
+  std::vector<std::string> args(fields.begin() + 1, fields.end());
+
+  /* Switch to the environment of the client for the duration of the job */
+  int savedCwd = open(".", O_RDONLY);
+  int savedFds[NumForwardedFds];
+  outs().flush();
+  errs().flush();
+  for (int i = 0; i < NumForwardedFds; i++) {
+    savedFds[i] = dup(i);
+    dup2(fds[i], i);
+    close(fds[i]);
+  }
+
+  int ret;
+  if (sys::fs::set_current_path(fields[0])) {
+    errs() << "taffo-server: cannot change directory to " << fields[0] << "\n";
+    ret = 1;
+  } else {
+    ret = job(args);
+  }
+
+  outs().flush();
+  errs().flush();
+  for (int i = 0; i < NumForwardedFds; i++) {
+    dup2(savedFds[i], i);
+    close(savedFds[i]);
+  }
+  if (savedCwd >= 0) {
+    if (fchdir(savedCwd))
+      errs() << "taffo-server: cannot restore the working directory\n";
+    close(savedCwd);
+  }
+
+  int32_t reply = ret;
+  writeAll(conn, &reply, sizeof(reply));
+}
+
+
+int runTaffoServer(StringRef socketPath, TaffoServerJob job)
+{
+  sockaddr_un addr;
+  if (!fillSocketAddress(addr, socketPath))
+    return 1;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    errs() << "Cannot create socket: " << strerror(errno) << "\n";
+    return 1;
+  }
+  unlink(addr.sun_path);
+  if (bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(sock, SOMAXCONN)) {
+    errs() << "Cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+    close(sock);
+    return 1;
+  }
+  /* a client which goes away must not terminate the server */
+  signal(SIGPIPE, SIG_IGN);
+
+  /* The TAFFO passes keep their state in global variables (command line
+   * options, metadata caches), and the jobs use the client streams as the
+   * process standard streams: the jobs are therefore run one at a time,
+   * while the pending connections wait in the listen backlog. */
+  for (;;) {
+    int conn = accept(sock, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      errs() << "taffo-server: accept failed: " << strerror(errno) << "\n";
+      break;
+    }
+    serveConnection(conn, job);
+    close(conn);
+  }
+
+  close(sock);
+  unlink(addr.sun_path);
+  return 1;
+}
+
+
+int runTaffoClient(StringRef socketPath, int argc, const char *const *argv)
+{
+  sockaddr_un addr;
+  if (!fillSocketAddress(addr, socketPath))
+    return 1;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+    errs() << "Cannot connect to " << socketPath << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  SmallString<256> cwd;
+  if (sys::fs::current_path(cwd)) {
+    errs() << "Cannot get the current directory\n";
+    return 1;
+  }
+  std::string payload(cwd.str());
+  payload.push_back('\0');
+  for (int i = 0; i < argc; i++) {
+    payload += argv[i];
+    payload.push_back('\0');
+  }
+
+  uint32_t len = payload.size();
+  int fds[NumForwardedFds] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  iovec iov = {&len, sizeof(len)};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  int32_t reply;
+  if (sendmsg(sock, &msg, 0) != sizeof(len) || !writeAll(sock, payload.data(), payload.size()) ||
+      !readAll(sock, &reply, sizeof(reply))) {
+    errs() << "Connection to the TAFFO server lost\n";
+    close(sock);
+    return 1;
+  }
+  close(sock);
+  return reply;
+}
@@ -0,0 +1,25 @@
+#ifndef TAFFO_DRIVER_SERVER_H
+#define TAFFO_DRIVER_SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+
+
+/* Runs a compilation job with the given arguments (argv[0] excluded) and
+ * returns its exit code. When the job is called the standard streams and
+ * the working directory are the ones of the client. */
+typedef std::function<int(const std::vector<std::string>&)> TaffoServerJob;
+
+/* Listens on the Unix socket at socketPath and runs the jobs requested by
+ * the clients, one at a time, until an error occurs. */
+int runTaffoServer(llvm::StringRef socketPath, TaffoServerJob job);
+
+/* Sends the given arguments, the working directory and the standard streams
+ * of the current process to the server listening on socketPath, and returns
+ * the exit code of the job. */
+int runTaffoClient(llvm::StringRef socketPath, int argc, const char *const *argv);
+
+
+#endif
@@ -0,0 +1,1398 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "SplitConversion.h"
+#include "TaffoServer.h"
+#include "RangeGuards.h"
+#include "CloneSpecialization.h"
+#include "PointPosAssignment.h"
+#include "TargetCostModel.h"
+#include "StorageNarrowing.h"
+#include "RangeSummaries.h"
+#include "ErrorReport.h"
+#include "ErrorSummaries.h"
+#include "RegionTiming.h"
+#include "OverflowChecks.h"
+#include "Saturation.h"
+#include "BoundaryConversions.h"
+#include "StructRepacking.h"
+#include "Kernels.h"
+#include "ErrorBudget.h"
+#include "RangeFolding.h"
+#include "ReductionTypes.h"
+#include "IntegerNarrowing.h"
+#include "CloneMerging.h"
+#include "Metadata.h"
+#include "Trace.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/PluginLoader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PassInfo.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Target/TargetMachine.h"
+#if LLVM_VERSION_MAJOR >= 14
+#include "llvm/MC/TargetRegistry.h"
+#else
+#include "llvm/Support/TargetRegistry.h"
+#endif
+
+using namespace llvm;
+
+
+enum TaffoStage {
+  StageInit = 0,
+  StageVRA,
+  StageDTA,
+  StageConversion,
+  StageErrorProp,
+  NumStages
+};
+
+
+cl::OptionCategory TAFFODriverOptions("taffo-driver options");
+cl::opt<std::string> InputFilename(cl::Positional,
+  cl::desc("<input file>"),
+  cl::init("-"));
+cl::opt<std::string> OutputFilename("o",
+  cl::desc("Output filename"), cl::value_desc("filename"),
+  cl::init("-"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> OutputAssembly("S",
+  cl::desc("Write output as LLVM assembly"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<TaffoStage> FirstStage("first-stage",
+  cl::desc("First TAFFO stage to run"),
+  cl::values(
+    clEnumValN(StageInit, "init", "Initializer"),
+    clEnumValN(StageVRA, "vra", "Value Range Analysis"),
+    clEnumValN(StageDTA, "dta", "Data Type Allocation"),
+    clEnumValN(StageConversion, "conversion", "Conversion"),
+    clEnumValN(StageErrorProp, "err", "Error Propagation")),
+  cl::init(StageInit), cl::cat(TAFFODriverOptions));
+cl::opt<TaffoStage> LastStage("last-stage",
+  cl::desc("Last TAFFO stage to run"),
+  cl::values(
+    clEnumValN(StageInit, "init", "Initializer"),
+    clEnumValN(StageVRA, "vra", "Value Range Analysis"),
+    clEnumValN(StageDTA, "dta", "Data Type Allocation"),
+    clEnumValN(StageConversion, "conversion", "Conversion"),
+    clEnumValN(StageErrorProp, "err", "Error Propagation")),
+  cl::init(StageConversion), cl::cat(TAFFODriverOptions));
+cl::list<std::string> InitFlags("Xinit",
+  cl::desc("Pass the specified option to the Initializer pass"),
+  cl::value_desc("option"), cl::ZeroOrMore, cl::cat(TAFFODriverOptions));
+cl::list<std::string> VRAFlags("Xvra",
+  cl::desc("Pass the specified option to the VRA pass"),
+  cl::value_desc("option"), cl::ZeroOrMore, cl::cat(TAFFODriverOptions));
+cl::list<std::string> DTAFlags("Xdta",
+  cl::desc("Pass the specified option to the DTA pass"),
+  cl::value_desc("option"), cl::ZeroOrMore, cl::cat(TAFFODriverOptions));
+cl::list<std::string> ConversionFlags("Xconversion",
+  cl::desc("Pass the specified option to the Conversion pass"),
+  cl::value_desc("option"), cl::ZeroOrMore, cl::cat(TAFFODriverOptions));
+cl::list<std::string> ErrFlags("Xerr",
+  cl::desc("Pass the specified option to the Error Propagator pass"),
+  cl::value_desc("option"), cl::ZeroOrMore, cl::cat(TAFFODriverOptions));
+cl::opt<bool> DisableVRA("disable-vra",
+  cl::desc("Do not run the VRA pass"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<bool> NoMem2Reg("no-mem2reg",
+  cl::desc("Do not schedule mem2reg before VRA"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<bool> VRASummaries("vra-summaries",
+  cl::desc("Compute the ranges with summaries of the functions for each signature "
+           "of the ranges of their arguments, instead of the VRA pass"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> VRAJobs("vra-jobs",
+  cl::desc("With -vra-summaries, analyze the call graph from up to N roots in parallel"),
+  cl::value_desc("N"), cl::init(1), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> VRACache("vra-cache",
+  cl::desc("With -vra-summaries, reuse the summaries in the specified file of the functions "
+           "which did not change since, and save all the summaries to it"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> ErrSummaries("err-summaries",
+  cl::desc("Propagate the errors with summaries of the functions for each signature "
+           "of the errors of their arguments, instead of the Error Propagator pass"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> ErrJobs("err-jobs",
+  cl::desc("With -err-summaries, propagate the errors from up to N roots of the call graph in parallel"),
+  cl::value_desc("N"), cl::init(1), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> ErrCache("err-cache",
+  cl::desc("With -err-summaries, reuse the summaries in the specified file whose functions "
+           "and callee errors did not change since, and save all the summaries to it"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> ErrOut("err-out",
+  cl::desc("Redirect the output of the Error Propagator to the specified file"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> ErrReport("err-report",
+  cl::desc("Write a JSON report of the errors of the targets, of the comparisons which "
+           "may be wrong and of the functions to the specified file"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> TempDir("temp-dir",
+  cl::desc("Dump the module produced by each stage to the specified directory"),
+  cl::value_desc("dir"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> TempPrefix("temp-prefix",
+  cl::desc("Base name of the files dumped to -temp-dir"),
+  cl::value_desc("name"), cl::init("taffo"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> DisableVerify("disable-verify",
+  cl::desc("Do not verify the module after each stage"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> ConversionJobs("conversion-jobs",
+  cl::desc("Split the module after DTA and convert up to N partitions in parallel processes"),
+  cl::value_desc("N"), cl::init(1), cl::cat(TAFFODriverOptions));
+cl::opt<bool> RangeGuards("range-guards",
+  cl::desc("Before DTA, guard the calls to the converted functions with a check of the ranges "
+           "of their arguments, and call the original functions when they are out of range"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> SpecializeClones("specialize-clones",
+  cl::desc("After VRA, split each converted function in up to N copies, each one called "
+           "with arguments in ranges which need the same types, and run VRA again"),
+  cl::value_desc("N"), cl::init(1), cl::cat(TAFFODriverOptions));
+cl::opt<bool> FoldRanges("fold-ranges",
+  cl::desc("After VRA, replace the values whose range is a single point and "
+           "the comparisons decided by the ranges with constants, and remove "
+           "the branches they make dead"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> NarrowIntegers("narrow-integers",
+  cl::desc("After VRA, store the integer arrays and compute the integer "
+           "operations in N bits when their ranges fit in them"),
+  cl::value_desc("N"), cl::init(0), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> MinShifts("min-shifts",
+  cl::desc("After DTA, lower the point positions by up to N bits to minimize "
+           "the alignment shifts executed by the converted code"),
+  cl::value_desc("N"), cl::init(0), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> NarrowReductions("narrow-reductions",
+  cl::desc("After DTA, give N bit fixed point types to the arrays which are "
+           "only loaded as operands of the reductions of the loops, while "
+           "the accumulators keep the types chosen by DTA"),
+  cl::value_desc("N"), cl::init(0), cl::cat(TAFFODriverOptions));
+cl::list<std::string> ErrorBudgets("error-budget",
+  cl::desc("After DTA, give the fewest bits to the values which reach the "
+           "targets while keeping their absolute error within the budget: "
+           "<error> for all the targets, or <target>=<error>"),
+  cl::CommaSeparated, cl::value_desc("budget,..."), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> NarrowStorage("narrow-storage",
+  cl::desc("After DTA, store the arrays, the globals and the structure "
+           "fields in the given format (8, 16 or 32 bit fixed point, half "
+           "or bfloat16) when it is narrower than their computation type"),
+  cl::value_desc("format"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> CostModel("cost-model",
+  cl::desc("After DTA, keep in floating point the values whose conversion "
+           "would be slower with the cost model of the target: cortex-m4, "
+           "target (from the code generator of the target of the module) "
+           "or the name of a file with the costs of the operations"),
+  cl::value_desc("model"), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> OverflowChecks("overflow-checks",
+  cl::desc("After the Conversion, check the overflows of the fixed point "
+           "operations in one call every N of each function (1: every call) "
+           "and report them at run time"),
+  cl::value_desc("N"), cl::init(0), cl::cat(TAFFODriverOptions));
+cl::opt<bool> OverflowChecksTargets("overflow-checks-targets",
+  cl::desc("With -overflow-checks, only check the targets and the values stored to them"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> Saturate("saturate",
+  cl::desc("After the Conversion, make the fixed point operations saturate "
+           "instead of wrapping around: all, targets (the targets and the "
+           "values stored to them) or edge (the values whose range reaches "
+           "the outer half of their type)"),
+  cl::value_desc("mode"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> VectorizeBoundaries("vectorize-boundaries",
+  cl::desc("After the Conversion, replace the loops which convert whole "
+           "arrays between floating point and fixed point with calls to the "
+           "vectorized conversion routines of the runtime"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<bool> RepackStructs("repack-structs",
+  cl::desc("After the Conversion, reorder the fields of the structures whose "
+           "layout is only known to the module to remove their padding"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<bool> MergeClones("merge-clones",
+  cl::desc("After the Conversion, merge the functions cloned by TAFFO whose "
+           "converted code is the same, and redirect their calls"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> MergeClonesReport("merge-clones-report",
+  cl::desc("Write a JSON report of the clones merged by -merge-clones and of "
+           "the estimate of the bytes of code saved"),
+  cl::value_desc("file"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> Kernels("kernels",
+  cl::desc("Before the Initializer, make the OpenCL, SPIR, AMDGPU and NVPTX "
+           "kernels of the module starting points"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> CacheDir("cache-dir",
+  cl::desc("Directory where the outputs of the stages are cached (default: $TAFFO_CACHE_DIR)"),
+  cl::value_desc("dir"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> NoCache("no-cache",
+  cl::desc("Do not use the stage output cache"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> Serve("serve",
+  cl::desc("Keep the plugins loaded and serve the compilation jobs sent by "
+           "'taffo-driver -connect <socket> ...' on the specified Unix socket"),
+  cl::value_desc("socket"), cl::cat(TAFFODriverOptions));
+cl::opt<bool> TimeReport("time-report",
+  cl::desc("Print wall time, user time and peak RSS of each stage"),
+  cl::init(false), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> TimeReportFile("time-report-file",
+  cl::desc("Append the time report records to the specified file"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> StatsJsonFile("stats-json-file",
+  cl::desc("Write the statistics counters of each stage to the specified file in JSON format"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::opt<std::string> TraceFile("trace",
+  cl::desc("Write the ranges and the types chosen by the stages to the "
+           "specified file in the binary format read by taffo-trace"),
+  cl::value_desc("filename"), cl::cat(TAFFODriverOptions));
+cl::list<std::string> TraceStages("trace-stages",
+  cl::desc("Only trace the specified stages: init, vra, dta, conversion, "
+           "errorprop, driver"),
+  cl::CommaSeparated, cl::value_desc("stage,..."), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> TraceSample("trace-sample",
+  cl::desc("Only trace one event every N events of each stage"),
+  cl::init(1), cl::value_desc("N"), cl::cat(TAFFODriverOptions));
+cl::opt<unsigned> TraceRing("trace-ring",
+  cl::desc("Only keep the last N events of the trace in memory, and write "
+           "them at the end"),
+  cl::init(0), cl::value_desc("N"), cl::cat(TAFFODriverOptions));
+
+
+struct StageDesc {
+  const char *Name;
+  /* index of the stage in the names of the temporary files produced by
+   * the taffo driver script */
+  int TempIndex;
+  cl::list<std::string> *Flags;
+};
+
+static const StageDesc Stages[NumStages] = {
+  {"init", 2, std::addressof(InitFlags)},
+  {"vra", 3, std::addressof(VRAFlags)},
+  {"dta", 4, std::addressof(DTAFlags)},
+  {"conversion", 5, std::addressof(ConversionFlags)},
+  {"err", 6, std::addressof(ErrFlags)}
+};
+
+
+std::vector<const char *> passesForStage(TaffoStage stage)
+{
+  switch (stage) {
+    case StageInit:
+      return {"taffoinit"};
+    case StageVRA:
+      if (DisableVRA || (VRASummaries && NoMem2Reg))
+        return {};
+      if (VRASummaries)
+        return {"mem2reg"};
+      if (NoMem2Reg)
+        return {"taffoVRA"};
+      return {"mem2reg", "taffoVRA"};
+    case StageDTA:
+      return {"taffodta", "globaldce"};
+    case StageConversion:
+      return {"flttofix", "globaldce", "dce"};
+    case StageErrorProp:
+      if (ErrSummaries)
+        return {};
+      return {"errorprop"};
+    default:
+      llvm_unreachable("unknown stage");
+  }
+}
+
+
+bool writeModule(Module& m, StringRef filename, bool assembly)
+{
+  std::error_code ec;
+  ToolOutputFile out(filename, ec, assembly ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (ec) {
+    errs() << "Cannot open " << filename << ": " << ec.message() << "\n";
+    return false;
+  }
+  if (assembly)
+    m.print(out.os(), nullptr);
+  else
+    WriteBitcodeToFile(m, out.os());
+  out.keep();
+  return true;
+}
+
+
+bool runStage(Module& m, TaffoStage stage)
+{
+  /* the kernels are the entry points of the device code, which has no main */
+  if (stage == StageInit && Kernels)
+    taffo::markKernelEntryPoints(m);
+
+  /* the original functions which are not called anymore are removed by
+   * DTA, after which the calls cannot fall back to them */
+  if (stage == StageDTA && RangeGuards)
+    taffo::insertRangeGuards(m);
+
+  legacy::PassManager passManager;
+  PassRegistry &registry = *PassRegistry::getPassRegistry();
+  for (const char *passName: passesForStage(stage)) {
+    const PassInfo *pi = registry.getPassInfo(StringRef(passName));
+    if (!pi || !pi->getNormalCtor()) {
+      errs() << "Pass -" << passName << " required by stage " << Stages[stage].Name
+             << " not found; was the TAFFO plugin loaded with -load?\n";
+      return false;
+    }
+    passManager.add(pi->createPass());
+  }
+  if (!DisableVerify)
+    passManager.add(createVerifierPass());
+
+  /* The error propagator reports its results on stderr; the script used to
+   * capture them by redirecting the whole opt invocation */
+  int savedStderr = -1;
+  if (stage == StageErrorProp && !ErrOut.empty()) {
+    int fd;
+    std::error_code ec = sys::fs::openFileForWrite(ErrOut, fd, sys::fs::CD_CreateAlways, sys::fs::OF_Text);
+    if (ec) {
+      errs() << "Cannot open " << ErrOut << ": " << ec.message() << "\n";
+      return false;
+    }
+    errs().flush();
+    savedStderr = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+  }
+
+  passManager.run(m);
+
+  if (stage == StageErrorProp && ErrSummaries) {
+    taffo::SummaryErrorPropagation propagation(m);
+    if (!ErrCache.empty())
+      propagation.loadCache(ErrCache);
+    propagation.run(std::max(1U, (unsigned)ErrJobs));
+    propagation.annotate();
+    propagation.printTargetErrors(errs());
+    std::string error;
+    if (!ErrCache.empty() && !propagation.saveCache(ErrCache, error))
+      errs() << "Cannot write " << ErrCache << ": " << error << "\n";
+  }
+
+  if (savedStderr >= 0) {
+    errs().flush();
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStderr);
+  }
+
+  if (stage == StageErrorProp && !ErrReport.empty()) {
+    std::error_code ec;
+    raw_fd_ostream report(ErrReport, ec, sys::fs::OF_Text);
+    if (ec)
+      errs() << "Cannot open " << ErrReport << ": " << ec.message() << "\n";
+    else
+      taffo::writeErrorReport(m, report);
+  }
+
+  if (stage == StageVRA && VRASummaries && !DisableVRA) {
+    taffo::SummaryRangeAnalysis analysis(m);
+    if (!VRACache.empty())
+      analysis.loadCache(VRACache);
+    analysis.run(std::max(1U, (unsigned)VRAJobs));
+    analysis.annotate();
+    std::string error;
+    if (!VRACache.empty() && !analysis.saveCache(VRACache, error))
+      errs() << "Cannot write " << VRACache << ": " << error << "\n";
+  }
+  return true;
+}
+
+
+/* Splits the clones whose calls need different argument types, and runs
+ * VRA again so that the ranges in each copy only come from its own calls */
+bool runCloneSpecialization(Module& m)
+{
+  if (SpecializeClones < 2 || DisableVRA)
+    return true;
+  if (taffo::specializeClonesOnCallRanges(m, SpecializeClones) == 0)
+    return true;
+  return runStage(m, StageVRA);
+}
+
+
+/* Folds the constants and the branches proven by the ranges of VRA, with
+ * -fold-ranges */
+void runRangeFolding(Module& m)
+{
+  if (!FoldRanges || DisableVRA)
+    return;
+  for (Function& f: m) {
+    if (!f.isDeclaration())
+      taffo::foldRangeConstants(f);
+  }
+}
+
+
+/* Narrows the integers whose ranges fit in -narrow-integers bits */
+void runIntegerNarrowing(Module& m)
+{
+  if (NarrowIntegers == 0 || DisableVRA)
+    return;
+  taffo::narrowIntegerStorage(m, NarrowIntegers);
+  for (Function& f: m)
+    taffo::narrowIntegerArithmetic(f, NarrowIntegers);
+}
+
+
+/* Reassigns the point positions chosen by DTA, function by function */
+void runShiftMinimization(Module& m)
+{
+  if (MinShifts == 0)
+    return;
+  for (Function& f: m)
+    taffo::minimizePointPosShifts(f, MinShifts);
+}
+
+
+/* Narrows the operands of the reductions with -narrow-reductions */
+void runReductionNarrowing(Module& m)
+{
+  if (NarrowReductions == 0)
+    return;
+  taffo::narrowReductionOperands(m, NarrowReductions);
+}
+
+
+/* Reassigns the types chosen by DTA to meet the budgets of -error-budget */
+bool runErrorBudget(Module& m)
+{
+  if (ErrorBudgets.empty())
+    return true;
+  taffo::ErrorBudget budget;
+  for (const std::string& spec: ErrorBudgets) {
+    std::string error;
+    if (!budget.parse(spec, error)) {
+      errs() << error << "\n";
+      return false;
+    }
+  }
+  unsigned changed;
+  if (!taffo::allocateTypesForErrorBudget(m, budget, changed, std::max(1U, (unsigned)ErrJobs)))
+    errs() << "warning: the error budget cannot be met, the types chosen by DTA are kept\n";
+  return true;
+}
+
+
+/* Lowers to saturating arithmetic the operations selected by -saturate */
+bool runSaturation(Module& m)
+{
+  if (Saturate.empty())
+    return true;
+  taffo::SaturationMode mode;
+  if (!taffo::parseSaturationMode(Saturate, mode)) {
+    errs() << "Invalid saturation mode " << Saturate << "\n";
+    return false;
+  }
+  taffo::lowerToSaturatingArith(m, mode);
+  return true;
+}
+
+
+/* Replaces the array conversion loops of the converted code, with
+ * -vectorize-boundaries */
+void runBoundaryConversions(Module& m)
+{
+  if (!VectorizeBoundaries)
+    return;
+  taffo::vectorizeBoundaryConversions(m);
+}
+
+
+/* Removes the padding of the structures of the converted code, with
+ * -repack-structs */
+void runStructRepacking(Module& m)
+{
+  if (!RepackStructs)
+    return;
+  taffo::repackStructTypes(m);
+}
+
+
+/* Merges the equivalent clones with -merge-clones, and writes the report
+ * of -merge-clones-report */
+void runCloneMerging(Module& m)
+{
+  if (!MergeClones)
+    return;
+  std::vector<taffo::MergedClone> merged = taffo::mergeEquivalentClones(m);
+  if (MergeClonesReport.empty())
+    return;
+  std::error_code ec;
+  raw_fd_ostream report(MergeClonesReport, ec, sys::fs::OF_Text);
+  if (ec)
+    errs() << "Cannot open " << MergeClonesReport << ": " << ec.message() << "\n";
+  else
+    taffo::writeCloneMergeReport(merged, report);
+}
+
+
+/* Inserts the run time checks of the converted code selected by
+ * -overflow-checks */
+void runOverflowChecks(Module& m)
+{
+  if (OverflowChecks == 0)
+    return;
+  taffo::insertOverflowChecks(m, OverflowChecks, OverflowChecksTargets);
+}
+
+
+/* Narrows the types of the data in memory as selected by -narrow-storage */
+bool runStorageNarrowing(Module& m)
+{
+  if (NarrowStorage.empty())
+    return true;
+  taffo::StorageFormat format;
+  if (!taffo::parseStorageFormat(NarrowStorage, format)) {
+    errs() << "Invalid storage format " << NarrowStorage << "\n";
+    return false;
+  }
+  taffo::narrowStorageTypes(m, format);
+  return true;
+}
+
+
+/* Keeps in float the values of each function whose conversion would be a
+ * slowdown according to the cost model selected by -cost-model */
+bool runCostModel(Module& m)
+{
+  if (CostModel.empty())
+    return true;
+
+  if (CostModel == "target") {
+    std::string error;
+    const Target *target = TargetRegistry::lookupTarget(m.getTargetTriple(), error);
+    if (!target) {
+      errs() << "Cannot create the cost model of " << m.getTargetTriple() << ": " << error << "\n";
+      return false;
+    }
+    std::unique_ptr<TargetMachine> tm(target->createTargetMachine(
+      m.getTargetTriple(), "", "", TargetOptions(), None));
+    for (Function& f: m) {
+      if (f.isDeclaration())
+        continue;
+      taffo::TargetCostModel model =
+        taffo::TargetCostModel::fromTargetTransformInfo(tm->getTargetTransformInfo(f), m.getContext());
+      taffo::revertUnprofitableConversions(f, model);
+    }
+    return true;
+  }
+
+  taffo::TargetCostModel model;
+  if (const taffo::TargetCostModel *builtin = taffo::TargetCostModel::getBuiltin(CostModel)) {
+    model = *builtin;
+  } else {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(CostModel);
+    if (std::error_code ec = file.getError()) {
+      errs() << "Cannot open " << CostModel << ": " << ec.message() << "\n";
+      return false;
+    }
+    std::string error;
+    if (!model.parse((*file)->getBuffer(), error)) {
+      errs() << CostModel << ": " << error << "\n";
+      return false;
+    }
+  }
+  for (Function& f: m)
+    taffo::revertUnprofitableConversions(f, model);
+  return true;
+}
+
+
+bool dumpStageOutput(Module& m, TaffoStage stage)
+{
+  if (TempDir.empty())
+    return true;
+  SmallString<128> path(TempDir);
+  sys::path::append(path, TempPrefix + "." + std::to_string(Stages[stage].TempIndex) + ".taffotmp.ll");
+  return writeModule(m, path, true);
+}
+
+
+/* The MetadataManager of the plugin caches data structures which refer to
+ * the metadata of a LLVMContext; they must be dropped when the context is
+ * destroyed if the plugin is used again */
+void clearPluginCaches()
+{
+  if (void *fn = sys::DynamicLibrary::SearchForAddressOfSymbol("TaffoMetadataManagerClearCache"))
+    reinterpret_cast<void (*)()>(fn)();
+}
+
+
+/* Runs the Conversion on the partitions of the module in child driver
+ * processes; the passes keep their state in globals, thus they cannot run
+ * on multiple threads. Falls back to the usual in-process Conversion when
+ * the module cannot be split. */
+bool runSplitConversionStage(std::unique_ptr<Module>& m, const char *argv0)
+{
+  std::vector<std::string> childArgs;
+  for (unsigned i = 0; i < PluginLoader::getNumPlugins(); i++) {
+    childArgs.push_back("-load");
+    childArgs.push_back(PluginLoader::getPlugin(i));
+  }
+  childArgs.push_back("-first-stage=conversion");
+  childArgs.push_back("-last-stage=conversion");
+  childArgs.push_back("-no-cache");
+  if (DisableVerify)
+    childArgs.push_back("-disable-verify");
+  for (const std::string& flag: ConversionFlags) {
+    childArgs.push_back("-Xconversion");
+    childArgs.push_back(flag);
+  }
+  std::string driverPath = sys::fs::getMainExecutable(argv0, (void *)(intptr_t)runStage);
+
+  bool error;
+  std::unique_ptr<Module> res = runSplitConversion(*m, ConversionJobs, driverPath, childArgs, error);
+  if (error)
+    return false;
+  if (!res)
+    return runStage(*m, StageConversion);
+
+  m = std::move(res);
+  clearPluginCaches();
+  if (!DisableVerify && verifyModule(*m, &errs())) {
+    errs() << "The module obtained by linking the converted partitions is broken\n";
+    return false;
+  }
+  return true;
+}
+
+/* Stage output cache
+ * The key of a stage is computed from the key of the previous stage (or
+ * the content of the input module, except its ModuleID, for the first
+ * stage), the passes and the options of the stage, and the versions of
+ * TAFFO, LLVM and of the loaded plugins. Thus a hit on a stage implies
+ * that all the stages before it would also have produced the same
+ * modules. */
+
+std::string pluginsIdentity()
+{
+  std::string res;
+  for (unsigned i = 0; i < PluginLoader::getNumPlugins(); i++) {
+    const std::string& path = PluginLoader::getPlugin(i);
+    sys::fs::file_status st;
+    res += path;
+    if (!sys::fs::status(path, st)) {
+      res += ":" + std::to_string(st.getSize());
+      res += ":" + std::to_string(sys::toTimeT(st.getLastModificationTime()));
+    }
+    res += ";";
+  }
+  return res;
+}
+
+/* The textual IR starts with the identifier of the module, that is the
+ * path of the file it was read from; for the intermediate files of taffo,
+ * it is in a different temporary directory at each build. */
+StringRef withoutModuleID(StringRef ir)
+{
+  if (!ir.startswith("; ModuleID = "))
+    return ir;
+  size_t eol = ir.find('\n');
+  return eol == StringRef::npos ? StringRef() : ir.substr(eol + 1);
+}
+
+
+std::string stageCacheKey(StringRef prevKey, TaffoStage stage)
+{
+  static const std::string plugins = pluginsIdentity();
+  const StringRef sep("\0", 1);
+  MD5 hasher;
+  hasher.update(prevKey);
+  hasher.update(sep);
+  hasher.update(TAFFO_VERSION " " LLVM_VERSION_STRING);
+  hasher.update(sep);
+  hasher.update(plugins);
+  hasher.update(sep);
+  hasher.update(Stages[stage].Name);
+  for (const char *passName: passesForStage(stage)) {
+    hasher.update(sep);
+    hasher.update(passName);
+  }
+  for (const std::string& flag: *Stages[stage].Flags) {
+    hasher.update(sep);
+    hasher.update(flag);
+  }
+  if (stage == StageInit && Kernels) {
+    hasher.update(sep);
+    hasher.update("-kernels");
+  }
+  if (stage == StageVRA && VRASummaries) {
+    hasher.update(sep);
+    hasher.update("-vra-summaries");
+  }
+  if (stage == StageErrorProp && ErrSummaries) {
+    hasher.update(sep);
+    hasher.update("-err-summaries");
+  }
+  if (stage == StageVRA && FoldRanges) {
+    hasher.update(sep);
+    hasher.update("-fold-ranges");
+  }
+  if (stage == StageVRA && NarrowIntegers > 0) {
+    hasher.update(sep);
+    hasher.update("-narrow-integers=" + std::to_string(NarrowIntegers));
+  }
+  if (stage == StageVRA && SpecializeClones > 1) {
+    hasher.update(sep);
+    hasher.update("-specialize-clones=" + std::to_string(SpecializeClones));
+  }
+  if (stage == StageDTA && RangeGuards) {
+    hasher.update(sep);
+    hasher.update("-range-guards");
+  }
+  if (stage == StageDTA && MinShifts > 0) {
+    hasher.update(sep);
+    hasher.update("-min-shifts=" + std::to_string(MinShifts));
+  }
+  if (stage == StageDTA && NarrowReductions > 0) {
+    hasher.update(sep);
+    hasher.update("-narrow-reductions=" + std::to_string(NarrowReductions));
+  }
+  for (const std::string& budget: ErrorBudgets) {
+    if (stage != StageDTA)
+      break;
+    hasher.update(sep);
+    hasher.update("-error-budget=" + budget);
+  }
+  if (stage == StageDTA && !NarrowStorage.empty()) {
+    hasher.update(sep);
+    hasher.update("-narrow-storage=" + NarrowStorage);
+  }
+  if (stage == StageDTA && !CostModel.empty()) {
+    hasher.update(sep);
+    hasher.update("-cost-model=" + CostModel);
+    /* a model file may change under the same name */
+    if (ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(CostModel)) {
+      hasher.update(sep);
+      hasher.update((*file)->getBuffer());
+    }
+  }
+  if (stage == StageConversion && !Saturate.empty()) {
+    hasher.update(sep);
+    hasher.update("-saturate=" + Saturate);
+  }
+  if (stage == StageConversion && VectorizeBoundaries) {
+    hasher.update(sep);
+    hasher.update("-vectorize-boundaries");
+  }
+  if (stage == StageConversion && RepackStructs) {
+    hasher.update(sep);
+    hasher.update("-repack-structs");
+  }
+  if (stage == StageConversion && MergeClones) {
+    hasher.update(sep);
+    hasher.update("-merge-clones");
+  }
+  if (stage == StageConversion && OverflowChecks > 0) {
+    hasher.update(sep);
+    hasher.update("-overflow-checks=" + std::to_string(OverflowChecks) +
+                  (OverflowChecksTargets ? " -overflow-checks-targets" : ""));
+  }
+  MD5::MD5Result res;
+  hasher.final(res);
+  return std::string(res.digest().str());
+}
+
+
+bool isStageCacheable(TaffoStage stage)
+{
+  /* the result of the error propagator is its report, not the module; the
+   * report of the merged clones is written while converting */
+  return stage != StageErrorProp && (stage != StageConversion || MergeClonesReport.empty());
+}
+
+
+std::string cacheEntryPath(StringRef key)
+{
+  SmallString<128> path(CacheDir);
+  sys::path::append(path, key.substr(0, 2), key + ".bc");
+  return std::string(path.str());
+}
+
+
+std::unique_ptr<Module> loadCachedModule(StringRef key, LLVMContext& c)
+{
+  std::string path = cacheEntryPath(key);
+  if (!sys::fs::exists(path))
+    return nullptr;
+  SMDiagnostic Err;
+  return parseIRFile(path, Err, c);
+}
+
+
+void storeCachedModule(Module& m, StringRef key)
+{
+  /* the module is written to a temporary file and then moved in place, so
+   * that concurrent drivers sharing the cache never read partial entries */
+  std::string path = cacheEntryPath(key);
+  if (sys::fs::create_directories(sys::path::parent_path(path)))
+    return;
+  SmallString<128> tmpPath;
+  int fd;
+  if (sys::fs::createUniqueFile(path + ".%%%%%%%%.tmp", fd, tmpPath))
+    return;
+  {
+    raw_fd_ostream out(fd, true);
+    WriteBitcodeToFile(m, out);
+    if (out.has_error()) {
+      out.clear_error();
+      sys::fs::remove(tmpPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(tmpPath, path))
+    sys::fs::remove(tmpPath);
+}
+
+/* Time report
+ * Records are also appended to -time-report-file as tab-separated lines
+ * <name> <wall seconds> <user seconds> <peak RSS KiB>, the same format
+ * written by -exec-timed, so that the taffo script can merge them with
+ * the timings of the other tools it runs. */
+
+struct StageTiming {
+  std::string Name;
+  double Wall;
+  double User;
+  uint64_t PeakRSS;
+};
+
+std::vector<StageTiming> Timings;
+
+
+uint64_t peakRSSKiB(int who)
+{
+  struct rusage ru;
+  if (getrusage(who, &ru))
+    return 0;
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1024;
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+
+double userTime(int who)
+{
+  struct rusage ru;
+  if (getrusage(who, &ru))
+    return 0.0;
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0;
+}
+
+
+bool timingEnabled()
+{
+  return TimeReport || !TimeReportFile.empty();
+}
+
+
+void recordTiming(StringRef name, const TimeRecord& start)
+{
+  if (!timingEnabled())
+    return;
+  /* the peak RSS is the high-water mark of the whole process up to the end
+   * of the stage, getrusage does not allow to reset it */
+  TimeRecord end = TimeRecord::getCurrentTime(false);
+  Timings.push_back({std::string(name), end.getWallTime() - start.getWallTime(),
+    end.getUserTime() - start.getUserTime(), peakRSSKiB(RUSAGE_SELF)});
+}
+
+
+bool appendTimingRecords(StringRef filename, ArrayRef<StageTiming> timings)
+{
+  std::error_code ec;
+  raw_fd_ostream out(filename, ec, sys::fs::OF_Append | sys::fs::OF_Text);
+  if (ec) {
+    errs() << "Cannot open " << filename << ": " << ec.message() << "\n";
+    return false;
+  }
+  for (const StageTiming& t: timings)
+    out << t.Name << "\t" << format("%.6f\t%.6f\t", t.Wall, t.User) << t.PeakRSS << "\n";
+  return true;
+}
+
+
+void printTimeReport(raw_ostream& out, ArrayRef<StageTiming> timings)
+{
+  out << "===-- TAFFO time report --===\n";
+  out << format("%-16s %12s %12s %16s\n",
+    (const char *)"Stage", (const char *)"Wall (s)", (const char *)"User (s)", (const char *)"Peak RSS (KiB)");
+  for (const StageTiming& t: timings)
+    out << format("%-16s %12.3f %12.3f %16llu\n", t.Name.c_str(), t.Wall, t.User, (unsigned long long)t.PeakRSS);
+}
+
+
+/* Statistics report
+ * The counters are cumulative over the life of the process, thus the
+ * report of each stage is the difference between the snapshots taken
+ * before and after it. This also holds for the jobs of a server. */
+
+typedef std::map<std::string, int64_t> StatisticsSnapshot;
+
+struct StageStatistics {
+  std::string Name;
+  StatisticsSnapshot Values;
+};
+
+std::vector<StageStatistics> Statistics;
+
+
+StatisticsSnapshot takeStatisticsSnapshot()
+{
+  StatisticsSnapshot res;
+  /* GetStatistics only returns the names of the counters without their
+   * DEBUG_TYPE, which is needed to tell apart the counters of different
+   * passes */
+  std::string buf;
+  raw_string_ostream os(buf);
+  PrintStatisticsJSON(os);
+  os.flush();
+  Expected<json::Value> parsed = json::parse(buf);
+  if (!parsed) {
+    consumeError(parsed.takeError());
+    return res;
+  }
+  if (const json::Object *obj = parsed->getAsObject()) {
+    for (const auto& entry: *obj) {
+      StringRef key = entry.first;
+      Optional<int64_t> val = entry.second.getAsInteger();
+      /* the timers printed along with the statistics are not counters */
+      if (val && !key.startswith("time."))
+        res[key.str()] = *val;
+    }
+  }
+  const mdutils::MDCacheStats cache = mdutils::MetadataManager::getMetadataManager().getCacheStats();
+  res["metadata-cache.hits"] = cache.Hits;
+  res["metadata-cache.misses"] = cache.Misses;
+  return res;
+}
+
+
+void recordStatistics(StringRef name, const StatisticsSnapshot& start)
+{
+  if (StatsJsonFile.empty())
+    return;
+  StageStatistics stage = {std::string(name), {}};
+  for (const auto& entry: takeStatisticsSnapshot()) {
+    auto prev = start.find(entry.first);
+    int64_t delta = entry.second - (prev == start.end() ? 0 : prev->second);
+    if (delta)
+      stage.Values[entry.first] = delta;
+  }
+  Statistics.push_back(std::move(stage));
+}
+
+
+bool writeStatisticsReport(StringRef filename, ArrayRef<StageStatistics> stages)
+{
+  std::error_code ec;
+  raw_fd_ostream out(filename, ec, sys::fs::OF_Text);
+  if (ec) {
+    errs() << "Cannot open " << filename << ": " << ec.message() << "\n";
+    return false;
+  }
+  StatisticsSnapshot total;
+  for (const StageStatistics& stage: stages)
+    for (const auto& entry: stage.Values)
+      total[entry.first] += entry.second;
+
+  auto writeValues = [](json::OStream& j, const StatisticsSnapshot& values) {
+    j.objectBegin();
+    for (const auto& entry: values)
+      j.attribute(entry.first, entry.second);
+    j.objectEnd();
+  };
+  json::OStream j(out, 2);
+  j.objectBegin();
+  j.attribute("version", 1);
+  j.attributeBegin("stages");
+  j.arrayBegin();
+  for (const StageStatistics& stage: stages) {
+    j.objectBegin();
+    j.attribute("name", stage.Name);
+    j.attributeBegin("statistics");
+    writeValues(j, stage.Values);
+    j.attributeEnd();
+    j.objectEnd();
+  }
+  j.arrayEnd();
+  j.attributeEnd();
+  j.attributeBegin("total");
+  writeValues(j, total);
+  j.attributeEnd();
+  j.objectEnd();
+  out << "\n";
+  return true;
+}
+
+
+/* taffo-driver -exec-timed <name> <report file> <program> [args...]
+ * Runs the given program and appends its timing record to the report file,
+ * returning its exit code. Used by the taffo script for the commands that
+ * do not run inside the driver (clang, llvm-link, ...) */
+int execTimed(int argc, char *argv[])
+{
+  if (argc < 5) {
+    errs() << "usage: " << argv[0] << " -exec-timed <name> <report file> <program> [args...]\n";
+    return 1;
+  }
+  StringRef program = argv[4];
+  std::string programPath(program);
+  if (program.find('/') == StringRef::npos) {
+    ErrorOr<std::string> found = sys::findProgramByName(program);
+    if (!found) {
+      errs() << "Cannot find " << program << "\n";
+      return 127;
+    }
+    programPath = *found;
+  }
+  std::vector<StringRef> args(argv + 4, argv + argc);
+
+  TimeRecord start = TimeRecord::getCurrentTime(true);
+  std::string errMsg;
+  int ret = sys::ExecuteAndWait(programPath, args, None, {}, 0, 0, &errMsg);
+  TimeRecord end = TimeRecord::getCurrentTime(false);
+  if (ret < 0) {
+    errs() << "Cannot execute " << program << ": " << errMsg << "\n";
+    return 127;
+  }
+
+  /* RUSAGE_CHILDREN accounts for the only child we have waited for; its
+   * peak RSS has the size of the driver as a lower bound */
+  StageTiming t = {argv[2], end.getWallTime() - start.getWallTime(),
+    userTime(RUSAGE_CHILDREN), peakRSSKiB(RUSAGE_CHILDREN)};
+  appendTimingRecords(argv[3], t);
+  return ret;
+}
+
+
+/* taffo-driver -region-timing <regions file> <input> <output>
+ * Instruments the regions of the input module with cycle counters. The
+ * regions marked by TAFFO in the module are written to the regions file;
+ * if the module has none, as the floating point version of the program,
+ * the regions listed in the file are instrumented instead, so that both
+ * versions count the same regions. */
+int instrumentRegions(int argc, char *argv[])
+{
+  if (argc != 5) {
+    errs() << "usage: " << argv[0] << " -region-timing <regions file> <input> <output>\n";
+    return 1;
+  }
+  LLVMContext c;
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseIRFile(argv[3], err, c);
+  if (!m) {
+    err.print(argv[0], errs());
+    return 1;
+  }
+
+  std::vector<std::string> regions = taffo::collectTimingRegions(*m);
+  if (!regions.empty()) {
+    std::error_code ec;
+    raw_fd_ostream out(argv[2], ec, sys::fs::OF_Text);
+    if (ec) {
+      errs() << "Cannot open " << argv[2] << ": " << ec.message() << "\n";
+      return 1;
+    }
+    for (const std::string& region: regions)
+      out << region << "\n";
+  } else {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(argv[2]);
+    if (!buf) {
+      errs() << "Cannot open " << argv[2] << ": " << buf.getError().message() << "\n";
+      return 1;
+    }
+    SmallVector<StringRef, 16> lines;
+    (*buf)->getBuffer().split(lines, '\n', -1, false);
+    for (StringRef line: lines)
+      regions.push_back(line.trim().str());
+  }
+
+  taffo::instrumentRegionTiming(*m, regions);
+  return writeModule(*m, argv[4], StringRef(argv[4]).endswith(".ll")) ? 0 : 1;
+}
+
+
+/* Parses the options forwarded to the passes of the stages to be run */
+bool parseStageOptions(const char *argv0)
+{
+  if (FirstStage > LastStage) {
+    errs() << "-first-stage must not come after -last-stage\n";
+    return false;
+  }
+
+  /* All stages run in the same process, thus the options forwarded to each
+   * pass are parsed as usual once the plugin has been loaded by -load.
+   * Only the options of the stages that are actually run are considered. */
+  std::vector<const char *> fwdArgv = {argv0};
+  for (int s = FirstStage; s <= LastStage; s++) {
+    for (const std::string& flag: *Stages[s].Flags)
+      fwdArgv.push_back(flag.c_str());
+  }
+  if (fwdArgv.size() > 1) {
+    if (!cl::ParseCommandLineOptions(fwdArgv.size(), fwdArgv.data(), "", &errs()))
+      return false;
+  }
+  return true;
+}
+
+
+/* Starts the trace requested by -trace, if any */
+bool startTrace()
+{
+  if (TraceFile.empty())
+    return true;
+  std::vector<taffo::TraceStage> stages;
+  for (const std::string& name: TraceStages) {
+    taffo::TraceStage stage;
+    if (!taffo::parseTraceStage(name, stage)) {
+      errs() << "Unknown stage " << name << " in -trace-stages\n";
+      return false;
+    }
+    stages.push_back(stage);
+  }
+  std::string err;
+  if (!taffo::Trace::start(TraceFile, stages, TraceSample, TraceRing, err)) {
+    errs() << "Cannot start the trace: " << err << "\n";
+    return false;
+  }
+  return true;
+}
+
+
+/* Writes the trace on every exit path of runPipeline */
+struct TraceScope {
+  ~TraceScope() {
+    if (!TraceFile.empty())
+      taffo::Trace::finish();
+  }
+};
+
+
+taffo::TraceStage getTraceStage(TaffoStage stage)
+{
+  switch (stage) {
+    case StageInit: return taffo::TraceStage::Init;
+    case StageVRA: return taffo::TraceStage::VRA;
+    case StageDTA: return taffo::TraceStage::DTA;
+    case StageConversion: return taffo::TraceStage::Conversion;
+    default: return taffo::TraceStage::ErrorProp;
+  }
+}
+
+
+/* Runs the stages selected by the command line options on a new
+ * LLVMContext */
+int runPipeline(const char *argv0)
+{
+  LLVMContext c;
+  if (!startTrace())
+    return 1;
+  TraceScope traceScope;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> input = MemoryBuffer::getFileOrSTDIN(InputFilename);
+  if (std::error_code ec = input.getError()) {
+    errs() << "Cannot open " << InputFilename << ": " << ec.message() << "\n";
+    return 1;
+  }
+
+  if (CacheDir.empty()) {
+    if (const char *env = std::getenv("TAFFO_CACHE_DIR"))
+      CacheDir = env;
+  }
+  /* the stages loaded from the cache would be missing from the trace */
+  bool useCache = !NoCache && !CacheDir.empty() && TraceFile.empty();
+
+  /* The output is the module produced by Conversion; the error propagator
+   * only annotates the converted code with its estimates */
+  TaffoStage outputStage = LastStage;
+  if (LastStage == StageErrorProp && FirstStage < StageErrorProp)
+    outputStage = StageConversion;
+
+  std::string cacheKeys[NumStages];
+  std::unique_ptr<Module> m;
+  int firstToRun = FirstStage;
+  TimeRecord parseStart = TimeRecord::getCurrentTime(true);
+  Statistics.clear();
+  StatisticsSnapshot stats;
+  if (!StatsJsonFile.empty())
+    stats = takeStatisticsSnapshot();
+  if (useCache) {
+    MD5 hasher;
+    hasher.update(withoutModuleID((*input)->getBuffer()));
+    MD5::MD5Result res;
+    hasher.final(res);
+    std::string key = std::string(res.digest().str());
+    for (int s = FirstStage; s <= LastStage; s++) {
+      key = stageCacheKey(key, (TaffoStage)s);
+      cacheKeys[s] = key;
+    }
+    /* resume from the latest stage whose output is available */
+    for (int s = LastStage; s >= FirstStage; s--) {
+      if (!isStageCacheable((TaffoStage)s))
+        continue;
+      m = loadCachedModule(cacheKeys[s], c);
+      if (m) {
+        m->setModuleIdentifier((*input)->getBufferIdentifier());
+        firstToRun = s + 1;
+        break;
+      }
+    }
+    if (m && firstToRun - 1 == outputStage && !writeModule(*m, OutputFilename, OutputAssembly))
+      return 1;
+  }
+
+  if (!m) {
+    SMDiagnostic Err;
+    m = parseIR((*input)->getMemBufferRef(), Err, c);
+    if (!m) {
+      Err.print(argv0, errs());
+      return 1;
+    }
+  }
+  recordTiming("parse", parseStart);
+  recordStatistics("parse", stats);
+
+  for (int s = firstToRun; s <= LastStage; s++) {
+    TimeRecord stageStart = TimeRecord::getCurrentTime(true);
+    if (!StatsJsonFile.empty())
+      stats = takeStatisticsSnapshot();
+    TAFFO_TRACE(taffo::TraceStage::Driver, nullptr, nullptr, nullptr, Stages[s].Name);
+    taffo::Trace::setCurrentStage(getTraceStage((TaffoStage)s));
+    bool ok;
+    if (s == StageConversion && ConversionJobs > 1)
+      ok = runSplitConversionStage(m, argv0);
+    else
+      ok = runStage(*m, (TaffoStage)s);
+    if (ok && s == StageVRA)
+      ok = runCloneSpecialization(*m);
+    if (ok && s == StageVRA) {
+      runRangeFolding(*m);
+      runIntegerNarrowing(*m);
+    }
+    if (ok && s == StageDTA) {
+      runShiftMinimization(*m);
+      runReductionNarrowing(*m);
+      ok = runErrorBudget(*m) && runStorageNarrowing(*m) && runCostModel(*m);
+    }
+    if (ok && s == StageConversion)
+      ok = runSaturation(*m);
+    if (ok && s == StageConversion) {
+      runBoundaryConversions(*m);
+      runStructRepacking(*m);
+      runCloneMerging(*m);
+      runOverflowChecks(*m);
+    }
+    if (!ok || !dumpStageOutput(*m, (TaffoStage)s))
+      return 1;
+    if (useCache && isStageCacheable((TaffoStage)s))
+      storeCachedModule(*m, cacheKeys[s]);
+    if (s == outputStage && !writeModule(*m, OutputFilename, OutputAssembly))
+      return 1;
+    recordTiming(Stages[s].Name, stageStart);
+    recordStatistics(Stages[s].Name, stats);
+  }
+  taffo::Trace::setCurrentStage(taffo::TraceStage::Driver);
+
+  if (TimeReport)
+    printTimeReport(errs(), Timings);
+  if (!TimeReportFile.empty() && !appendTimingRecords(TimeReportFile, Timings))
+    return 1;
+  if (!StatsJsonFile.empty() && !writeStatisticsReport(StatsJsonFile, Statistics))
+    return 1;
+
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  /* The initialization section is mostly copied from the
+   * source code of opt */
+  InitLLVM X(argc, argv);
+
+  if (argc > 1 && StringRef(argv[1]) == "-exec-timed")
+    return execTimed(argc, argv);
+  if (argc > 1 && StringRef(argv[1]) == "-region-timing")
+    return instrumentRegions(argc, argv);
+  if (argc > 2 && StringRef(argv[1]) == "-connect")
+    return runTaffoClient(argv[2], argc - 3, argv + 3);
+
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeCoroutines(Registry);
+  initializeScalarOpts(Registry);
+  initializeObjCARCOpts(Registry);
+  initializeVectorization(Registry);
+  initializeIPO(Registry);
+  initializeAnalysis(Registry);
+  initializeTransformUtils(Registry);
+  initializeInstCombine(Registry);
+  initializeAggressiveInstCombine(Registry);
+  initializeInstrumentation(Registry);
+  initializeTarget(Registry);
+  /* the code generators only provide the costs for -cost-model=target */
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+
+  cl::ParseCommandLineOptions(argc, argv, "TAFFO Pipeline Driver");
+  /* a counter is registered when it is first incremented, and only if the
+   * statistics are enabled at that point; a server enables them from the
+   * start, as any of its jobs may ask for them */
+  if (!StatsJsonFile.empty() || !Serve.empty())
+    EnableStatistics(false);
+
+  if (Serve.empty()) {
+    if (!parseStageOptions(argv[0]))
+      return 1;
+    return runPipeline(argv[0]);
+  }
+
+  std::string socketPath = Serve;
+  const char *argv0 = argv[0];
+  return runTaffoServer(socketPath, [argv0](const std::vector<std::string>& args) -> int {
+    /* the plugins loaded at startup stay loaded, every other option
+     * is reset to its default value */
+    cl::ResetAllOptionOccurrences();
+    Timings.clear();
+    std::vector<const char *> jobArgv = {argv0};
+    for (const std::string& arg: args)
+      jobArgv.push_back(arg.c_str());
+    int ret = 1;
+    if (cl::ParseCommandLineOptions(jobArgv.size(), jobArgv.data(), "", &errs()) &&
+        parseStageOptions(argv0))
+      ret = runPipeline(argv0);
+    clearPluginCaches();
+    return ret;
+  });
+}
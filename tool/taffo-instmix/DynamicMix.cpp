@@ -0,0 +1,198 @@
+#include "DynamicMix.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+
+#define INSTMIX_PROFILE_HEADER "taffo-instmix-profile"
+
+
+/* Delimiter calls which split a segment. Invokes terminate their block,
+ * so they never split one. */
+static int segmentDelimiter(Instruction& inst)
+{
+  if (!isa<CallInst>(inst))
+    return 0;
+  return isDelimiterInstruction(&inst);
+}
+
+
+void collectMixSegments(Module& m, std::vector<mix_segment>& out)
+{
+  for (Function& f: m) {
+    for (BasicBlock& bb: f) {
+      BasicBlock::iterator begin = bb.begin();
+      for (auto it = bb.begin(); it != bb.end(); it++) {
+        if (!segmentDelimiter(*it))
+          continue;
+        out.push_back({&bb, begin, std::next(it)});
+        begin = std::next(it);
+      }
+      out.push_back({&bb, begin, bb.end()});
+    }
+  }
+}
+
+
+/* Builds the function which writes the counters to the profile file */
+static Function *createDumpFunction(Module& m, GlobalVariable *counters, uint64_t n)
+{
+  LLVMContext& c = m.getContext();
+  Type *voidTy = Type::getVoidTy(c);
+  Type *i32Ty = Type::getInt32Ty(c);
+  Type *i64Ty = Type::getInt64Ty(c);
+  PointerType *ptrTy = Type::getInt8PtrTy(c);
+  FunctionCallee getenvF = m.getOrInsertFunction("getenv", ptrTy, ptrTy);
+  FunctionCallee fopenF = m.getOrInsertFunction("fopen", ptrTy, ptrTy, ptrTy);
+  FunctionCallee fcloseF = m.getOrInsertFunction("fclose", i32Ty, ptrTy);
+  FunctionCallee fprintfF = m.getOrInsertFunction("fprintf",
+      FunctionType::get(i32Ty, {ptrTy, ptrTy}, true));
+
+  Function *dump = Function::Create(FunctionType::get(voidTy, false),
+      GlobalValue::InternalLinkage, "__taffo_instmix_dump", &m);
+  BasicBlock *entry = BasicBlock::Create(c, "entry", dump);
+  BasicBlock *header = BasicBlock::Create(c, "header", dump);
+  BasicBlock *loop = BasicBlock::Create(c, "loop", dump);
+  BasicBlock *done = BasicBlock::Create(c, "done", dump);
+  BasicBlock *exit = BasicBlock::Create(c, "exit", dump);
+
+  IRBuilder<> b(entry);
+  Value *envName = b.CreateCall(getenvF, {b.CreateGlobalStringPtr(INSTMIX_PROFILE_ENV)});
+  Value *fileName = b.CreateSelect(b.CreateIsNull(envName),
+      b.CreateGlobalStringPtr(INSTMIX_PROFILE_DEFAULT), envName);
+  Value *file = b.CreateCall(fopenF, {fileName, b.CreateGlobalStringPtr("w")});
+  b.CreateCondBr(b.CreateIsNull(file), exit, header);
+
+  b.SetInsertPoint(header);
+  b.CreateCall(fprintfF, {file, b.CreateGlobalStringPtr(INSTMIX_PROFILE_HEADER " %llu\n"),
+                          ConstantInt::get(i64Ty, n)});
+  Value *format = b.CreateGlobalStringPtr("%llu\n");
+  b.CreateBr(loop);
+
+  b.SetInsertPoint(loop);
+  PHINode *idx = b.CreatePHI(i64Ty, 2);
+  idx->addIncoming(ConstantInt::get(i64Ty, 0), header);
+  Value *ptr = b.CreateInBoundsGEP(counters->getValueType(), counters,
+                                   {ConstantInt::get(i64Ty, 0), idx});
+  b.CreateCall(fprintfF, {file, format, b.CreateLoad(i64Ty, ptr)});
+  Value *next = b.CreateAdd(idx, ConstantInt::get(i64Ty, 1));
+  idx->addIncoming(next, loop);
+  b.CreateCondBr(b.CreateICmpULT(next, ConstantInt::get(i64Ty, n)), loop, done);
+
+  b.SetInsertPoint(done);
+  b.CreateCall(fcloseF, {file});
+  b.CreateBr(exit);
+
+  b.SetInsertPoint(exit);
+  b.CreateRetVoid();
+  return dump;
+}
+
+
+void instrumentForDynamicMix(Module& m, const std::vector<mix_segment>& segments)
+{
+  if (segments.empty())
+    return;
+  LLVMContext& c = m.getContext();
+  Type *i32Ty = Type::getInt32Ty(c);
+  Type *i64Ty = Type::getInt64Ty(c);
+
+  ArrayType *countersTy = ArrayType::get(i64Ty, segments.size());
+  GlobalVariable *counters = new GlobalVariable(m, countersTy, false,
+      GlobalValue::InternalLinkage, ConstantAggregateZero::get(countersTy),
+      "__taffo_instmix_counters");
+  /* nesting level of the measured regions */
+  GlobalVariable *eval = new GlobalVariable(m, i32Ty, false,
+      GlobalValue::InternalLinkage, ConstantInt::get(i32Ty, 0),
+      "__taffo_instmix_eval");
+
+  IRBuilder<> b(c);
+  for (size_t i = 0; i < segments.size(); i++) {
+    const mix_segment& seg = segments[i];
+    if (seg.begin == seg.block->begin()) {
+      if (seg.block->getFirstInsertionPt() == seg.block->end())
+        continue;
+      b.SetInsertPoint(&*seg.block->getFirstInsertionPt());
+    } else {
+      /* the segment follows a delimiter call, which updates the level */
+      Instruction *delim = &*std::prev(seg.begin);
+      b.SetInsertPoint(seg.block, seg.begin);
+      Value *level = b.CreateLoad(i32Ty, eval);
+      b.CreateStore(b.CreateAdd(level, ConstantInt::get(i32Ty, segmentDelimiter(*delim))), eval);
+    }
+    Value *inRegion = b.CreateZExt(b.CreateICmpNE(b.CreateLoad(i32Ty, eval),
+                                                  ConstantInt::get(i32Ty, 0)), i64Ty);
+    Value *ptr = b.CreateInBoundsGEP(countersTy, counters,
+                                     {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, i)});
+    b.CreateStore(b.CreateAdd(b.CreateLoad(i64Ty, ptr), inRegion), ptr);
+  }
+
+  /* the dump function is registered with atexit by a constructor, so that
+   * it also runs when the program calls exit */
+  Function *dump = createDumpFunction(m, counters, segments.size());
+  FunctionCallee atexitF = m.getOrInsertFunction("atexit", i32Ty, dump->getType());
+  Function *init = Function::Create(FunctionType::get(Type::getVoidTy(c), false),
+      GlobalValue::InternalLinkage, "__taffo_instmix_init", &m);
+  b.SetInsertPoint(BasicBlock::Create(c, "entry", init));
+  b.CreateCall(atexitF, {dump});
+  b.CreateRetVoid();
+  appendToGlobalCtors(m, init, 0);
+}
+
+
+bool readMixProfile(StringRef filename, size_t numSegments,
+                    std::vector<uint64_t>& counts, std::string& error)
+{
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(filename);
+  if (!buf) {
+    error = "cannot read " + filename.str() + ": " + buf.getError().message();
+    return false;
+  }
+  SmallVector<StringRef, 64> lines;
+  (*buf)->getBuffer().split(lines, '\n', -1, false);
+  uint64_t n;
+  if (lines.empty() || !lines[0].startswith(INSTMIX_PROFILE_HEADER " ") ||
+      lines[0].drop_front(sizeof(INSTMIX_PROFILE_HEADER)).trim().getAsInteger(10, n)) {
+    error = filename.str() + " is not an instruction mix profile";
+    return false;
+  }
+  if (n != numSegments || lines.size() != n + 1) {
+    error = filename.str() + " was not produced by this module";
+    return false;
+  }
+  counts.resize(n);
+  for (uint64_t i = 0; i < n; i++) {
+    if (lines[i + 1].trim().getAsInteger(10, counts[i])) {
+      error = filename.str() + ": malformed counter at line " + std::to_string(i + 2);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void computeDynamicMix(const std::vector<mix_segment>& segments,
+                       const std::vector<uint64_t>& counts, bool countCallSites,
+                       InstructionMix& imix)
+{
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (counts[i] == 0)
+      continue;
+    for (auto it = segments[i].begin; it != segments[i].end; it++) {
+      Instruction& inst = *it;
+      if (isSkippableInstruction(&inst))
+        continue;
+      CallBase *call = dyn_cast<CallBase>(&inst);
+      Function *callee = call ? call->getCalledFunction() : nullptr;
+      if (callee && !callee->empty() && !countCallSites)
+        continue;
+      imix.updateWithInstruction(&inst, counts[i]);
+    }
+  }
+}
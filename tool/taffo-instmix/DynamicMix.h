@@ -0,0 +1,54 @@
+#ifndef TAFFO_INSTMIX_DYNAMIC_MIX_H
+#define TAFFO_INSTMIX_DYNAMIC_MIX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Module.h"
+#include "InstructionMix.h"
+
+
+/* Environment variable with the path of the profile written by an
+ * instrumented program, and path used when it is not set */
+#define INSTMIX_PROFILE_ENV "TAFFO_INSTMIX_PROFILE"
+#define INSTMIX_PROFILE_DEFAULT "instmix.prof"
+
+
+/* Sequence of instructions of a basic block which are always executed the
+ * same number of times inside the measured regions. A basic block is split
+ * in segments after each call to a delimiter function (see
+ * isDelimiterInstruction), since the call may open or close a region. */
+struct mix_segment {
+  llvm::BasicBlock *block;
+  llvm::BasicBlock::iterator begin;
+  llvm::BasicBlock::iterator end;
+};
+
+/* Collects the segments of all the function definitions of m, in module
+ * order. The order only depends on the module, so that the segments of an
+ * instrumented module correspond to the ones of the original module. */
+void collectMixSegments(llvm::Module& m, std::vector<mix_segment>& out);
+
+/* Instruments m with a 64-bit counter per segment, incremented every time
+ * the segment is executed inside a measured region. The counters are
+ * written at exit to the file named by INSTMIX_PROFILE_ENV, or to
+ * INSTMIX_PROFILE_DEFAULT. The counters are not atomic, so the profile of
+ * a multi-threaded program is approximate. */
+void instrumentForDynamicMix(llvm::Module& m, const std::vector<mix_segment>& segments);
+
+/* Reads the counters of a profile written by an instrumented program.
+ * Returns false, with a message in error, if the file cannot be read or
+ * does not have numSegments counters. */
+bool readMixProfile(llvm::StringRef filename, size_t numSegments,
+                    std::vector<uint64_t>& counts, std::string& error);
+
+/* Adds to imix the instructions of each segment, weighted by its counter.
+ * Calls to functions with a body are counted only if countCallSites is
+ * set, since their callees are counted on their own. */
+void computeDynamicMix(const std::vector<mix_segment>& segments,
+                       const std::vector<uint64_t>& counts, bool countCallSites,
+                       InstructionMix& imix);
+
+#endif
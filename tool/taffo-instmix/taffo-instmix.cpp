@@ -4,6 +4,10 @@
 #include <unordered_set>
 #include <sstream>
 #include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ErrorOr.h"
@@ -12,11 +16,29 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/raw_os_ostream.h"
+#include "llvm/Support/FileSystem.h"
 #include "InstructionMix.h"
+#include "DynamicMix.h"
+#include "FeatureTable.h"
+#include "LazyModule.h"
+#include "CycleEstimate.h"
+#include "MixComparison.h"
 
 using namespace llvm;
 
@@ -28,9 +50,115 @@ cl::opt<bool> Verbose("verbose", cl::value_desc("verbose"),
 cl::opt<bool> CountCallSite("callsites", cl::value_desc("callsites"),
   cl::desc("Count call instructions to profiled functions"),
   cl::init(false));
-cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
-  cl::desc("<input file>"));
+cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+  cl::desc("<input files>"));
+cl::opt<std::string> InputListFilename("input-list", cl::value_desc("filename"),
+  cl::desc("File with the list of the input files, one per line"));
+cl::opt<unsigned> Jobs("j", cl::value_desc("jobs"),
+  cl::desc("Number of input files analyzed in parallel (0 = one per core)"),
+  cl::init(1));
+cl::opt<FeatureTable::Format> OutputFormat("format", cl::desc("Output format"),
+  cl::values(clEnumValN(FeatureTable::Text, "text", "Lines of name and count (default)"),
+             clEnumValN(FeatureTable::CSV, "csv", "A CSV row per input file"),
+             clEnumValN(FeatureTable::JSON, "json", "A JSON object keyed by input file")),
+  cl::init(FeatureTable::Text));
+cl::opt<bool> Instrument("instrument", cl::value_desc("instrument"),
+  cl::desc("Instrument the module to record the dynamic instruction mix in the "
+           "file named by $" INSTMIX_PROFILE_ENV " (default " INSTMIX_PROFILE_DEFAULT ")"),
+  cl::init(false));
+cl::opt<std::string> OutputFilename("o", cl::value_desc("filename"),
+  cl::desc("Output file of the instrumented module"), cl::init("-"));
+cl::opt<bool> OutputAssembly("S", cl::desc("Write the instrumented module as LLVM assembly"),
+  cl::init(false));
+cl::opt<std::string> ProfileFilename("profile", cl::value_desc("filename"),
+  cl::desc("Print the instruction mix weighted by the profile recorded by the "
+           "instrumented module, instead of the static one"));
+cl::opt<bool> Weighted("weighted", cl::value_desc("weighted"),
+  cl::desc("Weight each instruction by the trip counts of the enclosing loops"),
+  cl::init(false));
+cl::opt<unsigned> UnknownTripCount("unknown-trip-count", cl::value_desc("count"),
+  cl::desc("Trip count assumed by -weighted for the loops without a constant "
+           "maximum trip count (default 10)"),
+  cl::init(10));
+cl::opt<bool> EstimateCycles("cycles", cl::value_desc("cycles"),
+  cl::desc("Also print the number of cycles estimated from the mix"),
+  cl::init(false));
+cl::opt<std::string> CostTarget("cost-target", cl::value_desc("target"),
+  cl::desc("Latency table used by -cycles: x86-64, aarch64, cortex-m or a "
+           "target triple (default: the triple of the module)"));
+cl::opt<std::string> CostTableFilename("cost-table", cl::value_desc("filename"),
+  cl::desc("File with lines \"<opcode> <cycles>\" overriding the costs "
+           "of the latency table used by -cycles"));
+cl::opt<bool> Compare("compare", cl::value_desc("compare"),
+  cl::desc("Compare the static mix of each function and loop of a float module "
+           "with the one of its converted version, given in this order"),
+  cl::init(false));
+
+/* contents of the -cost-table file */
+std::string costTableText;
+
+
+/* Weights of the basic blocks for -weighted: the product of the maximum
+ * trip counts of the enclosing loops, as computed by ScalarEvolution */
+class LoopWeights {
+public:
+  int64_t getBlockWeight(BasicBlock *bb)
+  {
+    FunctionLoops& fl = getFunctionLoops(bb->getParent());
+    int64_t weight = 1;
+    for (Loop *l = fl.li.getLoopFor(bb); l; l = l->getParentLoop())
+      weight = saturatingMul(weight, getTripCount(fl, l));
+    return weight;
+  }
+
+  static int64_t saturatingMul(int64_t a, int64_t b)
+  {
+    if (b != 0 && a > std::numeric_limits<int64_t>::max() / b)
+      return std::numeric_limits<int64_t>::max();
+    return a * b;
+  }
+
+private:
+  struct FunctionLoops {
+    DominatorTree dt;
+    LoopInfo li;
+    TargetLibraryInfoImpl tlii;
+    TargetLibraryInfo tli;
+    AssumptionCache ac;
+    ScalarEvolution se;
+    DenseMap<Loop *, int64_t> tripCounts;
+
+    FunctionLoops(Function& f): dt(f), li(dt),
+        tlii(Triple(f.getParent()->getTargetTriple())), tli(tlii), ac(f),
+        se(f, tli, ac, dt, li) {}
+  };
+  DenseMap<Function *, std::unique_ptr<FunctionLoops>> functions;
+
+  FunctionLoops& getFunctionLoops(Function *f)
+  {
+    std::unique_ptr<FunctionLoops>& fl = functions[f];
+    if (!fl)
+      fl.reset(new FunctionLoops(*f));
+    return *fl;
+  }
 
+  int64_t getTripCount(FunctionLoops& fl, Loop *l)
+  {
+    auto cached = fl.tripCounts.find(l);
+    if (cached != fl.tripCounts.end())
+      return cached->second;
+    int64_t count = UnknownTripCount;
+    const SCEV *backedges = fl.se.getConstantMaxBackedgeTakenCount(l);
+    if (const SCEVConstant *c = dyn_cast<SCEVConstant>(backedges)) {
+      if (c->getAPInt().getActiveBits() < 63)
+        count = c->getAPInt().getZExtValue() + 1;
+      else
+        count = std::numeric_limits<int64_t>::max();
+    }
+    fl.tripCounts[l] = count;
+    return count;
+  }
+};
 
 struct block_eval_status {
   BasicBlock *block;
@@ -40,130 +168,337 @@ struct block_eval_status {
 };
 
 
-bool analyze_function(InstructionMix&, Function *, std::unordered_set<BasicBlock *>&, int &);
-void analyze_basic_block(InstructionMix&, BasicBlock *, std::unordered_set<BasicBlock *>&, int &);
+/* Instruction mix of a function, including its callees, split by the
+ * nesting level of the measured regions relative to the entry of the
+ * function. exitEval is the change of the level from the entry to the
+ * first return. */
+struct function_summary {
+  std::map<int, InstructionMix> mixByEval;
+  int exitEval = 0;
+};
 
 
-void analyze_basic_block(InstructionMix& imix, BasicBlock *bb, std::unordered_set<BasicBlock *>& countedbbs, int &eval)
-{
-  if (Verbose) {
-    raw_os_ostream stm(std::cerr);
-    stm << "  BasicBlock: ";
-    bb->printAsOperand(stm, true);
-    stm << '\n';
+/* Summaries of the functions of a module, computed bottom-up on the call
+ * graph so that every function is visited once and its summary is reused
+ * at all its call sites. Calls between functions of the same strongly
+ * connected component are not expanded. */
+class MixSummaries {
+public:
+  MixSummaries(Module& m, LoopWeights *weights): weights(weights)
+  {
+    CallGraph cg(m);
+    for (auto scc = scc_begin(&cg); !scc.isAtEnd(); ++scc) {
+      SmallPtrSet<Function *, 4> sccFuncs;
+      for (CallGraphNode *node: *scc) {
+        if (node->getFunction())
+          sccFuncs.insert(node->getFunction());
+      }
+      for (Function *f: sccFuncs) {
+        if (!f->empty())
+          summarize(f, sccFuncs);
+      }
+    }
   }
-  countedbbs.insert(bb);
   
-  for (auto iter3 = bb->begin(); iter3 != bb->end(); iter3++) {
-    Instruction &inst = *iter3;
-    
-    int delim = isDelimiterInstruction(&inst);
-    eval += delim;
-    if (delim > 0)
-      continue;
+  const function_summary *get(Function *f) const
+  {
+    auto it = summaries.find(f);
+    return it != summaries.end() ? &it->second : nullptr;
+  }
+  
+  /* Mix of the instructions of f which are in a measured region, when f
+   * is called outside of any region */
+  void getMix(Function *f, InstructionMix& out) const
+  {
+    if (const function_summary *fs = get(f)) {
+      for (auto& evalMix: fs->mixByEval) {
+        if (evalMix.first != 0)
+          out.add(evalMix.second);
+      }
+    }
+  }
+  
+private:
+  DenseMap<Function *, function_summary> summaries;
+  LoopWeights *weights;
+  
+  void summarize(Function *f, const SmallPtrSetImpl<Function *>& sccFuncs)
+  {
+    if (Verbose)
+      std::cerr << " Function: " << f->getName().str() << std::endl;
+    /* the summaries of the other functions of the SCC are not complete */
+    function_summary fs;
+    bool returned = false;
     
-    if (isSkippableInstruction(&inst))
-      continue;
-
-    Function *opnd = nullptr;
-    CallBase *call = dyn_cast<CallBase>(&inst);
-    if (call)
-      opnd = call->getCalledFunction();
+    std::unordered_set<BasicBlock *> queued;
+    std::deque<block_eval_status> queue;
+    queue.push_back(block_eval_status(&f->getEntryBlock(), 0));
+    queued.insert(&f->getEntryBlock());
+    while (queue.size() > 0) {
+      block_eval_status top = queue.front();
+      queue.pop_front();
+      
+      summarizeBasicBlock(fs, top.block, top.eval, sccFuncs);
+      
+      Instruction *term = top.block->getTerminator();
+      assert(term && "denormal bb found; abort");
+      if (isa<ReturnInst>(term) && !returned) {
+        fs.exitEval = top.eval;
+        returned = true;
+      }
+      int numbb = term->getNumSuccessors();
+      for (int bbi = 0; bbi < numbb; bbi++) {
+        BasicBlock *nextbb = term->getSuccessor(bbi);
+        if (!queued.insert(nextbb).second)
+          continue;
+        queue.push_back(block_eval_status(nextbb, top.eval));
+      }
+    }
+    summaries[f] = std::move(fs);
+  }
+  
+  void summarizeBasicBlock(function_summary& fs, BasicBlock *bb, int &eval,
+                           const SmallPtrSetImpl<Function *>& sccFuncs)
+  {
+    if (Verbose) {
+      raw_os_ostream stm(std::cerr);
+      stm << "  BasicBlock: ";
+      bb->printAsOperand(stm, true);
+      stm << '\n';
+    }
+    int64_t weight = weights ? weights->getBlockWeight(bb) : 1;
     
-    if (opnd) {
-      bool success = analyze_function(imix, opnd, countedbbs, eval);
-      if (success && !CountCallSite)
+    for (Instruction& inst: *bb) {
+      int delim = isDelimiterInstruction(&inst);
+      eval += delim;
+      if (delim > 0)
         continue;
+      
+      if (isSkippableInstruction(&inst))
+        continue;
+      
+      Function *opnd = nullptr;
+      if (CallBase *call = dyn_cast<CallBase>(&inst))
+        opnd = call->getCalledFunction();
+      
+      if (opnd && !opnd->empty()) {
+        if (CountCallSite)
+          fs.mixByEval[eval].updateWithInstruction(&inst, weight);
+        const function_summary *callee = sccFuncs.count(opnd) ? nullptr : get(opnd);
+        if (!callee) {
+          if (Verbose)
+            std::cerr << "Recursion!" << std::endl;
+          continue;
+        }
+        for (auto& evalMix: callee->mixByEval)
+          fs.mixByEval[eval + evalMix.first].add(evalMix.second, weight);
+        eval += callee->exitEval;
+        continue;
+      }
+      
+      fs.mixByEval[eval].updateWithInstruction(&inst, weight);
     }
+  }
+};
 
-    if (!eval)
-      continue;
-    
-    imix.updateWithInstruction(&inst);
+
+/* The function bodies are loaded lazily, see LazyModule.h */
+std::unique_ptr<Module> readModule(const std::string& filename, LLVMContext& c, std::string& error)
+{
+  std::unique_ptr<Module> m = readLazyModule(filename, c, error);
+  if (m && Verbose) {
+    std::cerr << "Successfully read Module:" << std::endl;
+    std::cerr << " Name: " << m.get()->getName().str() << std::endl;
+    std::cerr << " Target triple: " << m->getTargetTriple() << std::endl;
   }
+  return m;
+}
+
+
+int instrumentModule(const std::string& filename)
+{
+  LLVMContext c;
+  std::string error;
+  std::unique_ptr<Module> m = readModule(filename, c, error);
+  if (!m) {
+    std::cerr << "Error reading module " << filename << ": " << error << std::endl;
+    return 1;
+  }
+  if (Error e = m->materializeAll()) {
+    std::cerr << "Error reading module " << filename << ": " << toString(std::move(e)) << std::endl;
+    return 1;
+  }
+  std::vector<mix_segment> segments;
+  collectMixSegments(*m, segments);
+  instrumentForDynamicMix(*m, segments);
   
-  return;
+  std::error_code ec;
+  raw_fd_ostream out(OutputFilename, ec, OutputAssembly ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (ec) {
+    std::cerr << "Error opening " << OutputFilename << ": " << ec.message() << std::endl;
+    return 1;
+  }
+  if (OutputAssembly)
+    m->print(out, nullptr);
+  else
+    WriteBitcodeToFile(*m, out);
+  return 0;
 }
 
 
-bool analyze_function(InstructionMix& imix, Function *f, std::unordered_set<BasicBlock *>& countedbbs, int &eval)
+/* Computes the mix of a file; called concurrently on different files */
+void analyzeFile(const std::string& filename, FeatureTable::Row& row)
 {
-  if (Verbose)
-    std::cerr << " Function: " << f->getName().str() << std::endl;
+  LLVMContext c;
+  std::string error;
+  std::unique_ptr<Module> m = readModule(filename, c, error);
+  if (!m) {
+    row.error = "Error reading module " + filename + ": " + error;
+    return;
+  }
   
-  auto &bblist = f->getBasicBlockList();
-  if (bblist.empty()) {
-    return false;
+  InstructionMix imix;
+  if (!ProfileFilename.empty()) {
+    /* the segments are numbered over the whole module */
+    if (Error e = m->materializeAll()) {
+      row.error = "Error reading module " + filename + ": " + toString(std::move(e));
+      return;
+    }
+    std::vector<mix_segment> segments;
+    collectMixSegments(*m, segments);
+    std::vector<uint64_t> counts;
+    if (!readMixProfile(ProfileFilename, segments.size(), counts, row.error))
+      return;
+    computeDynamicMix(segments, counts, CountCallSite, imix);
+  } else {
+    Function *mainfunc = m->getFunction("main");
+    if (!mainfunc || mainfunc->isDeclaration()) {
+      row.error = "No main function found!";
+      return;
+    }
+    if (!materializeReachableFunctions(*mainfunc, error)) {
+      row.error = "Error reading module " + filename + ": " + error;
+      return;
+    }
+    std::unique_ptr<LoopWeights> weights;
+    if (Weighted)
+      weights.reset(new LoopWeights());
+    MixSummaries summaries(*m, weights.get());
+    summaries.getMix(mainfunc, imix);
   }
   
-  if (countedbbs.find(&(f->getEntryBlock())) != countedbbs.end()) {
-    if (Verbose)
-      std::cerr << "Recursion!" << std::endl;
-    return true;
+  int64_t cycles = 0;
+  if (EstimateCycles) {
+    std::string target = CostTarget.empty() ? m->getTargetTriple() : CostTarget.getValue();
+    const LatencyTable *builtin = getBuiltinLatencyTable(target);
+    if (!builtin && costTableText.empty()) {
+      row.error = "No latency table for target \"" + target + "\"";
+      return;
+    }
+    LatencyTable table = builtin ? *builtin : LatencyTable();
+    table.parse(costTableText, error);
+    cycles = estimateCycles(imix, table);
   }
   
-  std::deque<block_eval_status> queue;
-  queue.push_back(block_eval_status(&f->getEntryBlock(), eval));
-  while (queue.size() > 0) {
-    block_eval_status top = queue.front();
-    queue.pop_front();
-    
-    analyze_basic_block(imix, top.block, countedbbs, top.eval);
-    eval = top.eval;
-    
-    Instruction *term = top.block->getTerminator();
-    assert(term && "denormal bb found; abort");
-    int numbb = term->getNumSuccessors();
-    for (int bbi = 0; bbi < numbb; bbi++) {
-      BasicBlock *nextbb = term->getSuccessor(bbi);
-      if (countedbbs.find(nextbb) != countedbbs.end()) {
-        if (Verbose)
-          std::cerr << "Loop!" << std::endl;
-        continue;
-      }
-      
-      queue.push_back(block_eval_status(nextbb, top.eval));
+  row.features.push_back({"*", imix.ninstr});
+  if (EstimateCycles)
+    row.features.push_back({"cycles", cycles});
+  std::map<std::string, int64_t> stat = imix.getStat();
+  for (auto it = stat.begin(); it != stat.end(); it++)
+    row.features.push_back(*it);
+}
+
+
+/* Prints the differences between the mixes of the float and the converted
+ * functions, for -compare */
+int compareModules(const std::string& floatFile, const std::string& fixedFile)
+{
+  LLVMContext c;
+  std::unique_ptr<LoopWeights> weights;
+  if (Weighted)
+    weights.reset(new LoopWeights());
+  std::function<int64_t(BasicBlock *)> blockWeight;
+  if (weights)
+    blockWeight = [&](BasicBlock *bb) { return weights->getBlockWeight(bb); };
+  
+  std::vector<function_mix> mixes[2];
+  std::unique_ptr<Module> modules[2];
+  const std::string *files[2] = {&floatFile, &fixedFile};
+  for (int i = 0; i < 2; i++) {
+    std::string error;
+    modules[i] = readModule(*files[i], c, error);
+    if (!modules[i]) {
+      std::cerr << "Error reading module " << *files[i] << ": " << error << std::endl;
+      return 1;
     }
+    if (Error e = modules[i]->materializeAll()) {
+      std::cerr << "Error reading module " << *files[i] << ": " << toString(std::move(e)) << std::endl;
+      return 1;
+    }
+    mixes[i] = collectFunctionMixes(*modules[i], blockWeight);
   }
   
-  return true;
+  FeatureTable table;
+  table.keyName = "function";
+  table.rows = compareFunctionMixes(mixes[0], mixes[1]);
+  table.print(std::cout, OutputFormat);
+  return 0;
 }
 
 
 int main(int argc, char *argv[])
 {
   cl::ParseCommandLineOptions(argc, argv);
-
-  LLVMContext c;
-  SMDiagnostic Err;
-  std::unique_ptr<Module> m = parseIRFile(InputFilename, Err, c);
-  if (!m) {
-    std::cerr << "Error reading module " << InputFilename << std::endl;
+  
+  std::vector<std::string> files;
+  if (!collectInputFiles(InputFilenames, InputListFilename, files)) {
+    std::cerr << "Error reading " << InputListFilename << std::endl;
     return 1;
   }
-
-  if (Verbose) {
-    std::cerr << "Successfully read Module:" << std::endl;
-    std::cerr << " Name: " << m.get()->getName().str() << std::endl;
-    std::cerr << " Target triple: " << m->getTargetTriple() << std::endl;
+  if (files.empty()) {
+    std::cerr << "No input files" << std::endl;
+    return 1;
   }
-
-  int eval = 0;
-  std::unordered_set<BasicBlock *> bbs;
-  InstructionMix imix;
   
-  Function *mainfunc = m->getFunction("main");
-  if (!mainfunc) {
-    std::cout << "No main function found!\n";
-  } else {
-    analyze_function(imix, mainfunc, bbs, eval);
+  if (Instrument) {
+    if (files.size() != 1) {
+      std::cerr << "-instrument takes a single input file" << std::endl;
+      return 1;
+    }
+    return instrumentModule(files[0]);
   }
-
-  std::cout << "* " << imix.ninstr << std::endl;
-  for (auto it = imix.stat.begin(); it != imix.stat.end(); it++) {
-    std::cout << it->first << " " << it->second;
-    std::cout << std::endl;
+  if (Compare) {
+    if (files.size() != 2 || !ProfileFilename.empty()) {
+      std::cerr << "-compare takes the float and the converted module" << std::endl;
+      return 1;
+    }
+    return compareModules(files[0], files[1]);
   }
-
+  if (!ProfileFilename.empty() && files.size() != 1) {
+    std::cerr << "-profile takes a single input file" << std::endl;
+    return 1;
+  }
+  
+  if (!CostTableFilename.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(CostTableFilename);
+    if (!buf) {
+      std::cerr << "Error reading " << CostTableFilename << ": " << buf.getError().message() << std::endl;
+      return 1;
+    }
+    costTableText = (*buf)->getBuffer().str();
+    std::string error;
+    LatencyTable check;
+    if (!check.parse(costTableText, error)) {
+      std::cerr << CostTableFilename << ": " << error << std::endl;
+      return 1;
+    }
+  }
+  
+  FeatureTable table = analyzeFiles(files, Jobs, analyzeFile);
+  table.print(std::cout, OutputFormat);
+  
+  /* a single input keeps failing as it did before batch mode */
+  if (files.size() == 1 && !table.rows[0].error.empty())
+    return 1;
   return 0;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
 #include <llvm/Support/JSON.h>
 #include <map>
 #include <sstream>
@@ -28,39 +29,34 @@ namespace taffo
 		AnnotationMap(const llvm::json::Array &root);
 		AnnotationMap() = default;
 
-		std::string globalToStr(llvm::StringRef name)
+		/* The annotations are serialized once, when they are inserted; the
+		 * returned strings are empty if there is no annotation and live as long
+		 * as the map */
+		llvm::StringRef globalToStr(llvm::StringRef name) const
 		{
-			std::stringstream ss;
-			if (globalExists(name))
-			{
-				serialize(ss, globalAnnotations[name], symbolTable);
-				return ss.str();
-			}
-			return "";
+			return lookup(globalStrings, name);
 		}
 
-		std::string localToStr(llvm::StringRef name, llvm::StringRef function)
+		llvm::StringRef localToStr(
+				llvm::StringRef name, llvm::StringRef function) const
 		{
-			std::stringstream ss;
-			if (localExists(name, function))
-			{
-				serialize(ss, localAnnotations[function][name], symbolTable);
-				return ss.str();
-			}
-			return "";
+			auto fun = localStrings.find(function);
+			if (fun == localStrings.end())
+				return "";
+			return lookup(fun->getValue(), name);
 		}
 
-		std::string functionToStr(llvm::StringRef name)
+		llvm::StringRef functionToStr(llvm::StringRef name) const
 		{
-			std::stringstream ss;
-			if (functionExists(name))
-			{
-				serialize(ss, functionAnnotations[name], symbolTable);
-				return ss.str();
-			}
-			return "";
+			return lookup(functionStrings, name);
 		}
 
+		/* Names of the annotated variables and functions, to narrow the
+		 * searches to them */
+		std::vector<llvm::StringRef> globalNames() const;
+		std::vector<llvm::StringRef> localNames() const;
+		std::vector<llvm::StringRef> functionNames() const;
+
 		bool functionExists(llvm::StringRef name) const
 		{
 			return functionAnnotations.find(name) != functionAnnotations.end();
@@ -79,11 +75,13 @@ namespace taffo
 
 		void insertGlobal(StringOrAnnotation annotation, llvm::StringRef varName)
 		{
+			globalStrings[varName] = intern(annotation);
 			globalAnnotations[varName] = std::move(annotation);
 		}
 		void insertFunction(
 				StringOrAnnotation annotation, llvm::StringRef functionName)
 		{
+			functionStrings[functionName] = intern(annotation);
 			functionAnnotations[functionName] = std::move(annotation);
 		}
 		void insertLocal(
@@ -91,20 +89,42 @@ namespace taffo
 				llvm::StringRef varName,
 				llvm::StringRef functionName)
 		{
+			localStrings[functionName][varName] = intern(annotation);
 			localAnnotations[functionName][varName] = std::move(annotation);
 		}
 
+		/* The annotations which refer to the struct are serialized again */
 		void insertStruct(StructAnnotation strct, llvm::StringRef strName)
 		{
 			symbolTable[strName] = std::move(strct);
+			serializeAll();
 		}
 
 		void toJSON(std::ostream &stream);
 
 		private:
+		static llvm::StringRef
+		lookup(const llvm::StringMap<llvm::StringRef> &map, llvm::StringRef name)
+		{
+			auto ann = map.find(name);
+			if (ann == map.end())
+				return "";
+			return ann->getValue();
+		}
+
+		llvm::StringRef intern(const StringOrAnnotation &ann);
+		void serializeAll();
+
 		llvm::StringMap<llvm::StringMap<StringOrAnnotation>> localAnnotations;
 		llvm::StringMap<StringOrAnnotation> globalAnnotations;
 		llvm::StringMap<StringOrAnnotation> functionAnnotations;
 		llvm::StringMap<StructAnnotation> symbolTable;
+
+		/* Serialized annotations; many variables share the same annotation, so
+		 * the strings are stored once in internedStrings */
+		llvm::StringSet<> internedStrings;
+		llvm::StringMap<llvm::StringMap<llvm::StringRef>> localStrings;
+		llvm::StringMap<llvm::StringRef> globalStrings;
+		llvm::StringMap<llvm::StringRef> functionStrings;
 	};
 }	// namespace taffo
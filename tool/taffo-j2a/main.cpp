@@ -3,16 +3,25 @@
 #include <clang/Basic/Diagnostic.h>
 #include <clang/Basic/DiagnosticOptions.h>
 #include <clang/Frontend/FrontendActions.h>
-#include <clang/Frontend/TextDiagnosticPrinter.h>
-#include <clang/Rewrite/Core/Rewriter.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 #include <clang/Tooling/Refactoring.h>
 #include <clang/Tooling/Tooling.h>
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/JSON.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 
 #include "taffoAnnotations.hpp"
 
@@ -42,12 +51,27 @@ static cl::opt<std::string> AnnotationJSON(
 		cl::init(""),
 		cl::cat(AnnotationInserterCategory));
 
+static cl::opt<unsigned> Jobs(
+		"jobs",
+		cl::desc("Number of translation units annotated in parallel "
+						 "(default: number of CPU cores)"),
+		cl::init(0),
+		cl::cat(AnnotationInserterCategory));
+
+static cl::opt<std::string> Manifest(
+		"manifest",
+		cl::desc("Skip the files which did not change, and whose annotations did "
+						 "not change, since the previous run with the same manifest "
+						 "(requires -i)"),
+		cl::init(""),
+		cl::cat(AnnotationInserterCategory));
+
 class DeclarationPrinter: public MatchFinder::MatchCallback
 {
 	public:
 	DeclarationPrinter(
 			std::map<std::string, Replacements> &replacements,
-			taffo::AnnotationMap &annotations)
+			const taffo::AnnotationMap &annotations)
 			: replacements(replacements), annotations(annotations)
 	{
 	}
@@ -102,7 +126,7 @@ class DeclarationPrinter: public MatchFinder::MatchCallback
 	}
 
 	void addReplacement(
-			SourceRange Old, const ASTContext &Context, std::string ann)
+			SourceRange Old, const ASTContext &Context, StringRef ann)
 	{
 		std::string NewText;
 		NewText += Lexer::getSourceText(
@@ -110,7 +134,7 @@ class DeclarationPrinter: public MatchFinder::MatchCallback
 				Context.getSourceManager(),
 				Context.getLangOpts());
 
-		NewText += " __attribute((annotate(\"" + ann + "\"))) ";
+		NewText += " __attribute((annotate(\"" + ann.str() + "\"))) ";
 
 		tooling::Replacement R(
 				Context.getSourceManager(),
@@ -118,14 +142,14 @@ class DeclarationPrinter: public MatchFinder::MatchCallback
 				NewText,
 				Context.getLangOpts());
 
-		consumeError(replacements[R.getFilePath()].add(R));
+		insert(R, Context);
 	}
 
 	void addHeadReplacement(
-			SourceRange Old, const ASTContext &Context, std::string ann)
+			SourceRange Old, const ASTContext &Context, StringRef ann)
 	{
 		std::string NewText;
-		NewText += " __attribute((annotate(\"" + ann + "\"))) ";
+		NewText += " __attribute((annotate(\"" + ann.str() + "\"))) ";
 		NewText += Lexer::getSourceText(
 				CharSourceRange::getTokenRange(Old),
 				Context.getSourceManager(),
@@ -137,17 +161,17 @@ class DeclarationPrinter: public MatchFinder::MatchCallback
 				NewText,
 				Context.getLangOpts());
 
-		consumeError(replacements[R.getFilePath()].add(R));
+		insert(R, Context);
 	}
 
 	void addFunctionReplacement(
-			SourceRange Old, const ASTContext &Context, std::string anno)
+			SourceRange Old, const ASTContext &Context, StringRef anno)
 	{
 		std::string NewText = Lexer::getSourceText(
 				CharSourceRange::getTokenRange(Old),
 				Context.getSourceManager(),
 				Context.getLangOpts());
-		NewText += " __attribute((annotate(\"" + anno + "\"))) ";
+		NewText += " __attribute((annotate(\"" + anno.str() + "\"))) ";
 
 		tooling::Replacement R(
 				Context.getSourceManager(),
@@ -155,14 +179,309 @@ class DeclarationPrinter: public MatchFinder::MatchCallback
 				NewText,
 				Context.getLangOpts());
 
-		consumeError(replacements[R.getFilePath()].add(R));
+		insert(R, Context);
 	}
 
 	private:
+	/* The path of the file is made absolute, since each translation unit is
+	 * parsed in the directory of its compile command */
+	void insert(const tooling::Replacement &R, const ASTContext &Context)
+	{
+		SmallString<256> path(R.getFilePath());
+		Context.getSourceManager().getFileManager().makeAbsolutePath(path);
+		sys::path::remove_dots(path, true);
+		tooling::Replacement absolute(
+				path, R.getOffset(), R.getLength(), R.getReplacementText());
+		consumeError(replacements[absolute.getFilePath()].add(absolute));
+	}
+
 	std::map<std::string, Replacements> &replacements;
-	taffo::AnnotationMap &annotations;
+	const taffo::AnnotationMap &annotations;
 };
 
+/* Names of the variables and functions declared in a translation unit, as
+ * "g:<global>", "f:<function>" or "l:<function>:<local>", with the same
+ * criteria of DeclarationPrinter */
+class NameCollector: public MatchFinder::MatchCallback
+{
+	public:
+	NameCollector(std::set<std::string> &names): names(names) {}
+
+	void run(const MatchFinder::MatchResult &result) override
+	{
+		if (auto dec = result.Nodes.getNodeAs<VarDecl>("Var"))
+		{
+			const std::string &declName = dec->getDeclName().getAsString();
+			if (dec->hasGlobalStorage())
+				names.insert("g:" + declName);
+			if (dec->isLocalVarDeclOrParm())
+			{
+				if (auto fun =
+								dyn_cast_or_null<FunctionDecl>(dec->getParentFunctionOrMethod()))
+					names.insert(
+							"l:" + fun->getNameInfo().getAsString() + ":" + declName);
+			}
+		}
+		if (auto dec = result.Nodes.getNodeAs<FunctionDecl>("Function"))
+			names.insert("f:" + dec->getNameAsString());
+	}
+
+	private:
+	std::set<std::string> &names;
+};
+
+static void runInParallel(size_t n, std::function<void(size_t)> fn)
+{
+	unsigned jobs = Jobs;
+	if (jobs == 0)
+		jobs = std::max(std::thread::hardware_concurrency(), 1U);
+	jobs = std::min<size_t>(jobs, n);
+
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < n; i = next++)
+			fn(i);
+	};
+	if (jobs <= 1)
+	{
+		worker();
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < jobs; i++)
+		threads.emplace_back(worker);
+	for (std::thread &t : threads)
+		t.join();
+}
+
+static std::string absolutePath(StringRef file)
+{
+	SmallString<256> path(file);
+	sys::fs::make_absolute(path);
+	sys::path::remove_dots(path, true);
+	return path.str().str();
+}
+
+/* Parses and matches a single translation unit, and returns the exit code
+ * of its ClangTool */
+static int annotateFile(
+		const CompilationDatabase &compilations,
+		const std::string &file,
+		const taffo::AnnotationMap &ann,
+		std::map<std::string, Replacements> &replacements,
+		std::set<std::string> *declared)
+{
+	/* each thread has its own file system, so that the working directories
+	 * of the compile commands do not change the one of the process */
+	IntrusiveRefCntPtr<vfs::FileSystem> fs =
+			vfs::createPhysicalFileSystem().release();
+	ClangTool tool(
+			compilations,
+			{file},
+			std::make_shared<PCHContainerOperations>(),
+			fs);
+	tool.setRestoreWorkingDir(false);
+
+	DeclarationPrinter printer(replacements, ann);
+	MatchFinder finder;
+
+	/* The matchers are narrowed to the annotated names, so that the files
+	 * with few annotations are cheap. hasAnyName does not accept an empty
+	 * list of names. */
+	std::vector<StringRef> localNames = ann.localNames();
+	if (!localNames.empty())
+	{
+		DeclarationMatcher localDlc =
+				varDecl(isExpansionInMainFile(), hasAnyName(localNames))
+						.bind("LocalDecl");
+		finder.addMatcher(localDlc, &printer);
+	}
+
+	std::vector<StringRef> globalNames = ann.globalNames();
+	if (!globalNames.empty())
+	{
+		DeclarationMatcher globalDlc =
+				varDecl(
+						hasGlobalStorage(),
+						isExpansionInMainFile(),
+						hasAnyName(globalNames))
+						.bind("GlobalDecl");
+		finder.addMatcher(globalDlc, &printer);
+	}
+
+	std::vector<StringRef> functionNames = ann.functionNames();
+	if (!functionNames.empty())
+	{
+		DeclarationMatcher functionDlc =
+				functionDecl(
+						hasBody(isExpansionInMainFile()), hasAnyName(functionNames))
+						.bind("FunctionDecl");
+		finder.addMatcher(functionDlc, &printer);
+	}
+
+	std::unique_ptr<NameCollector> collector;
+	if (declared)
+	{
+		collector = std::make_unique<NameCollector>(*declared);
+		finder.addMatcher(
+				varDecl(isExpansionInMainFile()).bind("Var"), collector.get());
+		finder.addMatcher(
+				functionDecl(hasBody(isExpansionInMainFile())).bind("Function"),
+				collector.get());
+	}
+	auto factory = tooling::newFrontendActionFactory(&finder);
+	return tool.run(factory.get());
+}
+
+/* Returns the content of file with its replacements applied, or None if
+ * the file cannot be read */
+static Optional<std::string> applyReplacements(
+		const std::string &file, const Replacements &replacements)
+{
+	auto buffer = MemoryBuffer::getFile(file);
+	if (!buffer)
+	{
+		errs() << "Could not read " << file << ": "
+					 << buffer.getError().message() << "\n";
+		return None;
+	}
+	auto code = tooling::applyAllReplacements(
+			buffer.get()->getBuffer(), replacements);
+	if (!code)
+	{
+		errs() << "Could not apply the annotations to " << file << ": "
+					 << toString(code.takeError()) << "\n";
+		return None;
+	}
+	return std::move(code.get());
+}
+
+/* Incremental runs
+ * The manifest has a tab-separated line for each file annotated in place,
+ * with the hash of its content and compile command after the run, the hash
+ * of the annotations of the names declared in it, and those names. A file
+ * is up to date if both hashes did not change, since the declared names
+ * only depend on the content. */
+struct ManifestEntry
+{
+	std::string sourceHash;
+	std::string annotationsHash;
+	std::vector<std::string> names;
+};
+
+static std::string sourceHash(
+		const CompilationDatabase &compilations, const std::string &file)
+{
+	auto buffer = MemoryBuffer::getFile(file);
+	if (!buffer)
+		return "";
+	const StringRef sep("\0", 1);
+	MD5 hasher;
+	hasher.update(buffer.get()->getBuffer());
+	for (const CompileCommand &command : compilations.getCompileCommands(file))
+	{
+		hasher.update(sep);
+		hasher.update(command.Directory);
+		for (const std::string &arg : command.CommandLine)
+		{
+			hasher.update(sep);
+			hasher.update(arg);
+		}
+	}
+	MD5::MD5Result res;
+	hasher.final(res);
+	return std::string(res.digest().str());
+}
+
+static std::string annotationsHash(
+		const taffo::AnnotationMap &ann, const std::vector<std::string> &names)
+{
+	const StringRef sep("\0", 1);
+	MD5 hasher;
+	for (StringRef name : names)
+	{
+		StringRef annotation;
+		std::pair<StringRef, StringRef> kindAndName = name.split(':');
+		if (kindAndName.first == "g")
+			annotation = ann.globalToStr(kindAndName.second);
+		else if (kindAndName.first == "f")
+			annotation = ann.functionToStr(kindAndName.second);
+		else
+		{
+			std::pair<StringRef, StringRef> local = kindAndName.second.split(':');
+			annotation = ann.localToStr(local.second, local.first);
+		}
+		hasher.update(name);
+		hasher.update(sep);
+		hasher.update(annotation);
+		hasher.update(sep);
+	}
+	MD5::MD5Result res;
+	hasher.final(res);
+	return std::string(res.digest().str());
+}
+
+static void readManifest(
+		StringRef filename, std::map<std::string, ManifestEntry> &manifest)
+{
+	auto buffer = MemoryBuffer::getFile(filename);
+	if (!buffer)
+		return;
+	SmallVector<StringRef, 64> lines;
+	buffer.get()->getBuffer().split(lines, '\n', -1, false);
+	for (StringRef line : lines)
+	{
+		SmallVector<StringRef, 16> fields;
+		line.split(fields, '\t');
+		if (fields.size() < 3)
+			continue;
+		ManifestEntry &entry = manifest[fields[0].str()];
+		entry.sourceHash = fields[1].str();
+		entry.annotationsHash = fields[2].str();
+		for (unsigned i = 3; i < fields.size(); i++)
+			entry.names.push_back(fields[i].str());
+	}
+}
+
+/* The manifest is written to a temporary file and then moved in place, so
+ * that an interrupted run does not leave a partial manifest */
+static bool writeManifest(
+		StringRef filename, const std::map<std::string, ManifestEntry> &manifest)
+{
+	SmallString<128> tmpPath;
+	int fd;
+	if (sys::fs::createUniqueFile(filename + ".%%%%%%%%.tmp", fd, tmpPath))
+	{
+		errs() << "Could not write " << filename << "\n";
+		return false;
+	}
+	{
+		raw_fd_ostream out(fd, true);
+		for (const auto &fileAndEntry : manifest)
+		{
+			out << fileAndEntry.first << "\t" << fileAndEntry.second.sourceHash
+					<< "\t" << fileAndEntry.second.annotationsHash;
+			for (const std::string &name : fileAndEntry.second.names)
+				out << "\t" << name;
+			out << "\n";
+		}
+		if (out.has_error())
+		{
+			out.clear_error();
+			sys::fs::remove(tmpPath);
+			errs() << "Could not write " << filename << "\n";
+			return false;
+		}
+	}
+	if (sys::fs::rename(tmpPath, filename))
+	{
+		sys::fs::remove(tmpPath);
+		errs() << "Could not write " << filename << "\n";
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, const char **argv)
 {
 	CommonOptionsParser OptionParser(argc, argv, AnnotationInserterCategory);
@@ -185,55 +504,134 @@ int main(int argc, const char **argv)
 		llvm::errs() << "Could not parse " << AnnotationFile;
 		return -1;
 	}
-	taffo::AnnotationMap ann(*parsed);
+	/* read-only after loading, it is shared among the threads */
+	const taffo::AnnotationMap ann(*parsed);
 
+	/* The translation units are parsed and matched concurrently, each one by
+	 * its own ClangTool; their replacements are then merged per file, since
+	 * the same file may be a source path more than once */
 	auto Files = OptionParser.getSourcePathList();
-	tooling::RefactoringTool tool(OptionParser.getCompilations(), Files);
-
-	DeclarationPrinter printer(tool.getReplacements(), ann);
-	MatchFinder finder;
-
-	DeclarationMatcher localDlc =
-			varDecl(isExpansionInMainFile()).bind("LocalDecl");
-
-	DeclarationMatcher globalDlc =
-			varDecl(hasGlobalStorage(), isExpansionInMainFile()).bind("GlobalDecl");
-
-	DeclarationMatcher functionDlc =
-			functionDecl(hasBody(isExpansionInMainFile())).bind("FunctionDecl");
-
-	finder.addMatcher(localDlc, &printer);
-	finder.addMatcher(globalDlc, &printer);
-	finder.addMatcher(functionDlc, &printer);
-	auto factory = tooling::newFrontendActionFactory(&finder);
-
-	if (Inplace)
+	const CompilationDatabase &compilations = OptionParser.getCompilations();
+	if (!Manifest.empty() && !Inplace)
 	{
-		int out = tool.runAndSave(factory.get());
-		return out;
+		errs() << "-manifest requires -i\n";
+		return -1;
 	}
+	std::map<std::string, ManifestEntry> manifest;
+	if (!Manifest.empty())
+		readManifest(Manifest, manifest);
+	/* per source path; not vector<bool>, since it is written by the threads */
+	std::vector<char> skipped(Files.size(), false);
+	std::vector<char> failed(Files.size(), false);
+	std::vector<std::set<std::string>> declared(Files.size());
+
+	std::map<std::string, Replacements> replacements;
+	std::mutex replacementsMutex;
+	std::atomic<int> ExitCode(0);
+	runInParallel(Files.size(), [&](size_t i) {
+		if (!Manifest.empty())
+		{
+			auto entry = manifest.find(absolutePath(Files[i]));
+			if (entry != manifest.end() &&
+					entry->second.sourceHash == sourceHash(compilations, entry->first) &&
+					entry->second.annotationsHash ==
+							annotationsHash(ann, entry->second.names))
+			{
+				skipped[i] = true;
+				return;
+			}
+		}
 
-	int ExitCode = tool.run(factory.get());
-	LangOptions DefaultLangOptions;
-	IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts(new DiagnosticOptions());
-	TextDiagnosticPrinter DiagnosticPrinter(errs(), &*DiagOpts);
-	DiagnosticsEngine Diagnostics(
-			IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
-			&*DiagOpts,
-			&DiagnosticPrinter,
-			false);
+		std::map<std::string, Replacements> fileReplacements;
+		int out = annotateFile(
+				compilations,
+				Files[i],
+				ann,
+				fileReplacements,
+				Manifest.empty() ? nullptr : &declared[i]);
+		if (out != 0)
+		{
+			ExitCode = out;
+			failed[i] = true;
+		}
 
-	auto &FileMgr = tool.getFiles();
-	SourceManager Sources(Diagnostics, FileMgr);
-	Rewriter Rewrite(Sources, DefaultLangOptions);
-	tool.applyAllReplacements(Rewrite);
+		std::lock_guard<std::mutex> lock(replacementsMutex);
+		for (const auto &fileAndReplacements : fileReplacements)
+		{
+			Replacements &merged = replacements[fileAndReplacements.first];
+			for (const tooling::Replacement &R : fileAndReplacements.second)
+				consumeError(merged.add(R));
+		}
+	});
 
-	for (const auto &File : Files)
+	if (Inplace)
 	{
-		const auto *Entry = FileMgr.getFile(File);
-		const auto ID = Sources.getOrCreateFileID(Entry, SrcMgr::C_User);
-		Rewrite.getEditBuffer(ID).write(outs());
+		std::vector<const std::pair<const std::string, Replacements> *> edited;
+		for (const auto &fileAndReplacements : replacements)
+			edited.push_back(&fileAndReplacements);
+		std::set<std::string> notWritten;
+		std::mutex notWrittenMutex;
+		runInParallel(edited.size(), [&](size_t i) {
+			const std::string &file = edited[i]->first;
+			auto code = applyReplacements(file, edited[i]->second);
+			std::error_code EC;
+			if (code)
+			{
+				raw_fd_ostream out(file, EC);
+				if (!EC)
+					out << *code;
+				else
+					errs() << "Could not write " << file << ": " << EC.message() << "\n";
+			}
+			if (!code || EC)
+			{
+				ExitCode = 1;
+				std::lock_guard<std::mutex> lock(notWrittenMutex);
+				notWritten.insert(file);
+			}
+		});
+
+		if (Manifest.empty())
+			return ExitCode;
+		/* the hashes are those of the annotated files, which are the sources of
+		 * the next run */
+		for (size_t i = 0; i < Files.size(); i++)
+		{
+			std::string file = absolutePath(Files[i]);
+			if (skipped[i])
+				continue;
+			if (failed[i] || notWritten.count(file))
+			{
+				manifest.erase(file);
+				continue;
+			}
+			ManifestEntry &entry = manifest[file];
+			entry.names.assign(declared[i].begin(), declared[i].end());
+			entry.sourceHash = sourceHash(compilations, file);
+			entry.annotationsHash = annotationsHash(ann, entry.names);
+		}
+		if (!writeManifest(Manifest, manifest))
+			return 1;
+		return ExitCode;
 	}
 
+	std::vector<std::string> outputs(Files.size());
+	runInParallel(Files.size(), [&](size_t i) {
+		std::string file = absolutePath(Files[i]);
+		auto fileReplacements = replacements.find(file);
+		auto code = applyReplacements(
+				file,
+				fileReplacements != replacements.end() ? fileReplacements->second
+																							 : Replacements());
+		if (!code)
+		{
+			ExitCode = 1;
+			return;
+		}
+		outputs[i] = std::move(*code);
+	});
+	for (const std::string &output : outputs)
+		outs() << output;
+
 	return ExitCode;
 }
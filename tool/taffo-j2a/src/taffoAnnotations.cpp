@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 namespace taffo
 {
@@ -167,6 +168,56 @@ namespace taffo
 				continue;
 			}
 		}
+		serializeAll();
+	}
+
+	llvm::StringRef AnnotationMap::intern(const StringOrAnnotation &ann)
+	{
+		std::stringstream ss;
+		serialize(ss, ann, symbolTable);
+		return internedStrings.insert(ss.str()).first->getKey();
+	}
+
+	void AnnotationMap::serializeAll()
+	{
+		localStrings.clear();
+		globalStrings.clear();
+		functionStrings.clear();
+		internedStrings.clear();
+		for (auto const &x : localAnnotations)
+			for (auto const &f : x.second)
+				localStrings[x.first()][f.first()] = intern(f.second);
+		for (auto const &x : globalAnnotations)
+			globalStrings[x.first()] = intern(x.second);
+		for (auto const &x : functionAnnotations)
+			functionStrings[x.first()] = intern(x.second);
+	}
+
+	std::vector<llvm::StringRef> AnnotationMap::globalNames() const
+	{
+		std::vector<llvm::StringRef> names;
+		for (auto const &x : globalAnnotations)
+			names.push_back(x.first());
+		return names;
+	}
+
+	std::vector<llvm::StringRef> AnnotationMap::localNames() const
+	{
+		llvm::StringSet<> unique;
+		std::vector<llvm::StringRef> names;
+		for (auto const &x : localAnnotations)
+			for (auto const &f : x.second)
+				if (unique.insert(f.first()).second)
+					names.push_back(f.first());
+		return names;
+	}
+
+	std::vector<llvm::StringRef> AnnotationMap::functionNames() const
+	{
+		std::vector<llvm::StringRef> names;
+		for (auto const &x : functionAnnotations)
+			names.push_back(x.first());
+		return names;
 	}
 	void AnnotationMap::toJSON(std::ostream &stream)
 	{
@@ -0,0 +1,343 @@
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+#include "RangeProfile.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+
+#define RANGE_PROFILE_HEADER "taffo-range-profile"
+
+
+StringRef getSourceName(const Function& f)
+{
+  if (DISubprogram *sp = f.getSubprogram())
+    return sp->getName();
+  return f.getName();
+}
+
+
+StringRef getSourceName(const GlobalVariable& gv)
+{
+  SmallVector<DIGlobalVariableExpression *, 1> dbg;
+  gv.getDebugInfo(dbg);
+  if (!dbg.empty())
+    return dbg[0]->getVariable()->getName();
+  return gv.getName();
+}
+
+
+/* Floating point values and arrays of them, which are annotated with a
+ * single range */
+static bool isRangeType(Type *ty)
+{
+  while (ty->isArrayTy())
+    ty = ty->getArrayElementType();
+  return ty->isFloatingPointTy();
+}
+
+
+void collectRangeSlots(Module& m, std::vector<range_slot>& out)
+{
+  for (GlobalVariable& gv: m.globals()) {
+    if (gv.isDeclaration() || !isRangeType(gv.getValueType()) ||
+        gv.getName().startswith("llvm.") || gv.getName().startswith("__taffo_"))
+      continue;
+    StringRef name = getSourceName(gv);
+    if (!name.empty())
+      out.push_back({&gv, nullptr, name.str()});
+  }
+
+  for (Function& f: m) {
+    if (f.isDeclaration())
+      continue;
+    for (Argument& arg: f.args()) {
+      if (arg.getType()->isFloatingPointTy() && arg.hasName())
+        out.push_back({&arg, &f, arg.getName().str()});
+    }
+
+    DenseMap<const AllocaInst *, StringRef> declared;
+    for (Instruction& inst: instructions(f)) {
+      if (auto *decl = dyn_cast<DbgDeclareInst>(&inst)) {
+        if (auto *alloca = dyn_cast_or_null<AllocaInst>(decl->getAddress()))
+          declared.insert({alloca, decl->getVariable()->getName()});
+      }
+    }
+    for (Instruction& inst: instructions(f)) {
+      auto *alloca = dyn_cast<AllocaInst>(&inst);
+      if (!alloca || !isRangeType(alloca->getAllocatedType()))
+        continue;
+      /* without debug info, clang names the copies of the parameters
+       * <name>.addr */
+      StringRef name = declared.lookup(alloca);
+      if (name.empty() && !f.getSubprogram()) {
+        name = alloca->getName();
+        if (name.endswith(".addr"))
+          name = name.drop_back(5);
+      }
+      if (!name.empty())
+        out.push_back({alloca, &f, name.str()});
+    }
+  }
+}
+
+
+static void updateRange(double value, double& min, double& max)
+{
+  if (std::isnan(value))
+    return;
+  min = std::min(min, value);
+  max = std::max(max, value);
+}
+
+
+static double toDouble(APFloat value)
+{
+  bool losesInfo;
+  value.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven, &losesInfo);
+  return value.convertToDouble();
+}
+
+
+/* Adds to the range the values of the initializer of a global */
+static void addConstantRange(Constant *c, double& min, double& max)
+{
+  if (auto *fp = dyn_cast<ConstantFP>(c)) {
+    updateRange(toDouble(fp->getValueAPF()), min, max);
+  } else if (isa<ConstantAggregateZero>(c)) {
+    updateRange(0.0, min, max);
+  } else if (auto *seq = dyn_cast<ConstantDataSequential>(c)) {
+    for (unsigned i = 0; i < seq->getNumElements(); i++)
+      updateRange(toDouble(seq->getElementAsAPFloat(i)), min, max);
+  } else if (auto *arr = dyn_cast<ConstantArray>(c)) {
+    for (Value *op: arr->operands())
+      addConstantRange(cast<Constant>(op), min, max);
+  }
+}
+
+
+/* Builds the function which writes the ranges to the profile file */
+static Function *createDumpFunction(Module& m, GlobalVariable *mins, GlobalVariable *maxs, uint64_t n)
+{
+  LLVMContext& c = m.getContext();
+  Type *voidTy = Type::getVoidTy(c);
+  Type *i32Ty = Type::getInt32Ty(c);
+  Type *i64Ty = Type::getInt64Ty(c);
+  Type *doubleTy = Type::getDoubleTy(c);
+  PointerType *ptrTy = Type::getInt8PtrTy(c);
+  FunctionCallee getenvF = m.getOrInsertFunction("getenv", ptrTy, ptrTy);
+  FunctionCallee fopenF = m.getOrInsertFunction("fopen", ptrTy, ptrTy, ptrTy);
+  FunctionCallee fcloseF = m.getOrInsertFunction("fclose", i32Ty, ptrTy);
+  FunctionCallee fprintfF = m.getOrInsertFunction("fprintf",
+      FunctionType::get(i32Ty, {ptrTy, ptrTy}, true));
+
+  Function *dump = Function::Create(FunctionType::get(voidTy, false),
+      GlobalValue::InternalLinkage, "__taffo_range_dump", &m);
+  BasicBlock *entry = BasicBlock::Create(c, "entry", dump);
+  BasicBlock *header = BasicBlock::Create(c, "header", dump);
+  BasicBlock *loop = BasicBlock::Create(c, "loop", dump);
+  BasicBlock *done = BasicBlock::Create(c, "done", dump);
+  BasicBlock *exit = BasicBlock::Create(c, "exit", dump);
+
+  IRBuilder<> b(entry);
+  Value *envName = b.CreateCall(getenvF, {b.CreateGlobalStringPtr(RANGE_PROFILE_ENV)});
+  Value *fileName = b.CreateSelect(b.CreateIsNull(envName),
+      b.CreateGlobalStringPtr(RANGE_PROFILE_DEFAULT), envName);
+  Value *file = b.CreateCall(fopenF, {fileName, b.CreateGlobalStringPtr("w")});
+  b.CreateCondBr(b.CreateIsNull(file), exit, header);
+
+  b.SetInsertPoint(header);
+  b.CreateCall(fprintfF, {file, b.CreateGlobalStringPtr(RANGE_PROFILE_HEADER " %llu\n"),
+                          ConstantInt::get(i64Ty, n)});
+  Value *format = b.CreateGlobalStringPtr("%.17g %.17g\n");
+  b.CreateBr(loop);
+
+  b.SetInsertPoint(loop);
+  PHINode *idx = b.CreatePHI(i64Ty, 2);
+  idx->addIncoming(ConstantInt::get(i64Ty, 0), header);
+  Value *minPtr = b.CreateInBoundsGEP(mins->getValueType(), mins,
+                                      {ConstantInt::get(i64Ty, 0), idx});
+  Value *maxPtr = b.CreateInBoundsGEP(maxs->getValueType(), maxs,
+                                      {ConstantInt::get(i64Ty, 0), idx});
+  b.CreateCall(fprintfF, {file, format, b.CreateLoad(doubleTy, minPtr),
+                          b.CreateLoad(doubleTy, maxPtr)});
+  Value *next = b.CreateAdd(idx, ConstantInt::get(i64Ty, 1));
+  idx->addIncoming(next, loop);
+  b.CreateCondBr(b.CreateICmpULT(next, ConstantInt::get(i64Ty, n)), loop, done);
+
+  b.SetInsertPoint(done);
+  b.CreateCall(fcloseF, {file});
+  b.CreateBr(exit);
+
+  b.SetInsertPoint(exit);
+  b.CreateRetVoid();
+  return dump;
+}
+
+
+void instrumentForRanges(Module& m, const std::vector<range_slot>& slots)
+{
+  if (slots.empty())
+    return;
+  LLVMContext& c = m.getContext();
+  Type *i32Ty = Type::getInt32Ty(c);
+  Type *i64Ty = Type::getInt64Ty(c);
+  Type *doubleTy = Type::getDoubleTy(c);
+  const double inf = std::numeric_limits<double>::infinity();
+
+  DenseMap<const Value *, unsigned> slotIdx;
+  std::vector<Constant *> minInit, maxInit;
+  for (unsigned i = 0; i < slots.size(); i++) {
+    slotIdx.insert({slots[i].value, i});
+    double min = inf, max = -inf;
+    if (auto *gv = dyn_cast<GlobalVariable>(slots[i].value))
+      addConstantRange(gv->getInitializer(), min, max);
+    minInit.push_back(ConstantFP::get(doubleTy, min));
+    maxInit.push_back(ConstantFP::get(doubleTy, max));
+  }
+  ArrayType *rangesTy = ArrayType::get(doubleTy, slots.size());
+  GlobalVariable *mins = new GlobalVariable(m, rangesTy, false,
+      GlobalValue::InternalLinkage, ConstantArray::get(rangesTy, minInit),
+      "__taffo_range_min");
+  GlobalVariable *maxs = new GlobalVariable(m, rangesTy, false,
+      GlobalValue::InternalLinkage, ConstantArray::get(rangesTy, maxInit),
+      "__taffo_range_max");
+
+  /* the stores to the slots, also through the elements of the arrays */
+  std::vector<std::pair<Instruction *, unsigned>> updates;
+  std::vector<std::pair<Argument *, unsigned>> args;
+  for (Function& f: m) {
+    for (Instruction& inst: instructions(f)) {
+      auto *store = dyn_cast<StoreInst>(&inst);
+      if (!store || !store->getValueOperand()->getType()->isFloatingPointTy())
+        continue;
+      auto idx = slotIdx.find(store->getPointerOperand()->stripInBoundsOffsets());
+      if (idx != slotIdx.end())
+        updates.push_back({store, idx->second});
+    }
+    for (Argument& arg: f.args()) {
+      auto idx = slotIdx.find(&arg);
+      if (idx != slotIdx.end())
+        args.push_back({&arg, idx->second});
+    }
+  }
+
+  IRBuilder<> b(c);
+  auto record = [&](Value *value, unsigned i) {
+    Value *v = b.CreateFPCast(value, doubleTy);
+    Value *minPtr = b.CreateInBoundsGEP(rangesTy, mins,
+                                        {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, i)});
+    Value *maxPtr = b.CreateInBoundsGEP(rangesTy, maxs,
+                                        {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, i)});
+    /* the comparisons are false for NaN, which is not recorded */
+    Value *min = b.CreateLoad(doubleTy, minPtr);
+    b.CreateStore(b.CreateSelect(b.CreateFCmpOLT(v, min), v, min), minPtr);
+    Value *max = b.CreateLoad(doubleTy, maxPtr);
+    b.CreateStore(b.CreateSelect(b.CreateFCmpOGT(v, max), v, max), maxPtr);
+  };
+  for (auto& update: updates) {
+    b.SetInsertPoint(update.first);
+    record(cast<StoreInst>(update.first)->getValueOperand(), update.second);
+  }
+  for (auto& arg: args) {
+    BasicBlock& entry = arg.first->getParent()->getEntryBlock();
+    b.SetInsertPoint(&*entry.getFirstInsertionPt());
+    record(arg.first, arg.second);
+  }
+
+  /* the dump function is registered with atexit by a constructor, so that
+   * it also runs when the program calls exit */
+  Function *dump = createDumpFunction(m, mins, maxs, slots.size());
+  FunctionCallee atexitF = m.getOrInsertFunction("atexit", i32Ty, dump->getType());
+  Function *init = Function::Create(FunctionType::get(Type::getVoidTy(c), false),
+      GlobalValue::InternalLinkage, "__taffo_range_init", &m);
+  b.SetInsertPoint(BasicBlock::Create(c, "entry", init));
+  b.CreateCall(atexitF, {dump});
+  b.CreateRetVoid();
+  appendToGlobalCtors(m, init, 0);
+}
+
+
+bool readRangeProfile(StringRef filename, size_t numSlots,
+                      std::vector<std::pair<double, double>>& ranges,
+                      std::string& error)
+{
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(filename);
+  if (!buf) {
+    error = "cannot read " + filename.str() + ": " + buf.getError().message();
+    return false;
+  }
+  SmallVector<StringRef, 64> lines;
+  (*buf)->getBuffer().split(lines, '\n', -1, false);
+  uint64_t n;
+  if (lines.empty() || !lines[0].startswith(RANGE_PROFILE_HEADER " ") ||
+      lines[0].drop_front(sizeof(RANGE_PROFILE_HEADER)).trim().getAsInteger(10, n)) {
+    error = filename.str() + " is not a range profile";
+    return false;
+  }
+  if (n != numSlots || lines.size() != n + 1) {
+    error = filename.str() + " was not produced by this module";
+    return false;
+  }
+  for (uint64_t i = 0; i < n; i++) {
+    std::pair<StringRef, StringRef> minMax = lines[i + 1].trim().split(' ');
+    double min, max;
+    if (minMax.first.getAsDouble(min) || minMax.second.trim().getAsDouble(max)) {
+      error = filename.str() + ": malformed range at line " + std::to_string(i + 2);
+      return false;
+    }
+    ranges[i].first = std::min(ranges[i].first, min);
+    ranges[i].second = std::max(ranges[i].second, max);
+  }
+  return true;
+}
+
+
+json::Array getRangeAnnotations(const std::vector<range_slot>& slots,
+                                const std::vector<std::pair<double, double>>& ranges,
+                                double margin)
+{
+  /* (is local, function, name) */
+  std::map<std::tuple<bool, std::string, std::string>, std::pair<double, double>> merged;
+  for (size_t i = 0; i < slots.size(); i++) {
+    if (ranges[i].first > ranges[i].second)
+      continue;
+    std::string function = slots[i].function ? getSourceName(*slots[i].function).str() : "";
+    auto range = merged.insert({std::make_tuple(slots[i].function != nullptr, function, slots[i].name),
+                                ranges[i]});
+    if (!range.second) {
+      range.first->second.first = std::min(range.first->second.first, ranges[i].first);
+      range.first->second.second = std::max(range.first->second.second, ranges[i].second);
+    }
+  }
+
+  json::Array res;
+  for (auto& var: merged) {
+    double min = var.second.first, max = var.second.second;
+    double width = max - min;
+    if (width == 0.0)
+      width = std::abs(max);
+    json::Object ann;
+    if (std::get<0>(var.first)) {
+      ann["localVar"] = std::get<2>(var.first);
+      ann["function"] = std::get<1>(var.first);
+    } else {
+      ann["globalVar"] = std::get<2>(var.first);
+    }
+    ann["rangeMin"] = min - margin * width;
+    ann["rangeMax"] = max + margin * width;
+    res.push_back(std::move(ann));
+  }
+  return res;
+}
@@ -0,0 +1,65 @@
+#ifndef TAFFO_J2MD_RANGE_PROFILE_H
+#define TAFFO_J2MD_RANGE_PROFILE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/JSON.h"
+
+
+/* Environment variable with the path of the profile written by an
+ * instrumented program, and path used when it is not set */
+#define RANGE_PROFILE_ENV "TAFFO_RANGE_PROFILE"
+#define RANGE_PROFILE_DEFAULT "ranges.prof"
+
+
+/* Name of a function or of a global variable in the source, taken from
+ * the debug info when there is any */
+llvm::StringRef getSourceName(const llvm::Function& f);
+llvm::StringRef getSourceName(const llvm::GlobalVariable& gv);
+
+/* A floating point global, alloca or argument, or an array of floating
+ * point values, whose range is recorded */
+struct range_slot {
+  llvm::Value *value;
+  /* function of the alloca or argument, nullptr for the globals */
+  llvm::Function *function;
+  /* name of the variable in the source */
+  std::string name;
+};
+
+/* Collects the slots of m, in module order. The order only depends on the
+ * module, so that the slots of an instrumented module correspond to the
+ * ones of the original module. The values without a name are skipped. */
+void collectRangeSlots(llvm::Module& m, std::vector<range_slot>& out);
+
+/* Instruments m to record the minimum and the maximum of the values
+ * stored to each slot, and of the arguments at the entry of their
+ * function. The ranges start from the initializers of the globals, and are
+ * written at exit to the file named by RANGE_PROFILE_ENV, or to
+ * RANGE_PROFILE_DEFAULT. The ranges are not updated atomically, so the
+ * profile of a multi-threaded program is approximate. */
+void instrumentForRanges(llvm::Module& m, const std::vector<range_slot>& slots);
+
+/* Merges into ranges the ranges of a profile written by an instrumented
+ * program; ranges must have numSlots elements, initially (+inf, -inf).
+ * Returns false, with a message in error, if the file cannot be read or
+ * does not have numSlots ranges. */
+bool readRangeProfile(llvm::StringRef filename, size_t numSlots,
+                      std::vector<std::pair<double, double>>& ranges,
+                      std::string& error);
+
+/* Annotations in the JSON format of taffo-j2a with the range of each
+ * variable, widened on both sides by margin times its width (or its
+ * magnitude, if the range is a single value). The slots with the same
+ * name in the same function are merged, and the slots never written are
+ * skipped. */
+llvm::json::Array getRangeAnnotations(const std::vector<range_slot>& slots,
+                                      const std::vector<std::pair<double, double>>& ranges,
+                                      double margin);
+
+#endif
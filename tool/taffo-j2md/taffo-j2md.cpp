@@ -0,0 +1,414 @@
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "InputInfo.h"
+#include "Metadata.h"
+#include "RangeProfile.h"
+
+using namespace llvm;
+using namespace mdutils;
+
+
+cl::OptionCategory TAFFOJ2MDOptions("taffo-j2md options");
+cl::opt<std::string> InputFilename(cl::Positional,
+  cl::desc("<input file>"),
+  cl::init("-"));
+cl::opt<std::string> OutputFilename("o",
+  cl::desc("Output filename"), cl::value_desc("filename"),
+  cl::init("-"), cl::cat(TAFFOJ2MDOptions));
+cl::opt<bool> OutputAssembly("S",
+  cl::desc("Write output as LLVM assembly"),
+  cl::init(false), cl::cat(TAFFOJ2MDOptions));
+cl::opt<std::string> AnnotationFile("f",
+  cl::desc("Annotation file"), cl::value_desc("filename"),
+  cl::init("./annotations.json"), cl::cat(TAFFOJ2MDOptions));
+cl::opt<std::string> AnnotationJSON("j",
+  cl::desc("Inline annotation JSON"),
+  cl::init(""), cl::cat(TAFFOJ2MDOptions));
+cl::opt<bool> Instrument("instrument",
+  cl::desc("Instrument the module to record the range of its floating point "
+           "variables, instead of annotating it"),
+  cl::init(false), cl::cat(TAFFOJ2MDOptions));
+cl::list<std::string> ProfileFilenames("profile", cl::value_desc("filename"),
+  cl::desc("Write the annotations with the ranges recorded by the runs of "
+           "the instrumented module, instead of annotating it"),
+  cl::ZeroOrMore, cl::cat(TAFFOJ2MDOptions));
+cl::opt<double> RangeMargin("range-margin", cl::value_desc("percent"),
+  cl::desc("Widen the profiled ranges by this percentage of their width on "
+           "both sides (default: 10)"),
+  cl::init(10.0), cl::cat(TAFFOJ2MDOptions));
+
+
+/* The annotations are in the JSON format of taffo-j2a: an array of objects
+ * with either a "globalVar", a "localVar" and its "function", a "function"
+ * or a "struct" key, and the attributes of the annotation. Instead of
+ * rewriting the sources, the annotations are attached to the values of the
+ * module as the metadata produced by the Initializer. */
+class AnnotationInjector
+{
+public:
+  AnnotationInjector(Module& m): m(m) {}
+
+  /* Returns false, with a message in error, on malformed annotations */
+  bool inject(const json::Array& root, std::string& error)
+  {
+    for (const json::Value& elem: root) {
+      const json::Object *obj = elem.getAsObject();
+      if (obj && obj->getString("struct") && !obj->getString("localVar") &&
+          !obj->getString("globalVar") && !obj->getString("function")) {
+        const json::Array *content = obj->getArray("content");
+        if (!content) {
+          error = "struct " + obj->getString("struct")->str() + " was declared without content";
+          return false;
+        }
+        structs[*obj->getString("struct")] = content;
+      }
+    }
+
+    for (const json::Value& elem: root) {
+      const json::Object *obj = elem.getAsObject();
+      if (!obj) {
+        error = "top level item of json was not an object";
+        return false;
+      }
+      if (obj->empty())
+        continue;
+      auto localVar = obj->getString("localVar");
+      auto globalVar = obj->getString("globalVar");
+      auto function = obj->getString("function");
+      if (!localVar && !globalVar && !function)
+        continue;
+
+      std::shared_ptr<MDInfo> info = buildInfo(*obj, error);
+      if (!info)
+        return false;
+      if (localVar && !function) {
+        error = "function name for local var " + localVar->str() + " is missing";
+        return false;
+      }
+      if (localVar)
+        annotateLocal(*localVar, *function, *obj, *info);
+      else if (globalVar)
+        annotateGlobal(*globalVar, *obj, *info);
+      else
+        annotateFunction(*function);
+    }
+    return true;
+  }
+
+private:
+  Module& m;
+  StringMap<const json::Array *> structs;
+  /* structs being built, to reject recursive ones */
+  SmallPtrSet<const json::Array *, 4> building;
+
+  std::shared_ptr<MDInfo> buildInfo(const json::Object& obj, std::string& error)
+  {
+    if (auto name = obj.getString("struct"))
+      return buildStruct(*name, error);
+
+    std::shared_ptr<Range> range;
+    Optional<double> min = getDouble(obj, "rangeMin");
+    Optional<double> max = getDouble(obj, "rangeMax");
+    if (min.hasValue() != max.hasValue()) {
+      error = "only one of range min and max was defined";
+      return nullptr;
+    }
+    if (min)
+      range = std::make_shared<Range>(*min, *max);
+
+    std::shared_ptr<TType> type;
+    auto bits = obj.getNumber("bitsSize");
+    auto fractional = obj.getNumber("fractionalPos");
+    if (bits.hasValue() != fractional.hasValue()) {
+      error = "only bits size or fractional pos was defined";
+      return nullptr;
+    }
+    if (bits) {
+      auto sign = obj.getString("typeSign");
+      type = std::make_shared<FPType>((unsigned)*bits, (unsigned)*fractional,
+                                      !sign || *sign != "unsigned");
+    }
+
+    std::shared_ptr<double> err;
+    if (Optional<double> e = getDouble(obj, "error"))
+      err = std::make_shared<double>(*e);
+
+    auto disabled = obj.getNumber("disabled");
+    auto isFinal = obj.getNumber("final");
+    return std::make_shared<InputInfo>(type, range, err,
+                                       !disabled || *disabled == 0.0,
+                                       isFinal && *isFinal != 0.0);
+  }
+
+  std::shared_ptr<MDInfo> buildStruct(StringRef name, std::string& error)
+  {
+    auto content = structs.find(name);
+    if (content == structs.end()) {
+      error = "struct " + name.str() + " not found";
+      return nullptr;
+    }
+    const json::Array *fields = content->getValue();
+    if (!building.insert(fields).second) {
+      error = "struct " + name.str() + " contains itself";
+      return nullptr;
+    }
+
+    std::vector<std::shared_ptr<MDInfo>> infos;
+    for (const json::Value& field: *fields) {
+      std::shared_ptr<MDInfo> info;
+      if (auto fieldStruct = field.getAsString()) {
+        if (*fieldStruct != "void")
+          info = buildStruct(*fieldStruct, error);
+        if (*fieldStruct != "void" && !info)
+          return nullptr;
+      } else if (const json::Object *obj = field.getAsObject()) {
+        info = buildInfo(*obj, error);
+        if (!info)
+          return nullptr;
+      }
+      infos.push_back(info);
+    }
+    building.erase(fields);
+    return std::make_shared<StructInfo>(infos);
+  }
+
+  static Optional<double> getDouble(const json::Object& obj, StringRef key)
+  {
+    if (auto num = obj.getNumber(key))
+      return num;
+    double value;
+    if (auto str = obj.getString(key))
+      if (!str->trim().getAsDouble(value))
+        return value;
+    return None;
+  }
+
+  /* The annotated values are the roots of the conversion, like those read
+   * from the annotations by the Initializer */
+  template <typename T>
+  static void setInfo(T& v, const json::Object& obj, const MDInfo& info)
+  {
+    if (auto *ii = dyn_cast<InputInfo>(&info))
+      MetadataManager::setInputInfoMetadata(v, *ii);
+    else
+      MetadataManager::setStructInfoMetadata(v, cast<StructInfo>(info));
+    MetadataManager::setInputInfoInitWeightMetadata(&v, 0);
+    if (auto target = obj.getString("target"))
+      MetadataManager::setTargetMetadata(v, *target);
+  }
+
+  void annotateGlobal(StringRef name, const json::Object& obj, const MDInfo& info)
+  {
+    bool found = false;
+    for (GlobalVariable& gv: m.globals()) {
+      if (getSourceName(gv) != name)
+        continue;
+      setInfo(gv, obj, info);
+      found = true;
+    }
+    if (!found)
+      errs() << "warning: global variable " << name << " not found\n";
+  }
+
+  void annotateLocal(StringRef name, StringRef funName, const json::Object& obj, const MDInfo& info)
+  {
+    bool found = false;
+    for (Function& f: m) {
+      if (f.isDeclaration() || getSourceName(f) != funName)
+        continue;
+
+      /* every declaration with this name in the function, as taffo-j2a
+       * does; at -O0 the parameters are also stored to allocas */
+      SmallPtrSet<AllocaInst *, 4> allocas;
+      for (Instruction& i: instructions(f)) {
+        if (auto *decl = dyn_cast<DbgDeclareInst>(&i)) {
+          auto *alloca = dyn_cast_or_null<AllocaInst>(decl->getAddress());
+          if (alloca && decl->getVariable()->getName() == name)
+            allocas.insert(alloca);
+        }
+      }
+      if (!f.getSubprogram()) {
+        for (Instruction& i: instructions(f)) {
+          auto *alloca = dyn_cast<AllocaInst>(&i);
+          if (alloca && (alloca->getName() == name ||
+                         alloca->getName() == (name + ".addr").str()))
+            allocas.insert(alloca);
+        }
+      }
+      for (AllocaInst *alloca: allocas)
+        setInfo(*alloca, obj, info);
+      found |= !allocas.empty();
+
+      /* the parameters which are not stored to an alloca */
+      if (!allocas.empty())
+        continue;
+      for (Argument& arg: f.args()) {
+        if (arg.getName() != name)
+          continue;
+        SmallVector<MDInfo *, 4> args;
+        MetadataManager::getMetadataManager().retrieveArgumentInputInfo(f, args);
+        args.resize(f.arg_size(), nullptr);
+        args[arg.getArgNo()] = const_cast<MDInfo *>(&info);
+        MetadataManager::setArgumentInputInfoMetadata(f, args);
+
+        SmallVector<int, 4> weights;
+        MetadataManager::retrieveInputInfoInitWeightMetadata(&f, weights);
+        weights.resize(f.arg_size(), -1);
+        weights[arg.getArgNo()] = 0;
+        MetadataManager::setInputInfoInitWeightMetadata(&f, weights);
+        found = true;
+      }
+    }
+    if (!found)
+      errs() << "warning: local variable " << name << " of " << funName << " not found\n";
+  }
+
+  void annotateFunction(StringRef name)
+  {
+    bool found = false;
+    for (Function& f: m) {
+      if (f.isDeclaration() || getSourceName(f) != name)
+        continue;
+      MetadataManager::setStartingPoint(f);
+      found = true;
+    }
+    if (!found)
+      errs() << "warning: function " << name << " not found\n";
+  }
+};
+
+
+bool writeModule(Module& m, StringRef filename, bool assembly)
+{
+  std::error_code ec;
+  ToolOutputFile out(filename, ec, assembly ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (ec) {
+    errs() << "Cannot open " << filename << ": " << ec.message() << "\n";
+    return false;
+  }
+  if (assembly)
+    m.print(out.os(), nullptr);
+  else
+    WriteBitcodeToFile(m, out.os());
+  out.keep();
+  return true;
+}
+
+
+/* The slots of the profile are numbered on the original module */
+int profileRanges(Module& m)
+{
+  std::vector<range_slot> slots;
+  collectRangeSlots(m, slots);
+  if (Instrument) {
+    instrumentForRanges(m, slots);
+    return writeModule(m, OutputFilename, OutputAssembly) ? 0 : 1;
+  }
+
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<std::pair<double, double>> ranges(slots.size(), {inf, -inf});
+  for (const std::string& filename: ProfileFilenames) {
+    std::string error;
+    if (!readRangeProfile(filename, slots.size(), ranges, error)) {
+      errs() << error << "\n";
+      return 1;
+    }
+  }
+  json::Array annotations = getRangeAnnotations(slots, ranges, RangeMargin / 100.0);
+
+  std::error_code ec;
+  ToolOutputFile out(OutputFilename, ec, sys::fs::OF_Text);
+  if (ec) {
+    errs() << "Cannot open " << OutputFilename << ": " << ec.message() << "\n";
+    return 1;
+  }
+  out.os() << formatv("{0:2}", json::Value(std::move(annotations))) << "\n";
+  out.keep();
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  InitLLVM init(argc, argv);
+  cl::HideUnrelatedOptions(TAFFOJ2MDOptions);
+  cl::ParseCommandLineOptions(argc, argv,
+    "Attaches the TAFFO annotations of a taffo-j2a JSON file to a module as metadata,\n"
+    "or generates the annotations of the ranges observed by profiling the module\n");
+
+  if (Instrument || !ProfileFilenames.empty()) {
+    if (Instrument && !ProfileFilenames.empty()) {
+      errs() << "-instrument and -profile cannot be used together\n";
+      return 1;
+    }
+    if (RangeMargin < 0.0) {
+      errs() << "-range-margin cannot be negative\n";
+      return 1;
+    }
+    LLVMContext context;
+    SMDiagnostic err;
+    std::unique_ptr<Module> m = parseIRFile(InputFilename, err, context);
+    if (!m) {
+      err.print(argv[0], errs());
+      return 1;
+    }
+    return profileRanges(*m);
+  }
+
+  std::string text = AnnotationJSON;
+  if (text.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(AnnotationFile);
+    if (!buf) {
+      errs() << "Cannot read " << AnnotationFile << ": " << buf.getError().message() << "\n";
+      return 1;
+    }
+    text = (*buf)->getBuffer().str();
+  }
+  Expected<json::Value> js = json::parse(text);
+  if (!js) {
+    errs() << "Could not parse the annotations: " << toString(js.takeError()) << "\n";
+    return 1;
+  }
+  const json::Array *root = js->getAsArray();
+  if (!root) {
+    errs() << "The annotations are not a JSON array\n";
+    return 1;
+  }
+
+  LLVMContext context;
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseIRFile(InputFilename, err, context);
+  if (!m) {
+    err.print(argv[0], errs());
+    return 1;
+  }
+
+  std::string error;
+  AnnotationInjector injector(*m);
+  if (!injector.inject(*root, error)) {
+    errs() << error << "\n";
+    return 1;
+  }
+  return writeModule(*m, OutputFilename, OutputAssembly) ? 0 : 1;
+}
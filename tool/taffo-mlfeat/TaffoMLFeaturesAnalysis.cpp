@@ -4,6 +4,8 @@
 #include <sstream>
 #include <deque>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ErrorOr.h"
@@ -20,9 +22,19 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/raw_os_ostream.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/IVDescriptors.h"
+#include "llvm/Analysis/LoopAccessAnalysis.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "TaffoMLFeaturesAnalysis.h"
 #include "Metadata.h"
 
@@ -39,7 +51,8 @@ cl::opt<bool> CountAll("countall", cl::value_desc("countall"),
 
 struct MLFeatureBlock {
   BasicBlock *entry;
-  std::set<BasicBlock *> contents;
+  /* index of the enclosing block, -1 for the blocks outside any loop */
+  int parent = -1;
   
   int depth = 0;
   int tripCount = 0;
@@ -52,6 +65,23 @@ struct MLFeatureBlock {
   int minDist_mul = 12;
   int minDist_div = 12;
   int minDist_callBase = 12;
+  // def-use chains inside the basic blocks
+  double criticalPath = 0.0;
+  int numMulShiftChains = 0;
+  int ilpWidth = 0;
+  // loads and stores, with the strides of their addresses in bytes
+  int numMemAccesses = 0;
+  int numLoopAccesses = 0;
+  int numUnitStrideAccesses = 0;
+  int maxStride = 0;
+  int64_t bytesPerIteration = 0;
+  int64_t footprint = 0;
+  // vectorization potential of the innermost loops, not merged in the
+  // parents; the vector factors are for 8, 16 and 32 bit elements
+  bool vectorizable = false;
+  int64_t maxSafeDepDist = -1;
+  int numReductions = 0;
+  int vectorFactor[3] = {1, 1, 1};
   
   // used for sorting
   bool operator< (const MLFeatureBlock& other) const {
@@ -67,6 +97,66 @@ struct MLFeatureBlockComputationState {
 };
 
 
+/* Analyses of the function used by collectFunctionFeatures */
+struct MLFeatureFunctionAnalyses {
+  DominatorTree& dt;
+  LoopInfo& li;
+  ScalarEvolution& se;
+  const TargetLibraryInfo& tli;
+  AAResults& aa;
+};
+
+
+/* Features of the functions called by main, computed without inlining.
+ * The summary of a function is the list of its blocks, as computed by
+ * collectFunctionFeatures with the callees already expanded, for a given
+ * nesting level of the measured regions at its entry. Like the inliner,
+ * calls to recursive functions are not expanded. */
+class MLFeatureSummaries {
+public:
+  MLFeatureSummaries(Module& m, const LatencyTable& latencies);
+  
+  /* true if the callee of call is expanded at the call site */
+  bool isSummarized(CallBase *call);
+  /* change of the nesting level between the entry and the return of f */
+  int getLevelDelta(Function *f);
+  void setCallLevel(CallBase *call, int level) { callLevels[call] = level; }
+  const std::vector<MLFeatureBlock>& getSummary(Function *f, int level);
+  /* appends the blocks of the callee of call, which is in features[node] */
+  void appendCallee(std::vector<MLFeatureBlock>& features, int node, CallBase *call);
+  
+private:
+  struct FunctionAnalyses {
+    DominatorTree dt;
+    LoopInfo li;
+    TargetLibraryInfoImpl tlii;
+    TargetLibraryInfo tli;
+    AssumptionCache ac;
+    ScalarEvolution se;
+    BasicAAResult basicAA;
+    AAResults aa;
+    
+    FunctionAnalyses(Function& f): dt(f), li(dt),
+        tlii(Triple(f.getParent()->getTargetTriple())), tli(tlii), ac(f),
+        se(f, tli, ac, dt, li), basicAA(f.getParent()->getDataLayout(), f, tli, ac, &dt),
+        aa(tli)
+    {
+      aa.addAAResult(basicAA);
+    }
+    
+    MLFeatureFunctionAnalyses refs() { return {dt, li, se, tli, aa}; }
+  };
+  DenseMap<Function *, std::unique_ptr<FunctionAnalyses>> analyses;
+  DenseSet<Function *> recursive;
+  DenseMap<Function *, int> levelDeltas;
+  DenseMap<CallBase *, int> callLevels;
+  std::map<std::pair<Function *, int>, std::vector<MLFeatureBlock>> summaries;
+  const LatencyTable& latencies;
+  
+  FunctionAnalyses& getAnalyses(Function *f);
+};
+
+
 char TaffoMLFeatureAnalysisPass::ID = 0;
 
 
@@ -91,12 +181,46 @@ bool getCountEnabledForInstruction(Instruction *instr)
 }
 
 
-void computeBasicBlockStats(MLFeatureBlock& b, BasicBlock *bb, MLFeatureBlockComputationState& state)
+/* the distances start at INT_MAX before the first instruction of a kind */
+static int incrementDistance(int dist)
 {
+  return dist < INT_MAX ? dist + 1 : dist;
+}
+
+
+/* The calls expanded by summaries are not counted, and are appended to
+ * summarizedCalls instead. They reset the distances, since the inliner
+ * splits the block at the call.
+ * The def-use graph of the counted instructions of bb gives the longest
+ * chain in cycles of latencies (criticalPath), the number of shifts of the
+ * result of a multiplication, which is how fixed point multiplications are
+ * lowered (numMulShiftChains), and the largest number of instructions at
+ * the same distance from the start of the chains (ilpWidth). */
+void computeBasicBlockStats(MLFeatureBlock& b, BasicBlock *bb, MLFeatureBlockComputationState& state,
+                            const LatencyTable& latencies,
+                            MLFeatureSummaries *summaries = nullptr,
+                            SmallVectorImpl<CallBase *> *summarizedCalls = nullptr)
+{
+  struct chain_end {
+    double latency;
+    int length;
+  };
+  DenseMap<Instruction *, chain_end> chains;
+  SmallVector<int, 16> widthByLength;
+  
   for (Instruction& i: *bb) {
     if (isSkippableInstruction(&i))
       continue;
     
+    if (summaries) {
+      CallBase *call = dyn_cast<CallBase>(&i);
+      if (call && summaries->isSummarized(call)) {
+        summarizedCalls->push_back(call);
+        state = MLFeatureBlockComputationState();
+        continue;
+      }
+    }
+    
     if (AllocaInst *alloca = dyn_cast<AllocaInst>(&i)) {
       const DataLayout &dl = alloca->getModule()->getDataLayout();
       Optional<uint64_t> size = alloca->getAllocationSizeInBits(dl);
@@ -111,7 +235,7 @@ void computeBasicBlockStats(MLFeatureBlock& b, BasicBlock *bb, MLFeatureBlockCom
             b.maxAllocSize = std::max(b.maxAllocSize, (int)(ci->getSExtValue()));
         } else if (f->getName().equals("calloc")) {
           ConstantInt *count = dyn_cast<ConstantInt>(call->getArgOperand(0));
-          ConstantInt *size = dyn_cast<ConstantInt>(call->getArgOperand(0));
+          ConstantInt *size = dyn_cast<ConstantInt>(call->getArgOperand(1));
           if (count && size)
             b.maxAllocSize = std::max(b.maxAllocSize, (int)(count->getSExtValue() * size->getSExtValue()));
         }
@@ -123,23 +247,47 @@ void computeBasicBlockStats(MLFeatureBlock& b, BasicBlock *bb, MLFeatureBlockCom
     
     b.imix.updateWithInstruction(&i);
     
+    /* the operands defined in other blocks, or not counted, start a chain;
+     * the terminators do not produce values, and are left out */
+    if (!i.isTerminator()) {
+      chain_end chain = {0.0, 0};
+      for (Value *op: i.operands()) {
+        auto opchain = chains.find(dyn_cast<Instruction>(op));
+        if (opchain == chains.end())
+          continue;
+        chain.latency = std::max(chain.latency, opchain->second.latency);
+        chain.length = std::max(chain.length, opchain->second.length + 1);
+      }
+      chain.latency += latencies.opcodeCost[i.getOpcode()];
+      chains[&i] = chain;
+      b.criticalPath = std::max(b.criticalPath, chain.latency);
+      if ((int)widthByLength.size() <= chain.length)
+        widthByLength.resize(chain.length + 1);
+      b.ilpWidth = std::max(b.ilpWidth, ++widthByLength[chain.length]);
+    }
+    if (i.isShift()) {
+      Instruction *shifted = dyn_cast<Instruction>(i.getOperand(0));
+      if (shifted && shifted->getOpcode() == Instruction::Mul && chains.count(shifted))
+        b.numMulShiftChains++;
+    }
+    
     if (isa<CallBase>(&i)) {
       b.minDist_callBase = std::min(b.minDist_callBase, state.lastDist_callBase);
       state.lastDist_callBase = 0;
     } else
-      state.lastDist_callBase = std::max(state.lastDist_callBase, state.lastDist_callBase+1);
+      state.lastDist_callBase = incrementDistance(state.lastDist_callBase);
     
     if (i.getOpcode() == Instruction::Mul) {
       b.minDist_mul = std::min(b.minDist_mul, state.lastDist_mul);
       state.lastDist_mul = 0;
     } else
-      state.lastDist_mul = std::max(state.lastDist_mul, state.lastDist_mul+1);
+      state.lastDist_mul = incrementDistance(state.lastDist_mul);
     
     if (i.getOpcode() == Instruction::SDiv || i.getOpcode() == Instruction::UDiv) {
       b.minDist_div = std::min(b.minDist_div, state.lastDist_div);
       state.lastDist_div = 0;
     } else
-      state.lastDist_div = std::max(state.lastDist_div, state.lastDist_div+1);
+      state.lastDist_div = incrementDistance(state.lastDist_div);
     
     mdutils::MetadataManager& mm = mdutils::MetadataManager::getMetadataManager();
     mdutils::MDInfo *mdi = mm.retrieveMDInfo(&i);
@@ -150,26 +298,136 @@ void computeBasicBlockStats(MLFeatureBlock& b, BasicBlock *bb, MLFeatureBlockCom
 }
 
 
-void computeBlockStats(MLFeatureBlock& b)
+/* Adds to b the accesses to memory of the counted loads and stores of bb,
+ * which is directly inside the loop l (or outside any loop if l is null).
+ * The stride is the step of the address in l, when ScalarEvolution finds
+ * it to be an affine recurrence. The footprint estimates the bytes spanned
+ * by each access over the trip count of l. */
+void computeMemoryStats(MLFeatureBlock& b, BasicBlock *bb, Loop *l, ScalarEvolution& SE)
 {
-  /* TODO:
-   * (1) clique of b.contents & loop on cliques;
-   * (2) handle branches with `state` sharing */
-  for (BasicBlock *bb: b.contents) {
-    MLFeatureBlockComputationState state;
-    computeBasicBlockStats(b, bb, state);
+  const DataLayout& dl = bb->getModule()->getDataLayout();
+  int64_t trips = b.tripCount >= 0 ? (int64_t)b.tripCount + 1 : 1;
+  
+  for (Instruction& i: *bb) {
+    Value *ptr;
+    Type *accessTy;
+    if (LoadInst *load = dyn_cast<LoadInst>(&i)) {
+      ptr = load->getPointerOperand();
+      accessTy = load->getType();
+    } else if (StoreInst *store = dyn_cast<StoreInst>(&i)) {
+      ptr = store->getPointerOperand();
+      accessTy = store->getValueOperand()->getType();
+    } else {
+      continue;
+    }
+    if (!CountAll && !getCountEnabledForInstruction(&i))
+      continue;
+    
+    int64_t size = dl.getTypeStoreSize(accessTy);
+    b.numMemAccesses++;
+    b.bytesPerIteration += size;
+    if (!l) {
+      b.footprint += size;
+      continue;
+    }
+    
+    b.numLoopAccesses++;
+    const SCEV *addr = SE.getSCEV(ptr);
+    const SCEVAddRecExpr *rec = dyn_cast<SCEVAddRecExpr>(addr);
+    const SCEVConstant *step = rec && rec->getLoop() == l && rec->isAffine() ?
+        dyn_cast<SCEVConstant>(rec->getStepRecurrence(SE)) : nullptr;
+    if (step) {
+      int64_t stride = std::abs(step->getAPInt().getSExtValue());
+      b.maxStride = std::max(b.maxStride, (int)std::min<int64_t>(stride, INT_MAX));
+      b.numUnitStrideAccesses += stride == size;
+      b.footprint += stride > size ? stride * trips : size * trips;
+    } else if (SE.isLoopInvariant(addr, l)) {
+      b.footprint += size;
+    } else {
+      /* irregular accesses are assumed to touch new data every iteration */
+      b.footprint += size * trips;
+    }
+  }
+}
+
+
+/* Computes the vectorization potential of l if it is an innermost loop
+ * with a single exit. It is vectorizable if LoopAccessAnalysis allows to
+ * vectorize its memory accesses, and its header phis are all inductions or
+ * reductions. The vector factors are limited by the vector width of the
+ * target and by the maximum safe dependence distance. */
+void computeVectorizationStats(MLFeatureBlock& b, Loop *l, MLFeatureFunctionAnalyses& fa,
+                               const LatencyTable& latencies)
+{
+  if (!l->getSubLoops().empty() || !l->getExitingBlock())
+    return;
+  
+  LoopAccessInfo lai(l, &fa.se, &fa.tli, &fa.aa, &fa.dt, &fa.li);
+  uint64_t maxSafe = lai.getMaxSafeDepDistBytes();
+  if (maxSafe != std::numeric_limits<uint64_t>::max())
+    b.maxSafeDepDist = std::min<uint64_t>(maxSafe, std::numeric_limits<int64_t>::max());
+  
+  bool phisOk = true;
+  for (PHINode& phi: l->getHeader()->phis()) {
+    RecurrenceDescriptor rd;
+    InductionDescriptor id;
+    if (RecurrenceDescriptor::isReductionPHI(&phi, l, rd))
+      b.numReductions++;
+    else if (!InductionDescriptor::isInductionPHI(&phi, l, &fa.se, id))
+      phisOk = false;
+  }
+  b.vectorizable = lai.canVectorizeMemory() && phisOk;
+  if (!b.vectorizable)
+    return;
+  
+  static const int elemWidths[3] = {8, 16, 32};
+  for (int i = 0; i < 3; i++) {
+    int64_t vf = latencies.vectorWidth / elemWidths[i];
+    if (b.maxSafeDepDist >= 0)
+      vf = std::min<int64_t>(vf, b.maxSafeDepDist * 8 / elemWidths[i]);
+    b.vectorFactor[i] = std::max<int64_t>(vf, 1);
   }
 }
 
 
-void computeEnabledInstructions(Function *f, DominatorTree& dom)
+/* Adds to b the statistics of other, computed on a disjoint set of basic
+ * blocks. Since the distances are computed within each basic block, the
+ * statistics of a set of blocks are the merge of the ones of its blocks.
+ * TODO: handle branches with `state` sharing */
+void mergeBlockStats(MLFeatureBlock& b, const MLFeatureBlock& other)
+{
+  b.imix.add(other.imix);
+  b.maxAllocSize = std::max(b.maxAllocSize, other.maxAllocSize);
+  b.numAnnotatedInstr += other.numAnnotatedInstr;
+  b.minDist_mul = std::min(b.minDist_mul, other.minDist_mul);
+  b.minDist_div = std::min(b.minDist_div, other.minDist_div);
+  b.minDist_callBase = std::min(b.minDist_callBase, other.minDist_callBase);
+  b.criticalPath = std::max(b.criticalPath, other.criticalPath);
+  b.numMulShiftChains += other.numMulShiftChains;
+  b.ilpWidth = std::max(b.ilpWidth, other.ilpWidth);
+  b.numMemAccesses += other.numMemAccesses;
+  b.numLoopAccesses += other.numLoopAccesses;
+  b.numUnitStrideAccesses += other.numUnitStrideAccesses;
+  b.maxStride = std::max(b.maxStride, other.maxStride);
+  b.bytesPerIteration += other.bytesPerIteration;
+  b.footprint += other.footprint;
+}
+
+
+/* Returns the change of the nesting level between the entry of f and the
+ * first return reached. With summaries, the expanded calls change the
+ * level like their callees do, and their level is recorded. */
+int computeEnabledInstructions(Function *f, DominatorTree& dom, int entryLevel = 0,
+                               MLFeatureSummaries *summaries = nullptr)
 {
   struct state {
     BasicBlock *bb;
     int nestingLevel;
   };
   std::deque<state> queue;
-  queue.push_back({dom.getRoot(), 0});
+  queue.push_back({dom.getRoot(), entryLevel});
+  bool returnFound = false;
+  int delta = 0;
   
   while (!queue.empty()) {
     state self = *(queue.begin());
@@ -179,10 +437,19 @@ void computeEnabledInstructions(Function *f, DominatorTree& dom)
       int delim = isDelimiterInstruction(&inst);
       if (!delim) {
         setCountEnabledForInstruction(&inst, self.nestingLevel > 0);
+        CallBase *call = dyn_cast<CallBase>(&inst);
+        if (summaries && call && summaries->isSummarized(call)) {
+          summaries->setCallLevel(call, self.nestingLevel);
+          self.nestingLevel += summaries->getLevelDelta(call->getCalledFunction());
+        }
       } else {
         self.nestingLevel += delim;
         setCountEnabledForInstruction(&inst, false);
       }
+      if (isa<ReturnInst>(&inst) && !returnFound) {
+        returnFound = true;
+        delta = self.nestingLevel - entryLevel;
+      }
     }
     
     for (DomTreeNode *nexti: dom[self.bb]->getChildren()) {
@@ -191,55 +458,35 @@ void computeEnabledInstructions(Function *f, DominatorTree& dom)
       }
     }
   }
+  return delta;
 }
 
 
-void TaffoMLFeatureAnalysisPass::getAnalysisUsage(AnalysisUsage &AU) const
+/* Computes the statistics of the blocks outside any loop (features[0]) and
+ * of each loop of F, in preorder. Each basic block is scanned once, for the
+ * innermost loop containing it; the nested blocks are merged in their
+ * parents by printFeatures. The blocks of the callees expanded by
+ * summaries are appended after the loops of F. */
+void collectFunctionFeatures(Function& F, MLFeatureFunctionAnalyses& fa, const LatencyTable& latencies,
+                             MLFeatureSummaries *summaries, std::vector<MLFeatureBlock>& features)
 {
-  AU.addRequiredTransitive<ScalarEvolutionWrapperPass>();
-  AU.addRequiredTransitive<LoopInfoWrapperPass>();
-  AU.addRequiredTransitive<DominatorTreeWrapperPass>();
-}
-
-
-bool TaffoMLFeatureAnalysisPass::runOnFunction(Function &F)
-{
-  if (!CountAll) {
-    DominatorTreeWrapperPass& dtwp = Pass::getAnalysis<DominatorTreeWrapperPass>();
-    computeEnabledInstructions(&F, dtwp.getDomTree());
-  }
-
-  LoopInfo& li = this->getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-  
-  /* compute the list of basic blocks that are outside any loop */
-  std::set<BasicBlock *> allbbs;
-  for (BasicBlock& bb: F.getBasicBlockList()) {
-    allbbs.insert(&bb);
-  }
-  for (Loop *l: li.getLoopsInPreorder()) {
-    for (BasicBlock *bb: l->blocks()) {
-      allbbs.erase(bb);
-    }
-  }
-  
-  assert(allbbs.find(&F.getEntryBlock()) != allbbs.end() && "entry block of function is in a loop??");
-  
-  ScalarEvolution& SE = Pass::getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  LoopInfo& li = fa.li;
+  ScalarEvolution& SE = fa.se;
+  assert(!li.getLoopFor(&F.getEntryBlock()) && "entry block of function is in a loop??");
   
   SmallVector<Loop *, 4> loops = li.getLoopsInPreorder();
-  int nfeat = loops.size() + 1;
+  int nloops = loops.size();
+  DenseMap<Loop *, int> loopIdx;
+  for (int i = 1; i <= nloops; i++)
+    loopIdx[loops[i-1]] = i;
   
-  std::vector<MLFeatureBlock> features(nfeat);
+  features.resize(nloops + 1);
+  features[0].entry = &F.getEntryBlock();
   features[0].tripCount = 1;
-  features[0].contents = allbbs;
-  computeBlockStats(features[0]);
-  
-  int i = 1;
-  for (Loop *l: loops) {
-    for (BasicBlock *bb: l->blocks()) {
-      features[i].contents.insert(bb);
-    }
+  for (int i = 1; i <= nloops; i++) {
+    Loop *l = loops[i-1];
     features[i].entry = l->getHeader();
+    features[i].parent = l->getParentLoop() ? loopIdx[l->getParentLoop()] : 0;
     const SCEV *tripcnt = SE.getConstantMaxBackedgeTakenCount(l);
     if (const SCEVConstant *realtripcnt = dyn_cast<SCEVConstant>(tripcnt)) {
       features[i].tripCount = realtripcnt->getAPInt().getZExtValue();
@@ -247,34 +494,55 @@ bool TaffoMLFeatureAnalysisPass::runOnFunction(Function &F)
       features[i].tripCount = -1;
     }
     features[i].depth = l->getLoopDepth();
-    computeBlockStats(features[i]);
-    i++;
+    computeVectorizationStats(features[i], l, fa, latencies);
   }
   
-  // sort blocks by depth first, trip count later
-  std::sort(features.begin(), features.end());
-  
-  /* loopNestMtx[i][j] == true  ==>>  L_j inside L_i */
-  std::vector<std::vector<bool>> loopNestMtx;
-  loopNestMtx.resize(nfeat);
-  for (int i=0; i<nfeat; i++) {
-    loopNestMtx[i].resize(nfeat);
-    loopNestMtx[0][i] = true;
-    loopNestMtx[i][i] = true;
+  for (BasicBlock& bb: F) {
+    Loop *l = li.getLoopFor(&bb);
+    int node = l ? loopIdx[l] : 0;
+    MLFeatureBlockComputationState state;
+    SmallVector<CallBase *, 4> calls;
+    computeBasicBlockStats(features[node], &bb, state, latencies, summaries, &calls);
+    computeMemoryStats(features[node], &bb, l, SE);
+    for (CallBase *call: calls)
+      summaries->appendCallee(features, node, call);
+  }
+}
+
+
+/* Merges the nested loops in their parents and appends the features of
+ * each block which contains instructions, sorted by depth first and trip
+ * count later, to out. The loops are not merged in features[0], which only
+ * has the basic blocks outside any loop. */
+void printFeatures(std::vector<MLFeatureBlock>& features, FeatureList& out)
+{
+  int nfeat = features.size();
+  /* the parents precede their children */
+  for (int i = nfeat - 1; i >= 1; i--) {
+    if (features[i].parent > 0)
+      mergeBlockStats(features[features[i].parent], features[i]);
   }
   
-  for (int i=1; i<nfeat; i++) {
-    for (int j=1; j<nfeat; j++) {
-      if (loopNestMtx[j][i] == true)
-        continue;
-      loopNestMtx[i][j] = loops[i-1]->contains(loops[j-1]);
+  std::vector<int> order(nfeat);
+  for (int i = 0; i < nfeat; i++)
+    order[i] = i;
+  std::stable_sort(order.begin() + 1, order.end(), [&](int a, int b) {
+    return features[a] < features[b];
+  });
+  
+  /* contains(i, j) == true  ==>>  L_j inside L_i */
+  auto contains = [&](int i, int j) {
+    for (; j >= 0; j = features[j].parent) {
+      if (j == i)
+        return true;
     }
-  }
+    return false;
+  };
   
-  int blockIdx[nfeat];
+  std::vector<int> blockIdx(nfeat);
   blockIdx[0] = 0;
   for (int i=1, k=1; i<nfeat; i++) {
-    if (features[i].imix.ninstr > 0)
+    if (features[order[i]].imix.ninstr > 0)
       blockIdx[i] = k++;
     else
       blockIdx[i] = -1;
@@ -284,24 +552,171 @@ bool TaffoMLFeatureAnalysisPass::runOnFunction(Function &F)
   for (int ri=0; ri<nfeat; ri++) {
     int i = blockIdx[ri];
     if (i < 0) continue;
+    const MLFeatureBlock& b = features[order[ri]];
+    std::string prefix = "B" + std::to_string(i) + "_";
     for (int rj=1; rj<nfeat; rj++) {
       int j = blockIdx[rj];
       if (j < 0) continue;
-      std::cout << "B" << i << "_contain_B" << j << " " << loopNestMtx[ri][rj] << std::endl;
+      out.push_back({prefix + "contain_B" + std::to_string(j), contains(order[ri], order[rj])});
+    }
+    out.push_back({prefix + "depth", b.depth});
+    out.push_back({prefix + "tripCount", b.tripCount});
+    out.push_back({prefix + "maxAllocSize", b.maxAllocSize});
+    out.push_back({prefix + "numAnnotatedInstr", b.numAnnotatedInstr});
+    out.push_back({prefix + "minDist_mul", b.minDist_mul});
+    out.push_back({prefix + "minDist_div", b.minDist_div});
+    out.push_back({prefix + "minDist_call", b.minDist_callBase});
+    out.push_back({prefix + "criticalPath", (int64_t)std::ceil(b.criticalPath)});
+    out.push_back({prefix + "mulShiftChains", b.numMulShiftChains});
+    out.push_back({prefix + "ilpWidth", b.ilpWidth});
+    out.push_back({prefix + "bytesPerIteration", b.bytesPerIteration});
+    out.push_back({prefix + "maxStride", b.maxStride});
+    out.push_back({prefix + "footprint", b.footprint});
+    /* percentage of the accesses inside loops */
+    out.push_back({prefix + "unitStrideRatio",
+        b.numLoopAccesses ? b.numUnitStrideAccesses * 100 / b.numLoopAccesses : 0});
+    out.push_back({prefix + "vectorizable", b.vectorizable});
+    out.push_back({prefix + "maxSafeDepDist", b.maxSafeDepDist});
+    out.push_back({prefix + "numReductions", b.numReductions});
+    out.push_back({prefix + "vectorFactor8", b.vectorFactor[0]});
+    out.push_back({prefix + "vectorFactor16", b.vectorFactor[1]});
+    out.push_back({prefix + "vectorFactor32", b.vectorFactor[2]});
+    out.push_back({prefix + "n_*", b.imix.ninstr});
+    std::map<std::string, int64_t> stat = b.imix.getStat();
+    for (auto it = stat.begin(); it != stat.end(); it++) {
+      out.push_back({prefix + "n_" + it->first, it->second});
     }
-    std::cout << "B" << i << "_depth " << features[ri].depth << std::endl;
-    std::cout << "B" << i << "_tripCount " << features[ri].tripCount << std::endl;
-    std::cout << "B" << i << "_maxAllocSize " << features[ri].maxAllocSize << std::endl;
-    std::cout << "B" << i << "_numAnnotatedInstr " << features[ri].numAnnotatedInstr << std::endl;
-    std::cout << "B" << i << "_minDist_mul " << features[ri].minDist_mul << std::endl;
-    std::cout << "B" << i << "_minDist_div " << features[ri].minDist_div << std::endl;
-    std::cout << "B" << i << "_minDist_call " << features[ri].minDist_callBase << std::endl;
-    std::cout << "B" << i << "_n_* " << features[ri].imix.ninstr << std::endl;
-    for (auto it = features[ri].imix.stat.begin(); it != features[ri].imix.stat.end(); it++) {
-      std::cout << "B" << i << "_n_" << it->first << " " << it->second << std::endl;
+  }
+}
+
+
+MLFeatureSummaries::MLFeatureSummaries(Module& m, const LatencyTable& latencies): latencies(latencies)
+{
+  CallGraph cg(m);
+  for (scc_iterator<CallGraph *> scc = scc_begin(&cg); !scc.isAtEnd(); ++scc) {
+    if (!scc.hasCycle())
+      continue;
+    for (CallGraphNode *node: *scc) {
+      if (Function *f = node->getFunction())
+        recursive.insert(f);
     }
   }
+}
+
+
+bool MLFeatureSummaries::isSummarized(CallBase *call)
+{
+  Function *callee = call->getCalledFunction();
+  if (!callee || callee->isDeclaration() || !isFunctionInlinable(callee))
+    return false;
+  return !recursive.count(callee);
+}
+
+
+MLFeatureSummaries::FunctionAnalyses& MLFeatureSummaries::getAnalyses(Function *f)
+{
+  std::unique_ptr<FunctionAnalyses>& fa = analyses[f];
+  if (!fa)
+    fa.reset(new FunctionAnalyses(*f));
+  return *fa;
+}
+
+
+int MLFeatureSummaries::getLevelDelta(Function *f)
+{
+  auto cached = levelDeltas.find(f);
+  if (cached != levelDeltas.end())
+    return cached->second;
+  int delta = computeEnabledInstructions(f, getAnalyses(f).dt, 0, this);
+  levelDeltas[f] = delta;
+  return delta;
+}
+
+
+const std::vector<MLFeatureBlock>& MLFeatureSummaries::getSummary(Function *f, int level)
+{
+  std::pair<Function *, int> key(f, level);
+  auto cached = summaries.find(key);
+  if (cached != summaries.end())
+    return cached->second;
   
-  return false;
+  /* the callees are summarized on demand, and are never f itself since
+   * the recursive functions are not expanded */
+  FunctionAnalyses& fa = getAnalyses(f);
+  if (!CountAll)
+    computeEnabledInstructions(f, fa.dt, level, this);
+  std::vector<MLFeatureBlock> features;
+  MLFeatureFunctionAnalyses refs = fa.refs();
+  collectFunctionFeatures(*f, refs, latencies, this, features);
+  return summaries[key] = std::move(features);
+}
+
+
+void MLFeatureSummaries::appendCallee(std::vector<MLFeatureBlock>& features, int node, CallBase *call)
+{
+  auto level = callLevels.find(call);
+  const std::vector<MLFeatureBlock>& callee =
+      getSummary(call->getCalledFunction(), level != callLevels.end() ? level->second : 0);
+  
+  /* the blocks outside the loops of the callee end up in the block of the
+   * call site, its loops are nested in that block. The inliner removes a
+   * single return, and replaces multiple ones with branches. */
+  MLFeatureBlock body = callee[0];
+  int64_t nret = body.imix.opcodeStat[Instruction::Ret];
+  body.imix.opcodeStat[Instruction::Ret] = 0;
+  if (nret == 1)
+    body.imix.ninstr--;
+  else
+    body.imix.opcodeStat[Instruction::Br] += nret;
+  mergeBlockStats(features[node], body);
+  int base = features.size() - 1;
+  int depth = features[node].depth;
+  for (size_t i = 1; i < callee.size(); i++) {
+    MLFeatureBlock b = callee[i];
+    b.parent = b.parent == 0 ? node : base + b.parent;
+    b.depth += depth;
+    features.push_back(b);
+  }
 }
 
+
+void computeMLFeatureSummaries(Function& root, const LatencyTable& latencies, FeatureList& out,
+                               int entryLevel)
+{
+  MLFeatureSummaries summaries(*root.getParent(), latencies);
+  std::vector<MLFeatureBlock> features = summaries.getSummary(&root, entryLevel);
+  printFeatures(features, out);
+}
+
+
+void TaffoMLFeatureAnalysisPass::getAnalysisUsage(AnalysisUsage &AU) const
+{
+  AU.addRequiredTransitive<ScalarEvolutionWrapperPass>();
+  AU.addRequiredTransitive<LoopInfoWrapperPass>();
+  AU.addRequiredTransitive<DominatorTreeWrapperPass>();
+  AU.addRequiredTransitive<TargetLibraryInfoWrapperPass>();
+  AU.addRequiredTransitive<AAResultsWrapperPass>();
+}
+
+
+bool TaffoMLFeatureAnalysisPass::runOnFunction(Function &F)
+{
+  if (!CountAll) {
+    DominatorTreeWrapperPass& dtwp = Pass::getAnalysis<DominatorTreeWrapperPass>();
+    computeEnabledInstructions(&F, dtwp.getDomTree(), entryLevel);
+  }
+
+  MLFeatureFunctionAnalyses fa = {
+    Pass::getAnalysis<DominatorTreeWrapperPass>().getDomTree(),
+    this->getAnalysis<LoopInfoWrapperPass>().getLoopInfo(),
+    Pass::getAnalysis<ScalarEvolutionWrapperPass>().getSE(),
+    Pass::getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(F),
+    Pass::getAnalysis<AAResultsWrapperPass>().getAAResults()
+  };
+  
+  std::vector<MLFeatureBlock> features;
+  collectFunctionFeatures(F, fa, latencies, nullptr, features);
+  printFeatures(features, out);
+  
+  return false;
+}
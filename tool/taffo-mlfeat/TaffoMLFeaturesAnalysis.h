@@ -2,6 +2,8 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Instructions.h"
 #include "InstructionMix.h"
+#include "FeatureTable.h"
+#include "CycleEstimate.h"
 
 
 #ifndef TAFFO_ML_FEATURE_ANALYSIS_H
@@ -12,12 +14,30 @@ class TaffoMLFeatureAnalysisPass : public llvm::FunctionPass {
 public:
   static char ID;
 
-  TaffoMLFeatureAnalysisPass() : llvm::FunctionPass(ID) {};
+  /* the features of the analyzed function are appended to out; the
+   * latencies weight the def-use chains. With an entryLevel greater than 0
+   * the whole function counts as a measured region. */
+  TaffoMLFeatureAnalysisPass(FeatureList& out, const LatencyTable& latencies, int entryLevel = 0) :
+      llvm::FunctionPass(ID), out(out), latencies(latencies), entryLevel(entryLevel) {};
 
   bool runOnFunction(llvm::Function &F) override;
 
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+
+private:
+  FeatureList& out;
+  const LatencyTable& latencies;
+  int entryLevel;
 };
 
 
+/* Appends to out the features of root without inlining its callees. The
+ * features of each function are computed once for each nesting level of the
+ * measured regions it is called at, and composed through the call sites as
+ * the inliner would; root is entered at entryLevel. The loops must be in
+ * simplified form. */
+void computeMLFeatureSummaries(llvm::Function& root, const LatencyTable& latencies,
+                               FeatureList& out, int entryLevel = 0);
+
+
 #endif
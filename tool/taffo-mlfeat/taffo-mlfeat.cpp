@@ -10,6 +10,7 @@
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -26,6 +27,9 @@
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/InitializePasses.h"
 #include "TaffoMLFeaturesAnalysis.h"
+#include "Metadata.h"
+#include "LazyModule.h"
+#include "FeatureModel.h"
 
 using namespace llvm;
 
@@ -34,39 +38,56 @@ cl::OptionCategory TAFFOMLFeatOptions("taffo-mlfeat options");
 cl::opt<bool> Verbose("verbose", cl::value_desc("verbose"),
   cl::desc("Enable Verbose Output"),
   cl::init(false));
-cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
-  cl::desc("<input file>"));
+cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+  cl::desc("<input files>"));
+cl::opt<std::string> InputListFilename("input-list", cl::value_desc("filename"),
+  cl::desc("File with the list of the input files, one per line"));
+cl::opt<unsigned> Jobs("j", cl::value_desc("jobs"),
+  cl::desc("Number of input files analyzed in parallel (0 = one per core)"),
+  cl::init(1));
+cl::opt<FeatureTable::Format> OutputFormat("format", cl::desc("Output format"),
+  cl::values(clEnumValN(FeatureTable::Text, "text", "Lines of feature name and value (default)"),
+             clEnumValN(FeatureTable::CSV, "csv", "A CSV row per input file"),
+             clEnumValN(FeatureTable::JSON, "json", "A JSON object keyed by input file")),
+  cl::init(FeatureTable::Text));
+cl::opt<bool> Summaries("summaries", cl::value_desc("summaries"),
+  cl::desc("Compose per-function summaries through the call sites instead of "
+           "inlining every function in main"),
+  cl::init(false));
+cl::opt<std::string> CostTarget("cost-target", cl::value_desc("target"),
+  cl::desc("Latency table weighting the def-use chains: x86-64, aarch64, "
+           "cortex-m or a target triple (default: the triple of the module, "
+           "or x86-64 if it has no table)"));
+enum AnalysisScope {
+  ScopeMain,
+  ScopeFunctions,
+  ScopeRegions
+};
+cl::opt<AnalysisScope> Scope("scope", cl::desc("Code analyzed in each input file"),
+  cl::values(clEnumValN(ScopeMain, "main", "The measured regions reachable from main (default)"),
+             clEnumValN(ScopeFunctions, "functions", "Each function definition, as a separate record"),
+             clEnumValN(ScopeRegions, "regions", "Each function marked with taffo.start or "
+                                                 "with a taffo.target annotation, as a separate record")),
+  cl::init(ScopeMain));
+cl::opt<std::string> ModelFilename("model", cl::value_desc("filename"),
+  cl::desc("Print the options predicted by the regression tree model in the "
+           "specified file instead of the features; the text format prints "
+           "them as command line flags"));
 
+/* model read from -model */
+FeatureModel model;
 
-int main(int argc, char *argv[])
-{
-  /* The initialization section is mostly copied from the
-   * source code of opt */
-  InitLLVM X(argc, argv);
 
+/* Extracts the features of the function rootName of a file; called
+ * concurrently, each call loads its own copy of the module */
+void analyzeFile(const std::string& filename, const std::string& rootName, FeatureTable::Row& row)
+{
   LLVMContext c;
-
-  PassRegistry &Registry = *PassRegistry::getPassRegistry();
-  initializeCore(Registry);
-  initializeCoroutines(Registry);
-  initializeScalarOpts(Registry);
-  initializeObjCARCOpts(Registry);
-  initializeVectorization(Registry);
-  initializeIPO(Registry);
-  initializeAnalysis(Registry);
-  initializeTransformUtils(Registry);
-  initializeInstCombine(Registry);
-  initializeAggressiveInstCombine(Registry);
-  initializeInstrumentation(Registry);
-  initializeTarget(Registry);
-  
-  cl::ParseCommandLineOptions(argc, argv, "TAFFO Machine Learning Feature Extractor");
-
-  SMDiagnostic Err;
-  std::unique_ptr<Module> m = parseIRFile(InputFilename, Err, c);
+  std::string error;
+  std::unique_ptr<Module> m = readLazyModule(filename, c, error);
   if (!m) {
-    std::cerr << "Error reading module " << InputFilename << std::endl;
-    return 1;
+    row.error = "Error reading module " + filename + ": " + error;
+    return;
   }
   
   if (Verbose) {
@@ -75,10 +96,29 @@ int main(int argc, char *argv[])
     std::cerr << " Target triple: " << m->getTargetTriple() << std::endl;
   }
   
-  Function *mainfunc = m->getFunction("main");
-  if (!mainfunc) {
-    std::cout << "No main function found!\n";
-    return 1;
+  Function *mainfunc = m->getFunction(rootName);
+  if (!mainfunc || mainfunc->isDeclaration()) {
+    row.error = Scope == ScopeMain ? "No main function found!" : "No function " + rootName + " found!";
+    return;
+  }
+  /* outside of main the whole function is measured, and it must survive
+   * the removal of the inlined functions */
+  int entryLevel = Scope == ScopeMain ? 0 : 1;
+  if (mainfunc->hasLocalLinkage())
+    mainfunc->setLinkage(GlobalValue::ExternalLinkage);
+  const LatencyTable *latencies = getBuiltinLatencyTable(
+      CostTarget.empty() ? m->getTargetTriple() : CostTarget.getValue());
+  if (!latencies && CostTarget.empty())
+    latencies = getBuiltinLatencyTable("x86-64");
+  if (!latencies) {
+    row.error = "No latency table for target \"" + CostTarget + "\"";
+    return;
+  }
+  
+  /* only the code reachable from the root is analyzed */
+  if (!materializeReachableFunctions(*mainfunc, error)) {
+    row.error = "Error reading module " + filename + ": " + error;
+    return;
   }
   
   /* WARNING: always remember that the various PassManagers do NOT take
@@ -88,9 +128,18 @@ int main(int argc, char *argv[])
    * analyses/passes on the stack.
    * TBH I find this behavior kinda dumb. */
   
+  if (Summaries) {
+    legacy::PassManager passManager;
+    passManager.add(createLoopSimplifyPass());
+    passManager.run(*m);
+    computeMLFeatureSummaries(*mainfunc, *latencies, row.features, entryLevel);
+    mdutils::MetadataManager::getMetadataManager().releaseContext(c);
+    return;
+  }
+  
   /* remove all functions (when possible) */
   for (Function& fun: m->functions()) {
-    if (&fun != mainfunc && isFunctionInlinable(&fun)) {
+    if (&fun != mainfunc && !fun.isDeclaration() && isFunctionInlinable(&fun)) {
       fun.addFnAttr(Attribute::AlwaysInline);
       fun.setLinkage(GlobalValue::LinkageTypes::InternalLinkage);
     }
@@ -103,8 +152,160 @@ int main(int argc, char *argv[])
   
   /* do the actual work; jump to TaffoMLFeatureAnalysisPass.cpp pls */
   legacy::FunctionPassManager funPassManager(m.get());
-  funPassManager.add(new TaffoMLFeatureAnalysisPass());
+  funPassManager.add(new TaffoMLFeatureAnalysisPass(row.features, *latencies, entryLevel));
   funPassManager.run(*mainfunc);
   
+  /* the metadata cache refers to the context, which is going away */
+  mdutils::MetadataManager::getMetadataManager().releaseContext(c);
+}
+
+
+/* Appends to roots the names of the functions of a file analyzed by the
+ * -scope=functions and -scope=regions modes */
+bool listRoots(const std::string& filename, std::vector<std::string>& roots, std::string& error)
+{
+  LLVMContext c;
+  std::unique_ptr<Module> m = readLazyModule(filename, c, error);
+  if (!m)
+    return false;
+  /* the annotations are in the bodies of the functions */
+  if (Scope == ScopeRegions) {
+    if (Error err = m->materializeAll()) {
+      error = toString(std::move(err));
+      return false;
+    }
+  }
+  
+  for (Function& f: *m) {
+    if (f.isDeclaration())
+      continue;
+    bool isRoot = Scope == ScopeFunctions || mdutils::MetadataManager::isStartingPoint(f);
+    for (auto it = inst_begin(f); it != inst_end(f) && !isRoot; it++)
+      isRoot = mdutils::MetadataManager::retrieveTargetMetadata(*it).hasValue();
+    if (isRoot)
+      roots.push_back(f.getName().str());
+  }
+  return true;
+}
+
+
+/* Analyzes each root function of each file, with a row per function */
+FeatureTable analyzeRoots(const std::vector<std::string>& files)
+{
+  std::vector<std::vector<std::string>> roots(files.size());
+  std::vector<std::string> errors(files.size());
+  runInParallel(files.size(), Jobs, [&](size_t i) {
+    if (!listRoots(files[i], roots[i], errors[i]))
+      errors[i] = "Error reading module " + files[i] + ": " + errors[i];
+    else if (roots[i].empty())
+      errors[i] = Scope == ScopeFunctions ? "No functions found!" : "No annotated regions found!";
+  });
+  
+  struct root_job {
+    size_t file;
+    std::string root;
+    size_t row;
+  };
+  FeatureTable table;
+  std::vector<root_job> jobs;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!errors[i].empty()) {
+      table.rows.push_back({files[i], {}, errors[i]});
+      continue;
+    }
+    for (const std::string& root: roots[i]) {
+      jobs.push_back({i, root, table.rows.size()});
+      table.rows.push_back({files[i] + ":" + root, {}, ""});
+    }
+  }
+  
+  /* the functions are analyzed in parallel, also within the same file */
+  runInParallel(jobs.size(), Jobs, [&](size_t j) {
+    analyzeFile(files[jobs[j].file], jobs[j].root, table.rows[jobs[j].row]);
+  });
+  return table;
+}
+
+
+int main(int argc, char *argv[])
+{
+  /* The initialization section is mostly copied from the
+   * source code of opt */
+  InitLLVM X(argc, argv);
+
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeCoroutines(Registry);
+  initializeScalarOpts(Registry);
+  initializeObjCARCOpts(Registry);
+  initializeVectorization(Registry);
+  initializeIPO(Registry);
+  initializeAnalysis(Registry);
+  initializeTransformUtils(Registry);
+  initializeInstCombine(Registry);
+  initializeAggressiveInstCombine(Registry);
+  initializeInstrumentation(Registry);
+  initializeTarget(Registry);
+  
+  cl::ParseCommandLineOptions(argc, argv, "TAFFO Machine Learning Feature Extractor");
+  
+  std::vector<std::string> files;
+  if (!collectInputFiles(InputFilenames, InputListFilename, files)) {
+    std::cerr << "Error reading " << InputListFilename << std::endl;
+    return 1;
+  }
+  if (files.empty()) {
+    std::cerr << "No input files" << std::endl;
+    return 1;
+  }
+  
+  if (!ModelFilename.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(ModelFilename);
+    if (!buf) {
+      std::cerr << "Error reading " << ModelFilename << ": " << buf.getError().message() << std::endl;
+      return 1;
+    }
+    std::string error;
+    if (!model.parse((*buf)->getBuffer(), error)) {
+      std::cerr << ModelFilename << ": " << error << std::endl;
+      return 1;
+    }
+  }
+  
+  FeatureTable table;
+  if (Scope == ScopeMain) {
+    table = analyzeFiles(files, Jobs, [](const std::string& filename, FeatureTable::Row& row) {
+      analyzeFile(filename, "main", row);
+    });
+  } else {
+    table = analyzeRoots(files);
+  }
+  if (!ModelFilename.empty()) {
+    for (FeatureTable::Row& row: table.rows) {
+      if (row.error.empty())
+        row.features = model.predict(row.features);
+    }
+  }
+  if (!ModelFilename.empty() && OutputFormat == FeatureTable::Text) {
+    /* one line of flags per file, ready to be forwarded to the pass */
+    for (const FeatureTable::Row& row: table.rows) {
+      if (table.rows.size() > 1)
+        std::cout << "# " << row.file << std::endl;
+      if (!row.error.empty()) {
+        std::cerr << row.error << std::endl;
+        continue;
+      }
+      for (size_t i = 0; i < row.features.size(); i++)
+        std::cout << (i > 0 ? " -" : "-") << row.features[i].first << "=" << row.features[i].second;
+      std::cout << std::endl;
+    }
+  } else {
+    table.print(std::cout, OutputFormat);
+  }
+  
+  /* a single input keeps failing as it did before batch mode */
+  if (table.rows.size() == 1 && !table.rows[0].error.empty())
+    return 1;
   return 0;
 }
+
@@ -0,0 +1,291 @@
+#include <random>
+#include <string>
+#include <vector>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+
+cl::OptionCategory TAFFOSynthOptions("taffo-synth options");
+cl::opt<std::string> OutputFilename("o",
+  cl::desc("Output filename"), cl::value_desc("filename"),
+  cl::init("-"), cl::cat(TAFFOSynthOptions));
+cl::opt<bool> OutputAssembly("S",
+  cl::desc("Write output as LLVM assembly"),
+  cl::init(false), cl::cat(TAFFOSynthOptions));
+cl::opt<unsigned> NumFunctions("functions",
+  cl::desc("Number of functions"), cl::value_desc("N"),
+  cl::init(100), cl::cat(TAFFOSynthOptions));
+cl::opt<unsigned> LoopDepth("loop-depth",
+  cl::desc("Depth of the loop nest in each function"), cl::value_desc("N"),
+  cl::init(2), cl::cat(TAFFOSynthOptions));
+cl::opt<unsigned> TripCount("trip-count",
+  cl::desc("Trip count of each loop"), cl::value_desc("N"),
+  cl::init(8), cl::cat(TAFFOSynthOptions));
+cl::opt<unsigned> StructDepth("struct-depth",
+  cl::desc("Nesting depth of the structure local to each function (0: none)"), cl::value_desc("N"),
+  cl::init(2), cl::cat(TAFFOSynthOptions));
+cl::opt<unsigned> CallsPerFunction("calls",
+  cl::desc("Number of calls to other functions in each function"), cl::value_desc("N"),
+  cl::init(2), cl::cat(TAFFOSynthOptions));
+cl::opt<double> AnnotationDensity("annotation-density",
+  cl::desc("Probability of each variable to be annotated"), cl::value_desc("fraction"),
+  cl::init(0.5), cl::cat(TAFFOSynthOptions));
+cl::opt<unsigned> Seed("seed",
+  cl::desc("Seed of the random choices"),
+  cl::init(1), cl::cat(TAFFOSynthOptions));
+
+
+/* Generator of synthetic modules with the annotations emitted by clang for
+ * __attribute__((annotate)), to measure how the compile time of each stage
+ * of TAFFO scales with the size of the program.
+ *
+ * Each function f.<i>(double x) has a local double accumulator and,
+ * with -struct-depth > 0, a local structure whose innermost member holds a
+ * running value, and works on the global array g.<i>. A loop nest of
+ * -loop-depth loops of -trip-count iterations reads the array, updates
+ * the accumulator, the structure and the array, and then calls -calls
+ * functions with a lower index. main reads the annotated global input,
+ * calls all the functions and stores the sum of their results to the
+ * global output, the target of the error propagation. */
+class ModuleSynthesizer
+{
+public:
+  ModuleSynthesizer(Module& m): m(m), ctx(m.getContext()), rng(Seed),
+    doubleTy(Type::getDoubleTy(ctx)), i32Ty(Type::getInt32Ty(ctx)),
+    i8PtrTy(Type::getInt8PtrTy(ctx)) {}
+
+  void synthesize()
+  {
+    for (unsigned d = 0; d < StructDepth; d++) {
+      Type *inner = d == 0 ? (Type *)doubleTy : structTypes.back();
+      structTypes.push_back(StructType::create(ctx, {inner, doubleTy}, "struct.s" + std::to_string(d)));
+    }
+    for (unsigned i = 0; i < NumFunctions; i++)
+      createFunction(i);
+    createMain();
+    emitGlobalAnnotations();
+  }
+
+private:
+  Module& m;
+  LLVMContext& ctx;
+  std::mt19937 rng;
+  Type *doubleTy;
+  Type *i32Ty;
+  Type *i8PtrTy;
+  std::vector<StructType *> structTypes;
+  std::vector<Function *> functions;
+  std::vector<Constant *> globalAnnotations;
+  StringMap<Constant *> strings;
+
+  bool annotated()
+  {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng) < AnnotationDensity;
+  }
+
+  /* The strings are shared, as clang does */
+  Constant *stringConstant(StringRef str)
+  {
+    Constant *&res = strings[str];
+    if (!res) {
+      Constant *init = ConstantDataArray::getString(ctx, str);
+      auto *gv = new GlobalVariable(m, init->getType(), true, GlobalValue::PrivateLinkage, init, ".str");
+      gv->setSection("llvm.metadata");
+      gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+      res = ConstantExpr::getBitCast(gv, i8PtrTy);
+    }
+    return res;
+  }
+
+  /* The annotation of a value of the structure of depth d */
+  std::string structAnnotation(unsigned d)
+  {
+    std::string member = "scalar(range(-16, 16))";
+    std::string inner = d == 0 ? member : structAnnotation(d - 1);
+    return "struct[" + inner + ", " + member + "]";
+  }
+
+  void annotateLocal(IRBuilder<>& b, Value *alloca, StringRef annotation)
+  {
+    Function *decl = Intrinsic::getDeclaration(&m, Intrinsic::var_annotation);
+    SmallVector<Value *, 5> args = {b.CreateBitCast(alloca, i8PtrTy),
+      stringConstant(annotation), stringConstant("synthetic.c"), ConstantInt::get(i32Ty, 0)};
+    /* the arguments of the annotation, since LLVM 11 */
+    if (decl->getFunctionType()->getNumParams() > args.size())
+      args.push_back(ConstantPointerNull::get(cast<PointerType>(i8PtrTy)));
+    b.CreateCall(decl, args);
+  }
+
+  void annotateGlobal(GlobalVariable *gv, StringRef annotation)
+  {
+    SmallVector<Constant *, 5> fields = {ConstantExpr::getBitCast(gv, i8PtrTy),
+      stringConstant(annotation), stringConstant("synthetic.c"), ConstantInt::get(i32Ty, 0)};
+    if (Intrinsic::getDeclaration(&m, Intrinsic::var_annotation)->getFunctionType()->getNumParams() > 4)
+      fields.push_back(ConstantPointerNull::get(cast<PointerType>(i8PtrTy)));
+    globalAnnotations.push_back(ConstantStruct::getAnon(ctx, fields));
+  }
+
+  void emitGlobalAnnotations()
+  {
+    if (globalAnnotations.empty())
+      return;
+    auto *arrayTy = ArrayType::get(globalAnnotations[0]->getType(), globalAnnotations.size());
+    auto *gv = new GlobalVariable(m, arrayTy, false, GlobalValue::AppendingLinkage,
+      ConstantArray::get(arrayTy, globalAnnotations), "llvm.global.annotations");
+    gv->setSection("llvm.metadata");
+  }
+
+  /* A pointer to the innermost double member of the structure at p */
+  Value *innermostMember(IRBuilder<>& b, Value *p)
+  {
+    for (unsigned d = StructDepth; d > 0; d--)
+      p = b.CreateStructGEP(structTypes[d - 1], p, 0);
+    return p;
+  }
+
+  void createFunction(unsigned index)
+  {
+    std::string name = "f." + std::to_string(index);
+    unsigned elems = std::max(1U, (unsigned)TripCount);
+    auto *arrayTy = ArrayType::get(doubleTy, elems);
+    auto *array = new GlobalVariable(m, arrayTy, false, GlobalValue::InternalLinkage,
+      ConstantAggregateZero::get(arrayTy), "g." + std::to_string(index));
+    if (annotated())
+      annotateGlobal(array, "scalar(range(-16, 16))");
+
+    Function *f = Function::Create(FunctionType::get(doubleTy, {doubleTy}, false),
+      GlobalValue::InternalLinkage, name, &m);
+    Argument *x = f->getArg(0);
+    x->setName("x");
+    BasicBlock *entry = BasicBlock::Create(ctx, "entry", f);
+    IRBuilder<> b(entry);
+
+    Value *acc = b.CreateAlloca(doubleTy, nullptr, "acc");
+    Value *s = StructDepth > 0 ? b.CreateAlloca(structTypes.back(), nullptr, "s") : nullptr;
+    if (annotated())
+      annotateLocal(b, acc, "scalar(range(-256, 256))");
+    if (s && annotated())
+      annotateLocal(b, s, structAnnotation(StructDepth - 1));
+    b.CreateStore(x, acc);
+    Value *member = nullptr;
+    if (s) {
+      member = innermostMember(b, s);
+      b.CreateStore(ConstantFP::get(doubleTy, 0.5), member);
+    }
+
+    /* the loop nest, with the counter of the innermost loop as the index */
+    std::vector<PHINode *> counters;
+    std::vector<BasicBlock *> headers;
+    std::vector<BasicBlock *> latches;
+    BasicBlock *pred = entry;
+    for (unsigned d = 0; d < LoopDepth; d++) {
+      BasicBlock *header = BasicBlock::Create(ctx, "loop" + std::to_string(d), f);
+      b.CreateBr(header);
+      b.SetInsertPoint(header);
+      PHINode *counter = b.CreatePHI(i32Ty, 2, "i" + std::to_string(d));
+      counter->addIncoming(ConstantInt::get(i32Ty, 0), pred);
+      counters.push_back(counter);
+      headers.push_back(header);
+      pred = header;
+    }
+    Value *idx = counters.empty() ? (Value *)ConstantInt::get(i32Ty, 0) : counters.back();
+    Value *elem = b.CreateInBoundsGEP(arrayTy, array, {ConstantInt::get(i32Ty, 0), idx});
+    Value *v = b.CreateLoad(doubleTy, elem);
+    Value *t = b.CreateFMul(v, x);
+    if (member) {
+      Value *old = b.CreateLoad(doubleTy, member);
+      t = b.CreateFAdd(t, old);
+      b.CreateStore(b.CreateFMul(t, ConstantFP::get(doubleTy, 0.25)), member);
+    }
+    Value *sum = b.CreateFAdd(b.CreateFMul(b.CreateLoad(doubleTy, acc), ConstantFP::get(doubleTy, 0.5)), t);
+    b.CreateStore(sum, acc);
+    b.CreateStore(b.CreateFMul(t, ConstantFP::get(doubleTy, 0.5)), elem);
+
+    /* close the loops from the innermost one */
+    for (unsigned d = LoopDepth; d > 0; d--) {
+      PHINode *counter = counters[d - 1];
+      Value *next = b.CreateNSWAdd(counter, ConstantInt::get(i32Ty, 1));
+      Value *cond = b.CreateICmpSLT(next, ConstantInt::get(i32Ty, TripCount));
+      BasicBlock *latch = b.GetInsertBlock();
+      BasicBlock *exit = BasicBlock::Create(ctx, "exit" + std::to_string(d - 1), f);
+      b.CreateCondBr(cond, headers[d - 1], exit);
+      counter->addIncoming(next, latch);
+      b.SetInsertPoint(exit);
+    }
+
+    Value *result = b.CreateLoad(doubleTy, acc);
+    for (unsigned c = 0; c < CallsPerFunction && index > 0; c++) {
+      Function *callee = functions[std::uniform_int_distribution<unsigned>(0, index - 1)(rng)];
+      Value *arg = b.CreateFMul(x, ConstantFP::get(doubleTy, 0.5));
+      result = b.CreateFAdd(result, b.CreateCall(callee, {arg}));
+    }
+    b.CreateRet(result);
+    functions.push_back(f);
+  }
+
+  void createMain()
+  {
+    auto *in = new GlobalVariable(m, doubleTy, false, GlobalValue::InternalLinkage,
+      ConstantFP::get(doubleTy, 0.5), "in");
+    annotateGlobal(in, "scalar(range(-1, 1) final)");
+    auto *out = new GlobalVariable(m, doubleTy, false, GlobalValue::ExternalLinkage,
+      ConstantFP::get(doubleTy, 0.0), "out");
+    annotateGlobal(out, "target('out') scalar()");
+
+    Function *main = Function::Create(FunctionType::get(i32Ty, false),
+      GlobalValue::ExternalLinkage, "main", &m);
+    IRBuilder<> b(BasicBlock::Create(ctx, "entry", main));
+    Value *x = b.CreateLoad(doubleTy, in);
+    Value *sum = ConstantFP::get(doubleTy, 0.0);
+    for (Function *f: functions)
+      sum = b.CreateFAdd(sum, b.CreateCall(f, {x}));
+    b.CreateStore(sum, out);
+    b.CreateRet(ConstantInt::get(i32Ty, 0));
+  }
+};
+
+
+int main(int argc, char *argv[])
+{
+  InitLLVM init(argc, argv);
+  cl::HideUnrelatedOptions(TAFFOSynthOptions);
+  cl::ParseCommandLineOptions(argc, argv,
+    "Generates a synthetic annotated module, to benchmark the compile time of TAFFO\n");
+  if (AnnotationDensity < 0.0 || AnnotationDensity > 1.0) {
+    errs() << "-annotation-density must be between 0 and 1\n";
+    return 1;
+  }
+
+  LLVMContext context;
+  Module m("synthetic", context);
+  ModuleSynthesizer(m).synthesize();
+  if (verifyModule(m, &errs()))
+    return 1;
+
+  std::error_code ec;
+  ToolOutputFile out(OutputFilename, ec, OutputAssembly ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (ec) {
+    errs() << "Cannot open " << OutputFilename << ": " << ec.message() << "\n";
+    return 1;
+  }
+  if (OutputAssembly)
+    m.print(out.os(), nullptr);
+  else
+    WriteBitcodeToFile(m, out.os());
+  out.keep();
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <cmath>
+#include <string>
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include "InputInfo.h"
+#include "Trace.h"
+
+using namespace llvm;
+using namespace mdutils;
+using namespace taffo;
+
+
+cl::OptionCategory TAFFOTraceOptions("taffo-trace options");
+cl::opt<std::string> InputFilename(cl::Positional,
+  cl::desc("<trace file>"), cl::Required);
+cl::list<std::string> StageFilter("stage",
+  cl::desc("Only print the events of the specified stages"),
+  cl::CommaSeparated, cl::value_desc("stage,..."), cl::cat(TAFFOTraceOptions));
+cl::opt<std::string> FunctionFilter("function",
+  cl::desc("Only print the events of the values of the specified function"),
+  cl::value_desc("name"), cl::cat(TAFFOTraceOptions));
+cl::opt<std::string> ValueFilter("value",
+  cl::desc("Only print the events of the values with the specified name"),
+  cl::value_desc("name"), cl::cat(TAFFOTraceOptions));
+cl::opt<std::string> ReasonFilter("reason",
+  cl::desc("Only print the events whose reason contains the specified text"),
+  cl::value_desc("text"), cl::cat(TAFFOTraceOptions));
+cl::opt<bool> JSONOutput("json",
+  cl::desc("Print the events as a JSON array"),
+  cl::init(false), cl::cat(TAFFOTraceOptions));
+
+
+std::string getTypeName(const TraceEvent& e)
+{
+  if (e.Type == TraceEvent::FixedPoint)
+    return FPType(e.Width, e.PointPos).toString();
+  if (e.Type == TraceEvent::FloatingPoint)
+    return FloatType::getStandardName((FloatType::FloatStandard)e.Width);
+  return "";
+}
+
+
+void printText(raw_ostream& os, const TraceContents& trace, const TraceEvent& e)
+{
+  os << format("%-10s ", getTraceStageName((TraceStage)e.Stage).data());
+  StringRef function = trace.getString(e.Function);
+  StringRef value = trace.getString(e.Value);
+  if (!function.empty())
+    os << function << ":";
+  if (!value.empty())
+    os << "%" << value;
+  else if (e.ValueID)
+    os << "<" << format_hex(e.ValueID, 0) << ">";
+  if (!std::isnan(e.Min))
+    os << " [" << e.Min << ", " << e.Max << "]";
+  std::string type = getTypeName(e);
+  if (!type.empty())
+    os << " " << type;
+  StringRef reason = trace.getString(e.Reason);
+  if (!reason.empty())
+    os << " (" << reason << ")";
+  os << "\n";
+}
+
+
+json::Value toJSON(const TraceContents& trace, const TraceEvent& e)
+{
+  json::Object obj{
+    {"stage", getTraceStageName((TraceStage)e.Stage)},
+    {"function", trace.getString(e.Function)},
+    {"value", trace.getString(e.Value)},
+    {"id", (int64_t)e.ValueID},
+    {"reason", trace.getString(e.Reason)}};
+  if (!std::isnan(e.Min)) {
+    obj["min"] = e.Min;
+    obj["max"] = e.Max;
+  }
+  std::string type = getTypeName(e);
+  if (!type.empty())
+    obj["type"] = type;
+  return json::Value(std::move(obj));
+}
+
+
+int main(int argc, char *argv[])
+{
+  InitLLVM init(argc, argv);
+  cl::HideUnrelatedOptions(TAFFOTraceOptions);
+  cl::ParseCommandLineOptions(argc, argv,
+    "Prints the ranges and the types chosen by the stages of TAFFO, recorded\n"
+    "by taffo-driver -trace\n");
+
+  unsigned stages = 0;
+  for (const std::string& name: StageFilter) {
+    TraceStage stage;
+    if (!parseTraceStage(name, stage)) {
+      errs() << "Unknown stage " << name << "\n";
+      return 1;
+    }
+    stages |= 1U << (unsigned)stage;
+  }
+
+  TraceContents trace;
+  std::string err;
+  if (!readTrace(InputFilename, trace, err)) {
+    errs() << err << "\n";
+    return 1;
+  }
+
+  json::Array events;
+  for (const TraceEvent& e: trace.Events) {
+    if (stages && !(stages & (1U << e.Stage)))
+      continue;
+    if (!FunctionFilter.empty() && trace.getString(e.Function) != FunctionFilter)
+      continue;
+    if (!ValueFilter.empty() && trace.getString(e.Value) != ValueFilter)
+      continue;
+    if (!ReasonFilter.empty() && trace.getString(e.Reason).find(ReasonFilter) == StringRef::npos)
+      continue;
+    if (JSONOutput)
+      events.push_back(toJSON(trace, e));
+    else
+      printText(outs(), trace, e);
+  }
+  if (JSONOutput)
+    outs() << formatv("{0:2}", json::Value(std::move(events))) << "\n";
+  return 0;
+}
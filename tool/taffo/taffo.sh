@@ -29,6 +29,55 @@ taffo_setenv_find()
   fi
 }
 
+# Runs the command "$2 $3 ..." recording its timing under the name $1 when
+# the time report is enabled
+taffo_timed()
+{
+  local name="$1"
+  shift
+  if [[ $time_report -ne 0 ]]; then
+    "$TAFFO_DRIVER" -exec-timed "$name" "$time_report_file" "$@"
+  else
+    "$@"
+  fi
+}
+
+# Runs DTA, Conversion, the Error Propagator and the Performance Estimator
+# on the VRA output for the feedback candidate $1 using the DTA flags $2.
+# The outputs of the candidate are stored in the files named
+# ${output_basename}.fb$1.*.taffotmp.*
+taffo_feedback_candidate()
+{
+  local cand="${output_basename}.fb$1"
+  local err_cache=
+  if [[ ( "$driver_flags" == *-err-summaries* ) && ( "$driver_flags" != *-err-cache=* ) ]]; then
+    # the errors of the previous iteration of this candidate are only
+    # propagated again where the types changed
+    err_cache="-err-cache=${temporary_dir}/${cand}.errcache.taffotmp.txt"
+  fi
+  ${TAFFO_DRIVER} \
+    "${driver_opts[@]}" \
+    $(taffo_stage_flags -Xdta "$2") \
+    -first-stage=dta -last-stage=err \
+    -temp-prefix "$cand" ${err_cache} \
+    -err-out "${temporary_dir}/${cand}.errorprop.taffotmp.txt" \
+    -err-report "${temporary_dir}/${cand}.errorprop.taffotmp.json" \
+    -o "${temporary_dir}/${cand}.5.taffotmp.ll" "${temporary_dir}/${output_basename}.3.taffotmp.ll" || return $?
+  taffo_timed "taffo-pe:fb$1" ${TAFFO_PE} \
+    --fix "${temporary_dir}/${cand}.5.taffotmp.ll" \
+    --flt "${temporary_dir}/${output_basename}.float.taffotmp.ll" \
+    --model ${pe_model_file} > "${temporary_dir}/${cand}.perfest.taffotmp.txt" || return $?
+}
+
+# Prefixes each of the space-separated flags in $2 with the taffo-driver
+# option $1 which forwards it to a given stage
+taffo_stage_flags()
+{
+  for flag in $2; do
+    printf -- '%s %s ' "$1" "$flag"
+  done
+}
+
 
 SCRIPTPATH=$(dirname "$BASH_SOURCE")
 TAFFO_PREFIX=${SCRIPTPATH}/..
@@ -38,6 +87,9 @@ export INSTMIX=$(taffo_setenv_find $TAFFO_PREFIX 'bin' 'taffo-instmix')
 export TAFFO_MLFEAT=$(taffo_setenv_find $TAFFO_PREFIX 'bin' 'taffo-mlfeat')
 export TAFFO_FE=$(taffo_setenv_find $TAFFO_PREFIX 'bin' 'taffo-fe')
 export TAFFO_PE=$(taffo_setenv_find $TAFFO_PREFIX 'bin' 'taffo-pe')
+export TAFFO_DRIVER=$(taffo_setenv_find $TAFFO_PREFIX 'bin' 'taffo-driver')
+# runtime of the fixed point versions of the libm functions
+TAFFO_FIXM_LIB="$TAFFO_PREFIX/lib/libtaffofixm.a"
 
 if [[ -z "$LLVM_DIR" ]]; then
   LLVM_DIR=$(llvm-config --prefix 2> /dev/null)
@@ -84,12 +136,28 @@ conversion_flags=
 enable_errorprop=0
 errorprop_flags=
 errorprop_out=
+errorprop_report=
+driver_flags=
+time_report=0
+time_report_json=
+region_timing=0
+link_time=0
+kernel_mode=0
 mem2reg=-mem2reg
 dontlink=
 iscpp=$CLANG
 feedback=0
+feedback_batch=1
+feedback_state_dir="$TAFFO_FEEDBACK_STATE_DIR"
 pe_model_file=
+ml_model_file=
 temporary_dir=$(mktemp -d)
+if [ $(uname -s) = "Darwin" ]; then
+  parallel_jobs=$(sysctl -n hw.ncpu 2> /dev/null)
+else
+  parallel_jobs=$(nproc 2> /dev/null)
+fi
+if [[ -z "$parallel_jobs" ]]; then parallel_jobs=1; fi
 del_temporary_dir=1
 help=0
 for opt in $raw_opts; do
@@ -122,6 +190,13 @@ for opt in $raw_opts; do
         -float-output)
           parse_state=6;
           ;;
+        -j*)
+          if [[ ${#opt} -eq 2 ]]; then
+            parse_state=11;
+          else
+            parallel_jobs="${opt:2}";
+          fi;
+          ;;
         -O*)
           optimization=$opt;
           ;;
@@ -133,11 +208,8 @@ for opt in $raw_opts; do
           ;;
         -debug)
           if [[ $llvm_debug -ne 0 ]]; then
-            init_flags="$init_flags -debug";
-            dta_flags="$dta_flags -debug";
-            conversion_flags="$conversion_flags -debug";
-            vra_flags="$vra_flags -debug";
-            errorprop_flags="$errorprop_flags -debug";
+            # all stages share the same process, -debug must appear once
+            driver_flags="$driver_flags -debug";
           fi
           LOG=/dev/stderr
           ;;
@@ -160,9 +232,19 @@ for opt in $raw_opts; do
         -feedback)
           feedback=1
           ;;
+        -feedback-batch)
+          feedback=1
+          parse_state=13
+          ;;
+        -feedback-state)
+          parse_state=31
+          ;;
         -pe-model)
           parse_state=7
           ;;
+        -ml-model)
+          parse_state=15
+          ;;
         -temp-dir)
           del_temporary_dir=0
           parse_state=9
@@ -171,9 +253,108 @@ for opt in $raw_opts; do
           enable_errorprop=1
           parse_state=10
           ;;
+        -err-report)
+          enable_errorprop=1
+          parse_state=24
+          ;;
         -no-mem2reg)
           mem2reg=
           ;;
+        -vra-summaries)
+          driver_flags="$driver_flags -vra-summaries"
+          ;;
+        -lto)
+          link_time=1
+          ;;
+        -kernel)
+          kernel_mode=1
+          driver_flags="$driver_flags -kernels"
+          ;;
+        -vra-jobs)
+          parse_state=20
+          ;;
+        -vra-cache)
+          parse_state=21
+          ;;
+        -err-summaries)
+          driver_flags="$driver_flags -err-summaries"
+          ;;
+        -err-jobs)
+          parse_state=22
+          ;;
+        -err-cache)
+          parse_state=23
+          ;;
+        -conversion-jobs)
+          parse_state=14
+          ;;
+        -range-guards)
+          driver_flags="$driver_flags -range-guards"
+          ;;
+        -vectorize-boundaries)
+          driver_flags="$driver_flags -vectorize-boundaries"
+          ;;
+        -repack-structs)
+          driver_flags="$driver_flags -repack-structs"
+          ;;
+        -merge-clones)
+          driver_flags="$driver_flags -merge-clones"
+          ;;
+        -merge-clones-report)
+          parse_state=34
+          ;;
+        -fold-ranges)
+          driver_flags="$driver_flags -fold-ranges"
+          ;;
+        -narrow-integers)
+          parse_state=33
+          ;;
+        -specialize-clones)
+          parse_state=16
+          ;;
+        -min-shifts)
+          parse_state=17
+          ;;
+        -narrow-reductions)
+          parse_state=32
+          ;;
+        -error-budget)
+          parse_state=30
+          ;;
+        -cost-model)
+          parse_state=18
+          ;;
+        -narrow-storage)
+          parse_state=19
+          ;;
+        -overflow-checks)
+          parse_state=25
+          ;;
+        -overflow-checks-targets)
+          driver_flags="$driver_flags -overflow-checks-targets"
+          ;;
+        -saturate)
+          parse_state=26
+          ;;
+        -trace)
+          parse_state=27
+          ;;
+        -trace-stages)
+          parse_state=28
+          ;;
+        -trace-sample)
+          parse_state=29
+          ;;
+        -time-report)
+          time_report=1
+          ;;
+        -time-report-json)
+          time_report=1
+          parse_state=12
+          ;;
+        -region-timing)
+          region_timing=1
+          ;;
         -S)
           emit_source="s"
           float_opts="-S"
@@ -188,7 +369,7 @@ for opt in $raw_opts; do
         -*)
           opts="$opts $opt";
           ;;
-        *.c | *.ll)
+        *.c | *.ll | *.cl)
           input_files+=( "$opt" );
           ;;
         *.cpp | *.cc)
@@ -240,10 +421,110 @@ for opt in $raw_opts; do
       errorprop_out="$opt";
       parse_state=0;
       ;;
+    11)
+      parallel_jobs="$opt";
+      parse_state=0;
+      ;;
+    12)
+      time_report_json="$opt";
+      parse_state=0;
+      ;;
+    13)
+      feedback_batch="$opt";
+      parse_state=0;
+      ;;
+    14)
+      driver_flags="$driver_flags -conversion-jobs=$opt";
+      parse_state=0;
+      ;;
+    15)
+      ml_model_file="$opt";
+      parse_state=0;
+      ;;
+    16)
+      driver_flags="$driver_flags -specialize-clones=$opt";
+      parse_state=0;
+      ;;
+    17)
+      driver_flags="$driver_flags -min-shifts=$opt";
+      parse_state=0;
+      ;;
+    18)
+      driver_flags="$driver_flags -cost-model=$opt";
+      parse_state=0;
+      ;;
+    19)
+      driver_flags="$driver_flags -narrow-storage=$opt";
+      parse_state=0;
+      ;;
+    20)
+      driver_flags="$driver_flags -vra-jobs=$opt";
+      parse_state=0;
+      ;;
+    21)
+      driver_flags="$driver_flags -vra-cache=$opt";
+      parse_state=0;
+      ;;
+    22)
+      driver_flags="$driver_flags -err-jobs=$opt";
+      parse_state=0;
+      ;;
+    23)
+      driver_flags="$driver_flags -err-cache=$opt";
+      parse_state=0;
+      ;;
+    24)
+      errorprop_report="$opt";
+      parse_state=0;
+      ;;
+    25)
+      driver_flags="$driver_flags -overflow-checks=$opt";
+      parse_state=0;
+      ;;
+    26)
+      driver_flags="$driver_flags -saturate=$opt";
+      parse_state=0;
+      ;;
+    27)
+      driver_flags="$driver_flags -trace=$opt";
+      parse_state=0;
+      ;;
+    28)
+      driver_flags="$driver_flags -trace-stages=$opt";
+      parse_state=0;
+      ;;
+    29)
+      driver_flags="$driver_flags -trace-sample=$opt";
+      parse_state=0;
+      ;;
+    30)
+      driver_flags="$driver_flags -error-budget=$opt";
+      parse_state=0;
+      ;;
+    31)
+      feedback_state_dir="$opt";
+      parse_state=0;
+      ;;
+    32)
+      driver_flags="$driver_flags -narrow-reductions=$opt";
+      parse_state=0;
+      ;;
+    33)
+      driver_flags="$driver_flags -narrow-integers=$opt";
+      parse_state=0;
+      ;;
+    34)
+      driver_flags="$driver_flags -merge-clones -merge-clones-report=$opt";
+      parse_state=0;
+      ;;
   esac;
 done
 
 output_basename=$(basename ${output_file})
+time_report_file="${temporary_dir}/${output_basename}.time.taffotmp.txt"
+if [[ $time_report -ne 0 ]]; then
+  rm -f "$time_report_file"
+fi
 
 if [[ ( -z "$input_files" ) || ( $help -ne 0 ) ]]; then
   cat << HELP_END
@@ -260,6 +541,8 @@ Options:
                         The accepted optimization levels are the same as CLANG.
                         (-O, -O1, -O2, -O3, -Os, -Of)
   -c                    Do not link the output
+  -j <N>                Compile up to N input files in parallel
+                        (Default: number of CPU cores)
   -S                    Produce an assembly file in output instead of a binary
                         (overrides -c and -emit-llvm)
   -emit-llvm            Produce a LLVM-IR assembly file in output instead of
@@ -267,10 +550,28 @@ Options:
   -enable-err           Enable the error propagator (disabled by default)
   -err-out <file>       Produce a textual report about the estimates performed
                         by the Error Propagator in the specified file.
+  -err-report <file>    Write the errors of the targets, of the comparisons
+                        and of the functions to <file> in JSON format.
+  -err-summaries        Propagate the errors with per-function summaries,
+                        reused by the calls with arguments with the same
+                        errors, instead of the Error Propagator pass.
+  -err-jobs <N>         With -err-summaries, propagate the errors in up to N
+                        independent parts of the call graph in parallel.
+  -err-cache <file>     With -err-summaries, reuse the summaries saved to
+                        <file> whose functions and callee errors are
+                        unchanged, and save the new ones to it.
   -disable-vra          Disables the VRA analysis pass, and replaces it with
                         a simpler, optimistic, and potentially incorrect greedy
                         algorithm.
   -no-mem2reg           Disable scheduling of the mem2reg pass.
+  -vra-summaries        Compute the ranges with per-function summaries,
+                        reused by the calls with arguments in the same
+                        ranges, instead of the VRA pass.
+  -vra-jobs <N>         With -vra-summaries, analyze up to N independent
+                        parts of the call graph in parallel.
+  -vra-cache <file>     With -vra-summaries, reuse the summaries saved in
+                        the specified file for the unchanged functions, and
+                        save the new ones to it.
   -float-output <file>  Also compile the files without using TAFFO and store
                         the output to the specified location.
   -Xinit <option>       Pass the specified option to the Initializer pass of
@@ -286,6 +587,92 @@ Options:
   -debug-taffo          Enable TAFFO-only debug logging during the compilation.
   -temp-dir <dir>       Store various temporary files related to the execution
                         of TAFFO to the specified directory.
+  -conversion-jobs <N>  Split the program after DTA and convert up to N
+                        parts of it in parallel.
+  -kernel               Compile OpenCL, SPIR, AMDGPU or NVPTX kernels: the
+                        kernels are the entry points, and the output is the
+                        converted LLVM-IR of the device (bitcode, or
+                        assembly with -S or -emit-llvm), which is not linked.
+  -lto                  With more than one input, run the Initializer on each
+                        input file concurrently, and the rest of TAFFO on the
+                        linked program with -vra-summaries and the
+                        Conversion split in up to -j parts.
+  -range-guards         Check at run time that the arguments of the converted
+                        functions are in the ranges their types were sized
+                        for, and call the floating point version otherwise.
+  -specialize-clones <N>
+                        Split each converted function in up to N copies,
+                        called with arguments in different ranges, so that
+                        each copy gets its own types.
+  -fold-ranges          Replace the values which VRA proves constant with
+                        constants, and remove the branches which the ranges
+                        prove dead.
+  -narrow-integers <W>  Store the integer arrays and compute the integer
+                        operations in W bits when the ranges of VRA fit.
+  -min-shifts <N>       Lower the point positions chosen by DTA by up to N
+                        bits to minimize the shifts in the hot code.
+  -narrow-reductions <W>
+                        Give W bit fixed point types to the arrays only read
+                        as operands of the reductions of the loops, while the
+                        accumulators keep the types chosen by DTA.
+  -error-budget <budget>
+                        Give the fewest bits to the values which reach the
+                        targets that keep their absolute error within the
+                        budget: <error> for all the targets, or
+                        <target>=<error>. May be repeated.
+  -cost-model <model>   Keep in floating point the values whose conversion
+                        is slower on the target: cortex-m4, target (from
+                        the LLVM target of the module) or a cost file.
+  -narrow-storage <fmt> Store arrays, globals and structure fields in
+                        memory as 8, 16 or 32 bit fixed point, half or
+                        bfloat16 values, and compute on the wider types.
+  -overflow-checks <N>  Check the overflows of the fixed point operations in
+                        one call every N of each function (1: every call),
+                        and report their location and exact value at run
+                        time. Needs libtaffofixm.a.
+  -overflow-checks-targets
+                        With -overflow-checks, only check the targets and
+                        the values stored to them.
+  -saturate <mode>      Make the fixed point operations saturate instead of
+                        wrapping around: all, targets (the targets and the
+                        values stored to them) or edge (the values whose
+                        range is near the bounds of their type).
+  -vectorize-boundaries Replace the loops which convert whole arrays between
+                        floating point and fixed point with calls to the
+                        vectorized routines of libtaffofixm.a.
+  -repack-structs       Reorder the fields of the structures which are only
+                        used in the module to remove their padding.
+  -merge-clones         Merge the functions cloned by TAFFO whose converted
+                        code is the same.
+  -merge-clones-report <file>
+                        Like -merge-clones, and write a JSON report of the
+                        merged clones and of the bytes saved to the file.
+  -trace <file>         Write the ranges and the types chosen by the stages
+                        to the specified file, which is printed by
+                        taffo-trace. Unlike -debug-taffo, it also works
+                        with release builds of LLVM.
+  -trace-stages <list>  Only trace the specified stages (comma separated):
+                        init, vra, dta, conversion, errorprop, driver.
+  -trace-sample <N>     Only trace one event every N of each stage.
+  -ml-model <file>      Predict the options of the DTA pass from the features
+                        of the program with the model in the specified file
+                        (see taffo-mlfeat -model), trained on the features
+                        printed by taffo-mlfeat -summaries. The options given
+                        with -Xdta take precedence.
+  -feedback-state <dir> With -feedback, keep the state of the feedback
+                        estimator in the specified directory (default:
+                        \$TAFFO_FEEDBACK_STATE_DIR), and restart the builds
+                        of the same program with the same options from the
+                        DTA flags they converged to.
+  -time-report          Print wall time, user time and peak RSS of each
+                        compilation stage.
+  -time-report-json <file>
+                        Also write the time report to the specified file in
+                        JSON format (implies -time-report)
+  -region-timing        Count the calls and the cycles of the functions
+                        marked by TAFFO in the output and in the -float-output
+                        programs, written at exit to \$TAFFO_REGION_PROFILE
+                        (default: regions.prof).
 HELP_END
   exit 0
 fi
@@ -300,26 +687,38 @@ fi
 ###
 if [[ ${#input_files[@]} -eq 1 ]]; then
   # one input file
-  ${CLANG} \
+  taffo_timed clang ${CLANG} \
     $opts -O0 -Xclang -disable-O0-optnone \
     -c -emit-llvm \
     ${input_files} \
     -S -o "${temporary_dir}/${output_basename}.1.taffotmp.ll" || exit $?
 else
   # > 1 input files
+  # the files are compiled concurrently, at most $parallel_jobs at a time;
+  # jobs are waited for in the order they were started, so that the first
+  # failing input (in command line order) determines the exit code
   tmp=()
+  pids=()
   for input_file in "${input_files[@]}"; do
     thisfn=$(basename "$input_file")
     thisfn=${thisfn%.*}
     thisfn="${temporary_dir}/${output_basename}.${thisfn}.0.taffotmp.ll"
     tmp+=( $thisfn )
-    ${CLANG} \
+    if [[ ${#pids[@]} -ge $parallel_jobs ]]; then
+      wait ${pids[0]} || exit $?
+      pids=( "${pids[@]:1}" )
+    fi
+    taffo_timed "clang:$(basename "$input_file")" ${CLANG} \
       $opts -O0 -Xclang -disable-O0-optnone \
       -c -emit-llvm \
       ${input_file} \
-      -S -o "${thisfn}" || exit $?
+      -S -o "${thisfn}" &
+    pids+=( $! )
+  done
+  for pid in "${pids[@]}"; do
+    wait $pid || exit $?
   done
-  ${LLVM_LINK} \
+  taffo_timed llvm-link ${LLVM_LINK} \
     ${tmp[@]} \
     -S -o "${temporary_dir}/${output_basename}.1.taffotmp.ll" || exit $?
 fi
@@ -328,113 +727,315 @@ fi
 build_float="${iscpp} $opts ${optimization} ${temporary_dir}/${output_basename}.1.taffotmp.ll"
 
 ###
-###  TAFFO initialization
-###
-${OPT} \
-  -load "$TAFFOLIB" \
-  -taffoinit \
-  ${init_flags} \
-  -S -o "${temporary_dir}/${output_basename}.2.taffotmp.ll" "${temporary_dir}/${output_basename}.1.taffotmp.ll" || exit $?
-  
+###  TAFFO pipeline
 ###
-###  TAFFO Value Range Analysis
-###
-if [[ $disable_vra -eq 0 ]]; then
-  ${OPT} \
-    -load "$TAFFOLIB" \
-    ${mem2reg} -taffoVRA \
-    ${vra_flags} \
-    -S -o "${temporary_dir}/${output_basename}.3.taffotmp.ll" "${temporary_dir}/${output_basename}.2.taffotmp.ll" || exit $?;
+# All the passes of TAFFO are run by taffo-driver in a single process, which
+# avoids re-parsing and re-printing the module between the stages.
+# when TAFFO_SERVER is set the stages are run by the server listening on that
+# socket (taffo-driver -load Taffo.so -serve <socket>) instead
+if [[ -z "$TAFFO_SERVER" ]]; then
+  driver_opts=( -load "$TAFFOLIB" )
 else
-  cp "${temporary_dir}/${output_basename}.2.taffotmp.ll" "${temporary_dir}/${output_basename}.3.taffotmp.ll";
+  driver_opts=( -connect "$TAFFO_SERVER" )
+fi
+driver_opts+=( -S ${driver_flags} \
+  $(taffo_stage_flags -Xinit "${init_flags}") \
+  $(taffo_stage_flags -Xvra "${vra_flags}") \
+  $(taffo_stage_flags -Xconversion "${conversion_flags}") \
+  $(taffo_stage_flags -Xerr "${errorprop_flags}") )
+if [[ $time_report -ne 0 ]]; then
+  driver_opts+=( -time-report-file "$time_report_file" )
+fi
+if [[ $disable_vra -ne 0 ]]; then
+  driver_opts+=( -disable-vra )
+fi
+if [[ -z "$mem2reg" ]]; then
+  driver_opts+=( -no-mem2reg )
+fi
+if [[ $del_temporary_dir -eq 0 ]]; then
+  driver_opts+=( -temp-dir "${temporary_dir}" )
+fi
+# with -lto the Initializer runs on each input on its own, as concurrently
+# as the front end, and the rest of the pipeline starts from the link of the
+# initialized modules
+taffo_input=( "${temporary_dir}/${output_basename}.1.taffotmp.ll" )
+if [[ ( $link_time -ne 0 ) && ( ${#input_files[@]} -gt 1 ) ]]; then
+  inited=()
+  pids=()
+  for thisfn in "${tmp[@]}"; do
+    initfn="${thisfn%.0.taffotmp.ll}.2.taffotmp.ll"
+    inited+=( "$initfn" )
+    if [[ ${#pids[@]} -ge $parallel_jobs ]]; then
+      wait ${pids[0]} || exit $?
+      pids=( "${pids[@]:1}" )
+    fi
+    ${TAFFO_DRIVER} \
+      "${driver_opts[@]}" \
+      -last-stage=init \
+      -temp-prefix "$(basename "${initfn%.2.taffotmp.ll}")" \
+      -o "$initfn" "$thisfn" &
+    pids+=( $! )
+  done
+  for pid in "${pids[@]}"; do
+    wait $pid || exit $?
+  done
+  taffo_timed llvm-link ${LLVM_LINK} \
+    "${inited[@]}" \
+    -S -o "${temporary_dir}/${output_basename}.2.taffotmp.ll" || exit $?
+  taffo_input=( -first-stage=vra "${temporary_dir}/${output_basename}.2.taffotmp.ll" )
+  if [[ " $driver_flags " != *" -vra-summaries "* ]]; then
+    driver_opts+=( -vra-summaries )
+  fi
+  if [[ " $driver_flags " != *" -vra-jobs="* ]]; then
+    driver_opts+=( -vra-jobs=$parallel_jobs )
+  fi
+  if [[ " $driver_flags " != *" -conversion-jobs="* ]]; then
+    driver_opts+=( -conversion-jobs=$parallel_jobs )
+  fi
 fi
 
-feedback_stop=0
-if [[ $feedback -ne 0 ]]; then
-  # init the feedback estimator if needed
-  base_dta_flags="${dta_flags}"
-  dta_flags="${base_dta_flags} "$($TAFFO_FE --init --state "${temporary_dir}/${output_basename}.festate.taffotmp.bin")
+if [[ ( $enable_errorprop -eq 1 ) || ( $feedback -ne 0 ) ]]; then
+  last_stage=err
+else
+  last_stage=conversion
 fi
-while [[ $feedback_stop -eq 0 ]]; do
-  ###
-  ###  TAFFO Data Type Allocation
-  ###
-  ${OPT} \
-    -load "$TAFFOLIB" \
-    -taffodta -globaldce \
-    ${dta_flags} \
-    -S -o "${temporary_dir}/${output_basename}.4.taffotmp.ll" "${temporary_dir}/${output_basename}.3.taffotmp.ll" || exit $?
-    
-  ###
-  ###  TAFFO Conversion
-  ###
-  ${OPT} \
-    -load "$TAFFOLIB" \
-    -flttofix -globaldce -dce \
-    ${conversion_flags} \
-    -S -o "${temporary_dir}/${output_basename}.5.taffotmp.ll" "${temporary_dir}/${output_basename}.4.taffotmp.ll" || exit $?
-    
-  ###
-  ###  TAFFO Feedback Estimator
-  ###
-  if [[ ( $enable_errorprop -eq 1 ) || ( $feedback -ne 0 ) ]]; then
-    ${OPT} \
-      -load "$TAFFOLIB" \
-      -errorprop \
-      ${errorprop_flags} \
-      -S -o "${temporary_dir}/${output_basename}.6.taffotmp.ll" "${temporary_dir}/${output_basename}.5.taffotmp.ll" 2> "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt" || exit $?
-    if [[ ! ( -z "$errorprop_out" ) ]]; then
-      cp "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt" "$errorprop_out"
+
+# with -ml-model the DTA flags are predicted once from the output of VRA,
+# which is also the starting point of the feedback iterations if enabled
+vra_done=0
+if [[ ! ( -z "$ml_model_file" ) ]]; then
+  ${TAFFO_DRIVER} \
+    "${driver_opts[@]}" \
+    -last-stage=vra \
+    -temp-prefix "${output_basename}" \
+    -o "${temporary_dir}/${output_basename}.3.taffotmp.ll" "${taffo_input[@]}" || exit $?
+  vra_done=1
+  ml_flags=$(taffo_timed taffo-mlfeat ${TAFFO_MLFEAT} -summaries \
+    -model "$ml_model_file" "${temporary_dir}/${output_basename}.3.taffotmp.ll") || exit $?
+  for flag in $ml_flags; do
+    name=${flag%%=*}
+    if [[ ( " $dta_flags " != *" $name="* ) && ( " $dta_flags " != *" $name "* ) ]]; then
+      dta_flags="$dta_flags $flag"
     fi
+  done
+fi
+
+if [[ $feedback -eq 0 ]]; then
+  if [[ $vra_done -ne 0 ]]; then
+    driver_input=( -first-stage=dta "${temporary_dir}/${output_basename}.3.taffotmp.ll" )
+  else
+    driver_input=( "${taffo_input[@]}" )
+  fi
+  ${TAFFO_DRIVER} \
+    "${driver_opts[@]}" \
+    $(taffo_stage_flags -Xdta "${dta_flags}") \
+    -last-stage=${last_stage} \
+    -temp-prefix "${output_basename}" \
+    -err-out "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt" \
+    -err-report "${temporary_dir}/${output_basename}.errorprop.taffotmp.json" \
+    -o "${temporary_dir}/${output_basename}.5.taffotmp.ll" "${driver_input[@]}" || exit $?
+  if [[ ( $enable_errorprop -eq 1 ) && ! ( -z "$errorprop_out" ) ]]; then
+    cp "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt" "$errorprop_out"
+  fi
+  if [[ ( $enable_errorprop -eq 1 ) && ! ( -z "$errorprop_report" ) ]]; then
+    cp "${temporary_dir}/${output_basename}.errorprop.taffotmp.json" "$errorprop_report"
   fi
-  if [[ $feedback -eq 0 ]]; then
-    break
+else
+  # the output of VRA is the starting point of each feedback iteration
+  if [[ $vra_done -eq 0 ]]; then
+    ${TAFFO_DRIVER} \
+      "${driver_opts[@]}" \
+      -last-stage=vra \
+      -temp-prefix "${output_basename}" \
+      -o "${temporary_dir}/${output_basename}.3.taffotmp.ll" "${taffo_input[@]}" || exit $?
   fi
-  ${build_float} -S -emit-llvm \
+
+  # the float version of the program does not depend on the feedback
+  # iterations, the performance estimator always compares against it
+  taffo_timed float ${build_float} -S -emit-llvm \
     -o "${temporary_dir}/${output_basename}.float.taffotmp.ll" || exit $?
-  ${TAFFO_PE} \
-    --fix "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
-    --flt "${temporary_dir}/${output_basename}.float.taffotmp.ll" \
-    --model ${pe_model_file} > "${temporary_dir}/${output_basename}.perfest.taffotmp.txt" || exit $?
-  newflgs=$(${TAFFO_FE} \
-    --pe-out "${temporary_dir}/${output_basename}.perfest.taffotmp.txt" \
-    --ep-out "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt" \
-    --state "${temporary_dir}/${output_basename}.festate.taffotmp.bin" || exit $?)
-  if [[ ( "$newflgs" == 'STOP' ) || ( -z "$newflgs" ) ]]; then
-    feedback_stop=1
+
+  # init the feedback estimator; with -feedback-batch K > 1 the estimator
+  # proposes up to K sets of DTA flags at a time, one per line
+  base_dta_flags="${dta_flags}"
+  fe_state="${temporary_dir}/${output_basename}.festate.taffotmp.bin"
+  fe_batch_opts=
+  if [[ $feedback_batch -gt 1 ]]; then
+    fe_batch_opts="--batch $feedback_batch"
+  fi
+  # with -feedback-state, a previous build of the same VRA output (thus of
+  # the same sources and annotations) with the same options restarts the
+  # estimator from its state, with the flags it converged to as the first
+  # candidate; the ModuleID of the VRA output is the path of its input in
+  # the temporary directory, which differs at each build
+  fe_key=
+  if [[ ! ( -z "$feedback_state_dir" ) ]]; then
+    fe_key=$( { sed -e '/^; ModuleID = /d' -e "s|${temporary_dir}/||g" \
+      "${temporary_dir}/${output_basename}.3.taffotmp.ll"; \
+      printf '%s\n' "$base_dta_flags" "$feedback_batch" "$pe_model_file"; } | \
+      cksum | cut -d ' ' -f 1)
+    fe_key="${feedback_state_dir}/${output_basename}.${fe_key}"
+  fi
+  if [[ ( ! ( -z "$fe_key" ) ) && ( -f "${fe_key}.festate.bin" ) && ( -f "${fe_key}.flags" ) ]]; then
+    echo "Restarting the feedback estimator from ${fe_key}" >> $LOG
+    cp "${fe_key}.festate.bin" "$fe_state" || exit $?
+    newflgs=$(cat "${fe_key}.flags")
   else
-    dta_flags="${base_dta_flags} ${newflgs}"
+    newflgs=$($TAFFO_FE --init --state "$fe_state" $fe_batch_opts)
   fi
-done
+  feedback_stop=0
+  selected=0
+  while [[ $feedback_stop -eq 0 ]]; do
+    candidates=()
+    while IFS= read -r line; do
+      candidates+=( "$line" )
+    done <<< "$newflgs"
+
+    # evaluate all candidates starting from the same VRA output, each one
+    # with its own files
+    pids=()
+    for i in "${!candidates[@]}"; do
+      if [[ ${#pids[@]} -ge $parallel_jobs ]]; then
+        wait ${pids[0]} || exit $?
+        pids=( "${pids[@]:1}" )
+      fi
+      taffo_feedback_candidate $i "${base_dta_flags} ${candidates[$i]}" &
+      pids+=( $! )
+    done
+    for pid in "${pids[@]}"; do
+      wait $pid || exit $?
+    done
+
+    fe_args=()
+    for i in "${!candidates[@]}"; do
+      fe_args+=( --pe-out "${temporary_dir}/${output_basename}.fb$i.perfest.taffotmp.txt" )
+      fe_args+=( --ep-out "${temporary_dir}/${output_basename}.fb$i.errorprop.taffotmp.txt" )
+    done
+    newflgs=$(${TAFFO_FE} \
+      "${fe_args[@]}" \
+      --state "$fe_state" $fe_batch_opts || exit $?)
+    # "STOP <i>" selects the i-th candidate of the last batch as the result
+    if [[ ( "$newflgs" == STOP* ) || ( -z "$newflgs" ) ]]; then
+      feedback_stop=1
+      selected=$(echo "$newflgs" | cut -s -d ' ' -f 2)
+      if [[ -z "$selected" ]]; then selected=0; fi
+    fi
+  done
+  if [[ ! ( -z "$fe_key" ) ]]; then
+    # written to temporary names and renamed, as concurrent builds may
+    # share the directory
+    mkdir -p "$feedback_state_dir" && \
+      cp "$fe_state" "${fe_key}.festate.bin.$$" && \
+      printf '%s\n' "${candidates[$selected]}" > "${fe_key}.flags.$$" && \
+      mv -f "${fe_key}.festate.bin.$$" "${fe_key}.festate.bin" && \
+      mv -f "${fe_key}.flags.$$" "${fe_key}.flags" || \
+      printf 'Warning: cannot save the feedback state to %s\n' "$feedback_state_dir" 1>&2
+  fi
+  cp "${temporary_dir}/${output_basename}.fb$selected.5.taffotmp.ll" "${temporary_dir}/${output_basename}.5.taffotmp.ll"
+  cp "${temporary_dir}/${output_basename}.fb$selected.errorprop.taffotmp.txt" "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt"
+  cp "${temporary_dir}/${output_basename}.fb$selected.errorprop.taffotmp.json" "${temporary_dir}/${output_basename}.errorprop.taffotmp.json"
+  if [[ ! ( -z "$errorprop_out" ) ]]; then
+    cp "${temporary_dir}/${output_basename}.errorprop.taffotmp.txt" "$errorprop_out"
+  fi
+  if [[ ! ( -z "$errorprop_report" ) ]]; then
+    cp "${temporary_dir}/${output_basename}.errorprop.taffotmp.json" "$errorprop_report"
+  fi
+fi
+
+###
+###  Region timing
+###
+# the regions found in the converted module are also instrumented in the
+# floating point version, which has no TAFFO metadata
+if [[ $region_timing -ne 0 ]]; then
+  taffo_timed region-timing ${TAFFO_DRIVER} -region-timing \
+    "${temporary_dir}/${output_basename}.regions.taffotmp.txt" \
+    "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
+    "${temporary_dir}/${output_basename}.5.taffotmp.ll" || exit $?
+  if [[ ! ( -z ${float_output_file} ) ]]; then
+    taffo_timed region-timing-float ${TAFFO_DRIVER} -region-timing \
+      "${temporary_dir}/${output_basename}.regions.taffotmp.txt" \
+      "${temporary_dir}/${output_basename}.1.taffotmp.ll" \
+      "${temporary_dir}/${output_basename}.1.regions.taffotmp.ll" || exit $?
+    build_float="${iscpp} $opts ${optimization} ${temporary_dir}/${output_basename}.1.regions.taffotmp.ll"
+  fi
+fi
 
 ###
 ###  Backend
 ###
 
 # Produce the requested output file
-if [[ ( $emit_source == "s" ) || ( $del_temporary_dir -eq 0 ) ]]; then
-  ${CLANG} \
-    $opts ${optimization} \
-    -c \
-    "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
-    -S -o "${temporary_dir}/${output_basename}.taffotmp.s" || exit $?
-fi
-if [[ $emit_source == "s" ]]; then
-  cp "${temporary_dir}/${output_basename}.taffotmp.s" "$output_file"
-elif [[ $emit_source == "ll" ]]; then
-  cp "${temporary_dir}/${output_basename}.5.taffotmp.ll" "$output_file"
+# the kernels are not compiled for the host: the output is the device IR,
+# which the OpenCL or CUDA runtime compiles for the device
+if [[ $kernel_mode -ne 0 ]]; then
+  if [[ -n "$emit_source" ]]; then
+    cp "${temporary_dir}/${output_basename}.5.taffotmp.ll" "$output_file"
+  else
+    taffo_timed backend ${CLANG} \
+      $opts ${optimization} \
+      -c -emit-llvm \
+      "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
+      -o "$output_file" || exit $?
+  fi
+  if [[ ! ( -z ${float_output_file} ) ]]; then
+    if [[ -n "$emit_source" ]]; then
+      float_opts="-S -emit-llvm"
+    fi
+    taffo_timed float-output ${build_float} \
+      -c -emit-llvm ${float_opts} \
+      -o "$float_output_file" || exit $?
+  fi
 else
-  ${iscpp} \
-    $opts ${optimization} \
-    ${dontlink} \
-    "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
-    -o "$output_file" || exit $?
+  if [[ ( $emit_source == "s" ) || ( $del_temporary_dir -eq 0 ) ]]; then
+    taffo_timed backend-asm ${CLANG} \
+      $opts ${optimization} \
+      -c \
+      "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
+      -S -o "${temporary_dir}/${output_basename}.taffotmp.s" || exit $?
+  fi
+  if [[ $emit_source == "s" ]]; then
+    cp "${temporary_dir}/${output_basename}.taffotmp.s" "$output_file"
+  elif [[ $emit_source == "ll" ]]; then
+    cp "${temporary_dir}/${output_basename}.5.taffotmp.ll" "$output_file"
+  else
+    runtime_libs=
+    if [[ ( -z "$dontlink" ) && ( -f "$TAFFO_FIXM_LIB" ) ]]; then
+      runtime_libs="$TAFFO_FIXM_LIB"
+    fi
+    taffo_timed backend ${iscpp} \
+      $opts ${optimization} \
+      ${dontlink} \
+      "${temporary_dir}/${output_basename}.5.taffotmp.ll" \
+      ${runtime_libs} \
+      -o "$output_file" || exit $?
+  fi
+
+  if [[ ! ( -z ${float_output_file} ) ]]; then
+    taffo_timed float-output ${build_float} \
+      ${dontlink} ${float_opts} \
+      -o "$float_output_file" || exit $?
+  fi
 fi
 
-if [[ ! ( -z ${float_output_file} ) ]]; then
-  ${build_float} \
-    ${dontlink} ${float_opts} \
-    -o "$float_output_file" || exit $?
+###
+###  Time report
+###
+if [[ $time_report -ne 0 ]]; then
+  # the report is printed on stderr like the one of clang -ftime-report
+  awk -F '\t' '
+    BEGIN { print "===-- TAFFO time report --===";
+            printf "%-24s %12s %12s %16s\n", "Stage", "Wall (s)", "User (s)", "Peak RSS (KiB)" }
+    { printf "%-24s %12.3f %12.3f %16d\n", $1, $2, $3, $4 }' \
+    "$time_report_file" 1>&2
+  if [[ ! ( -z "$time_report_json" ) ]]; then
+    awk -F '\t' '
+      BEGIN { printf "{\n  \"stages\": [" }
+      { gsub(/["\\]/, "\\\\&", $1);
+        printf "%s\n    {\"name\": \"%s\", \"wall\": %s, \"user\": %s, \"peak_rss_kib\": %s}", (NR > 1 ? "," : ""), $1, $2, $3, $4 }
+      END { printf "\n  ]\n}\n" }' \
+      "$time_report_file" > "$time_report_json"
+  fi
 fi
 
 ###
@@ -0,0 +1,117 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "AnnotationTable.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+
+
+class AnnotationTableTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  GlobalVariable *G;
+  Instruction *Add;
+
+  AnnotationTableTest() : M("test", Context) {
+    Type *Ty = Type::getDoubleTy(Context);
+    G = new GlobalVariable(M, Ty, false, GlobalValue::ExternalLinkage,
+                           ConstantFP::get(Ty, 1.0));
+    new GlobalVariable(M, Ty, false, GlobalValue::ExternalLinkage,
+                       ConstantFP::get(Ty, 2.0));
+    Function *F = Function::Create(FunctionType::get(Ty, {Ty, Ty}, false),
+                                   GlobalValue::ExternalLinkage, "f", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    Value *V = B.CreateFAdd(F->getArg(0), F->getArg(1));
+    Add = cast<Instruction>(V);
+    B.CreateRet(V);
+
+    MetadataManager::setInputInfoMetadata(*G, InputInfo(
+        std::make_shared<FPType>(-32, 20), std::make_shared<Range>(-3.0, 4.5),
+        std::make_shared<double>(1e-6), true));
+    MetadataManager::setInputInfoMetadata(*Add, InputInfo(
+        nullptr, std::make_shared<Range>(0.0, 9.0), nullptr, false, true));
+    MetadataManager::setErrorMetadata(*Add, 0.25);
+  }
+
+  ~AnnotationTableTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+};
+
+
+TEST_F(AnnotationTableTest, RoundTrip) {
+  AnnotationValueNumbering N(M);
+  /* 2 globals, 2 arguments, 2 instructions */
+  EXPECT_EQ(N.size(), 6U);
+
+  AnnotationTableWriter W;
+  W.addFromMetadata(M);
+  W.write(M, N.size());
+
+  AnnotationTableReader R(M, N);
+  ASSERT_TRUE(R.isValid());
+  EXPECT_EQ(R.getNumRecords(), 2U);
+
+  AnnotationRecord Rec;
+  ASSERT_TRUE(R.lookup(N.getID(G), Rec));
+  EXPECT_TRUE(Rec.has(AnnotationRecord::HasType));
+  EXPECT_EQ(Rec.Width, -32);
+  EXPECT_EQ(Rec.PointPos, 20U);
+  EXPECT_EQ(Rec.Min, -3.0);
+  EXPECT_EQ(Rec.Max, 4.5);
+  EXPECT_TRUE(Rec.has(AnnotationRecord::HasError));
+  EXPECT_EQ(Rec.Error, 1e-6);
+  EXPECT_TRUE(Rec.has(AnnotationRecord::EnableConversion));
+  EXPECT_FALSE(Rec.has(AnnotationRecord::HasAbsError));
+
+  ASSERT_TRUE(R.lookup(N.getID(Add), Rec));
+  EXPECT_FALSE(Rec.has(AnnotationRecord::HasType));
+  EXPECT_TRUE(Rec.has(AnnotationRecord::Final));
+  EXPECT_TRUE(Rec.has(AnnotationRecord::HasAbsError));
+  EXPECT_EQ(Rec.AbsError, 0.25);
+  std::unique_ptr<InputInfo> II = Rec.toInputInfo();
+  ASSERT_NE(II->IRange, nullptr);
+  EXPECT_EQ(II->IRange->Max, 9.0);
+  EXPECT_TRUE(II->IFinal);
+
+  EXPECT_FALSE(R.lookup(N.getID(M.getFunction("f")->getArg(0)), Rec));
+}
+
+
+TEST_F(AnnotationTableTest, RejectsStaleTable) {
+  AnnotationValueNumbering N(M);
+  AnnotationTableWriter W;
+  W.addFromMetadata(M);
+  std::string Blob = W.encode(N.size());
+  EXPECT_TRUE(AnnotationTableReader(Blob, N.size()).isValid());
+  EXPECT_FALSE(AnnotationTableReader(Blob, N.size() + 1).isValid());
+  EXPECT_FALSE(AnnotationTableReader(StringRef(Blob).drop_back(), N.size()).isValid());
+}
+
+
+TEST_F(AnnotationTableTest, LastRecordWins) {
+  AnnotationTableWriter W;
+  AnnotationRecord Rec;
+  Rec.ValueID = 3;
+  Rec.Max = 1.0;
+  W.addRecord(Rec);
+  Rec.Max = 2.0;
+  W.addRecord(Rec);
+  Rec.ValueID = 1;
+  W.addRecord(Rec);
+  std::string Blob = W.encode(6);
+  AnnotationTableReader R(Blob, 6);
+  ASSERT_EQ(R.getNumRecords(), 2U);
+  ASSERT_TRUE(R.lookup(3, Rec));
+  EXPECT_EQ(Rec.Max, 2.0);
+}
+
+}
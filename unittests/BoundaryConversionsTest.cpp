@@ -0,0 +1,143 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "BoundaryConversions.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class BoundaryConversionsTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+
+  BoundaryConversionsTest() : M("test", Context) {}
+
+  ~BoundaryConversionsTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  /* void Name(SrcTy *in, DstTy *out, i64 n) { for (i = 0; i < n; i++)
+   * out[i * DstStride] = Convert(in[i]); }, with the exit test in the
+   * header like the loops of the code promoted by mem2reg */
+  Function *createLoop(StringRef Name, Type *SrcTy, Type *DstTy, unsigned DstStride,
+                       function_ref<Value *(IRBuilder<> &, Value *)> Convert, bool ExtraCall = false) {
+    Type *I64 = Type::getInt64Ty(Context);
+    Function *F = Function::Create(
+        FunctionType::get(Type::getVoidTy(Context), {SrcTy->getPointerTo(), DstTy->getPointerTo(), I64}, false),
+        GlobalValue::ExternalLinkage, Name, &M);
+    BasicBlock *Entry = BasicBlock::Create(Context, "entry", F);
+    BasicBlock *Header = BasicBlock::Create(Context, "header", F);
+    BasicBlock *Body = BasicBlock::Create(Context, "body", F);
+    BasicBlock *Exit = BasicBlock::Create(Context, "exit", F);
+    IRBuilder<> B(Entry);
+    B.CreateBr(Header);
+
+    B.SetInsertPoint(Header);
+    PHINode *I = B.CreatePHI(I64, 2, "i");
+    I->addIncoming(ConstantInt::get(I64, 0), Entry);
+    B.CreateCondBr(B.CreateICmpSLT(I, F->getArg(2)), Body, Exit);
+
+    B.SetInsertPoint(Body);
+    Value *X = B.CreateLoad(SrcTy, B.CreateInBoundsGEP(SrcTy, F->getArg(0), I), "x");
+    Value *DstI = DstStride == 1 ? (Value *)I : B.CreateNSWMul(I, ConstantInt::get(I64, DstStride));
+    B.CreateStore(Convert(B, X), B.CreateInBoundsGEP(DstTy, F->getArg(1), DstI));
+    if (ExtraCall)
+      B.CreateCall(M.getOrInsertFunction("g", Type::getVoidTy(Context)));
+    Value *Next = B.CreateNSWAdd(I, ConstantInt::get(I64, 1));
+    I->addIncoming(Next, Body);
+    B.CreateBr(Header);
+
+    B.SetInsertPoint(Exit);
+    B.CreateRetVoid();
+    return F;
+  }
+
+  CallInst *findCall(Function *F) {
+    for (BasicBlock &BB : *F)
+      for (Instruction &I : BB)
+        if (auto *Call = dyn_cast<CallInst>(&I))
+          if (Call->getCalledFunction()->getName().startswith("taffo_fixm_"))
+            return Call;
+    return nullptr;
+  }
+
+  unsigned countStores(Function *F) {
+    unsigned N = 0;
+    for (BasicBlock &BB : *F)
+      for (Instruction &I : BB)
+        N += isa<StoreInst>(&I);
+    return N;
+  }
+};
+
+
+TEST_F(BoundaryConversionsTest, Names) {
+  EXPECT_EQ(getArrayConversionName(true, Type::getFloatTy(Context), 32, true), "taffo_fixm_to_fixed_f32_s32");
+  EXPECT_EQ(getArrayConversionName(false, Type::getDoubleTy(Context), 16, false), "taffo_fixm_from_fixed_u16_f64");
+  EXPECT_EQ(getArrayConversionName(true, Type::getHalfTy(Context), 32, true), "");
+  EXPECT_EQ(getArrayConversionName(true, Type::getFloatTy(Context), 24, true), "");
+}
+
+
+TEST_F(BoundaryConversionsTest, ToFixed) {
+  Function *F = createLoop("f", Type::getFloatTy(Context), Type::getInt32Ty(Context), 1,
+                           [](IRBuilder<> &B, Value *X) {
+                             return B.CreateFPToSI(B.CreateFMul(X, ConstantFP::get(X->getType(), 65536.0)),
+                                                   B.getInt32Ty());
+                           });
+  EXPECT_EQ(vectorizeBoundaryConversions(M), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_EQ(countStores(F), 0U);
+
+  CallInst *Call = findCall(F);
+  ASSERT_NE(Call, nullptr);
+  EXPECT_EQ(Call->getCalledFunction()->getName(), "taffo_fixm_to_fixed_f32_s32");
+  EXPECT_EQ(Call->getParent(), &F->getEntryBlock());
+  EXPECT_EQ(Call->getArgOperand(0), F->getArg(0));
+  EXPECT_EQ(Call->getArgOperand(1), F->getArg(1));
+  EXPECT_EQ(cast<ConstantFP>(Call->getArgOperand(3))->getValueAPF().convertToFloat(), 65536.0f);
+}
+
+
+TEST_F(BoundaryConversionsTest, FromFixed) {
+  Function *F = createLoop("f", Type::getInt16Ty(Context), Type::getDoubleTy(Context), 1,
+                           [](IRBuilder<> &B, Value *X) {
+                             return B.CreateFDiv(B.CreateUIToFP(X, B.getDoubleTy()),
+                                                 ConstantFP::get(B.getDoubleTy(), 256.0));
+                           });
+  EXPECT_EQ(vectorizeBoundaryConversions(M), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  CallInst *Call = findCall(F);
+  ASSERT_NE(Call, nullptr);
+  EXPECT_EQ(Call->getCalledFunction()->getName(), "taffo_fixm_from_fixed_u16_f64");
+  EXPECT_EQ(cast<ConstantFP>(Call->getArgOperand(3))->getValueAPF().convertToDouble(), 1.0 / 256.0);
+}
+
+
+TEST_F(BoundaryConversionsTest, Unchanged) {
+  auto ToFixed = [](IRBuilder<> &B, Value *X) { return B.CreateFPToSI(X, B.getInt64Ty()); };
+  Function *Strided = createLoop("strided", Type::getDoubleTy(Context), Type::getInt64Ty(Context), 2, ToFixed);
+  Function *Call = createLoop("call", Type::getDoubleTy(Context), Type::getInt64Ty(Context), 1, ToFixed, true);
+  /* the division by 3 has no exact inverse */
+  Function *Div = createLoop("div", Type::getFloatTy(Context), Type::getInt32Ty(Context), 1,
+                             [](IRBuilder<> &B, Value *X) {
+                               return B.CreateFPToSI(B.CreateFDiv(X, ConstantFP::get(X->getType(), 3.0)),
+                                                     B.getInt32Ty());
+                             });
+  EXPECT_EQ(vectorizeBoundaryConversions(M), 0U);
+  EXPECT_EQ(countStores(Strided), 1U);
+  EXPECT_EQ(countStores(Call), 1U);
+  EXPECT_EQ(countStores(Div), 1U);
+}
+
+}
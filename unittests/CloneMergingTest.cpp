@@ -0,0 +1,170 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include "CloneMerging.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class CloneMergingTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Type *I32;
+  Function *Orig;
+
+  CloneMergingTest() : M("test", Context) {
+    I32 = Type::getInt32Ty(Context);
+    Orig = Function::Create(FunctionType::get(Type::getDoubleTy(Context), {Type::getDoubleTy(Context)}, false),
+                            GlobalValue::ExternalLinkage, "f", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Orig));
+    B.CreateRet(B.CreateFMul(Orig->getArg(0), ConstantFP::get(Type::getDoubleTy(Context), 3.0)));
+  }
+
+  ~CloneMergingTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  /* int Name(int x) { return x << Shift; }, cloned from f */
+  Function *createClone(StringRef Name, unsigned Shift,
+                        GlobalValue::LinkageTypes Linkage = GlobalValue::InternalLinkage) {
+    Function *F = Function::Create(FunctionType::get(I32, {I32}, false), Linkage, Name, &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    B.CreateRet(B.CreateShl(F->getArg(0), Shift));
+    F->setMetadata(SOURCE_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Orig)));
+    return F;
+  }
+
+  /* int Name(int x) { return Callee(x) + 1; } */
+  Function *createCaller(StringRef Name, Function *Callee) {
+    Function *F = Function::Create(FunctionType::get(I32, {I32}, false), GlobalValue::InternalLinkage, Name, &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    B.CreateRet(B.CreateAdd(B.CreateCall(Callee, {F->getArg(0)}), B.getInt32(1)));
+    F->setMetadata(SOURCE_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Orig)));
+    return F;
+  }
+
+  /* calls each function of Fs */
+  Function *createMain(ArrayRef<Function *> Fs) {
+    Function *Main = Function::Create(FunctionType::get(I32, false), GlobalValue::ExternalLinkage, "main", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Main));
+    Value *Sum = B.getInt32(0);
+    for (Function *F : Fs)
+      Sum = B.CreateAdd(Sum, B.CreateCall(F, {B.getInt32(2)}));
+    B.CreateRet(Sum);
+    return Main;
+  }
+};
+
+
+TEST_F(CloneMergingTest, IsClone) {
+  EXPECT_FALSE(isTaffoClone(*Orig));
+  EXPECT_TRUE(isTaffoClone(*createClone("f.1", 1)));
+  EXPECT_EQ(estimateCodeSize(*Orig), 8U);
+  EXPECT_EQ(estimateCodeSize(*Orig, 2), 4U);
+}
+
+TEST_F(CloneMergingTest, Merge) {
+  Function *F1 = createClone("f.1", 4);
+  Function *F2 = createClone("f.2", 4);
+  Function *F3 = createClone("f.3", 5);
+  Function *Main = createMain({F1, F2, F3});
+
+  std::vector<MergedClone> Merged = mergeEquivalentClones(M);
+  ASSERT_EQ(Merged.size(), 1U);
+  EXPECT_EQ(Merged[0].Name, "f.2");
+  EXPECT_EQ(Merged[0].Into, "f.1");
+  EXPECT_EQ(Merged[0].Bytes, 8U);
+  EXPECT_EQ(M.getFunction("f.2"), nullptr);
+  EXPECT_EQ(M.getFunction("f.3"), F3);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  unsigned CallsToF1 = 0;
+  for (Instruction &I : Main->getEntryBlock()) {
+    if (auto *Call = dyn_cast<CallInst>(&I))
+      CallsToF1 += Call->getCalledFunction() == F1;
+  }
+  EXPECT_EQ(CallsToF1, 2U);
+}
+
+TEST_F(CloneMergingTest, MergeCallers) {
+  Function *F1 = createClone("f.1", 4);
+  Function *F2 = createClone("f.2", 4);
+  Function *G1 = createCaller("g.1", F1);
+  Function *G2 = createCaller("g.2", F2);
+  createMain({G1, G2});
+
+  /* g.1 and g.2 are only the same once f.2 is merged */
+  std::vector<MergedClone> Merged = mergeEquivalentClones(M);
+  ASSERT_EQ(Merged.size(), 2U);
+  EXPECT_EQ(M.getFunction("f.2"), nullptr);
+  EXPECT_EQ(M.getFunction("g.2"), nullptr);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  std::string Report;
+  raw_string_ostream OS(Report);
+  writeCloneMergeReport(Merged, OS);
+  OS.flush();
+  EXPECT_NE(Report.find("\"into\": \"g.1\""), std::string::npos);
+  EXPECT_NE(Report.find("\"bytes\": 20"), std::string::npos);
+}
+
+TEST_F(CloneMergingTest, KeepExternal) {
+  Function *F1 = createClone("f.1", 4);
+  Function *F2 = createClone("f.2", 4, GlobalValue::ExternalLinkage);
+  createMain({F1, F2});
+  /* f.2 may be called from other modules, but f.1 can be merged into it */
+  std::vector<MergedClone> Merged = mergeEquivalentClones(M);
+  ASSERT_EQ(Merged.size(), 1U);
+  EXPECT_EQ(Merged[0].Name, "f.1");
+  EXPECT_EQ(Merged[0].Into, "f.2");
+}
+
+TEST_F(CloneMergingTest, KeepAddressTaken) {
+  Function *F1 = createClone("f.1", 4);
+  Function *F2 = createClone("f.2", 4);
+  Function *F3 = createClone("f.3", 4);
+  Function *Main = createMain({F1, F2, F3});
+  /* the addresses of f.2 and f.3 are stored, but only the one of f.2 may
+   * be compared */
+  auto *Table = new GlobalVariable(M, ArrayType::get(F2->getType(), 2), true, GlobalValue::ExternalLinkage,
+                                   ConstantArray::get(ArrayType::get(F2->getType(), 2), {F2, F3}), "table");
+  F3->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+
+  std::vector<MergedClone> Merged = mergeEquivalentClones(M);
+  ASSERT_EQ(Merged.size(), 2U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_EQ(M.getFunction("f.3"), nullptr);
+  EXPECT_EQ(Table->getInitializer()->getOperand(1), F1);
+
+  /* f.2 is kept as a thunk, and its direct calls now call f.1 */
+  ASSERT_EQ(M.getFunction("f.2"), F2);
+  EXPECT_EQ(Table->getInitializer()->getOperand(0), F2);
+  EXPECT_TRUE(F2->hasLocalLinkage());
+  auto *Call = dyn_cast<CallInst>(&F2->getEntryBlock().front());
+  ASSERT_TRUE(Call && Call->isTailCall());
+  EXPECT_EQ(Call->getCalledFunction(), F1);
+  EXPECT_EQ(Call->getArgOperand(0), F2->getArg(0));
+  EXPECT_EQ(Merged[0].Name, "f.2");
+  EXPECT_EQ(Merged[0].Bytes, 0U);
+  for (Instruction &I : Main->getEntryBlock()) {
+    if (auto *Call = dyn_cast<CallInst>(&I)) {
+      EXPECT_EQ(Call->getCalledFunction(), F1);
+    }
+  }
+
+  /* the thunk is not merged again */
+  EXPECT_TRUE(mergeEquivalentClones(M).empty());
+}
+
+}
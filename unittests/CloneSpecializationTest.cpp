@@ -0,0 +1,95 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "CloneSpecialization.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class CloneSpecializationTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Function *Orig;
+  Function *Clone;
+  SmallVector<CallInst *, 4> Calls;
+
+  /* double f(double); its clone with the range [-100, 100], called by
+   * main on 0.5, 50 and 0.75 */
+  CloneSpecializationTest() : M("test", Context) {
+    Type *Ty = Type::getDoubleTy(Context);
+    FunctionType *FTy = FunctionType::get(Ty, {Ty}, false);
+    Orig = Function::Create(FTy, GlobalValue::ExternalLinkage, "f", &M);
+    Clone = Function::Create(FTy, GlobalValue::InternalLinkage, "f.1", &M);
+    for (Function *F : {Orig, Clone}) {
+      IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+      B.CreateRet(B.CreateFMul(F->getArg(0), F->getArg(0)));
+    }
+    Clone->setMetadata(ORIGINAL_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Orig)));
+    Orig->setMetadata(CLONED_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Clone)));
+    InputInfo II(std::make_shared<FPType>(-32, 24), std::make_shared<Range>(-100.0, 100.0), nullptr);
+    MDInfo *ArgInfos[] = {&II};
+    MetadataManager::setArgumentInputInfoMetadata(*Clone, ArgInfos);
+
+    Function *Main = Function::Create(FunctionType::get(Ty, false),
+                                      GlobalValue::ExternalLinkage, "main", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Main));
+    Value *Sum = ConstantFP::get(Ty, 0.0);
+    for (double V : {0.5, 50.0, 0.75}) {
+      Calls.push_back(B.CreateCall(Clone, {ConstantFP::get(Ty, V)}));
+      Sum = B.CreateFAdd(Sum, Calls.back());
+    }
+    B.CreateRet(Sum);
+  }
+
+  ~CloneSpecializationTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+};
+
+
+TEST_F(CloneSpecializationTest, Signature) {
+  EXPECT_EQ(getCallRangeSignature(*Calls[0]), getCallRangeSignature(*Calls[2]));
+  EXPECT_NE(getCallRangeSignature(*Calls[0]), getCallRangeSignature(*Calls[1]));
+  std::shared_ptr<Range> R = getCallSiteRange(Calls[1]->getArgOperand(0));
+  ASSERT_NE(R, nullptr);
+  EXPECT_EQ(R->Min, 50.0);
+  EXPECT_EQ(R->Max, 50.0);
+}
+
+TEST_F(CloneSpecializationTest, Specialize) {
+  EXPECT_EQ(specializeClonesOnCallRanges(M, 1), 0U);
+  EXPECT_EQ(specializeClonesOnCallRanges(M, 4), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  /* the two calls in [0.5, 0.75] share the new clone */
+  Function *Spec = Calls[0]->getCalledFunction();
+  EXPECT_NE(Spec, Clone);
+  EXPECT_EQ(Calls[2]->getCalledFunction(), Spec);
+  EXPECT_EQ(Calls[1]->getCalledFunction(), Clone);
+  EXPECT_NE(Spec->getMetadata(ORIGINAL_FUN_METADATA), nullptr);
+  EXPECT_EQ(Orig->getMetadata(CLONED_FUN_METADATA)->getNumOperands(), 2U);
+
+  SmallVector<MDInfo *, 1> ArgInfos;
+  MetadataManager::getMetadataManager().retrieveArgumentInputInfo(*Spec, ArgInfos);
+  ASSERT_EQ(ArgInfos.size(), 1U);
+  InputInfo *II = dyn_cast_or_null<InputInfo>(ArgInfos[0]);
+  ASSERT_NE(II, nullptr);
+  ASSERT_NE(II->IRange, nullptr);
+  EXPECT_EQ(II->IRange->Min, 0.5);
+  EXPECT_EQ(II->IRange->Max, 0.75);
+
+  /* each function is now called with a single signature */
+  EXPECT_EQ(specializeClonesOnCallRanges(M, 4), 0U);
+}
+
+}
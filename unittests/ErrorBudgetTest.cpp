@@ -0,0 +1,151 @@
+#include <cmath>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "ErrorBudget.h"
+#include "ErrorSummaries.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class ErrorBudgetTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Type *Ty;
+  Instruction *X;
+  Instruction *Mul;
+  Instruction *Add;
+  Instruction *Div;
+
+  /* double g in [0, 4], h in [-1, 1];
+   * void main() { out = g * 3.0 + g; other = (g * 3.0 + g) / h; }
+   * with all the values in Q15.16 */
+  ErrorBudgetTest() : M("test", Context) {
+    Ty = Type::getDoubleTy(Context);
+    auto *G = new GlobalVariable(M, Ty, false, GlobalValue::InternalLinkage, ConstantFP::get(Ty, 1.0), "g");
+    auto *H = new GlobalVariable(M, Ty, false, GlobalValue::InternalLinkage, ConstantFP::get(Ty, 1.0), "h");
+    setInfo(*G, 0.0, 4.0);
+    setInfo(*H, -1.0, 1.0);
+
+    Function *Main = Function::Create(FunctionType::get(Type::getVoidTy(Context), false),
+                                      GlobalValue::ExternalLinkage, "main", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Main));
+    AllocaInst *Out = B.CreateAlloca(Ty, nullptr, "out");
+    AllocaInst *Other = B.CreateAlloca(Ty, nullptr, "other");
+    X = B.CreateLoad(Ty, G);
+    Mul = cast<Instruction>(B.CreateFMul(X, ConstantFP::get(Ty, 3.0)));
+    Add = cast<Instruction>(B.CreateFAdd(Mul, X));
+    B.CreateStore(Add, Out);
+    Instruction *Y = B.CreateLoad(Ty, H);
+    Div = cast<Instruction>(B.CreateFDiv(Add, Y));
+    B.CreateStore(Div, Other);
+    B.CreateRetVoid();
+    setInfo(*Out, 0.0, 16.0);
+    setInfo(*Other, -1e6, 1e6);
+    setInfo(*X, 0.0, 4.0);
+    setInfo(*Mul, 0.0, 12.0);
+    setInfo(*Add, 0.0, 16.0);
+    setInfo(*Y, -1.0, 1.0);
+    setInfo(*Div, -1e6, 1e6);
+    MetadataManager::setTargetMetadata(*Out, "out");
+    MetadataManager::setTargetMetadata(*Other, "other");
+  }
+
+  ~ErrorBudgetTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  template <typename T>
+  void setInfo(T &V, double Min, double Max) {
+    InputInfo II(std::make_shared<FPType>(-32, 16), std::make_shared<Range>(Min, Max), nullptr, true);
+    MetadataManager::setInputInfoMetadata(V, II);
+  }
+
+  const FPType *getType(Instruction *I) {
+    return cast<FPType>(MetadataManager::getMetadataManager().retrieveInputInfo(*I)->IType.get());
+  }
+
+  double getTargetError(StringRef Target) {
+    SummaryErrorPropagation P(M);
+    P.run(1);
+    return P.getTargetErrors()[Target.str()];
+  }
+};
+
+
+TEST_F(ErrorBudgetTest, Parse) {
+  ErrorBudget Budget;
+  std::string Error;
+  EXPECT_TRUE(std::isinf(Budget.get("out")));
+  ASSERT_TRUE(Budget.parse("1e-3", Error)) << Error;
+  ASSERT_TRUE(Budget.parse("out=0.5", Error)) << Error;
+  EXPECT_EQ(Budget.get("out"), 0.5);
+  EXPECT_EQ(Budget.get("other"), 1e-3);
+  EXPECT_FALSE(Budget.parse("out=", Error));
+  EXPECT_FALSE(Budget.parse("-1", Error));
+}
+
+TEST_F(ErrorBudgetTest, Sensitivities) {
+  auto S = computeErrorSensitivities(M);
+  ASSERT_EQ(S.size(), 2U);
+  const auto &Out = S["out"];
+  EXPECT_DOUBLE_EQ(Out.lookup(Add), 1.0);
+  EXPECT_DOUBLE_EQ(Out.lookup(Mul), 1.0);
+  /* through the product by 3 */
+  EXPECT_DOUBLE_EQ(Out.lookup(X), 3.0);
+  EXPECT_FALSE(Out.count(Div));
+  /* the divisor may be zero */
+  EXPECT_TRUE(std::isinf(S["other"].lookup(Add)));
+  EXPECT_DOUBLE_EQ(S["other"].lookup(Div), 1.0);
+}
+
+TEST_F(ErrorBudgetTest, Allocate) {
+  ErrorBudget Budget;
+  std::string Error;
+  ASSERT_TRUE(Budget.parse("out=1e-3", Error));
+  unsigned Changed;
+  ASSERT_TRUE(allocateTypesForErrorBudget(M, Budget, Changed));
+  EXPECT_EQ(Changed, 2U);
+  /* 2 instructions with sensitivity 1 need 2^-f <= 1e-3 / 2 */
+  EXPECT_EQ(getType(Mul)->getWidth(), 16U);
+  EXPECT_GE(getType(Mul)->getPointPos(), 11U);
+  EXPECT_EQ(getType(Add)->getWidth(), 16U);
+  EXPECT_GE(getType(Add)->getPointPos(), 11U);
+  EXPECT_EQ(getType(Div)->getWidth(), 32U);
+  EXPECT_LE(getTargetError("out"), 1e-3);
+}
+
+TEST_F(ErrorBudgetTest, Unbounded) {
+  ErrorBudget Budget;
+  std::string Error;
+  ASSERT_TRUE(Budget.parse("1e-3", Error));
+  unsigned Changed;
+  /* the error of other is unbounded because of the divisor, so its
+   * budget cannot be met and all the types are kept */
+  EXPECT_FALSE(allocateTypesForErrorBudget(M, Budget, Changed));
+  EXPECT_EQ(Changed, 0U);
+  EXPECT_EQ(getType(Mul)->getWidth(), 32U);
+  EXPECT_EQ(getType(Add)->getWidth(), 32U);
+}
+
+TEST_F(ErrorBudgetTest, NotMet) {
+  ErrorBudget Budget;
+  std::string Error;
+  ASSERT_TRUE(Budget.parse("out=1e-30", Error));
+  unsigned Changed;
+  EXPECT_FALSE(allocateTypesForErrorBudget(M, Budget, Changed));
+  EXPECT_EQ(Changed, 0U);
+  EXPECT_EQ(getType(Mul)->getWidth(), 32U);
+  EXPECT_EQ(getType(Mul)->getPointPos(), 16U);
+}
+
+}
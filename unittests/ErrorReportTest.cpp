@@ -0,0 +1,107 @@
+#include <cmath>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/JSON.h"
+#include "gtest/gtest.h"
+#include "ErrorReport.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class ErrorReportTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+
+  ErrorReportTest() : M("test", Context) {}
+
+  ~ErrorReportTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  json::Value report() {
+    std::string Text;
+    raw_string_ostream OS(Text);
+    writeErrorReport(M, OS);
+    Expected<json::Value> V = json::parse(OS.str());
+    EXPECT_TRUE((bool)V);
+    return V ? *V : json::Value(nullptr);
+  }
+};
+
+
+TEST_F(ErrorReportTest, Report) {
+  /* double g; void f(double x) { g = x * 2.0; if (g < 1.0) ...; x + 1.0 } */
+  Type *Ty = Type::getDoubleTy(Context);
+  auto *G = new GlobalVariable(M, Ty, false, GlobalValue::InternalLinkage,
+                               ConstantFP::get(Ty, 0.0), "g");
+  InputInfo II(nullptr, std::make_shared<Range>(0.0, 1.0), std::make_shared<double>(0.125), true);
+  MetadataManager::setInputInfoMetadata(*G, II);
+  MetadataManager::setTargetMetadata(*G, "out");
+
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Context), {Ty}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  auto *Mul = cast<Instruction>(B.CreateFMul(F->getArg(0), ConstantFP::get(Ty, 2.0)));
+  B.CreateStore(Mul, G);
+  auto *Cmp = cast<Instruction>(B.CreateFCmpOLT(Mul, ConstantFP::get(Ty, 1.0)));
+  auto *Add = cast<Instruction>(B.CreateFAdd(F->getArg(0), ConstantFP::get(Ty, 1.0)));
+  B.CreateRetVoid();
+  MetadataManager::setErrorMetadata(*Mul, 0.5);
+  MetadataManager::setErrorMetadata(*Add, INFINITY);
+  MetadataManager::setTargetMetadata(*Add, "sum");
+  MetadataManager::setCmpErrorMetadata(*Cmp, CmpErrorInfo(0.25));
+
+  json::Value V = report();
+  json::Object *R = V.getAsObject();
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->getInteger("version"), Optional<int64_t>(1));
+
+  json::Array *Targets = R->getArray("targets");
+  ASSERT_TRUE(Targets);
+  ASSERT_EQ(Targets->size(), 2U);
+  json::Object *Out = (*Targets)[0].getAsObject();
+  EXPECT_EQ(Out->getString("name"), Optional<StringRef>("out"));
+  /* the error stored to g is larger than the initial one */
+  EXPECT_EQ(Out->getNumber("error"), Optional<double>(0.5));
+  json::Object *Sum = (*Targets)[1].getAsObject();
+  EXPECT_EQ(Sum->getString("name"), Optional<StringRef>("sum"));
+  ASSERT_TRUE(Sum->get("error"));
+  EXPECT_EQ(Sum->get("error")->kind(), json::Value::Null);
+
+  json::Array *Cmps = R->getArray("comparisons");
+  ASSERT_TRUE(Cmps);
+  ASSERT_EQ(Cmps->size(), 1U);
+  json::Object *C = (*Cmps)[0].getAsObject();
+  EXPECT_EQ(C->getString("function"), Optional<StringRef>("f"));
+  EXPECT_EQ(C->getInteger("instruction"), Optional<int64_t>(2));
+  EXPECT_EQ(C->getNumber("max_tolerance"), Optional<double>(0.25));
+  EXPECT_EQ(C->getBoolean("may_be_wrong"), Optional<bool>(true));
+
+  json::Array *Functions = R->getArray("functions");
+  ASSERT_TRUE(Functions);
+  ASSERT_EQ(Functions->size(), 1U);
+  json::Object *FR = (*Functions)[0].getAsObject();
+  EXPECT_EQ(FR->getString("name"), Optional<StringRef>("f"));
+  EXPECT_EQ(FR->get("max_error")->kind(), json::Value::Null);
+  EXPECT_EQ(FR->getInteger("instructions"), Optional<int64_t>(2));
+}
+
+TEST_F(ErrorReportTest, Empty) {
+  json::Value V = report();
+  json::Object *R = V.getAsObject();
+  ASSERT_TRUE(R);
+  EXPECT_TRUE(R->getArray("targets")->empty());
+  EXPECT_TRUE(R->getArray("comparisons")->empty());
+  EXPECT_TRUE(R->getArray("functions")->empty());
+}
+
+}
@@ -0,0 +1,197 @@
+#include <climits>
+#include <cmath>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "gtest/gtest.h"
+#include "ErrorSummaries.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class ErrorSummariesTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Type *Ty;
+  GlobalVariable *G;
+  Function *F;
+  Function *Main;
+  Instruction *Mul;
+  Instruction *Add;
+  SmallVector<CallInst *, 2> Calls;
+
+  /* double g = input with error 2^-10, in [0, 10];
+   * double f(double x) { return x * 0.5 + 0.25; }
+   * double main() { return f(g) + f(g); }
+   * with the values of f in Q15.16 */
+  ErrorSummariesTest() : M("test", Context) {
+    Ty = Type::getDoubleTy(Context);
+    G = new GlobalVariable(M, Ty, false, GlobalValue::InternalLinkage,
+                           ConstantFP::get(Ty, 1.0), "g");
+    setInfo(*G, -10.0, 10.0, std::ldexp(1.0, -10));
+
+    F = Function::Create(FunctionType::get(Ty, {Ty}, false), GlobalValue::InternalLinkage, "f", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    Mul = cast<Instruction>(B.CreateFMul(F->getArg(0), ConstantFP::get(Ty, 0.5)));
+    Add = cast<Instruction>(B.CreateFAdd(Mul, ConstantFP::get(Ty, 0.25)));
+    B.CreateRet(Add);
+    setInfo(*Mul, -5.0, 5.0);
+    setInfo(*Add, -5.0, 6.0);
+    InputInfo ArgInfo(std::make_shared<FPType>(-32, 16), std::make_shared<Range>(-10.0, 10.0), nullptr, true);
+    MDInfo *ArgInfos[] = {&ArgInfo};
+    MetadataManager::setArgumentInputInfoMetadata(*F, ArgInfos);
+
+    Main = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage, "main", &M);
+    B.SetInsertPoint(BasicBlock::Create(Context, "entry", Main));
+    for (unsigned I = 0; I < 2; I++)
+      Calls.push_back(B.CreateCall(F, {B.CreateLoad(Ty, G)}));
+    B.CreateRet(B.CreateFAdd(Calls[0], Calls[1]));
+  }
+
+  ~ErrorSummariesTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  template <typename T>
+  void setInfo(T &V, double Min, double Max, double Error = 0.0) {
+    InputInfo II(std::make_shared<FPType>(-32, 16), std::make_shared<Range>(Min, Max),
+                 Error > 0.0 ? std::make_shared<double>(Error) : nullptr, true);
+    MetadataManager::setInputInfoMetadata(V, II);
+  }
+};
+
+
+TEST_F(ErrorSummariesTest, Signature) {
+  EXPECT_EQ(getErrorSignature(0.0), INT_MIN);
+  EXPECT_EQ(getErrorSignature(INFINITY), INT_MAX);
+  EXPECT_EQ(getErrorSignature(0.25), -2);
+  EXPECT_EQ(getErrorSignature(0.3), -1);
+  EXPECT_EQ(getSignatureError(-2), 0.25);
+  EXPECT_EQ(getSignatureError(INT_MIN), 0.0);
+  EXPECT_TRUE(std::isinf(getSignatureError(INT_MAX)));
+}
+
+TEST_F(ErrorSummariesTest, Propagation) {
+  SummaryErrorPropagation P(M);
+  P.run(2);
+  /* main, and f for the error of g, shared by both calls */
+  EXPECT_EQ(P.getNumSummaries(), 2U);
+
+  double Q = std::ldexp(1.0, -16);
+  const ErrorSummary &FS = P.getSummary(*F, {std::ldexp(1.0, -10)});
+  /* 0.5 and 0.25 are exact in Q15.16; the operations truncate */
+  EXPECT_DOUBLE_EQ(FS.Values.lookup(Mul), std::ldexp(1.0, -11) + Q);
+  EXPECT_DOUBLE_EQ(FS.Values.lookup(Add), std::ldexp(1.0, -11) + 2 * Q);
+  ASSERT_TRUE(FS.Return.hasValue());
+  EXPECT_DOUBLE_EQ(*FS.Return, std::ldexp(1.0, -11) + 2 * Q);
+
+  const ErrorSummary &MS = P.getSummary(*Main, {});
+  EXPECT_DOUBLE_EQ(MS.Values.lookup(Calls[1]), *FS.Return);
+  EXPECT_EQ(P.getNumSummaries(), 2U);
+
+  /* a larger argument error */
+  EXPECT_DOUBLE_EQ(*P.getSummary(*F, {0.5}).Return, 0.25 + 2 * Q);
+  EXPECT_EQ(P.getNumSummaries(), 3U);
+}
+
+TEST_F(ErrorSummariesTest, Loop) {
+  /* double acc() { double s = 0; for (int i = 0; i < 100; i++) s += g; return s; } */
+  Type *IntTy = Type::getInt32Ty(Context);
+  Function *Acc = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage, "acc", &M);
+  BasicBlock *Entry = BasicBlock::Create(Context, "entry", Acc);
+  BasicBlock *Loop = BasicBlock::Create(Context, "loop", Acc);
+  BasicBlock *Exit = BasicBlock::Create(Context, "exit", Acc);
+  IRBuilder<> B(Entry);
+  B.CreateBr(Loop);
+  B.SetInsertPoint(Loop);
+  PHINode *I = B.CreatePHI(IntTy, 2);
+  PHINode *S = B.CreatePHI(Ty, 2);
+  Instruction *Next = cast<Instruction>(B.CreateFAdd(S, B.CreateLoad(Ty, G)));
+  Value *NextI = B.CreateNSWAdd(I, ConstantInt::get(IntTy, 1));
+  B.CreateCondBr(B.CreateICmpSLT(NextI, ConstantInt::get(IntTy, 100)), Loop, Exit);
+  I->addIncoming(ConstantInt::get(IntTy, 0), Entry);
+  I->addIncoming(NextI, Loop);
+  S->addIncoming(ConstantFP::get(Ty, 0.0), Entry);
+  S->addIncoming(Next, Loop);
+  B.SetInsertPoint(Exit);
+  B.CreateRet(Next);
+  setInfo(*S, -1000.0, 1000.0);
+  setInfo(*Next, -1000.0, 1000.0);
+
+  SummaryErrorPropagation P(M);
+  const ErrorSummary &AS = P.getSummary(*Acc, {});
+  /* bounded by the trip count instead of unbounded */
+  double Step = std::ldexp(1.0, -10) + std::ldexp(1.0, -16);
+  EXPECT_DOUBLE_EQ(AS.Values.lookup(S), 100 * Step);
+  EXPECT_DOUBLE_EQ(*AS.Return, 101 * Step);
+}
+
+TEST_F(ErrorSummariesTest, AnnotateAndTargets) {
+  MetadataManager::setTargetMetadata(*Calls[0], "out");
+  SummaryErrorPropagation P(M);
+  P.run(1);
+  EXPECT_EQ(P.annotate(), 2U);
+  double Expected = std::ldexp(1.0, -11) + std::ldexp(1.0, -15);
+  EXPECT_DOUBLE_EQ(MetadataManager::retrieveErrorMetadata(*Add), Expected);
+
+  std::string Report;
+  raw_string_ostream OS(Report);
+  P.printTargetErrors(OS);
+  EXPECT_EQ(OS.str().rfind("Computed error for target out: ", 0), 0U);
+  EXPECT_DOUBLE_EQ(std::stod(OS.str().substr(31)), Expected);
+}
+
+TEST_F(ErrorSummariesTest, Cache) {
+  SmallString<128> Path;
+  ASSERT_FALSE(sys::fs::createTemporaryFile("err-cache", "txt", Path));
+  std::string Error;
+  {
+    SummaryErrorPropagation P(M);
+    P.run(1);
+    ASSERT_TRUE(P.saveCache(Path, Error)) << Error;
+  }
+  {
+    SummaryErrorPropagation P(M);
+    EXPECT_EQ(P.loadCache(Path), 2U);
+    P.run(2);
+    EXPECT_EQ(P.getNumReused(), 2U);
+    EXPECT_DOUBLE_EQ(P.getSummary(*F, {std::ldexp(1.0, -10)}).Values.lookup(Add),
+                     std::ldexp(1.0, -11) + std::ldexp(1.0, -15));
+  }
+
+  /* a new type in main: f is reused */
+  Instruction *Sum = cast<Instruction>(Main->getEntryBlock().getTerminator()->getOperand(0));
+  setInfo(*Sum, -20.0, 20.0);
+  {
+    SummaryErrorPropagation P(M);
+    P.loadCache(Path);
+    P.run(1);
+    EXPECT_EQ(P.getNumReused(), 1U);
+    EXPECT_DOUBLE_EQ(P.getSummary(*Main, {}).Values.lookup(Sum),
+                     std::ldexp(1.0, -10) + 5 * std::ldexp(1.0, -16));
+    ASSERT_TRUE(P.saveCache(Path, Error)) << Error;
+  }
+
+  /* a new type in f: its error changes, so main is propagated again */
+  InputInfo II(std::make_shared<FPType>(-32, 8), std::make_shared<Range>(-5.0, 5.0), nullptr, true);
+  MetadataManager::setInputInfoMetadata(*Mul, II);
+  SummaryErrorPropagation P(M);
+  P.loadCache(Path);
+  P.run(1);
+  EXPECT_EQ(P.getNumReused(), 0U);
+  double Expected = std::ldexp(1.0, -11) + std::ldexp(1.0, -8) + std::ldexp(1.0, -16);
+  EXPECT_DOUBLE_EQ(*P.getSummary(*F, {std::ldexp(1.0, -10)}).Return, Expected);
+  EXPECT_DOUBLE_EQ(P.getSummary(*Main, {}).Values.lookup(Sum), 2 * Expected + std::ldexp(1.0, -16));
+  sys::fs::remove(Path);
+}
+
+}
@@ -0,0 +1,95 @@
+#include <cmath>
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "FixedMathCalls.h"
+#include "TaffoFixedMath.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+TEST(FixedMathCallsTest, Lookup) {
+  ASSERT_NE(getFixedMathFunction("sin"), nullptr);
+  EXPECT_STREQ(getFixedMathFunction("sin")->RuntimeName, "taffo_fixm_sin");
+  EXPECT_EQ(getFixedMathFunction("sinf"), getFixedMathFunction("sin"));
+  EXPECT_EQ(getFixedMathFunction("llvm.sqrt.f64"), getFixedMathFunction("sqrt"));
+  EXPECT_EQ(getFixedMathFunction("logl"), getFixedMathFunction("log"));
+  EXPECT_EQ(getFixedMathFunction("pow"), nullptr);
+  EXPECT_EQ(getFixedMathFunction("cosh"), nullptr);
+  EXPECT_TRUE(isFixedMathType(FPType(-32, 31)));
+  EXPECT_FALSE(isFixedMathType(FPType(32, 16)));
+  EXPECT_FALSE(isFixedMathType(FPType(-64, 32)));
+}
+
+TEST(FixedMathCallsTest, CreateCall) {
+  LLVMContext Context;
+  Module M("test", Context);
+  Type *I16 = Type::getInt16Ty(Context);
+  Function *F = Function::Create(FunctionType::get(I16, {I16}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  Value *R = createFixedMathCall(B, *getFixedMathFunction("cos"), F->getArg(0),
+                                 FPType(-16, 12), FPType(-16, 14));
+  ASSERT_NE(R, nullptr);
+  EXPECT_EQ(R->getType(), I16);
+  B.CreateRet(R);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  Function *Decl = M.getFunction("taffo_fixm_cos");
+  ASSERT_NE(Decl, nullptr);
+  EXPECT_TRUE(Decl->doesNotAccessMemory());
+
+  EXPECT_EQ(createFixedMathCall(B, *getFixedMathFunction("cos"), F->getArg(0),
+                                FPType(-16, 12), FPType(-64, 14)), nullptr);
+}
+
+/* Largest error of Fn over N arguments in [Lo, Hi], relative to the error
+ * bound declared for it */
+double relativeError(const char *Name, int32_t (*Fn)(int32_t, int32_t, int32_t),
+                     double (*Ref)(double), unsigned FracIn, unsigned FracOut,
+                     double Lo, double Hi) {
+  const FixedMathFunction *Desc = getFixedMathFunction(Name);
+  EXPECT_NE(Desc, nullptr);
+  FPType TRes(-32, FracOut);
+  double Worst = 0.0;
+  const int N = 4000;
+  for (int I = 0; I < N; I++) {
+    double V = Lo + (Hi - Lo) * I / (N - 1);
+    int32_t X = (int32_t)std::llround(std::ldexp(V, FracIn));
+    double Exact = Ref(std::ldexp((double)X, -(int)FracIn));
+    /* the saturated results are not checked */
+    if (std::abs(std::ldexp(Exact, FracOut)) >= 2147483647.0)
+      continue;
+    double Got = std::ldexp((double)Fn(X, FracIn, FracOut), -(int)FracOut);
+    double Bound = getFixedMathError(*Desc, TRes, Range(Exact, Exact));
+    Worst = std::max(Worst, std::abs(Got - Exact) / Bound);
+  }
+  return Worst;
+}
+
+TEST(FixedMathCallsTest, Accuracy) {
+  const unsigned Formats[][2] = {{0, 30}, {8, 24}, {16, 30}, {20, 16}, {24, 8}, {28, 30}, {31, 31}};
+  for (auto &Fmt : Formats) {
+    unsigned FI = Fmt[0], FO = Fmt[1];
+    double Max = std::min(std::ldexp(1.0, 30 - FI), 1e4);
+    SCOPED_TRACE(testing::Message() << "frac_in " << FI << ", frac_out " << FO);
+    EXPECT_LE(relativeError("sin", taffo_fixm_sin, [](double V) { return std::sin(V); }, FI, FO, -Max, Max), 1.0);
+    EXPECT_LE(relativeError("cos", taffo_fixm_cos, [](double V) { return std::cos(V); }, FI, FO, -Max, Max), 1.0);
+    EXPECT_LE(relativeError("exp", taffo_fixm_exp, [](double V) { return std::exp(V); }, FI, FO, std::max(-Max, -25.0), std::min(Max, 25.0)), 1.0);
+    EXPECT_LE(relativeError("log", taffo_fixm_log, [](double V) { return std::log(V); }, FI, FO, std::ldexp(1.0, -(int)FI), Max), 1.0);
+    EXPECT_LE(relativeError("sqrt", taffo_fixm_sqrt, [](double V) { return std::sqrt(V); }, FI, FO, 0.0, Max), 1.0);
+  }
+  /* saturation and domain */
+  EXPECT_EQ(taffo_fixm_exp(30 << 16, 16, 16), INT32_MAX);
+  EXPECT_EQ(taffo_fixm_exp(-(30 << 16), 16, 16), 0);
+  EXPECT_EQ(taffo_fixm_log(0, 16, 16), INT32_MIN);
+  EXPECT_EQ(taffo_fixm_sqrt(-1, 16, 16), 0);
+}
+
+}
@@ -0,0 +1,109 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "FixedPointArith.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class FixedPointArithTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  /* without an insertion point the builder folds the constants */
+  IRBuilder<> B;
+
+  FixedPointArithTest() : B(Context) {}
+
+  Constant *fix(const FPType &T, int64_t V) {
+    return ConstantInt::get(Type::getIntNTy(Context, T.getWidth()), V, T.isSigned());
+  }
+
+  int64_t value(Value *V, const FPType &T) {
+    ConstantInt *C = dyn_cast<ConstantInt>(V);
+    EXPECT_NE(C, nullptr);
+    if (!C)
+      return 0;
+    EXPECT_EQ(C->getType()->getIntegerBitWidth(), T.getWidth());
+    return T.isSigned() ? C->getSExtValue() : (int64_t)C->getZExtValue();
+  }
+};
+
+
+TEST_F(FixedPointArithTest, Mul) {
+  FPType Q15(-16, 15), Q30(-32, 30), U8(8, 4), S24(-32, 8), S16(-32, 16);
+  /* 0.5 * -0.25 */
+  EXPECT_EQ(value(createFixedPointMul(B, fix(Q15, 1 << 14), Q15, fix(Q15, -(1 << 13)), Q15, Q15), Q15), -(1 << 12));
+  /* truncation towards minus infinity, and rounding */
+  EXPECT_EQ(value(createFixedPointMul(B, fix(Q15, 3), Q15, fix(Q15, -(1 << 14)), Q15, Q15), Q15), -2);
+  EXPECT_EQ(value(createFixedPointMul(B, fix(Q15, 3), Q15, fix(Q15, -(1 << 14)), Q15, Q15, true), Q15), -1);
+  EXPECT_EQ(value(createFixedPointMul(B, fix(Q15, 3), Q15, fix(Q15, 1 << 14), Q15, Q15, true), Q15), 2);
+  /* the product keeps all the fractional bits */
+  EXPECT_EQ(value(createFixedPointMul(B, fix(Q15, 3), Q15, fix(Q15, -(1 << 14)), Q15, Q30), Q30), -3 * (1 << 14));
+  /* unsigned by signed, and more fractional bits in the result */
+  EXPECT_EQ(value(createFixedPointMul(B, fix(U8, 0xF8), U8, fix(S24, -(3 << 8)), S24, S16), S16), -(93 << 15));
+  EXPECT_EQ(value(createFixedPointMul(B, fix(U8, 0x18), U8, fix(S24, -(3 << 8)), S24, S24), S24), -(9 << 7));
+}
+
+TEST_F(FixedPointArithTest, Div) {
+  FPType Q15(-16, 15), S16(-32, 16), U8(8, 4), U16(16, 0);
+  /* 0.25 / 0.5 */
+  EXPECT_EQ(value(createFixedPointDiv(B, fix(Q15, 1 << 13), Q15, fix(Q15, 1 << 14), Q15, Q15), Q15), 1 << 14);
+  /* -1.5 / 0.25, truncated towards zero */
+  EXPECT_EQ(value(createFixedPointDiv(B, fix(S16, -(3 << 15)), S16, fix(Q15, 1 << 13), Q15, S16), S16), -6 * (1 << 16));
+  EXPECT_EQ(value(createFixedPointDiv(B, fix(S16, -1), S16, fix(S16, 3 << 16), S16, S16), S16), 0);
+  /* an unsigned divisor with its top bit set, and more fractional bits in
+   * the divisor than in the result */
+  EXPECT_EQ(value(createFixedPointDiv(B, fix(S16, -(15 << 16)), S16, fix(U8, 0xF0), U8, U16), U16), 0xFFFF);
+  EXPECT_EQ(value(createFixedPointDiv(B, fix(U16, 60000), U16, fix(U8, 0xF0), U8, U16), U16), 4000);
+}
+
+TEST_F(FixedPointArithTest, MulAdd) {
+  FPType Q15(-16, 15), Q30(-32, 30), S8(-16, 8);
+  /* 0.5 * 0.5 + 0.25 */
+  EXPECT_EQ(value(createFixedPointMulAdd(B, fix(Q30, 1 << 28), Q30, fix(Q15, 1 << 14), Q15, fix(Q15, 1 << 14), Q15), Q30), 1 << 29);
+  /* the product is truncated towards minus infinity */
+  EXPECT_EQ(value(createFixedPointMulAdd(B, fix(Q15, 1), Q15, fix(Q15, 1 << 14), Q15, fix(Q15, 1), Q15), Q15), 1);
+  EXPECT_EQ(value(createFixedPointMulAdd(B, fix(Q15, -1), Q15, fix(Q15, 1), Q15, fix(Q15, 1), Q15), Q15), -1);
+  EXPECT_EQ(value(createFixedPointMulAdd(B, fix(Q15, 1), Q15, fix(S8, 1 << 6), S8, fix(S8, 1 << 7), S8), Q15), (1 << 12) + 1);
+  /* more fractional bits in the accumulator than in the product */
+  EXPECT_EQ(value(createFixedPointMulAdd(B, fix(Q30, 1), Q30, fix(S8, 1 << 6), S8, fix(S8, 1 << 7), S8), Q30), (1 << 27) + 1);
+}
+
+TEST_F(FixedPointArithTest, Vector) {
+  FPType Q15(-16, 15);
+  Type *Ty = VectorType::get(Type::getInt16Ty(Context), 8, false);
+  Module M("test", Context);
+  Function *F = Function::Create(FunctionType::get(Ty, {Ty, Ty}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> FB(BasicBlock::Create(Context, "entry", F));
+
+  Value *R = createFixedPointMul(FB, F->getArg(0), Q15, F->getArg(1), Q15, Q15, true);
+  EXPECT_EQ(R->getType(), Ty);
+  /* Q15 products are computed in 32 bit lanes */
+  unsigned Muls = 0;
+  for (Instruction &I : F->getEntryBlock()) {
+    if (I.getOpcode() != Instruction::Mul)
+      continue;
+    Muls++;
+    EXPECT_EQ(I.getType(), VectorType::get(Type::getInt32Ty(Context), 8, false));
+  }
+  EXPECT_EQ(Muls, 1U);
+
+  /* the lanes of constant vectors are folded independently */
+  Constant *A = ConstantVector::get({fix(Q15, 1 << 14), fix(Q15, 3)});
+  Constant *C = ConstantVector::get({fix(Q15, -(1 << 13)), fix(Q15, -(1 << 14))});
+  Value *P = createFixedPointMul(B, A, Q15, C, Q15, Q15, true);
+  Constant *PC = dyn_cast<Constant>(P);
+  ASSERT_NE(PC, nullptr);
+  EXPECT_EQ(value(PC->getAggregateElement(0U), Q15), -(1 << 12));
+  EXPECT_EQ(value(PC->getAggregateElement(1U), Q15), -1);
+}
+
+}
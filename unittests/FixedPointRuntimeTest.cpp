@@ -0,0 +1,82 @@
+#include "gtest/gtest.h"
+#include "InputInfo.h"
+#include "TaffoFixedPoint.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace taffo;
+
+
+/* the formats of the runtime have the bounds and the names of the FPTypes */
+template <class Fixp> void expectSameAsFPType() {
+  FPType T(Fixp::width, Fixp::point_pos, Fixp::is_signed);
+  EXPECT_EQ(Fixp::name(), T.toString());
+  EXPECT_EQ(Fixp::min().toDouble(), T.getMinValueBound());
+  EXPECT_EQ(Fixp::max().toDouble(), T.getMaxValueBound());
+  EXPECT_EQ(Fixp::epsilon().toDouble(), T.getRoundingError());
+}
+
+TEST(FixedPointRuntimeTest, Formats) {
+  expectSameAsFPType<sfixp<16, 16>>();
+  expectSameAsFPType<ufixp<2, 6>>();
+  expectSameAsFPType<fixp<20, 12, true>>();
+  expectSameAsFPType<fixp<48, 40, false>>();
+  EXPECT_EQ((sfixp<16, 16>::name()), "s16_16fixp");
+  static_assert(sizeof(fixp<20, 12>::storage_type) == 4, "20 bits are stored in 32");
+  static_assert(sfixp<3, 5>::fromDouble(1.5).bits() == 48, "the conversions are constexpr");
+}
+
+TEST(FixedPointRuntimeTest, Conversions) {
+  typedef sfixp<4, 4> S8;
+  typedef ufixp<4, 4> U8;
+  typedef sfixp<8, 8> S16;
+  typedef fixp<64, 0> S64;
+  EXPECT_EQ(S8::fromDouble(1.3).bits(), 20);
+  EXPECT_EQ(S8::fromDouble(-1.3).bits(), -20);
+  EXPECT_EQ(S8::fromDouble(100.0), S8::max());
+  EXPECT_EQ(S8::fromDouble(-100.0), S8::min());
+  EXPECT_EQ(S8::fromDouble(NAN).bits(), 0);
+  EXPECT_EQ(U8::fromDouble(-1.0).bits(), 0);
+  EXPECT_EQ(S64::fromDouble(1e300), S64::max());
+
+  /* the point moves like in the shifts of the converted code */
+  EXPECT_EQ(S8::fromDouble(-1.25).convert<S16>().toDouble(), -1.25);
+  EXPECT_EQ(S16::fromDouble(1.7).convert<S8>().toDouble(), 1.6875);
+  EXPECT_EQ(S16::fromDouble(9.0).convert<S8>().toDouble(), -7.0);
+}
+
+TEST(FixedPointRuntimeTest, Arithmetic) {
+  typedef sfixp<16, 16> S32;
+  S32 A = S32::fromDouble(2.5), B = S32::fromDouble(-1.25);
+  EXPECT_EQ((A + B).toDouble(), 1.25);
+  EXPECT_EQ((A - B).toDouble(), 3.75);
+  EXPECT_EQ((A * B).toDouble(), -3.125);
+  EXPECT_EQ((A / B).toDouble(), -2.0);
+  EXPECT_EQ((-A).toDouble(), -2.5);
+  EXPECT_LT(B, A);
+
+  /* the results wrap around in Width bits, not in the storage */
+  typedef fixp<12, 4, true> S12;
+  EXPECT_EQ((S12::max() + S12::epsilon()), S12::min());
+  EXPECT_EQ((S12::fromDouble(100.0) * S12::fromDouble(2.0)).toDouble(), 200.0 - 256.0);
+  typedef fixp<40, 20, true> S40;
+  EXPECT_EQ((S40::fromDouble(1000.5) * S40::fromDouble(-2.0)).toDouble(), -2001.0);
+}
+
+TEST(FixedPointRuntimeTest, Arrays) {
+  typedef sfixp<8, 8> S16;
+  const float In[] = {0.5f, -3.75f, 1000.0f, 0.001f};
+  int16_t Bits[4];
+  float Out[4];
+  toFixedArray<S16>(In, Bits, 4);
+  EXPECT_EQ(Bits[0], 128);
+  EXPECT_EQ(Bits[1], -960);
+  EXPECT_EQ(Bits[2], INT16_MAX);
+  EXPECT_EQ(Bits[3], 0);
+  fromFixedArray<S16>(Bits, Out, 4);
+  EXPECT_EQ(Out[1], -3.75f);
+  EXPECT_EQ(Out[2], S16::max().toDouble());
+}
+
+}
@@ -0,0 +1,167 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "IntegerNarrowing.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class IntegerNarrowingTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  IntegerType *I32;
+
+  IntegerNarrowingTest() : M("test", Context) {
+    I32 = Type::getInt32Ty(Context);
+  }
+
+  ~IntegerNarrowingTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  InputInfo getInfo(double Min, double Max) {
+    return InputInfo(nullptr, std::make_shared<Range>(Min, Max), nullptr);
+  }
+
+  void setRange(Instruction *I, double Min, double Max) {
+    MetadataManager::setInputInfoMetadata(*I, getInfo(Min, Max));
+  }
+};
+
+
+TEST_F(IntegerNarrowingTest, Fits) {
+  EXPECT_TRUE(fitsIntegerWidth(Range(-128.0, 127.0), 8, true));
+  EXPECT_FALSE(fitsIntegerWidth(Range(-128.0, 128.0), 8, true));
+  EXPECT_TRUE(fitsIntegerWidth(Range(0.0, 255.0), 8, false));
+  EXPECT_FALSE(fitsIntegerWidth(Range(-1.0, 255.0), 8, false));
+  EXPECT_TRUE(fitsIntegerWidth(Range(-30000.0, 30000.0), 16, true));
+  EXPECT_FALSE(fitsIntegerWidth(Range(0.0, NAN), 16, true));
+}
+
+/* static int a[4] = {1, 2, 3, 4};
+ * int f(int i, int x) {
+ *   a[2] = x;
+ *   return a[i];
+ * } */
+TEST_F(IntegerNarrowingTest, Storage) {
+  ArrayType *ArrTy = ArrayType::get(I32, 4);
+  Constant *Init = ConstantDataArray::get(Context, ArrayRef<uint32_t>({1, 2, 3, 4}));
+  auto *A = new GlobalVariable(M, ArrTy, false, GlobalValue::InternalLinkage, Init, "a");
+  MetadataManager::setInputInfoMetadata(*A, getInfo(0.0, 200.0));
+  Function *F = Function::Create(FunctionType::get(I32, {I32, I32}, false), GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  B.CreateStore(F->getArg(1), B.CreateConstInBoundsGEP2_32(ArrTy, A, 0, 2));
+  Value *Ptr = B.CreateInBoundsGEP(ArrTy, A, {B.getInt32(0), F->getArg(0)});
+  B.CreateRet(B.CreateLoad(I32, Ptr));
+
+  EXPECT_EQ(narrowIntegerStorage(M, 8), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  GlobalVariable *NewA = M.getGlobalVariable("a", true);
+  ASSERT_NE(NewA, nullptr);
+  EXPECT_EQ(NewA->getValueType(), ArrayType::get(Type::getInt8Ty(Context), 4));
+  auto *NewInit = cast<ConstantDataArray>(NewA->getInitializer());
+  EXPECT_EQ(NewInit->getElementAsInteger(3), 4U);
+  EXPECT_NE(MetadataManager::getMetadataManager().retrieveMDInfo(NewA), nullptr);
+
+  /* [0, 200] only fits in 8 unsigned bits */
+  auto *Ret = cast<ReturnInst>(F->getEntryBlock().getTerminator());
+  auto *Ext = dyn_cast<ZExtInst>(Ret->getReturnValue());
+  ASSERT_NE(Ext, nullptr);
+  EXPECT_TRUE(isa<LoadInst>(Ext->getOperand(0)));
+  unsigned Truncs = 0;
+  for (Instruction &I : instructions(F))
+    Truncs += isa<TruncInst>(&I);
+  EXPECT_EQ(Truncs, 1U);
+}
+
+TEST_F(IntegerNarrowingTest, StorageEscapes) {
+  ArrayType *ArrTy = ArrayType::get(I32, 4);
+  auto *A = new GlobalVariable(M, ArrTy, false, GlobalValue::InternalLinkage, ConstantAggregateZero::get(ArrTy), "a");
+  MetadataManager::setInputInfoMetadata(*A, getInfo(0.0, 10.0));
+  Function *G = Function::Create(FunctionType::get(Type::getVoidTy(Context), {ArrTy->getPointerTo()}, false),
+                                 GlobalValue::ExternalLinkage, "g", &M);
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Context), false), GlobalValue::ExternalLinkage,
+                                 "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  B.CreateCall(G, {A});
+  B.CreateRetVoid();
+  EXPECT_EQ(narrowIntegerStorage(M, 8), 0U);
+  EXPECT_EQ(A->getValueType(), ArrTy);
+}
+
+/* int f() {
+ *   int i = 0;
+ *   do
+ *     i = i + 1;
+ *   while (i < 16);
+ *   return i;
+ * } */
+TEST_F(IntegerNarrowingTest, Arithmetic) {
+  Function *F = Function::Create(FunctionType::get(I32, false), GlobalValue::ExternalLinkage, "f", &M);
+  BasicBlock *Entry = BasicBlock::Create(Context, "entry", F);
+  BasicBlock *Loop = BasicBlock::Create(Context, "loop", F);
+  BasicBlock *Exit = BasicBlock::Create(Context, "exit", F);
+  IRBuilder<> B(Entry);
+  B.CreateBr(Loop);
+  B.SetInsertPoint(Loop);
+  PHINode *I = B.CreatePHI(I32, 2, "i");
+  auto *Next = cast<Instruction>(B.CreateAdd(I, B.getInt32(1), "next"));
+  B.CreateCondBr(B.CreateICmpSLT(Next, B.getInt32(16)), Loop, Exit);
+  I->addIncoming(B.getInt32(0), Entry);
+  I->addIncoming(Next, Loop);
+  B.SetInsertPoint(Exit);
+  B.CreateRet(Next);
+  setRange(I, 0.0, 15.0);
+  setRange(Next, 1.0, 16.0);
+
+  /* the phi, the addition and the comparison */
+  EXPECT_EQ(narrowIntegerArithmetic(*F, 8), 3U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  auto *NewI = cast<PHINode>(&Loop->front());
+  EXPECT_EQ(NewI->getType(), Type::getInt8Ty(Context));
+  auto *Add = dyn_cast<BinaryOperator>(NewI->getIncomingValueForBlock(Loop));
+  ASSERT_NE(Add, nullptr);
+  EXPECT_EQ(Add->getOperand(0), NewI);
+  EXPECT_TRUE(Add->hasNoSignedWrap());
+  EXPECT_TRUE(Add->hasNoUnsignedWrap());
+  auto *Cmp = cast<ICmpInst>(cast<BranchInst>(Loop->getTerminator())->getCondition());
+  EXPECT_EQ(Cmp->getOperand(0), Add);
+  /* the extension of the phi is dead, the result is still returned in 32 bits */
+  auto *Ret = cast<ReturnInst>(Exit->getTerminator());
+  auto *Ext = dyn_cast<CastInst>(Ret->getReturnValue());
+  ASSERT_NE(Ext, nullptr);
+  EXPECT_EQ(Ext->getOperand(0), Add);
+  unsigned Exts = 0;
+  for (Instruction &Inst : instructions(F))
+    Exts += isa<CastInst>(&Inst);
+  EXPECT_EQ(Exts, 1U);
+}
+
+TEST_F(IntegerNarrowingTest, ArithmeticOutOfRange) {
+  Function *F = Function::Create(FunctionType::get(I32, {Type::getInt8Ty(Context)}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  Value *X = B.CreateSExt(F->getArg(0), I32);
+  auto *Mul = cast<Instruction>(B.CreateMul(X, B.getInt32(300)));
+  B.CreateRet(Mul);
+  setRange(Mul, -128.0 * 300.0, 127.0 * 300.0);
+  EXPECT_EQ(narrowIntegerArithmetic(*F, 8), 0U);
+  EXPECT_EQ(narrowIntegerArithmetic(*F, 16), 0U);
+  setRange(Mul, -128.0, 127.0);
+  /* the low 8 bits of the product only depend on the low 8 bits of 300 */
+  EXPECT_EQ(narrowIntegerArithmetic(*F, 8), 1U);
+  EXPECT_FALSE(verifyFunction(*F, &errs()));
+}
+
+}
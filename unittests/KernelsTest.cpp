@@ -0,0 +1,70 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "Kernels.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class KernelsTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+
+  KernelsTest() : M("test", Context) {}
+
+  ~KernelsTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  Function *createFunction(StringRef Name, CallingConv::ID CC) {
+    Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Context), false),
+                                   GlobalValue::ExternalLinkage, Name, &M);
+    F->setCallingConv(CC);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    B.CreateRetVoid();
+    return F;
+  }
+};
+
+
+TEST_F(KernelsTest, Target) {
+  EXPECT_FALSE(isKernelTarget(M));
+  M.setTargetTriple("spir64-unknown-unknown");
+  EXPECT_TRUE(isKernelTarget(M));
+  M.setTargetTriple("nvptx64-nvidia-cuda");
+  EXPECT_TRUE(isKernelTarget(M));
+  M.setTargetTriple("x86_64-pc-linux-gnu");
+  EXPECT_FALSE(isKernelTarget(M));
+}
+
+
+TEST_F(KernelsTest, Mark) {
+  Function *Spir = createFunction("spir", CallingConv::SPIR_KERNEL);
+  Function *Amd = createFunction("amd", CallingConv::AMDGPU_KERNEL);
+  Function *Helper = createFunction("helper", CallingConv::SPIR_FUNC);
+  Function *Cuda = createFunction("cuda", CallingConv::C);
+  Metadata *Entry[] = {ValueAsMetadata::get(Cuda), MDString::get(Context, "kernel"),
+                       ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(Context), 1))};
+  M.getOrInsertNamedMetadata("nvvm.annotations")->addOperand(MDNode::get(Context, Entry));
+
+  EXPECT_TRUE(isKernel(*Spir));
+  EXPECT_TRUE(isKernel(*Cuda));
+  EXPECT_FALSE(isKernel(*Helper));
+  EXPECT_EQ(markKernelEntryPoints(M), 3U);
+  EXPECT_TRUE(MetadataManager::isStartingPoint(*Amd));
+  EXPECT_TRUE(MetadataManager::isStartingPoint(*Cuda));
+  EXPECT_FALSE(MetadataManager::isStartingPoint(*Helper));
+  /* already marked */
+  EXPECT_EQ(markKernelEntryPoints(M), 0U);
+}
+
+}
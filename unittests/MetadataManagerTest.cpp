@@ -0,0 +1,242 @@
+#include <thread>
+#include <vector>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+
+
+class MetadataManagerTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  std::vector<GlobalVariable *> Globals;
+
+  MetadataManagerTest() : M("test", Context) {
+    MetadataManager::getMetadataManager().clearCache();
+    Type *Ty = Type::getDoubleTy(Context);
+    for (int i = 0; i < 256; i++) {
+      GlobalVariable *GV = new GlobalVariable(M, Ty, false,
+          GlobalValue::ExternalLinkage, ConstantFP::get(Ty, i));
+      /* some globals share the same (uniqued) range metadata */
+      InputInfo II(std::make_shared<FPType>(32, 16),
+                   std::make_shared<Range>(0.0, (double)(i % 32)),
+                   nullptr, true);
+      MetadataManager::setInputInfoMetadata(*GV, II);
+      Globals.push_back(GV);
+    }
+  }
+
+  ~MetadataManagerTest() {
+    MetadataManager::getMetadataManager().clearCache();
+  }
+};
+
+
+TEST_F(MetadataManagerTest, ConcurrentRetrieve) {
+  const unsigned NumThreads = 8;
+  std::vector<std::vector<InputInfo *>> Results(NumThreads);
+  std::vector<std::thread> Threads;
+  for (unsigned t = 0; t < NumThreads; t++) {
+    Threads.emplace_back([this, t, &Results]() {
+      MetadataManager &MM = MetadataManager::getMetadataManager();
+      /* each thread visits the globals in a different order */
+      for (unsigned i = 0; i < Globals.size(); i++) {
+        GlobalVariable *GV = Globals[(i * (2 * t + 1)) % Globals.size()];
+        Results[t].push_back(MM.retrieveInputInfo(*GV));
+      }
+    });
+  }
+  for (std::thread &T : Threads)
+    T.join();
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  for (unsigned t = 0; t < NumThreads; t++) {
+    for (unsigned i = 0; i < Globals.size(); i++) {
+      unsigned g = (i * (2 * t + 1)) % Globals.size();
+      InputInfo *II = Results[t][i];
+      ASSERT_NE(II, nullptr);
+      /* all the threads must observe the same cached object */
+      EXPECT_EQ(II, MM.retrieveInputInfo(*Globals[g]));
+      ASSERT_NE(II->IRange, nullptr);
+      EXPECT_EQ(II->IRange->Max, (double)(g % 32));
+      ASSERT_NE(II->IType, nullptr);
+      EXPECT_EQ(cast<FPType>(II->IType.get())->getPointPos(), 16U);
+    }
+  }
+}
+
+
+TEST_F(MetadataManagerTest, EmitSharesNodes) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  InputInfo A(std::make_shared<FPType>(32, 16),
+              std::make_shared<Range>(-1.0, 1.0), nullptr, true);
+  InputInfo B(std::make_shared<FPType>(32, 16),
+              std::make_shared<Range>(-1.0, 1.0), nullptr, true);
+  InputInfo C(std::make_shared<FPType>(32, 16),
+              std::make_shared<Range>(-1.0, 1.0), nullptr, false);
+  MDCacheStats Before = MM.getCacheStats();
+  MDNode *NA = MM.emitMDInfo(Context, A);
+  EXPECT_EQ(NA, MM.emitMDInfo(Context, B));
+  EXPECT_NE(NA, MM.emitMDInfo(Context, C));
+  /* seeding the caches is not an access */
+  EXPECT_EQ(MM.getCacheStats().Hits, Before.Hits);
+  EXPECT_EQ(MM.getCacheStats().Misses, Before.Misses);
+
+  /* the decoded InputInfo is the one seeded when the node was built */
+  Globals[0]->setMetadata(INPUT_INFO_METADATA, NA);
+  InputInfo *II = MM.retrieveInputInfo(*Globals[0]);
+  EXPECT_EQ(MM.getCacheStats().Misses, Before.Misses);
+  ASSERT_NE(II, nullptr);
+  ASSERT_NE(II->IType, nullptr);
+  EXPECT_EQ(cast<FPType>(II->IType.get())->getPointPos(), 16U);
+  ASSERT_NE(II->IRange, nullptr);
+  EXPECT_EQ(II->IRange->Min, -1.0);
+  EXPECT_TRUE(II->IEnableConversion);
+}
+
+
+TEST_F(MetadataManagerTest, ReleaseContext) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  for (GlobalVariable *GV : Globals)
+    MM.retrieveInputInfo(*GV);
+  MDCacheStats Before = MM.getCacheStats();
+  EXPECT_GT(Before.Entries, 0U);
+  EXPECT_GT(Before.Hits, 0U);
+
+  /* the entries of an unrelated context are kept */
+  LLVMContext Other;
+  Module OtherM("other", Other);
+  GlobalVariable *OtherGV = new GlobalVariable(OtherM, Type::getDoubleTy(Other),
+      false, GlobalValue::ExternalLinkage, ConstantFP::get(Type::getDoubleTy(Other), 1.0));
+  MetadataManager::setInputInfoMetadata(*OtherGV,
+      InputInfo(std::make_shared<FPType>(32, 8), nullptr, nullptr, true));
+  ASSERT_NE(MM.retrieveInputInfo(*OtherGV), nullptr);
+  uint64_t OtherEntries = MM.getCacheStats().Entries - Before.Entries;
+  EXPECT_GT(OtherEntries, 0U);
+
+  MM.releaseModule(M);
+  EXPECT_EQ(MM.getCacheStats().Entries, OtherEntries);
+  MM.releaseContext(Other);
+  EXPECT_EQ(MM.getCacheStats().Entries, 0U);
+
+  /* the released metadata is converted again on demand */
+  InputInfo *II = MM.retrieveInputInfo(*Globals[1]);
+  ASSERT_NE(II, nullptr);
+  EXPECT_EQ(II->IRange->Max, 1.0);
+}
+
+
+TEST_F(MetadataManagerTest, ReleaseAfterDestroyedContext) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  for (GlobalVariable *GV : Globals)
+    MM.retrieveInputInfo(*GV);
+  uint64_t Entries = MM.getCacheStats().Entries;
+
+  /* the nodes of a context destroyed without releasing it are freed, and
+   * must not be accessed by the release of another context */
+  {
+    LLVMContext Dead;
+    Module DeadM("dead", Dead);
+    GlobalVariable *DeadGV = new GlobalVariable(DeadM, Type::getDoubleTy(Dead),
+        false, GlobalValue::ExternalLinkage, ConstantFP::get(Type::getDoubleTy(Dead), 1.0));
+    MetadataManager::setInputInfoMetadata(*DeadGV,
+        InputInfo(std::make_shared<FPType>(32, 8), std::make_shared<Range>(0.0, 1.0), nullptr, true));
+    ASSERT_NE(MM.retrieveInputInfo(*DeadGV), nullptr);
+  }
+  uint64_t DeadEntries = MM.getCacheStats().Entries - Entries;
+  EXPECT_GT(DeadEntries, 0U);
+
+  MM.releaseModule(M);
+  EXPECT_EQ(MM.getCacheStats().Entries, DeadEntries);
+}
+
+TEST_F(MetadataManagerTest, FunctionBatch) {
+  Type *Ty = Type::getDoubleTy(Context);
+  Function *F = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  Value *A = B.CreateFMul(F->getArg(0), F->getArg(0));
+  Value *S = B.CreateFAdd(A, A);
+  B.CreateRet(S);
+
+  InputInfo II(nullptr, std::make_shared<Range>(0.0, 4.0), nullptr, true);
+  StructInfo SI(2);
+  MetadataManager::setFunctionMDInfoMetadata(*F, {&II, nullptr, &SI});
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  SmallVector<MDInfo *, 4> Infos;
+  MM.retrieveFunctionMDInfo(*F, Infos);
+  ASSERT_EQ(Infos.size(), 3U);
+  ASSERT_NE(Infos[0], nullptr);
+  EXPECT_EQ(cast<InputInfo>(Infos[0])->IRange->Max, 4.0);
+  EXPECT_EQ(Infos[0], MM.retrieveMDInfo(A));
+  EXPECT_EQ(Infos[1], nullptr);
+  ASSERT_NE(Infos[2], nullptr);
+  EXPECT_TRUE(isa<StructInfo>(Infos[2]));
+}
+
+
+
+TEST_F(MetadataManagerTest, FloatTypeRoundTrip) {
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  InputInfo II(std::make_shared<FloatType>(FloatType::Float_bfloat),
+               std::make_shared<Range>(-2.0, 2.0), nullptr, true);
+  MetadataManager::setInputInfoMetadata(*Globals[0], II);
+  InputInfo *Res = MM.retrieveInputInfo(*Globals[0]);
+  ASSERT_NE(Res, nullptr);
+  ASSERT_NE(Res->IType, nullptr);
+  EXPECT_TRUE(*Res->IType == *II.IType);
+  EXPECT_FALSE(*Res->IType == FloatType(FloatType::Float_half));
+  EXPECT_FALSE(*Res->IType == FPType(16, 8));
+}
+
+TEST_F(MetadataManagerTest, AnnotationCache) {
+  AnnotationCache &Cache = MetadataManager::getMetadataManager().getAnnotationCache();
+  unsigned Parsed = 0;
+  auto Parse = [&](StringRef Text, ParsedAnnotation &Out, std::string &Error) {
+    Parsed++;
+    if (!Text.startswith("scalar(")) {
+      Error = "unknown data type pattern";
+      return false;
+    }
+    Out.Info = std::make_shared<InputInfo>(nullptr, std::make_shared<Range>(0.0, 1.0), nullptr);
+    Out.Target = std::string("t");
+    return true;
+  };
+
+  std::string Error;
+  MDCacheStats Before = Cache.getStats();
+  std::shared_ptr<const ParsedAnnotation> A = Cache.get("scalar(range(0, 1))", Parse, Error);
+  ASSERT_NE(A, nullptr);
+  EXPECT_EQ(Cache.get("scalar(range(0, 1))", Parse, Error), A);
+  EXPECT_EQ(Parsed, 1U);
+  EXPECT_EQ(*A->Target, "t");
+
+  /* each value gets its own copy */
+  std::unique_ptr<MDInfo> Copy = A->instantiate();
+  cast<InputInfo>(Copy.get())->IRange->Max = 2.0;
+  EXPECT_EQ(cast<InputInfo>(A->Info.get())->IRange->Max, 1.0);
+
+  /* the errors are reported at each use */
+  EXPECT_EQ(Cache.get("struct[", Parse, Error), nullptr);
+  EXPECT_EQ(Error, "unknown data type pattern");
+  EXPECT_EQ(Cache.get("struct[", Parse, Error), nullptr);
+  EXPECT_EQ(Parsed, 3U);
+
+  MDCacheStats After = Cache.getStats();
+  EXPECT_EQ(After.Hits - Before.Hits, 1U);
+  EXPECT_EQ(After.Misses - Before.Misses, 3U);
+  MetadataManager::getMetadataManager().clearCache();
+  EXPECT_EQ(Cache.getStats().Entries, 0U);
+}
+
+}
@@ -4,6 +4,7 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "gtest/gtest.h"
+#include <set>
 #include "MultiValueMap.h"
 
 namespace {
@@ -337,5 +338,115 @@ TEST_F(MultiValueMapTest, RAUWCallback) {
   ASSERT_EQ(F->second, 20);
 }
 
+TEST_F(MultiValueMapTest, StableValueAddresses) {
+  MultiValueMap<Value *, std::string> VVMap;
+  std::vector<Value *> Keys;
+  std::vector<std::string *> Addrs;
+  for (int I = 0; I < 300; I++) {
+    Keys.push_back(ConstantInt::get(Type::getInt32Ty(Context), I + 1));
+    VVMap.push_back(Keys.back(), std::to_string(I));
+    Addrs.push_back(&VVMap[Keys.back()]);
+  }
+  /* erasing the even keys frees slots which the new keys reuse */
+  for (int I = 0; I < 300; I += 2)
+    VVMap.erase(Keys[I]);
+  for (int I = 300; I < 400; I++)
+    VVMap.push_back(ConstantInt::get(Type::getInt32Ty(Context), I + 1), std::to_string(I));
+  for (int I = 1; I < 300; I += 2) {
+    ASSERT_EQ(&VVMap[Keys[I]], Addrs[I]);
+    ASSERT_EQ(VVMap[Keys[I]], std::to_string(I));
+  }
+  ASSERT_EQ(VVMap.size(), 250U);
+
+  VVMap.clear();
+  ASSERT_TRUE(VVMap.empty());
+  VVMap.push_back(Keys[0], "again");
+  ASSERT_EQ(VVMap.lookup(Keys[0]), "again");
+}
+
+TEST_F(MultiValueMapTest, ReserveOnNonEmptyMap) {
+  MultiValueMap<Value *, int> VVMap;
+  std::vector<Value *> Keys;
+  Keys.push_back(ConstantInt::get(Type::getInt32Ty(Context), 1));
+  VVMap.push_back(Keys.back(), 0);
+  /* the reserved memory must not overlap the partially used slab */
+  VVMap.reserve(100);
+  for (int I = 1; I <= 200; I++) {
+    Keys.push_back(ConstantInt::get(Type::getInt32Ty(Context), I + 1));
+    VVMap.push_back(Keys.back(), I);
+  }
+  std::set<int *> Addrs;
+  for (unsigned I = 0; I < Keys.size(); I++) {
+    ASSERT_EQ(VVMap[Keys[I]], (int)I);
+    ASSERT_TRUE(Addrs.insert(&VVMap[Keys[I]]).second);
+  }
+  ASSERT_EQ(VVMap.size(), Keys.size());
+  unsigned Pos = 0;
+  for (auto P: VVMap)
+    ASSERT_EQ(P.first, Keys[Pos++]);
+}
+
+TEST_F(MultiValueMapTest, RepeatedInsertionAtSamePosition) {
+  MultiValueMap<Value *, int> VVMap;
+  Value *First = ConstantInt::get(Type::getInt32Ty(Context), 1);
+  Value *Last = ConstantInt::get(Type::getInt32Ty(Context), 2);
+  VVMap.push_back(First, 0);
+  VVMap.push_back(Last, 0);
+  /* each key is inserted right before Last, well beyond the number of
+   * times the initial gap between First and Last can be halved */
+  std::vector<Value *> Keys = {First};
+  for (int I = 0; I < 2000; I++) {
+    Value *K = ConstantInt::get(Type::getInt32Ty(Context), I + 3);
+    VVMap.insert(VVMap.find(Last), K, I);
+    Keys.push_back(K);
+  }
+  Keys.push_back(Last);
+  
+  unsigned Pos = 0;
+  for (auto P: VVMap)
+    ASSERT_EQ(P.first, Keys[Pos++]);
+  for (unsigned I = 1; I < Keys.size(); I++) {
+    ASSERT_TRUE(VVMap.comesBefore(Keys[I - 1], Keys[I]));
+    ASSERT_FALSE(VVMap.comesBefore(Keys[I], Keys[I - 1]));
+    ASSERT_TRUE(VVMap.find(Keys[I - 1]) < VVMap.find(Keys[I]));
+  }
+  ASSERT_TRUE(VVMap.comesBefore(First, Last));
+}
+
+
+TEST_F(MultiValueMapTest, BulkConstruction) {
+  std::vector<std::pair<Value *, int>> Pairs;
+  for (int I = 0; I < 500; I++)
+    Pairs.push_back({ConstantInt::get(Type::getInt32Ty(Context), I + 1), I});
+  /* duplicate keys keep the first value */
+  Pairs.push_back({Pairs[10].first, -1});
+  
+  MultiValueMap<Value *, int> VVMap;
+  VVMap.reserve(Pairs.size());
+  VVMap.push_back(this->SubV.get(), 1000);
+  VVMap.assign(Pairs.begin(), Pairs.end());
+  ASSERT_EQ(VVMap.size(), 500U);
+  ASSERT_EQ(VVMap.count(this->SubV.get()), 0U);
+  
+  /* appending a range keeps the order, also with the single insertions */
+  std::vector<std::pair<Value *, int>> More;
+  for (int I = 500; I < 600; I++)
+    More.push_back({ConstantInt::get(Type::getInt32Ty(Context), I + 1), I});
+  VVMap.insert(VVMap.end(), More.begin(), More.end());
+  VVMap.insert(VVMap.find(Pairs[0].first), {this->SubV.get(), -2});
+  
+  ASSERT_EQ(VVMap.size(), 601U);
+  auto It = VVMap.begin();
+  ASSERT_EQ(It->first, this->SubV.get());
+  ++It;
+  for (int I = 0; I < 600; I++, ++It) {
+    Value *K = I < 500 ? Pairs[I].first : More[I - 500].first;
+    ASSERT_EQ(It->first, K);
+    ASSERT_EQ(It->second, I);
+  }
+  ASSERT_EQ(It, VVMap.end());
+  ASSERT_TRUE(VVMap.comesBefore(Pairs[499].first, More[0].first));
+}
+
 
 }
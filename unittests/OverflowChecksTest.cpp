@@ -0,0 +1,126 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "OverflowChecks.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class OverflowChecksTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Function *F;
+  Instruction *Add;
+  Instruction *Trunc;
+  Instruction *Sub;
+
+  /* i32 f(i32 a, i32 b, i64 w), converted to fixed point with 16
+   * fractional bits: the sum is stored to the target out, the truncation
+   * of w is returned; the subtraction has no fixed point type */
+  OverflowChecksTest() : M("test", Context) {
+    Type *I32 = Type::getInt32Ty(Context);
+    Type *I64 = Type::getInt64Ty(Context);
+    GlobalVariable *Out = new GlobalVariable(M, I32, false, GlobalValue::InternalLinkage,
+                                             ConstantInt::get(I32, 0), "out");
+    MetadataManager::setTargetMetadata(*Out, "out");
+    F = Function::Create(FunctionType::get(I32, {I32, I32, I64}, false),
+                         GlobalValue::ExternalLinkage, "f", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    Add = cast<Instruction>(B.CreateAdd(F->getArg(0), F->getArg(1), "add"));
+    B.CreateStore(Add, Out);
+    Trunc = cast<Instruction>(B.CreateTrunc(F->getArg(2), I32, "trunc"));
+    Sub = cast<Instruction>(B.CreateSub(Trunc, F->getArg(0), "sub"));
+    B.CreateRet(B.CreateXor(Sub, Trunc));
+
+    auto FixP = std::make_shared<FPType>(32, 16, true);
+    for (Instruction *I : {Add, Trunc})
+      MetadataManager::setInputInfoMetadata(*I, InputInfo(FixP, std::make_shared<Range>(-1.0, 1.0), nullptr));
+  }
+
+  ~OverflowChecksTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  unsigned countCalls(const Function &Fn, StringRef Name) {
+    unsigned N = 0;
+    for (const BasicBlock &BB : Fn)
+      for (const Instruction &I : BB)
+        if (auto *Call = dyn_cast<CallInst>(&I))
+          N += Call->getCalledFunction() && Call->getCalledFunction()->getName().startswith(Name);
+    return N;
+  }
+};
+
+
+TEST_F(OverflowChecksTest, MayOverflow) {
+  EXPECT_TRUE(mayOverflow(*Add));
+  EXPECT_TRUE(mayOverflow(*Trunc));
+  EXPECT_FALSE(mayOverflow(*Sub));
+  EXPECT_EQ(getCheckLocation(*Add), "f, instruction 0");
+}
+
+
+TEST_F(OverflowChecksTest, CheckAll) {
+  EXPECT_EQ(insertOverflowChecks(M, 1, false), 2U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_EQ(countCalls(*F, "llvm.sadd.with.overflow"), 1U);
+  EXPECT_EQ(countCalls(*F, "taffo_fixm_overflow"), 2U);
+
+  /* the reports are in blocks of their own */
+  CallInst *Report = nullptr;
+  for (BasicBlock &BB : *F)
+    for (Instruction &I : BB)
+      if (auto *Call = dyn_cast<CallInst>(&I))
+        if (Call->getCalledFunction()->getName() == "taffo_fixm_overflow" && !Report)
+          Report = Call;
+  ASSERT_NE(Report, nullptr);
+  EXPECT_NE(Report->getParent(), Add->getParent());
+  auto *Value = dyn_cast<BinaryOperator>(Report->getArgOperand(1));
+  ASSERT_NE(Value, nullptr);
+  EXPECT_EQ(Value->getOpcode(), Instruction::FMul);
+}
+
+
+TEST_F(OverflowChecksTest, TargetsOnly) {
+  EXPECT_EQ(insertOverflowChecks(M, 1, true), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_EQ(countCalls(*F, "llvm.sadd.with.overflow"), 1U);
+}
+
+
+TEST_F(OverflowChecksTest, Sampled) {
+  EXPECT_EQ(insertOverflowChecks(M, 100, false), 2U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  /* the checks are in the clone, called one time every 100 */
+  Function *Checked = M.getFunction("f.checked");
+  ASSERT_NE(Checked, nullptr);
+  EXPECT_EQ(countCalls(*Checked, "taffo_fixm_overflow"), 2U);
+  EXPECT_EQ(countCalls(*F, "taffo_fixm_overflow"), 0U);
+  EXPECT_EQ(countCalls(*F, "f.checked"), 1U);
+  GlobalVariable *Countdown = M.getGlobalVariable("__taffo_overflow_countdown.f", true);
+  ASSERT_NE(Countdown, nullptr);
+  EXPECT_EQ(cast<ConstantInt>(Countdown->getInitializer())->getZExtValue(), 100U);
+  /* f may run on several threads */
+  for (User *U : Countdown->users()) {
+    if (auto *Load = dyn_cast<LoadInst>(U)) {
+      EXPECT_TRUE(Load->isAtomic());
+    } else {
+      EXPECT_TRUE(cast<StoreInst>(U)->isAtomic());
+    }
+  }
+  EXPECT_EQ(Countdown->getNumUses(), 2U);
+}
+
+}
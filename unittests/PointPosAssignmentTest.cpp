@@ -0,0 +1,121 @@
+#include <cstdint>
+#include <limits>
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "PointPosAssignment.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+TEST(PointPosAssignmentTest, Solve) {
+  PointPosProblem P;
+  unsigned A = P.addValue(10, 14, 1e-3);
+  unsigned B = P.addValue(12, 16, 1e-3);
+  unsigned C = P.addValue(0, 4, 1e-3);
+  P.addEdge(A, B, 1.0);
+  P.addEdge(B, C, 0.5);
+  std::vector<int> Pos = P.solve();
+  /* A and B meet, and C pulls them down to the lowest common position */
+  EXPECT_EQ(Pos[A], 12);
+  EXPECT_EQ(Pos[B], 12);
+  EXPECT_EQ(Pos[C], 4);
+
+  /* the hot edge wins */
+  PointPosProblem Q;
+  unsigned X = Q.addValue(10, 10, 0.0);
+  unsigned Y = Q.addValue(6, 10, 1e-3);
+  unsigned Z = Q.addValue(6, 6, 0.0);
+  Q.addEdge(X, Y, 1.0);
+  Q.addEdge(Y, Z, 100.0);
+  EXPECT_EQ(Q.solve()[Y], 6);
+}
+
+TEST(PointPosAssignmentTest, Optimal) {
+  /* compare with the exhaustive search on random small problems */
+  uint32_t Seed = 12345;
+  auto Rand = [&](unsigned N) {
+    Seed = Seed * 1103515245U + 12345U;
+    return (Seed >> 16) % N;
+  };
+  for (int Iter = 0; Iter < 50; Iter++) {
+    PointPosProblem P;
+    unsigned N = 2 + Rand(3);
+    std::vector<int> Lo(N), Hi(N);
+    for (unsigned V = 0; V < N; V++) {
+      Lo[V] = Rand(6);
+      Hi[V] = Lo[V] + Rand(4);
+      P.addValue(Lo[V], Hi[V], Rand(2) * 0.01);
+    }
+    for (unsigned E = 0; E < N + 1; E++)
+      P.addEdge(Rand(N), Rand(N), 1.0 + Rand(10));
+
+    double Best = std::numeric_limits<double>::infinity();
+    std::vector<int> Pos(Lo);
+    while (true) {
+      Best = std::min(Best, P.getCost(Pos));
+      unsigned V = 0;
+      while (V < N && Pos[V] == Hi[V]) {
+        Pos[V] = Lo[V];
+        V++;
+      }
+      if (V == N)
+        break;
+      Pos[V]++;
+    }
+    std::vector<int> Sol = P.solve();
+    for (unsigned V = 0; V < N; V++) {
+      EXPECT_GE(Sol[V], Lo[V]);
+      EXPECT_LE(Sol[V], Hi[V]);
+    }
+    EXPECT_NEAR(P.getCost(Sol), Best, 1e-9);
+  }
+}
+
+TEST(PointPosAssignmentTest, Function) {
+  LLVMContext Context;
+  Module M("test", Context);
+  Type *Ty = Type::getDoubleTy(Context);
+  Function *F = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  Instruction *I1 = cast<Instruction>(B.CreateFAdd(F->getArg(0), F->getArg(0)));
+  Instruction *I2 = cast<Instruction>(B.CreateFAdd(I1, I1));
+  Instruction *I3 = cast<Instruction>(B.CreateFAdd(I2, I1));
+  B.CreateRet(I3);
+  unsigned Positions[] = {20, 18, 16};
+  Instruction *Insts[] = {I1, I2, I3};
+  for (int I = 0; I < 3; I++) {
+    MetadataManager::setInputInfoMetadata(*Insts[I], InputInfo(
+        std::make_shared<FPType>(-32, Positions[I]), std::make_shared<Range>(-1.0, 1.0),
+        nullptr, true));
+  }
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  auto PosOf = [&](Instruction *I) {
+    return cast<FPType>(MM.retrieveInputInfo(*I)->IType.get())->getPointPos();
+  };
+  /* with one bit of slack I1 gets closer to I2, which uses it twice */
+  EXPECT_EQ(minimizePointPosShifts(*F, 1), 1U);
+  EXPECT_EQ(PosOf(I1), 19U);
+  EXPECT_EQ(PosOf(I2), 18U);
+  EXPECT_EQ(PosOf(I3), 16U);
+  /* the range and the width are kept */
+  EXPECT_EQ(MM.retrieveInputInfo(*I1)->IRange->Max, 1.0);
+  EXPECT_EQ(cast<FPType>(MM.retrieveInputInfo(*I1)->IType.get())->getSWidth(), -32);
+
+  /* with enough slack there is no shift */
+  EXPECT_EQ(minimizePointPosShifts(*F, 4), 2U);
+  EXPECT_EQ(PosOf(I3), 16U);
+  EXPECT_EQ(PosOf(I1), 16U);
+  EXPECT_EQ(PosOf(I2), 16U);
+  MM.releaseContext(Context);
+}
+
+}
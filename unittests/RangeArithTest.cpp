@@ -0,0 +1,111 @@
+#include <cmath>
+#include <limits>
+#include "gtest/gtest.h"
+#include "RangeArith.h"
+
+namespace {
+
+using namespace mdutils;
+
+const double Inf = std::numeric_limits<double>::infinity();
+
+
+void expectContains(const Range &R, double Lo, double Hi) {
+  EXPECT_LE(R.Min, Lo) << R.toString();
+  EXPECT_GE(R.Max, Hi) << R.toString();
+  /* outward rounding must not widen by more than a few ulps */
+  if (std::isfinite(Lo)) {
+    EXPECT_GE(R.Min, Lo - std::abs(Lo) * 1e-14 - 1e-300) << R.toString();
+  }
+  if (std::isfinite(Hi)) {
+    EXPECT_LE(R.Max, Hi + std::abs(Hi) * 1e-14 + 1e-300) << R.toString();
+  }
+}
+
+
+TEST(RangeArithTest, Arithmetic) {
+  Range A(-1.0, 2.0), B(3.0, 4.0);
+  expectContains(rangeAdd(A, B), 2.0, 6.0);
+  expectContains(rangeSub(A, B), -5.0, -1.0);
+  expectContains(rangeMul(A, B), -4.0, 8.0);
+  expectContains(rangeDiv(A, B), -1.0 / 3.0, 2.0 / 3.0);
+
+  /* 0.1 + 0.2 is not exact: the result must contain the real sum */
+  Range S = rangeAdd(Range(0.1, 0.1), Range(0.2, 0.2));
+  EXPECT_LT(S.Min, 0.1 + 0.2);
+  EXPECT_GT(S.Max, 0.1 + 0.2);
+}
+
+
+TEST(RangeArithTest, SpecialCases) {
+  Range Full = rangeDiv(Range(1.0, 2.0), Range(-1.0, 1.0));
+  EXPECT_EQ(Full.Min, -Inf);
+  EXPECT_EQ(Full.Max, Inf);
+  Range Unb = rangeAdd(Range(-Inf, 0.0), Range(0.0, Inf));
+  EXPECT_EQ(Unb.Min, -Inf);
+  EXPECT_EQ(Unb.Max, Inf);
+  Range Z = rangeMul(Range(0.0, 0.0), Range(-Inf, Inf));
+  expectContains(Z, 0.0, 0.0);
+  Range Abs = rangeAbs(Range(-3.0, 2.0));
+  EXPECT_EQ(Abs.Min, 0.0);
+  EXPECT_EQ(Abs.Max, 3.0);
+}
+
+
+TEST(RangeArithTest, Functions) {
+  expectContains(rangeSqrt(Range(-1.0, 4.0)), 0.0, 2.0);
+  expectContains(rangeExp(Range(0.0, 1.0)), 1.0, std::exp(1.0));
+  expectContains(rangeLog(Range(1.0, std::exp(2.0))), 0.0, 2.0);
+
+  Range C = rangeCos(Range(-0.5, 0.5));
+  EXPECT_EQ(C.Max, 1.0);
+  expectContains(C, std::cos(0.5), 1.0);
+  Range S = rangeSin(Range(1.0, 5.0));
+  EXPECT_EQ(S.Max, 1.0);
+  EXPECT_EQ(S.Min, -1.0);
+  Range Small = rangeSin(Range(1e-20, 2e-20));
+  expectContains(Small, 1e-20, 2e-20);
+  Range Wide = rangeCos(Range(0.0, 100.0));
+  EXPECT_EQ(Wide.Min, -1.0);
+  EXPECT_EQ(Wide.Max, 1.0);
+}
+
+
+TEST(RangeArithTest, BatchMatchesScalar) {
+  RangeArray A, B;
+  for (int I = -20; I < 20; I++) {
+    A.push_back(Range(I * 0.7 - 1.0, I * 0.7 + 0.3));
+    B.push_back(Range(I * 0.3 - 0.1, I * 1.1 + 2.0));
+  }
+  A.push_back(Range(-Inf, 1.0));
+  B.push_back(Range(2.0, Inf));
+
+  RangeArray R;
+  auto Check = [&](Range (*Scalar)(const Range &, const Range &)) {
+    for (size_t I = 0; I < A.size(); I++) {
+      Range E = Scalar(A.get(I), B.get(I));
+      EXPECT_EQ(R.get(I).Min, E.Min);
+      EXPECT_EQ(R.get(I).Max, E.Max);
+    }
+  };
+  rangeAdd(A, B, R);
+  Check(rangeAdd);
+  rangeSub(A, B, R);
+  Check(rangeSub);
+  rangeMul(A, B, R);
+  Check(rangeMul);
+  rangeDiv(A, B, R);
+  Check(rangeDiv);
+  rangeMin(A, B, R);
+  Check(rangeMin);
+  rangeMax(A, B, R);
+  Check(rangeMax);
+  rangeUnion(A, B, R);
+  Check(rangeUnion);
+
+  /* the result may be one of the operands */
+  rangeAdd(A, B, A);
+  EXPECT_EQ(A.size(), B.size());
+}
+
+}
@@ -0,0 +1,163 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "RangeFolding.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class RangeFoldingTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+
+  RangeFoldingTest() : M("test", Context) {}
+
+  ~RangeFoldingTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  void setRange(Instruction &I, double Min, double Max) {
+    InputInfo II(nullptr, std::make_shared<Range>(Min, Max), nullptr);
+    MetadataManager::setInputInfoMetadata(I, II);
+  }
+};
+
+
+TEST_F(RangeFoldingTest, Cmp) {
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_OLT, Range(0.0, 1.0), Range(2.0, 3.0)), Optional<bool>(true));
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_UGE, Range(0.0, 1.0), Range(2.0, 3.0)), Optional<bool>(false));
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_OLE, Range(0.0, 2.0), Range(2.0, 3.0)), Optional<bool>(true));
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_OLT, Range(0.0, 2.0), Range(2.0, 3.0)), None);
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::ICMP_SGT, Range(5.0, 9.0), Range(-1.0, 4.0)), Optional<bool>(true));
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_OEQ, Range(1.0, 1.0), Range(1.0, 1.0)), Optional<bool>(true));
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_UNE, Range(0.0, 1.0), Range(2.0, 3.0)), Optional<bool>(true));
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_OEQ, Range(0.0, 1.0), Range(1.0, 3.0)), None);
+  /* unsigned comparisons of negative values */
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::ICMP_ULT, Range(-2.0, -1.0), Range(0.0, 1.0)), None);
+  EXPECT_EQ(evaluateCmpOnRanges(CmpInst::FCMP_ORD, Range(0.0, 1.0), Range(0.0, 1.0)), None);
+}
+
+/* double g;
+ * double f() {
+ *   double x = g;                // [0, 4]
+ *   double k = x * 0.0 + 2.0;    // [2, 2]
+ *   if (x < 10.0) return x * k;
+ *   return x / 3.0;
+ * } */
+TEST_F(RangeFoldingTest, Fold) {
+  Type *Ty = Type::getDoubleTy(Context);
+  auto *G = new GlobalVariable(M, Ty, false, GlobalValue::ExternalLinkage, ConstantFP::get(Ty, 1.0), "g");
+  Function *F = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage, "f", &M);
+  BasicBlock *Entry = BasicBlock::Create(Context, "entry", F);
+  BasicBlock *Then = BasicBlock::Create(Context, "then", F);
+  BasicBlock *Else = BasicBlock::Create(Context, "else", F);
+  IRBuilder<> B(Entry);
+  auto *X = B.CreateLoad(Ty, G);
+  auto *Zero = cast<Instruction>(B.CreateFMul(X, ConstantFP::get(Ty, 0.0)));
+  auto *K = cast<Instruction>(B.CreateFAdd(Zero, ConstantFP::get(Ty, 2.0)));
+  B.CreateCondBr(B.CreateFCmpOLT(X, ConstantFP::get(Ty, 10.0)), Then, Else);
+  B.SetInsertPoint(Then);
+  auto *Mul = cast<Instruction>(B.CreateFMul(X, K));
+  B.CreateRet(Mul);
+  B.SetInsertPoint(Else);
+  B.CreateRet(B.CreateFDiv(X, ConstantFP::get(Ty, 3.0)));
+  setRange(*X, 0.0, 4.0);
+  setRange(*Zero, 0.0, 0.0);
+  setRange(*K, 2.0, 2.0);
+  setRange(*Mul, 0.0, 8.0);
+
+  /* zero, k, the compare and the branch */
+  EXPECT_EQ(foldRangeConstants(*F), 4U);
+  EXPECT_FALSE(verifyFunction(*F, &errs()));
+  ASSERT_EQ(F->size(), 2U);
+  auto *Br = dyn_cast<BranchInst>(Entry->getTerminator());
+  ASSERT_TRUE(Br && Br->isUnconditional());
+  EXPECT_EQ(Br->getSuccessor(0), Then);
+  /* the load and the branch */
+  EXPECT_EQ(Entry->size(), 2U);
+  EXPECT_EQ(Mul->getOperand(1), ConstantFP::get(Ty, 2.0));
+}
+
+/* i8 a; i1 b; double *p, *q; i1 r;
+ * void f() {
+ *   r = a <u 200;    // a in [0, 100], folded
+ *   r = a == 200;    // a in [0, 255]
+ *   r = b == true;   // b in [0, 1]
+ *   r = p == q;      // both in [1, 1], the range of the pointed values
+ * } */
+TEST_F(RangeFoldingTest, UnsignedAndPointerCmp) {
+  Type *I8 = Type::getInt8Ty(Context);
+  Type *I1 = Type::getInt1Ty(Context);
+  Type *PtrTy = Type::getDoublePtrTy(Context);
+  auto Global = [&](Type *Ty, const char *Name) {
+    return new GlobalVariable(M, Ty, false, GlobalValue::ExternalLinkage, Constant::getNullValue(Ty), Name);
+  };
+  GlobalVariable *GA = Global(I8, "a"), *GB = Global(I1, "b"), *GP = Global(PtrTy, "p"),
+                 *GQ = Global(PtrTy, "q"), *GR = Global(I1, "r");
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Context), false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  auto *Small = B.CreateLoad(I8, GA);
+  auto *Full = B.CreateLoad(I8, GA);
+  auto *Bool = B.CreateLoad(I1, GB);
+  auto *P = B.CreateLoad(PtrTy, GP);
+  auto *Q = B.CreateLoad(PtrTy, GQ);
+  SmallVector<Value *, 4> Cmps = {
+    B.CreateICmpULT(Small, ConstantInt::get(I8, 200)),
+    B.CreateICmpEQ(Full, ConstantInt::get(I8, 200)),
+    B.CreateICmpEQ(Bool, ConstantInt::getTrue(Context)),
+    B.CreateICmpEQ(P, Q)
+  };
+  for (Value *Cmp : Cmps)
+    B.CreateStore(Cmp, GR);
+  B.CreateRetVoid();
+  setRange(*Small, 0.0, 100.0);
+  setRange(*Full, 0.0, 255.0);
+  setRange(*Bool, 0.0, 1.0);
+  setRange(*P, 1.0, 1.0);
+  setRange(*Q, 1.0, 1.0);
+
+  /* 200 is read as unsigned by the unsigned compare */
+  EXPECT_EQ(foldRangeConstants(*F), 1U);
+  EXPECT_FALSE(verifyFunction(*F, &errs()));
+  SmallVector<Value *, 4> Stored;
+  for (Instruction &I : instructions(*F)) {
+    if (auto *Store = dyn_cast<StoreInst>(&I))
+      Stored.push_back(Store->getValueOperand());
+  }
+  ASSERT_EQ(Stored.size(), 4U);
+  EXPECT_EQ(Stored[0], ConstantInt::getTrue(Context));
+  /* 200 and true are negative as signed numbers, and p and q may be equal */
+  EXPECT_EQ(Stored[1], Cmps[1]);
+  EXPECT_EQ(Stored[2], Cmps[2]);
+  EXPECT_EQ(Stored[3], Cmps[3]);
+}
+
+TEST_F(RangeFoldingTest, NotExact) {
+  Type *Ty = Type::getFloatTy(Context);
+  Function *F = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  auto *Mul = cast<Instruction>(B.CreateFMul(F->getArg(0), ConstantFP::get(Ty, 0.0)));
+  auto *Add = cast<Instruction>(B.CreateFAdd(Mul, ConstantFP::get(Ty, 0.1)));
+  B.CreateRet(Add);
+  /* 0.1 is not a float */
+  setRange(*Add, 0.1, 0.1);
+  setRange(*Mul, 0.0, 0.0);
+  EXPECT_EQ(foldRangeConstants(*F), 1U);
+  EXPECT_EQ(Add->getOperand(0), ConstantFP::get(Ty, 0.0));
+  EXPECT_EQ(F->getEntryBlock().getTerminator()->getOperand(0), Add);
+}
+
+}
@@ -0,0 +1,96 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "RangeGuards.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class RangeGuardsTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Function *Orig;
+  Function *Clone;
+  Function *Main;
+  CallInst *Call;
+
+  /* double f(double, double *); its clone with the range [-1, 2] on the
+   * first argument, called by main */
+  RangeGuardsTest() : M("test", Context) {
+    Type *Ty = Type::getDoubleTy(Context);
+    FunctionType *FTy = FunctionType::get(Ty, {Ty, Ty->getPointerTo()}, false);
+    Orig = Function::Create(FTy, GlobalValue::ExternalLinkage, "f", &M);
+    Clone = Function::Create(FTy, GlobalValue::InternalLinkage, "f.1", &M);
+    for (Function *F : {Orig, Clone}) {
+      IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+      B.CreateRet(F->getArg(0));
+    }
+    Clone->setMetadata(ORIGINAL_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Orig)));
+    InputInfo II(nullptr, std::make_shared<Range>(-1.0, 2.0), nullptr);
+    MDInfo *ArgInfos[] = {&II, nullptr};
+    MetadataManager::setArgumentInputInfoMetadata(*Clone, ArgInfos);
+
+    Main = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                            GlobalValue::ExternalLinkage, "main", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Main));
+    Call = B.CreateCall(Clone, {Main->getArg(0), ConstantPointerNull::get(Ty->getPointerTo())}, "r");
+    MetadataManager::setInputInfoMetadata(*Call, InputInfo(nullptr, std::make_shared<Range>(-1.0, 2.0), nullptr));
+    B.CreateRet(B.CreateFAdd(Call, Call));
+  }
+
+  ~RangeGuardsTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+};
+
+
+TEST_F(RangeGuardsTest, GuardCall) {
+  EXPECT_EQ(getOriginalFunction(*Call), Orig);
+  EXPECT_EQ(insertRangeGuards(M), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  /* the clone is called only when the argument is in range */
+  BranchInst *Br = dyn_cast<BranchInst>(Main->getEntryBlock().getTerminator());
+  ASSERT_NE(Br, nullptr);
+  ASSERT_TRUE(Br->isConditional());
+  EXPECT_EQ(Call->getParent(), Br->getSuccessor(0));
+  CallInst *Fallback = dyn_cast<CallInst>(&Br->getSuccessor(1)->front());
+  ASSERT_NE(Fallback, nullptr);
+  EXPECT_EQ(Fallback->getCalledFunction(), Orig);
+  EXPECT_EQ(Fallback->getMetadata(INPUT_INFO_METADATA), nullptr);
+  EXPECT_NE(Call->getMetadata(INPUT_INFO_METADATA), nullptr);
+
+  /* the results are merged for the users of the call */
+  ASSERT_TRUE(Call->hasOneUse());
+  PHINode *Res = dyn_cast<PHINode>(Call->user_back());
+  ASSERT_NE(Res, nullptr);
+  EXPECT_EQ(Res->getIncomingValueForBlock(Br->getSuccessor(1)), Fallback);
+
+  /* the guarded call is not guarded again */
+  EXPECT_EQ(insertRangeGuards(M), 0U);
+}
+
+TEST_F(RangeGuardsTest, NoGuard) {
+  /* constant arguments in range, and calls from the clones */
+  Call->setArgOperand(0, ConstantFP::get(Type::getDoubleTy(Context), 0.5));
+  EXPECT_FALSE(insertRangeGuard(*Call));
+  Main->setMetadata(ORIGINAL_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Orig)));
+  Call->setArgOperand(0, Main->getArg(0));
+  EXPECT_EQ(insertRangeGuards(M), 0U);
+  /* calls to functions which are not clones */
+  Call->setCalledFunction(Orig);
+  EXPECT_EQ(getOriginalFunction(*Call), nullptr);
+  EXPECT_FALSE(insertRangeGuard(*Call));
+}
+
+}
@@ -0,0 +1,325 @@
+#include <cmath>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "RangeSummaries.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class RangeSummariesTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Function *Sq;
+  Function *Set;
+  Function *Main;
+  SmallVector<CallInst *, 4> Calls;
+  LoadInst *Load;
+  PHINode *Phi;
+
+  /* double sq(double x) { return x * x; }
+   * void set(double *p, double v) { *p = v * 2; }
+   * double main() {
+   *   double x; set(&x, 3);
+   *   double s = sq(0.5) + sq(0.75) + sq(50) + x;
+   *   for (double i = 0; i < 10; i += 1) ;
+   *   return s;
+   * } */
+  RangeSummariesTest() : M("test", Context) {
+    Type *Ty = Type::getDoubleTy(Context);
+    Sq = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                          GlobalValue::InternalLinkage, "sq", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Sq));
+    B.CreateRet(B.CreateFMul(Sq->getArg(0), Sq->getArg(0)));
+
+    Set = Function::Create(FunctionType::get(Type::getVoidTy(Context), {Ty->getPointerTo(), Ty}, false),
+                           GlobalValue::InternalLinkage, "set", &M);
+    B.SetInsertPoint(BasicBlock::Create(Context, "entry", Set));
+    B.CreateStore(B.CreateFMul(Set->getArg(1), ConstantFP::get(Ty, 2.0)), Set->getArg(0));
+    B.CreateRetVoid();
+
+    Main = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage, "main", &M);
+    BasicBlock *Entry = BasicBlock::Create(Context, "entry", Main);
+    BasicBlock *Loop = BasicBlock::Create(Context, "loop", Main);
+    BasicBlock *Exit = BasicBlock::Create(Context, "exit", Main);
+    B.SetInsertPoint(Entry);
+    AllocaInst *X = B.CreateAlloca(Ty);
+    B.CreateCall(Set, {X, ConstantFP::get(Ty, 3.0)});
+    Value *Sum = ConstantFP::get(Ty, 0.0);
+    for (double V : {0.5, 0.75, 50.0}) {
+      Calls.push_back(B.CreateCall(Sq, {ConstantFP::get(Ty, V)}));
+      Sum = B.CreateFAdd(Sum, Calls.back());
+    }
+    Load = B.CreateLoad(Ty, X);
+    Sum = B.CreateFAdd(Sum, Load);
+    B.CreateBr(Loop);
+    B.SetInsertPoint(Loop);
+    Phi = B.CreatePHI(Ty, 2);
+    Value *Next = B.CreateFAdd(Phi, ConstantFP::get(Ty, 1.0));
+    Phi->addIncoming(ConstantFP::get(Ty, 0.0), Entry);
+    Phi->addIncoming(Next, Loop);
+    B.CreateCondBr(B.CreateFCmpOLT(Next, ConstantFP::get(Ty, 10.0)), Loop, Exit);
+    B.SetInsertPoint(Exit);
+    B.CreateRet(Sum);
+  }
+
+  ~RangeSummariesTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+};
+
+
+TEST_F(RangeSummariesTest, SignatureRange) {
+  Range R = getSignatureRange(2, false);
+  EXPECT_DOUBLE_EQ(R.Min, 0.0);
+  EXPECT_DOUBLE_EQ(R.Max, 4.0);
+  R = getSignatureRange(-3, true);
+  EXPECT_EQ(R.Min, -0.125);
+  EXPECT_DOUBLE_EQ(R.Max, 0.125);
+  R = getSignatureRange(INT_MIN, false);
+  EXPECT_DOUBLE_EQ(R.Max, 0.0);
+  EXPECT_TRUE(std::isinf(getSignatureRange(INT_MAX, true).Max));
+}
+
+TEST_F(RangeSummariesTest, Summaries) {
+  SummaryRangeAnalysis A(M);
+  A.run(4);
+  /* main, set, and sq for [0, 1] (shared by 0.5 and 0.75) and [0, 64] */
+  EXPECT_EQ(A.getNumSummaries(), 4U);
+
+  Range Half(0.5, 0.5), Big(50.0, 50.0);
+  const RangeSummary &Small = A.getSummary(*Sq, {&Half});
+  ASSERT_TRUE(Small.Return.hasValue());
+  EXPECT_DOUBLE_EQ(Small.Return->Min, 0.0);
+  EXPECT_DOUBLE_EQ(Small.Return->Max, 1.0);
+  EXPECT_DOUBLE_EQ(A.getSummary(*Sq, {&Big}).Return->Max, 4096.0);
+  EXPECT_EQ(A.getNumSummaries(), 4U);
+
+  Range Three(3.0, 3.0);
+  const RangeSummary &SetS = A.getSummary(*Set, {nullptr, &Three});
+  EXPECT_FALSE(SetS.Return.hasValue());
+  ASSERT_TRUE(SetS.ArgStores[0].hasValue());
+  EXPECT_DOUBLE_EQ(SetS.ArgStores[0]->Max, 8.0);
+
+  const RangeSummary &MainS = A.getSummary(*Main, {});
+  /* the store through the pointer argument of set */
+  ASSERT_TRUE(MainS.Values.count(Load));
+  EXPECT_DOUBLE_EQ(MainS.Values.lookup(Load).Max, 8.0);
+  ASSERT_TRUE(MainS.Values.count(Calls[2]));
+  EXPECT_DOUBLE_EQ(MainS.Values.lookup(Calls[2]).Max, 4096.0);
+  /* the loop counter is bounded by the trip count, which ScalarEvolution
+   * computes by evaluating the loop */
+  ASSERT_TRUE(MainS.Values.count(Phi));
+  EXPECT_DOUBLE_EQ(MainS.Values.lookup(Phi).Min, 0.0);
+  EXPECT_DOUBLE_EQ(MainS.Values.lookup(Phi).Max, 10.0);
+}
+
+TEST_F(RangeSummariesTest, Loops) {
+  /* double acc() {
+   *   double s = 0, m = 0;
+   *   for (int i = 0; i < 100; i++) {
+   *     s += 0.5; (double)i; m = fmin(m + 1, 10);
+   *   }
+   *   return s;
+   * } */
+  Type *Ty = Type::getDoubleTy(Context);
+  Type *IntTy = Type::getInt32Ty(Context);
+  Function *Acc = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage, "acc", &M);
+  BasicBlock *Entry = BasicBlock::Create(Context, "entry", Acc);
+  BasicBlock *Loop = BasicBlock::Create(Context, "loop", Acc);
+  BasicBlock *Exit = BasicBlock::Create(Context, "exit", Acc);
+  IRBuilder<> B(Entry);
+  B.CreateBr(Loop);
+  B.SetInsertPoint(Loop);
+  PHINode *I = B.CreatePHI(IntTy, 2);
+  PHINode *S = B.CreatePHI(Ty, 2);
+  PHINode *Min = B.CreatePHI(Ty, 2);
+  Value *NextS = B.CreateFAdd(S, ConstantFP::get(Ty, 0.5));
+  Value *Conv = B.CreateSIToFP(I, Ty);
+  Value *NextMin = B.CreateMinNum(B.CreateFAdd(Min, ConstantFP::get(Ty, 1.0)), ConstantFP::get(Ty, 10.0));
+  Value *NextI = B.CreateNSWAdd(I, ConstantInt::get(IntTy, 1));
+  B.CreateCondBr(B.CreateICmpSLT(NextI, ConstantInt::get(IntTy, 100)), Loop, Exit);
+  I->addIncoming(ConstantInt::get(IntTy, 0), Entry);
+  I->addIncoming(NextI, Loop);
+  S->addIncoming(ConstantFP::get(Ty, 0.0), Entry);
+  S->addIncoming(NextS, Loop);
+  Min->addIncoming(ConstantFP::get(Ty, 0.0), Entry);
+  Min->addIncoming(NextMin, Loop);
+  B.SetInsertPoint(Exit);
+  B.CreateRet(NextS);
+
+  SummaryRangeAnalysis A(M);
+  const RangeSummary &Sum = A.getSummary(*Acc, {});
+  /* bounded by the trip count instead of widened */
+  EXPECT_DOUBLE_EQ(Sum.Values.lookup(S).Min, 0.0);
+  EXPECT_DOUBLE_EQ(Sum.Values.lookup(S).Max, 50.0);
+  EXPECT_DOUBLE_EQ(Sum.Return->Max, 50.5);
+  /* the range of the induction variable */
+  EXPECT_DOUBLE_EQ(Sum.Values.lookup(Conv).Min, 0.0);
+  EXPECT_DOUBLE_EQ(Sum.Values.lookup(Conv).Max, 99.0);
+  /* widened, then narrowed */
+  EXPECT_DOUBLE_EQ(Sum.Values.lookup(Min).Max, 10.0);
+}
+
+TEST_F(RangeSummariesTest, ParallelLoops) {
+  /* double loopN() {
+   *   double s = 0;
+   *   for (int i = 0; i < N; i++) s += (double)i;
+   *   return s;
+   * }
+   * analyzed on one thread each, which only read the trip counts and the
+   * ranges of i computed beforehand */
+  Type *Ty = Type::getDoubleTy(Context);
+  Type *IntTy = Type::getInt32Ty(Context);
+  SmallVector<Instruction *, 16> Convs;
+  SmallVector<PHINode *, 16> Sums;
+  for (int N = 1; N <= 16; N++) {
+    Function *F = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage,
+                                   "loop" + Twine(N), &M);
+    BasicBlock *Entry = BasicBlock::Create(Context, "entry", F);
+    BasicBlock *Loop = BasicBlock::Create(Context, "loop", F);
+    BasicBlock *Exit = BasicBlock::Create(Context, "exit", F);
+    IRBuilder<> B(Entry);
+    B.CreateBr(Loop);
+    B.SetInsertPoint(Loop);
+    PHINode *I = B.CreatePHI(IntTy, 2);
+    PHINode *S = B.CreatePHI(Ty, 2);
+    Value *Conv = B.CreateSIToFP(I, Ty);
+    Value *NextS = B.CreateFAdd(S, Conv);
+    Value *NextI = B.CreateNSWAdd(I, ConstantInt::get(IntTy, 1));
+    B.CreateCondBr(B.CreateICmpSLT(NextI, ConstantInt::get(IntTy, N)), Loop, Exit);
+    I->addIncoming(ConstantInt::get(IntTy, 0), Entry);
+    I->addIncoming(NextI, Loop);
+    S->addIncoming(ConstantFP::get(Ty, 0.0), Entry);
+    S->addIncoming(NextS, Loop);
+    B.SetInsertPoint(Exit);
+    B.CreateRet(NextS);
+    Convs.push_back(cast<Instruction>(Conv));
+    Sums.push_back(S);
+  }
+
+  SummaryRangeAnalysis A(M);
+  A.run(16);
+  for (int N = 1; N <= 16; N++) {
+    const RangeSummary &Sum = A.getSummary(*Convs[N - 1]->getFunction(), {});
+    EXPECT_DOUBLE_EQ(Sum.Values.lookup(Convs[N - 1]).Min, 0.0);
+    EXPECT_DOUBLE_EQ(Sum.Values.lookup(Convs[N - 1]).Max, N - 1);
+    EXPECT_TRUE(Sum.Values.count(Sums[N - 1]));
+  }
+}
+
+TEST_F(RangeSummariesTest, OpenMP) {
+  /* void par() {
+   *   double a = 3, b;
+   *   #pragma omp parallel
+   *   b = a * 2;
+   *   b;
+   * } */
+  Type *Ty = Type::getDoubleTy(Context);
+  Type *IdTy = Type::getInt32PtrTy(Context);
+  FunctionType *MicroTy = FunctionType::get(Type::getVoidTy(Context), {IdTy, IdTy}, true);
+  Function *Outlined = Function::Create(FunctionType::get(Type::getVoidTy(Context), {IdTy, IdTy, Ty->getPointerTo(), Ty->getPointerTo()}, false),
+                                        GlobalValue::InternalLinkage, ".omp_outlined.", &M);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", Outlined));
+  LoadInst *Inner = B.CreateLoad(Ty, Outlined->getArg(2));
+  B.CreateStore(B.CreateFMul(Inner, ConstantFP::get(Ty, 2.0)), Outlined->getArg(3));
+  B.CreateRetVoid();
+
+  FunctionCallee Fork = M.getOrInsertFunction("__kmpc_fork_call",
+      FunctionType::get(Type::getVoidTy(Context), {Type::getInt8PtrTy(Context), Type::getInt32Ty(Context),
+                                                   MicroTy->getPointerTo()}, true));
+  Function *Par = Function::Create(FunctionType::get(Type::getVoidTy(Context), false),
+                                   GlobalValue::ExternalLinkage, "par", &M);
+  B.SetInsertPoint(BasicBlock::Create(Context, "entry", Par));
+  AllocaInst *A = B.CreateAlloca(Ty);
+  AllocaInst *Res = B.CreateAlloca(Ty);
+  B.CreateStore(ConstantFP::get(Ty, 3.0), A);
+  B.CreateCall(Fork, {ConstantPointerNull::get(Type::getInt8PtrTy(Context)), B.getInt32(1),
+                      ConstantExpr::getBitCast(Outlined, MicroTy->getPointerTo()), A, Res});
+  LoadInst *After = B.CreateLoad(Ty, Res);
+  B.CreateRetVoid();
+
+  SummaryRangeAnalysis SRA(M);
+  SRA.run(1);
+  /* the outlined function is analyzed from the fork, not as a root, for
+   * the range of b before and after its stores */
+  EXPECT_EQ(SRA.getNumSummaries(), 7U);
+  const RangeSummary &ParS = SRA.getSummary(*Par, {});
+  ASSERT_TRUE(ParS.Values.count(After));
+  EXPECT_DOUBLE_EQ(ParS.Values.lookup(After).Max, 8.0);
+  Range Three(3.0, 3.0);
+  const RangeSummary &OutlinedS = SRA.getSummary(*Outlined, {nullptr, nullptr, &Three, nullptr});
+  ASSERT_TRUE(OutlinedS.Values.count(Inner));
+  EXPECT_DOUBLE_EQ(OutlinedS.Values.lookup(Inner).Min, 0.0);
+  EXPECT_DOUBLE_EQ(OutlinedS.Values.lookup(Inner).Max, 4.0);
+  EXPECT_EQ(SRA.getNumSummaries(), 7U);
+}
+
+TEST_F(RangeSummariesTest, Cache) {
+  SmallString<128> Path;
+  ASSERT_FALSE(sys::fs::createTemporaryFile("vra-cache", "txt", Path));
+  std::string Error;
+  {
+    SummaryRangeAnalysis A(M);
+    A.run(1);
+    ASSERT_TRUE(A.saveCache(Path, Error)) << Error;
+  }
+  {
+    SummaryRangeAnalysis A(M);
+    EXPECT_EQ(A.loadCache(Path), 4U);
+    A.run(2);
+    EXPECT_EQ(A.getNumSummaries(), 4U);
+    ASSERT_TRUE(A.getSummary(*Main, {}).Values.count(Load));
+    EXPECT_DOUBLE_EQ(A.getSummary(*Main, {}).Values.lookup(Load).Max, 8.0);
+  }
+
+  /* set and its caller are analyzed again, sq is reused */
+  Instruction *Mul = &Set->getEntryBlock().front();
+  Mul->setOperand(1, ConstantFP::get(Type::getDoubleTy(Context), 4.0));
+  SummaryRangeAnalysis A(M);
+  EXPECT_EQ(A.loadCache(Path), 2U);
+  A.run(1);
+  EXPECT_EQ(A.getNumSummaries(), 4U);
+  EXPECT_DOUBLE_EQ(A.getSummary(*Main, {}).Values.lookup(Load).Max, 16.0);
+  sys::fs::remove(Path);
+}
+
+TEST_F(RangeSummariesTest, Annotate) {
+  InputInfo Info(nullptr, std::make_shared<Range>(-1.0, 1.0), nullptr);
+  MetadataManager::setInputInfoMetadata(*Load, Info);
+  MetadataManager::setInputInfoMetadata(*Phi, Info);
+  Info.IFinal = true;
+  MetadataManager::setInputInfoMetadata(*Calls[0], Info);
+  InputInfo ArgInfo(nullptr, nullptr, nullptr);
+  MDInfo *ArgInfos[] = {&ArgInfo};
+  MetadataManager::setArgumentInputInfoMetadata(*Sq, ArgInfos);
+
+  SummaryRangeAnalysis A(M);
+  A.run(1);
+  EXPECT_EQ(A.annotate(), 3U);
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  EXPECT_DOUBLE_EQ(MM.retrieveInputInfo(*Load)->IRange->Max, 8.0);
+  EXPECT_DOUBLE_EQ(MM.retrieveInputInfo(*Phi)->IRange->Max, 10.0);
+  EXPECT_DOUBLE_EQ(MM.retrieveInputInfo(*Calls[0])->IRange->Max, 1.0);
+  SmallVector<MDInfo *, 1> NewArgInfos;
+  MM.retrieveArgumentInputInfo(*Sq, NewArgInfos);
+  ASSERT_EQ(NewArgInfos.size(), 1U);
+  Range *ArgRange = cast<InputInfo>(NewArgInfos[0])->IRange.get();
+  ASSERT_TRUE(ArgRange);
+  EXPECT_DOUBLE_EQ(ArgRange->Min, 0.0);
+  EXPECT_DOUBLE_EQ(ArgRange->Max, 64.0);
+}
+
+}
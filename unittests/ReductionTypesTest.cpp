@@ -0,0 +1,141 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "ReductionTypes.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class ReductionTypesTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Type *Ty;
+  GlobalVariable *A;
+  GlobalVariable *B;
+  Function *F;
+  BasicBlock *Loop;
+  PHINode *S;
+  LoadInst *LA;
+  LoadInst *LB;
+  Instruction *Mul;
+  Instruction *Add;
+
+  ReductionTypesTest() : M("test", Context) {}
+
+  ~ReductionTypesTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  void setInfo(Value *V, double Min, double Max, unsigned PointPos) {
+    InputInfo II(std::make_shared<FPType>(32, PointPos), std::make_shared<Range>(Min, Max), nullptr);
+    if (auto *I = dyn_cast<Instruction>(V))
+      MetadataManager::setInputInfoMetadata(*I, II);
+    else
+      MetadataManager::setInputInfoMetadata(*cast<GlobalObject>(V), II);
+  }
+
+  FPType *getType(Value *V) {
+    auto *II = cast<InputInfo>(MetadataManager::getMetadataManager().retrieveMDInfo(V));
+    return cast<FPType>(II->IType.get());
+  }
+
+  /* double a[16], b[16];
+   * double f() {
+   *   double s = 0.0;
+   *   for (int i = 0; i < 16; i++)
+   *     s += a[i] * b[i];
+   *   return s;
+   * } */
+  void buildDotProduct() {
+    Ty = Type::getDoubleTy(Context);
+    ArrayType *ArrTy = ArrayType::get(Ty, 16);
+    Type *IntTy = Type::getInt32Ty(Context);
+    A = new GlobalVariable(M, ArrTy, false, GlobalValue::ExternalLinkage, ConstantAggregateZero::get(ArrTy), "a");
+    B = new GlobalVariable(M, ArrTy, false, GlobalValue::ExternalLinkage, ConstantAggregateZero::get(ArrTy), "b");
+    F = Function::Create(FunctionType::get(Ty, false), GlobalValue::ExternalLinkage, "f", &M);
+    BasicBlock *Entry = BasicBlock::Create(Context, "entry", F);
+    Loop = BasicBlock::Create(Context, "loop", F);
+    BasicBlock *Exit = BasicBlock::Create(Context, "exit", F);
+    IRBuilder<> IRB(Entry);
+    IRB.CreateBr(Loop);
+    IRB.SetInsertPoint(Loop);
+    PHINode *I = IRB.CreatePHI(IntTy, 2);
+    S = IRB.CreatePHI(Ty, 2);
+    Value *Zero = ConstantInt::get(IntTy, 0);
+    LA = IRB.CreateLoad(Ty, IRB.CreateInBoundsGEP(ArrTy, A, {Zero, I}));
+    LB = IRB.CreateLoad(Ty, IRB.CreateInBoundsGEP(ArrTy, B, {Zero, I}));
+    Mul = cast<Instruction>(IRB.CreateFMul(LA, LB));
+    Add = cast<Instruction>(IRB.CreateFAdd(S, Mul));
+    Value *Next = IRB.CreateAdd(I, ConstantInt::get(IntTy, 1));
+    IRB.CreateCondBr(IRB.CreateICmpSLT(Next, ConstantInt::get(IntTy, 16)), Loop, Exit);
+    I->addIncoming(Zero, Entry);
+    I->addIncoming(Next, Loop);
+    S->addIncoming(ConstantFP::get(Ty, 0.0), Entry);
+    S->addIncoming(Add, Loop);
+    IRB.SetInsertPoint(Exit);
+    IRB.CreateRet(Add);
+
+    setInfo(A, -1.0, 1.0, 30);
+    setInfo(B, -1.0, 1.0, 30);
+    setInfo(LA, -1.0, 1.0, 30);
+    setInfo(LB, -1.0, 1.0, 30);
+    setInfo(Mul, -1.0, 1.0, 30);
+    setInfo(S, -16.0, 16.0, 26);
+    setInfo(Add, -16.0, 16.0, 26);
+  }
+};
+
+
+TEST_F(ReductionTypesTest, Find) {
+  buildDotProduct();
+  DominatorTree DT(*F);
+  LoopInfo LI(DT);
+  ASSERT_EQ(LI.getLoopsInPreorder().size(), 1U);
+  SmallVector<Reduction, 2> Rs = findReductions(*LI.getLoopFor(Loop));
+  /* the induction variable is also used by the GEPs and the compare */
+  ASSERT_EQ(Rs.size(), 1U);
+  EXPECT_EQ(Rs[0].Accumulator, S);
+  ASSERT_EQ(Rs[0].Updates.size(), 1U);
+  EXPECT_EQ(Rs[0].Updates[0], Add);
+  ASSERT_EQ(Rs[0].Steps.size(), 1U);
+  EXPECT_EQ(Rs[0].Steps[0], Mul);
+  ASSERT_EQ(Rs[0].Operands.size(), 2U);
+  EXPECT_EQ(Rs[0].Operands[0], LA);
+  EXPECT_EQ(Rs[0].Operands[1], LB);
+}
+
+TEST_F(ReductionTypesTest, Narrow) {
+  buildDotProduct();
+  EXPECT_EQ(narrowReductionOperands(M, 16), 2U);
+  for (Value *V : {(Value *)A, (Value *)B, (Value *)LA, (Value *)LB}) {
+    EXPECT_EQ(getType(V)->getWidth(), 16U);
+    EXPECT_EQ(getType(V)->getPointPos(), 14U);
+  }
+  EXPECT_EQ(getType(Mul)->getWidth(), 32U);
+  EXPECT_EQ(getType(S)->getWidth(), 32U);
+  EXPECT_EQ(getType(Add)->getWidth(), 32U);
+  /* already narrow */
+  EXPECT_EQ(narrowReductionOperands(M, 16), 0U);
+}
+
+TEST_F(ReductionTypesTest, OtherLoads) {
+  buildDotProduct();
+  /* a[0] is also loaded after the loop, so only b is narrowed */
+  IRBuilder<> IRB(F->back().getTerminator());
+  IRB.CreateLoad(Ty, IRB.CreateConstInBoundsGEP2_32(A->getValueType(), A, 0, 0));
+  EXPECT_EQ(narrowReductionOperands(M, 16), 1U);
+  EXPECT_EQ(getType(A)->getWidth(), 32U);
+  EXPECT_EQ(getType(B)->getWidth(), 16U);
+}
+
+}
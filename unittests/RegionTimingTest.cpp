@@ -0,0 +1,132 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "RegionTiming.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class RegionTimingTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+
+  RegionTimingTest() : M("test", Context) {}
+
+  /* kernel is a starting point, with an alloca and two returns; its clone
+   * kernel.1_fixp is called by main, which has a target; helper is not a
+   * region */
+  void build(StringRef Triple) {
+    M.setTargetTriple(Triple);
+    Type *Ty = Type::getDoubleTy(Context);
+    Type *I32 = Type::getInt32Ty(Context);
+    Function *Kernel = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                                        GlobalValue::ExternalLinkage, "kernel", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Kernel));
+    B.CreateStore(Kernel->getArg(0), B.CreateAlloca(Ty));
+    BasicBlock *Neg = BasicBlock::Create(Context, "neg", Kernel);
+    BasicBlock *Pos = BasicBlock::Create(Context, "pos", Kernel);
+    B.CreateCondBr(B.CreateFCmpOLT(Kernel->getArg(0), ConstantFP::get(Ty, 0.0)), Neg, Pos);
+    B.SetInsertPoint(Neg);
+    B.CreateRet(ConstantFP::get(Ty, 0.0));
+    B.SetInsertPoint(Pos);
+    B.CreateRet(Kernel->getArg(0));
+    MetadataManager::setStartingPoint(*Kernel);
+
+    Function *Clone = Function::Create(FunctionType::get(I32, {I32}, false),
+                                       GlobalValue::InternalLinkage, "kernel.1_fixp", &M);
+    B.SetInsertPoint(BasicBlock::Create(Context, "entry", Clone));
+    B.CreateRet(Clone->getArg(0));
+    MetadataManager::setStartingPoint(*Clone);
+    Clone->setMetadata(ORIGINAL_FUN_METADATA, MDNode::get(Context, ValueAsMetadata::get(Kernel)));
+
+    Function *Helper = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                                        GlobalValue::ExternalLinkage, "helper", &M);
+    B.SetInsertPoint(BasicBlock::Create(Context, "entry", Helper));
+    B.CreateRet(Helper->getArg(0));
+
+    Function *Main = Function::Create(FunctionType::get(I32, false),
+                                      GlobalValue::ExternalLinkage, "main", &M);
+    B.SetInsertPoint(BasicBlock::Create(Context, "entry", Main));
+    CallInst *Call = B.CreateCall(Clone, {ConstantInt::get(I32, 1)});
+    MetadataManager::setTargetMetadata(*Call, "result");
+    B.CreateRet(Call);
+  }
+
+  ~RegionTimingTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  unsigned countCalls(const Function &F, Intrinsic::ID ID) {
+    unsigned N = 0;
+    for (const BasicBlock &BB : F)
+      for (const Instruction &I : BB)
+        if (auto *II = dyn_cast<IntrinsicInst>(&I))
+          N += II->getIntrinsicID() == ID;
+    return N;
+  }
+};
+
+
+TEST_F(RegionTimingTest, Regions) {
+  build("x86_64-unknown-linux-gnu");
+  EXPECT_EQ(getRegionName(*M.getFunction("kernel.1_fixp")), "kernel");
+  EXPECT_EQ(getRegionName(*M.getFunction("helper")), "helper");
+
+  std::vector<std::string> Regions = collectTimingRegions(M);
+  ASSERT_EQ(Regions.size(), 2U);
+  EXPECT_EQ(Regions[0], "kernel");
+  EXPECT_EQ(Regions[1], "main");
+}
+
+
+TEST_F(RegionTimingTest, Instrument) {
+  build("x86_64-unknown-linux-gnu");
+  std::vector<std::string> Regions = collectTimingRegions(M);
+  /* the clone shares the counters of kernel */
+  EXPECT_EQ(instrumentRegionTiming(M, Regions), 3U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  auto *Calls = M.getGlobalVariable("__taffo_region_calls", true);
+  ASSERT_NE(Calls, nullptr);
+  EXPECT_EQ(cast<ArrayType>(Calls->getValueType())->getNumElements(), 2U);
+  ASSERT_NE(M.getFunction("__taffo_region_dump"), nullptr);
+  ASSERT_NE(M.getFunction("fopen"), nullptr);
+
+  /* one reading at the entry and one at each return */
+  EXPECT_EQ(countCalls(*M.getFunction("kernel"), Intrinsic::readcyclecounter), 3U);
+  EXPECT_EQ(countCalls(*M.getFunction("kernel.1_fixp"), Intrinsic::readcyclecounter), 2U);
+  EXPECT_EQ(countCalls(*M.getFunction("helper"), Intrinsic::readcyclecounter), 0U);
+  /* the alloca is still the first instruction */
+  EXPECT_TRUE(isa<AllocaInst>(M.getFunction("kernel")->getEntryBlock().front()));
+}
+
+
+TEST_F(RegionTimingTest, CortexM) {
+  build("thumbv7em-none-eabi");
+  EXPECT_EQ(instrumentRegionTiming(M, {"kernel"}), 2U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_EQ(countCalls(*M.getFunction("kernel"), Intrinsic::readcyclecounter), 0U);
+
+  /* the counter is a volatile load from DWT_CYCCNT */
+  unsigned Loads = 0;
+  for (const Instruction &I : M.getFunction("kernel.1_fixp")->getEntryBlock())
+    if (auto *Load = dyn_cast<LoadInst>(&I))
+      Loads += Load->isVolatile();
+  EXPECT_EQ(Loads, 2U);
+  /* without an operating system the counters are printed */
+  EXPECT_NE(M.getFunction("printf"), nullptr);
+  EXPECT_EQ(M.getFunction("fopen"), nullptr);
+}
+
+}
@@ -0,0 +1,163 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "Saturation.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class SaturationTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Function *F;
+  Instruction *Diff;
+  Instruction *Sum;
+  Instruction *Prod;
+  Instruction *Clamped;
+  Instruction *UClamped;
+
+  /* i32 f(i32 a, i32 b, i64 w), converted to fixed point with 16
+   * fractional bits, mixing signed and unsigned types:
+   *   diff = a - b, signed in [-1, 1], is stored to the target out;
+   *   sum = a + b, unsigned in [0, 60000];
+   *   prod = trunc((zext a * zext b) >> 16), unsigned in [0, 1];
+   *   clamped = trunc w, signed in [-30000, 30000];
+   *   uclamped = trunc w, unsigned in [0, 60000] */
+  SaturationTest() : M("test", Context) {
+    Type *I32 = Type::getInt32Ty(Context);
+    Type *I64 = Type::getInt64Ty(Context);
+    GlobalVariable *Out = new GlobalVariable(M, I32, false, GlobalValue::InternalLinkage,
+                                             ConstantInt::get(I32, 0), "out");
+    MetadataManager::setTargetMetadata(*Out, "out");
+    F = Function::Create(FunctionType::get(I32, {I32, I32, I64}, false),
+                         GlobalValue::ExternalLinkage, "f", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    Value *A = F->getArg(0), *Bv = F->getArg(1), *W = F->getArg(2);
+    Diff = cast<Instruction>(B.CreateSub(A, Bv, "diff"));
+    B.CreateStore(Diff, Out);
+    Sum = cast<Instruction>(B.CreateAdd(A, Bv, "sum"));
+    Value *Wide = B.CreateMul(B.CreateZExt(A, I64), B.CreateZExt(Bv, I64), "wide");
+    Prod = cast<Instruction>(B.CreateTrunc(B.CreateLShr(Wide, 16), I32, "prod"));
+    Clamped = cast<Instruction>(B.CreateTrunc(W, I32, "clamped"));
+    UClamped = cast<Instruction>(B.CreateTrunc(W, I32, "uclamped"));
+    Value *Res = B.CreateXor(B.CreateXor(Sum, Prod), B.CreateXor(Clamped, UClamped));
+    B.CreateRet(Res);
+
+    auto SFixP = std::make_shared<FPType>(32, 16, true);
+    auto UFixP = std::make_shared<FPType>(32, 16, false);
+    MetadataManager::setInputInfoMetadata(*Diff, InputInfo(SFixP, std::make_shared<Range>(-1.0, 1.0), nullptr));
+    MetadataManager::setInputInfoMetadata(*Sum, InputInfo(UFixP, std::make_shared<Range>(0.0, 60000.0), nullptr));
+    MetadataManager::setInputInfoMetadata(*Prod, InputInfo(UFixP, std::make_shared<Range>(0.0, 1.0), nullptr));
+    MetadataManager::setInputInfoMetadata(*Clamped, InputInfo(SFixP, std::make_shared<Range>(-30000.0, 30000.0), nullptr));
+    MetadataManager::setInputInfoMetadata(*UClamped, InputInfo(UFixP, std::make_shared<Range>(0.0, 60000.0), nullptr));
+  }
+
+  ~SaturationTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  CallInst *findCall(StringRef Name) {
+    for (BasicBlock &BB : *F)
+      for (Instruction &I : BB)
+        if (auto *Call = dyn_cast<CallInst>(&I))
+          if (Call->getCalledFunction() && Call->getCalledFunction()->getName().startswith(Name))
+            return Call;
+    return nullptr;
+  }
+
+  unsigned count(unsigned Opcode) {
+    unsigned N = 0;
+    for (BasicBlock &BB : *F)
+      for (Instruction &I : BB)
+        N += I.getOpcode() == Opcode;
+    return N;
+  }
+};
+
+
+TEST_F(SaturationTest, ParseMode) {
+  SaturationMode Mode;
+  EXPECT_TRUE(parseSaturationMode("edge", Mode));
+  EXPECT_EQ(Mode, SaturationMode::Edge);
+  EXPECT_TRUE(parseSaturationMode("targets", Mode));
+  EXPECT_EQ(Mode, SaturationMode::Targets);
+  EXPECT_FALSE(parseSaturationMode("wrap", Mode));
+  EXPECT_FALSE(isNearTypeBounds(*Diff));
+  EXPECT_FALSE(isNearTypeBounds(*Prod));
+  /* the outer half of the unsigned type starts at 2^15 */
+  EXPECT_TRUE(isNearTypeBounds(*Sum));
+  EXPECT_TRUE(isNearTypeBounds(*Clamped));
+}
+
+
+TEST_F(SaturationTest, All) {
+  EXPECT_EQ(lowerToSaturatingArith(M, SaturationMode::All), 5U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  CallInst *SDiff = findCall("llvm.ssub.sat");
+  ASSERT_NE(SDiff, nullptr);
+  EXPECT_EQ(SDiff->getName(), "diff");
+  EXPECT_NE(MetadataManager::getMetadataManager().retrieveInputInfo(*SDiff), nullptr);
+  CallInst *USum = findCall("llvm.uadd.sat");
+  ASSERT_NE(USum, nullptr);
+  EXPECT_EQ(USum->getName(), "sum");
+  EXPECT_EQ(findCall("llvm.sadd.sat"), nullptr);
+
+  /* the unsigned 64 bit product is replaced by the saturating fixed point
+   * one on the unextended operands */
+  CallInst *UProd = findCall("llvm.umul.fix.sat");
+  ASSERT_NE(UProd, nullptr);
+  EXPECT_EQ(UProd->getArgOperand(0), F->getArg(0));
+  EXPECT_EQ(UProd->getArgOperand(1), F->getArg(1));
+  EXPECT_EQ(cast<ConstantInt>(UProd->getArgOperand(2))->getZExtValue(), 16U);
+  EXPECT_EQ(count(Instruction::Mul), 0U);
+  EXPECT_EQ(count(Instruction::ZExt), 0U);
+
+  /* the signed truncation is clamped at both bounds of i32, the unsigned
+   * one at the upper bound only */
+  ASSERT_EQ(count(Instruction::Select), 3U);
+  auto *Lo = cast<SelectInst>(Clamped->getOperand(0));
+  auto *Hi = cast<SelectInst>(Lo->getFalseValue());
+  EXPECT_EQ(cast<ICmpInst>(Lo->getCondition())->getPredicate(), ICmpInst::ICMP_SLT);
+  EXPECT_EQ(cast<ConstantInt>(Lo->getTrueValue())->getSExtValue(), INT32_MIN);
+  EXPECT_EQ(cast<ICmpInst>(Hi->getCondition())->getPredicate(), ICmpInst::ICMP_SGT);
+  EXPECT_EQ(cast<ConstantInt>(Hi->getTrueValue())->getSExtValue(), INT32_MAX);
+  EXPECT_EQ(Hi->getFalseValue(), F->getArg(2));
+  auto *UHi = cast<SelectInst>(UClamped->getOperand(0));
+  EXPECT_EQ(cast<ICmpInst>(UHi->getCondition())->getPredicate(), ICmpInst::ICMP_UGT);
+  EXPECT_EQ(cast<ConstantInt>(UHi->getTrueValue())->getZExtValue(), (uint64_t)UINT32_MAX);
+  EXPECT_EQ(UHi->getFalseValue(), F->getArg(2));
+}
+
+
+TEST_F(SaturationTest, Targets) {
+  EXPECT_EQ(lowerToSaturatingArith(M, SaturationMode::Targets), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_NE(findCall("llvm.ssub.sat"), nullptr);
+  EXPECT_EQ(findCall("llvm.uadd.sat"), nullptr);
+  EXPECT_EQ(findCall("llvm.umul.fix.sat"), nullptr);
+  EXPECT_EQ(count(Instruction::Select), 0U);
+}
+
+
+TEST_F(SaturationTest, Edge) {
+  EXPECT_EQ(lowerToSaturatingArith(M, SaturationMode::Edge), 3U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+  EXPECT_EQ(findCall("llvm.ssub.sat"), nullptr);
+  EXPECT_EQ(findCall("llvm.umul.fix.sat"), nullptr);
+  EXPECT_NE(findCall("llvm.uadd.sat"), nullptr);
+  EXPECT_EQ(count(Instruction::Select), 3U);
+}
+
+}
@@ -0,0 +1,104 @@
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "StorageNarrowing.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+TEST(StorageNarrowingTest, Format) {
+  StorageFormat F;
+  EXPECT_TRUE(parseStorageFormat("8", F));
+  EXPECT_EQ(F.Width, 8U);
+  EXPECT_TRUE(parseStorageFormat("bfloat16", F));
+  EXPECT_EQ(F.Width, 0U);
+  EXPECT_EQ(F.Float, FloatType::Float_bfloat);
+  EXPECT_FALSE(parseStorageFormat("12", F));
+  EXPECT_FALSE(parseStorageFormat("float", F));
+}
+
+TEST(StorageNarrowingTest, NarrowType) {
+  StorageFormat F16, Half;
+  parseStorageFormat("16", F16);
+  parseStorageFormat("half", Half);
+
+  /* the integer bits are kept */
+  std::shared_ptr<TType> T = getNarrowStorageType(FPType(-32, 24), F16);
+  ASSERT_TRUE(T && isa<FPType>(T.get()));
+  EXPECT_EQ(cast<FPType>(T.get())->getSWidth(), -16);
+  EXPECT_EQ(cast<FPType>(T.get())->getPointPos(), 8U);
+  T = getNarrowStorageType(FPType(32, 30, false), F16);
+  ASSERT_TRUE(T);
+  EXPECT_EQ(cast<FPType>(T.get())->getSWidth(), 16);
+  EXPECT_EQ(cast<FPType>(T.get())->getPointPos(), 14U);
+  /* too many integer bits, or not wider */
+  EXPECT_FALSE(getNarrowStorageType(FPType(-32, 4), F16));
+  EXPECT_FALSE(getNarrowStorageType(FPType(-16, 8), F16));
+  EXPECT_FALSE(getNarrowStorageType(FloatType(FloatType::Float_float), F16));
+
+  T = getNarrowStorageType(FPType(-32, 16), Half);
+  ASSERT_TRUE(T && isa<FloatType>(T.get()));
+  EXPECT_EQ(cast<FloatType>(T.get())->getStandard(), FloatType::Float_half);
+  /* 2^23 does not fit in half */
+  EXPECT_FALSE(getNarrowStorageType(FPType(-32, 8), Half));
+}
+
+TEST(StorageNarrowingTest, Module) {
+  LLVMContext C;
+  Module M("test", C);
+  Type *Ty = Type::getDoubleTy(C);
+  ArrayType *ArrTy = ArrayType::get(Ty, 4);
+  StructType *STy = StructType::create({Ty, Type::getInt32Ty(C)}, "pair");
+  auto *G = new GlobalVariable(M, ArrTy, false, GlobalValue::InternalLinkage,
+                               ConstantAggregateZero::get(ArrTy), "g");
+  Function *Ext = Function::Create(
+      FunctionType::get(Type::getVoidTy(C), {ArrTy->getPointerTo()}, false),
+      GlobalValue::ExternalLinkage, "ext", &M);
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(C), false),
+                                 GlobalValue::ExternalLinkage, "f", &M);
+  IRBuilder<> B(BasicBlock::Create(C, "entry", F));
+  AllocaInst *A = B.CreateAlloca(ArrTy);
+  AllocaInst *Escaping = B.CreateAlloca(ArrTy);
+  AllocaInst *S = B.CreateAlloca(STy);
+  Instruction *GEP = cast<Instruction>(B.CreateConstInBoundsGEP2_32(ArrTy, A, 0, 1));
+  Instruction *Load = B.CreateLoad(Ty, GEP);
+  B.CreateStore(Load, GEP);
+  B.CreateCall(Ext, {Escaping});
+  B.CreateRetVoid();
+
+  InputInfo Info(std::make_shared<FPType>(-32, 24), std::make_shared<Range>(-1.0, 1.0),
+                 nullptr, true);
+  MetadataManager::setInputInfoMetadata(*G, Info);
+  for (Instruction *I : {(Instruction *)A, (Instruction *)Escaping, GEP, Load})
+    MetadataManager::setInputInfoMetadata(*I, Info);
+  StructInfo SInfo(2);
+  SInfo.setField(0, std::shared_ptr<MDInfo>(Info.clone()));
+  MetadataManager::setStructInfoMetadata(*S, SInfo);
+
+  StorageFormat F16;
+  parseStorageFormat("16", F16);
+  EXPECT_EQ(narrowStorageTypes(M, F16), 3U);
+
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  auto WidthOf = [&](MDInfo *MI) {
+    return cast<FPType>(cast<InputInfo>(MI)->IType.get())->getWidth();
+  };
+  EXPECT_EQ(WidthOf(MM.retrieveInputInfo(*G)), 16U);
+  EXPECT_EQ(WidthOf(MM.retrieveInputInfo(*A)), 16U);
+  EXPECT_EQ(WidthOf(MM.retrieveInputInfo(*GEP)), 16U);
+  /* the loaded values are computed in the original type */
+  EXPECT_EQ(WidthOf(MM.retrieveInputInfo(*Load)), 32U);
+  EXPECT_EQ(WidthOf(MM.retrieveInputInfo(*Escaping)), 32U);
+  StructInfo *NewSInfo = MM.retrieveStructInfo(*S);
+  EXPECT_EQ(WidthOf(NewSInfo->getField(0).get()), 16U);
+  EXPECT_EQ(NewSInfo->getField(1).get(), nullptr);
+  MM.releaseContext(C);
+}
+
+}
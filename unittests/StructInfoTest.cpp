@@ -0,0 +1,136 @@
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/LLVMContext.h"
+#include "gtest/gtest.h"
+#include "InputInfo.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+
+
+std::shared_ptr<StructInfo> makeNested()
+{
+  std::shared_ptr<MDInfo> Inner(new StructInfo({
+      std::make_shared<InputInfo>(nullptr, std::make_shared<Range>(0.0, 1.0), nullptr),
+      nullptr}));
+  return std::make_shared<StructInfo>(ArrayRef<std::shared_ptr<MDInfo>>({
+      std::make_shared<InputInfo>(nullptr, std::make_shared<Range>(0.0, 2.0), nullptr),
+      Inner}));
+}
+
+
+TEST(StructInfoTest, CloneSharedSharesFields) {
+  std::shared_ptr<StructInfo> S = makeNested();
+  std::unique_ptr<StructInfo> C(S->cloneShared());
+  const StructInfo &CS = *C;
+  EXPECT_EQ(CS.getField(0), static_cast<const StructInfo &>(*S).getField(0));
+  EXPECT_EQ(CS.getField(1), static_cast<const StructInfo &>(*S).getField(1));
+}
+
+
+TEST(StructInfoTest, ModifiedCloneIsIndependent) {
+  std::shared_ptr<StructInfo> S = makeNested();
+  std::unique_ptr<StructInfo> C(S->cloneShared());
+
+  std::shared_ptr<MDInfo> Inner = C->getField(1);
+  cast<InputInfo>(cast<StructInfo>(Inner.get())->getField(0).get())->IRange->Max = 10.0;
+  C->setField(0, nullptr);
+
+  const StructInfo &CS = *S;
+  ASSERT_NE(CS.getField(0), nullptr);
+  EXPECT_EQ(cast<InputInfo>(CS.getField(0))->IRange->Max, 2.0);
+  const StructInfo *SInner = cast<StructInfo>(CS.getField(1));
+  EXPECT_EQ(cast<InputInfo>(SInner->getField(0))->IRange->Max, 1.0);
+  EXPECT_EQ(C->getField(0), nullptr);
+  EXPECT_EQ(cast<InputInfo>(cast<StructInfo>(C->getField(1).get())->getField(0).get())->IRange->Max, 10.0);
+}
+
+
+TEST(StructInfoTest, ModifiedOriginalIsIndependent) {
+  std::shared_ptr<StructInfo> S = makeNested();
+  std::unique_ptr<StructInfo> C(S->cloneShared());
+
+  /* the fields shared with the clone must not be modified in place */
+  cast<InputInfo>(S->getField(0).get())->IRange->Max = 5.0;
+  for (std::shared_ptr<MDInfo> &F : *S)
+    F = nullptr;
+
+  const StructInfo &CS = *C;
+  ASSERT_NE(CS.getField(0), nullptr);
+  EXPECT_EQ(cast<InputInfo>(CS.getField(0))->IRange->Max, 2.0);
+  EXPECT_NE(CS.getField(1), nullptr);
+  EXPECT_EQ(S->getField(1), nullptr);
+}
+
+
+
+TEST(StructInfoTest, CloneIsDeep) {
+  std::shared_ptr<StructInfo> S = makeNested();
+  /* a field obtained before cloning stays exclusive to the original */
+  std::shared_ptr<MDInfo> Field = S->getField(0);
+  std::shared_ptr<MDInfo> Inner = S->getField(1);
+  std::unique_ptr<StructInfo> C(cast<StructInfo>(S->clone()));
+  cast<InputInfo>(Field.get())->IRange->Max = 5.0;
+  cast<InputInfo>(cast<StructInfo>(Inner.get())->getField(0).get())->IRange->Max = 6.0;
+
+  const StructInfo &CC = *C;
+  EXPECT_NE(CC.getField(0), Field.get());
+  EXPECT_EQ(cast<InputInfo>(CC.getField(0))->IRange->Max, 2.0);
+  const StructInfo *CInner = cast<StructInfo>(CC.getField(1));
+  EXPECT_NE(CInner, Inner.get());
+  EXPECT_EQ(cast<InputInfo>(CInner->getField(0))->IRange->Max, 1.0);
+  EXPECT_EQ(cast<InputInfo>(S->getField(0).get())->IRange->Max, 5.0);
+}
+
+
+TEST(StructInfoTest, CloneOfSharedCloneIsIndependent) {
+  std::shared_ptr<StructInfo> S = makeNested();
+  std::unique_ptr<StructInfo> C(S->cloneShared());
+  /* the storage stays shared after the original is gone */
+  S.reset();
+  std::unique_ptr<StructInfo> D(C->cloneShared());
+  C->setField(0, nullptr);
+  cast<InputInfo>(cast<StructInfo>(C->getField(1).get())->getField(0).get())->IRange->Max = 3.0;
+
+  const StructInfo &CD = *D;
+  ASSERT_NE(CD.getField(0), nullptr);
+  EXPECT_EQ(cast<InputInfo>(CD.getField(0))->IRange->Max, 2.0);
+  const StructInfo *DInner = cast<StructInfo>(CD.getField(1));
+  EXPECT_EQ(cast<InputInfo>(DInner->getField(0))->IRange->Max, 1.0);
+}
+
+
+TEST(StructInfoTest, ConstructFromLLVMTypeReturnsDistinctObjects) {
+  LLVMContext Context;
+  Type *Double = Type::getDoubleTy(Context);
+  StructType *Ty = StructType::get(Context, {Double, Double, Double});
+
+  std::shared_ptr<StructInfo> A = StructInfo::constructFromLLVMType(Ty);
+  std::shared_ptr<StructInfo> B = StructInfo::constructFromLLVMType(Ty);
+  ASSERT_NE(A, nullptr);
+  ASSERT_NE(B, nullptr);
+  EXPECT_NE(A, B);
+  EXPECT_EQ(A->size(), 3U);
+  EXPECT_EQ(StructInfo::constructFromLLVMType(Double), nullptr);
+
+  A->setField(1, std::make_shared<InputInfo>(nullptr, std::make_shared<Range>(0.0, 1.0), nullptr));
+  EXPECT_EQ(B->getField(1), nullptr);
+  EXPECT_EQ(StructInfo::constructFromLLVMType(Ty)->getField(1), nullptr);
+  StructInfo::releaseTypeCache(Context);
+}
+
+TEST(StructInfoTest, ConstructFromLLVMTypeInNewContexts) {
+  /* the contexts, and their types, may get the addresses of the ones
+   * destroyed before */
+  for (unsigned N = 1; N <= 4; N++) {
+    std::unique_ptr<LLVMContext> Context(new LLVMContext());
+    SmallVector<Type *, 4> Fields(N, Type::getDoubleTy(*Context));
+    std::shared_ptr<StructInfo> SI = StructInfo::constructFromLLVMType(StructType::get(*Context, Fields));
+    ASSERT_NE(SI, nullptr);
+    EXPECT_EQ(SI->size(), N);
+    StructInfo::releaseTypeCache(*Context);
+  }
+}
+
+}
@@ -0,0 +1,121 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "gtest/gtest.h"
+#include "InputInfo.h"
+#include "Metadata.h"
+#include "StructRepacking.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class StructRepackingTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  /* { i16, i64*, i16, i64* }: 32 bytes, 24 with the pointers first */
+  StructType *Rec;
+
+  StructRepackingTest() : M("test", Context) {
+    Type *I16 = Type::getInt16Ty(Context);
+    Type *I64P = Type::getInt64PtrTy(Context);
+    Rec = StructType::create(Context, {I16, I64P, I16, I64P}, "rec");
+  }
+
+  ~StructRepackingTest() {
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  /* i16 f(i64 i) { rec a[4]; a[i].f2 = 3; a[i].f1 = null; return a[1].f2; } */
+  Function *createFunction(StringRef Name) {
+    Function *F = Function::Create(FunctionType::get(Type::getInt16Ty(Context), {Type::getInt64Ty(Context)}, false),
+                                   GlobalValue::ExternalLinkage, Name, &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    AllocaInst *A = B.CreateAlloca(ArrayType::get(Rec, 4), nullptr, "a");
+    Type *ArrTy = A->getAllocatedType();
+    B.CreateStore(B.getInt16(3), B.CreateInBoundsGEP(ArrTy, A, {B.getInt64(0), F->getArg(0), B.getInt32(2)}));
+    B.CreateStore(ConstantPointerNull::get(Type::getInt64PtrTy(Context)),
+                  B.CreateInBoundsGEP(ArrTy, A, {B.getInt64(0), F->getArg(0), B.getInt32(1)}));
+    Value *F2 = B.CreateInBoundsGEP(ArrTy, A, {B.getInt64(0), B.getInt64(1), B.getInt32(2)});
+    B.CreateRet(B.CreateLoad(B.getInt16Ty(), F2));
+
+    std::shared_ptr<MDInfo> Fields[] = {
+        std::make_shared<InputInfo>(std::make_shared<FPType>(16, 8, true), std::make_shared<Range>(0.0, 1.0), nullptr),
+        nullptr, nullptr, nullptr};
+    MetadataManager::setStructInfoMetadata(*A, StructInfo(Fields));
+    return F;
+  }
+
+  AllocaInst *getAlloca(Function *F) { return cast<AllocaInst>(&F->getEntryBlock().front()); }
+};
+
+
+TEST_F(StructRepackingTest, Order) {
+  const DataLayout &DL = M.getDataLayout();
+  SmallVector<unsigned, 8> Order = getRepackedFieldOrder(Rec, DL);
+  ASSERT_EQ(Order.size(), 4U);
+  EXPECT_EQ(Order[0], 1U);
+  EXPECT_EQ(Order[1], 3U);
+  EXPECT_EQ(Order[2], 0U);
+  EXPECT_EQ(Order[3], 2U);
+
+  StructType *Packed = StructType::create(Context, {Type::getInt64PtrTy(Context), Type::getInt16Ty(Context)}, "p");
+  EXPECT_TRUE(getRepackedFieldOrder(Packed, DL).empty());
+}
+
+
+TEST_F(StructRepackingTest, Repack) {
+  Function *F = createFunction("f");
+  EXPECT_TRUE(hasLocalLayout(M, Rec));
+  EXPECT_EQ(repackStructTypes(M), 1U);
+  EXPECT_FALSE(verifyModule(M, &errs()));
+
+  AllocaInst *A = getAlloca(F);
+  auto *New = cast<StructType>(A->getAllocatedType()->getArrayElementType());
+  EXPECT_NE(New, Rec);
+  EXPECT_EQ(M.getDataLayout().getTypeAllocSize(New), 24U);
+
+  /* the GEP of a[i].f2 now indexes the last field */
+  auto *GEP = cast<GetElementPtrInst>(A->getNextNode());
+  EXPECT_EQ(cast<ConstantInt>(GEP->getOperand(3))->getZExtValue(), 3U);
+  EXPECT_TRUE(GEP->getResultElementType()->isIntegerTy(16));
+
+  /* the structinfo follows the fields */
+  StructInfo *SI = MetadataManager::getMetadataManager().retrieveStructInfo(*A);
+  ASSERT_NE(SI, nullptr);
+  EXPECT_EQ(SI->getField(0), nullptr);
+  EXPECT_NE(SI->getField(2), nullptr);
+}
+
+
+TEST_F(StructRepackingTest, Escapes) {
+  createFunction("f");
+  /* a function which takes a pointer to rec makes it visible to its
+   * callers in other modules */
+  Function::Create(FunctionType::get(Type::getVoidTy(Context), {Rec->getPointerTo()}, false),
+                   GlobalValue::ExternalLinkage, "g", &M);
+  EXPECT_FALSE(hasLocalLayout(M, Rec));
+  EXPECT_EQ(repackStructTypes(M), 0U);
+}
+
+
+TEST_F(StructRepackingTest, Casts) {
+  Function *F = createFunction("f");
+  IRBuilder<> B(getAlloca(F)->getNextNode());
+  Value *Ptr = B.CreateBitCast(getAlloca(F), B.getInt8PtrTy());
+  B.CreateLifetimeStart(Ptr);
+  EXPECT_TRUE(hasLocalLayout(M, Rec));
+
+  /* the bytes of the structures are read by memset */
+  B.CreateMemSet(Ptr, B.getInt8(0), 128, MaybeAlign(8));
+  EXPECT_FALSE(hasLocalLayout(M, Rec));
+}
+
+}
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Metadata.h"
+#include "MultiValueMap.h"
+
+using namespace llvm;
+using namespace mdutils;
+using namespace taffo;
+
+
+static cl::opt<unsigned> MinSize("min-size", cl::init(1000U),
+    cl::desc("Smallest number of values (default 1000)"));
+static cl::opt<unsigned> MaxSize("max-size", cl::init(1000000U),
+    cl::desc("Largest number of values (default 1000000)"));
+static cl::opt<unsigned> Repetitions("repetitions", cl::init(5U),
+    cl::desc("Number of runs of each benchmark; the fastest one is reported"));
+static cl::opt<std::string> OutputFilename("o", cl::init("-"),
+    cl::desc("Output JSON file"), cl::value_desc("filename"));
+
+
+namespace {
+
+/* Keeps the results of the benchmarked operations alive */
+volatile uintptr_t Sink;
+
+struct Result {
+  std::string Name;
+  unsigned Size;
+  double NsPerOp;
+};
+
+class BenchmarkRunner {
+public:
+  std::vector<Result> Results;
+
+  /* Runs Setup and then Body Repetitions times, and records the fastest
+   * run of Body, divided by the number of operations it performs */
+  void run(const std::string& Name, unsigned Size, unsigned NumOps,
+           std::function<void()> Setup, std::function<void()> Body)
+  {
+    double Best = 0.0;
+    for (unsigned R = 0; R < std::max(Repetitions.getValue(), 1U); R++) {
+      Setup();
+      auto Start = std::chrono::steady_clock::now();
+      Body();
+      auto End = std::chrono::steady_clock::now();
+      double Ns = std::chrono::duration<double, std::nano>(End - Start).count();
+      Best = R == 0 ? Ns : std::min(Best, Ns);
+    }
+    Results.push_back({Name, Size, Best / NumOps});
+  }
+
+  void print(raw_ostream& OS)
+  {
+    json::Array Arr;
+    for (const Result& R: Results)
+      Arr.push_back(json::Object{{"name", R.Name}, {"size", (int64_t)R.Size},
+                                 {"repetitions", (int64_t)Repetitions.getValue()},
+                                 {"ns_per_op", R.NsPerOp}});
+    OS << formatv("{0:2}", json::Value(json::Object{{"benchmarks", std::move(Arr)}})) << "\n";
+  }
+};
+
+
+/* Instructions not inserted in any basic block, used as keys which can be
+ * replaced and deleted */
+class KeySet {
+public:
+  explicit KeySet(LLVMContext& C, unsigned N)
+  {
+    Value *Zero = ConstantInt::get(Type::getInt32Ty(C), 0);
+    for (unsigned I = 0; I < N; I++)
+      Keys.emplace_back(BinaryOperator::CreateAdd(Zero, ConstantInt::get(Type::getInt32Ty(C), I)));
+  }
+
+  unsigned size() const { return Keys.size(); }
+  Value *operator[](unsigned I) const { return Keys[I].get(); }
+
+private:
+  std::vector<std::unique_ptr<BinaryOperator>> Keys;
+};
+
+
+void benchmarkMaps(BenchmarkRunner& BR, LLVMContext& C, unsigned N)
+{
+  KeySet Keys(C, N);
+  KeySet NewKeys(C, N);
+  std::unique_ptr<MultiValueMap<Value *, unsigned>> MVM;
+  std::unique_ptr<ValueMap<Value *, unsigned>> VM;
+
+  auto FillMVM = [&]() {
+    MVM.reset(new MultiValueMap<Value *, unsigned>());
+    for (unsigned I = 0; I < N; I++)
+      MVM->push_back(Keys[I], I);
+  };
+  auto FillVM = [&]() {
+    VM.reset(new ValueMap<Value *, unsigned>());
+    for (unsigned I = 0; I < N; I++)
+      VM->insert({Keys[I], I});
+  };
+
+  BR.run("MultiValueMap/insert", N, N, [&]() { MVM.reset(); }, FillMVM);
+  BR.run("ValueMap/insert", N, N, [&]() { VM.reset(); }, FillVM);
+
+  BR.run("MultiValueMap/find", N, N, FillMVM, [&]() {
+    for (unsigned I = 0; I < N; I++)
+      Sink = Sink + MVM->find(Keys[I])->second;
+  });
+  BR.run("ValueMap/find", N, N, FillVM, [&]() {
+    for (unsigned I = 0; I < N; I++)
+      Sink = Sink + VM->find(Keys[I])->second;
+  });
+
+  BR.run("MultiValueMap/iterate", N, N, FillMVM, [&]() {
+    for (auto P: *MVM)
+      Sink = Sink + P.second;
+  });
+  BR.run("ValueMap/iterate", N, N, FillVM, [&]() {
+    for (auto P: *VM)
+      Sink = Sink + P.second;
+  });
+
+  BR.run("MultiValueMap/erase", N, N, FillMVM, [&]() {
+    for (unsigned I = 0; I < N; I++)
+      MVM->erase(Keys[I]);
+  });
+  BR.run("ValueMap/erase", N, N, FillVM, [&]() {
+    for (unsigned I = 0; I < N; I++)
+      VM->erase(Keys[I]);
+  });
+
+  /* replace the keys back and forth, so that each run starts from a map
+   * which has the keys of the setup */
+  auto ReplaceAll = [&]() {
+    for (unsigned I = 0; I < N; I++)
+      Keys[I]->replaceAllUsesWith(NewKeys[I]);
+    for (unsigned I = 0; I < N; I++)
+      NewKeys[I]->replaceAllUsesWith(Keys[I]);
+  };
+  BR.run("MultiValueMap/RAUW", N, 2 * N, FillMVM, ReplaceAll);
+  MVM.reset();
+  BR.run("ValueMap/RAUW", N, 2 * N, FillVM, ReplaceAll);
+  VM.reset();
+}
+
+
+void benchmarkMetadataManager(BenchmarkRunner& BR, LLVMContext& C, unsigned N)
+{
+  Module M("bench", C);
+  Type *Ty = Type::getDoubleTy(C);
+  std::vector<GlobalVariable *> Globals;
+  for (unsigned I = 0; I < N; I++)
+    Globals.push_back(new GlobalVariable(M, Ty, false, GlobalValue::ExternalLinkage,
+                                         ConstantFP::get(Ty, I)));
+  MetadataManager& MM = MetadataManager::getMetadataManager();
+
+  auto SetAll = [&]() {
+    for (unsigned I = 0; I < N; I++) {
+      InputInfo II(std::make_shared<FPType>(32, I % 32),
+                   std::make_shared<Range>(0.0, (double)(I % 1024)), nullptr, true);
+      MetadataManager::setInputInfoMetadata(*Globals[I], II);
+    }
+  };
+  auto RetrieveAll = [&]() {
+    for (unsigned I = 0; I < N; I++)
+      Sink = Sink + (uintptr_t)MM.retrieveInputInfo(*Globals[I]);
+  };
+
+  BR.run("MetadataManager/set", N, N, [&]() { MM.clearCache(); }, SetAll);
+  BR.run("MetadataManager/retrieve-cold", N, N, [&]() { MM.clearCache(); }, RetrieveAll);
+  BR.run("MetadataManager/retrieve-warm", N, N, RetrieveAll, RetrieveAll);
+  BR.run("MetadataManager/round-trip", N, N, [&]() { MM.clearCache(); }, [&]() {
+    SetAll();
+    RetrieveAll();
+  });
+  MM.releaseModule(M);
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv,
+      "Microbenchmarks of the TaffoUtils data structures\n");
+
+  BenchmarkRunner BR;
+  for (unsigned N = MinSize; N <= MaxSize && N > 0; N *= 10) {
+    LLVMContext C;
+    benchmarkMaps(BR, C, N);
+    benchmarkMetadataManager(BR, C, N);
+    MetadataManager::getMetadataManager().releaseContext(C);
+  }
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "cannot open " << OutputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+  BR.print(OS);
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include <string>
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "TargetCostModel.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+TEST(TargetCostModelTest, Parse) {
+  TargetCostModel M;
+  std::string Error;
+  EXPECT_TRUE(M.parse("# comment\n\nfmul double 40\nsdiv 5\nlanes i16 2\n", Error));
+  EXPECT_EQ(M.getCost(Instruction::FMul, TargetCostModel::Double), 40.0);
+  EXPECT_EQ(M.getCost(Instruction::FMul, TargetCostModel::Float), 1.0);
+  EXPECT_EQ(M.getCost(Instruction::SDiv, TargetCostModel::Int8), 5.0);
+  EXPECT_EQ(M.getCost(Instruction::SDiv, TargetCostModel::Int64), 5.0);
+  EXPECT_EQ(M.getLanes(TargetCostModel::Int16), 2U);
+  /* the lanes only apply to the binary operations in loops */
+  EXPECT_EQ(M.getCost(Instruction::SDiv, TargetCostModel::Int16, true), 2.5);
+  EXPECT_EQ(M.getCost(Instruction::SDiv, TargetCostModel::Int16, false), 5.0);
+  EXPECT_EQ(M.getCost(Instruction::Load, TargetCostModel::Int16, true), 1.0);
+
+  EXPECT_FALSE(M.parse("frobnicate 1", Error));
+  EXPECT_EQ(Error, "line 1: unknown opcode frobnicate");
+  EXPECT_FALSE(M.parse("\nadd i128 1", Error));
+  EXPECT_EQ(Error, "line 2: unknown type i128");
+  EXPECT_FALSE(M.parse("add i32 -1", Error));
+  EXPECT_FALSE(M.parse("lanes i16", Error));
+}
+
+TEST(TargetCostModelTest, CostType) {
+  LLVMContext Context;
+  EXPECT_EQ(TargetCostModel::getCostType(Type::getInt1Ty(Context)).getValue(), TargetCostModel::Int8);
+  EXPECT_EQ(TargetCostModel::getCostType(Type::getIntNTy(Context, 24)).getValue(), TargetCostModel::Int32);
+  EXPECT_EQ(TargetCostModel::getCostType(
+      VectorType::get(Type::getDoubleTy(Context), 4, false)).getValue(), TargetCostModel::Double);
+  EXPECT_FALSE(TargetCostModel::getCostType(Type::getInt8PtrTy(Context)).hasValue());
+  EXPECT_EQ(TargetCostModel::getCostTypeName(TargetCostModel::Int64), "i64");
+}
+
+TEST(TargetCostModelTest, ChooseType) {
+  LLVMContext Context;
+  Module Mod("test", Context);
+  Type *Ty = Type::getFloatTy(Context);
+  Function *F = Function::Create(FunctionType::get(Ty, {Ty, Ty}, false),
+                                 GlobalValue::ExternalLinkage, "f", &Mod);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  Instruction *Mul = cast<Instruction>(B.CreateFMul(F->getArg(0), F->getArg(1)));
+  B.CreateRet(Mul);
+
+  const TargetCostModel *M4 = TargetCostModel::getBuiltin("cortex-m4");
+  ASSERT_NE(M4, nullptr);
+  EXPECT_EQ(TargetCostModel::getBuiltin("pdp-11"), nullptr);
+  /* the product of two s4_28 values needs 64 bits, the one of two s4_12
+   * values fits in 32 bits */
+  FPType Candidates[] = {FPType(-32, 28), FPType(-16, 12)};
+  EXPECT_EQ(chooseCheapestType(*Mul, Candidates, {}, *M4, false), 1U);
+  EXPECT_GT(getFixedPointCost(*Mul, Candidates[0], {}, *M4, false),
+            getFixedPointCost(*Mul, Candidates[1], {}, *M4, false));
+  /* ties go to the first candidate */
+  FPType Same[] = {FPType(-32, 20), FPType(-32, 10)};
+  EXPECT_EQ(chooseCheapestType(*Mul, Same, {}, TargetCostModel(), false), 0U);
+
+  TargetTransformInfo TTI(Mod.getDataLayout());
+  TargetCostModel FromTTI = TargetCostModel::fromTargetTransformInfo(TTI, Context);
+  EXPECT_GE(FromTTI.getCost(Instruction::Mul, TargetCostModel::Int32), 0.0);
+  EXPECT_GE(FromTTI.getCost(Instruction::FDiv, TargetCostModel::Double), 0.0);
+  EXPECT_GE(FromTTI.getLanes(TargetCostModel::Int8), 1U);
+}
+
+TEST(TargetCostModelTest, RevertUnprofitable) {
+  LLVMContext Context;
+  Module Mod("test", Context);
+  Type *Ty = Type::getDoubleTy(Context);
+  Function *Ext = Function::Create(FunctionType::get(Type::getVoidTy(Context), {Ty}, false),
+                                   GlobalValue::ExternalLinkage, "ext", &Mod);
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Context), false),
+                                 GlobalValue::ExternalLinkage, "f", &Mod);
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  AllocaInst *Var = B.CreateAlloca(Ty);
+  B.CreateStore(ConstantFP::get(Ty, 0.5), Var);
+  Instruction *Load = B.CreateLoad(Ty, Var);
+  Instruction *Mul = cast<Instruction>(B.CreateFMul(Load, ConstantFP::get(Ty, 0.25)));
+  Instruction *Add = cast<Instruction>(B.CreateFAdd(Mul, Load));
+  B.CreateStore(Add, Var);
+  B.CreateRetVoid();
+  Instruction *Insts[] = {Var, Load, Mul, Add};
+  auto SetTypes = [&]() {
+    for (Instruction *I : Insts) {
+      MetadataManager::setInputInfoMetadata(*I, InputInfo(
+          std::make_shared<FPType>(-32, 28), std::make_shared<Range>(0.0, 1.0),
+          nullptr, true));
+    }
+  };
+  MetadataManager &MM = MetadataManager::getMetadataManager();
+  auto Enabled = [&](Instruction *I) {
+    return MM.retrieveInputInfo(*I)->IEnableConversion;
+  };
+
+  /* the double precision operations are emulated on the Cortex-M4 */
+  SetTypes();
+  const TargetCostModel *M4 = TargetCostModel::getBuiltin("cortex-m4");
+  EXPECT_EQ(revertUnprofitableConversions(*F, *M4), 0U);
+  EXPECT_TRUE(Enabled(Mul));
+
+  /* with a slow 64-bit multiply the whole group stays in float */
+  TargetCostModel SlowMul;
+  std::string Error;
+  ASSERT_TRUE(SlowMul.parse("mul i64 100", Error));
+  EXPECT_EQ(revertUnprofitableConversions(*F, SlowMul), 4U);
+  for (Instruction *I : Insts)
+    EXPECT_FALSE(Enabled(I));
+
+  /* unless it passes a fixed point value to another function */
+  SetTypes();
+  B.SetInsertPoint(Mul);
+  B.CreateCall(Ext, {Load});
+  EXPECT_EQ(revertUnprofitableConversions(*F, SlowMul), 0U);
+  EXPECT_TRUE(Enabled(Add));
+  MM.releaseContext(Context);
+}
+
+}
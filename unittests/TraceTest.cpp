@@ -0,0 +1,142 @@
+#include <cmath>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "gtest/gtest.h"
+#include "Metadata.h"
+#include "Trace.h"
+
+namespace {
+
+using namespace mdutils;
+using namespace llvm;
+using namespace taffo;
+
+
+class TraceTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  Module M;
+  Instruction *Add;
+  Instruction *Mul;
+  SmallString<128> Path;
+
+  TraceTest() : M("test", Context) {
+    Type *Ty = Type::getDoubleTy(Context);
+    Function *F = Function::Create(FunctionType::get(Ty, {Ty}, false),
+                                   GlobalValue::ExternalLinkage, "kernel", &M);
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+    Add = cast<Instruction>(B.CreateFAdd(F->getArg(0), F->getArg(0), "add"));
+    Mul = cast<Instruction>(B.CreateFMul(Add, Add, "mul"));
+    B.CreateRet(Mul);
+    sys::fs::createTemporaryFile("taffo-trace", "bin", Path);
+  }
+
+  ~TraceTest() {
+    Trace::setCurrentStage(TraceStage::Driver);
+    sys::fs::remove(Path);
+    MetadataManager::getMetadataManager().releaseContext(Context);
+  }
+
+  TraceContents read() {
+    TraceContents Contents;
+    std::string Error;
+    EXPECT_TRUE(readTrace(Path, Contents, Error)) << Error;
+    return Contents;
+  }
+};
+
+
+TEST_F(TraceTest, Disabled) {
+  EXPECT_FALSE(Trace::isEnabled(TraceStage::VRA));
+  Range R(0.0, 1.0);
+  TAFFO_TRACE(TraceStage::VRA, Add, &R, nullptr, "range");
+}
+
+TEST_F(TraceTest, Events) {
+  std::string Error;
+  ASSERT_TRUE(Trace::start(Path, {}, 1, 0, Error)) << Error;
+  EXPECT_TRUE(Trace::isEnabled(TraceStage::Conversion));
+  Range R(-2.0, 8.0);
+  FPType T(16, 10, true);
+  TAFFO_TRACE(TraceStage::VRA, Add, &R, nullptr, "range");
+  Trace::setCurrentStage(TraceStage::DTA);
+  MetadataManager::setInputInfoMetadata(*Mul, InputInfo(std::make_shared<FPType>(T), std::make_shared<Range>(R), nullptr));
+  TAFFO_TRACE(TraceStage::Driver, nullptr, nullptr, nullptr, "dta");
+  Trace::finish();
+  EXPECT_FALSE(Trace::isEnabled(TraceStage::VRA));
+
+  TraceContents C = read();
+  ASSERT_EQ(C.Events.size(), 3U);
+  const TraceEvent &E0 = C.Events[0];
+  EXPECT_EQ(E0.Stage, (uint8_t)TraceStage::VRA);
+  EXPECT_EQ(E0.ValueID, (uint64_t)(uintptr_t)Add);
+  EXPECT_EQ(C.getString(E0.Function), "kernel");
+  EXPECT_EQ(C.getString(E0.Value), "add");
+  EXPECT_EQ(C.getString(E0.Reason), "range");
+  EXPECT_DOUBLE_EQ(E0.Min, -2.0);
+  EXPECT_DOUBLE_EQ(E0.Max, 8.0);
+  EXPECT_EQ(E0.Type, TraceEvent::NoType);
+
+  const TraceEvent &E1 = C.Events[1];
+  EXPECT_EQ(E1.Stage, (uint8_t)TraceStage::DTA);
+  EXPECT_EQ(C.getString(E1.Value), "mul");
+  EXPECT_EQ(C.getString(E1.Reason), "taffo.info");
+  EXPECT_EQ(E1.Type, TraceEvent::FixedPoint);
+  EXPECT_EQ(E1.Width, -16);
+  EXPECT_EQ(E1.PointPos, 10U);
+  /* the strings are only written once */
+  EXPECT_EQ(E1.Function, E0.Function);
+
+  const TraceEvent &E2 = C.Events[2];
+  EXPECT_EQ(E2.Stage, (uint8_t)TraceStage::Driver);
+  EXPECT_EQ(E2.ValueID, 0U);
+  EXPECT_EQ(E2.Function, 0U);
+  EXPECT_TRUE(std::isnan(E2.Min));
+  EXPECT_EQ(C.getString(E2.Reason), "dta");
+}
+
+TEST_F(TraceTest, StagesAndSampling) {
+  std::string Error;
+  ASSERT_TRUE(Trace::start(Path, {TraceStage::VRA}, 3, 0, Error)) << Error;
+  EXPECT_FALSE(Trace::isEnabled(TraceStage::DTA));
+  for (int I = 0; I < 7; I++) {
+    Range R(0.0, I);
+    TAFFO_TRACE(TraceStage::VRA, Add, &R, nullptr, "range");
+    TAFFO_TRACE(TraceStage::DTA, Add, &R, nullptr, "type");
+  }
+  Trace::finish();
+
+  TraceContents C = read();
+  ASSERT_EQ(C.Events.size(), 3U);
+  EXPECT_DOUBLE_EQ(C.Events[0].Max, 0.0);
+  EXPECT_DOUBLE_EQ(C.Events[1].Max, 3.0);
+  EXPECT_DOUBLE_EQ(C.Events[2].Max, 6.0);
+}
+
+TEST_F(TraceTest, Ring) {
+  std::string Error;
+  ASSERT_TRUE(Trace::start(Path, {}, 1, 4, Error)) << Error;
+  for (int I = 0; I < 10; I++) {
+    Range R(0.0, I);
+    TAFFO_TRACE(TraceStage::VRA, Add, &R, nullptr, "range");
+  }
+  Trace::finish();
+
+  TraceContents C = read();
+  ASSERT_EQ(C.Events.size(), 4U);
+  for (unsigned I = 0; I < 4; I++)
+    EXPECT_DOUBLE_EQ(C.Events[I].Max, 6.0 + I);
+}
+
+TEST_F(TraceTest, StageNames) {
+  TraceStage Stage;
+  ASSERT_TRUE(parseTraceStage("errorprop", Stage));
+  EXPECT_EQ(Stage, TraceStage::ErrorProp);
+  EXPECT_EQ(getTraceStageName(TraceStage::Conversion), "conversion");
+  EXPECT_FALSE(parseTraceStage("err", Stage));
+}
+
+}
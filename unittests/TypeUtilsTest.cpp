@@ -0,0 +1,181 @@
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "gtest/gtest.h"
+#include "TypeUtils.h"
+
+namespace {
+
+using namespace taffo;
+using namespace mdutils;
+
+
+/* The type selection as it was before the closed form, which grew the
+ * type one increment at a time */
+FPType referenceType(double Min, double Max, FixedPointTypeGenError &Err,
+                     int TotalBits, int FracThreshold, int MaxTotalBits, int Increment)
+{
+  Err = FixedPointTypeGenError::NoError;
+  if (std::isnan(Min) || std::isnan(Max)) {
+    Err = FixedPointTypeGenError::InvalidRange;
+    return FPType(TotalBits, 0, true);
+  }
+  bool IsSigned = Min < 0;
+  if (std::isinf(Min) || std::isinf(Max)) {
+    Err = FixedPointTypeGenError::UnboundedRange;
+    return FPType(TotalBits, 0, IsSigned);
+  }
+
+  double AbsMax = std::max(std::abs(Min), std::abs(Max));
+  int IntBit = std::lround(std::ceil(std::log2(AbsMax + 1.0))) + (IsSigned ? 1 : 0);
+  int BitsAmt = TotalBits;
+  int MaxFracBitsAmt = INT_MAX;
+  if (Min == Max && FracThreshold < 0) {
+    int Exp;
+    double Mant = std::frexp(AbsMax, &Exp);
+    int NonZeroBits = 0;
+    while (Mant != 0) {
+      NonZeroBits += 1;
+      Mant = Mant * 2 - std::trunc(Mant * 2);
+    }
+    MaxFracBitsAmt = std::max(0, -Exp + NonZeroBits);
+  }
+  int FracBitsAmt = std::min(BitsAmt - IntBit, MaxFracBitsAmt);
+  int NegIntBitsAmt = std::max(0, (int)std::ceil(-std::log2(AbsMax)));
+  while ((FracBitsAmt - NegIntBitsAmt) < FracThreshold && BitsAmt < MaxTotalBits) {
+    BitsAmt += Increment;
+    FracBitsAmt = BitsAmt - IntBit;
+  }
+  if (FracBitsAmt < FracThreshold) {
+    FracBitsAmt = 0;
+    Err = IntBit > BitsAmt ? FixedPointTypeGenError::NotEnoughIntAndFracBits
+                           : FixedPointTypeGenError::NotEnoughFracBits;
+  }
+  return FPType(BitsAmt, FracBitsAmt, IsSigned);
+}
+
+
+/* Both the scalar and the batch versions must select the types of the
+ * reference loop */
+void checkMatchesReference(const std::vector<double> &Mins, const std::vector<double> &Maxs,
+                             int TotalBits, int FracThreshold, int MaxTotalBits, int Increment)
+{
+  size_t N = Mins.size();
+  std::vector<int> SWidths(N);
+  std::vector<unsigned> PointPos(N);
+  std::vector<FixedPointTypeGenError> Errs(N);
+  fixedPointTypesFromRanges(Mins, Maxs, SWidths, PointPos, Errs,
+                            TotalBits, FracThreshold, MaxTotalBits, Increment);
+  for (size_t I = 0; I < N; I++) {
+    FixedPointTypeGenError RefErr;
+    FPType Ref = referenceType(Mins[I], Maxs[I], RefErr, TotalBits, FracThreshold, MaxTotalBits, Increment);
+    FixedPointTypeGenError Err;
+    FPType T = fixedPointTypeFromRange(Range(Mins[I], Maxs[I]), &Err,
+                                       TotalBits, FracThreshold, MaxTotalBits, Increment);
+    EXPECT_EQ(T.getSWidth(), Ref.getSWidth()) << "range " << Mins[I] << ", " << Maxs[I];
+    EXPECT_EQ(T.getPointPos(), Ref.getPointPos()) << "range " << Mins[I] << ", " << Maxs[I];
+    EXPECT_EQ(Err, RefErr) << "range " << Mins[I] << ", " << Maxs[I];
+    EXPECT_EQ(SWidths[I], Ref.getSWidth()) << "range " << Mins[I] << ", " << Maxs[I];
+    EXPECT_EQ(PointPos[I], Ref.getPointPos()) << "range " << Mins[I] << ", " << Maxs[I];
+    EXPECT_EQ(Errs[I], RefErr) << "range " << Mins[I] << ", " << Maxs[I];
+  }
+}
+
+
+TEST(TypeUtilsTest, MatchesIterativeSelection) {
+  const double Inf = std::numeric_limits<double>::infinity();
+  const double NaN = std::numeric_limits<double>::quiet_NaN();
+  std::vector<double> Mins = {0.0, -1.0, -Inf, NaN, 0.125, 3.0, -1e12, 1e-9, 0.0, -0.75};
+  std::vector<double> Maxs = {1.0, 1.0, 0.0, 1.0, 0.125, 3.0, 1e12, 2e-9, 0.0, 1e30};
+  for (double E = -40.0; E <= 40.0; E += 0.37) {
+    Mins.push_back(-std::pow(2.0, E));
+    Maxs.push_back(std::pow(2.0, E / 2));
+    Mins.push_back(std::pow(2.0, E));
+    Maxs.push_back(std::pow(2.0, E));
+  }
+
+  checkMatchesReference(Mins, Maxs, 32, 3, 64, 64);
+  checkMatchesReference(Mins, Maxs, 8, 3, 64, 8);
+  checkMatchesReference(Mins, Maxs, 16, -1, 128, 16);
+  checkMatchesReference(Mins, Maxs, 32, 12, 96, 5);
+}
+
+
+TEST(TypeUtilsTest, GrowsByIncrement) {
+  FixedPointTypeGenError Err;
+  /* 8 bits leave 1 fractional bit for [-100, 100]: grown twice to 24 bits */
+  FPType T = fixedPointTypeFromRange(Range(-100.0, 100.0), &Err, 8, 12, 64, 8);
+  EXPECT_EQ(T.getSWidth(), -24);
+  EXPECT_EQ(T.getPointPos(), 16U);
+  EXPECT_EQ(Err, FixedPointTypeGenError::NoError);
+  /* the leading zero fractional bits of [0, 2^-10] do not count */
+  FPType Small = fixedPointTypeFromRange(Range(0.0, std::ldexp(1.0, -10)), &Err, 8, 3, 64, 5);
+  EXPECT_EQ(Small.getSWidth(), 18);
+  EXPECT_EQ(Small.getPointPos(), 17U);
+  /* the growth stops at the first width not below the maximum */
+  FPType Large = fixedPointTypeFromRange(Range(-1e12, 1e12), &Err, 32, 12, 48, 10);
+  EXPECT_EQ(Large.getSWidth(), -52);
+  EXPECT_EQ(Large.getPointPos(), 0U);
+  EXPECT_EQ(Err, FixedPointTypeGenError::NotEnoughFracBits);
+}
+
+
+TEST(TypeUtilsTest, BatchWithoutErrors) {
+  std::vector<double> Mins = {-2.0, 0.0};
+  std::vector<double> Maxs = {2.0, 0.5};
+  std::vector<int> SWidths(2);
+  std::vector<unsigned> PointPos(2);
+  fixedPointTypesFromRanges(Mins, Maxs, SWidths, PointPos, {});
+  EXPECT_EQ(SWidths[0], -32);
+  EXPECT_EQ(PointPos[0], 29U);
+  EXPECT_EQ(SWidths[1], 32);
+}
+
+
+
+TEST(TypeUtilsTest, LaneWidths) {
+  std::vector<int> Lanes = {8, 16, 32};
+  int Lane;
+  FixedPointTypeGenError Err;
+
+  FPType T = fixedPointTypeFromRangeForLanes(Range(0.0, 1.0), Lanes, &Err, &Lane);
+  EXPECT_EQ(Lane, 8);
+  EXPECT_EQ(T.getSWidth(), 8);
+  EXPECT_EQ(T.getPointPos(), 7U);
+  EXPECT_EQ(Err, FixedPointTypeGenError::NoError);
+
+  FPType T16 = fixedPointTypeFromRangeForLanes(Range(-1000.0, 1000.0), Lanes, &Err, &Lane);
+  EXPECT_EQ(Lane, 16);
+  EXPECT_EQ(T16.getSWidth(), -16);
+  EXPECT_EQ(T16.getPointPos(), 5U);
+
+  /* no lane is large enough, the type is the one of fixedPointTypeFromRange */
+  FPType TWide = fixedPointTypeFromRangeForLanes(Range(0.0, 1e12), Lanes, &Err, &Lane);
+  FPType Scalar = fixedPointTypeFromRange(Range(0.0, 1e12));
+  EXPECT_EQ(Lane, 0);
+  EXPECT_EQ(TWide.getSWidth(), Scalar.getSWidth());
+  EXPECT_EQ(TWide.getPointPos(), Scalar.getPointPos());
+
+  EXPECT_FALSE(vectorLaneWidthsForTarget(llvm::Triple("x86_64-pc-linux-gnu")).empty());
+}
+
+
+
+TEST(TypeUtilsTest, FloatTypeBounds) {
+  FloatType Half(FloatType::Float_half);
+  EXPECT_EQ(Half.getMaxValueBound(), 65504.0);
+  EXPECT_EQ(Half.getMinValueBound(), -65504.0);
+  EXPECT_EQ(Half.getRoundingError(), std::ldexp(1.0, -11));
+  EXPECT_EQ(Half.getRoundingError(-4.0, 2.0), std::ldexp(1.0, -9));
+  EXPECT_EQ(Half.getRoundingError(0.0, 0.0), std::ldexp(1.0, -25));
+
+  FloatType Single(FloatType::Float_float);
+  EXPECT_EQ(Single.getMaxValueBound(), (double)std::numeric_limits<float>::max());
+  FloatType BFloat(FloatType::Float_bfloat);
+  EXPECT_EQ(BFloat.getWidth(), 16U);
+  EXPECT_GT(BFloat.getMaxValueBound(), Half.getMaxValueBound());
+  EXPECT_GT(BFloat.getRoundingError(), Half.getRoundingError());
+}
+
+}